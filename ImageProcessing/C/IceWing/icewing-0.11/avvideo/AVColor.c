@@ -29,16 +29,293 @@
 #include <string.h>
 #include "AVColor.h"
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define AV_COLOR_X86
+#include <immintrin.h>
+#define AV_TARGET(t)	__attribute__((target(t)))
+#endif
+
+static int simd_cpu = -1;				/* Level supported by the CPU */
+static int simd_max = AV_COLOR_AVX2;	/* Level set by av_color_set_simd() */
+
+/*********************************************************************
+  Return the SIMD level supported by the CPU, limited by the level set
+  with av_color_set_simd().
+*********************************************************************/
+avColorSimd av_color_get_simd (void)
+{
+	if (simd_cpu < 0) {
+		int cpu = AV_COLOR_SCALAR;
+#ifdef AV_COLOR_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports ("avx2"))
+			cpu = AV_COLOR_AVX2;
+		else if (__builtin_cpu_supports ("ssse3"))
+			cpu = AV_COLOR_SSSE3;
+		else if (__builtin_cpu_supports ("sse2"))
+			cpu = AV_COLOR_SSE2;
+#endif
+		simd_cpu = cpu;
+	}
+	return MIN (simd_cpu, simd_max);
+}
+
+/*********************************************************************
+  Limit the SIMD level used by the av_color_...() functions to level,
+  e.g. AV_COLOR_SCALAR to force the plain C versions.
+*********************************************************************/
+void av_color_set_simd (avColorSimd level)
+{
+	simd_max = level;
+}
+
+#ifdef AV_COLOR_X86
+
+/*********************************************************************
+  SIMD kernels. All of them process as many pixels as possible
+  (but never more than cnt) and return the number of pixels they
+  have processed. The remaining pixels are processed by the plain C
+  code of the calling function.
+*********************************************************************/
+
+/* Packed YUYV (y==0) / UYVY (y==1) -> planar YUV, 16 pixels per step */
+static AV_TARGET("sse2") int yuyv_sse2 (guchar **data, guchar *src, int y, int cnt)
+{
+	__m128i mask = _mm_set1_epi16 (0x00FF);
+	int i;
+
+	for (i=0; i+16 <= cnt; i+=16) {
+		__m128i a = _mm_loadu_si128 ((__m128i*)(src+i*2));
+		__m128i b = _mm_loadu_si128 ((__m128i*)(src+i*2+16));
+		__m128i even = _mm_packus_epi16 (_mm_and_si128 (a, mask), _mm_and_si128 (b, mask));
+		__m128i odd = _mm_packus_epi16 (_mm_srli_epi16 (a, 8), _mm_srli_epi16 (b, 8));
+		__m128i luma = y ? odd : even;
+		__m128i uv = y ? even : odd;
+		__m128i u = _mm_and_si128 (uv, mask);
+		__m128i v = _mm_srli_epi16 (uv, 8);
+
+		_mm_storeu_si128 ((__m128i*)(data[0]+i), luma);
+		_mm_storeu_si128 ((__m128i*)(data[1]+i), _mm_or_si128 (u, _mm_slli_epi16 (u, 8)));
+		_mm_storeu_si128 ((__m128i*)(data[2]+i), _mm_or_si128 (v, _mm_slli_epi16 (v, 8)));
+	}
+	return i;
+}
+
+/* Packed YUYV (y==0) / UYVY (y==1) -> planar YUV, 32 pixels per step */
+static AV_TARGET("avx2") int yuyv_avx2 (guchar **data, guchar *src, int y, int cnt)
+{
+	__m256i mask = _mm256_set1_epi16 (0x00FF);
+	int i;
+
+	for (i=0; i+32 <= cnt; i+=32) {
+		__m256i a = _mm256_loadu_si256 ((__m256i*)(src+i*2));
+		__m256i b = _mm256_loadu_si256 ((__m256i*)(src+i*2+32));
+		/* packus works per 128 bit lane -> restore the order with permute4x64 */
+		__m256i even = _mm256_permute4x64_epi64 (
+			_mm256_packus_epi16 (_mm256_and_si256 (a, mask),
+								 _mm256_and_si256 (b, mask)), 0xD8);
+		__m256i odd = _mm256_permute4x64_epi64 (
+			_mm256_packus_epi16 (_mm256_srli_epi16 (a, 8),
+								 _mm256_srli_epi16 (b, 8)), 0xD8);
+		__m256i luma = y ? odd : even;
+		__m256i uv = y ? even : odd;
+		__m256i u = _mm256_and_si256 (uv, mask);
+		__m256i v = _mm256_srli_epi16 (uv, 8);
+
+		_mm256_storeu_si256 ((__m256i*)(data[0]+i), luma);
+		_mm256_storeu_si256 ((__m256i*)(data[1]+i), _mm256_or_si256 (u, _mm256_slli_epi16 (u, 8)));
+		_mm256_storeu_si256 ((__m256i*)(data[2]+i), _mm256_or_si256 (v, _mm256_slli_epi16 (v, 8)));
+	}
+	return i;
+}
+
+static int yuyv_simd (guchar **data, guchar *src, int y, int cnt)
+{
+	avColorSimd simd = av_color_get_simd();
+
+	if (simd >= AV_COLOR_AVX2)
+		return yuyv_avx2 (data, src, y, cnt);
+	else if (simd >= AV_COLOR_SSE2)
+		return yuyv_sse2 (data, src, y, cnt);
+	return 0;
+}
+
+/* dst[2*i] = dst[2*i+1] = src[i], 16 source values per step */
+static AV_TARGET("sse2") int upsample2_sse2 (guchar *dst, const guchar *src, int cnt)
+{
+	int i;
+
+	for (i=0; i+16 <= cnt; i+=16) {
+		__m128i s = _mm_loadu_si128 ((__m128i*)(src+i));
+		_mm_storeu_si128 ((__m128i*)(dst+2*i), _mm_unpacklo_epi8 (s, s));
+		_mm_storeu_si128 ((__m128i*)(dst+2*i+16), _mm_unpackhi_epi8 (s, s));
+	}
+	return i;
+}
+
+/* dst[2*i] = dst[2*i+1] = src[i], 32 source values per step */
+static AV_TARGET("avx2") int upsample2_avx2 (guchar *dst, const guchar *src, int cnt)
+{
+	int i;
+
+	for (i=0; i+32 <= cnt; i+=32) {
+		__m256i s = _mm256_permute4x64_epi64 (
+			_mm256_loadu_si256 ((__m256i*)(src+i)), 0xD8);
+		_mm256_storeu_si256 ((__m256i*)(dst+2*i), _mm256_unpacklo_epi8 (s, s));
+		_mm256_storeu_si256 ((__m256i*)(dst+2*i+32), _mm256_unpackhi_epi8 (s, s));
+	}
+	return i;
+}
+
+static int upsample2_simd (guchar *dst, const guchar *src, int cnt)
+{
+	avColorSimd simd = av_color_get_simd();
+
+	if (simd >= AV_COLOR_AVX2)
+		return upsample2_avx2 (dst, src, cnt);
+	else if (simd >= AV_COLOR_SSE2)
+		return upsample2_sse2 (dst, src, cnt);
+	return 0;
+}
+
+/* Packed 24 bit -> 3 planes, 16 pixels per step */
+static AV_TARGET("ssse3") int rgb24_ssse3 (guchar **p, guchar *src, int cnt)
+{
+	guchar shuf[3][3][16];
+	__m128i mask[3][3];
+	int i, j, k;
+
+	/* mask[k][l]: Collect byte k of the 16 pixels from load l (src+16*l) */
+	for (k=0; k<3; k++) {
+		memset (shuf[k], 0x80, sizeof(shuf[k]));
+		for (j=0; j<16; j++) {
+			int n = 3*j+k;
+			shuf[k][n/16][j] = n%16;
+		}
+		for (j=0; j<3; j++)
+			mask[k][j] = _mm_loadu_si128 ((__m128i*)shuf[k][j]);
+	}
+
+	for (i=0; i+16 <= cnt; i+=16) {
+		__m128i a = _mm_loadu_si128 ((__m128i*)(src+i*3));
+		__m128i b = _mm_loadu_si128 ((__m128i*)(src+i*3+16));
+		__m128i c = _mm_loadu_si128 ((__m128i*)(src+i*3+32));
+
+		for (k=0; k<3; k++)
+			_mm_storeu_si128 ((__m128i*)(p[k]+i),
+							  _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (a, mask[k][0]),
+														  _mm_shuffle_epi8 (b, mask[k][1])),
+											_mm_shuffle_epi8 (c, mask[k][2])));
+	}
+	return i;
+}
+
+/* Packed 32 bit -> planes, byte k of a pixel is stored in p[k]
+   (if p[k]!=NULL), 16 pixels per step */
+static AV_TARGET("sse2") int rgb32_sse2 (guchar **p, guchar *src, int cnt)
+{
+	__m128i mask = _mm_set1_epi32 (0xFF);
+	int i, k;
+
+	for (i=0; i+16 <= cnt; i+=16) {
+		__m128i s0 = _mm_loadu_si128 ((__m128i*)(src+i*4));
+		__m128i s1 = _mm_loadu_si128 ((__m128i*)(src+i*4+16));
+		__m128i s2 = _mm_loadu_si128 ((__m128i*)(src+i*4+32));
+		__m128i s3 = _mm_loadu_si128 ((__m128i*)(src+i*4+48));
+
+		for (k=0; k<4; k++) {
+			__m128i sh = _mm_cvtsi32_si128 (k*8);
+			if (!p[k]) continue;
+			_mm_storeu_si128 ((__m128i*)(p[k]+i), _mm_packus_epi16 (
+				_mm_packs_epi32 (_mm_and_si128 (_mm_srl_epi32 (s0, sh), mask),
+								 _mm_and_si128 (_mm_srl_epi32 (s1, sh), mask)),
+				_mm_packs_epi32 (_mm_and_si128 (_mm_srl_epi32 (s2, sh), mask),
+								 _mm_and_si128 (_mm_srl_epi32 (s3, sh), mask))));
+		}
+	}
+	return i;
+}
+
+/* Packed 32 bit -> planes, byte k of a pixel is stored in p[k]
+   (if p[k]!=NULL), 32 pixels per step */
+static AV_TARGET("avx2") int rgb32_avx2 (guchar **p, guchar *src, int cnt)
+{
+	__m256i mask = _mm256_set1_epi32 (0xFF);
+	/* Undo the per 128 bit lane interleaving of the pack instructions */
+	__m256i perm = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+	int i, k;
+
+	for (i=0; i+32 <= cnt; i+=32) {
+		__m256i s0 = _mm256_loadu_si256 ((__m256i*)(src+i*4));
+		__m256i s1 = _mm256_loadu_si256 ((__m256i*)(src+i*4+32));
+		__m256i s2 = _mm256_loadu_si256 ((__m256i*)(src+i*4+64));
+		__m256i s3 = _mm256_loadu_si256 ((__m256i*)(src+i*4+96));
+
+		for (k=0; k<4; k++) {
+			__m128i sh = _mm_cvtsi32_si128 (k*8);
+			__m256i v;
+			if (!p[k]) continue;
+			v = _mm256_packus_epi16 (
+				_mm256_packs_epi32 (_mm256_and_si256 (_mm256_srl_epi32 (s0, sh), mask),
+									_mm256_and_si256 (_mm256_srl_epi32 (s1, sh), mask)),
+				_mm256_packs_epi32 (_mm256_and_si256 (_mm256_srl_epi32 (s2, sh), mask),
+									_mm256_and_si256 (_mm256_srl_epi32 (s3, sh), mask)));
+			_mm256_storeu_si256 ((__m256i*)(p[k]+i),
+								 _mm256_permutevar8x32_epi32 (v, perm));
+		}
+	}
+	return i;
+}
+
+static int rgb32_simd (guchar **p, guchar *src, int cnt)
+{
+	avColorSimd simd = av_color_get_simd();
+
+	if (simd >= AV_COLOR_AVX2)
+		return rgb32_avx2 (p, src, cnt);
+	else if (simd >= AV_COLOR_SSE2)
+		return rgb32_sse2 (p, src, cnt);
+	return 0;
+}
+
+/* 12 bit packed -> 16 bit, 8 pixels per step */
+static AV_TARGET("ssse3") int mono12_ssse3 (guchar *dst, guchar *src, int cnt)
+{
+	/* Every 16 bit lane gets the bytes (b1,b0) or (b1,b2) of a
+	   3 byte group b0 b1 b2 */
+	__m128i shuf = _mm_setr_epi8 (1, 0, 1, 2, 4, 3, 4, 5,
+								  7, 6, 7, 8, 10, 9, 10, 11);
+	__m128i mhigh = _mm_setr_epi16 (-1, 0x0FF0, -1, 0x0FF0, -1, 0x0FF0, -1, 0x0FF0);
+	__m128i mlow = _mm_setr_epi16 (0, 0x000F, 0, 0x000F, 0, 0x000F, 0, 0x000F);
+	int i;
+
+	/* 12 bytes are used per step, but 16 are loaded
+	   -> stop early enough to stay inside of src */
+	for (i=0; i+16 <= cnt; i+=8) {
+		__m128i w = _mm_shuffle_epi8 (_mm_loadu_si128 ((__m128i*)(src+i/2*3)), shuf);
+		__m128i v = _mm_or_si128 (_mm_and_si128 (_mm_srli_epi16 (w, 4), mhigh),
+								  _mm_and_si128 (w, mlow));
+		_mm_storeu_si128 ((__m128i*)(dst+i*2), v);
+	}
+	return i;
+}
+
+#endif /* AV_COLOR_X86 */
+
 /*********************************************************************
   V4L2_PIX_FMT_YUYV / V4L2_PIX_FMT_UYVY: Packed Y(0) U(0,1) Y(1) V(0,1) Y(2) ...
 *********************************************************************/
 void av_color_yuyv (iwImage *dst, guchar *src, int y)
 {
 	guchar **data = dst->data;
-	int i, cnt, pos;
+	int i = 0, cnt, pos;
 
 	cnt = dst->width*dst->height;
-	for (i=0; i<cnt; i+=2) {
+#ifdef AV_COLOR_X86
+	i = yuyv_simd (data, src, y, cnt);
+#endif
+	for (; i<cnt; i+=2) {
 		pos = i*2;
 
 		data[0][i] = src[pos+y];
@@ -114,34 +391,33 @@ void av_color_uyyvyy (iwImage *dst, guchar *src)
 void av_color_yuv420 (iwImage *dst, guchar *src, int u)
 {
 	guchar *plane, value;
-	int i, w, cnt, pos;
+	int i, p, x, y, w, h, cnt;
 
 	w = dst->width;
-	cnt = w*dst->height;
+	h = dst->height;
+	cnt = w*h;
 
 	memcpy (dst->data[0], src, cnt * sizeof(guchar));
 	src += cnt;
 
-	cnt = (w/2)*(dst->height/2);
-	plane = dst->data[u];
-	for (i=0; i<cnt; i++) {
-		value = src[i];
-		pos = (i/(w/2))*w + 2*i;
-		plane[pos] = value;
-		plane[pos+1] = value;
-		plane[pos+w] = value;
-		plane[pos+w+1] = value;
-	}
-	src += cnt;
-
-	plane = dst->data[3-u];
-	for (i=0; i<cnt; i++) {
-		value = src[i];
-		pos = (i/(w/2))*w + 2*i;
-		plane[pos] = value;
-		plane[pos+1] = value;
-		plane[pos+w] = value;
-		plane[pos+w+1] = value;
+	for (p=0; p<2; p++) {
+		plane = dst->data[p ? 3-u : u];
+		for (y=0; y<h/2; y++) {
+			x = 0;
+#ifdef AV_COLOR_X86
+			x = upsample2_simd (plane, src, w/2);
+#endif
+			for (; x<w/2; x++) {
+				value = src[x];
+				plane[2*x] = value;
+				plane[2*x+1] = value;
+			}
+			/* Duplicate the just upsampled line */
+			for (i=0; i<2*(w/2); i++)
+				plane[w+i] = plane[i];
+			src += w/2;
+			plane += 2*w;
+		}
 	}
 }
 
@@ -159,16 +435,24 @@ void av_color_yuv422P (iwImage *dst, guchar *src)
 	src += cnt;
 
 	cnt = (dst->width/2)*dst->height;
-	pos = 0;
-	for (i=0; i<cnt; i++) {
+	i = 0;
+#ifdef AV_COLOR_X86
+	i = upsample2_simd (data[1], src, cnt);
+#endif
+	pos = 2*i;
+	for (; i<cnt; i++) {
 		value = src[i];
 		data[1][pos++] = value;
 		data[1][pos++] = value;
 	}
 	src += cnt;
 
-	pos = 0;
-	for (i=0; i<cnt; i++) {
+	i = 0;
+#ifdef AV_COLOR_X86
+	i = upsample2_simd (data[2], src, cnt);
+#endif
+	pos = 2*i;
+	for (; i<cnt; i++) {
 		value = src[i];
 		data[2][pos++] = value;
 		data[2][pos++] = value;
@@ -398,11 +682,20 @@ void av_color_rgb24 (iwImage *dst, guchar *src, int r, int g, int b)
 	guchar *rPlane = dst->data[r];
 	guchar *gPlane = dst->data[g];
 	guchar *bPlane = dst->data[b];
-	int i, cnt, pos;
+	int i = 0, cnt, pos;
 
 	cnt = dst->width*dst->height;
-	pos = 0;
-	for (i=0; i<cnt; i++) {
+#ifdef AV_COLOR_X86
+	if (av_color_get_simd() >= AV_COLOR_SSSE3) {
+		guchar *p[3];
+		p[0] = rPlane;
+		p[1] = gPlane;
+		p[2] = bPlane;
+		i = rgb24_ssse3 (p, src, cnt);
+	}
+#endif
+	pos = i*3;
+	for (; i<cnt; i++) {
 		rPlane[i] = src[pos++];
 		gPlane[i] = src[pos++];
 		bPlane[i] = src[pos++];
@@ -433,11 +726,21 @@ void av_color_rgb24_10 (iwImage *dst, guchar *src)
 void av_color_rgb32 (iwImage *dst, guchar *src)
 {
 	guchar **data = dst->data;
-	int i, cnt, pos;
+	int i = 0, cnt, pos;
 
 	cnt = dst->width*dst->height;
-	pos = 0;
-	for (i=0; i<cnt; i++) {
+#ifdef AV_COLOR_X86
+	{
+		guchar *p[4];
+		p[0] = NULL;
+		p[1] = data[0];
+		p[2] = data[1];
+		p[3] = data[2];
+		i = rgb32_simd (p, src, cnt);
+	}
+#endif
+	pos = i*4;
+	for (; i<cnt; i++) {
 		data[0][i] = src[pos+1];
 		data[1][i] = src[pos+2];
 		data[2][i] = src[pos+3];
@@ -451,11 +754,21 @@ void av_color_rgb32 (iwImage *dst, guchar *src)
 void av_color_bgr32 (iwImage *dst, guchar *src)
 {
 	guchar **data = dst->data;
-	int i, cnt, pos;
+	int i = 0, cnt, pos;
 
 	cnt = dst->width*dst->height;
-	pos = 0;
-	for (i=0; i<cnt; i++) {
+#ifdef AV_COLOR_X86
+	{
+		guchar *p[4];
+		p[0] = data[2];
+		p[1] = data[1];
+		p[2] = data[0];
+		p[3] = NULL;
+		i = rgb32_simd (p, src, cnt);
+	}
+#endif
+	pos = i*4;
+	for (; i<cnt; i++) {
 		data[2][i] = src[pos];
 		data[1][i] = src[pos+1];
 		data[0][i] = src[pos+2];
@@ -545,8 +858,14 @@ void av_color_rgb24P_16 (iwImage *dst, guchar *src)
 *********************************************************************/
 void av_color_mono12 (guchar *dst, guchar *src, int cnt)
 {
-	int i;
-	for (i=0; i<cnt; i+=2) {
+	int i = 0;
+#ifdef AV_COLOR_X86
+	if (av_color_get_simd() >= AV_COLOR_SSSE3) {
+		i = mono12_ssse3 (dst, src, cnt);
+		src += i/2*3;
+	}
+#endif
+	for (; i<cnt; i+=2) {
 		((guint16*)dst)[i] = (src[0] << 4) + (src[1] >> 4);
 		((guint16*)dst)[i+1] = (src[1] & 0xF) + (src[2] << 4);
 		src += 3;
@@ -30,10 +30,30 @@
 #include "tools/tools.h"
 #include "gui/Gimage.h"
 
+/* SIMD instruction sets used by the av_color_...() functions */
+typedef enum {
+	AV_COLOR_SCALAR,	/* Plain C code only */
+	AV_COLOR_SSE2,
+	AV_COLOR_SSSE3,
+	AV_COLOR_AVX2
+} avColorSimd;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*********************************************************************
+  Return the SIMD level supported by the CPU, limited by the level set
+  with av_color_set_simd().
+*********************************************************************/
+avColorSimd av_color_get_simd (void);
+
+/*********************************************************************
+  Limit the SIMD level used by the av_color_...() functions to level,
+  e.g. AV_COLOR_SCALAR to force the plain C versions.
+*********************************************************************/
+void av_color_set_simd (avColorSimd level);
+
 /*********************************************************************
   Convert the data from src to YUV and save it in dst->data.
 *********************************************************************/
@@ -29,6 +29,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #ifdef WITH_GPB
 #include <gdk-pixbuf/gdk-pixbuf.h>
@@ -48,6 +53,13 @@
 
 #include <setjmp.h>
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define GIMAGE_SSE2
+#include <emmintrin.h>
+#define GIMAGE_TARGET(t)	__attribute__((target(t)))
+#endif
+
 /* ATTENTION: Must be dividable by 3*8 */
 #define BUF_SIZE 3000
 
@@ -72,6 +84,8 @@ char *iwImgFormatText[] = {
 	"AVI MJPEG (Movie)",
 	"AVI FFV1 (Movie)",
 	"AVI MPEG4 (Movie)",
+	"IWR Raw (Movie)",
+	"IWR LZ4 (Movie)",
 	"SVG (Vector)",
 	NULL
 };
@@ -85,6 +99,8 @@ char *iwImgFormatTextBM[] = {
 	"AVI MJPEG (Movie)",
 	"AVI FFV1 (Movie)",
 	"AVI MPEG4 (Movie)",
+	"IWR Raw (Movie)",
+	"IWR LZ4 (Movie)",
 	NULL
 };
 
@@ -905,90 +921,276 @@ iwImgStatus img_save_interleaved_raw (const guchar *data, int width, int height,
 }
 #endif
 
-static void skip_comments (FILE *fp)
+/* A file mapped into memory by ppm_map() */
+typedef struct ppmFile {
+	const guchar *data;		/* File contents */
+	size_t size;
+	gboolean mapped;		/* data is mmap()ed and not malloc()ed */
+	const guchar *pos;		/* Current read position */
+} ppmFile;
+
+/*********************************************************************
+  Map the file fname read-only into memory. If this is not possible
+  (e.g. for pipes), the file is read into an allocated buffer.
+  Return: TRUE on success.
+*********************************************************************/
+static gboolean ppm_map (const char *fname, ppmFile *f, iwImgStatus *status)
 {
-	char ch;
+	struct stat st;
+	int fd;
+
+	memset (f, 0, sizeof(ppmFile));
+	if ((fd = open (fname, O_RDONLY)) < 0) {
+		if (status) *status = IW_IMG_STATUS_OPEN;
+		return FALSE;
+	}
+	if (fstat (fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise (data, st.st_size, MADV_SEQUENTIAL);
+#endif
+			f->data = data;
+			f->size = st.st_size;
+			f->mapped = TRUE;
+		}
+	}
+	if (!f->data) {
+		size_t max = 0;
+		ssize_t cnt;
+		guchar *data = NULL;
+
+		do {
+			if (f->size >= max) {
+				max = max ? max*2 : 64*1024;
+				data = realloc (data, max);
+			}
+			cnt = read (fd, data + f->size, max - f->size);
+			if (cnt > 0) f->size += cnt;
+		} while (cnt > 0);
+		f->data = data;
+	}
+	close (fd);
+	f->pos = f->data;
+
+	if (!f->data || f->size == 0) {
+		if (f->data) free ((void*)f->data);
+		f->data = NULL;
+		if (status) *status = IW_IMG_STATUS_READ;
+		return FALSE;
+	}
+	return TRUE;
+}
 
-	do {
-		while (isspace((int)(ch=getc(fp))));
-		if (ch == '#') {
-			while ((ch=getc(fp)) != '\n' && ch != EOF);
-			if (ch == EOF) break;
+static void ppm_unmap (ppmFile *f)
+{
+	if (!f->data) return;
+	if (f->mapped)
+		munmap ((void*)f->data, f->size);
+	else
+		free ((void*)f->data);
+	f->data = NULL;
+}
+
+static size_t ppm_left (ppmFile *f)
+{
+	return f->data + f->size - f->pos;
+}
+
+static void ppm_skip_comments (ppmFile *f)
+{
+	const guchar *end = f->data + f->size;
+
+	while (f->pos < end) {
+		while (f->pos < end && isspace((int)*f->pos)) f->pos++;
+		if (f->pos < end && *f->pos == '#') {
+			while (f->pos < end && *f->pos != '\n') f->pos++;
 		} else
 			break;
-	} while (1);
-	ungetc (ch,fp);
+	}
 }
 
-static gboolean read_val (FILE *file, char *buffer, int *bufpos, int *bufcnt, int *val)
+/*********************************************************************
+  Read a header value like fscanf("%d") and return TRUE on success.
+*********************************************************************/
+static gboolean ppm_read_int (ppmFile *f, int *val)
 {
-#define FILL	if (pos >= *bufcnt) { \
-					if ((*bufcnt = fread (buffer, 1, BUF_SIZE, file)) <= 0) { \
-						*val = sign*v; \
-						return FALSE; \
-					} \
-					pos = 0; \
-				}
-	int v = 0, sign = 1, pos = *bufpos;
-
-	do {
-		pos++;
-		FILL;
-		if (buffer[pos] == '-')
-			sign = -sign;
-	} while (buffer[pos] < '0' || buffer[pos] > '9');
-	do {
-		v = v*10 + buffer[pos] - '0';
-		pos++;
-		FILL;
-	} while (buffer[pos] >= '0' && buffer[pos] <= '9');
-	*bufpos = pos;
+	const guchar *end = f->data + f->size;
+	int v = 0, sign = 1;
+
+	while (f->pos < end && isspace((int)*f->pos)) f->pos++;
+	if (f->pos < end && (*f->pos == '-' || *f->pos == '+')) {
+		if (*f->pos == '-') sign = -1;
+		f->pos++;
+	}
+	if (f->pos >= end || !isdigit((int)*f->pos)) return FALSE;
+	while (f->pos < end && isdigit((int)*f->pos))
+		v = v*10 + *f->pos++ - '0';
 	*val = sign*v;
+	return TRUE;
+}
 
+/*********************************************************************
+  Read a header word like fscanf("%s") with a max. length of len-1.
+*********************************************************************/
+static void ppm_read_word (ppmFile *f, char *word, int len)
+{
+	const guchar *end = f->data + f->size;
+
+	while (f->pos < end && isspace((int)*f->pos)) f->pos++;
+	while (f->pos < end && !isspace((int)*f->pos) && len > 1) {
+		*word++ = *f->pos++;
+		len--;
+	}
+	*word = '\0';
+}
+
+/*********************************************************************
+  Read the next ASCII value of the image data. Everything before the
+  value is skipped, every '-' in there changes the sign.
+*********************************************************************/
+static inline gboolean ppm_read_val (ppmFile *f, int *val)
+{
+	const guchar *p = f->pos, *end = f->data + f->size;
+	unsigned int d;
+	int v, sign = 1;
+
+	while (p < end && (d = *p - '0') > 9) {
+		if (*p == '-') sign = -sign;
+		p++;
+	}
+	if (p >= end) return FALSE;
+
+	v = d;
+	while (++p < end && (d = *p - '0') <= 9)
+		v = v*10 + d;
+	f->pos = p;
+	*val = sign*v;
 	return TRUE;
-#undef FILL
+}
+
+#ifdef GIMAGE_SSE2
+static gboolean ppm_simd (void)
+{
+	static int simd = -1;
+	if (simd < 0) {
+		__builtin_cpu_init();
+		simd = __builtin_cpu_supports ("sse2") ? 1 : 0;
+	}
+	return simd;
+}
+
+/*********************************************************************
+  Split cnt pixels of three interleaved 8 bit planes from s into d[]
+  in blocks of 16 pixels. Return the number of processed pixels.
+*********************************************************************/
+static GIMAGE_TARGET("sse2") int ppm_deinterleave3_sse2 (const guchar *s, guchar **d, int cnt)
+{
+	int i;
+
+	for (i=0; i+16 <= cnt; i+=16, s+=48) {
+		__m128i t00 = _mm_loadu_si128 ((const __m128i*)s);
+		__m128i t01 = _mm_loadu_si128 ((const __m128i*)(s+16));
+		__m128i t02 = _mm_loadu_si128 ((const __m128i*)(s+32));
+
+		__m128i t10 = _mm_unpacklo_epi8 (t00, _mm_unpackhi_epi64 (t01, t01));
+		__m128i t11 = _mm_unpacklo_epi8 (_mm_unpackhi_epi64 (t00, t00), t02);
+		__m128i t12 = _mm_unpacklo_epi8 (t01, _mm_unpackhi_epi64 (t02, t02));
+
+		__m128i t20 = _mm_unpacklo_epi8 (t10, _mm_unpackhi_epi64 (t11, t11));
+		__m128i t21 = _mm_unpacklo_epi8 (_mm_unpackhi_epi64 (t10, t10), t12);
+		__m128i t22 = _mm_unpacklo_epi8 (t11, _mm_unpackhi_epi64 (t12, t12));
+
+		__m128i t30 = _mm_unpacklo_epi8 (t20, _mm_unpackhi_epi64 (t21, t21));
+		__m128i t31 = _mm_unpacklo_epi8 (_mm_unpackhi_epi64 (t20, t20), t22);
+		__m128i t32 = _mm_unpacklo_epi8 (t21, _mm_unpackhi_epi64 (t22, t22));
+
+		_mm_storeu_si128 ((__m128i*)(d[0]+i),
+						  _mm_unpacklo_epi8 (t30, _mm_unpackhi_epi64 (t31, t31)));
+		_mm_storeu_si128 ((__m128i*)(d[1]+i),
+						  _mm_unpacklo_epi8 (_mm_unpackhi_epi64 (t30, t30), t32));
+		_mm_storeu_si128 ((__m128i*)(d[2]+i),
+						  _mm_unpacklo_epi8 (t31, _mm_unpackhi_epi64 (t32, t32)));
+	}
+	return i;
+}
+#endif
+
+/*********************************************************************
+  Split cnt pixels of 'planes' interleaved 8 bit planes from s into
+  the planes d[].
+*********************************************************************/
+static void ppm_deinterleave_8u (const guchar *s, guchar **d, int planes, int cnt)
+{
+	int i = 0, p;
+
+#ifdef GIMAGE_SSE2
+	if (planes == 3 && ppm_simd()) {
+		i = ppm_deinterleave3_sse2 (s, d, cnt);
+		s += i*3;
+	}
+#endif
+	if (planes == 3) {
+		guchar *d0 = d[0], *d1 = d[1], *d2 = d[2];
+		for (; i<cnt; i++) {
+			d0[i] = *s++;
+			d1[i] = *s++;
+			d2[i] = *s++;
+		}
+	} else {
+		for (; i<cnt; i++)
+			for (p=0; p<planes; p++)
+				d[p][i] = *s++;
+	}
 }
 
 /*********************************************************************
   Native loader for ppm images. Loads an image of type P1 to P6 and PI
   from file fname and stores it in img. img is newly allocated without
   freeing it before.
+  The file is mapped into memory, so the binary formats are copied
+  (and, if needed, split into planes) directly from the page cache.
 *********************************************************************/
 static iwImage* img_load_ppm (const char *fname, gboolean interleaved, iwImgStatus *status)
 {
-	FILE *file = NULL;
-	char buffer[BUF_SIZE], type[100] = "";
+	ppmFile file;
+	char type[100] = "";
 	int width = 0, height = 0, planes = 0;
-	int count, i, p;
+	int count, i, p, pos, val;
 	int ftype;
 	iwImage *img = NULL;
 	gboolean swap;
 
-	if (!(file = fopen(fname, "rb"))) {
-		if (status) *status = IW_IMG_STATUS_OPEN;
+	if (status) *status = IW_IMG_STATUS_ERR;
+	if (!ppm_map (fname, &file, status))
 		return NULL;
-	}
 
-	skip_comments (file);
+	ppm_skip_comments (&file);
 
-	if (!fgets(buffer, 1000, file) ||
-		buffer[0]!='P' ||
-		(buffer[1]!='1' && buffer[1]!='2' && buffer[1]!='3' &&
-		 buffer[1]!='4' && buffer[1]!='5' && buffer[1]!='6' && buffer[1]!='I') ||
-		(buffer[2]!='\0' && buffer[2]!='\n')) {
+	if (ppm_left(&file) < 2 ||
+		file.pos[0]!='P' ||
+		(file.pos[1]!='1' && file.pos[1]!='2' && file.pos[1]!='3' &&
+		 file.pos[1]!='4' && file.pos[1]!='5' && file.pos[1]!='6' && file.pos[1]!='I') ||
+		(ppm_left(&file) > 2 && file.pos[2]!='\n')) {
 		if (status) *status = IW_IMG_STATUS_ERR;
 		goto cleanup;
 	}
-	ftype = buffer[1] - '0';
+	ftype = file.pos[1] - '0';
+	file.pos += 2;
 
 	if (!(img = iw_img_new ())) {
 		if (status) *status = IW_IMG_STATUS_MEM;
 		goto cleanup;
 	}
 
-	skip_comments (file);
-	if (buffer[1] == 'I') {
-		fscanf (file, "%d%d%d%s", &width, &height, &planes, type);
+	ppm_skip_comments (&file);
+	if (ftype == 'I'-'0') {
+		if (!ppm_read_int (&file, &width) || !ppm_read_int (&file, &height) ||
+			!ppm_read_int (&file, &planes)) {
+			if (status) *status = IW_IMG_STATUS_ERR;
+			goto cleanup;
+		}
+		ppm_read_word (&file, type, sizeof(type));
 		for (i=0; imgTypeText[i]; i++) {
 			if (!strcmp (type, imgTypeText[i])) {
 				img->type = i;
@@ -1000,18 +1202,21 @@ static iwImage* img_load_ppm (const char *fname, gboolean interleaved, iwImgStat
 			goto cleanup;
 		}
 
-		skip_comments (file);
-		fscanf (file, "%d", &count);
+		ppm_skip_comments (&file);
+		ppm_read_int (&file, &count);
 	} else {
 		if (ftype == 3 || ftype == 6)
 			planes = 3;
 		else
 			planes = 1;
-		fscanf (file, "%d%d", &width, &height);
+		if (!ppm_read_int (&file, &width) || !ppm_read_int (&file, &height)) {
+			if (status) *status = IW_IMG_STATUS_ERR;
+			goto cleanup;
+		}
 
 		if (ftype != 1 && ftype != 4) {
-			skip_comments (file);
-			fscanf (file, "%d", &count);
+			ppm_skip_comments (&file);
+			ppm_read_int (&file, &count);
 		} else
 			count = 1;
 		if (count > 65535) {
@@ -1037,111 +1242,53 @@ static iwImage* img_load_ppm (const char *fname, gboolean interleaved, iwImgStat
 	}
 	/*
 	iw_debug (4, "File: '%s', Type: '%c', Size: %d x %d in %d maxvalues",
-			  fname, buffer[1], width, height, count);
+			  fname, ftype+'0', width, height, count);
 	*/
-	fgetc (file);		/* Skip remaining newline */
+	if (ppm_left(&file) > 0)
+		file.pos++;		/* Skip remaining newline */
 
 	if (status) *status = IW_IMG_STATUS_READ;
 
+	count = width * height;
 	if (ftype == 1 ||  ftype == 2 ||  ftype == 3) {
 		/* Plain ASCII format */
-		int pos = 0, bufpos = -1, bufcnt = 0, val;
-
-		count = width * height;
-		if (planes > 1) {
-			while (count--) {
-				if (interleaved) {
-					switch (img->type) {
-						case IW_8U:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								img->data[0][pos++] = val;
-							}
-							break;
-						case IW_16U:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								((guint16**)img->data)[0][pos++] = val;
-							}
-							break;
-						case IW_32S:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								((gint32**)img->data)[0][pos++] = val;
-							}
-							break;
-						default:
-							break;
-					}
-				} else {
-					switch (img->type) {
-						case IW_8U:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								img->data[p][pos] = val;
-							}
-							break;
-						case IW_16U:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								((guint16**)img->data)[p][pos] = val;
-							}
-							break;
-						case IW_32S:
-							for (p = 0; p<planes; p++) {
-								if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-									goto cleanup;
-								((gint32**)img->data)[p][pos] = val;
-							}
-							break;
-						default:
-							break;
-					}
-					pos++;
-				}
-			}
-		} else {
-			while (count--) {
-				if (!read_val(file, buffer, &bufpos, &bufcnt, &val))
-					goto cleanup;
-				if (ftype == 1) {
-					if (val == 0)
-						val = 255;
-					else if (val == 1)
-						val = 0;
-				}
-				switch (img->type) {
-					case IW_8U:
-						img->data[0][pos] = val;
-						break;
-					case IW_16U:
-						((guint16**)img->data)[0][pos] = val;
-						break;
-					case IW_32S:
-						((gint32**)img->data)[0][pos] = val;
-						break;
-					default:
-						break;
-				}
-				pos++;
-			}
+#define PPM_ASCII(type) \
+		for (pos=0; pos<count; pos++) { \
+			for (p=0; p<planes; p++) { \
+				if (!ppm_read_val (&file, &val)) \
+					goto cleanup; \
+				if (ftype == 1) \
+					val = val == 0 ? 255 : (val == 1 ? 0 : val); \
+				if (interleaved) \
+					((type**)img->data)[0][pos*planes+p] = val; \
+				else \
+					((type**)img->data)[p][pos] = val; \
+			} \
 		}
+		switch (img->type) {
+			case IW_8U:
+				PPM_ASCII(guchar);
+				break;
+			case IW_16U:
+				PPM_ASCII(guint16);
+				break;
+			case IW_32S:
+				PPM_ASCII(gint32);
+				break;
+			default:
+				break;
+		}
+#undef PPM_ASCII
 	} else if (ftype == 4) {
 		/* RAW BITMAP format */
-		int bit, x, y, count = (width+7)/8;
-		guchar *line = malloc (count);
+		int bit, x, y, bytes = (width+7)/8;
+		const guchar *line;
 
+		if (ppm_left(&file) < (size_t)bytes*height)
+			goto cleanup;
 		x = 0;
 		for (y=0; y<height; y++) {
-			if (fread (line, 1, count, file) != count) {
-				free (line);
-				goto cleanup;
-			}
+			line = file.pos + y*bytes;
 			for (i=0; i<width/8; i++) {
 				for (bit=128; bit>0; bit/=2) {
 					if (line[i] & bit)
@@ -1152,81 +1299,66 @@ static iwImage* img_load_ppm (const char *fname, gboolean interleaved, iwImgStat
 			}
 			bit = 128;
 			for (i=width%8; i>0; i--) {
-				if (line[count-1] & bit)
+				if (line[bytes-1] & bit)
 					img->data[0][x++] = 0;
 				else
 					img->data[0][x++] = 255;
 				bit /= 2;
 			}
 		}
-		free (line);
 	} else {
 		/* RAW BINARY format */
-		count = width * height * planes * IW_TYPE_SIZE(img);
-		swap = IW_TYPE_SIZE(img) > 1 && G_BYTE_ORDER != G_BIG_ENDIAN;
+		int size = IW_TYPE_SIZE(img);
+		size_t bytes = (size_t)count * planes * size;
 
-		if (!interleaved && planes > 1) {
-			int pos = 0, read;
+		if (ppm_left(&file) < bytes)
+			goto cleanup;
+		swap = size > 1 && G_BYTE_ORDER != G_BIG_ENDIAN;
 
-			while (count > 0) {
-				i = BUF_SIZE - BUF_SIZE % (IW_TYPE_SIZE(img)*planes);
-				read = fread (buffer, 1, i, file);
-				if (read != i && read < count)
-					goto cleanup;
-				if (read > count) read = count;
-				count -= read;
-				swap_buffer ((guchar*)buffer, (guchar*)buffer, read, img->type, swap);
-				i = 0;
-				read /= IW_TYPE_SIZE(img)*planes;
+		if (interleaved || planes == 1) {
+			memcpy (img->data[0], file.pos, bytes);
+			swap_buffer (img->data[0], img->data[0], bytes, img->type, swap);
+		} else if (img->type == IW_8U) {
+			ppm_deinterleave_8u (file.pos, img->data, planes, count);
+		} else {
+			/* Copy line by line to get aligned and swapped data */
+			guchar *line = malloc (width*planes*size);
+			int x, y;
+
+#define PPM_SPLIT(type) \
+			for (x=0; x<width; x++) \
+				for (p=0; p<planes; p++) \
+					((type**)img->data)[p][pos+x] = ((type*)line)[x*planes+p];
+
+			for (y=0, pos=0; y<height; y++, pos+=width) {
+				memcpy (line, file.pos + (size_t)pos*planes*size, width*planes*size);
+				swap_buffer (line, line, width*planes*size, img->type, swap);
 				switch (img->type) {
-					case IW_8U:
-						for (; read > 0; read--) {
-							for (p = 0; p<planes; p++)
-								img->data[p][pos] = buffer[i++];
-							pos++;
-						}
-						break;
 					case IW_16U:
-						for (; read>0; read--) {
-							for (p = 0; p<planes; p++)
-								((guint16**)img->data)[p][pos] = ((guint16*)buffer)[i++];
-							pos++;
-						}
+						PPM_SPLIT(guint16);
 						break;
 					case IW_32S:
-						for (; read>0; read--) {
-							for (p = 0; p<planes; p++)
-								((gint32**)img->data)[p][pos] = ((gint32*)buffer)[i++];
-							pos++;
-						}
+						PPM_SPLIT(gint32);
 						break;
 					case IW_FLOAT:
-						for (; read>0; read--) {
-							for (p = 0; p<planes; p++)
-								((gfloat**)img->data)[p][pos] = ((gfloat*)buffer)[i++];
-							pos++;
-						}
+						PPM_SPLIT(gfloat);
 						break;
 					case IW_DOUBLE:
-						for (; read>0; read--) {
-							for (p = 0; p<planes; p++)
-								((gdouble**)img->data)[p][pos] = ((gdouble*)buffer)[i++];
-							pos++;
-						}
+						PPM_SPLIT(gdouble);
+						break;
+					default:
 						break;
 				}
 			}
-		} else {
-			if (fread (img->data[0], 1, count, file) != count)
-				goto cleanup;
-			swap_buffer (img->data[0], img->data[0], count, img->type, swap);
+#undef PPM_SPLIT
+			free (line);
 		}
 	} /* if (raw BINARY format) */
 	if (status) *status = IW_IMG_STATUS_OK;
 
 	/* Clean Up */
  cleanup:
-	if (file) fclose (file);
+	ppm_unmap (&file);
 	if (status && *status != IW_IMG_STATUS_OK && img) {
 		iw_img_free (img, IW_IMG_FREE_ALL);
 		img = NULL;
@@ -1508,6 +1640,9 @@ iwImgFileData *iw_img_data_create (void)
 	data->movie = NULL;
 	data->framerate = 25;
 	data->quality = 75;
+	data->time.tv_sec = 0;
+	data->time.tv_usec = 0;
+	data->img_number = 0;
 	return data;
 }
 
@@ -1536,6 +1671,22 @@ void iw_img_data_set_quality (iwImgFileData *data, int quality)
 	data->quality = quality;
 }
 
+/*********************************************************************
+  Set the grabbing time and the image number of the next frame (used
+  for iceWing raw movie saving). time==NULL: Use the current time.
+*********************************************************************/
+void iw_img_data_set_frame (iwImgFileData *data, const struct timeval *time,
+							int img_number)
+{
+	if (time) {
+		data->time = *time;
+	} else {
+		data->time.tv_sec = 0;
+		data->time.tv_usec = 0;
+	}
+	data->img_number = img_number;
+}
+
 /*********************************************************************
   If 'format' == IW_IMG_FORMAT_UNKNOWN return a format based on the
   extension of fname. Otherwise return 'format'.
@@ -1550,9 +1701,11 @@ iwImgFormat iw_img_save_get_format (iwImgFormat format, const char *fname)
 	static char *mjpeg[] = {".avi", ".mjpg", ".mjpeg", NULL};
 	static char *ffv1[] = {".avi", ".ffv", ".ffv1", NULL};
 	static char *mpeg4[] = {".avi", ".mpeg4", ".mp4", NULL};
+	static char *iwr_raw[] = {".iwr", NULL};
+	static char *iwr_lz4[] = {".iwz", NULL};
 	static char *svg[] = {".svg", NULL};
 	static char **ext[] = {pnm, png, jpeg,
-						   raw444, raw420, mjpeg, ffv1, mpeg4,
+						   raw444, raw420, mjpeg, ffv1, mpeg4, iwr_raw, iwr_lz4,
 						   svg, NULL};
 	char fext[10], *pos;
 	int i, j;
@@ -1608,6 +1761,8 @@ iwImgStatus iw_img_save (const iwImage *img, iwImgFormat format,
 		case IW_IMG_FORMAT_AVI_MJPEG:
 		case IW_IMG_FORMAT_AVI_FFV1:
 		case IW_IMG_FORMAT_AVI_MPEG4:
+		case IW_IMG_FORMAT_IWR_RAW:
+		case IW_IMG_FORMAT_IWR_LZ4:
 			if (data && data->movie)
 				status = iw_movie_write (data, format, img, fname);
 			else
@@ -83,7 +83,9 @@ typedef enum {
 	IW_IMG_FORMAT_AVI_MJPEG,
 	IW_IMG_FORMAT_AVI_FFV1,
 	IW_IMG_FORMAT_AVI_MPEG4,
-	IW_IMG_FORMAT_MOVIE_MAX = IW_IMG_FORMAT_AVI_MPEG4,	/* Last movie format */
+	IW_IMG_FORMAT_IWR_RAW,			/* iceWing raw movie, uncompressed */
+	IW_IMG_FORMAT_IWR_LZ4,			/* iceWing raw movie, LZ4 compressed */
+	IW_IMG_FORMAT_MOVIE_MAX = IW_IMG_FORMAT_IWR_LZ4,	/* Last movie format */
 
 	IW_IMG_FORMAT_VECTOR = 200,
 	IW_IMG_FORMAT_SVG = IW_IMG_FORMAT_VECTOR
@@ -233,6 +235,15 @@ iwMovie* iw_movie_open (const char *fname, iwImgStatus *status);
 iwImage* iw_movie_read (iwMovie **movie, const char *fname,
 						int frame, iwImgStatus *status);
 
+/*********************************************************************
+  Open the movie 'fname' (if not already open) and decode its frame
+  'frame' directly into img, avoiding the copy of the internal image.
+  The planes of img are reused if their format matches the frame,
+  otherwise they are reallocated.
+*********************************************************************/
+iwImgStatus iw_movie_read_to (iwMovie **movie, const char *fname,
+							  int frame, iwImage *img);
+
 /*********************************************************************
   Return frame rate of 'movie'.
 *********************************************************************/
@@ -249,6 +260,14 @@ int iw_movie_get_framecnt (const iwMovie *movie);
 *********************************************************************/
 int iw_movie_get_framepos (iwMovie *movie);
 
+/*********************************************************************
+  If movie stores the grabbing time of its frames (iceWing raw
+  movies), return in time the time of the frame, which was the result
+  of the last call to iw_movie_read().
+  Return: TRUE if time was set.
+*********************************************************************/
+gboolean iw_movie_get_frametime (iwMovie *movie, struct timeval *time);
+
 /*********************************************************************
   Initialise struct holding settings for saving images.
 *********************************************************************/
@@ -269,6 +288,13 @@ void iw_img_data_set_movie (iwImgFileData *data, iwMovie **movie, float framerat
 *********************************************************************/
 void iw_img_data_set_quality (iwImgFileData *data, int quality);
 
+/*********************************************************************
+  Set the grabbing time and the image number of the next frame (used
+  for iceWing raw movie saving). time==NULL: Use the current time.
+*********************************************************************/
+void iw_img_data_set_frame (iwImgFileData *data, const struct timeval *time,
+							int img_number);
+
 /*********************************************************************
   If 'format' == IW_IMG_FORMAT_UNKNOWN return a format based on the
   extension of fname. Otherwise return 'format'.
@@ -41,6 +41,8 @@ struct _iwImgFileData {
 	iwMovie **movie;
 	float framerate;
 	int quality;
+	struct timeval time;	/* Grabbing time of the frame, 0: current time */
+	int img_number;			/* Image number of the frame */
 };
 
 #ifdef __cplusplus
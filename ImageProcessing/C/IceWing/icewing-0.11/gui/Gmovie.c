@@ -25,9 +25,18 @@
  */
 
 #include "config.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 
 #include "tools/tools.h"
 #include "Gimage_i.h"
@@ -38,6 +47,9 @@
 #ifdef WITH_JPEG
 #include "avi/jpegutils.h"
 #endif
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
 
 #ifdef WITH_FFMPEG
 #ifdef FFMPEG_LIBINC
@@ -96,13 +108,112 @@
 #if LIBAVFORMAT_VERSION_INT < ((53<<16)+(25<<8))
 #  define avformat_close_input(s) av_close_input_file(*s)
 #endif
+/* Up to FFmpeg 4.0 codecs can only be opened and closed from
+   different threads if a lock manager is registered */
+#if LIBAVCODEC_VERSION_INT >= ((52<<16)+(30<<8)) && \
+	LIBAVCODEC_VERSION_INT < ((58<<16)+(9<<8))
+#  define FFM_LOCKMGR
+#endif
+/* Timestamp of the decoded frame in presentation order */
+#if LIBAVCODEC_VERSION_INT >= ((54<<16)+(0<<8))
+#  define FFM_FRAME_TS
+#endif
 #endif
 
 #define EVEN_PROD(w,h)	((((w)+1)&(~1)) * (((h)+1)&(~1)))
 
+/* iceWing raw movie (IW_IMG_FORMAT_IWR_RAW/LZ4), an append-only
+   container in host byte order:
+     iwrHeader {iwrFrame guint32 psize[] [palette] plane data}* index
+   psize[] gives the stored (maybe compressed) size of every plane,
+   interleaved images have one plane. The index consists of an
+   iwrIndex followed by the guint64 file positions of all frames. If
+   it is missing (file still written, program crashed) it is rebuild
+   by scanning the frames. */
+#define IWR_MAGIC			"iwRawMov"
+#define IWR_VERSION			1
+#define IWR_ORDER			0x01020304
+#define IWR_FRAME_MAGIC		IW_FOURCC('I','W','F','R')
+#define IWR_INDEX_MAGIC		IW_FOURCC('I','W','I','X')
+
+#define IWR_COMP_NONE		0
+#define IWR_COMP_LZ4		1
+
+#define IWR_CTAB_INDEX		(-1)		/* IW_INDEX */
+#define IWR_CTAB_PALETTE	(-2)		/* Own palette stored after psize[] */
+
+typedef struct iwrHeader {
+	char magic[8];				/* IWR_MAGIC */
+	guint32 version;			/* IWR_VERSION */
+	guint32 order;				/* IWR_ORDER in the byte order of the file */
+	guint64 index_pos;			/* File position of the index, 0: no index */
+	guint32 fcount;				/* Number of frames in the index */
+	float framerate;
+	guint32 reserved[8];
+} iwrHeader;
+
+typedef struct iwrFrame {
+	guint32 magic;				/* IWR_FRAME_MAGIC */
+	guint32 compression;		/* IWR_COMP_... */
+	guint64 size;				/* Size of all data following the header */
+	gint64 sec;					/* Grabbing time of the frame */
+	gint32 usec;
+	gint32 img_number;			/* Consecutive number of the grabbed image */
+	gint32 width, height;
+	gint32 planes;
+	gint32 type;				/* iwType */
+	gint32 rowstride;			/* >0: Interleaved image */
+	gint32 ctab;				/* <= IW_COLFORMAT_MAX or IWR_CTAB_... */
+	gint32 reserved[2];
+} iwrFrame;
+
+typedef struct iwrIndex {
+	guint32 magic;				/* IWR_INDEX_MAGIC */
+	guint32 fcount;				/* Number of following guint64 positions */
+} iwrIndex;
+
+#ifdef WITH_FFMPEG
+/* Keyframe index of ffmpeg movies, built on the first seek by
+   scanning all packets and cached in the iceWing config directory:
+     ffmIndexHeader movie-name ffmKey[nkeys]
+   The movie size and modification time must match to use it. */
+#define FFM_INDEX_MAGIC		"iwKeyIdx"
+#define FFM_INDEX_VERSION	2
+
+#define FFM_CACHE_SIZE		(64*1024*1024)	/* Memory for decoded frames */
+#define FFM_CACHE_MAX		64				/* Max. number of decoded frames */
+#define FFM_POS_UNKNOWN		(-99)			/* Demuxer position after a seek */
+
+typedef struct ffmIndexHeader {
+	char magic[8];				/* FFM_INDEX_MAGIC */
+	guint32 version;			/* FFM_INDEX_VERSION */
+	guint32 nkeys;				/* Number of keyframes */
+	gint64 fsize;				/* Size of the movie */
+	gint64 mtime;				/* Modification time of the movie */
+	gint32 fmax;				/* Highest (uncorrected) frame number */
+	gint32 namelen;				/* Length of the following movie name */
+	gint32 reserved[2];
+} ffmIndexHeader;
+
+typedef struct ffmKey {
+	gint64 dts;					/* Time stamp to seek to the keyframe, the
+								   decoding time stamp if known */
+	gint32 fnum;				/* Frame number from the presentation time
+								   stamp, not corrected by fnum_start */
+	gint32 reserved;
+} ffmKey;
+
+typedef struct ffmCached {
+	gboolean valid;				/* img contains frame fnum */
+	int fnum;					/* Frame number of img */
+	guint32 used;				/* Time of the last access */
+	iwImage *img;
+} ffmCached;
+#endif
+
 typedef struct iwMovieIn {
 	int fnum_ret;				/* Number of the frame returned by iw_movie_read() */
-	iwImage *image;				/* Last (ffmpeg: previously) read frame */
+	iwImage *image;				/* Frame returned by iw_movie_read() */
 
 	avi_t *AVI;
 
@@ -110,15 +221,25 @@ typedef struct iwMovieIn {
 	AVFormatContext *formatCtx;
 	int videoStream;
 	AVFrame	*frame;				/* Frame read from file, frame data allocated by ffmpeg */
-	AVFrame	*frameYUV;			/* Converted frame, frameYUV.data == image2.data */
-	int fnum;					/* Frame number of image, starting at 0 */
+	AVFrame	*frameYUV;			/* Converted frame, data points to the destination */
+	int fnum;					/* Last decoded frame, -1: at start, or FFM_POS_UNKNOWN */
+	gboolean decoded;			/* frame contains the decoded frame fnum */
 	int fnum_start;				/* Frame number of first frame */
 	AVRational r_frate;			/* Rational frame rate */
-
-	iwImage *image2;			/* Last read frame */
-	int fnum2;					/* Frame number of image2 */
 	struct SwsContext *convert_ctx;	/* Context for sws_scale */
+
+	ffmKey *keys;				/* Keyframe index */
+	int nkeys;
+	gboolean keys_tried;		/* Index was already loaded or build */
+	ffmCached *cache;			/* Recently decoded frames, LRU replacement */
+	int ncache;
+	guint32 cache_tick;
 #endif
+	guchar *iwr_map;			/* iceWing raw movie: Mapped file */
+	size_t iwr_size;			/* Size of the mapping */
+	guint64 *iwr_index;			/* Positions of the frames */
+	struct timeval iwr_time;	/* Grabbing time of the last read frame */
+
 	int fcount;					/* Number of frames in video */
 	double framerate;
 
@@ -135,6 +256,13 @@ typedef struct iwMovieOut {
 	uint8_t *outbuf;			/* Buffer for encoded frame */
 	int outbuf_size;			/* Size of buffer for encoded frame */
 #endif
+	int iwr_fd;					/* File of an iceWing raw movie */
+	guint64 iwr_pos;			/* Current end of the file */
+	guint64 *iwr_index;			/* Positions of the written frames */
+	int iwr_fcount;				/* Number of written frames */
+	int iwr_isize;				/* Allocated size of iwr_index */
+	guchar *iwr_buf;			/* Buffer for compressed frames */
+	size_t iwr_bufsize;			/* Size of iwr_buf */
 } iwMovieOut;
 
 struct _iwMovie {
@@ -317,6 +445,29 @@ void iw_img_convert (const iwImage *img, guchar **dst, int width, int height,
 	}
 }
 
+/*********************************************************************
+  Prepare img to receive a frame of the given format. The planes of
+  img are reused if the format matches, otherwise they are
+  reallocated. The color table is not changed.
+*********************************************************************/
+static gboolean movie_img_prepare (iwImage *img, int width, int height,
+								   int planes, iwType type, int rowstride)
+{
+	if (img->data && img->data[0] &&
+		img->width == width && img->height == height &&
+		img->planes == planes && img->type == type &&
+		img->rowstride == rowstride)
+		return TRUE;
+
+	iw_img_free (img, IW_IMG_FREE_PLANE | IW_IMG_FREE_PLANEPTR);
+	img->width = width;
+	img->height = height;
+	img->planes = planes;
+	img->type = type;
+	img->rowstride = rowstride;
+	return iw_img_allocate (img);
+}
+
 #ifdef WITH_FFMPEG
 
 /*********************************************************************
@@ -386,19 +537,255 @@ static iwImgStatus ffm_seek (iwMovie **movie, const char *fname, int fnum,
 	return status;
 }
 
-static void ffm_swap_images (iwMovieIn *m)
+/*********************************************************************
+  Return the frame number of the time stamp ts of the video stream,
+  not corrected by m->fnum_start.
+*********************************************************************/
+static int ffm_ts2fnum (iwMovieIn *m, int64_t ts)
+{
+	AVStream *stream = m->formatCtx->streams[m->videoStream];
+
+	if (stream->start_time != AV_NOPTS_VALUE)
+		ts -= stream->start_time;
+	return av_rescale_rnd (ts,
+						   (int64_t)stream->time_base.num * m->r_frate.num,
+						   (int64_t)stream->time_base.den * m->r_frate.den,
+						   AV_ROUND_NEAR_INF);
+}
+
+/*********************************************************************
+  Get in fnum the frame number of the video packet packet, not
+  corrected by m->fnum_start. The presentation time stamp is used if
+  the decoded frames are numbered by their own time stamp.
+  Return FALSE if the packet has no time stamp.
+*********************************************************************/
+static gboolean ffm_packet_fnum (iwMovieIn *m, AVPacket *packet, int *fnum)
+{
+#ifdef FFM_FRAME_TS
+	if (packet->pts != AV_NOPTS_VALUE) {
+		*fnum = ffm_ts2fnum (m, packet->pts);
+		return TRUE;
+	}
+#endif
+	if (packet->dts != AV_NOPTS_VALUE) {
+		*fnum = ffm_ts2fnum (m, packet->dts);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*********************************************************************
+  Return the frame number of the just decoded frame m->frame. With
+  B-frames the decoder returns the frames delayed and reordered, so
+  the time stamp of the frame is used. Without one pfnum, the number
+  of the packet given to the decoder (if known), is used.
+*********************************************************************/
+static int ffm_frame_fnum (iwMovieIn *m, gboolean known, int pfnum)
+{
+#ifdef FFM_FRAME_TS
+	if (m->frame->best_effort_timestamp != AV_NOPTS_VALUE)
+		return ffm_ts2fnum (m, m->frame->best_effort_timestamp) - m->fnum_start;
+	if (m->decoded)
+		return m->fnum + 1;
+#endif
+	if (known)
+		return pfnum - m->fnum_start;
+	return m->decoded ? m->fnum + 1 : 0;
+}
+
+/*********************************************************************
+  Get in fname (size PATH_MAX) the name of the keyframe index file
+  for the movie 'movie' inside the iceWing config directory.
+*********************************************************************/
+static void ffm_index_name (const char *movie, char *fname)
+{
+	const char *base = strrchr (movie, '/');
+	char name[60];
+
+	base = base ? base+1 : movie;
+	g_snprintf (name, sizeof(name), "keyindex-%.40s-%08x",
+				base, (guint)g_str_hash (movie));
+	gui_convert_prg_rc (fname, name, TRUE);
+}
+
+/*********************************************************************
+  Load the keyframe index of movie fname (with the file status st)
+  from the index cache.
+*********************************************************************/
+static gboolean ffm_index_load (iwMovieIn *m, const char *fname, struct stat *st)
+{
+	char iname[PATH_MAX], *name;
+	ffmIndexHeader head;
+	ffmKey *keys;
+	gboolean ok = FALSE;
+	FILE *file;
+
+	ffm_index_name (fname, iname);
+	if (!(file = fopen (iname, "rb")))
+		return FALSE;
+
+	if (fread (&head, sizeof(head), 1, file) == 1 &&
+		!memcmp (head.magic, FFM_INDEX_MAGIC, sizeof(head.magic)) &&
+		head.version == FFM_INDEX_VERSION &&
+		head.fsize == st->st_size && head.mtime == st->st_mtime &&
+		head.namelen == (gint32)strlen(fname) && head.nkeys > 0 &&
+		head.nkeys < INT_MAX/sizeof(ffmKey)) {
+
+		name = g_malloc (head.namelen+1);
+		keys = malloc (head.nkeys * sizeof(ffmKey));
+		if (keys &&
+			fread (name, 1, head.namelen, file) == head.namelen &&
+			!memcmp (name, fname, head.namelen) &&
+			fread (keys, sizeof(ffmKey), head.nkeys, file) == head.nkeys) {
+			m->keys = keys;
+			m->nkeys = head.nkeys;
+			m->fcount = head.fmax+1 - m->fnum_start;
+			ok = TRUE;
+		} else if (keys)
+			free (keys);
+		g_free (name);
+	}
+	fclose (file);
+
+	if (ok)
+		iw_debug (4, "Loaded keyframe index %s with %d keys", iname, m->nkeys);
+	return ok;
+}
+
+/*********************************************************************
+  Save the keyframe index of movie fname in the index cache.
+*********************************************************************/
+static void ffm_index_save (iwMovieIn *m, const char *fname, struct stat *st,
+							int fmax)
 {
-	iwImage *img = m->image;
+	char iname[PATH_MAX];
+	ffmIndexHeader head;
+	FILE *file;
+
+	ffm_index_name (fname, iname);
+	if (!(file = fopen (iname, "wb"))) {
+		iw_debug (3, "Unable to open keyframe index %s: %s", iname, strerror(errno));
+		return;
+	}
+	memset (&head, 0, sizeof(head));
+	memcpy (head.magic, FFM_INDEX_MAGIC, sizeof(head.magic));
+	head.version = FFM_INDEX_VERSION;
+	head.nkeys = m->nkeys;
+	head.fsize = st->st_size;
+	head.mtime = st->st_mtime;
+	head.fmax = fmax;
+	head.namelen = strlen (fname);
+
+	if (fwrite (&head, sizeof(head), 1, file) != 1 ||
+		fwrite (fname, 1, head.namelen, file) != head.namelen ||
+		fwrite (m->keys, sizeof(ffmKey), m->nkeys, file) != m->nkeys) {
+		iw_debug (3, "Unable to write keyframe index %s", iname);
+		fclose (file);
+		unlink (iname);
+		return;
+	}
+	fclose (file);
+}
 
-	m->fnum = m->fnum2;
-	m->fnum2 = -99;
+/*********************************************************************
+  Load the keyframe index of movie fname from the index cache or, if
+  not available, build it by reading all packets of the video stream.
+  Afterwards the demuxer is at an undefined position.
+*********************************************************************/
+static void ffm_index_build (iwMovieIn *m, const char *fname)
+{
+	AVStream *stream = m->formatCtx->streams[m->videoStream];
+	struct stat st;
+	AVPacket packet;
+	int64_t start;
+	int fmax = -1, size = 0;
+
+	m->keys_tried = TRUE;
+	if (stat (fname, &st) == 0 && ffm_index_load (m, fname, &st))
+		return;
+
+	/* Rewind to the start of the video */
+	m->fnum = FFM_POS_UNKNOWN;
+	m->decoded = FALSE;
+	start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+	if (av_seek_frame (m->formatCtx, m->videoStream, start,
+					   AVSEEK_FLAG_BACKWARD | AVSEEK_FLAG_ANY) < 0) {
+		iw_debug (3, "Unable to rewind %s, no keyframe index", fname);
+		return;
+	}
 
-	m->image = m->image2;
-	m->image2 = img;
+	while (av_read_frame (m->formatCtx, &packet) >= 0) {
+		int fnum;
+
+		if (packet.stream_index == m->videoStream &&
+			ffm_packet_fnum (m, &packet, &fnum)) {
+			if (packet.flags & AV_PKT_FLAG_KEY) {
+				if (m->nkeys >= size) {
+					ffmKey *keys;
+					size = size ? size*2 : 256;
+					if (!(keys = realloc (m->keys, size * sizeof(ffmKey)))) {
+						av_free_packet (&packet);
+						m->nkeys = 0;
+						break;
+					}
+					m->keys = keys;
+				}
+				m->keys[m->nkeys].dts =
+					packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+				m->keys[m->nkeys].fnum = fnum;
+				m->keys[m->nkeys].reserved = 0;
+				m->nkeys++;
+			}
+			if (fnum > fmax)
+				fmax = fnum;
+		}
+		av_free_packet (&packet);
+	}
+
+	if (m->nkeys <= 0) {
+		free (m->keys);
+		m->keys = NULL;
+		m->nkeys = 0;
+		return;
+	}
+	/* The duration from the container is only an estimate */
+	m->fcount = fmax+1 - m->fnum_start;
+	iw_debug (4, "Scanned %d keyframes, %d frames", m->nkeys, m->fcount);
 
-	m->frameYUV->data[0] = img->data[0];
-	m->frameYUV->data[1] = img->data[1];
-	m->frameYUV->data[2] = img->data[2];
+	if (stat (fname, &st) == 0)
+		ffm_index_save (m, fname, &st, fmax);
+}
+
+/*********************************************************************
+  Seek to the last keyframe at or before frame number fnum by using
+  the keyframe index. Return TRUE on success.
+*********************************************************************/
+static gboolean ffm_seek_key (iwMovieIn *m, int fnum)
+{
+	AVStream *stream = m->formatCtx->streams[m->videoStream];
+	int l = 0, r = m->nkeys-1, c;
+
+	if (m->nkeys <= 0 || m->keys[0].fnum - m->fnum_start > fnum)
+		return FALSE;
+
+	/* Binary search for the last keyframe <= fnum */
+	while (l < r) {
+		c = (l+r+1) / 2;
+		if (m->keys[c].fnum - m->fnum_start <= fnum)
+			l = c;
+		else
+			r = c-1;
+	}
+	if (av_seek_frame (m->formatCtx, m->videoStream, m->keys[l].dts,
+					   AVSEEK_FLAG_BACKWARD) < 0)
+		return FALSE;
+	avcodec_flush_buffers (stream->codec);
+	m->fnum = FFM_POS_UNKNOWN;
+	m->decoded = FALSE;
+
+	iw_debug (5, "Seek to frame %d: keyframe %d dts %ld", fnum,
+			  m->keys[l].fnum - m->fnum_start, (long)m->keys[l].dts);
+	return TRUE;
 }
 
 static gboolean ffm_convert (iwMovieIn *m, AVPicture *src, iwImage *dst)
@@ -408,9 +795,12 @@ static gboolean ffm_convert (iwMovieIn *m, AVPicture *src, iwImage *dst)
 	int pix_fmt;
 
 	m->frameYUV->data[0] = dst->data[0];
+	m->frameYUV->linesize[0] = dst->width * IW_TYPE_SIZE(dst);
 	if (dst->planes == 3) {
 		m->frameYUV->data[1] = dst->data[1];
 		m->frameYUV->data[2] = dst->data[2];
+		m->frameYUV->linesize[1] = m->frameYUV->linesize[0];
+		m->frameYUV->linesize[2] = m->frameYUV->linesize[0];
 		pix_fmt = PIX_FMT_YUV444P;
 	} else if (dst->type == IW_16U) {
 		pix_fmt = PIX_FMT_GRAY16;
@@ -433,91 +823,103 @@ static gboolean ffm_convert (iwMovieIn *m, AVPicture *src, iwImage *dst)
 }
 
 /*********************************************************************
-  Read and decode frame 'frame'.
+  Return the cache entry of frame fnum or NULL if it is not cached.
 *********************************************************************/
-static iwImgStatus ffm_read_frame (iwMovie **movie, const char *fname, int frame)
+static ffmCached *ffm_cache_get (iwMovieIn *m, int fnum)
+{
+	int i;
+
+	for (i=0; i<m->ncache; i++) {
+		if (m->cache[i].valid && m->cache[i].fnum == fnum) {
+			m->cache[i].used = ++m->cache_tick;
+			return &m->cache[i];
+		}
+	}
+	return NULL;
+}
+
+/*********************************************************************
+  Return the cached frame nearest to fnum, preferring frames before
+  fnum. Needed if frame numbers have gaps or at the end of the movie.
+*********************************************************************/
+static ffmCached *ffm_cache_nearest (iwMovieIn *m, int fnum)
+{
+	ffmCached *below = NULL, *above = NULL, *c;
+	int i;
+
+	for (i=0; i<m->ncache; i++) {
+		c = &m->cache[i];
+		if (!c->valid)
+			continue;
+		if (c->fnum <= fnum) {
+			if (!below || c->fnum > below->fnum)
+				below = c;
+		} else if (!above || c->fnum < above->fnum)
+			above = c;
+	}
+	c = below ? below : above;
+	if (c)
+		c->used = ++m->cache_tick;
+	return c;
+}
+
+/*********************************************************************
+  Convert the last decoded frame m->frame into the least recently
+  used cache entry and return the entry.
+*********************************************************************/
+static ffmCached *ffm_cache_store (iwMovieIn *m, int fnum)
+{
+	AVCodecContext *codecCtx = m->formatCtx->streams[m->videoStream]->codec;
+	ffmCached *c = ffm_cache_get (m, fnum);
+	int i;
+
+	if (c)
+		return c;
+
+	c = &m->cache[0];
+	for (i=1; i<m->ncache && c->valid; i++) {
+		if (!m->cache[i].valid || m->cache[i].used < c->used)
+			c = &m->cache[i];
+	}
+	if (!c->img) {
+		c->img = iw_img_new_alloc (codecCtx->width, codecCtx->height,
+								   m->image->planes, m->image->type);
+		if (!c->img)
+			return NULL;
+		c->img->ctab = m->image->ctab;
+	}
+	c->valid = FALSE;
+	if (!ffm_convert (m, (AVPicture*)m->frame, c->img))
+		return NULL;
+	c->valid = TRUE;
+	c->fnum = fnum;
+	c->used = ++m->cache_tick;
+	return c;
+}
+
+/*********************************************************************
+  Read the next video packet and decode it. Frames before skip_before
+  are decoded only as far as needed for the following frames. At the
+  end of file the frames delayed by the decoder are returned.
+  Return the frame number of the decoded frame in fnum or FALSE at
+  end of file.
+*********************************************************************/
+static gboolean ffm_decode_next (iwMovieIn *m, int skip_before, int *fnum)
 {
-	iwMovieIn *m = &(*movie)->io.i;
 	AVStream *stream = m->formatCtx->streams[m->videoStream];
 	AVCodecContext *codecCtx = stream->codec;
 	int	frameFinished;
-	int seek_fnum = -99;
 	AVPacket packet;
-	AVPicture frame_last;
-	int fnum_last;
-	gboolean next = FALSE, prev = FALSE;
-	gboolean reopened = FALSE;
 
-	if (frame == IW_MOVIE_NEXT_FRAME) {
-		frame = (m->fnum_ret+1+m->fcount) % m->fcount;
-		next = TRUE;
-	} else if (frame == IW_MOVIE_PREV_FRAME) {
-		frame = (m->fnum_ret-1+m->fcount) % m->fcount;
-		prev = TRUE;
-	}
-	m->fnum_ret = frame;
+	gboolean known;
+	int pfnum;
 
-	if (frame == m->fnum || (!next && frame > m->fnum && frame < m->fnum2)) {
-		/* Return buffered image */
-		return IW_IMG_STATUS_OK;
-	} else if (frame == m->fnum2 || frame == m->fnum2+1 ||
-			   (next && frame > m->fnum && frame < m->fnum2)) {
-		ffm_swap_images (m);
-		if (frame == m->fnum || (next && frame < m->fnum)) {
-			/* Return buffered image */
-			m->fnum_ret = m->fnum;
-			return IW_IMG_STATUS_OK;
-		}
-	} else if (frame != m->fnum+1) {
-		iwImgStatus status = ffm_seek (movie, fname, frame, &reopened);
-		if (status != IW_IMG_STATUS_OK) {
-			iw_warning ("Unable to seek to frame %d", frame);
-			return status;
-		}
-		/* Seek may have reopened the movie */
-		m = &(*movie)->io.i;
-		stream = m->formatCtx->streams[m->videoStream];
-		codecCtx = stream->codec;
-		seek_fnum = -1;
-	}
-
-	fnum_last = -1;
-	frame_last.data[0] = NULL;
 	while (av_read_frame (m->formatCtx, &packet) >= 0) {
 		/* Is this a packet from the video stream? */
 		if (packet.stream_index == m->videoStream) {
-			int fnum;
-			int64_t dts = packet.dts;
-			if (stream->start_time != AV_NOPTS_VALUE)
-				dts -= stream->start_time;
-			fnum = av_rescale_rnd (dts,
-								   (int64_t)stream->time_base.num * m->r_frate.num,
-								   (int64_t)stream->time_base.den * m->r_frate.den,
-								   AV_ROUND_NEAR_INF)
-				- m->fnum_start;
-
-			/* If seeked to far try to reopen the video */
-			if (seek_fnum > -99 && fnum > frame && frame == 0 && !reopened) {
-				iwImgStatus status;
-				iw_movie_close (*movie);
-				*movie = iw_movie_open (fname, &status);
-				if (status != IW_IMG_STATUS_OK) {
-					iw_warning ("Unable to seek to frame %d", frame);
-					return status;
-				} else
-					iw_warning ("Seek failed, reopened file %s", fname);
-				reopened = TRUE;
+			known = ffm_packet_fnum (m, &packet, &pfnum);
 
-				m = &(*movie)->io.i;
-				stream = m->formatCtx->streams[m->videoStream];
-				codecCtx = stream->codec;
-				continue;
-			}
-#ifdef IW_DEBUG
-			if (seek_fnum == -1)
-				seek_fnum = fnum;
-#endif
-			if (fnum < frame-2)
+			if (known && pfnum - m->fnum_start < skip_before)
 				codecCtx->skip_frame = 1; /* No decoding of b frames */
 			else
 				codecCtx->skip_frame = 0;
@@ -528,63 +930,169 @@ static iwImgStatus ffm_read_frame (iwMovie **movie, const char *fname, int frame
 #else
 			avcodec_decode_video2 (codecCtx, m->frame, &frameFinished, &packet);
 #endif
-			/* Did we get a complete video frame and is it "near" the final one?
-			   HACK: Gaps of a size of more than 50 frames are not supported. */
-			if (frameFinished && fnum+50 > frame) {
-				if (fnum < frame) {
-					/* Remember the frame before the final one */
-					if (!frame_last.data[0])
-						avpicture_alloc (&frame_last, codecCtx->pix_fmt,
-										 codecCtx->width, codecCtx->height);
-					av_picture_copy (&frame_last, (AVPicture*)m->frame, codecCtx->pix_fmt,
-									 codecCtx->width, codecCtx->height);
-					fnum_last = fnum;
-				} else {
-					gboolean ok;
-					/* Convert the image from its native format to YUV/Gray */
-					if (fnum == frame || m->fnum < 0 || next) {
-						ok = ffm_convert (m, (AVPicture*)m->frame, m->image);
-						m->fnum = fnum;
-						m->fnum2 = -99;
-					} else {
-						if (frame_last.data[0]) {
-							ffm_convert (m, &frame_last, m->image);
-							m->fnum = fnum_last;
-						}
-						ok = ffm_convert (m, (AVPicture*)m->frame, m->image2);
-						m->fnum2 = fnum;
-					}
+			iw_debug (6, "Decoded (finished %d): packet: pts %ld dts %ld",
+					  frameFinished, (long)packet.pts, (long)packet.dts);
+			av_free_packet (&packet);
+			if (frameFinished) {
+				codecCtx->skip_frame = 0;
+				*fnum = ffm_frame_fnum (m, known, pfnum);
+				return TRUE;
+			}
+		} else {
+			/* Free the packet that was allocated by av_read_frame */
+			av_free_packet (&packet);
+		}
+	}
+	codecCtx->skip_frame = 0;
 
-					/*
-					if (m->frame->repeat_pict)
-						fprintf (stderr, "Repeat %d: %d\n", m->fnum, m->frame->repeat_pict);
-					*/
-					iw_debug (5, "Frame %d seek %d dst %d last %d: packet: pts %ld"
-							  " dur %ld dts %ld  stream: dts %ld",
-							  m->fnum, seek_fnum, frame, fnum, (long)packet.pts,
-							  (long)packet.duration, (long)packet.dts, (long)stream->cur_dts);
-
-					avpicture_free (&frame_last);
-					av_free_packet (&packet);
-					if (next || prev)
-						m->fnum_ret = m->fnum;
-					else
-						m->fnum_ret = frame;
-					if (ok)
-						return IW_IMG_STATUS_OK;
-					else
-						return IW_IMG_STATUS_ERR;
+	/* End of file: Get the frames delayed by the decoder */
+	av_init_packet (&packet);
+	packet.data = NULL;
+	packet.size = 0;
+#if LIBAVCODEC_VERSION_INT < ((52<<16)+(26<<8))
+	avcodec_decode_video (codecCtx, m->frame, &frameFinished, NULL, 0);
+#else
+	avcodec_decode_video2 (codecCtx, m->frame, &frameFinished, &packet);
+#endif
+	if (frameFinished) {
+		*fnum = ffm_frame_fnum (m, FALSE, 0);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*********************************************************************
+  Return TRUE if frame a should be returned instead of frame b for
+  the requested frame fnum, i.e. a is nearer, preferring frames
+  before fnum.
+*********************************************************************/
+static gboolean ffm_nearer (int a, int b, int fnum)
+{
+	if (a <= fnum)
+		return b > fnum || a > b;
+	return b > fnum && a < b;
+}
+
+/*********************************************************************
+  Read and decode frame 'frame' into dst (NULL: m->image).
+  The decoded frame is converted directly into dst. Frames following
+  shortly after the last decoded one are reached by decoding forward,
+  otherwise the keyframe index is used to seek to the last keyframe
+  before the frame. Only the frames decoded on the way to the final
+  frame are converted into an LRU cache, which makes stepping
+  backwards cheap. Cache hits are copied into dst.
+*********************************************************************/
+static iwImgStatus ffm_read_frame (iwMovie **movie, const char *fname, int frame,
+								   iwImage *dst)
+{
+	iwMovieIn *m = &(*movie)->io.i;
+	gboolean relative = FALSE, reopened = FALSE, seeked = FALSE;
+	ffmCached *c;
+	iwImage *src;
+	int fnum, p;
+
+	if (frame == IW_MOVIE_NEXT_FRAME || frame == IW_MOVIE_PREV_FRAME) {
+		int step = frame == IW_MOVIE_NEXT_FRAME ? 1 : -1;
+		if (m->fcount > 0)
+			frame = (m->fnum_ret+step+m->fcount) % m->fcount;
+		else
+			frame = MAX (m->fnum_ret+step, 0);
+		relative = TRUE;
+	}
+	m->fnum_ret = frame;
+
+	if (!(c = ffm_cache_get (m, frame)) && !(m->decoded && m->fnum == frame)) {
+		/* Seek if the frame is not reachable by decoding forward */
+		if (m->fnum == FFM_POS_UNKNOWN || frame <= m->fnum ||
+			frame > m->fnum + m->ncache) {
+			if (!m->keys_tried)
+				ffm_index_build (m, fname);
+			if (!ffm_seek_key (m, frame)) {
+				iwImgStatus status = ffm_seek (movie, fname, frame, &reopened);
+				if (status != IW_IMG_STATUS_OK) {
+					iw_warning ("Unable to seek to frame %d", frame);
+					return status;
 				}
+				/* Seek may have reopened the movie */
+				m = &(*movie)->io.i;
+				m->fnum_ret = frame;
+				m->fnum = FFM_POS_UNKNOWN;
+				m->decoded = FALSE;
 			}
+			seeked = TRUE;
 		}
 
-		/* Free the packet that was allocated by av_read_frame */
-		av_free_packet (&packet);
+		/* Decode up to the frame, cache the frames close before it */
+		while (ffm_decode_next (m, frame - m->ncache, &fnum)) {
+			/* If seeked to far try to reopen the video */
+			if (seeked && fnum > frame && frame == 0 && !reopened) {
+				iwImgStatus status;
+				iw_movie_close (*movie);
+				*movie = iw_movie_open (fname, &status);
+				if (!*movie) {
+					iw_warning ("Unable to seek to frame %d", frame);
+					return status;
+				} else
+					iw_warning ("Seek failed, reopened file %s", fname);
+				reopened = TRUE;
+				m = &(*movie)->io.i;
+				m->fnum_ret = frame;
+				if ((c = ffm_cache_get (m, frame)) || (m->decoded && m->fnum == frame))
+					break;
+				continue;
+			}
+			seeked = FALSE;
+			m->fnum = fnum;
+			m->decoded = TRUE;
+			if (fnum >= frame)
+				break;
+			if (fnum > frame - m->ncache && !ffm_cache_store (m, fnum))
+				return IW_IMG_STATUS_MEM;
+		}
+
+		/* Frame numbers may have gaps and the end of the movie may be
+		   reached: Use the nearest available frame */
+		if (!c && !(m->decoded && m->fnum == frame)) {
+			c = ffm_cache_nearest (m, frame);
+			if (m->decoded && (!c || ffm_nearer (m->fnum, c->fnum, frame)))
+				c = NULL;
+			else if (!c)
+				return IW_IMG_STATUS_ERR;
+		}
+	}
+	if (relative)
+		m->fnum_ret = c ? c->fnum : m->fnum;
+
+	if (!dst)
+		dst = m->image;
+	if (!c) {
+		/* Convert the last decoded frame directly into the destination */
+		AVCodecContext *codecCtx = m->formatCtx->streams[m->videoStream]->codec;
+		if (!movie_img_prepare (dst, codecCtx->width, codecCtx->height,
+								m->image->planes, m->image->type, 0))
+			return IW_IMG_STATUS_MEM;
+		if (dst != m->image) {
+			iw_img_free (dst, IW_IMG_FREE_CTAB);
+			dst->ctab = m->image->ctab;
+		}
+		if (!ffm_convert (m, (AVPicture*)m->frame, dst))
+			return IW_IMG_STATUS_ERR;
+		return IW_IMG_STATUS_OK;
 	}
-	avpicture_free (&frame_last);
-	codecCtx->skip_frame = 0;
 
-	return IW_IMG_STATUS_ERR;
+	/* Copy the cached frame into the destination */
+	src = c->img;
+	if (!movie_img_prepare (dst, src->width, src->height, src->planes, src->type, 0))
+		return IW_IMG_STATUS_MEM;
+	if (dst != m->image) {
+		iw_img_free (dst, IW_IMG_FREE_CTAB);
+		dst->ctab = src->ctab;
+	}
+	for (p=0; p<src->planes; p++)
+		memcpy (dst->data[p], src->data[p],
+				src->width*src->height*IW_TYPE_SIZE(src));
+
+	return IW_IMG_STATUS_OK;
 }
 
 /*********************************************************************
@@ -609,18 +1117,57 @@ static iwMovie* ffm_open_error (iwMovie *m, char *errstr, int err, iwImgStatus *
 	return NULL;
 }
 
-static void ffm_init_lib (void)
+#ifdef FFM_LOCKMGR
+/*********************************************************************
+  Lock manager for libavcodec, movies are opened and closed from
+  different threads, e.g. by the prefetch threads of the fileset.
+*********************************************************************/
+static int ffm_lockmgr (void **mutex, enum AVLockOp op)
 {
-	static gboolean initialized = FALSE;
+	switch (op) {
+		case AV_LOCK_CREATE:
+			if (!(*mutex = malloc (sizeof(pthread_mutex_t))))
+				return 1;
+			if (pthread_mutex_init (*mutex, NULL)) {
+				free (*mutex);
+				*mutex = NULL;
+				return 1;
+			}
+			return 0;
+		case AV_LOCK_OBTAIN:
+			return pthread_mutex_lock (*mutex) != 0;
+		case AV_LOCK_RELEASE:
+			return pthread_mutex_unlock (*mutex) != 0;
+		case AV_LOCK_DESTROY:
+			if (*mutex) {
+				pthread_mutex_destroy (*mutex);
+				free (*mutex);
+				*mutex = NULL;
+			}
+			return 0;
+	}
+	return 1;
+}
+#endif
 
-	if (!initialized) {
-		av_register_all();
+static void ffm_init_once (void)
+{
+#ifdef FFM_LOCKMGR
+	if (av_lockmgr_register (ffm_lockmgr))
+		iw_warning ("Unable to register the FFmpeg lock manager");
+#endif
+	av_register_all();
 #ifdef IW_DEBUG
-		if (iw_debug_get_level() <= 5)
+	if (iw_debug_get_level() <= 5)
 #endif
-			av_log_set_level (AV_LOG_ERROR);
-		initialized = TRUE;
-	}
+		av_log_set_level (AV_LOG_ERROR);
+}
+
+static void ffm_init_lib (void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once (&once, ffm_init_once);
 }
 
 /*********************************************************************
@@ -697,23 +1244,20 @@ static iwMovie *ffm_open (const char *fname, iwImgStatus *status)
 	m->frame = avcodec_alloc_frame();
 	m->frameYUV = avcodec_alloc_frame();
 	m->image = iw_img_new_alloc (codecCtx->width, codecCtx->height, planes, type);
-	m->image2 = iw_img_new_alloc (codecCtx->width, codecCtx->height, planes, type);
-	if (!m->image || !m->image2 || !m->frame || !m->frameYUV)
+	if (!m->image || !m->frame || !m->frameYUV)
 		return ffm_open_error (movie, "avcodec_alloc_frame()", AVERROR(ENOMEM), status);
-
-	m->frameYUV->data[0] = m->image2->data[0];
-	m->frameYUV->linesize[0] = m->image2->width * IW_TYPE_SIZE(m->image2);
-	if (planes == 1) {
+	if (planes == 1)
 		m->image->ctab = IW_GRAY;
-		m->image2->ctab = IW_GRAY;
-	} else {
-		m->frameYUV->data[1] = m->image2->data[1];
-		m->frameYUV->data[2] = m->image2->data[2];
-		m->frameYUV->linesize[1] = m->frameYUV->linesize[0];
-		m->frameYUV->linesize[2] = m->frameYUV->linesize[0];
+	else
 		m->image->ctab = IW_YUV;
-		m->image2->ctab = IW_YUV;
-	}
+
+	/* Cache of decoded frames, the images are allocated on demand */
+	m->ncache = FFM_CACHE_SIZE /
+		((double)codecCtx->width * codecCtx->height * planes * IW_TYPE_SIZE(m->image));
+	m->ncache = CLAMP (m->ncache, 2, FFM_CACHE_MAX);
+	m->cache = calloc (m->ncache, sizeof(ffmCached));
+	if (!m->cache)
+		return ffm_open_error (movie, "calloc()", AVERROR(ENOMEM), status);
 
 	/* At least one DIVX movie had a wrong frame rate of (1,1) */
 	if ((stream->r_frame_rate.num == 1 && stream->r_frame_rate.den == 1) ||
@@ -729,9 +1273,10 @@ static iwMovie *ffm_open (const char *fname, iwImgStatus *status)
 	/* Some decoder need the first packets -> read them */
 	m->fnum_start = 0;
 	m->fnum = -1;
-	m->fnum2 = -99;
-	ffm_read_frame (&movie, fname, 0);
+	ffm_read_frame (&movie, fname, 0, NULL);
 	m->fnum_start = m->fnum;
+	for (i=0; i<m->ncache; i++)
+		m->cache[i].fnum -= m->fnum_start;
 	m->fnum_ret = -1;
 	m->fnum = 0;
 
@@ -972,19 +1517,19 @@ static iwMovie *avi_open (const char *fname, iwImgStatus *status)
 *********************************************************************/
 static BOOL avi_dup_frame (avi_t *AVI, int frame)
 {
-	long len = AVI->video_index[frame].len;
-	long pos = AVI->video_index[frame].pos;
+	long len = AVI_frame_size (AVI, frame);
+	int64_t pos = AVI_frame_pos (AVI, frame);
 
-	return len == 0 ||
+	return len <= 0 ||
 		( frame > 0 &&
-		  AVI->video_index[frame-1].pos == pos &&
-		  AVI->video_index[frame-1].len == len );
+		  AVI_frame_pos (AVI, frame-1) == pos &&
+		  AVI_frame_size (AVI, frame-1) == len );
 }
 
 /*********************************************************************
-  Read and decode frame 'frame'.
+  Read and decode frame 'frame' into dst.
 *********************************************************************/
-static iwImgStatus avi_read_frame (iwMovie *movie, int frame)
+static iwImgStatus avi_read_frame (iwMovie *movie, int frame, iwImage *dst)
 {
 	iwMovieIn *m = &movie->io.i;
 	iwImgStatus status = IW_IMG_STATUS_OK;
@@ -1030,9 +1575,13 @@ static iwImgStatus avi_read_frame (iwMovie *movie, int frame)
 	} else {
 		status = IW_IMG_STATUS_ERR;
 	}
+	if (status == IW_IMG_STATUS_OK && !movie_img_prepare (dst, w, h, 3, IW_8U, 0))
+		status = IW_IMG_STATUS_MEM;
 	if (status == IW_IMG_STATUS_OK) {
-		iwImage *img = m->image;
+		iwImage *img = dst;
 
+		iw_img_free (img, IW_IMG_FREE_CTAB);
+		img->ctab = IW_YUV;
 		if (codec == IW_CODEC_444P) {
 			memcpy (img->data[0], buf, w*h);
 			memcpy (img->data[2], buf+w*h, w*h);
@@ -1112,6 +1661,403 @@ static iwImgStatus avi_read_frame (iwMovie *movie, int frame)
 	return status;
 }
 
+/*********************************************************************
+  Write len bytes from buf to fd.
+*********************************************************************/
+static gboolean iwr_write (int fd, const void *buf, size_t len)
+{
+	const guchar *pos = buf;
+
+	while (len > 0) {
+		ssize_t cnt = write (fd, pos, len);
+		if (cnt < 0) {
+			if (errno == EINTR) continue;
+			return FALSE;
+		}
+		pos += cnt;
+		len -= cnt;
+	}
+	return TRUE;
+}
+
+/*********************************************************************
+  Return the iwrFrame.ctab value for the color format of img.
+*********************************************************************/
+static gint32 iwr_ctab_encode (const iwImage *img)
+{
+	if (img->ctab <= IW_COLFORMAT_MAX)
+		return (gint32)(long)img->ctab;
+	else if (img->ctab == IW_INDEX)
+		return IWR_CTAB_INDEX;
+	else
+		return IWR_CTAB_PALETTE;
+}
+
+/*********************************************************************
+  Append img as a new frame to the iceWing raw movie *data->movie. If
+  the movie is not open, create it as fname.
+*********************************************************************/
+static iwImgStatus iwr_write_frame (const iwImgFileData *data, iwImgFormat format,
+									const iwImage *img, const char *fname)
+{
+	iwMovieOut *m;
+	iwrFrame frame;
+	guint32 *psize;
+	guchar *pos;
+	int p, nplanes = img->rowstride ? 1 : img->planes;
+	size_t plane, need;
+
+	if (img->rowstride)
+		plane = (size_t)img->rowstride*img->height;
+	else
+		plane = (size_t)img->width*img->height*IW_TYPE_SIZE(img);
+
+	if (!*data->movie) {
+		iwrHeader head;
+		int fd = open (fname, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+
+		if (fd < 0)
+			return IW_IMG_STATUS_OPEN;
+		memset (&head, 0, sizeof(iwrHeader));
+		memcpy (head.magic, IWR_MAGIC, sizeof(head.magic));
+		head.version = IWR_VERSION;
+		head.order = IWR_ORDER;
+		head.framerate = data->framerate;
+		if (!iwr_write (fd, &head, sizeof(iwrHeader))) {
+			close (fd);
+			return IW_IMG_STATUS_WRITE;
+		}
+		*data->movie = calloc (1, sizeof(iwMovie));
+		(*data->movie)->in = FALSE;
+		m = &(*data->movie)->io.o;
+		m->format = format;
+		m->iwr_fd = fd;
+		m->iwr_pos = sizeof(iwrHeader);
+#ifndef WITH_LZ4
+		if (format == IW_IMG_FORMAT_IWR_LZ4)
+			iw_warning ("Compiled without LZ4-support, saving uncompressed frames");
+#endif
+	}
+	m = &(*data->movie)->io.o;
+
+	memset (&frame, 0, sizeof(iwrFrame));
+	frame.magic = IWR_FRAME_MAGIC;
+	frame.compression = IWR_COMP_NONE;
+	if (data->time.tv_sec || data->time.tv_usec) {
+		frame.sec = data->time.tv_sec;
+		frame.usec = data->time.tv_usec;
+	} else {
+		struct timeval time;
+		gettimeofday (&time, NULL);
+		frame.sec = time.tv_sec;
+		frame.usec = time.tv_usec;
+	}
+	frame.img_number = data->img_number;
+	frame.width = img->width;
+	frame.height = img->height;
+	frame.planes = img->planes;
+	frame.type = img->type;
+	frame.rowstride = img->rowstride;
+	frame.ctab = iwr_ctab_encode (img);
+
+	/* Buffer layout: psize[] [palette] [compressed planes] */
+	need = nplanes*sizeof(guint32);
+	if (frame.ctab == IWR_CTAB_PALETTE)
+		need += IW_CTAB_SIZE*3;
+#ifdef WITH_LZ4
+	if (m->format == IW_IMG_FORMAT_IWR_LZ4)
+		need += nplanes*(size_t)LZ4_compressBound (plane);
+#endif
+	if (need > m->iwr_bufsize) {
+		guchar *buf = realloc (m->iwr_buf, need);
+		if (!buf) return IW_IMG_STATUS_MEM;
+		m->iwr_buf = buf;
+		m->iwr_bufsize = need;
+	}
+	psize = (guint32*)m->iwr_buf;
+	pos = m->iwr_buf + nplanes*sizeof(guint32);
+	if (frame.ctab == IWR_CTAB_PALETTE) {
+		memcpy (pos, img->ctab, IW_CTAB_SIZE*3);
+		pos += IW_CTAB_SIZE*3;
+	}
+
+#ifdef WITH_LZ4
+	if (m->format == IW_IMG_FORMAT_IWR_LZ4) {
+		guchar *start = pos;
+
+		frame.compression = IWR_COMP_LZ4;
+		for (p=0; p<nplanes; p++) {
+			int cnt = LZ4_compress_default ((char*)img->data[p], (char*)pos, plane,
+											LZ4_compressBound (plane));
+			if (cnt <= 0) break;
+			psize[p] = cnt;
+			pos += cnt;
+		}
+		/* Store the frame uncompressed if LZ4 did not help */
+		if (p < nplanes || (size_t)(pos-start) >= nplanes*plane) {
+			frame.compression = IWR_COMP_NONE;
+			pos = start;
+		}
+	}
+#endif
+	if (frame.compression == IWR_COMP_NONE) {
+		for (p=0; p<nplanes; p++)
+			psize[p] = plane;
+		frame.size = (pos - m->iwr_buf) + nplanes*plane;
+	} else
+		frame.size = pos - m->iwr_buf;
+
+	if (m->iwr_fcount >= m->iwr_isize) {
+		int isize = m->iwr_isize ? m->iwr_isize*2 : 1024;
+		guint64 *index = realloc (m->iwr_index, isize*sizeof(guint64));
+		if (!index) return IW_IMG_STATUS_MEM;
+		m->iwr_index = index;
+		m->iwr_isize = isize;
+	}
+
+	if (iwr_write (m->iwr_fd, &frame, sizeof(iwrFrame)) &&
+		iwr_write (m->iwr_fd, m->iwr_buf, pos - m->iwr_buf)) {
+		if (frame.compression == IWR_COMP_NONE) {
+			for (p=0; p<nplanes; p++)
+				if (!iwr_write (m->iwr_fd, img->data[p], plane))
+					break;
+		} else
+			p = nplanes;
+		if (p == nplanes) {
+			m->iwr_index[m->iwr_fcount++] = m->iwr_pos;
+			m->iwr_pos += sizeof(iwrFrame) + frame.size;
+			return IW_IMG_STATUS_OK;
+		}
+	}
+
+	/* Remove the partially written frame, so that the file stays readable */
+	if (ftruncate (m->iwr_fd, m->iwr_pos) == 0)
+		lseek (m->iwr_fd, m->iwr_pos, SEEK_SET);
+	return IW_IMG_STATUS_WRITE;
+}
+
+/*********************************************************************
+  Append the index to the iceWing raw movie m and close it.
+*********************************************************************/
+static void iwr_close_out (iwMovieOut *m)
+{
+	iwrIndex index;
+	iwrHeader head;
+
+	index.magic = IWR_INDEX_MAGIC;
+	index.fcount = m->iwr_fcount;
+	head.index_pos = m->iwr_pos;
+	head.fcount = m->iwr_fcount;
+	if (!iwr_write (m->iwr_fd, &index, sizeof(iwrIndex)) ||
+		!iwr_write (m->iwr_fd, m->iwr_index, m->iwr_fcount*sizeof(guint64)) ||
+		pwrite (m->iwr_fd, &head.index_pos, sizeof(head.index_pos),
+				offsetof(iwrHeader, index_pos)) != sizeof(head.index_pos) ||
+		pwrite (m->iwr_fd, &head.fcount, sizeof(head.fcount),
+				offsetof(iwrHeader, fcount)) != sizeof(head.fcount))
+		iw_warning ("Unable to write the index of a raw movie: %s", strerror(errno));
+	close (m->iwr_fd);
+
+	free (m->iwr_index);
+	free (m->iwr_buf);
+}
+
+/*********************************************************************
+  Read the index of the mapped iceWing raw movie m.
+  Return: TRUE if the index is valid.
+*********************************************************************/
+static gboolean iwr_index_read (iwMovieIn *m, const iwrHeader *head)
+{
+	iwrIndex index;
+	guint64 pos = head->index_pos;
+
+	if (pos < sizeof(iwrHeader) || pos + sizeof(iwrIndex) > m->iwr_size)
+		return FALSE;
+	memcpy (&index, m->iwr_map + pos, sizeof(iwrIndex));
+	pos += sizeof(iwrIndex);
+	if (index.magic != IWR_INDEX_MAGIC ||
+		index.fcount > (m->iwr_size - pos) / sizeof(guint64))
+		return FALSE;
+
+	m->iwr_index = malloc ((index.fcount+1)*sizeof(guint64));
+	memcpy (m->iwr_index, m->iwr_map + pos, index.fcount*sizeof(guint64));
+	m->fcount = index.fcount;
+	return TRUE;
+}
+
+/*********************************************************************
+  Build the index of the mapped iceWing raw movie m by scanning all
+  frames. Used for files without an index, e.g. if they are still
+  being written.
+*********************************************************************/
+static void iwr_index_scan (iwMovieIn *m)
+{
+	guint64 pos = sizeof(iwrHeader);
+	int isize = 0;
+	iwrFrame frame;
+
+	m->fcount = 0;
+	while (pos + sizeof(iwrFrame) <= m->iwr_size) {
+		memcpy (&frame, m->iwr_map + pos, sizeof(iwrFrame));
+		if (frame.magic != IWR_FRAME_MAGIC ||
+			frame.size > m->iwr_size - pos - sizeof(iwrFrame))
+			break;
+		if (m->fcount >= isize) {
+			isize = isize ? isize*2 : 1024;
+			m->iwr_index = realloc (m->iwr_index, isize*sizeof(guint64));
+		}
+		m->iwr_index[m->fcount++] = pos;
+		pos += sizeof(iwrFrame) + frame.size;
+	}
+	iw_debug (3, "Raw movie without index, found %d frames", m->fcount);
+}
+
+/*********************************************************************
+  Try to open fname as an iceWing raw movie. The file is mapped, so
+  that the frames can be accessed randomly.
+*********************************************************************/
+static iwMovie *iwr_open (const char *fname, iwImgStatus *status)
+{
+	iwMovie *movie;
+	iwMovieIn *m;
+	iwrHeader head;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ((fd = open (fname, O_RDONLY)) < 0)
+		return NULL;
+	if (fstat (fd, &st) || (size_t)st.st_size < sizeof(iwrHeader) ||
+		pread (fd, &head, sizeof(iwrHeader), 0) != sizeof(iwrHeader) ||
+		memcmp (head.magic, IWR_MAGIC, sizeof(head.magic))) {
+		close (fd);
+		return NULL;
+	}
+	if (head.order != IWR_ORDER || head.version > IWR_VERSION) {
+		iw_warning ("Raw movie '%s' has an unsupported byte order or version", fname);
+		close (fd);
+		if (status) *status = IW_IMG_STATUS_FORMAT;
+		return NULL;
+	}
+	map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED) {
+		if (status) *status = IW_IMG_STATUS_READ;
+		return NULL;
+	}
+
+	movie = calloc (1, sizeof(iwMovie));
+	movie->in = TRUE;
+	m = &movie->io.i;
+	m->iwr_map = map;
+	m->iwr_size = st.st_size;
+	m->framerate = head.framerate;
+	m->fnum_ret = -1;
+	if (!iwr_index_read (m, &head))
+		iwr_index_scan (m);
+
+	return movie;
+}
+
+/*********************************************************************
+  Read and decompress frame 'frame' of an iceWing raw movie into dst.
+*********************************************************************/
+static iwImgStatus iwr_read_frame (iwMovie *movie, int frame, iwImage *img)
+{
+	iwMovieIn *m = &movie->io.i;
+	const guchar *data, *pos, *end;
+	iwrFrame f;
+	guint64 fstart;
+	int fpos, p, nplanes;
+	double plane;
+
+	if (m->fcount <= 0)
+		return IW_IMG_STATUS_ERR;
+
+	if (frame == IW_MOVIE_NEXT_FRAME)
+		fpos = m->fnum_ret+1;
+	else if (frame == IW_MOVIE_PREV_FRAME)
+		fpos = m->fnum_ret-1;
+	else
+		fpos = frame;
+	if (fpos < 0)
+		fpos = m->fcount-1;
+	else if (fpos >= m->fcount)
+		fpos = 0;
+	m->fnum_ret = fpos;
+
+	fstart = m->iwr_index[fpos];
+	if (fstart + sizeof(iwrFrame) > m->iwr_size)
+		return IW_IMG_STATUS_READ;
+	memcpy (&f, m->iwr_map + fstart, sizeof(iwrFrame));
+	if (f.magic != IWR_FRAME_MAGIC ||
+		f.size > m->iwr_size - fstart - sizeof(iwrFrame))
+		return IW_IMG_STATUS_READ;
+	if (f.width <= 0 || f.height <= 0 || f.planes <= 0 || f.rowstride < 0 ||
+		f.type < IW_8U || f.type > IW_DOUBLE)
+		return IW_IMG_STATUS_ERR;
+
+	nplanes = f.rowstride ? 1 : f.planes;
+	if (f.rowstride)
+		plane = (double)f.rowstride*f.height;
+	else
+		plane = (double)f.width*f.height*iwTypeSize[f.type];
+	if (plane >= INT_MAX)
+		return IW_IMG_STATUS_ERR;
+
+	data = m->iwr_map + fstart + sizeof(iwrFrame);
+	end = data + f.size;
+	pos = data + nplanes*sizeof(guint32);
+	if (pos > end)
+		return IW_IMG_STATUS_READ;
+
+	/* Reallocate the image if the frame format changed */
+	if (!movie_img_prepare (img, f.width, f.height, f.planes, f.type, f.rowstride))
+		return IW_IMG_STATUS_MEM;
+
+	if (f.ctab == IWR_CTAB_PALETTE) {
+		if (end - pos < IW_CTAB_SIZE*3)
+			return IW_IMG_STATUS_READ;
+		if (img->ctab <= IW_COLFORMAT_MAX || img->ctab == IW_INDEX)
+			img->ctab = malloc (IW_CTAB_SIZE*3);
+		memcpy (img->ctab, pos, IW_CTAB_SIZE*3);
+		pos += IW_CTAB_SIZE*3;
+	} else {
+		iw_img_free (img, IW_IMG_FREE_CTAB);
+		if (f.ctab == IWR_CTAB_INDEX)
+			img->ctab = IW_INDEX;
+		else if (f.ctab > 0 && f.ctab <= (long)IW_COLFORMAT_MAX)
+			img->ctab = (iwColtab)(long)f.ctab;
+	}
+
+	for (p=0; p<nplanes; p++) {
+		guint32 psize;
+
+		memcpy (&psize, data + p*sizeof(guint32), sizeof(guint32));
+		if (psize > end - pos)
+			return IW_IMG_STATUS_READ;
+		if (f.compression == IWR_COMP_NONE) {
+			if (psize != plane)
+				return IW_IMG_STATUS_READ;
+			memcpy (img->data[p], pos, psize);
+		} else if (f.compression == IWR_COMP_LZ4) {
+#ifdef WITH_LZ4
+			if (LZ4_decompress_safe ((const char*)pos, (char*)img->data[p],
+									 psize, plane) != plane)
+				return IW_IMG_STATUS_READ;
+#else
+			iw_warning ("Compiled without LZ4-support");
+			return IW_IMG_STATUS_FORMAT;
+#endif
+		} else
+			return IW_IMG_STATUS_FORMAT;
+		pos += psize;
+	}
+	m->iwr_time.tv_sec = f.sec;
+	m->iwr_time.tv_usec = f.usec;
+
+	return IW_IMG_STATUS_OK;
+}
+
 /*********************************************************************
   Close movie file if it is != NULL and free all associated data.
 *********************************************************************/
@@ -1128,12 +2074,23 @@ void iw_movie_close (iwMovie *movie)
 		if (m->AVI)
 			AVI_close (m->AVI);
 
+		if (m->iwr_map) {
+			munmap (m->iwr_map, m->iwr_size);
+			free (m->iwr_index);
+		}
+
 #ifdef WITH_FFMPEG
 		/* Free the frames */
 		av_free (m->frameYUV);
 		av_free (m->frame);
-		if (m->image2)
-			iw_img_free (m->image2, IW_IMG_FREE_ALL);
+		if (m->cache) {
+			int i;
+			for (i=0; i<m->ncache; i++)
+				if (m->cache[i].img)
+					iw_img_free (m->cache[i].img, IW_IMG_FREE_ALL);
+			free (m->cache);
+		}
+		free (m->keys);
 
 		/* Close the file */
 		if (m->formatCtx) {
@@ -1149,6 +2106,9 @@ void iw_movie_close (iwMovie *movie)
 		if (m->AVI)
 			AVI_close (m->AVI);
 
+		if (m->format == IW_IMG_FORMAT_IWR_RAW || m->format == IW_IMG_FORMAT_IWR_LZ4)
+			iwr_close_out (m);
+
 #ifdef WITH_FFMPEG
 		if (m->formatCtx) {
 			int i;
@@ -1193,6 +2153,10 @@ iwMovie* iw_movie_open (const char *fname, iwImgStatus *status)
 	iwMovie *movie = NULL;
 	if (status) *status = IW_IMG_STATUS_OK;
 
+	if ((movie = iwr_open (fname, status)) ||
+		(status && *status != IW_IMG_STATUS_OK))
+		return movie;
+
 #ifdef WITH_FFMPEG
 	if ((movie = ffm_open (fname, status)))
 		return movie;
@@ -1239,28 +2203,64 @@ int iw_movie_get_framepos (iwMovie *movie)
 }
 
 /*********************************************************************
-  Open the movie 'fname' (if not already open) and return its frame
-  'frame'.
-  ATTENTION: The returned frame is a pointer to an internally used
-  image which is freed by iw_movie_close().
+  If movie stores the grabbing time of its frames (iceWing raw
+  movies), return in time the time of the frame, which was the result
+  of the last call to iw_movie_read().
+  Return: TRUE if time was set.
 *********************************************************************/
-iwImage* iw_movie_read (iwMovie **movie, const char *fname,
-						int frame, iwImgStatus *status)
+gboolean iw_movie_get_frametime (iwMovie *movie, struct timeval *time)
 {
-	iwImgStatus _status = IW_IMG_STATUS_OK;
+	if (movie && movie->in && movie->io.i.iwr_map && movie->io.i.fnum_ret >= 0) {
+		*time = movie->io.i.iwr_time;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/*********************************************************************
+  Open the movie 'fname' (if not already open) and decode its frame
+  'frame' into img. img == NULL: Use the internal image of the movie.
+*********************************************************************/
+static iwImgStatus movie_read_frame (iwMovie **movie, const char *fname,
+									 int frame, iwImage *img)
+{
+	iwImgStatus status = IW_IMG_STATUS_OK;
+	iwMovieIn *m;
 
 	if (!*movie) {
-		*movie = iw_movie_open (fname, status);
-		if (!*movie) return NULL;
+		*movie = iw_movie_open (fname, &status);
+		if (!*movie) return status;
 	}
+	m = &(*movie)->io.i;
+	if (!img && !m->image && !(m->image = iw_img_new()))
+		return IW_IMG_STATUS_MEM;
 
 #ifdef WITH_FFMPEG
-	if ((*movie)->io.i.formatCtx)
-		_status = ffm_read_frame (movie, fname, frame);
+	/* The movie may get reopened -> resolve img == NULL later and
+	   do not access m afterwards */
+	if (m->formatCtx)
+		return ffm_read_frame (movie, fname, frame, img);
 #endif
 
-	if ((*movie)->io.i.AVI)
-		_status = avi_read_frame (*movie, frame);
+	if (m->AVI)
+		status = avi_read_frame (*movie, frame, img ? img : m->image);
+
+	if (m->iwr_map)
+		status = iwr_read_frame (*movie, frame, img ? img : m->image);
+
+	return status;
+}
+
+/*********************************************************************
+  Open the movie 'fname' (if not already open) and return its frame
+  'frame'.
+  ATTENTION: The returned frame is a pointer to an internally used
+  image which is freed by iw_movie_close().
+*********************************************************************/
+iwImage* iw_movie_read (iwMovie **movie, const char *fname,
+						int frame, iwImgStatus *status)
+{
+	iwImgStatus _status = movie_read_frame (movie, fname, frame, NULL);
 
 	if (status) *status = _status;
 
@@ -1270,6 +2270,20 @@ iwImage* iw_movie_read (iwMovie **movie, const char *fname,
 		return NULL;
 }
 
+/*********************************************************************
+  Open the movie 'fname' (if not already open) and decode its frame
+  'frame' directly into img, avoiding the copy of the internal image.
+  The planes of img are reused if their format matches the frame,
+  otherwise they are reallocated.
+*********************************************************************/
+iwImgStatus iw_movie_read_to (iwMovie **movie, const char *fname,
+							  int frame, iwImage *img)
+{
+	if (!img)
+		return IW_IMG_STATUS_ERR;
+	return movie_read_frame (movie, fname, frame, img);
+}
+
 /*********************************************************************
   If '*data->movie' is not open, open it as 'fname' with parameters
   from data. Write img as a new frame to the movie '*data->movie'.
@@ -1283,6 +2297,9 @@ iwImgStatus iw_movie_write (const iwImgFileData *data, iwImgFormat format,
 	iwImgStatus status = IW_IMG_STATUS_OK;
 	iwMovieOut *m;
 
+	if (format == IW_IMG_FORMAT_IWR_RAW || format == IW_IMG_FORMAT_IWR_LZ4)
+		return iwr_write_frame (data, format, img, fname);
+
 	if (IW_TYPE_SIZE(img) > 1)
 		return IW_IMG_STATUS_ERR;
 
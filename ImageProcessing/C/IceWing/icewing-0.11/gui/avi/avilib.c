@@ -23,7 +23,11 @@
  *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
+/* Positions in OpenDML files may exceed 2GB */
+#define _FILE_OFFSET_BITS 64
+
 #include <stdio.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -41,12 +45,26 @@ long AVI_errno = 0;
  *                                                                 *
  *******************************************************************/
 
-/* AVI_MAX_LEN: The maximum length of an AVI file, we stay a bit below
-    the 2GB limit (Remember: 2*10^9 is smaller than 2 GB) */
-#define AVI_MAX_LEN 2000000000
+/* AVI_RIFF_MAX: The maximum length of one RIFF chunk. OpenDML (AVI 2.0)
+    readers expect the first RIFF-AVI chunk to stay below 1GB, all
+    further data goes to RIFF-AVIX chunks of the same maximum size */
+#define AVI_RIFF_MAX (1<<30)
+
+/* AVI_IDX1_MAX: The maximum number of entries of the classic idx1 index,
+    which is kept in memory while writing the first RIFF chunk */
+#define AVI_IDX1_MAX 65536
+
+/* AVI_STD_INDEX_SIZE: The number of entries after which a standard
+    index (ix##) of a stream is written to the file */
+#define AVI_STD_INDEX_SIZE 16384
+
+/* AVI_SUPER_INDEX_SIZE: The maximum number of entries of the super
+    index (indx) of a stream. Every entry references one standard index,
+    i.e. at most one RIFF chunk or AVI_STD_INDEX_SIZE frames */
+#define AVI_SUPER_INDEX_SIZE 1024
 
 /* HEADERBYTES: The number of bytes to reserve for the header */
-#define HEADERBYTES 2048
+#define HEADERBYTES (2048 + 2*(32+16*AVI_SUPER_INDEX_SIZE))
 
 #define PAD_EVEN(x) ( ((x)+1) & ~1 )
 
@@ -64,13 +82,28 @@ static void long2str (uint8_t *dst, int n)
    also working on big endian machines */
 static unsigned long str2ulong (uint8_t *str)
 {
-   return (str[0] | (str[1]<<8) | (str[2]<<16) | (str[3]<<24));
+   return (str[0] | (str[1]<<8) | (str[2]<<16) | ((unsigned long)str[3]<<24));
 }
 static unsigned long str2ushort (uint8_t *str)
 {
    return (str[0] | (str[1]<<8));
 }
 
+/* Same for 8 byte numbers */
+static void long2str64 (uint8_t *dst, int64_t n)
+{
+   long2str (dst  ,(int)(n & 0xffffffff));
+   long2str (dst+4,(int)(n >> 32));
+}
+static int64_t str2ulong64 (uint8_t *str)
+{
+   return (int64_t)str2ulong(str) | ((int64_t)str2ulong(str+4) << 32);
+}
+
+/* Chunk ids of the video and the audio stream and of their indices */
+static const char *avi_tags[2] = {"00db", "01wb"};
+static const char *avi_ix_tags[2] = {"ix00", "ix01"};
+
 /* Calculate audio sample size from number of bits and number of channels.
    This may have to be adjusted for eg. 12 bits and stereo */
 static int avi_sampsize (avi_t *AVI)
@@ -138,6 +171,220 @@ static int avi_add_index_entry (avi_t *AVI, const uint8_t *tag, long flags, long
    return 0;
 }
 
+/* Add the chunk at pos with len data bytes to the standard index of
+   stream s, which must not be full. Returns -1 on error */
+static int avi_ix_add (avi_t *AVI, int s, int64_t pos, long len)
+{
+   avi_odml_index *odml = &AVI->odml[s];
+   uint8_t *entry;
+
+   if (!odml->ix)
+   {
+      odml->ix = (uint8_t *) malloc (24 + AVI_STD_INDEX_SIZE*8);
+      if (odml->ix == 0)
+      {
+         AVI_errno = AVI_ERR_NO_MEM;
+         return -1;
+      }
+   }
+
+   /* The entries are relative to the data of the first chunk. A duplicated
+      frame may reference the previous RIFF chunk, so the offsets still
+      fit in 32 bits */
+   if (odml->n_ix == 0)
+   {
+      odml->ix_base = pos+8;
+      odml->ix_duration = 0;
+   }
+   entry = odml->ix + 24 + odml->n_ix*8;
+   long2str (entry  ,pos+8 - odml->ix_base);
+   long2str (entry+4,len);      /* Bit 31 not set: key frame */
+   odml->n_ix++;
+
+   if (s == 0)
+      odml->ix_duration++;
+   else
+      odml->ix_duration += len/avi_sampsize(AVI);
+
+   return 0;
+}
+
+/* Write the standard index of stream s as an ix## chunk to the
+   current movi list and add it to the super index.
+   Returns -1 on error */
+static int avi_ix_flush (avi_t *AVI, int s)
+{
+   avi_odml_index *odml = &AVI->odml[s];
+   avi_super_entry *se;
+   long len;
+
+   if (odml->n_ix == 0) return 0;
+
+   if (odml->n_super >= AVI_SUPER_INDEX_SIZE)
+   {
+      AVI_errno = AVI_ERR_SIZELIM;
+      return -1;
+   }
+   if (odml->n_super >= odml->max_super)
+   {
+      void *ptr = realloc ((void *)odml->super,
+                           (odml->max_super+64)*sizeof(avi_super_entry));
+      if (ptr == 0)
+      {
+         AVI_errno = AVI_ERR_NO_MEM;
+         return -1;
+      }
+      odml->max_super += 64;
+      odml->super = (avi_super_entry *) ptr;
+   }
+
+   /* The standard index header */
+   len = 24 + odml->n_ix*8;
+   odml->ix[0] = 2;                     /* wLongsPerEntry */
+   odml->ix[1] = 0;
+   odml->ix[2] = 0;                     /* bIndexSubType */
+   odml->ix[3] = 1;                     /* bIndexType: AVI_INDEX_OF_CHUNKS */
+   long2str (odml->ix+4,odml->n_ix);    /* nEntriesInUse */
+   memcpy (odml->ix+8,avi_tags[s],4);   /* dwChunkId */
+   long2str64 (odml->ix+12,odml->ix_base); /* qwBaseOffset */
+   long2str (odml->ix+20,0);            /* dwReserved */
+
+   se = &odml->super[odml->n_super];
+   se->offset = AVI->pos;
+   if (lseek (AVI->fdes,AVI->pos,SEEK_SET) < 0 ||
+       avi_add_chunk (AVI,(const uint8_t*)avi_ix_tags[s],odml->ix,len))
+   {
+      AVI_errno = AVI_ERR_WRITE;
+      return -1;
+   }
+   se->size = 8 + len;
+   se->duration = odml->ix_duration;
+   se->first = 0;
+   se->entries = NULL;
+   odml->n_super++;
+   odml->n_ix = 0;
+
+   return 0;
+}
+
+/* Finish the current RIFF chunk: Flush the standard indices, write idx1
+   for the first RIFF chunk and set the lengths of a RIFF-AVIX chunk.
+   Returns -1 on error */
+static int avi_riff_finish (avi_t *AVI)
+{
+   uint8_t c[4];
+   int ret = 0;
+
+   /* On errors the lengths are still set, so that the data
+      written so far remains readable */
+   if (avi_ix_flush (AVI,0)) ret = -1;
+   if (avi_ix_flush (AVI,1)) ret = -1;
+
+   if (AVI->n_riff == 0)
+   {
+      /* Already finished, but starting the next chunk failed? */
+      if (AVI->riff0_len) return ret;
+
+      AVI->movi0_len = AVI->pos - HEADERBYTES + 4;
+      AVI->riff0_frames = AVI->video_frames;
+
+      /* A failing idx1 is only reported, the OpenDML index is still
+         present and the file remains usable */
+      if (avi_add_chunk (AVI,(const uint8_t*)"idx1",(void*)AVI->idx,AVI->n_idx*16))
+      {
+         AVI->idx1_error = 1;
+         AVI_errno = AVI_ERR_WRITE_INDEX;
+      }
+      AVI->riff0_len = AVI->pos - 8;
+
+      if (AVI->idx) free (AVI->idx);
+      AVI->idx = NULL;
+      AVI->n_idx = AVI->max_idx = 0;
+   }
+   else
+   {
+      long2str (c,AVI->pos - AVI->riff_start - 8);
+      if (pwrite (AVI->fdes,c,4,AVI->riff_start+4) != 4)
+      {
+         AVI_errno = AVI_ERR_WRITE;
+         ret = -1;
+      }
+      long2str (c,AVI->pos - AVI->riff_start - 20);
+      if (pwrite (AVI->fdes,c,4,AVI->riff_start+16) != 4)
+      {
+         AVI_errno = AVI_ERR_WRITE;
+         ret = -1;
+      }
+   }
+   return ret;
+}
+
+/* Start a new RIFF-AVIX chunk with a movi list, the lengths
+   are set by avi_riff_finish(). Returns -1 on error */
+static int avi_riff_start (avi_t *AVI)
+{
+   uint8_t c[24];
+
+   memcpy (c,"RIFF",4);
+   long2str (c+4,0);
+   memcpy (c+8,"AVIX",4);
+   memcpy (c+12,"LIST",4);
+   long2str (c+16,0);
+   memcpy (c+20,"movi",4);
+
+   if (lseek (AVI->fdes,AVI->pos,SEEK_SET) < 0 ||
+       write (AVI->fdes,c,24) != 24)
+   {
+      lseek (AVI->fdes,AVI->pos,SEEK_SET);
+      AVI_errno = AVI_ERR_WRITE;
+      return -1;
+   }
+   AVI->riff_start = AVI->pos;
+   AVI->pos += 24;
+   AVI->n_riff++;
+
+   return 0;
+}
+
+/* Make sure that a chunk with bytes data bytes for stream s can be added:
+   Start a new RIFF chunk if the current one would get too large and
+   write the standard index if it is full. One super index entry per
+   stream is kept for avi_close_output_file().
+   Returns -1 on error */
+static int avi_check_space (avi_t *AVI, int s, long bytes)
+{
+   avi_odml_index *odml = AVI->odml;
+   int64_t need;
+
+   /* Size of the RIFF chunk with the chunk and the pending indices */
+   need = AVI->pos - AVI->riff_start + 8 + PAD_EVEN(bytes) +
+      32 + (odml[0].n_ix+1)*8 + 32 + (odml[1].n_ix+1)*8;
+   if (AVI->n_riff == 0)
+      need += 8 + (AVI->n_idx+1)*16;
+
+   if (need > AVI_RIFF_MAX || (AVI->n_riff == 0 && AVI->n_idx >= AVI_IDX1_MAX))
+   {
+      if (PAD_EVEN(bytes) > AVI_RIFF_MAX - 4096 ||
+          odml[0].n_super >= AVI_SUPER_INDEX_SIZE-1 ||
+          odml[1].n_super >= AVI_SUPER_INDEX_SIZE-1)
+      {
+         AVI_errno = AVI_ERR_SIZELIM;
+         return -1;
+      }
+      if (avi_riff_finish (AVI) || avi_riff_start (AVI)) return -1;
+   }
+   else if (odml[s].n_ix >= AVI_STD_INDEX_SIZE)
+   {
+      if (odml[s].n_super >= AVI_SUPER_INDEX_SIZE-1)
+      {
+         AVI_errno = AVI_ERR_SIZELIM;
+         return -1;
+      }
+      if (avi_ix_flush (AVI,s)) return -1;
+   }
+   return 0;
+}
+
 /*
    AVI_open_output_file: Open an AVI File and write a bunch
                          of zero bytes as space for the header.
@@ -148,7 +395,7 @@ avi_t* AVI_open_output_file (const char * filename)
 {
    avi_t *AVI;
    int i;
-   uint8_t AVI_header[HEADERBYTES];
+   uint8_t *AVI_header;
 
    /* Allocate the avi_t struct and zero it */
    AVI = (avi_t *) malloc(sizeof(avi_t));
@@ -172,9 +419,16 @@ avi_t* AVI_open_output_file (const char * filename)
 
    /* Write out HEADERBYTES bytes, the header will go here
       when we are finished with writing */
-   for (i=0;i<HEADERBYTES;i++)
-       AVI_header[i] = 0;
+   AVI_header = (uint8_t *) calloc (1,HEADERBYTES);
+   if (AVI_header==0)
+   {
+      close (AVI->fdes);
+      AVI_errno = AVI_ERR_NO_MEM;
+      free (AVI);
+      return 0;
+   }
    i = write (AVI->fdes,AVI_header,HEADERBYTES);
+   free (AVI_header);
    if (i != HEADERBYTES)
    {
       close (AVI->fdes);
@@ -225,6 +479,34 @@ void AVI_set_audio (avi_t *AVI, int channels, long rate, int bits, int format)
    } \
    nhb += 2
 
+#define OUTQUAD(n) \
+   if (nhb<=HEADERBYTES-8) long2str64 (AVI_header+nhb,n); nhb += 8
+
+/* Output the OpenDML super index of stream s,
+   returns the new header length */
+static long avi_out_super_index (avi_t *AVI, uint8_t *AVI_header, long nhb, int s)
+{
+   avi_odml_index *odml = &AVI->odml[s];
+   long i;
+
+   OUT4CC ("indx");
+   OUTLONG(24 + odml->n_super*16); /* # of bytes to follow */
+   OUTSHRT(4);                  /* wLongsPerEntry */
+   OUTSHRT(0);                  /* bIndexSubType, bIndexType: AVI_INDEX_OF_INDEXES */
+   OUTLONG(odml->n_super);      /* nEntriesInUse */
+   OUT4CC (avi_tags[s]);        /* dwChunkId */
+   OUTLONG(0);                  /* dwReserved */
+   OUTLONG(0);
+   OUTLONG(0);
+   for (i=0; i<odml->n_super; i++)
+   {
+      OUTQUAD(odml->super[i].offset);   /* qwOffset */
+      OUTLONG(odml->super[i].size);     /* dwSize */
+      OUTLONG(odml->super[i].duration); /* dwDuration */
+   }
+   return nhb;
+}
+
 /*
   Write the header of an AVI file and close it.
   returns 0 on success, -1 on write error.
@@ -232,25 +514,29 @@ void AVI_set_audio (avi_t *AVI, int channels, long rate, int bits, int format)
 static int avi_close_output_file (avi_t *AVI)
 {
 
-   int ret, njunk, sampsize, ms_per_frame, idxerror, flag;
-   int movi_len, hdrl_start, strl_start;
-   uint8_t AVI_header[HEADERBYTES];
+   int njunk, sampsize, ms_per_frame, idxerror, flag, i;
+   int hdrl_start, strl_start;
+   uint8_t *AVI_header;
    long nhb;
 
-   /* Calculate length of movi list */
-   movi_len = AVI->pos - HEADERBYTES + 4;
-
-   /* Try to ouput the index entries. This may fail e.g. if no space
-      is left on device. We will report this as an error, but we still
-      try to write the header correctly (so that the file still may be
-      readable in the most cases */
+   /* Try to ouput the index entries and finish the last RIFF chunk.
+      This may fail e.g. if no space is left on device. We will report
+      this as an error, but we still try to write the header correctly
+      (so that the file still may be readable in the most cases */
    idxerror = 0;
-   ret = avi_add_chunk (AVI,(const uint8_t*)"idx1",(void*)AVI->idx,AVI->n_idx*16);
-   if (ret)
+   if (avi_riff_finish (AVI))
    {
       idxerror = 1;
       AVI_errno = AVI_ERR_WRITE_INDEX;
    }
+   if (AVI->idx1_error) idxerror = 1;
+
+   AVI_header = (uint8_t *) calloc (1,HEADERBYTES);
+   if (AVI_header==0)
+   {
+      AVI_errno = AVI_ERR_NO_MEM;
+      return -1;
+   }
 
    /* Calculate Microseconds per frame */
    if (AVI->fps < 0.001)
@@ -263,7 +549,7 @@ static int avi_close_output_file (avi_t *AVI)
 
    /* The RIFF header */
    OUT4CC ("RIFF");
-   OUTLONG(AVI->pos - 8);    /* # of bytes to follow */
+   OUTLONG(AVI->riff0_len);  /* # of bytes to follow */
    OUT4CC ("AVI ");
 
    /* Start the header list */
@@ -289,10 +575,10 @@ static int avi_close_output_file (avi_t *AVI)
    OUTLONG(0);                  /* PaddingGranularity (whatever that might be) */
                                 /* Other sources call it 'reserved' */
    flag = AVIF_WASCAPTUREFILE;
-   if (!idxerror) flag |= AVIF_HASINDEX;
-   if (!idxerror && AVI->must_use_index) flag |= AVIF_MUSTUSEINDEX;
+   if (!AVI->idx1_error) flag |= AVIF_HASINDEX;
+   if (!AVI->idx1_error && AVI->must_use_index) flag |= AVIF_MUSTUSEINDEX;
    OUTLONG(flag);               /* Flags */
-   OUTLONG(AVI->video_frames);  /* TotalFrames */
+   OUTLONG(AVI->riff0_frames);  /* TotalFrames in the first RIFF chunk */
    OUTLONG(0);                  /* InitialFrames */
    if (AVI->audio_bytes)
       { OUTLONG(2); }           /* Streams */
@@ -348,6 +634,9 @@ static int avi_close_output_file (avi_t *AVI)
    OUTLONG(0);                  /* ClrUsed: Number of colors used */
    OUTLONG(0);                  /* ClrImportant: Number of colors important */
 
+   /* The OpenDML super index */
+   nhb = avi_out_super_index (AVI,AVI_header,nhb,0);
+
    /* Finish stream list, i.e. put number of bytes in the list to proper pos */
    long2str (AVI_header+strl_start-4,nhb-strl_start);
 
@@ -392,11 +681,27 @@ static int avi_close_output_file (avi_t *AVI)
       OUTSHRT(sampsize);             /* BlockAlign */
       OUTSHRT(AVI->a_bits);          /* BitsPerSample */
 
+      /* The OpenDML super index */
+      nhb = avi_out_super_index (AVI,AVI_header,nhb,1);
+
       /* Finish stream list, i.e. put number of bytes in the list to proper pos */
       long2str (AVI_header+strl_start-4,nhb-strl_start);
 
    }
 
+   /* The OpenDML extended header with the number of frames of all
+      RIFF chunks */
+   OUT4CC ("LIST");
+   OUTLONG(4+8+248);            /* Length of list in bytes */
+   OUT4CC ("odml");
+   OUT4CC ("dmlh");
+   OUTLONG(248);                /* # of bytes to follow */
+   OUTLONG(AVI->video_frames);  /* dwTotalFrames */
+   for (i=0; i<61; i++)
+   {
+      OUTLONG(0);               /* Reserved */
+   }
+
    /* Finish header list */
    long2str (AVI_header+hdrl_start-4,nhb-hdrl_start);
 
@@ -408,6 +713,7 @@ static int avi_close_output_file (avi_t *AVI)
       This is a fatal error */
    if (njunk<=0)
    {
+      free (AVI_header);
       fprintf (stderr, "AVI_close_output_file: # of header bytes too small\n");
       exit (1);
    }
@@ -419,7 +725,7 @@ static int avi_close_output_file (avi_t *AVI)
 
    /* Start the movi list */
    OUT4CC ("LIST");
-   OUTLONG(movi_len); /* Length of list in bytes */
+   OUTLONG(AVI->movi0_len); /* Length of list in bytes */
    OUT4CC ("movi");
 
    /* Output the header, truncate the file to the number of bytes
@@ -428,9 +734,11 @@ static int avi_close_output_file (avi_t *AVI)
        write (AVI->fdes,AVI_header,HEADERBYTES) != HEADERBYTES ||
        ftruncate(AVI->fdes,AVI->pos) < 0)
    {
+      free (AVI_header);
       AVI_errno = AVI_ERR_CLOSE;
       return -1;
    }
+   free (AVI_header);
 
    if (idxerror) return -1;
 
@@ -447,28 +755,22 @@ static int avi_close_output_file (avi_t *AVI)
 */
 static int avi_write_data (avi_t *AVI, uint8_t *data, long bytes, int audio)
 {
-   int n;
-   uint8_t *tag;
+   int s = audio ? 1 : 0;
+   const uint8_t *tag = (const uint8_t*)avi_tags[s];
+   int64_t pos;
 
-   /* Check for maximum file length */
-   if ((AVI->pos + 8 + bytes + 8 + (AVI->n_idx+1)*16) > AVI_MAX_LEN) {
-      AVI_errno = AVI_ERR_SIZELIM;
-      return -1;
-   }
-
-   /* Add index entry */
-   if (audio) {
-      tag = (uint8_t*)"01wb";
-      n = avi_add_index_entry (AVI,tag,0x00,AVI->pos,bytes);
-   } else {
-      tag = (uint8_t*)"00db";
-      n = avi_add_index_entry (AVI,tag,0x10,AVI->pos,bytes);
-   }
-   if (n) return -1;
+   /* Start a new RIFF chunk / flush the index if necessary */
+   if (avi_check_space (AVI,s,bytes)) return -1;
 
    /* Output tag and data */
-   n = avi_add_chunk (AVI,tag,data,bytes);
-   if (n) return -1;
+   pos = AVI->pos;
+   if (avi_add_chunk (AVI,tag,data,bytes)) return -1;
+
+   /* Add index entries, idx1 only for the first RIFF chunk */
+   if (AVI->n_riff == 0 &&
+       avi_add_index_entry (AVI,tag,audio ? 0x00 : 0x10,pos,bytes))
+      return -1;
+   if (avi_ix_add (AVI,s,pos,bytes)) return -1;
 
    return 0;
 }
@@ -477,11 +779,13 @@ int AVI_write_frame_start (avi_t *AVI, long length)
 {
    if (AVI->mode==AVI_MODE_READ) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
 
-   AVI->cur_pos = AVI->pos;
+   if (avi_write_data(AVI,NULL,length,0)) return -1;
+
+   /* avi_write_data() may have written an index or a new RIFF chunk
+      before the frame */
+   AVI->cur_pos = AVI->pos - 8 - PAD_EVEN(length);
    AVI->cur_len = length;
    AVI->cur_written = 0;
-
-   if (avi_write_data(AVI,NULL,length,0)) return -1;
    return 0;
 }
 
@@ -516,7 +820,12 @@ int AVI_dup_frame (avi_t *AVI)
 
    if (AVI->last_pos==0)
        return 0; /* No previous real frame */
-   if (avi_add_index_entry (AVI,(const uint8_t*)"00db",0x10,AVI->last_pos,AVI->last_len))
+   if (avi_check_space (AVI,0,0))
+       return -1;
+   if (AVI->n_riff == 0 &&
+       avi_add_index_entry (AVI,(const uint8_t*)"00db",0x10,AVI->last_pos,AVI->last_len))
+       return -1;
+   if (avi_ix_add (AVI,0,AVI->last_pos,AVI->last_len))
        return -1;
    AVI->video_frames++;
    AVI->must_use_index = 1;
@@ -534,9 +843,20 @@ int AVI_write_audio (avi_t *AVI, uint8_t *data, long bytes)
 
 long AVI_bytes_remain (avi_t *AVI)
 {
+   int64_t remain;
+   long n_super;
+
    if (AVI->mode==AVI_MODE_READ) return 0;
 
-   return (AVI_MAX_LEN - (AVI->pos + 8 + 16*AVI->n_idx));
+   /* Space in the current RIFF chunk and in the RIFF chunks the super
+      index can still reference */
+   n_super = AVI->odml[0].n_super > AVI->odml[1].n_super ?
+      AVI->odml[0].n_super : AVI->odml[1].n_super;
+   remain = AVI_RIFF_MAX - (AVI->pos - AVI->riff_start + 8 + 16*AVI->n_idx) +
+      (int64_t)(AVI_SUPER_INDEX_SIZE-2 - n_super) * AVI_RIFF_MAX;
+   if (remain < 0) return 0;
+   if (remain > LONG_MAX) return LONG_MAX;
+   return remain;
 }
 
 /*******************************************************************
@@ -546,7 +866,8 @@ long AVI_bytes_remain (avi_t *AVI)
  *******************************************************************/
 int AVI_close (avi_t *AVI)
 {
-   int ret;
+   int ret, s;
+   long i;
 
    /* If the file was open for writing, the header and index still have
       to be written */
@@ -560,6 +881,13 @@ int AVI_close (avi_t *AVI)
    if (AVI->idx) free (AVI->idx);
    if (AVI->video_index) free (AVI->video_index);
    if (AVI->audio_index) free (AVI->audio_index);
+   for (s=0; s<2; s++)
+   {
+      for (i=0; i<AVI->odml[s].n_super; i++)
+         if (AVI->odml[s].super[i].entries) free (AVI->odml[s].super[i].entries);
+      if (AVI->odml[s].super) free (AVI->odml[s].super);
+      if (AVI->odml[s].ix) free (AVI->odml[s].ix);
+   }
    free (AVI);
 
    return ret;
@@ -579,15 +907,211 @@ int AVI_fileno (avi_t *AVI)
    return 0; \
 }
 
+/* Check if the header list contains an OpenDML super index */
+static int avi_hdrl_has_indx (uint8_t *hdrl_data, long hdrl_len)
+{
+   long i;
+
+   for (i=0; i+8 <= hdrl_len;)
+   {
+      if (strncasecmp((char*)hdrl_data+i,"LIST",4)==0) { i+= 12; continue; }
+      if (strncasecmp((char*)hdrl_data+i,"indx",4)==0) return 1;
+      i += 8 + PAD_EVEN(str2ulong (hdrl_data+i+4));
+   }
+   return 0;
+}
+
+/* Read the OpenDML super index from the data of an indx chunk
+   with n bytes. Returns -1 on memory error */
+static int avi_super_read (avi_odml_index *odml, uint8_t *data, long n)
+{
+   avi_super_entry *se;
+   long i, cnt, first;
+
+   /* Only an index of indices with 4 longs per entry is supported */
+   if (n < 24 || str2ushort(data) != 4 || data[3] != 0 || odml->super)
+      return 0;
+
+   cnt = str2ulong (data+4);
+   if (cnt > (n-24)/16) cnt = (n-24)/16;
+   if (cnt <= 0) return 0;
+
+   odml->super = (avi_super_entry *) calloc (cnt,sizeof(avi_super_entry));
+   if (odml->super==0) return -1;
+   odml->n_super = odml->max_super = cnt;
+
+   first = 0;
+   for (i=0; i<cnt; i++)
+   {
+      se = &odml->super[i];
+      se->offset   = str2ulong64 (data+24+i*16);
+      se->size     = str2ulong (data+24+i*16+ 8);
+      se->duration = str2ulong (data+24+i*16+12);
+      se->first    = first;
+      first += se->duration;
+   }
+   return 0;
+}
+
+/* Read the standard index chunk referenced by se. Allocates at least min
+   entries for se->entries, not used ones are set to 0.
+   Returns the number of entries read or -1 on error */
+static long avi_ix_read (avi_t *AVI, avi_super_entry *se, long min)
+{
+   uint8_t *data;
+   int64_t base;
+   long i, cnt, len;
+
+   if (se->size < 32 || se->size > 64*1024*1024)
+   {
+      AVI_errno = AVI_ERR_NO_IDX;
+      return -1;
+   }
+   data = (uint8_t *) malloc (se->size);
+   if (data==0)
+   {
+      AVI_errno = AVI_ERR_NO_MEM;
+      return -1;
+   }
+   if (pread (AVI->fdes,data,se->size,se->offset) != (ssize_t)se->size)
+   {
+      free (data);
+      AVI_errno = AVI_ERR_READ;
+      return -1;
+   }
+
+   /* Only an index of chunks with 2 longs per entry is supported */
+   if (strncasecmp((char*)data,"ix",2) != 0 ||
+       str2ushort(data+8) != 2 || data[11] != 1)
+   {
+      free (data);
+      AVI_errno = AVI_ERR_NO_IDX;
+      return -1;
+   }
+   cnt = str2ulong (data+12);
+   if (cnt > (long)(se->size-32)/8) cnt = (se->size-32)/8;
+   base = str2ulong64 (data+20);
+
+   len = cnt > min ? cnt : min;
+   se->entries = (video_index_entry *) calloc (len > 0 ? len : 1,sizeof(video_index_entry));
+   if (se->entries==0)
+   {
+      free (data);
+      AVI_errno = AVI_ERR_NO_MEM;
+      return -1;
+   }
+   for (i=0; i<cnt; i++)
+   {
+      se->entries[i].pos = base + str2ulong (data+32+i*8);
+      se->entries[i].len = str2ulong (data+32+i*8+4) & 0x7fffffff;
+   }
+   free (data);
+
+   return cnt;
+}
+
+/* Return the index entry of video frame frame or NULL on error.
+   OpenDML standard indices are loaded on first access. */
+static video_index_entry *avi_video_entry (avi_t *AVI, long frame)
+{
+   avi_odml_index *odml = &AVI->odml[0];
+   avi_super_entry *se;
+   long n0, n1, n;
+
+   if (AVI->video_index) return &AVI->video_index[frame];
+
+   /* Binary search in the super index */
+   n0 = 0;
+   n1 = odml->n_super;
+
+   while (n0 < n1-1)
+   {
+      n = (n0+n1)/2;
+      if (odml->super[n].first > frame)
+         n1 = n;
+      else
+         n0 = n;
+   }
+
+   se = &odml->super[n0];
+   if (!se->entries && avi_ix_read (AVI,se,se->duration) < 0) return NULL;
+   return &se->entries[frame - se->first];
+}
+
+/* Check if a video index is available, AVI_errno is set if not */
+static int avi_has_video_index (avi_t *AVI)
+{
+   if (AVI->video_index || AVI->odml[0].n_super) return 1;
+   AVI_errno = AVI_ERR_NO_IDX;
+   return 0;
+}
+
+/* Check if an audio index is available. The audio index of OpenDML
+   files is build from the standard indices on first use. */
+static int avi_has_audio_index (avi_t *AVI)
+{
+   avi_odml_index *odml = &AVI->odml[1];
+   avi_super_entry *se;
+   void *ptr;
+   long i, j, cnt, tot;
+
+   if (AVI->audio_index) return 1;
+   if (!odml->n_super)
+   {
+      AVI_errno = AVI_ERR_NO_IDX;
+      return 0;
+   }
+
+   tot = 0;
+   AVI->audio_chunks = 0;
+   for (i=0; i<odml->n_super; i++)
+   {
+      se = &odml->super[i];
+      if ((cnt = avi_ix_read (AVI,se,0)) < 0) break;
+
+      ptr = realloc ((void *)AVI->audio_index,
+                     (AVI->audio_chunks+cnt+1)*sizeof(audio_index_entry));
+      if (ptr==0)
+      {
+         AVI_errno = AVI_ERR_NO_MEM;
+         break;
+      }
+      AVI->audio_index = (audio_index_entry *) ptr;
+      for (j=0; j<cnt; j++)
+      {
+         AVI->audio_index[AVI->audio_chunks].pos = se->entries[j].pos;
+         AVI->audio_index[AVI->audio_chunks].len = se->entries[j].len;
+         AVI->audio_index[AVI->audio_chunks].tot = tot;
+         tot += se->entries[j].len;
+         AVI->audio_chunks++;
+      }
+      free (se->entries);
+      se->entries = NULL;
+   }
+   if (i < odml->n_super || !AVI->audio_chunks)
+   {
+      if (AVI->audio_index) free (AVI->audio_index);
+      AVI->audio_index = NULL;
+      AVI->audio_chunks = 0;
+      if (i >= odml->n_super) AVI_errno = AVI_ERR_NO_IDX;
+      return 0;
+   }
+   AVI->audio_bytes = tot;
+
+   return 1;
+}
+
 avi_t *AVI_open_input_file (const char *filename, int getIndex)
 {
    avi_t *AVI;
    long i, n, rate, scale, idx_type;
    uint8_t *hdrl_data;
    long hdrl_len = 0;
-   long nvi, nai, ioff;
+   long nvi, nai;
+   int64_t ioff;
    long tot;
    int lasttag = 0;
+   int strl_type = 0;
    int vids_strh_seen = 0;
    int vids_strf_seen = 0;
    int auds_strh_seen = 0;
@@ -647,6 +1171,11 @@ avi_t *AVI_open_input_file (const char *filename, int getIndex)
          else if (strncasecmp((char*)data,"movi",4) == 0)
          {
             AVI->movi_start = lseek (AVI->fdes,0,SEEK_CUR);
+
+            /* With an OpenDML index neither idx1 nor the
+               RIFF-AVIX chunks are needed */
+            if (getIndex && hdrl_data && avi_hdrl_has_indx (hdrl_data,hdrl_len))
+               break;
             lseek (AVI->fdes,n,SEEK_CUR);
          }
          else
@@ -704,6 +1233,7 @@ avi_t *AVI_open_input_file (const char *filename, int getIndex)
          }
          else
             lasttag = 0;
+         strl_type = lasttag;
          num_stream++;
       }
       else if (strncasecmp((char*)hdrl_data+i,"strf",4) == 0)
@@ -725,6 +1255,17 @@ avi_t *AVI_open_input_file (const char *filename, int getIndex)
          }
          lasttag = 0;
       }
+      else if (strncasecmp((char*)hdrl_data+i,"indx",4) == 0)
+      {
+         i += 8;
+         if (getIndex && strl_type &&
+             avi_super_read (&AVI->odml[strl_type-1],hdrl_data+i,n))
+         {
+            free (hdrl_data);
+            ERR_EXIT(AVI_ERR_NO_MEM)
+         }
+         lasttag = 0;
+      }
       else
       {
          i += 8;
@@ -757,6 +1298,22 @@ avi_t *AVI_open_input_file (const char *filename, int getIndex)
    /* get index if wanted */
    if (!getIndex) return AVI;
 
+   /* With an OpenDML super index, the standard indices are
+      only read when they are needed */
+   if (AVI->odml[0].n_super)
+   {
+      avi_super_entry *se = &AVI->odml[0].super[AVI->odml[0].n_super-1];
+
+      AVI->video_frames = se->first + se->duration;
+      if (AVI->video_frames==0) ERR_EXIT(AVI_ERR_NO_VIDS)
+      if (AVI->idx) free (AVI->idx);
+      AVI->idx = NULL;
+      AVI->n_idx = AVI->max_idx = 0;
+
+      AVI->video_pos = 0;
+      return AVI;
+   }
+
    /* if the file has an idx1, check if this is relative
       to the start of the file or to the start of the movi list */
    idx_type = 0;
@@ -804,8 +1361,10 @@ avi_t *AVI_open_input_file (const char *filename, int getIndex)
          if (read(AVI->fdes,data,8) != 8) break;
          n = str2ulong (data+4);
 
-         /* The movi list may contain sub-lists, ignore them */
-         if (strncasecmp((char*)data,"LIST",4) == 0)
+         /* The movi list may contain sub-lists, ignore them,
+            same for the RIFF-AVIX chunks of OpenDML files */
+         if (strncasecmp((char*)data,"LIST",4) == 0 ||
+             strncasecmp((char*)data,"RIFF",4) == 0)
          {
             lseek (AVI->fdes,4,SEEK_CUR);
             continue;
@@ -923,11 +1482,28 @@ long AVI_audio_bytes (avi_t *AVI)
 
 long AVI_frame_size (avi_t *AVI, long frame)
 {
+   video_index_entry *entry;
+
    if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
-   if (!AVI->video_index)         { AVI_errno = AVI_ERR_NO_IDX;   return -1; }
+   if (!avi_has_video_index(AVI)) return -1;
 
    if (frame < 0 || frame >= AVI->video_frames) return 0;
-   return (AVI->video_index[frame].len);
+   if (!(entry = avi_video_entry (AVI,frame))) return -1;
+   return (entry->len);
+}
+
+/* AVI_frame_pos: File position of the data of frame, 0 if frame
+                  does not exist, -1 on error */
+int64_t AVI_frame_pos (avi_t *AVI, long frame)
+{
+   video_index_entry *entry;
+
+   if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
+   if (!avi_has_video_index(AVI)) return -1;
+
+   if (frame < 0 || frame >= AVI->video_frames) return 0;
+   if (!(entry = avi_video_entry (AVI,frame))) return -1;
+   return (entry->pos);
 }
 
 int AVI_seek_start (avi_t *AVI)
@@ -942,7 +1518,7 @@ int AVI_seek_start (avi_t *AVI)
 int AVI_set_video_position (avi_t *AVI, long frame)
 {
    if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
-   if (!AVI->video_index)         { AVI_errno = AVI_ERR_NO_IDX;   return -1; }
+   if (!avi_has_video_index(AVI)) return -1;
 
    if (frame < 0 ) frame = 0;
    AVI->video_pos = frame;
@@ -952,15 +1528,17 @@ int AVI_set_video_position (avi_t *AVI, long frame)
 
 long AVI_read_frame (avi_t *AVI, uint8_t *vidbuf)
 {
+   video_index_entry *entry;
    long n;
 
    if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
-   if (!AVI->video_index)         { AVI_errno = AVI_ERR_NO_IDX;   return -1; }
+   if (!avi_has_video_index(AVI)) return -1;
 
    if (AVI->video_pos < 0 || AVI->video_pos >= AVI->video_frames) return 0;
-   n = AVI->video_index[AVI->video_pos].len;
+   if (!(entry = avi_video_entry (AVI,AVI->video_pos))) return -1;
+   n = entry->len;
 			
-   lseek (AVI->fdes, AVI->video_index[AVI->video_pos].pos, SEEK_SET);
+   lseek (AVI->fdes, entry->pos, SEEK_SET);
    if (read(AVI->fdes,vidbuf,n) != n)
    {
       AVI_errno = AVI_ERR_READ;
@@ -977,7 +1555,7 @@ int AVI_set_audio_position (avi_t *AVI, long byte)
    long n0, n1, n;
 
    if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
-   if (!AVI->audio_index)         { AVI_errno = AVI_ERR_NO_IDX;   return -1; }
+   if (!avi_has_audio_index(AVI)) return -1;
 
    if (byte < 0) byte = 0;
 
@@ -1002,10 +1580,11 @@ int AVI_set_audio_position (avi_t *AVI, long byte)
 
 long AVI_read_audio (avi_t *AVI, uint8_t *audbuf, long bytes)
 {
-   long nr, pos, left, todo;
+   long nr, left, todo;
+   int64_t pos;
 
    if (AVI->mode==AVI_MODE_WRITE) { AVI_errno = AVI_ERR_NOT_PERM; return -1; }
-   if (!AVI->audio_index)         { AVI_errno = AVI_ERR_NO_IDX;   return -1; }
+   if (!avi_has_audio_index(AVI)) return -1;
 
    nr = 0; /* total number of bytes read */
 
@@ -1063,8 +1642,9 @@ int AVI_read_data (avi_t *AVI, uint8_t *vidbuf, long max_vidbuf,
       /* Read tag and length */
       if (read(AVI->fdes,data,8) != 8) return 0;
 
-      /* if we got a list tag, ignore it */
-      if (strncasecmp((char*)data,"LIST",4) == 0)
+      /* if we got a list tag or a RIFF-AVIX chunk, ignore it */
+      if (strncasecmp((char*)data,"LIST",4) == 0 ||
+          strncasecmp((char*)data,"RIFF",4) == 0)
       {
          lseek (AVI->fdes,4,SEEK_CUR);
          continue;
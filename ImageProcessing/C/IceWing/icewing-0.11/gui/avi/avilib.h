@@ -21,17 +21,41 @@
 
 typedef struct
 {
-   long pos;
+   int64_t pos;
    long len;
 } video_index_entry;
 
 typedef struct
 {
-   long pos;
+   int64_t pos;
    long len;
    long tot;
 } audio_index_entry;
 
+/* One entry of an OpenDML super index (indx chunk) */
+typedef struct
+{
+   int64_t  offset;          /* Position of the standard index (ix##) chunk */
+   uint32_t size;            /* Size of the chunk including its header */
+   uint32_t duration;        /* Frames (video) / samples (audio) it covers */
+   long     first;           /* Reading: Number of the first frame */
+   video_index_entry *entries; /* Reading: Entries, loaded on first access */
+} avi_super_entry;
+
+/* OpenDML index of one stream */
+typedef struct
+{
+   avi_super_entry *super;   /* Super index */
+   long     n_super;         /* Number of super index entries in use */
+   long     max_super;       /* Number of super index entries allocated */
+
+   uint8_t  *ix;             /* Writing: Standard index (header and entries),
+                                which is not yet written to the file */
+   long     n_ix;            /* Writing: Number of entries in ix */
+   int64_t  ix_base;         /* Writing: Base offset of the entries in ix */
+   uint32_t ix_duration;     /* Writing: Frames / samples covered by ix */
+} avi_odml_index;
+
 typedef struct
 {
    long   fdes;              /* File descriptor of AVI file */
@@ -58,18 +82,26 @@ typedef struct
    long   audio_posc;        /* Audio position: chunk */
    long   audio_posb;        /* Audio position: byte within chunk */
 
-   long   pos;               /* position in file */
+   int64_t pos;              /* position in file */
    long   n_idx;             /* number of index entries actually filled */
    long   max_idx;           /* number of index entries actually allocated */
    uint8_t (*idx)[16];          /* index entries (AVI idx1 tag) */
    video_index_entry * video_index;
    audio_index_entry * audio_index;
-   long   last_pos;          /* Position of last frame written */
+   int64_t last_pos;         /* Position of last frame written */
    long   last_len;          /* Length of last frame written */
    int    must_use_index;    /* Flag if frames are duplicated */
-   long   movi_start;
+   int64_t movi_start;
+
+   avi_odml_index odml[2];   /* OpenDML index of video (0) and audio (1) */
+   int    n_riff;            /* Number of RIFF-AVIX chunks */
+   int64_t riff_start;       /* Start of the current RIFF-AVIX chunk */
+   int64_t riff0_len;        /* Length of the first RIFF-AVI chunk */
+   int64_t movi0_len;        /* Length of the movi list of the first RIFF */
+   long   riff0_frames;      /* Number of video frames in the first RIFF */
+   int    idx1_error;        /* Writing the idx1 chunk failed */
 
-   long cur_pos;             /* For incremental frame writing */
+   int64_t cur_pos;          /* For incremental frame writing */
    long cur_len;
    long cur_written;
 } avi_t;
@@ -167,6 +199,7 @@ long AVI_audio_rate (avi_t *AVI);
 long AVI_audio_bytes (avi_t *AVI);
 
 long AVI_frame_size (avi_t *AVI, long frame);
+int64_t AVI_frame_pos (avi_t *AVI, long frame);
 int  AVI_seek_start (avi_t *AVI);
 int  AVI_set_video_position (avi_t *AVI, long frame);
 long AVI_read_frame (avi_t *AVI, uint8_t *vidbuf);
@@ -288,11 +288,15 @@ static void my_error_exit (j_common_ptr cinfo)
 #define MAX_LUMA_WIDTH   4096
 #define MAX_CHROMA_WIDTH 2048
 
-static unsigned char buf0[16][MAX_LUMA_WIDTH];
-static unsigned char buf1[8][MAX_CHROMA_WIDTH];
-static unsigned char buf2[8][MAX_CHROMA_WIDTH];
-static unsigned char chr1[8][MAX_CHROMA_WIDTH];
-static unsigned char chr2[8][MAX_CHROMA_WIDTH];
+/* Scratch rows of decode_jpeg_raw(), allocated per call so that
+   several threads can decode at the same time. */
+typedef struct {
+   unsigned char buf0[16][MAX_LUMA_WIDTH];
+   unsigned char buf1[8][MAX_CHROMA_WIDTH];
+   unsigned char buf2[8][MAX_CHROMA_WIDTH];
+   unsigned char chr1[8][MAX_CHROMA_WIDTH];
+   unsigned char chr2[8][MAX_CHROMA_WIDTH];
+} jpegScratch;
 
 
 
@@ -438,20 +442,26 @@ int decode_jpeg_raw (unsigned char *jpeg_data, int len,
    int numfields, hsf[3], vsf[3], field, yl, yc, x, y, i, xsl, xsc, xs, xd,
        hdown;
 
-   JSAMPROW row0[16] = { buf0[0], buf0[1], buf0[2], buf0[3],
-      buf0[4], buf0[5], buf0[6], buf0[7],
-      buf0[8], buf0[9], buf0[10], buf0[11],
-      buf0[12], buf0[13], buf0[14], buf0[15]
-   };
-   JSAMPROW row1[8] = { buf1[0], buf1[1], buf1[2], buf1[3],
-      buf1[4], buf1[5], buf1[6], buf1[7]
-   };
-   JSAMPROW row2[8] = { buf2[0], buf2[1], buf2[2], buf2[3],
-      buf2[4], buf2[5], buf2[6], buf2[7]
-   };
+   JSAMPROW row0[16], row1[8], row2[8];
    JSAMPARRAY scanarray[3];
    struct jpeg_decompress_struct dinfo;
    struct my_error_mgr jerr;
+   jpegScratch *scratch;
+   unsigned char (*chr1)[MAX_CHROMA_WIDTH], (*chr2)[MAX_CHROMA_WIDTH];
+
+   scratch = malloc (sizeof(jpegScratch));
+   if (!scratch) {
+      fprintf (stderr, "Out of memory for JPEG decompression\n");
+      return -1;
+   }
+   for (i = 0; i < 16; i++)
+      row0[i] = scratch->buf0[i];
+   for (i = 0; i < 8; i++) {
+      row1[i] = scratch->buf1[i];
+      row2[i] = scratch->buf2[i];
+   }
+   chr1 = scratch->chr1;
+   chr2 = scratch->chr2;
 
    scanarray[0] = row0;
    scanarray[1] = row1;
@@ -465,6 +475,7 @@ int decode_jpeg_raw (unsigned char *jpeg_data, int len,
    if (setjmp (jerr.setjmp_buffer)) {
       /* If we get here, the JPEG code has signaled an error. */
       jpeg_destroy_decompress (&dinfo);
+      free (scratch);
       return -1;
    }
 
@@ -650,10 +661,12 @@ int decode_jpeg_raw (unsigned char *jpeg_data, int len,
    }
 
    jpeg_destroy_decompress (&dinfo);
+   free (scratch);
    return 0;
 
  ERR_EXIT:
    jpeg_destroy_decompress (&dinfo);
+   free (scratch);
    return -1;
 }
 
@@ -682,17 +695,9 @@ int encode_jpeg_raw (unsigned char *jpeg_data, int len, int quality,
 {
    int numfields, field, yl, yc, y, i;
 
-   JSAMPROW row0[16] = { buf0[0], buf0[1], buf0[2], buf0[3],
-      buf0[4], buf0[5], buf0[6], buf0[7],
-      buf0[8], buf0[9], buf0[10], buf0[11],
-      buf0[12], buf0[13], buf0[14], buf0[15]
-   };
-   JSAMPROW row1[8] = { buf1[0], buf1[1], buf1[2], buf1[3],
-      buf1[4], buf1[5], buf1[6], buf1[7]
-   };
-   JSAMPROW row2[8] = { buf2[0], buf2[1], buf2[2], buf2[3],
-      buf2[4], buf2[5], buf2[6], buf2[7]
-   };
+   /* The rows point directly into raw0/raw1/raw2 (see below),
+      no scratch buffers are needed. */
+   JSAMPROW row0[16] = { NULL }, row1[8] = { NULL }, row2[8] = { NULL };
    JSAMPARRAY scanarray[3];
 
    struct jpeg_compress_struct cinfo;
@@ -0,0 +1,684 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "main/image.h"
+#include "main/region.h"
+#include "classify.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define CLASS_AVX2
+#include <immintrin.h>
+#define CLASS_TARGET(t)	__attribute__((target(t)))
+#endif
+
+static int simd_cpu = -1;			/* AVX2 supported by the CPU? */
+static BOOL simd_enabled = TRUE;	/* Set by iw_classify_set_simd() */
+
+/* All opened lookup tables */
+static iwLookup *lookup_list = NULL;
+static pthread_mutex_t lookup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+	const iwClassifyPara *para;
+	int width, height;
+	uchar **planes;
+	int *avg[3];				/* Averaged values of one row */
+} classData;
+
+/*********************************************************************
+  Return entry i of the byte lookup table lookup or, if bits!=NULL, of
+  the bit packed table bits.
+*********************************************************************/
+static inline uchar class_lookup (const uchar *lookup, const uchar *bits, int i)
+{
+	if (bits)
+		return (bits[i >> 3] >> (i & 7)) & 1;
+	return lookup[i];
+}
+
+/*********************************************************************
+  Convert the class values out[start..end-1] for a two class lookup
+  table.
+*********************************************************************/
+static void class_twoclass (uchar *out, int start, int end)
+{
+	for (; start < end; start++)
+		out[start] = (1-out[start])*IW_COLMAX;
+}
+
+/*********************************************************************
+  Return TRUE if the CPU supports AVX2.
+*********************************************************************/
+static BOOL class_simd_cpu (void)
+{
+	if (simd_cpu < 0) {
+		int cpu = 0;
+#ifdef CLASS_AVX2
+		__builtin_cpu_init();
+		cpu = __builtin_cpu_supports ("avx2") ? 1 : 0;
+#endif
+		simd_cpu = cpu;
+	}
+	return simd_cpu;
+}
+
+/*********************************************************************
+  Return TRUE if the AVX2 versions of the row classification should
+  be used.
+*********************************************************************/
+static inline BOOL class_simd (void)
+{
+	return simd_enabled && class_simd_cpu();
+}
+
+#ifdef CLASS_AVX2
+
+/*********************************************************************
+  Return the 16 values s[0..15] as 16 bit values. If pix_cnt>0 each
+  value is averaged over its 4 (pix_cnt==1) or 5 (pix_cnt==2)
+  neighbours like in class_avg_row().
+*********************************************************************/
+static CLASS_TARGET("avx2") __m256i class_load_avx2 (const uchar *s, int width, int pix_cnt)
+{
+	__m256i sum;
+
+	if (pix_cnt <= 0)
+		return _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)s));
+
+	sum = _mm256_add_epi16 (
+		_mm256_add_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(s-1))),
+						  _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(s+1)))),
+		_mm256_add_epi16 (_mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(s-width))),
+						  _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)(s+width)))));
+	if (pix_cnt == 1)
+		return _mm256_srli_epi16 (sum, 2);
+
+	/* sum/5 == (sum*0xCCCD)>>18, exact for sum <= 5*255 */
+	sum = _mm256_add_epi16 (sum, _mm256_cvtepu8_epi16 (_mm_loadu_si128 ((const __m128i*)s)));
+	return _mm256_srli_epi16 (_mm256_mulhi_epu16 (sum, _mm256_set1_epi16 ((short)0xCCCD)), 2);
+}
+
+/*********************************************************************
+  Classify the pixels x..end-1 of row r for the features
+  IW_CLASSIFY_YUV7/UV8 in blocks of 16 pixels. The averages and the
+  table indices are computed in vector registers, only the table
+  lookups are scalar. If para->pix_cnt>0, x>=1, end<=width-1, and
+  0<r<height-1 must hold.
+  Return: The first pixel not classified.
+*********************************************************************/
+static CLASS_TARGET("avx2") int class_row_avx2 (classData *c, int r, int x, int end, uchar *out)
+{
+	const iwClassifyPara *para = c->para;
+	const uchar *lookup = para->lookup, *bits = para->bits;
+	int width = c->width, pix_cnt = para->pix_cnt, off = r*width, i;
+	const uchar *y = c->planes[0]+off, *u = c->planes[1]+off, *v = c->planes[2]+off;
+	gint32 index[16];
+	__m256i vy, vu, vv, idx;
+
+	for (; x+16 <= end; x += 16) {
+		vu = class_load_avx2 (u+x, width, pix_cnt);
+		vv = class_load_avx2 (v+x, width, pix_cnt);
+		if (para->feature == IW_CLASSIFY_YUV7) {
+			vy = _mm256_srli_epi16 (class_load_avx2 (y+x, width, pix_cnt), 1);
+			idx = _mm256_or_si256 (_mm256_slli_epi16 (_mm256_srli_epi16 (vu, 1), 7),
+								   _mm256_srli_epi16 (vv, 1));
+			_mm256_storeu_si256 ((__m256i*)index, _mm256_or_si256 (
+									 _mm256_cvtepu16_epi32 (_mm256_castsi256_si128 (idx)),
+									 _mm256_slli_epi32 (_mm256_cvtepu16_epi32 (
+															_mm256_castsi256_si128 (vy)), 14)));
+			_mm256_storeu_si256 ((__m256i*)(index+8), _mm256_or_si256 (
+									 _mm256_cvtepu16_epi32 (_mm256_extracti128_si256 (idx, 1)),
+									 _mm256_slli_epi32 (_mm256_cvtepu16_epi32 (
+															_mm256_extracti128_si256 (vy, 1)), 14)));
+		} else {
+			idx = _mm256_or_si256 (_mm256_slli_epi16 (vu, 8), vv);
+			_mm256_storeu_si256 ((__m256i*)index,
+								 _mm256_cvtepu16_epi32 (_mm256_castsi256_si128 (idx)));
+			_mm256_storeu_si256 ((__m256i*)(index+8),
+								 _mm256_cvtepu16_epi32 (_mm256_extracti128_si256 (idx, 1)));
+		}
+		if (bits) {
+			for (i=0; i<16; i++)
+				out[x+i] = (bits[index[i] >> 3] >> (index[i] & 7)) & 1;
+		} else {
+			for (i=0; i<16; i++)
+				out[x+i] = lookup[index[i]];
+		}
+	}
+	return x;
+}
+#endif
+
+/*********************************************************************
+  Classify the pixels x..end-1 of row r with the vectorized version if
+  possible.
+  Return: The first pixel not classified.
+*********************************************************************/
+static inline int class_row_simd (classData *c, int r, int x, int end, uchar *out)
+{
+#ifdef CLASS_AVX2
+	if ((c->para->feature == IW_CLASSIFY_YUV7 || c->para->feature == IW_CLASSIFY_UV8)
+		&& class_simd())
+		return class_row_avx2 (c, r, x, end, out);
+#endif
+	return x;
+}
+
+/*********************************************************************
+  Classify row r of the image without any averaging and write the
+  result to out.
+*********************************************************************/
+static void class_row_direct (classData *c, int r, uchar *out)
+{
+	const iwClassifyPara *para = c->para;
+	const uchar *lookup = para->lookup, *bits = para->bits;
+	int width = c->width, off = r*width, x, start = 0, end = width;
+	const uchar *y = c->planes[0]+off, *u = c->planes[1]+off, *v = c->planes[2]+off;
+
+	switch (para->feature) {
+		case IW_CLASSIFY_YUV7:
+			for (x=class_row_simd (c, r, 0, width, out); x<width; x++)
+				out[x] = class_lookup (lookup, bits,
+									   ((y[x]>>1) << 14) | ((u[x]>>1) << 7) | (v[x]>>1));
+			break;
+		case IW_CLASSIFY_UV8:
+			for (x=class_row_simd (c, r, 0, width, out); x<width; x++)
+				out[x] = class_lookup (lookup, bits, (u[x] << 8) | v[x]);
+			break;
+		case IW_CLASSIFY_UV6_PAIR:
+			/* The neighbours are taken from the image in memory order,
+			   only the first and the last image pixel are skipped */
+			if (r == 0) out[start++] = 0;
+			if (r == c->height-1) out[--end] = 0;
+			for (x=start; x<end; x++)
+				out[x] = class_lookup (lookup, bits,
+									   ((u[x-1]>>2) << 18) | ((v[x-1]>>2) << 12) |
+									   ((u[x+1]>>2) << 6) | (v[x+1]>>2));
+			break;
+		default:
+			for (x=0; x<width; x++)
+				out[x] = para->func (para->data, y[x], u[x], v[x]);
+			break;
+	}
+	if (para->twoclass)
+		class_twoclass (out, start, end);
+}
+
+/*********************************************************************
+  Average the pixels start..width-2 of row r of plane s over
+  4 (pix_cnt==1) or 5 (pix_cnt==2) pixels and write the result to avg.
+*********************************************************************/
+static void class_avg_row (const uchar *s, int width, int r, int pix_cnt,
+						   int start, int *avg)
+{
+	int x;
+
+	s += r*width;
+	if (pix_cnt == 2) {
+		for (x=start; x<width-1; x++)
+			avg[x] = (s[x] + s[x-1] + s[x+1] + s[x-width] + s[x+width]) / 5;
+	} else {
+		for (x=start; x<width-1; x++)
+			avg[x] = (s[x-1] + s[x+1] + s[x-width] + s[x+width]) / 4;
+	}
+}
+
+/*********************************************************************
+  Classify row r of the image after averaging over 4 or 5 pixels and
+  write the result to out. Pixels without a full neighborhood are 0.
+*********************************************************************/
+static void class_row_avg (classData *c, int r, uchar *out)
+{
+	const iwClassifyPara *para = c->para;
+	const uchar *lookup = para->lookup, *bits = para->bits;
+	int width = c->width, x, start, end = width-1;
+	int *ay = c->avg[0], *au = c->avg[1], *av = c->avg[2];
+
+	if (r == 0 || r == c->height-1) {
+		memset (out, 0, width);
+		return;
+	}
+	/* Only the remaining pixels must be averaged in C */
+	start = class_row_simd (c, r, 1, end, out);
+	if (para->feature == IW_CLASSIFY_YUV7 || para->feature == IW_CLASSIFY_FUNC)
+		class_avg_row (c->planes[0], width, r, para->pix_cnt, start, ay);
+	class_avg_row (c->planes[1], width, r, para->pix_cnt, start, au);
+	class_avg_row (c->planes[2], width, r, para->pix_cnt, start, av);
+
+	switch (para->feature) {
+		case IW_CLASSIFY_YUV7:
+			for (x=start; x<end; x++)
+				out[x] = class_lookup (lookup, bits,
+									   ((ay[x]>>1) << 14) | ((au[x]>>1) << 7) | (av[x]>>1));
+			break;
+		case IW_CLASSIFY_UV8:
+			for (x=start; x<end; x++)
+				out[x] = class_lookup (lookup, bits, (au[x] << 8) | av[x]);
+			break;
+		case IW_CLASSIFY_UV6_PAIR:
+			/* Pixel x is classified with the pixels x and x+2 */
+			for (end=width-3, x=1; x<end; x++)
+				out[x] = class_lookup (lookup, bits,
+									   ((au[x]>>2) << 18) | ((av[x]>>2) << 12) |
+									   ((au[x+2]>>2) << 6) | (av[x+2]>>2));
+			for (x=end; x<width-1; x++)
+				out[x] = 0;
+			break;
+		default:
+			for (x=1; x<end; x++)
+				out[x] = para->func (para->data, ay[x], au[x], av[x]);
+			break;
+	}
+	if (para->twoclass)
+		class_twoclass (out, 1, end);
+	out[0] = out[width-1] = 0;
+}
+
+/*********************************************************************
+  Median smoothing of one row, rows[0..size*2] are the source rows.
+  Gives the same result as iw_img_median().
+*********************************************************************/
+static void smooth_median_row (const uchar **rows, uchar *out, int width, int size)
+{
+	int h[IW_COLCNT], n = size*2+1, half, half2, i, x;
+	int median, sub, add, left;
+
+	half = (n*n)/2;
+	half2 = (n*n+1)/2;
+
+	memset (h, 0, sizeof(int)*IW_COLCNT);
+	for (i=0; i<n; i++)
+		for (x=0; x<n; x++) h[rows[i][x]]++;
+
+	left = 0;
+	for (median=-1; left<=half; median++) left += h[median+1];
+	left = left - h[median];
+	out[size] = median;
+
+	for (x=0; x<width-n; x++) {
+		for (i=0; i<n; i++) {
+			sub = rows[i][x];
+			add = rows[i][x+n];
+			/* Classification results contain large uniform areas,
+			   skipping them avoids dependent histogram updates */
+			if (sub == add) continue;
+			h[sub]--;
+			h[add]++;
+
+			if (sub < median) left--;
+			if (add < median) left++;
+		}
+		if (left > half) {
+			do {
+				median--;
+				left -= h[median];
+			} while (left > half);
+		} else if (left+h[median] < half2) {
+			do {
+				left += h[median];
+				median++;
+			} while (left+h[median] < half2);
+		}
+		out[size+x+1] = median;
+	}
+}
+
+/*********************************************************************
+  Black/white median smoothing of one row, rows[0..size*2] are the
+  source rows. Gives the same result as iw_img_medianBW().
+*********************************************************************/
+static void smooth_medianBW_row (const uchar **rows, uchar *out, int width, int size)
+{
+	int n = size*2+1, half = (n*n)/2, white = 0, i, x;
+
+	for (i=0; i<n; i++)
+		for (x=0; x<n; x++)
+			if (rows[i][x] > 0) white++;
+	out[size] = white > half ? IW_COLMAX:0;
+
+	for (x=0; x<width-n; x++) {
+		for (i=0; i<n; i++) {
+			if (rows[i][x] > 0) white--;
+			if (rows[i][x+n] > 0) white++;
+		}
+		out[size+x+1] = white > half ? IW_COLMAX:0;
+	}
+}
+
+/*********************************************************************
+  Return the most frequent value of the histogram h, the smallest one
+  if there are several.
+*********************************************************************/
+static int smooth_max_index (const int *h)
+{
+	int i, max = h[0], maxind = 0;
+
+	for (i=1; i<IW_COLCNT; i++) {
+		if (h[i] > max) {
+			max = h[i];
+			maxind = i;
+		}
+	}
+	return maxind;
+}
+
+/*********************************************************************
+  Smoothing of one row by using the most frequent value, rows[0..size*2]
+  are the source rows. Gives the same result as iw_img_max().
+*********************************************************************/
+static void smooth_max_row (const uchar **rows, uchar *out, int width, int size)
+{
+	int h[IW_COLCNT], n = size*2+1, half = (n*n+1)/2, maxind, i, x;
+
+	memset (h, 0, sizeof(int)*IW_COLCNT);
+	for (i=0; i<n; i++)
+		for (x=0; x<n; x++) h[rows[i][x]]++;
+	maxind = smooth_max_index (h);
+	out[size] = maxind;
+
+	for (x=0; x<width-n; x++) {
+		for (i=0; i<n; i++) {
+			int sub = rows[i][x], add = rows[i][x+n];
+			if (sub != add) {
+				h[sub]--;
+				h[add]++;
+			}
+		}
+		/* A value occurring in more than half of the mask is the
+		   maximum, otherwise the histogram must be searched */
+		if (h[maxind] < half)
+			maxind = smooth_max_index (h);
+		out[size+x+1] = maxind;
+	}
+}
+
+/*********************************************************************
+  Row y of the result is completely available in d, finish it by
+  labeling it.
+*********************************************************************/
+static void class_row_done (const iwClassifyPara *para, uchar *d,
+							int width, int height, int y)
+{
+	if (para->label) {
+		uchar *row = d+y*width;
+
+		/* Like iw_img_border(d, width, height, 1) */
+		if (y == 0 || y == height-1)
+			memset (row, 0, width);
+		else
+			row[0] = row[width-1] = 0;
+		iw_reg_label_rows_data (d, y, y+1, para->label_data);
+	}
+}
+
+/*********************************************************************
+  Enable or disable the AVX2 versions of the classification for the
+  features IW_CLASSIFY_YUV7 and IW_CLASSIFY_UV8 (default: enabled).
+  Return: TRUE if the CPU supports AVX2.
+*********************************************************************/
+BOOL iw_classify_set_simd (BOOL enable)
+{
+	simd_enabled = enable;
+	return class_simd_cpu();
+}
+
+/*********************************************************************
+  Initialize para with the defaults: IW_CLASSIFY_FUNC, no averaging,
+  no smoothing, no labeling.
+*********************************************************************/
+void iw_classify_init (iwClassifyPara *para)
+{
+	memset (para, 0, sizeof(iwClassifyPara));
+	para->feature = IW_CLASSIFY_FUNC;
+	para->smooth = IW_CLASSIFY_MEDIAN;
+}
+
+/*********************************************************************
+  Color classification of the YUV image img according to para with
+  an optional neighborhood averaging, smoothing, and region labeling
+  in one pass over the image. Only a few rows are buffered, so the
+  intermediate results stay in the cache. The result is written
+  to d, the image border not covered by the averaging or smoothing
+  is set to 0.
+  Return: Number of regions if para->label!=NULL, otherwise 0.
+*********************************************************************/
+int iw_classify (const iwImage *img, uchar *d, const iwClassifyPara *para)
+{
+	int width = img->width, height = img->height;
+	int size = para->size, n = size*2+1, r, y, i, nregions = 0;
+	void (*class_row) (classData *c, int r, uchar *out);
+	void (*smooth_row) (const uchar **rows, uchar *out, int width, int size);
+	const uchar **rows;
+	uchar *ring;
+	void *buffer;
+	classData c;
+	iw_time_add_static (time_class, "Classify");
+
+	iw_time_start (time_class);
+
+	c.para = para;
+	c.width = width;
+	c.height = height;
+	c.planes = img->data;
+
+	if (size < 0 || n > width || n > height) size = 0;
+	n = size*2+1;
+	buffer = iw_img_get_buffer (sizeof(int)*3*width + sizeof(uchar*)*n + n*width);
+	for (i=0; i<3; i++)
+		c.avg[i] = (int*)buffer + i*width;
+	rows = (const uchar**)(c.avg[2] + width);
+	ring = (uchar*)(rows + n);
+
+	if (para->pix_cnt > 0 && width > 2)
+		class_row = class_row_avg;
+	else
+		class_row = class_row_direct;
+	if (para->smooth == IW_CLASSIFY_MEDIAN_BW)
+		smooth_row = smooth_medianBW_row;
+	else if (para->smooth == IW_CLASSIFY_MAX)
+		smooth_row = smooth_max_row;
+	else
+		smooth_row = smooth_median_row;
+
+	if (para->label)
+		iw_reg_label_begin_data (width, height, para->label, para->label_data);
+
+	if (para->size <= 0) {
+		for (r=0; r<height; r++) {
+			class_row (&c, r, d+r*width);
+			class_row_done (para, d, width, height, r);
+		}
+	} else {
+		/* Classify into a ring of n rows and give out a smoothed row
+		   as soon as all its source rows are available. If the image
+		   is smaller than the mask, the result is completely 0. */
+		for (y=0; y<size; y++) {
+			memset (d+y*width, 0, width);
+			class_row_done (para, d, width, height, y);
+		}
+		if (size > 0) {
+			for (r=0; r<height; r++) {
+				class_row (&c, r, ring + (r % n)*width);
+				if (r < n-1) continue;
+
+				y = r-size;
+				for (i=0; i<n; i++)
+					rows[i] = ring + ((y-size+i) % n)*width;
+				memset (d+y*width, 0, size);
+				memset (d+y*width+width-size, 0, size);
+				smooth_row (rows, d+y*width, width, size);
+				class_row_done (para, d, width, height, y);
+			}
+			y = height-size;
+		}
+		for (; y<height; y++) {
+			memset (d+y*width, 0, width);
+			class_row_done (para, d, width, height, y);
+		}
+	}
+	if (para->label)
+		nregions = iw_reg_label_end_data (d, para->label_data);
+
+	iw_img_release_buffer();
+	iw_time_stop (time_class, FALSE);
+
+	return nregions;
+}
+
+/*********************************************************************
+  Return a bit packed version of the byte table data with cells
+  entries, bit i is set if data[i] != 0.
+*********************************************************************/
+static uchar *lookup_pack (const uchar *data, int cells)
+{
+	uchar *bits = iw_malloc0 ((cells+7)/8, "packed lookup table");
+	int i;
+
+	for (i=0; i<cells; i++)
+		if (data[i]) bits[i >> 3] |= 1 << (i & 7);
+	return bits;
+}
+
+/*********************************************************************
+  Open the lookup table file fname with one byte per table entry.
+  The file is mapped read-only into memory, so it is shared between
+  all processes using it. Tables opened more than once in a process
+  are shared as well.
+  packed: Return a bit packed table (1 bit per entry, set for all
+          entries != 0), suitable for two class tables. A 128^3 YUV
+          table needs only 256KB and fits in the L2 cache.
+  Return: The table or NULL on error. Use iw_lookup_close() if it is
+          not needed any more.
+*********************************************************************/
+iwLookup *iw_lookup_open (const char *fname, BOOL packed)
+{
+	char path[PATH_MAX];
+	struct stat stbuf;
+	iwLookup *look;
+	uchar *data;
+	int fd;
+
+	if (!realpath (fname, path)) {
+		iw_warning ("Unable to find lookup table '%s'", fname);
+		return NULL;
+	}
+
+	pthread_mutex_lock (&lookup_mutex);
+	for (look = lookup_list; look; look = look->next) {
+		if (look->packed == packed && !strcmp (look->fname, path)) {
+			look->refcount++;
+			pthread_mutex_unlock (&lookup_mutex);
+			return look;
+		}
+	}
+
+	if ((fd = open (path, O_RDONLY)) < 0 || fstat (fd, &stbuf) != 0) {
+		iw_warning ("Unable to open lookup table '%s'", path);
+		if (fd >= 0) close (fd);
+		pthread_mutex_unlock (&lookup_mutex);
+		return NULL;
+	}
+
+	look = iw_malloc0 (sizeof(iwLookup), "lookup table");
+	look->cells = stbuf.st_size;
+	look->packed = packed;
+	look->fname = strdup (path);
+	look->refcount = 1;
+
+	data = mmap (NULL, look->cells, PROT_READ, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		/* Fall back to a private copy */
+		data = iw_malloc (look->cells, "lookup table");
+		if (read (fd, data, look->cells) != look->cells) {
+			iw_warning ("Unable to read lookup table '%s'", path);
+			free (data);
+			free (look->fname);
+			free (look);
+			close (fd);
+			pthread_mutex_unlock (&lookup_mutex);
+			return NULL;
+		}
+	} else
+		look->map_size = look->cells;
+	close (fd);
+
+	if (packed) {
+		look->data = lookup_pack (data, look->cells);
+		if (look->map_size > 0)
+			munmap (data, look->map_size);
+		else
+			free (data);
+		look->map_size = 0;
+	} else
+		look->data = data;
+
+	look->next = lookup_list;
+	lookup_list = look;
+	pthread_mutex_unlock (&lookup_mutex);
+
+	return look;
+}
+
+/*********************************************************************
+  Release the lookup table look opened with iw_lookup_open().
+*********************************************************************/
+void iw_lookup_close (iwLookup *look)
+{
+	iwLookup **pos;
+
+	if (!look) return;
+
+	pthread_mutex_lock (&lookup_mutex);
+	if (--look->refcount > 0) {
+		pthread_mutex_unlock (&lookup_mutex);
+		return;
+	}
+	for (pos = &lookup_list; *pos; pos = &(*pos)->next) {
+		if (*pos == look) {
+			*pos = look->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock (&lookup_mutex);
+
+	if (look->map_size > 0)
+		munmap ((void*)look->data, look->map_size);
+	else
+		free ((void*)look->data);
+	free (look->fname);
+	free (look);
+}
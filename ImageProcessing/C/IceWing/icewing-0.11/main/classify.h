@@ -0,0 +1,127 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#ifndef iw_classify_H
+#define iw_classify_H
+
+#include "gui/Gimage.h"
+#include "tools/tools.h"
+#include "main/region.h"
+
+/* Classify one pixel with the (averaged) color values c1, c2, c3 */
+typedef uchar (*iwClassifyFunc) (void *data, int c1, int c2, int c3);
+
+typedef enum {
+	IW_CLASSIFY_YUV7,		/* lookup[(y>>1)<<14 | (u>>1)<<7 | v>>1] */
+	IW_CLASSIFY_UV8,		/* lookup[u<<8 | v] */
+	IW_CLASSIFY_UV6_PAIR,	/* lookup[u1>>2<<18 | v1>>2<<12 | u2>>2<<6 | v2>>2],
+							   pixel 1/2: left/right neighbour */
+	IW_CLASSIFY_FUNC		/* func (data, y, u, v) */
+} iwClassifyFeature;
+
+typedef enum {
+	IW_CLASSIFY_MEDIAN,		/* Median, see iw_img_median() */
+	IW_CLASSIFY_MEDIAN_BW,	/* Black/white median, see iw_img_medianBW() */
+	IW_CLASSIFY_MAX			/* Most frequent value, see iw_img_max() */
+} iwClassifySmooth;
+
+typedef struct {
+	iwClassifyFeature feature;
+	const uchar *lookup;	/* Lookup table for the IW_CLASSIFY_YUV7/UV8/UV6_PAIR */
+	const uchar *bits;		/* Bit packed lookup table (bit i: byte i/8, bit i%8),
+							   used instead of lookup if !=NULL */
+	iwClassifyFunc func;	/* Classification function for IW_CLASSIFY_FUNC */
+	void *data;				/* Passed to func */
+	BOOL twoclass;			/* Result is (1-class)*IW_COLMAX */
+	int pix_cnt;			/* 0,1,2 -> average over 1,4,5 pixels */
+	int size;				/* Smoothing mask size: size*2+1, 0: no smoothing */
+	iwClassifySmooth smooth;
+	gint32 *label;			/* !=NULL: Region label the result into label,
+							   see iw_reg_label() */
+	iwRegCalcData *label_data;	/* Labeling state, see iw_reg_label_data(),
+								   NULL: the static one */
+} iwClassifyPara;
+
+/* Lookup table opened with iw_lookup_open() */
+typedef struct iwLookup {
+	const uchar *data;		/* Table entries, bit packed if packed==TRUE */
+	int cells;				/* Number of entries */
+	BOOL packed;			/* One bit per entry? */
+
+	char *fname;			/* Private: Absolute file name, ... */
+	size_t map_size;		/* Size of the mapping, 0: data was allocated */
+	int refcount;
+	struct iwLookup *next;
+} iwLookup;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+  Initialize para with the defaults: IW_CLASSIFY_FUNC, no averaging,
+  no smoothing, no labeling.
+*********************************************************************/
+void iw_classify_init (iwClassifyPara *para);
+
+/*********************************************************************
+  Enable or disable the AVX2 versions of the classification for the
+  features IW_CLASSIFY_YUV7 and IW_CLASSIFY_UV8 (default: enabled).
+  Return: TRUE if the CPU supports AVX2.
+*********************************************************************/
+BOOL iw_classify_set_simd (BOOL enable);
+
+/*********************************************************************
+  Color classification of the YUV image img according to para with
+  an optional neighborhood averaging, smoothing, and region labeling
+  in one pass over the image. Only a few rows are buffered, so the
+  intermediate results stay in the cache. The result is written
+  to d, the image border not covered by the averaging or smoothing
+  is set to 0.
+  Return: Number of regions if para->label!=NULL, otherwise 0.
+*********************************************************************/
+int iw_classify (const iwImage *img, uchar *d, const iwClassifyPara *para);
+
+/*********************************************************************
+  Open the lookup table file fname with one byte per table entry.
+  The file is mapped read-only into memory, so it is shared between
+  all processes using it. Tables opened more than once in a process
+  are shared as well.
+  packed: Return a bit packed table (1 bit per entry, set for all
+          entries != 0), suitable for two class tables. A 128^3 YUV
+          table needs only 256KB and fits in the L2 cache.
+  Return: The table or NULL on error. Use iw_lookup_close() if it is
+          not needed any more.
+*********************************************************************/
+iwLookup *iw_lookup_open (const char *fname, BOOL packed);
+
+/*********************************************************************
+  Release the lookup table look opened with iw_lookup_open().
+*********************************************************************/
+void iw_lookup_close (iwLookup *look);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* iw_classify_H */
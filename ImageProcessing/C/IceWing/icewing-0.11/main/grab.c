@@ -658,16 +658,17 @@ static BOOL img_grab (grabPlugin *plug, grabImageData *img)
 /*********************************************************************
   Process image src by stereo-deinterlacing, bayer-decoding, cropping,
   downsampling, and rotating it (in that order) and save the result
-  to dst.
+  to dst. If the result is an RGB image and rgb!=NULL, the result is
+  saved in rgb and dst gets its YUV conversion.
 *********************************************************************/
 static void img_process (grabPlugin *plug, iwImage *orig, iwImage *dst,
-						 int downw, int downh)
+						 iwImage *rgb, int downw, int downh)
 {
 	int c_x = plug->para.crop_x, c_y = plug->para.crop_y,
 		c_w = plug->para.crop_w, c_h = plug->para.crop_h;
 	int rotate = plug->para.rotate;
 	iwImgBayer bayer = plug->para.bayer;
-	iwImage *src = orig, s_img, b_img;
+	iwImage *src = orig, *yuv = NULL, s_img, b_img;
 
 	b_img.data = s_img.data = NULL;
 
@@ -702,6 +703,10 @@ static void img_process (grabPlugin *plug, iwImage *orig, iwImage *dst,
 						"\twith 8/16 bit images with one plane and even width, skipping...");
 	}
 
+	if (rgb && src->ctab == IW_RGB) {
+		yuv = dst;
+		dst = rgb;
+	}
 	dst->ctab = src->ctab;
 
 	if (c_x < 0) c_x = 0;
@@ -782,6 +787,9 @@ static void img_process (grabPlugin *plug, iwImage *orig, iwImage *dst,
 			}
 		}
 	}
+	if (yuv)
+		iw_img_rgbToYuvVis_down (dst, yuv, NULL, NULL, 1, 1);
+
 	if (b_img.data)
 		iw_img_free (&b_img, IW_IMG_FREE_DATA);
 	if (s_img.data)
@@ -1292,7 +1300,7 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 	int downw, downh;
 	grabImageData *img, *rgb = NULL;
 	BOOL rgb_observed = plug_data_is_observed(plug->image_rgb_ident);
-	BOOL optsChanged;
+	BOOL optsChanged, down_done = FALSE;
 
 	iw_time_add_static (time_grab, "Grab");
 
@@ -1330,10 +1338,13 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 		grab_process_avgui (plug_d, &plug->avgui_data);
 
 	iw_time_start (time_grab);
+	iw_time_scope_begin ("Grab acquire");
 	if (!img_grab (plug, &plug->img)) {
+		iw_time_scope_end();
 		iw_time_stop (time_grab, FALSE);
 		return TRUE;
 	}
+	iw_time_scope_end();
 
 	pthread_mutex_lock (&plug->ring_img_mutex);
 
@@ -1384,13 +1395,41 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 	img->frame_number = plug->img.frame_number;
 	img->downw = plug->img.downw * downw;
 	img->downh = plug->img.downh * downh;
-	/* Stereo/Bayer-decode, crop, resize, rotate image */
-	img_process (plug, &plug->img.img, &img->img, downw, downh);
+	/* Stereo/Bayer-decode, crop, resize, rotate image. If no further
+	   downsampling follows, an RGB result is directly used for the
+	   RGB observers instead of copying it. */
+	iw_time_scope_begin ("Grab process");
+	if (rgb_observed && !plug->ring_up.cur) {
+		rgb = grab_image_new();
+		img_process (plug, &plug->img.img, &img->img, &rgb->img, downw, downh);
+		if (!rgb->img.data) {
+			grab_image_free (rgb);
+			rgb = NULL;
+		}
+	} else
+		img_process (plug, &plug->img.img, &img->img, NULL, downw, downh);
+	iw_time_scope_end();
 
+	iw_time_scope_begin ("Grab convert");
 	if (img->img.ctab == IW_RGB) {
-		if (rgb_observed)
-			rgb = grab_image_duplicate (img);
-		iw_img_rgbToYuvVis (&img->img);
+		if (plug->ring_up.cur) {
+			/* Convert the full image and get the downsampled YUV
+			   and RGB images in one pass */
+			if (rgb_observed)
+				rgb = grab_image_new();
+			iw_img_rgbToYuvVis_down (&img->img, &img->img,
+									 &plug->ring_down.cur[0]->img.img,
+									 rgb ? &rgb->img : NULL,
+									 plug->downsamp, plug->downsamp);
+			down_done = TRUE;
+		} else
+			iw_img_rgbToYuvVis (&img->img);
+	}
+	iw_time_scope_end();
+	if (rgb) {
+		rgb->time = img->time;
+		rgb->img_number = img->img_number;
+		rgb->frame_number = img->frame_number;
 	}
 
 	plug->img.img = img->img;
@@ -1412,7 +1451,9 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 #endif
 	if (plug->para.out_interval >= 0 &&
 		(img->img_number % plug->para.out_interval) == 0) {
+		iw_time_scope_begin ("Grab output");
 		iw_output_image (img, NULL);
+		iw_time_scope_end();
 	}
 	if (plug->ring_up.cur) {
 		grabImageData *img = &plug->ring_down.cur[0]->img;
@@ -1423,19 +1464,17 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 		img->downw = plug->ring_up.cur[0]->img.downw * plug->downsamp;
 		img->downh = plug->ring_up.cur[0]->img.downh * plug->downsamp;
 
-		iw_img_downsample (&plug->img.img, &img->img, plug->downsamp, plug->downsamp);
-		img->img.ctab = plug->img.img.ctab;
-		if (rgb) {
-			iwImage full = rgb->img;
-			iw_img_init (&rgb->img);
-			iw_img_downsample (&full, &rgb->img, plug->downsamp, plug->downsamp);
-			/* To be optimized, reuse the image */
-			iw_img_free (&full, IW_IMG_FREE_DATA);
+		if (!down_done) {
+			iw_time_scope_begin ("Grab downsample");
+			iw_img_downsample (&plug->img.img, &img->img, plug->downsamp, plug->downsamp);
+			iw_time_scope_end();
 		}
+		img->img.ctab = plug->img.img.ctab;
 	}
 
 	pthread_mutex_unlock (&plug->ring_img_mutex);
 
+	iw_time_scope_begin ("Grab render");
 	{
 		iwImage *img = &plug->ring_down.cur[0]->img.img;
 		int w = img->width, h = img->height;
@@ -1518,6 +1557,7 @@ static BOOL grab_process (plugDefinition *plug_d, char *ident, plugData *data)
 
 		plug_data_set (plug_d, plug->image_ident, plug->ring_down.cur[0], grab_image_destroy);
 	}
+	iw_time_scope_end();
 
 	return TRUE;
 }
@@ -69,6 +69,7 @@ char *ICEWING_VERSION = "0.11";
 *********************************************************************/
 static void stop_it (void)
 {
+	iw_time_trace_write (NULL);
 	plug_cleanup_all();
 	iw_output_cleanup();
 }
@@ -118,10 +119,11 @@ static void help (void)
 			 "                -sp <fileset>... | -sp1 <fileset>...] [-prop] [-c cnt] [-f [cnt]]\n"
 			 "               [-r factor] [-stereo] [-bayer [method] [pattern]] [-crop x y w h]\n"
 			 "               [-rot {0|90|180|270}] [-nyuv name] [-nrgb name] [-oi [interval]]\n"
-			 "               [-of] [-os] [-p <width>x<height>] [-rc config-file|config-setting]\n"
+			 "               [-of] [-os] [-ou [socket]] [-p <width>x<height>]\n"
+			 "               [-rc config-file|config-setting]\n"
 			 "               [-ses session-file] [-l libs] [-lg libs] [-a plugin args] [-d plugins]\n"
 			 "               [-iconic] [-t talklevel] [-time <cnt|plugins|all>...]\n"
-			 "               [--help] [--version] [@file]\n",
+			 "               [-trace file] [--help] [--version] [@file]\n",
 			 ICEWING_NAME);
 	fprintf (stderr,
 			 "-n        name for DACS registration, default: %s\n"
@@ -159,6 +161,8 @@ static void help (void)
 			 "          and a function <%s>_getImg(imgspec) to get the current image\n"
 			 "-os       output some (currently very few) status informations on\n"
 			 "          stream <%s>_status\n"
+			 "-ou       send all output streams via the local Unix socket 'socket' instead\n"
+			 "          of DACS, default: /tmp/<%s>-output\n"
 			 "-p        size of preview windows, default: %dx%d\n"
 			 "-rc       if the argument contains a '=', set gui options according to the argument;\n"
 			 "          otherwise, load the config-file additionaly to \"%s\"\n"
@@ -174,11 +178,14 @@ static void help (void)
 			 "-time     how often timers are given out, default: all 50 mainloop runs;\n"
 			 "          for which plugins process() execution time is measured;\n"
 			 "          all: measure all plugin instances; eg. -time \"5 backpro imgclass\"\n"
+			 "-trace    record all timers, grabbing stages, and plugin process() calls per\n"
+			 "          thread and write them on exit to file, *.json: Chrome trace-event\n"
+			 "          format (chrome://tracing), otherwise a binary dump\n"
 			 "--help    display this help and exit\n"
 			 "--version display version information and exit\n"
 			 "@file     replace the argument '@file' with the content of file\n",
 			 IW_DACSNAME, AVDriverHelp(), SYNC_LEVEL, IW_DACSNAME, IW_DACSNAME,
-			 IW_DACSNAME, IW_DACSNAME, IW_DACSNAME, IW_DACSNAME,
+			 IW_DACSNAME, IW_DACSNAME, IW_DACSNAME, IW_DACSNAME, IW_DACSNAME,
 			 PREV_WIDTH, PREV_HEIGHT,
 			 opts_get_default_file(), iw_session_get_name());
 
@@ -253,7 +260,7 @@ static void str_append (char **str, int *len, int *max, ...)
   Parse and initialise the arguments.
 *********************************************************************/
 #define ARG_TEMPLATE \
-	"-N:dr -SG:1 -SD:2r -SP:3r -SP1:4r -PROP:p -NYUV:nr -NRGB:Nr -C:ci -F:fio -R:ri -STEREO:s -BAYER:b -CROP:C -ROT:Ji -O:Oc -OF:6 -OI:7io -OS:8 -P:Pr -RC:Rr -SES:Sr -ICONIC:I -T:Ti -A:Ar -D:Dr -L:lr -LG:Lr -H:H -HELP:H --HELP:H -VERSION:V --VERSION:V -TIME:tr"
+	"-N:dr -SG:1 -SD:2r -SP:3r -SP1:4r -PROP:p -NYUV:nr -NRGB:Nr -C:ci -F:fio -R:ri -STEREO:s -BAYER:b -CROP:C -ROT:Ji -O:Oc -OF:6 -OI:7io -OS:8 -OU:uro -P:Pr -RC:Rr -SES:Sr -ICONIC:I -T:Ti -A:Ar -D:Dr -L:lr -LG:Lr -H:H -HELP:H --HELP:H -VERSION:V --VERSION:V -TIME:tr -TRACE:xr"
 static void init_args (int argc, char **argv, grabParameter *para)
 {
 	void *arg;
@@ -293,6 +300,9 @@ static void init_args (int argc, char **argv, grabParameter *para)
 			case '8':				/* -os */
 				para->output |= IW_OUTPUT_STATUS;
 				break;
+			case 'u':				/* -ou */
+				iw_output_set_socket ((char*)arg);
+				break;
 			case 'O':				/* -o[fis] */
 				ch_arg = (char*)arg;
 				while (ch_arg && *ch_arg) {
@@ -345,6 +355,9 @@ static void init_args (int argc, char **argv, grabParameter *para)
 				}
 				break;
 			}
+			case 'x':				/* -trace */
+				iw_time_trace_start ((char*)arg);
+				break;
 			case 'R':				/* -rc */
 				if (rcfile_cnt == 0)
 					rcfile_cnt = 2;
@@ -28,39 +28,83 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "image.h"
 #include "gui/Gtools.h"
 #include "gui/Gpolygon.h"
+#include "tools/parallel.h"
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define IMAGE_SSE2
+#include <emmintrin.h>
+#define IMAGE_TARGET(t)	__attribute__((target(t)))
+#endif
 
 /* Number of buffers for iw_img_get_buffer() */
 #define BUF_MAX			10
-static int buf_number = 0;
+
+/* Intermediate buffers of one thread for iw_img_get_buffer() */
+typedef struct {
+	int number;
+	int size[BUF_MAX];
+	void *buffer[BUF_MAX];
+} imgBuffers;
+
+static pthread_key_t buf_key;
+static pthread_once_t buf_once = PTHREAD_ONCE_INIT;
+
+/*********************************************************************
+  Free the intermediate buffers of a thread on thread exit.
+*********************************************************************/
+static void buf_free (void *data)
+{
+	imgBuffers *b = data;
+	int i;
+
+	for (i=0; i<BUF_MAX; i++)
+		if (b->buffer[i]) free (b->buffer[i]);
+	free (b);
+}
+
+/*********************************************************************
+  Create the key for the per thread buffers.
+*********************************************************************/
+static void buf_key_init (void)
+{
+	pthread_key_create (&buf_key, buf_free);
+}
 
 /*********************************************************************
   Return a pointer to an internal intermediate buffer. If the buffer
   is smaller than size bytes, the buffer is reallocated.
   Calls to iw_img_get_buffer() can be nested. iw_img_release_buffer()
-  must be called if the buffer is not needed any more.
+  must be called if the buffer is not needed any more. Every thread
+  uses its own buffers.
 *********************************************************************/
 void* iw_img_get_buffer (int size)
 {
-	static int buf_size[BUF_MAX] = {
-		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
-	static void *buffer[BUF_MAX] = {
-		NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+	imgBuffers *b;
 
-	iw_assert (buf_number >= 0 && buf_number < BUF_MAX,
+	pthread_once (&buf_once, buf_key_init);
+	if (!(b = pthread_getspecific (buf_key))) {
+		b = iw_malloc0 (sizeof(imgBuffers), "image buffers");
+		pthread_setspecific (buf_key, b);
+	}
+
+	iw_assert (b->number >= 0 && b->number < BUF_MAX,
 			   "Buffer number (%d) out of range [0..%d]\n"
 			   "\t(too many iw_img_release_buffer()/iw_img_get_buffer()-calls?)",
-			   buf_number, BUF_MAX-1);
+			   b->number, BUF_MAX-1);
 
-	if (size > buf_size[buf_number]) {
-		if (!(buffer[buf_number] = realloc (buffer[buf_number], size)))
+	if (!b->buffer[b->number] || size > b->size[b->number]) {
+		if (!(b->buffer[b->number] = realloc (b->buffer[b->number], size)))
 			iw_error ("Out of memory: image buffer");
-		buf_size[buf_number] = size;
+		b->size[b->number] = size;
 	}
-	return buffer[buf_number++];
+	return b->buffer[b->number++];
 }
 
 /*********************************************************************
@@ -68,7 +112,9 @@ void* iw_img_get_buffer (int size)
 *********************************************************************/
 void iw_img_release_buffer (void)
 {
-	buf_number--;
+	imgBuffers *b = pthread_getspecific (buf_key);
+
+	b->number--;
 }
 
 #ifdef IW_DEBUG
@@ -99,67 +145,87 @@ void iw_img_col_debug (const char *str, const iwImage *s, int x, int y) {}
 #endif
 
 /*********************************************************************
-  Downsample source by factor (downw,downh) and put it to dest.
-  dest->data is freed and newly allocated if the size or the type
-  of source has changed. Supports IW_8U - IW_DOUBLE.
+  Check if dest has the size width x height and the given planes and
+  type. If not, free the image data and allocate new data.
 *********************************************************************/
-void iw_img_downsample (const iwImage *source, iwImage *dest,
-						int downw, int downh)
+static void img_prepare (iwImage *dest, int width, int height,
+						 int planes, iwType type, const char *err)
 {
-	int d_width = source->width/downw, d_height = source->height/downh;
-	int bytes = IW_TYPE_SIZE(source), planes = source->planes;
-	uchar *d, *s;
-
-	if (dest->width != d_width || dest->height != d_height ||
-		dest->planes != planes || dest->type != source->type) {
+	if (dest->width != width || dest->height != height ||
+		dest->planes != planes || dest->type != type) {
 		iw_img_free (dest, IW_IMG_FREE_PLANE|IW_IMG_FREE_PLANEPTR);
-		dest->width = d_width;
-		dest->height = d_height;
+		dest->width = width;
+		dest->height = height;
 		dest->planes = planes;
-		dest->type = source->type;
+		dest->type = type;
 		if (!iw_img_allocate (dest))
-			iw_error ("Unable to allocate memory for downsampled image");
+			iw_error ("Unable to allocate memory for %s image", err);
 	}
+}
+
+/*********************************************************************
+  Downsample the lines y_start..y_end-1 of dest from source by factor
+  (downw,downh). dest must already have the correct size.
+*********************************************************************/
+static void img_downsample_lines (const iwImage *source, iwImage *dest,
+								  int downw, int downh, int y_start, int y_end)
+{
+	int d_width = dest->width;
+	int bytes = IW_TYPE_SIZE(source), planes = source->planes-1;
+	int line = (downh-1)*source->width*bytes + (source->width%downw)*bytes;
+	int xs, ys;
+	uchar *d, *s;
 
-	planes--;
 	if (downw == 1 && downh == 1) {
 		for (; planes>=0; planes--)
-			memcpy (dest->data[planes], source->data[planes],
-					d_width*d_height*bytes);
-	} else {
-		int line = (downh-1)*source->width*bytes + (source->width%downw)*bytes;
-		int xs, ys;
-
-		downw *= bytes;
-
-		for (; planes>=0; planes--) {
-			d = dest->data[planes];
-			s = source->data[planes];
-			/* Special case 8U to speed it up */
-			if (source->type == IW_8U) {
-				for (ys=0; ys<d_height; ys++) {
-					for (xs=0; xs<d_width; xs++) {
-						*d++ = *s;
-						s += downw;
-					}
-					s += line;
+			memcpy (dest->data[planes] + y_start*d_width*bytes,
+					source->data[planes] + y_start*d_width*bytes,
+					(y_end-y_start)*d_width*bytes);
+		return;
+	}
+
+	downw *= bytes;
+
+	for (; planes>=0; planes--) {
+		d = dest->data[planes] + y_start*d_width*bytes;
+		s = source->data[planes] + y_start*downh*source->width*bytes;
+		/* Special case 8U to speed it up */
+		if (source->type == IW_8U) {
+			for (ys=y_start; ys<y_end; ys++) {
+				for (xs=0; xs<d_width; xs++) {
+					*d++ = *s;
+					s += downw;
 				}
-			} else {
-				for (ys=0; ys<d_height; ys++) {
-					for (xs=0; xs<d_width; xs++) {
-						memcpy (d, s, bytes);
-						d += bytes;
-						s += downw;
-					}
-					s += line;
+				s += line;
+			}
+		} else {
+			for (ys=y_start; ys<y_end; ys++) {
+				for (xs=0; xs<d_width; xs++) {
+					memcpy (d, s, bytes);
+					d += bytes;
+					s += downw;
 				}
+				s += line;
 			}
 		}
 	}
 }
 
 /*********************************************************************
-  The code for iw_img_resize() is based on the resizing code from Gimp
+  Downsample source by factor (downw,downh) and put it to dest.
+  dest->data is freed and newly allocated if the size or the type
+  of source has changed. Supports IW_8U - IW_DOUBLE.
+*********************************************************************/
+void iw_img_downsample (const iwImage *source, iwImage *dest,
+						int downw, int downh)
+{
+	img_prepare (dest, source->width/downw, source->height/downh,
+				 source->planes, source->type, "downsampled");
+	img_downsample_lines (source, dest, downw, downh, 0, dest->height);
+}
+
+/*********************************************************************
+  The code for img_resize_no_resample() is based on the resizing code from Gimp
   Version 1.2, which is released under the following copyright:
 
   The GIMP -- an image manipulation program
@@ -236,235 +302,492 @@ static void img_resize_no_resample (const iwImage *srcPR, iwImage *dstPR)
 	iw_img_release_buffer();
 }
 
-static void rotate_pointers (double **p, int n)
-{
-	int i;
-	void *tmp;
+/* Precision of the fixed point weights of the resize engine */
+#define RESIZE_SHIFT	14
+/* Additional precision of the horizontally scaled 8 bit lines */
+#define RESIZE_SHIFT8	7
+/* Number of cached weight tables */
+#define RESIZE_CACHE	8
+
+/* Weights to resize one image dimension from src_size to dst_size */
+typedef struct {
+	int src_size, dst_size;
+	int taps;				/* Number of weights per destination pixel */
+	int *start;				/* First source pixel for every destination pixel */
+	gint16 *fix;			/* dst_size*taps fixed point weights for IW_8U */
+	float *flt;				/* dst_size*taps float weights for IW_16U/IW_FLOAT */
+	int ref;				/* Number of iw_img_resize() calls using the table */
+	BOOL cached;			/* Is the table part of resize_cache[]? */
+	unsigned int used;		/* Time of the last use, for LRU replacement */
+} resizeCoef;
+
+/* Data shared by all bands of one iw_img_resize() call */
+typedef struct {
+	const iwImage *src;
+	iwImage *dst;
+	int planes;
+	resizeCoef *hc, *vc;	/* Horizontal/vertical weights */
+	int band;				/* Number of destination lines per band */
+} resizeJob;
 
-	tmp = p[0];
-	for (i = 0; i < n-1; i++)
-		p[i] = p[i+1];
-	p[i] = tmp;
-}
+static pthread_mutex_t resize_mutex = PTHREAD_MUTEX_INITIALIZER;
+static resizeCoef *resize_cache[RESIZE_CACHE];
+static unsigned int resize_time = 0;
 
-static void expand_line (double *dest, double *src, int planes,
-						 int old_width, int width)
+/*********************************************************************
+  Get the source pixels idx and their weights w, which contribute to
+  the destination pixel x, if a dimension is resized from src to dst
+  pixels. Enlarging uses linear interpolation, reducing averages all
+  covered source pixels. Return the number of pixels.
+*********************************************************************/
+static int resize_weights (int x, int src, int dst, int *idx, double *w)
 {
-	double ratio;
-	int x,b;
-	int src_col;
-	double frac;
-	double *s;
-	ratio = old_width/(double)width;
-
-	/* This could be opimized much more by precalculating
-	   the coeficients for each x */
-	for (x = 0; x < width; x++) {
-		src_col = ((int)((x) * ratio + 2.0 - 0.5)) - 2;
-		/* +2, -2 is there because (int) rounds towards 0 and we need
-		   to round down */
-		frac = ((x) * ratio - 0.5) - src_col;
-		s = &src[src_col * planes];
-		for (b = 0; b < planes; b++)
-			dest[b] = ((s[b + planes] - s[b]) * frac + s[b]);
-		dest += planes;
+	double ratio = (double)src / dst;
+	int i, n = 0;
+
+	if (src == dst) {
+		idx[0] = x;
+		w[0] = 1;
+		n = 1;
+	} else if (dst > src) {
+		double pos = x*ratio - 0.5;
+		i = floor (pos);
+		idx[0] = i;
+		w[0] = 1 - (pos-i);
+		idx[1] = i+1;
+		w[1] = pos-i;
+		n = 2;
+	} else {
+		double a = x*ratio, b = (x+1)*ratio, f;
+		for (i = floor(a); i < b; i++) {
+			f = (MIN(b, i+1) - MAX(a, i)) / ratio;
+			if (f > 0) {
+				idx[n] = i;
+				w[n] = f;
+				n++;
+			}
+		}
 	}
+	/* Set the off edge pixels to their nearest neighbor */
+	for (i=0; i<n; i++)
+		idx[i] = CLAMP (idx[i], 0, src-1);
+	return n;
 }
 
-static void shrink_line (double *dest, double *src, int planes,
-						 int old_width, int width)
+/*********************************************************************
+  Calculate the weight tables to resize a dimension from src to dst.
+*********************************************************************/
+static resizeCoef* resize_coef_calc (int src, int dst)
 {
-	int x, b;
-	double *source, *destp;
-	register double accum;
-	register unsigned int max;
-	register double mant, tmp;
-	register const double step = old_width/(double)width;
-	register const double inv_step = 1.0/step;
-	double position;
-
-	for (b = 0; b < planes; b++) {
-		source = &src[b];
-		destp = &dest[b];
-		position = -1;
-
-		mant = *source;
-
-		for (x = 0; x < width; x++) {
-			source+= planes;
-			accum = 0;
-			max = ((int)(position+step)) - ((int)(position));
-			max--;
-			while (max) {
-				accum += *source;
-				source += planes;
-				max--;
-			}
-			tmp = accum + mant;
-			mant = ((position+step) - (int)(position + step));
-			mant *= *source;
-			tmp += mant;
-			tmp *= inv_step;
-			mant = *source - mant;
-			*(destp) = tmp;
-			destp += planes;
-			position += step;
+	resizeCoef *c = iw_malloc0 (sizeof(resizeCoef), "resize weights");
+	int x, k, n, first, last, max = (int)ceil((double)src/dst) + 2;
+	int *idx = iw_malloc (sizeof(int)*max, "resize weights");
+	double *w = iw_malloc (sizeof(double)*max, "resize weights");
+
+	c->src_size = src;
+	c->dst_size = dst;
+
+	/* Maximal distance between the first and the last source pixel */
+	c->taps = 1;
+	for (x=0; x<dst; x++) {
+		n = resize_weights (x, src, dst, idx, w);
+		first = last = idx[0];
+		for (k=1; k<n; k++) {
+			first = MIN (first, idx[k]);
+			last = MAX (last, idx[k]);
 		}
+		c->taps = MAX (c->taps, last-first+1);
 	}
+
+	c->start = iw_malloc (sizeof(int)*dst, "resize weights");
+	c->fix = iw_malloc0 (sizeof(gint16)*dst*c->taps, "resize weights");
+	c->flt = iw_malloc0 (sizeof(float)*dst*c->taps, "resize weights");
+	for (x=0; x<dst; x++) {
+		gint16 *fix = c->fix + x*c->taps;
+		float *flt = c->flt + x*c->taps;
+		int sum = 0, kmax = 0;
+
+		n = resize_weights (x, src, dst, idx, w);
+		first = idx[0];
+		for (k=1; k<n; k++)
+			first = MIN (first, idx[k]);
+		/* Never access pixels behind the end of the source line */
+		first = MIN (first, src - c->taps);
+		c->start[x] = first;
+
+		for (k=0; k<n; k++)
+			flt[idx[k]-first] += w[k];
+		for (k=0; k<c->taps; k++) {
+			fix[k] = gui_lrint (flt[k] * (1<<RESIZE_SHIFT));
+			sum += fix[k];
+			if (fix[k] > fix[kmax]) kmax = k;
+		}
+		/* The sum of the fixed point weights must be exactly one */
+		fix[kmax] += (1<<RESIZE_SHIFT) - sum;
+	}
+
+	free (idx);
+	free (w);
+	return c;
 }
 
-static void get_scaled_row (double **src, int y, int new_width,
-							const iwImage *srcPR, double *row)
+/*********************************************************************
+  Free the weight tables c.
+*********************************************************************/
+static void resize_coef_free (resizeCoef *c)
 {
-	/* Get the necesary lines from the source image, scale them,
-	   and put them into src[] */
-	int planes = srcPR->planes;
-	int b, x, p, offset;
-
-	rotate_pointers (src, 4);
-	if (y < 0) y = 0;
-
-	if (y < srcPR->height) {
-
-		/* Get image data */
-		offset = y * srcPR->width;
-		x = 0;
-		for (b=0; b<srcPR->width; b++)
-			for (p = 0; p < planes; p++)
-				row[x++] = srcPR->data[p][b+offset];
-
-		/* Set the off edge pixels to their nearest neighbor */
-		for (b = 0; b < 2 * planes; b++)
-			row[-2*planes + b] = row[(b%planes)];
-		for (b = 0; b < planes * 2; b++)
-			row[srcPR->width*planes + b] = row[(srcPR->width - 1) * planes + (b%planes)];
-
-		if (new_width > srcPR->width)
-			expand_line(src[3], row, planes,
-						srcPR->width, new_width);
-		else if (srcPR->width > new_width)
-			shrink_line(src[3], row, planes,
-						srcPR->width, new_width);
-		else /* No scaling needed */
-			memcpy (src[3], row, sizeof (double) * new_width * planes);
-	} else
-		memcpy(src[3], src[2], sizeof (double) * new_width * planes);
+	free (c->start);
+	free (c->fix);
+	free (c->flt);
+	free (c);
 }
 
 /*********************************************************************
-  Resize image srcPR to size of image dstPR and save it in dstPR.
-  interpolate==TRUE: Use linear interpolation.
+  Return the weight tables to resize a dimension from src to dst.
+  The tables are cached, resize_coef_release() must be called if they
+  are not needed any more.
 *********************************************************************/
-void iw_img_resize (const iwImage *srcPR, iwImage *destPR, BOOL interpolate)
+static resizeCoef* resize_coef_get (int src, int dst)
 {
-	double  *src[4];
-	double *row, *accum;
-	int planes;
-	int width, height;
-	int orig_width, orig_height;
-	double y_rat;
-	int old_y = -4, new_y;
-	int x, y, p, b, offset;
+	resizeCoef *c;
+	int i, slot = -1;
+
+	pthread_mutex_lock (&resize_mutex);
+	for (i=0; i<RESIZE_CACHE; i++) {
+		c = resize_cache[i];
+		if (c && c->src_size == src && c->dst_size == dst) {
+			c->ref++;
+			c->used = ++resize_time;
+			pthread_mutex_unlock (&resize_mutex);
+			return c;
+		}
+	}
+	pthread_mutex_unlock (&resize_mutex);
 
-	if (!interpolate) {
-		img_resize_no_resample (srcPR, destPR);
-		return;
+	c = resize_coef_calc (src, dst);
+
+	pthread_mutex_lock (&resize_mutex);
+	/* Use an empty or the least recently used, currently unused entry */
+	for (i=0; i<RESIZE_CACHE; i++) {
+		if (!resize_cache[i]) {
+			slot = i;
+			break;
+		}
+		if (resize_cache[i]->ref == 0 &&
+			(slot < 0 || resize_cache[i]->used < resize_cache[slot]->used))
+			slot = i;
+	}
+	if (slot >= 0) {
+		if (resize_cache[slot])
+			resize_coef_free (resize_cache[slot]);
+		resize_cache[slot] = c;
+		c->cached = TRUE;
 	}
+	c->ref = 1;
+	c->used = ++resize_time;
+	pthread_mutex_unlock (&resize_mutex);
 
-	orig_width = srcPR->width;
-	orig_height = srcPR->height;
+	return c;
+}
 
-	width = destPR->width;
-	height = destPR->height;
+/*********************************************************************
+  Release the weight tables c got with resize_coef_get().
+*********************************************************************/
+static void resize_coef_release (resizeCoef *c)
+{
+	pthread_mutex_lock (&resize_mutex);
+	c->ref--;
+	if (!c->cached)
+		resize_coef_free (c);
+	pthread_mutex_unlock (&resize_mutex);
+}
 
-	/* Find the ratios of old y to new y */
-	y_rat = (double) orig_height / (double) height;
+/*********************************************************************
+  Return the start of plane p of img. step: Distance between two pixels
+  in elements, stride: Distance between two lines in bytes.
+*********************************************************************/
+static guchar* resize_plane (const iwImage *img, int p, int *step, int *stride)
+{
+	int bytes = IW_TYPE_SIZE(img);
 
-	planes = destPR->planes;
+	if (img->rowstride > 0) {
+		*step = img->planes;
+		*stride = img->rowstride;
+		return img->data[0] + p*bytes;
+	}
+	*step = 1;
+	*stride = img->width*bytes;
+	return img->data[p];
+}
 
-	/* The data pointers... */
-	accum = iw_img_get_buffer (sizeof(double) *
-							(width * planes * 5 + (orig_width + 2*2) * planes));
-	for (x = 0; x < 4; x++) {
-		src[x] = accum;
-		accum += width * planes;
+/*********************************************************************
+  Horizontally resize the line s (pixel distance step) to d.
+*********************************************************************/
+static void resize_hline_8u (const guchar *s, int step, const resizeCoef *c, gint16 *d)
+{
+	const gint16 *w = c->fix;
+	const guchar *sp;
+	int x, k, sum, taps = c->taps;
+
+	for (x=0; x<c->dst_size; x++) {
+		sp = s + c->start[x]*step;
+		sum = 1 << (RESIZE_SHIFT-RESIZE_SHIFT8-1);
+		for (k=0; k<taps; k++) {
+			sum += w[k] * *sp;
+			sp += step;
+		}
+		d[x] = sum >> (RESIZE_SHIFT-RESIZE_SHIFT8);
+		w += taps;
 	}
+}
 
-	/* Offset the row pointer by 2*planes so the range of the array
-	   is [-2*planes] to [(orig_width + 2)*planes] */
-	row = accum;
-	row += planes*2;
-
-	accum += (orig_width + 2*2) * planes;
-
-	/* Scale the selected region */
-	for (y = 0; y < height;  y++) {
-		if (height < orig_height) {
-			int max;
-			double frac;
-			const double inv_ratio = 1.0 / y_rat;
-			if (y == 0) /* Load the first row if this it the first time through */
-				get_scaled_row (&src[0], 0, width, srcPR, row);
-			new_y = (int)((y) * y_rat);
-			frac = 1.0 - (y*y_rat - new_y);
-			for (x  = 0; x < width*planes; x++)
-				accum[x] = src[3][x] * frac;
-
-			max = ((int)((y+1) *y_rat)) - (new_y);
-			max--;
-
-			get_scaled_row (&src[0], ++new_y, width, srcPR, row);
-
-			while (max > 0) {
-				for (x = 0; x < width*planes; x++)
-					accum[x] += src[3][x];
-				get_scaled_row (&src[0], ++new_y, width, srcPR, row);
-				max--;
-			}
-			frac = (y + 1)*y_rat - ((int)((y + 1)*y_rat));
-			for (x = 0; x < width*planes; x++) {
-				accum[x] += frac * src[3][x];
-				accum[x] *= inv_ratio;
-			}
-		} else if (height > orig_height) {
-			new_y = floor((y) * y_rat - 0.5);
-
-			while (old_y <= new_y) {
-				/* Get the necesary lines from the source image, scale them,
-				   and put them into src[] */
-				get_scaled_row (&src[0], old_y + 2, width, srcPR, row);
-				old_y++;
-			}
+static void resize_hline_16u (const guint16 *s, int step, const resizeCoef *c, gfloat *d)
+{
+	const float *w = c->flt;
+	const guint16 *sp;
+	int x, k, taps = c->taps;
+	float sum;
+
+	for (x=0; x<c->dst_size; x++) {
+		sp = s + c->start[x]*step;
+		sum = 0;
+		for (k=0; k<taps; k++) {
+			sum += w[k] * *sp;
+			sp += step;
+		}
+		d[x] = sum;
+		w += taps;
+	}
+}
 
-			{
-				double idy = ((y) * y_rat - 0.5) - new_y;
-				double dy = 1.0 - idy;
-				for (x = 0; x < width * planes; x++)
-					accum[x] = dy * src[1][x] + idy * src[2][x];
-			}
-		} else {	/* height == orig_height */
+static void resize_hline_float (const gfloat *s, int step, const resizeCoef *c, gfloat *d)
+{
+	const float *w = c->flt;
+	const gfloat *sp;
+	int x, k, taps = c->taps;
+	float sum;
+
+	for (x=0; x<c->dst_size; x++) {
+		sp = s + c->start[x]*step;
+		sum = 0;
+		for (k=0; k<taps; k++) {
+			sum += w[k] * *sp;
+			sp += step;
+		}
+		d[x] = sum;
+		w += taps;
+	}
+}
 
-			get_scaled_row (&src[0], y, width, srcPR, row);
-			memcpy (accum, src[3], sizeof(double) * width * planes);
+#ifdef IMAGE_SSE2
+/*********************************************************************
+  Vertically combine the horizontally resized 8 bit lines rows[] with
+  the weights w and store cnt pixels in d. Process 8 pixels per step
+  and return the number of processed pixels.
+*********************************************************************/
+static IMAGE_TARGET("sse2") int resize_vline_8u_sse2 (gint16 **rows, const gint16 *w,
+													   int taps, guchar *d, int cnt)
+{
+	const int shift = RESIZE_SHIFT+RESIZE_SHIFT8;
+	__m128i round = _mm_set1_epi32 (1 << (shift-1)), zero = _mm_setzero_si128();
+	__m128i lo, hi, a, b, c;
+	int x, k;
+
+	for (x=0; x+8 <= cnt; x+=8) {
+		lo = hi = round;
+		for (k=0; k+1 < taps; k+=2) {
+			a = _mm_loadu_si128 ((__m128i*)(rows[k]+x));
+			b = _mm_loadu_si128 ((__m128i*)(rows[k+1]+x));
+			c = _mm_set1_epi32 ((guint16)w[k] | ((guint32)(guint16)w[k+1] << 16));
+			lo = _mm_add_epi32 (lo, _mm_madd_epi16 (_mm_unpacklo_epi16 (a, b), c));
+			hi = _mm_add_epi32 (hi, _mm_madd_epi16 (_mm_unpackhi_epi16 (a, b), c));
 		}
+		if (k < taps) {
+			a = _mm_loadu_si128 ((__m128i*)(rows[k]+x));
+			c = _mm_set1_epi32 ((guint16)w[k]);
+			lo = _mm_add_epi32 (lo, _mm_madd_epi16 (_mm_unpacklo_epi16 (a, zero), c));
+			hi = _mm_add_epi32 (hi, _mm_madd_epi16 (_mm_unpackhi_epi16 (a, zero), c));
+		}
+		lo = _mm_srai_epi32 (lo, shift);
+		hi = _mm_srai_epi32 (hi, shift);
+		a = _mm_packs_epi32 (lo, hi);
+		_mm_storel_epi64 ((__m128i*)(d+x), _mm_packus_epi16 (a, a));
+	}
+	return x;
+}
 
-		offset = y * destPR->width;
-		x = 0;
-		for (b = 0; b < width; b++) {
-			for (p = 0; p < planes; p++) {
-				if (accum[x] < 0.0)
-					destPR->data[p][b+offset] = 0;
-				else if (accum[x] > (float)IW_COLMAX)
-					destPR->data[p][b+offset] = IW_COLMAX;
-				else
-					destPR->data[p][b+offset] = rint(accum[x]);
-				x++;
-			}
+/*********************************************************************
+  Return TRUE if the SSE2 versions of the resize functions can be used.
+*********************************************************************/
+static BOOL resize_simd (void)
+{
+	static int simd = -1;
+	if (simd < 0) {
+		__builtin_cpu_init();
+		simd = __builtin_cpu_supports ("sse2") ? 1 : 0;
+	}
+	return simd;
+}
+#endif
+
+/*********************************************************************
+  Vertically combine the horizontally resized lines rows[] with the
+  weights w and store cnt pixels in d (pixel distance step).
+*********************************************************************/
+static void resize_vline_8u (gint16 **rows, const gint16 *w, int taps,
+							 guchar *d, int step, int cnt)
+{
+	const int shift = RESIZE_SHIFT+RESIZE_SHIFT8;
+	int x = 0, k, sum;
+
+#ifdef IMAGE_SSE2
+	if (step == 1 && resize_simd())
+		x = resize_vline_8u_sse2 (rows, w, taps, d, cnt);
+#endif
+	for (; x<cnt; x++) {
+		sum = 1 << (shift-1);
+		for (k=0; k<taps; k++)
+			sum += w[k] * rows[k][x];
+		sum >>= shift;
+		d[x*step] = MIN (sum, 255);
+	}
+}
+
+static void resize_vline_16u (gfloat **rows, const float *w, int taps,
+							  guint16 *d, int step, int cnt)
+{
+	int x, k;
+	float sum;
+
+	for (x=0; x<cnt; x++) {
+		sum = 0.5;
+		for (k=0; k<taps; k++)
+			sum += w[k] * rows[k][x];
+		d[x*step] = MIN (sum, 65535);
+	}
+}
+
+static void resize_vline_float (gfloat **rows, const float *w, int taps,
+								gfloat *d, int step, int cnt)
+{
+	int x, k;
+	float sum;
+
+	for (x=0; x<cnt; x++) {
+		sum = 0;
+		for (k=0; k<taps; k++)
+			sum += w[k] * rows[k][x];
+		d[x*step] = sum;
+	}
+}
+
+/*********************************************************************
+  iw_parallel_for() worker for iw_img_resize(): Resize the destination
+  lines of band nr. First all needed source lines are resized
+  horizontally, afterwards they are combined vertically.
+*********************************************************************/
+static void resize_band (int nr, void *data)
+{
+	resizeJob *job = data;
+	const iwImage *src = job->src;
+	iwImage *dst = job->dst;
+	resizeCoef *hc = job->hc, *vc = job->vc;
+	int y0 = nr*job->band, y1 = MIN (y0+job->band, dst->height);
+	int sy0 = vc->start[y0], sy1 = vc->start[y1-1] + vc->taps;
+	int width = dst->width, taps = vc->taps;
+	int p, y, k, sstep, sstride, dstep, dstride;
+	guchar *buffer, *s, *d;
+	void **rows;
+
+	buffer = iw_malloc ((sy1-sy0)*width*4, "resize buffer");
+	rows = iw_malloc (sizeof(void*)*taps, "resize buffer");
+
+	for (p=0; p<job->planes; p++) {
+		s = resize_plane (src, p, &sstep, &sstride);
+		d = resize_plane (dst, p, &dstep, &dstride);
+
+		switch (src->type) {
+			case IW_8U:
+				for (y=sy0; y<sy1; y++)
+					resize_hline_8u (s + y*sstride, sstep, hc,
+									 (gint16*)buffer + (y-sy0)*width);
+				for (y=y0; y<y1; y++) {
+					for (k=0; k<taps; k++)
+						rows[k] = (gint16*)buffer + (vc->start[y]-sy0+k)*width;
+					resize_vline_8u ((gint16**)rows, vc->fix + y*taps, taps,
+									 d + y*dstride, dstep, width);
+				}
+				break;
+			case IW_16U:
+				for (y=sy0; y<sy1; y++)
+					resize_hline_16u ((guint16*)(s + y*sstride), sstep, hc,
+									  (gfloat*)buffer + (y-sy0)*width);
+				for (y=y0; y<y1; y++) {
+					for (k=0; k<taps; k++)
+						rows[k] = (gfloat*)buffer + (vc->start[y]-sy0+k)*width;
+					resize_vline_16u ((gfloat**)rows, vc->flt + y*taps, taps,
+									  (guint16*)(d + y*dstride), dstep, width);
+				}
+				break;
+			case IW_FLOAT:
+				for (y=sy0; y<sy1; y++)
+					resize_hline_float ((gfloat*)(s + y*sstride), sstep, hc,
+										(gfloat*)buffer + (y-sy0)*width);
+				for (y=y0; y<y1; y++) {
+					for (k=0; k<taps; k++)
+						rows[k] = (gfloat*)buffer + (vc->start[y]-sy0+k)*width;
+					resize_vline_float ((gfloat**)rows, vc->flt + y*taps, taps,
+										(gfloat*)(d + y*dstride), dstep, width);
+				}
+				break;
+			default:
+				break;
 		}
 	}
 
-	/* Free up temporary arrays */
-	iw_img_release_buffer();
+	free (rows);
+	free (buffer);
+}
+
+/*********************************************************************
+  Resize image srcPR to size of image dstPR and save it in dstPR.
+  interpolate==TRUE: Use linear interpolation when enlarging and
+                     averaging when reducing the image. Supports
+                     IW_8U, IW_16U, and IW_FLOAT, planed and
+                     interleaved images.
+  interpolate==FALSE: Use the nearest pixel, only for planed IW_8U.
+*********************************************************************/
+void iw_img_resize (const iwImage *srcPR, iwImage *destPR, BOOL interpolate)
+{
+	resizeJob job;
+	int threads;
+
+	if (!interpolate) {
+		img_resize_no_resample (srcPR, destPR);
+		return;
+	}
+	if (destPR->width <= 0 || destPR->height <= 0) return;
+	if (srcPR->type != destPR->type ||
+		(srcPR->type != IW_8U && srcPR->type != IW_16U && srcPR->type != IW_FLOAT)) {
+		iw_warning ("Resizing of image type %d to type %d not supported",
+					srcPR->type, destPR->type);
+		return;
+	}
+
+	job.src = srcPR;
+	job.dst = destPR;
+	job.planes = MIN (srcPR->planes, destPR->planes);
+	job.hc = resize_coef_get (srcPR->width, destPR->width);
+	job.vc = resize_coef_get (srcPR->height, destPR->height);
+
+	/* Some bands per thread for a better load balancing */
+	threads = iw_parallel_get_threads();
+	job.band = MAX (16, (destPR->height + 4*threads-1) / (4*threads));
+
+	iw_parallel_for ((destPR->height + job.band-1) / job.band, resize_band, &job);
+
+	resize_coef_release (job.hc);
+	resize_coef_release (job.vc);
 }
 
 /*********************************************************************
@@ -481,11 +804,15 @@ void iw_img_resize_raw (const uchar **src, uchar **dst,
 	srcPR.width = src_w;
 	srcPR.height = src_h;
 	srcPR.planes = planes;
+	srcPR.type = IW_8U;
+	srcPR.rowstride = 0;
 	srcPR.data = (uchar**)src; /* const */
 
 	dstPR.width = dst_w;
 	dstPR.height = dst_h;
 	dstPR.planes = planes;
+	dstPR.type = IW_8U;
+	dstPR.rowstride = 0;
 	dstPR.data = dst;
 
 	iw_img_resize (&srcPR, &dstPR, interpolate);
@@ -883,25 +1210,22 @@ void iw_img_sobel (const uchar *src, uchar *dest, int width, int height, int thr
 }
 
 /*********************************************************************
-  Perform RGB to YUV conversion with intervall reduction.
-  Supports IW_8U - IW_DOUBLE.
+  Perform RGB to YUV conversion with intervall reduction of cnt pixels
+  starting at pixel start from the planes src to the planes dst.
+  src and dst may be identical.
 *********************************************************************/
-void iw_img_rgbToYuvVis (iwImage *img)
+static void img_rgbToYuv_pixels (iwType type, uchar **src, uchar **dst,
+								 int start, int cnt)
 {
 	float yf;
 	int x;
 
-	if (img->planes < 3) return;
-	/* Interleaved images not yet supported */
-	if (img->rowstride) return;
-
-	if (img->ctab < IW_COLFORMAT_MAX) img->ctab = IW_YUV;
-
-	switch (img->type) {
+	switch (type) {
 		case IW_8U: {
-			guchar *y=img->data[0], *u=img->data[1], *v=img->data[2];
-			for (x = img->width*img->height; x>0; x--) {
-				prev_inline_rgbToYuvVis (*y, *u, *v, y, u, v);
+			guchar *r = src[0]+start, *g = src[1]+start, *b = src[2]+start;
+			guchar *y = dst[0]+start, *u = dst[1]+start, *v = dst[2]+start;
+			for (x = cnt; x>0; x--) {
+				prev_inline_rgbToYuvVis (*r++, *g++, *b++, y, u, v);
 				y++;
 				u++;
 				v++;
@@ -909,12 +1233,15 @@ void iw_img_rgbToYuvVis (iwImage *img)
 		}
 		break;
 		case IW_16U: {
-			guint16 *y = (guint16*)img->data[0],
-				*u = (guint16*)img->data[1],
-				*v = (guint16*)img->data[2];
+			guint16 *rp = (guint16*)src[0]+start,
+				*gp = (guint16*)src[1]+start,
+				*bp = (guint16*)src[2]+start;
+			guint16 *y = (guint16*)dst[0]+start,
+				*u = (guint16*)dst[1]+start,
+				*v = (guint16*)dst[2]+start;
 			guint16 r, g, b;
-			for (x = img->width*img->height; x>0; x--) {
-				r = *y; g = *u; b = *v;
+			for (x = cnt; x>0; x--) {
+				r = *rp++; g = *gp++; b = *bp++;
 
 				yf = 0.257*r + 0.504*g + 0.0979*b;
 				*y++ = gui_lrint (yf+16.0*256);
@@ -924,12 +1251,15 @@ void iw_img_rgbToYuvVis (iwImage *img)
 		}
 		break;
 		case IW_32S: {
-			gint32 *y = (gint32*)img->data[0],
-				*u = (gint32*)img->data[1],
-				*v = (gint32*)img->data[2];
+			gint32 *rp = (gint32*)src[0]+start,
+				*gp = (gint32*)src[1]+start,
+				*bp = (gint32*)src[2]+start;
+			gint32 *y = (gint32*)dst[0]+start,
+				*u = (gint32*)dst[1]+start,
+				*v = (gint32*)dst[2]+start;
 			gint32 r, g, b;
-			for (x = img->width*img->height; x>0; x--) {
-				r = *y; g = *u; b = *v;
+			for (x = cnt; x>0; x--) {
+				r = *rp++; g = *gp++; b = *bp++;
 
 				yf = 0.257*r + 0.504*g + 0.0979*b;
 				*y++ = gui_lrint (yf);
@@ -939,12 +1269,15 @@ void iw_img_rgbToYuvVis (iwImage *img)
 		}
 		break;
 		case IW_FLOAT: {
-			gfloat *y = (gfloat*)img->data[0],
-				*u = (gfloat*)img->data[1],
-				*v = (gfloat*)img->data[2];
+			gfloat *rp = (gfloat*)src[0]+start,
+				*gp = (gfloat*)src[1]+start,
+				*bp = (gfloat*)src[2]+start;
+			gfloat *y = (gfloat*)dst[0]+start,
+				*u = (gfloat*)dst[1]+start,
+				*v = (gfloat*)dst[2]+start;
 			gfloat r, g, b;
-			for (x = img->width*img->height; x>0; x--) {
-				r = *y; g = *u; b = *v;
+			for (x = cnt; x>0; x--) {
+				r = *rp++; g = *gp++; b = *bp++;
 
 				yf = 0.257*r + 0.504*g + 0.0979*b;
 				*y++ = yf;
@@ -954,12 +1287,15 @@ void iw_img_rgbToYuvVis (iwImage *img)
 		}
 		break;
 		case IW_DOUBLE: {
-			gdouble *y = (gdouble*)img->data[0],
-				*u = (gdouble*)img->data[1],
-				*v = (gdouble*)img->data[2];
+			gdouble *rp = (gdouble*)src[0]+start,
+				*gp = (gdouble*)src[1]+start,
+				*bp = (gdouble*)src[2]+start;
+			gdouble *y = (gdouble*)dst[0]+start,
+				*u = (gdouble*)dst[1]+start,
+				*v = (gdouble*)dst[2]+start;
 			gdouble r, g, b, yf;
-			for (x = img->width*img->height; x>0; x--) {
-				r = *y; g = *u; b = *v;
+			for (x = cnt; x>0; x--) {
+				r = *rp++; g = *gp++; b = *bp++;
 
 				yf = 0.257*r + 0.504*g + 0.0979*b;
 				*y++ = yf;
@@ -971,6 +1307,89 @@ void iw_img_rgbToYuvVis (iwImage *img)
 	}
 }
 
+/*********************************************************************
+  Perform RGB to YUV conversion with intervall reduction.
+  Supports IW_8U - IW_DOUBLE.
+*********************************************************************/
+void iw_img_rgbToYuvVis (iwImage *img)
+{
+	if (img->planes < 3) return;
+	/* Interleaved images not yet supported */
+	if (img->rowstride) return;
+
+	if (img->ctab < IW_COLFORMAT_MAX) img->ctab = IW_YUV;
+
+	img_rgbToYuv_pixels (img->type, img->data, img->data,
+						 0, img->width*img->height);
+}
+
+/* Approximate number of bytes per plane processed in one step
+   by iw_img_rgbToYuvVis_down() */
+#define IMG_BAND_BYTES		(16*1024)
+
+/*********************************************************************
+  Perform RGB to YUV conversion with intervall reduction of src and
+  save the result in dst (dst may be identical to src). If down!=NULL,
+  additionally save the YUV image downsampled by factor (downw,downh)
+  in down. If rgb!=NULL, save the source RGB image downsampled by
+  (downw,downh) in rgb. All is done in one pass over src in bands of
+  some lines, so that every source line is read only once from memory.
+  dst, down, and rgb are (re)allocated like in iw_img_downsample().
+  Supports IW_8U - IW_DOUBLE.
+*********************************************************************/
+void iw_img_rgbToYuvVis_down (const iwImage *src, iwImage *dst, iwImage *down,
+							  iwImage *rgb, int downw, int downh)
+{
+	int width = src->width, height = src->height;
+	int d_height = height/downh, band, y, y_end;
+
+	if (src->planes < 3 || src->rowstride) {
+		/* Not supported by the fused loop -> same result with single steps */
+		if (rgb)
+			iw_img_downsample (src, rgb, downw, downh);
+		if (dst != src) {
+			iw_img_downsample (src, dst, 1, 1);
+			dst->ctab = src->ctab;
+		}
+		iw_img_rgbToYuvVis (dst);
+		if (down) {
+			iw_img_downsample (dst, down, downw, downh);
+			down->ctab = dst->ctab;
+		}
+		return;
+	}
+
+	if (dst != src)
+		img_prepare (dst, width, height, src->planes, src->type, "converted");
+	if (down)
+		img_prepare (down, width/downw, d_height, src->planes, src->type, "downsampled");
+	if (rgb) {
+		img_prepare (rgb, width/downw, d_height, src->planes, src->type, "downsampled");
+		rgb->ctab = src->ctab;
+	}
+	dst->ctab = src->ctab < IW_COLFORMAT_MAX ? IW_YUV : src->ctab;
+	if (down)
+		down->ctab = dst->ctab;
+
+	/* Number of downsampled lines processed in one step */
+	band = IMG_BAND_BYTES / (width*IW_TYPE_SIZE(src)*downh);
+	if (band < 1) band = 1;
+
+	for (y = 0; y < d_height; y += band) {
+		y_end = MIN (y+band, d_height);
+		if (rgb)
+			img_downsample_lines (src, rgb, downw, downh, y, y_end);
+		img_rgbToYuv_pixels (src->type, src->data, dst->data,
+							 y*downh*width, (y_end-y)*downh*width);
+		if (down)
+			img_downsample_lines (dst, down, downw, downh, y, y_end);
+	}
+	/* Lines not covered by the downsampling */
+	if (d_height*downh < height)
+		img_rgbToYuv_pixels (src->type, src->data, dst->data,
+							 d_height*downh*width, (height-d_height*downh)*width);
+}
+
 /*********************************************************************
   Perform YUV to RGB conversion with intervall expansion.
   Supports IW_8U - IW_DOUBLE.
@@ -42,7 +42,8 @@ extern "C" {
   Return a pointer to an internal intermediate buffer. If the buffer
   is smaller than size bytes, the buffer is reallocated.
   Calls to iw_img_get_buffer() can be nested. iw_img_release_buffer()
-  must be called if the buffer is not needed any more.
+  must be called if the buffer is not needed any more. Every thread
+  uses its own buffers.
 *********************************************************************/
 void* iw_img_get_buffer (int size);
 
@@ -67,7 +68,11 @@ void iw_img_downsample (const iwImage *source, iwImage *dest,
 
 /*********************************************************************
   Resize image srcPR to size of image dstPR and save it in dstPR.
-  interpolate==TRUE: Use linear interpolation.
+  interpolate==TRUE: Use linear interpolation when enlarging and
+                     averaging when reducing the image. Supports
+                     IW_8U, IW_16U, and IW_FLOAT, planed and
+                     interleaved images.
+  interpolate==FALSE: Use the nearest pixel, only for planed IW_8U.
 *********************************************************************/
 void iw_img_resize (const iwImage *srcPR, iwImage *destPR, BOOL interpolate);
 
@@ -137,6 +142,19 @@ void iw_img_sobel (const uchar *src, uchar *dest,
 *********************************************************************/
 void iw_img_rgbToYuvVis (iwImage *img);
 
+/*********************************************************************
+  Perform RGB to YUV conversion with intervall reduction of src and
+  save the result in dst (dst may be identical to src). If down!=NULL,
+  additionally save the YUV image downsampled by factor (downw,downh)
+  in down. If rgb!=NULL, save the source RGB image downsampled by
+  (downw,downh) in rgb. All is done in one pass over src in bands of
+  some lines, so that every source line is read only once from memory.
+  dst, down, and rgb are (re)allocated like in iw_img_downsample().
+  Supports IW_8U - IW_DOUBLE.
+*********************************************************************/
+void iw_img_rgbToYuvVis_down (const iwImage *src, iwImage *dst, iwImage *down,
+							  iwImage *rgb, int downw, int downh);
+
 /*********************************************************************
   Perform YUV to RGB conversion with intervall expansion.
   Supports IW_8U - IW_DOUBLE.
@@ -29,6 +29,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include "gui/Goptions.h"
 #include "image.h"
 #include "grab.h"
@@ -48,6 +56,37 @@
 #define KAMERA_UNDEF		((Kamera_t)-1)
 #define GERAET_UNDEF		((Geraet_t)-1)
 
+#define OUT_QUEUE_LEN		8		/* Max. number of queued items per stream */
+#define OUT_SOCK_CLIENTS	8		/* Max. number of output socket clients */
+#define OUT_SOCK_POLL		100		/* ms between checks for new socket clients */
+#define OUT_SOCK_TIMEOUT	1000	/* ms a client may block a send */
+
+typedef enum {
+	OUT_IMAGE,
+	OUT_REGIONS,
+	OUT_STRING,
+	OUT_SYNC,
+	OUT_OPAQUE					/* Not serialized data of iw_output_stream() */
+} outItemType;
+
+typedef struct outItem {
+	outItemType type;
+	char *data;					/* Serialized data, reused for later items */
+	int len, size;
+	BOOL done;					/* OUT_OPAQUE: The item was sent */
+	struct outItem *next;
+} outItem;
+
+typedef struct outStream {
+	char *name;
+	BOOL socket;				/* Use the Unix socket instead of DACS */
+	outItem *head, *tail;		/* Queued items */
+	outItem *free;				/* Items for reuse */
+	int cnt;					/* Number of allocated items */
+	int dropped;				/* Number of dropped item groups */
+	BOOL warned;
+} outStream;
+
 DACSentry_t *iw_dacs_entry = NULL;
 
 static char *dacsName = NULL,
@@ -59,6 +98,20 @@ static int image_x1 = 0, image_y1 = 0, image_x2 = 99999, image_y2 = 99999;
 
 static BOOL out_do_output;
 
+static pthread_mutex_t out_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t out_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t out_sent = PTHREAD_COND_INITIALIZER;	/* OUT_OPAQUE items */
+static pthread_t out_thread;
+static BOOL out_thread_run = FALSE, out_quit = FALSE;
+static GHashTable *out_streams = NULL;
+static GSList *out_stream_list = NULL;
+
+	/* Unix socket transport, used instead of DACS if out_sock_path!=NULL */
+static char *out_sock_path = NULL;
+static int out_sock_fd = -1;
+static int out_sock_clients[OUT_SOCK_CLIENTS];
+static int out_sock_nclients = 0;
+
 /*********************************************************************
   Free the image img.
   full==TRUE: Free the image data additionally.
@@ -342,31 +395,541 @@ static char* output_getSettingsFunc (char *in, char **out, void *data)
 	return NULL;
 }
 
+/*********************************************************************
+  Asynchronous output: Every stream has a bounded queue of serialized
+  items, a single sender thread forwards them via DACS or the local
+  Unix socket. The caller only copies its data into a recycled item
+  buffer and never waits for the transport.
+*********************************************************************/
+
+/*********************************************************************
+  Append len bytes at the end of item and return a pointer to them.
+  Sizes are rounded up to 4 bytes to keep all ints/floats aligned.
+*********************************************************************/
+static void *out_item_add (outItem *item, int len)
+{
+	void *pos;
+
+	len = (len+3) & ~3;
+	if (item->len + len > item->size) {
+		item->size = item->len + len + 1024;
+		item->data = realloc (item->data, item->size);
+		if (!item->data)
+			iw_error ("Out of memory for output buffer");
+	}
+	pos = item->data + item->len;
+	item->len += len;
+	return pos;
+}
+
+static void out_item_int (outItem *item, gint32 val)
+{
+	*(gint32*)out_item_add (item, sizeof(gint32)) = val;
+}
+
+static void out_item_float (outItem *item, float val)
+{
+	*(float*)out_item_add (item, sizeof(float)) = val;
+}
+
+static void out_item_polygon (outItem *item, const Polygon_t *poly)
+{
+	float *pts;
+	int i;
+
+	out_item_int (item, poly->n_punkte);
+	pts = out_item_add (item, sizeof(float)*2*poly->n_punkte);
+	for (i = 0; i < poly->n_punkte; i++) {
+		*pts++ = poly->punkt[i]->x;
+		*pts++ = poly->punkt[i]->y;
+	}
+}
+
+/* Reading back an item, pos is advanced like with out_item_add() */
+static gint32 out_get_int (char **pos)
+{
+	gint32 val = *(gint32*)*pos;
+	*pos += sizeof(gint32);
+	return val;
+}
+
+static float out_get_float (char **pos)
+{
+	float val = *(float*)*pos;
+	*pos += sizeof(float);
+	return val;
+}
+
+/*********************************************************************
+  Get the queue of stream name. If it does not exist, create one,
+  which uses the transport selected by iw_output_set_socket().
+  out_mutex must be locked.
+*********************************************************************/
+static outStream *out_stream_get (const char *name)
+{
+	outStream *stream;
+
+	if (!out_streams)
+		out_streams = g_hash_table_new (g_str_hash, g_str_equal);
+	stream = g_hash_table_lookup (out_streams, name);
+	if (!stream) {
+		stream = calloc (1, sizeof(outStream));
+		stream->name = strdup (name);
+		stream->socket = out_sock_path != NULL;
+		g_hash_table_insert (out_streams, stream->name, stream);
+		out_stream_list = g_slist_append (out_stream_list, stream);
+	}
+	return stream;
+}
+
+/*********************************************************************
+  Return a free item for stream. If the queue is full, the oldest
+  group of items up to and including the next SYNC is dropped. An
+  OUT_OPAQUE item is never dropped, its caller waits for it.
+  out_mutex must be locked.
+*********************************************************************/
+static outItem *out_item_get (outStream *stream)
+{
+	outItem *item;
+
+	if (!stream->free && stream->cnt >= OUT_QUEUE_LEN && stream->head &&
+		stream->head->type != OUT_OPAQUE) {
+		BOOL sync = FALSE;
+		while (stream->head && !sync && stream->head->type != OUT_OPAQUE) {
+			item = stream->head;
+			stream->head = item->next;
+			sync = item->type == OUT_SYNC;
+			item->next = stream->free;
+			stream->free = item;
+		}
+		if (!stream->head) stream->tail = NULL;
+		stream->dropped++;
+		iw_debug (3, "Output queue of '%s' full, dropped %d groups so far",
+				  stream->name, stream->dropped);
+	}
+	if (stream->free) {
+		item = stream->free;
+		stream->free = item->next;
+	} else {
+		item = calloc (1, sizeof(outItem));
+		stream->cnt++;
+	}
+	item->len = 0;
+	item->next = NULL;
+	return item;
+}
+
+/*********************************************************************
+  Start a new item of type type for stream name. Returns NULL if
+  nothing should be given out.
+*********************************************************************/
+static outItem *out_item_start (const char *name, outItemType type,
+								outStream **stream)
+{
+	outItem *item;
+
+	if (!out_do_output || !name || !*name) return NULL;
+
+	pthread_mutex_lock (&out_mutex);
+	*stream = out_stream_get (name);
+	item = out_item_get (*stream);
+	pthread_mutex_unlock (&out_mutex);
+
+	item->type = type;
+	return item;
+}
+
+/*********************************************************************
+  Append the (now completely serialized) item to the queue of stream
+  and wake up the sender thread.
+*********************************************************************/
+static void out_item_queue (outStream *stream, outItem *item)
+{
+	pthread_mutex_lock (&out_mutex);
+	if (stream->tail)
+		stream->tail->next = item;
+	else
+		stream->head = item;
+	stream->tail = item;
+	pthread_cond_signal (&out_cond);
+	pthread_mutex_unlock (&out_mutex);
+}
+
+/*********************************************************************
+  Convert the serialized image item to a Bild_t and send it via DACS.
+*********************************************************************/
+static DACSstatus_t out_send_dacs_image (const char *name, outItem *item)
+{
+	static Bild_t *bild = NULL;
+	grabImageData frame;
+	char *pos = item->data;
+	int w, h, p, y;
+
+	memset (&frame, 0, sizeof(frame));
+	frame.img.type = IW_8U;
+	frame.time.tv_sec = out_get_int (&pos);
+	frame.time.tv_usec = out_get_int (&pos);
+	frame.img_number = out_get_int (&pos);
+	w = out_get_int (&pos);
+	h = out_get_int (&pos);
+	frame.img.planes = out_get_int (&pos);
+	frame.img.ctab = out_get_int (&pos) ? IW_RGB : IW_YUV;
+
+	if (!bild || bild->delta.x != w || bild->delta.y != h ||
+		bild->anzahl != frame.img.planes) {
+		ndr_Bild_free (bild, FALSE);
+		bild = ndr_Bild_init (YUV_IMAGE_TITLE, &frame, w, h);
+		if (!bild) return D_GEN_ERROR;
+	}
+	bild->inhalt = frame.img.planes == 1 ? SW_BILD :
+		(frame.img.ctab == IW_RGB ? RGB_IMAGE_INHALT : YUV_IMAGE_INHALT);
+	bild->kopf.sec = frame.time.tv_sec;
+	bild->kopf.usec = frame.time.tv_usec;
+	bild->kopf.sequenz_nr = frame.img_number;
+	for (p = 0; p < bild->anzahl; p++) {
+		for (y = 0; y < h; y++) {
+			bild->bild[p][y] = (unsigned char*)pos;
+			pos += w;
+		}
+	}
+	return dacs_update_stream (iw_dacs_entry, (char*)name, bild);
+}
+
+/*********************************************************************
+  Read the serialized polygon at *pos into poly. The point pointers
+  are taken from *ptrs, which is advanced.
+*********************************************************************/
+static void out_get_polygon (char **pos, Polygon_t *poly, Punkt_t ***ptrs)
+{
+	int i;
+
+	poly->n_punkte = out_get_int (pos);
+	poly->punkt = *ptrs;
+	for (i = 0; i < poly->n_punkte; i++)
+		poly->punkt[i] = (Punkt_t*)(*pos + i*sizeof(Punkt_t));
+	*pos += sizeof(Punkt_t)*poly->n_punkte;
+	*ptrs += poly->n_punkte;
+}
+
+/*********************************************************************
+  Convert the serialized regions item to RegionHyp_t's and send them
+  via DACS.
+*********************************************************************/
+static DACSstatus_t out_send_dacs_regions (const char *name, outItem *item)
+{
+	static Punkt_t **ptrs = NULL;
+	static Polygon_t *polys = NULL, **polyptrs = NULL;
+	static int ptrs_len = 0, polys_len = 0;
+	RegionHyp_t hyp = {
+		{NULL, MODULE_TITLE,
+		 0.0, 0, 0, -1, -1, -1, -1,
+		 SKK_Region, 0, NULL},	/* kopf */
+		KAMERA_UNDEF,			/* kamera */
+		GERAET_UNDEF,			/* geraet */
+		NULL					/* region */
+	};
+	DACSstatus_t status = D_OK, s;
+	char *pos = item->data;
+	int cnt, i, j;
+
+	hyp.kopf.sec = out_get_int (&pos);
+	hyp.kopf.usec = out_get_int (&pos);
+	hyp.kopf.sequenz_nr = out_get_int (&pos);
+	cnt = out_get_int (&pos);
+
+	for (i = 0; i < cnt; i++) {
+		Region_t r;
+		Punkt_t **ptr;
+		int npts, len;
+
+		memset (&r, 0, sizeof(r));
+		hyp.kopf.id = out_get_int (&pos);
+		hyp.kopf.alter = out_get_int (&pos);
+		hyp.kopf.bewertung = out_get_float (&pos);
+		hyp.kopf.stabilitaet = out_get_int (&pos);
+		len = out_get_int (&pos);
+		hyp.kopf.typ = pos;			/* Terminated by out_item_regions() */
+		pos += (len+1+3) & ~3;
+
+		r.schwerpunkt.x = out_get_float (&pos);
+		r.schwerpunkt.y = out_get_float (&pos);
+		r.farbe = out_get_int (&pos);
+		r.farbe2 = out_get_int (&pos);
+		r.pixelanzahl = out_get_int (&pos);
+		r.umfang = out_get_int (&pos);
+		r.hauptachse.winkel = out_get_float (&pos);
+		r.hauptachse.radius = out_get_float (&pos);
+		r.exzentrizitaet = out_get_float (&pos);
+		r.compactness = out_get_float (&pos);
+		r.echtfarbe.modell = out_get_int (&pos);
+		r.echtfarbe.x = out_get_float (&pos);
+		r.echtfarbe.y = out_get_float (&pos);
+		r.echtfarbe.z = out_get_float (&pos);
+		npts = out_get_int (&pos);
+		r.n_einschluss = out_get_int (&pos);
+
+		if (npts > ptrs_len) {
+			ptrs_len = npts;
+			ptrs = realloc (ptrs, sizeof(Punkt_t*)*ptrs_len);
+		}
+		if (r.n_einschluss > polys_len) {
+			polys_len = r.n_einschluss;
+			polys = realloc (polys, sizeof(Polygon_t)*polys_len);
+			polyptrs = realloc (polyptrs, sizeof(Polygon_t*)*polys_len);
+		}
+		ptr = ptrs;
+		out_get_polygon (&pos, &r.polygon, &ptr);
+		for (j = 0; j < r.n_einschluss; j++) {
+			out_get_polygon (&pos, &polys[j], &ptr);
+			polyptrs[j] = &polys[j];
+		}
+		r.einschluss = polyptrs;
+
+		hyp.region = &r;
+		if ((s = dacs_update_stream (iw_dacs_entry, (char*)name, &hyp)) != D_OK)
+			status = s;
+	}
+	return status;
+}
+
+/*********************************************************************
+  Send item of stream to all clients of the Unix socket. Clients,
+  which do not accept the data, are disconnected.
+*********************************************************************/
+static void out_send_socket (outStream *stream, outItem *item)
+{
+	struct iovec iov[3];
+	guint32 head[3];
+	int i, len;
+
+	head[1] = item->type;
+	head[2] = strlen (stream->name);
+	head[0] = sizeof(head[1]) + sizeof(head[2]) + head[2] + item->len;
+	iov[0].iov_base = head;
+	iov[0].iov_len = sizeof(head);
+	iov[1].iov_base = stream->name;
+	iov[1].iov_len = head[2];
+	iov[2].iov_base = item->data;
+	iov[2].iov_len = item->len;
+	len = sizeof(head) + head[2] + item->len;
+
+	for (i = 0; i < out_sock_nclients; i++) {
+		struct msghdr msg;
+		memset (&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 3;
+		if (sendmsg (out_sock_clients[i], &msg, MSG_NOSIGNAL) != len) {
+			iw_debug (2, "Output client %d disconnected", out_sock_clients[i]);
+			close (out_sock_clients[i]);
+			out_sock_clients[i--] = out_sock_clients[--out_sock_nclients];
+		}
+	}
+}
+
+/*********************************************************************
+  Accept all pending connections on the output socket.
+*********************************************************************/
+static void out_sock_accept (void)
+{
+	struct timeval timeout = {OUT_SOCK_TIMEOUT/1000, (OUT_SOCK_TIMEOUT%1000)*1000};
+	int fd;
+
+	while ((fd = accept (out_sock_fd, NULL, NULL)) >= 0) {
+		if (out_sock_nclients >= OUT_SOCK_CLIENTS) {
+			iw_warning ("Too many output clients, rejecting new connection");
+			close (fd);
+			continue;
+		}
+		/* Sends are blocking, but a stuck client is dropped after a timeout */
+		fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) & ~O_NONBLOCK);
+		setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		out_sock_clients[out_sock_nclients++] = fd;
+		iw_debug (2, "New output client %d on '%s'", fd, out_sock_path);
+	}
+}
+
+/*********************************************************************
+  Send item of stream with the transport of the stream.
+*********************************************************************/
+static void out_send_item (outStream *stream, outItem *item)
+{
+	DACSstatus_t status = D_OK;
+
+	if (stream->socket) {
+		out_send_socket (stream, item);
+		return;
+	}
+	switch (item->type) {
+		case OUT_IMAGE:
+			status = out_send_dacs_image (stream->name, item);
+			break;
+		case OUT_REGIONS:
+			status = out_send_dacs_regions (stream->name, item);
+			break;
+		case OUT_STRING:
+		case OUT_OPAQUE:
+			status = dacs_update_stream (iw_dacs_entry, stream->name, item->data);
+			break;
+		case OUT_SYNC:
+			if ((status = dacs_sync_stream (iw_dacs_entry, stream->name,
+											STREAM_SYNC)) != D_OK)
+				iw_warning ("Error %d syncing stream '%s'", status, stream->name);
+			return;
+	}
+	if (status != D_OK)
+		iw_warning ("Error %d updating stream '%s'", status, stream->name);
+}
+
+/*********************************************************************
+  Sender thread: Forward the queued items of all streams (round
+  robin, one item per stream at a time) till iw_output_cleanup().
+*********************************************************************/
+static void *out_sender (void *data)
+{
+	GSList *start = NULL;
+	int i, n;
+
+	iw_showtid (1, "Output sender");
+
+	pthread_mutex_lock (&out_mutex);
+	while (1) {
+		outStream *stream = NULL;
+		outItem *item;
+		GSList *pos;
+
+		/* Round robin, starting after the last sent stream */
+		pos = start;
+		n = g_slist_length (out_stream_list);
+		for (i = 0; i < n; i++) {
+			pos = (pos && pos->next) ? pos->next : out_stream_list;
+			if (((outStream*)pos->data)->head) {
+				stream = pos->data;
+				start = pos;
+				break;
+			}
+		}
+
+		if (!stream) {
+			if (out_quit) break;
+			if (out_sock_fd >= 0) {
+				struct timespec until;
+				struct timeval now;
+				gettimeofday (&now, NULL);
+				until.tv_sec = now.tv_sec + (now.tv_usec/1000 + OUT_SOCK_POLL) / 1000;
+				until.tv_nsec = ((now.tv_usec/1000 + OUT_SOCK_POLL) % 1000) * 1000000;
+				pthread_cond_timedwait (&out_cond, &out_mutex, &until);
+			} else
+				pthread_cond_wait (&out_cond, &out_mutex);
+			if (out_sock_fd >= 0) {
+				pthread_mutex_unlock (&out_mutex);
+				out_sock_accept();
+				pthread_mutex_lock (&out_mutex);
+			}
+			continue;
+		}
+
+		item = stream->head;
+		stream->head = item->next;
+		if (!stream->head) stream->tail = NULL;
+		pthread_mutex_unlock (&out_mutex);
+
+		out_send_item (stream, item);
+
+		pthread_mutex_lock (&out_mutex);
+		if (item->type == OUT_OPAQUE) {
+			/* Owned by the waiting iw_output_stream() */
+			item->done = TRUE;
+			pthread_cond_broadcast (&out_sent);
+		} else {
+			item->next = stream->free;
+			stream->free = item;
+		}
+	}
+	pthread_mutex_unlock (&out_mutex);
+	return NULL;
+}
+
+/*********************************************************************
+  Open the Unix socket for the output streams.
+*********************************************************************/
+static void out_sock_open (void)
+{
+	struct sockaddr_un addr;
+
+	if (!*out_sock_path) {
+		free (out_sock_path);
+		out_sock_path = malloc (strlen(dacsName)+20);
+		sprintf (out_sock_path, "/tmp/%s-output", dacsName);
+	}
+	if (strlen(out_sock_path) >= sizeof(addr.sun_path))
+		iw_error ("Output socket name '%s' too long", out_sock_path);
+
+	if ((out_sock_fd = socket (PF_UNIX, SOCK_STREAM, 0)) < 0)
+		iw_error ("Unable to create output socket: %s", strerror(errno));
+	memset (&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, out_sock_path);
+	unlink (out_sock_path);
+	if (bind (out_sock_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+		listen (out_sock_fd, OUT_SOCK_CLIENTS) < 0)
+		iw_error ("Unable to listen on output socket '%s': %s",
+				  out_sock_path, strerror(errno));
+	fcntl (out_sock_fd, F_SETFL, fcntl (out_sock_fd, F_GETFL) | O_NONBLOCK);
+	iw_debug (2, "Output streams available on socket '%s'", out_sock_path);
+}
+
 /*********************************************************************
   Output a SYNC signal on stream 'stream'.
 *********************************************************************/
 void iw_output_sync (const char *stream)
 {
-	DACSstatus_t status;
-
-	if (!out_do_output) return;
+	outStream *s;
+	outItem *item;
 
-	if ((status = dacs_sync_stream (iw_dacs_entry, (char*)stream,
-									STREAM_SYNC)) != D_OK)
-		iw_warning ("Error %d syncing stream '%s'", status, stream);
+	if ((item = out_item_start (stream, OUT_SYNC, &s)))
+		out_item_queue (s, item);
 }
 
 /*********************************************************************
-  Output 'data' on stream 'stream'.
+  Output 'data' on stream 'stream'. As 'data' has an unknown type, it
+  can not be copied. It is queued without copying and the function
+  waits till the sender thread has sent it after all earlier queued
+  data of 'stream'.
 *********************************************************************/
 void iw_output_stream (const char *stream, const void *data)
 {
-	DACSstatus_t status;
+	outItem item;
+	outStream *s;
+	BOOL warn = FALSE;
 
 	if (!out_do_output) return;
 
-	if ((status = dacs_update_stream (iw_dacs_entry, (char*)stream, (char*)data)) != D_OK)
-		iw_warning ("Error %d updating stream '%s'", status, stream);
+	/* All DACS calls are done by the sender thread, so the item is
+	   sent from there as well and the caller waits. */
+	memset (&item, 0, sizeof(item));
+	item.type = OUT_OPAQUE;
+	item.data = (char*)data;
+
+	pthread_mutex_lock (&out_mutex);
+	s = out_stream_get (stream);
+	if (s->socket) {
+		warn = !s->warned;
+		s->warned = TRUE;
+	} else {
+		if (s->tail)
+			s->tail->next = &item;
+		else
+			s->head = &item;
+		s->tail = &item;
+		pthread_cond_signal (&out_cond);
+		while (!item.done)
+			pthread_cond_wait (&out_sent, &out_mutex);
+	}
+	pthread_mutex_unlock (&out_mutex);
+
+	if (warn)
+		iw_warning ("Stream '%s' has an unknown type, "
+					"it can not be sent via the output socket", stream);
 }
 
 /*********************************************************************
@@ -375,14 +938,12 @@ void iw_output_stream (const char *stream, const void *data)
 *********************************************************************/
 void iw_output_image (const grabImageData *img, const char *stream)
 {
-	static Bild_t *bild = NULL;
-	DACSstatus_t status;
 	int p, y, x, x1, x2, y1, y2;
-	unsigned char *block;
+	unsigned char *block, *pos;
+	outItem *item;
+	outStream *s;
 
 	if (!stream) stream = stream_images;
-	if (!out_do_output || !stream || !*stream) return;
-
 	if (img->img.type != IW_8U) return;
 
 	x1 = image_x1 / img->downw;
@@ -403,30 +964,33 @@ void iw_output_image (const grabImageData *img, const char *stream)
 		y1 = y2;
 		y2 = y;
 	}
-	if (x1 != x2 && y1 != y2) {
-		x = x2-x1+1;
-		y = y2-y1+1;
-
-		if (!bild || (bild->delta.x != x || bild->delta.y != y ||
-					  bild->anzahl != img->img.planes)) {
-			ndr_Bild_free (bild, FALSE);
-			bild = ndr_Bild_init (YUV_IMAGE_TITLE, img, x, y);
-			if (!bild) return;
-		}
-
-		for (p = 0; p < bild->anzahl; p++) {
-			block = img->img.data[p] + y1 * img->img.width + x1;
-			for (y = 0; y < bild->delta.y; y++)
-				bild->bild[p][y] = block + y * img->img.width;
+	if (x1 == x2 || y1 == y2) return;
+
+	if (!(item = out_item_start (stream, OUT_IMAGE, &s))) return;
+
+	x = x2-x1+1;
+	y = y2-y1+1;
+	out_item_int (item, img->time.tv_sec);
+	out_item_int (item, img->time.tv_usec);
+	out_item_int (item, img->img_number);
+	out_item_int (item, x);
+	out_item_int (item, y);
+	out_item_int (item, img->img.planes);
+	out_item_int (item, img->img.ctab == IW_RGB);
+
+	pos = out_item_add (item, x*y*img->img.planes);
+	for (p = 0; p < img->img.planes; p++) {
+		block = img->img.data[p] + y1 * img->img.width + x1;
+		for (y = y1; y <= y2; y++) {
+			memcpy (pos, block, x);
+			pos += x;
+			block += img->img.width;
 		}
-
-		if ((status = dacs_update_stream (iw_dacs_entry, (char*)stream, bild))
-			!= D_OK)
-			iw_warning ("Error %d updating stream '%s'", status, stream);
-		if ((status = dacs_sync_stream (iw_dacs_entry, (char*)stream, STREAM_SYNC))
-			!= D_OK)
-			iw_warning ("Error %d syncing stream '%s'", status, stream);
 	}
+	out_item_queue (s, item);
+
+	if ((item = out_item_start (stream, OUT_SYNC, &s)))
+		out_item_queue (s, item);
 }
 
 /*********************************************************************
@@ -438,59 +1002,77 @@ int iw_output_regions (iwRegion *regions, int nregions,
 					   struct timeval time, int img_num, const char *typ,
 					   const char *stream)
 {
-	RegionHyp_t region_hyp = {
-		{NULL, MODULE_TITLE,
-		 0.0, 0, 0, -1, -1, -1, -1,
-		 SKK_Region, 0, NULL},	/* kopf */
-		KAMERA_UNDEF,			/* kamera */
-		GERAET_UNDEF,			/* geraet */
-		NULL					/* region */
-	};
-	char *dtyp, *data;
-	DACSstatus_t status;
-	int i, anzout = 0;
 	static plugDataFunc *func = (plugDataFunc*)1;
+	int i, j, anzout = 0, npts, len, cnt_pos;
+	char *data, *dtyp;
+	outItem *item;
+	outStream *s;
 
-	if (!out_do_output) return 0;
+	if (!(item = out_item_start (stream, OUT_REGIONS, &s))) return 0;
 
 	if (func == (plugDataFunc*)1) {
 		func = NULL;
 		func = plug_function_get (IW_REG_DATA_IDENT, NULL);
 	}
-	region_hyp.kopf.alter = -1;
-	region_hyp.kopf.sec = time.tv_sec;
-	region_hyp.kopf.usec = time.tv_usec;
-	region_hyp.kopf.sequenz_nr = img_num;
+	out_item_int (item, time.tv_sec);
+	out_item_int (item, time.tv_usec);
+	out_item_int (item, img_num);
+	cnt_pos = item->len;
+	out_item_int (item, 0);
 
 	for (i=0; i<nregions; i++) {
-		if (regions[i].r.pixelanzahl > 0) {
-			if (regions[i].data && func)
-				data = ((iwRegDataFunc)func->func) (func->plug, &regions[i],
-													IW_REG_DATA_CONVERT);
-			else
-				data = NULL;
-			dtyp = malloc (sizeof(char)*strlen(typ) + 2 +
-						   (data ? strlen(data):0));
-			strcpy (dtyp, typ);
-			if (data) {
-				strcat (dtyp, " ");
-				strcat (dtyp, data);
-			}
-			region_hyp.kopf.typ = dtyp;
-			region_hyp.region = &regions[i].r;
-			region_hyp.kopf.id = regions[i].id;
-			region_hyp.kopf.alter = regions[i].alter;
-			region_hyp.kopf.bewertung = regions[i].judgement;
-			region_hyp.kopf.stabilitaet = regions[i].judge_kalman*100;
-
-			if ((status = dacs_update_stream (iw_dacs_entry, (char*)stream, &region_hyp))
-				!= D_OK)
-				iw_warning ("Error %d updating stream '%s'", status, stream);
-			if (data) free (data);
-			if (dtyp) free (dtyp);
-			anzout++;
+		Region_t *r = &regions[i].r;
+
+		if (r->pixelanzahl <= 0) continue;
+
+		if (regions[i].data && func)
+			data = ((iwRegDataFunc)func->func) (func->plug, &regions[i],
+												IW_REG_DATA_CONVERT);
+		else
+			data = NULL;
+		out_item_int (item, regions[i].id);
+		out_item_int (item, regions[i].alter);
+		out_item_float (item, regions[i].judgement);
+		out_item_int (item, regions[i].judge_kalman*100);
+
+		/* Type string: "typ[ data]", always with a '\0' */
+		len = strlen(typ) + (data ? strlen(data)+1 : 0);
+		out_item_int (item, len);
+		dtyp = out_item_add (item, len+1);
+		strcpy (dtyp, typ);
+		if (data) {
+			strcat (dtyp, " ");
+			strcat (dtyp, data);
+			free (data);
 		}
+
+		out_item_float (item, r->schwerpunkt.x);
+		out_item_float (item, r->schwerpunkt.y);
+		out_item_int (item, r->farbe);
+		out_item_int (item, r->farbe2);
+		out_item_int (item, r->pixelanzahl);
+		out_item_int (item, r->umfang);
+		out_item_float (item, r->hauptachse.winkel);
+		out_item_float (item, r->hauptachse.radius);
+		out_item_float (item, r->exzentrizitaet);
+		out_item_float (item, r->compactness);
+		out_item_int (item, r->echtfarbe.modell);
+		out_item_float (item, r->echtfarbe.x);
+		out_item_float (item, r->echtfarbe.y);
+		out_item_float (item, r->echtfarbe.z);
+		npts = r->polygon.n_punkte;
+		for (j = 0; j < r->n_einschluss; j++)
+			npts += r->einschluss[j]->n_punkte;
+		out_item_int (item, npts);
+		out_item_int (item, r->n_einschluss);
+		out_item_polygon (item, &r->polygon);
+		for (j = 0; j < r->n_einschluss; j++)
+			out_item_polygon (item, r->einschluss[j]);
+		anzout++;
 	}
+	*(gint32*)(item->data + cnt_pos) = anzout;
+	out_item_queue (s, item);
+
 	return anzout;
 }
 
@@ -501,17 +1083,12 @@ int iw_output_regions (iwRegion *regions, int nregions,
 void iw_output_hypos (iwRegion *regions, int nregions,
 					  struct timeval time, int img_num, const char *stream)
 {
-	DACSstatus_t status;
-
 	if (!out_do_output || !stream || !*stream) return;
 
 	if (regions)
 		iw_output_regions (regions, nregions, time, img_num,
 						   IW_GHYP_TITLE, stream);
-
-	if ((status = dacs_sync_stream (iw_dacs_entry, (char*)stream, STREAM_SYNC))
-		!= D_OK)
-		iw_warning ("Error %d syncing stream '%s'", status, stream);
+	iw_output_sync (stream);
 }
 
 /*********************************************************************
@@ -519,16 +1096,14 @@ void iw_output_hypos (iwRegion *regions, int nregions,
 *********************************************************************/
 void iw_output_status (const char *msg)
 {
-	DACSstatus_t status;
+	outItem *item;
+	outStream *s;
 
-	if (!out_do_output || !stream_status || !*stream_status) return;
+	if (!(item = out_item_start (stream_status, OUT_STRING, &s))) return;
+	strcpy (out_item_add (item, strlen(msg)+1), msg);
+	out_item_queue (s, item);
 
-	if ((status = dacs_update_stream (iw_dacs_entry, stream_status, (char*)msg))
-		!= D_OK)
-		iw_warning ("Error %d updating stream '%s'", status, stream_status);
-	if ((status = dacs_sync_stream (iw_dacs_entry, stream_status, STREAM_SYNC))
-		!= D_OK)
-		iw_warning ("Error %d syncing stream '%s'", status, stream_status);
+	iw_output_sync (stream_status);
 }
 
 /*********************************************************************
@@ -551,9 +1126,14 @@ char *iw_output_register_stream (const char *suffix, NDRfunction_t *fkt)
 	char *name = malloc(strlen(dacsName)+strlen(suffix)+1);
 	DACSstatus_t status;
 
-	iw_output_register();
-
 	sprintf (name, "%s%s", dacsName, suffix);
+	pthread_mutex_lock (&out_mutex);
+	out_stream_get (name);
+	pthread_mutex_unlock (&out_mutex);
+	if (out_sock_path)
+		return name;
+
+	iw_output_register();
 	if ((status = dacs_register_stream (iw_dacs_entry, name, fkt)) != D_OK)
 		iw_error ("Unable to register output stream '%s', error %d", name, status);
 
@@ -611,10 +1191,36 @@ void iw_output_set_name (char *name)
 }
 
 /*********************************************************************
-  PRIVATE: Close any DACS connections.
+  PRIVATE: Use a local Unix socket named path (""/NULL: default name)
+  instead of DACS for all output streams.
+*********************************************************************/
+void iw_output_set_socket (const char *path)
+{
+	out_sock_path = strdup (path ? path : "");
+}
+
+/*********************************************************************
+  PRIVATE: Stop the sender thread after sending all queued items and
+  close any DACS connections and the output socket.
 *********************************************************************/
 void iw_output_cleanup (void)
 {
+	out_do_output = FALSE;
+	if (out_thread_run) {
+		pthread_mutex_lock (&out_mutex);
+		out_quit = TRUE;
+		pthread_cond_signal (&out_cond);
+		pthread_mutex_unlock (&out_mutex);
+		pthread_join (out_thread, NULL);
+		out_thread_run = FALSE;
+	}
+	if (out_sock_fd >= 0) {
+		while (out_sock_nclients > 0)
+			close (out_sock_clients[--out_sock_nclients]);
+		close (out_sock_fd);
+		out_sock_fd = -1;
+		unlink (out_sock_path);
+	}
 	if (iw_dacs_entry) {
 		dacs_unregister (iw_dacs_entry);
 		iw_dacs_entry = NULL;
@@ -627,6 +1233,11 @@ void iw_output_cleanup (void)
 *********************************************************************/
 void iw_output_init (int output)
 {
+	if (out_sock_path)
+		out_sock_open();
+	if (pthread_create (&out_thread, NULL, out_sender, NULL) != 0)
+		iw_error ("Unable to start the output thread");
+	out_thread_run = TRUE;
 	out_do_output = TRUE;
 
 	if (output & IW_OUTPUT_FUNCTION) {
@@ -643,8 +1254,9 @@ void iw_output_init (int output)
 	if (output & IW_OUTPUT_STREAM) {
 		stream_images = iw_output_register_stream ("_images", (NDRfunction_t*)ndr_Bild);
 
-		iw_output_register_function ("_setCrop", (DACSfunction_t*)output_setCropFunc,
-									 (NDRfunction_t*)ndr_string, NULL, NULL);
+		if (!out_sock_path)
+			iw_output_register_function ("_setCrop", (DACSfunction_t*)output_setCropFunc,
+										 (NDRfunction_t*)ndr_string, NULL, NULL);
 	}
 	if (output & IW_OUTPUT_STATUS)
 		stream_status = iw_output_register_stream ("_status", (NDRfunction_t*)ndr_string);
@@ -45,13 +45,21 @@ extern DACSentry_t *iw_dacs_entry;
 extern "C" {
 #endif
 
+/*********************************************************************
+  All output functions only queue the data and return immediately,
+  a separate thread sends it. If the queue of a stream is full, the
+  oldest data up to the next SYNC is dropped.
+*********************************************************************/
+
 /*********************************************************************
   Output a SYNC signal on stream 'stream'.
 *********************************************************************/
 void iw_output_sync (const char *stream);
 
 /*********************************************************************
-  Output 'data' on stream 'stream'.
+  Output 'data' on stream 'stream'. As 'data' has an unknown type, it
+  can not be copied and the function returns after the output thread
+  has sent it after all earlier queued data of 'stream'.
 *********************************************************************/
 void iw_output_stream (const char *stream, const void *data);
 
@@ -47,7 +47,14 @@ BOOL *iw_output_get_output (void);
 void iw_output_set_name (char *name);
 
 /*********************************************************************
-  Close any DACS connections.
+  Use a local Unix socket named path (""/NULL: default name) instead
+  of DACS for all output streams.
+*********************************************************************/
+void iw_output_set_socket (const char *path);
+
+/*********************************************************************
+  Stop the sender thread after sending all queued items and close any
+  DACS connections and the output socket.
 *********************************************************************/
 void iw_output_cleanup (void);
 
@@ -729,6 +729,26 @@ void plug_cleanup_all (void)
 	}
 }
 
+/*********************************************************************
+  Call the plugin process()-function and measure it with the plugin
+  timer or, if there is none, with a trace scope.
+*********************************************************************/
+static BOOL plug_process_call (plugPlugin *plug, char *ident, plugData *data)
+{
+	BOOL cont;
+
+	if (plug->timer >= 0)
+		iw_time_start (plug->timer);
+	else
+		iw_time_scope_begin (plug->def->name);
+	cont = plug->def->process (plug->def, ident, data);
+	if (plug->timer >= 0)
+		iw_time_stop (plug->timer, FALSE);
+	else
+		iw_time_scope_end();
+	return cont;
+}
+
 /*********************************************************************
   Call the plugin process()-function if the plugin is enabled.
 *********************************************************************/
@@ -741,11 +761,7 @@ BOOL plug_process (plugPlugin *plug, char *ident, plugData *data)
 
 		if (*plug->plugins == PLUGINS_FIRST) {
 			/* No plugins entry -> Call the plugin directly. */
-			if (plug->timer >= 0)
-				iw_time_start (plug->timer);
-			cont = plug->def->process (plug->def, ident, data);
-			if (plug->timer >= 0)
-				iw_time_stop (plug->timer, FALSE);
+			cont = plug_process_call (plug, ident, data);
 		} else {
 			/* Distribute new data according to the option page settings. */
 			plugData **datas = NULL;
@@ -774,11 +790,7 @@ BOOL plug_process (plugPlugin *plug, char *ident, plugData *data)
 				if (cont && strcmp (plug->def->name, datas[i]->plug->name)) {
 					iw_debug (4, "%s: Processing data from '%s'...",
 							  plug->def->name, datas[i]->plug->name);
-					if (plug->timer >= 0)
-						iw_time_start (plug->timer);
-					cont = plug->def->process (plug->def, ident, datas[i]);
-					if (plug->timer >= 0)
-						iw_time_stop (plug->timer, FALSE);
+					cont = plug_process_call (plug, ident, datas[i]);
 				}
 				plug_data_unget (datas[i]);
 			}
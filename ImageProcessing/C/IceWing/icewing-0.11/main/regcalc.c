@@ -16,7 +16,7 @@
 #include <math.h>
 #include <string.h>
 
-#include "region.h"
+#include "region_i.h"
 #include "tools/tools.h"
 #include "plugin_comm.h"
 
@@ -26,16 +26,6 @@
 #define VERZERR_FAKTOR			1.333
 #define MAX_REGIONS				3000	/* Max. erlaubte Anzahl von regionen */
 
-struct _regCalcData {
-	int minPixelCount;
-	iwImage *color;
-	uchar **orig_img;
-	uchar *confimg;
-	iwRegThinning thin_mode;
-	float thin_maxdist;
-	iwRegMode mode;
-};
-
 typedef struct {
 	int pixelcount;			/* Anzahl der Pixel der Region */
 	int summe_conf;			/* Summe der Pixel im ConfidenceMapped Bild */
@@ -68,6 +58,38 @@ typedef struct {
 	int *liste;
 } PUNKT_LISTE;
 
+/* Speicher der Regionenberechnung, wird zwischen Aufrufen gehalten */
+typedef struct {
+	int xlen_old, ylen_old;
+	gint32 **einschlfeld;
+	gint32 *einschlimage;
+	REGION_INFO *region_info;
+	Polygon_t *newpolygon;
+	iwRegion *regionen;
+	PUNKTFELD *punktfeld;
+	PUNKT_LISTE punkte;
+	int len_region_info,		/* Groesse von region_info, ... ==
+								   max Anzahl Regionen */
+		len_region_big;			/* Groesse von regionen, ... ==
+								   max anz Regionen mit pixelcount > minPixelCount */
+} REGCALC_STATE;
+
+struct _regCalcData {
+	int minPixelCount;
+	iwImage *color;
+	uchar **orig_img;
+	uchar *confimg;
+	iwRegThinning thin_mode;
+	float thin_maxdist;
+	iwRegMode mode;
+
+	iwRegLabelState label;		/* State of iw_reg_label_..._data() */
+	REGCALC_STATE calc;			/* State of iw_reg_calc_data() */
+};
+
+/* Used by iw_reg_calc() and iw_reg_calc_img() */
+static iwRegCalcData *regcalc_default = NULL;
+
 static float calcdist (Punkt_t p1, Punkt_t p2)
 {
 	return((p1.x-p2.x)*(p1.x-p2.x)+(p1.y-p2.y)*(p1.y-p2.y));
@@ -666,18 +688,17 @@ iwRegion *iw_reg_calc_data (int xlen, int ylen, gint32 *image,
 	Punkt_t spunkt;
 	Polygon_t *einschlpolygon, *duennpolygon;
 	REGION_INFO *infopntr;
-	static int xlen_old = 0, ylen_old = 0;
-	static gint32 **einschlfeld = NULL;
-	static gint32 *einschlimage = NULL;
-	static REGION_INFO *region_info = NULL;
-	static Polygon_t *newpolygon = NULL;
-	static iwRegion *regionen = NULL;
-	static PUNKTFELD *punktfeld = NULL;
-	static PUNKT_LISTE punkte = {0, NULL};
-	static int len_region_info = 0,		/* Groesse von region_info, ... ==
-										   max Anzahl Regionen */
-			   len_region_big = 0;		/* Groesse von regionen, ... ==
-										   max anz Regionen mit pixelcount > minPixelCount */
+	REGCALC_STATE *st = &data->calc;
+	int xlen_old = st->xlen_old, ylen_old = st->ylen_old;
+	gint32 **einschlfeld = st->einschlfeld;
+	gint32 *einschlimage = st->einschlimage;
+	REGION_INFO *region_info = st->region_info;
+	Polygon_t *newpolygon = st->newpolygon;
+	iwRegion *regionen = st->regionen;
+	PUNKTFELD *punktfeld = st->punktfeld;
+	PUNKT_LISTE punkte = st->punkte;
+	int len_region_info = st->len_region_info,
+		len_region_big = st->len_region_big;
 	uchar *y_img, *u_img, *v_img;
 
 	if (*num_reg > MAX_REGIONS) {
@@ -1155,17 +1176,51 @@ iwRegion *iw_reg_calc_data (int xlen, int ylen, gint32 *image,
 											 IW_REG_DATA_SET);
 		}
 	}
+	st->xlen_old = xlen_old;
+	st->ylen_old = ylen_old;
+	st->einschlfeld = einschlfeld;
+	st->einschlimage = einschlimage;
+	st->region_info = region_info;
+	st->newpolygon = newpolygon;
+	st->regionen = regionen;
+	st->punktfeld = punktfeld;
+	st->punkte = punkte;
+	st->len_region_info = len_region_info;
+	st->len_region_big = len_region_big;
+
 	*num_reg = reg_count;
 	return regionen;
 }
+
+/*********************************************************************
+  Return the static data struct used by iw_reg_calc() and
+  iw_reg_calc_img() with all settings reset to the defaults.
+*********************************************************************/
+static iwRegCalcData *regcalc_get_default (void)
+{
+	iwRegCalcData *data;
+
+	if (!regcalc_default)
+		regcalc_default = iw_reg_data_create();
+	data = regcalc_default;
+
+	data->minPixelCount = 0;
+	data->color = NULL;
+	data->orig_img = NULL;
+	data->confimg = NULL;
+	data->thin_mode = IW_REG_THIN_DIST;
+	data->thin_maxdist = MAX_DIST_KONTUR;
+	data->mode = 0;
+	return data;
+}
+
 iwRegion *iw_reg_calc (int xlen, int ylen, uchar *color,
 						gint32 *image, uchar **orig_img, uchar *confimg,
 						int *num_reg, int doEinschluss, int minPixelCount)
 {
-	iwRegCalcData *data = iw_reg_data_create();
+	iwRegCalcData *data = regcalc_get_default();
 	iwImage cimg;
 	uchar *planeptr[1];
-	iwRegion *regs;
 
 	iw_img_init (&cimg);
 	cimg.data = planeptr;
@@ -1180,26 +1235,18 @@ iwRegion *iw_reg_calc (int xlen, int ylen, uchar *color,
 		iw_reg_data_set_mode (data, IW_REG_INCLUSION);
 	else
 		iw_reg_data_set_mode (data, IW_REG_NO_ZERO);
-	regs = iw_reg_calc_data (xlen, ylen, image, num_reg, data);
-
-	iw_reg_data_free (data);
-
-	return regs;
+	return iw_reg_calc_data (xlen, ylen, image, num_reg, data);
 }
 iwRegion *iw_reg_calc_img (int xlen, int ylen, iwImage *color,
 						   gint32 *image, uchar **orig_img, uchar *confimg,
 						   int *num_reg, iwRegMode mode, int minPixelCount)
 {
-	iwRegCalcData *data = iw_reg_data_create();
-	iwRegion *regs;
+	iwRegCalcData *data = regcalc_get_default();
 
 	iw_reg_data_set_minregion (data, minPixelCount);
 	iw_reg_data_set_images (data, color, orig_img, confimg);
 	iw_reg_data_set_mode (data, mode);
-	regs = iw_reg_calc_data (xlen, ylen, image, num_reg, data);
-
-	iw_reg_data_free (data);
-	return regs;
+	return iw_reg_calc_data (xlen, ylen, image, num_reg, data);
 }
 
 /*********************************************************************
@@ -1226,7 +1273,45 @@ iwRegCalcData *iw_reg_data_create (void)
 
 void iw_reg_data_free (iwRegCalcData *data)
 {
-	if (data) free (data);
+	REGCALC_STATE *st;
+	int i;
+
+	if (!data) return;
+
+	st = &data->calc;
+	if (st->region_info) {
+		for (i=(-1); i<st->len_region_info; ++i)
+			free (st->region_info[i].merge-1);
+		free (st->region_info-1);
+		free (st->einschlfeld[0]);
+		free (st->einschlfeld[1]);
+		free (st->einschlfeld);
+	}
+	if (st->punktfeld) {
+		free (st->punktfeld->polygons);
+		free (st->punktfeld->pktarray);
+		free (st->punktfeld->pktbar);
+		free (st->punktfeld);
+	}
+	if (st->regionen) {
+		for (i=0; i<st->len_region_big; i++)
+			free (st->regionen[i].r.einschluss);
+		free (st->regionen);
+	}
+	if (st->newpolygon) free (st->newpolygon);
+	if (st->einschlimage) free (st->einschlimage);
+	if (st->punkte.liste) free (st->punkte.liste);
+	iw_reg_label_state_free (&data->label);
+
+	free (data);
+}
+
+/*********************************************************************
+  Return the labeling state of data.
+*********************************************************************/
+iwRegLabelState *iw_reg_data_get_label (iwRegCalcData *data)
+{
+	return &data->label;
 }
 
 void iw_reg_data_set_minregion (iwRegCalcData *data, int minPixelCount)
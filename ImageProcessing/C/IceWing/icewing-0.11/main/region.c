@@ -31,7 +31,7 @@
 #include <string.h>
 
 #include "tools/tools.h"
-#include "region.h"
+#include "region_i.h"
 
 #define isequal(a,b)	(fabsf((a)-(b)) < 0.00001)
 
@@ -42,10 +42,10 @@
 * Datum:	11.1.1996
 **/
 
-static gint32 *r_alias = NULL;
-static gint32 last_new = -1, last_old = -1;
+/* Labeling state used by the functions without an iwRegCalcData */
+static iwRegLabelState lab_default;
 
-static int normalize (int r)
+static int normalize (const gint32 *r_alias, int r)
 {
 	while (r_alias[r] >= 0 && r_alias[r] < r)
 		r = r_alias[r];
@@ -53,8 +53,9 @@ static int normalize (int r)
 	return r;
 }
 
-static inline void alias (gint32 r_new, gint32 r_old)
+static inline void alias (iwRegLabelState *lab, gint32 r_new, gint32 r_old)
 {
+	gint32 *r_alias = lab->r_alias;
 	int r_al;
 
 	if (r_new == r_old) return;
@@ -63,11 +64,11 @@ static inline void alias (gint32 r_new, gint32 r_old)
 		r_al = r_old; r_old = r_new; r_new = r_al;
 	}
 
-	if (last_new == r_new && last_old == r_old)
+	if (lab->last_new == r_new && lab->last_old == r_old)
 		return;
 	else {
-		last_new = r_new;
-		last_old = r_old;
+		lab->last_new = r_new;
+		lab->last_old = r_old;
 	}
 
 	do {
@@ -84,45 +85,53 @@ static inline void alias (gint32 r_new, gint32 r_old)
 }
 
 /*********************************************************************
-  Regionenlabeling des Bildes color (Groesse xsize x ysize)
-  durchfuehren und nach region schreiben.
-  Falls minPixelCount>0:
-	Pixelanzahl, Farbe und Schwerpunkt der Regionen berechnen.
-	Pixelanzahl < minPixelCount: Pixelanzahl der Region = Null
+  Free the memory of the labeling state lab.
 *********************************************************************/
-static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
-									  gint32 *region, int *nregions, int minPixelCount)
+void iw_reg_label_state_free (iwRegLabelState *lab)
 {
-	static int len_COMinfo = 0;
-	static iwRegCOMinfo *COMinfo = NULL;
+	if (lab->r_alias) free (lab->r_alias-1);
+	if (lab->COMinfo) free (lab->COMinfo);
+	memset (lab, 0, sizeof(iwRegLabelState));
+}
 
-	static int _xsize = -1;
-	static int _ysize = -1;
+/*********************************************************************
+  Return the labeling state of data, data==NULL: The shared default.
+*********************************************************************/
+static iwRegLabelState *region_label_state (iwRegCalcData *data)
+{
+	return data ? iw_reg_data_get_label (data) : &lab_default;
+}
 
-	int rcount = 0;
-	int found;
-	int i, k;
-	gint32 *regionpntr, *r;
-	const uchar *pixelpntr;
+/*********************************************************************
+  Start a row wise region labeling of an image of size
+  xsize x ysize, the labels are written to region.
+*********************************************************************/
+static void region_label_begin (iwRegLabelState *lab, int xsize, int ysize,
+								gint32 *region)
+{
+	gint32 *r;
+	int i;
 
-	last_new = last_old = -1;
+	lab->last_new = lab->last_old = -1;
+	lab->rcount = 0;
 
 	/* Beim ersten Aufruf ... */
-	if (!r_alias || xsize != _xsize || ysize != _ysize) {
+	if (!lab->r_alias || xsize != lab->xsize || ysize != lab->ysize) {
 		/* Einzel-Farbbild erzeugen */
-		_xsize = xsize;
-		_ysize = ysize;
+		lab->xsize = xsize;
+		lab->ysize = ysize;
 
 		/* Regionen-Alias-Liste erzeugen ... */
-		if (r_alias) r_alias--;			/* Index -1 erlauben */
-		if (!(r_alias = realloc (r_alias, (1 + xsize * ysize) * sizeof(gint32))))
+		if (lab->r_alias) lab->r_alias--;	/* Index -1 erlauben */
+		if (!(lab->r_alias = realloc (lab->r_alias, (1 + xsize * ysize) * sizeof(gint32))))
 			iw_error ("Out of memory: r_alias in regionlab");
 
 		/* ... und initialisieren */
-		for (i = 1 + xsize * ysize, r = r_alias; i > 0; i--)
+		for (i = 1 + xsize * ysize, r = lab->r_alias; i > 0; i--)
 			*r++ = -1;
-		r_alias++;
+		lab->r_alias++;
 	}
+	lab->region = region;
 
 	for (i=1; i<ysize-1; i++) {
 		*(region+i*xsize) = 0;
@@ -130,18 +139,36 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 	}
 	memset (region, 0, sizeof(gint32)*xsize);
 	memset (region+(ysize-1)*xsize, 0, sizeof(gint32)*xsize);
+}
+
+/*********************************************************************
+  Label the rows y_start..y_end-1 of color. The rows must be given in
+  increasing order, the image border is ignored.
+*********************************************************************/
+static void region_label_rows (iwRegLabelState *lab, const uchar *color,
+							   int y_start, int y_end)
+{
+	int xsize = lab->xsize, rcount = lab->rcount, found, i, k;
+	gint32 *region = lab->region, *regionpntr;
+	const uchar *pixelpntr;
+
+	if (y_start < 1) y_start = 1;
+	if (y_end > lab->ysize-1) y_end = lab->ysize-1;
 
 	/* Uebers Bild laufen und jeweils linken Nachbarn und die drei
 	   oberhalb liegenden Pixel betrachten */
 	/* Sonderbehandlung fuer erste Bildzeile */
-	for (k=2, region[xsize+1] = rcount++; k<xsize-1; ++k) {
-		if (color[k+xsize] == color[k-1+xsize])
-			region[k+xsize] = region[k-1+xsize];
-		else
-			region[k+xsize] = rcount++;
+	if (y_start == 1 && y_end > 1) {
+		for (k=2, region[xsize+1] = rcount++; k<xsize-1; ++k) {
+			if (color[k+xsize] == color[k-1+xsize])
+				region[k+xsize] = region[k-1+xsize];
+			else
+				region[k+xsize] = rcount++;
+		}
+		y_start = 2;
 	}
 
-	for (i=2; i<ysize-1; ++i) {
+	for (i=y_start; i<y_end; ++i) {
 		/* Sonderbehandlung fuer erstes Pixel der Zeile */
 		pixelpntr = color+i*xsize + 1;
 		regionpntr = region+i*xsize + 1;
@@ -152,7 +179,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 		}
 		if (*pixelpntr == *(pixelpntr-xsize+1)) {
 			if (found)
-				alias(*regionpntr, *(regionpntr-xsize+1));
+				alias(lab, *regionpntr, *(regionpntr-xsize+1));
 			else {
 				*regionpntr = *(regionpntr-xsize+1);
 				found = 1;
@@ -171,7 +198,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 			}
 			if (*pixelpntr == *(pixelpntr-xsize-1)) {
 				if (found)
-					alias(*regionpntr,
+					alias(lab, *regionpntr,
 						  *(regionpntr-xsize-1));
 				else {
 					*regionpntr = *(regionpntr-xsize-1);
@@ -180,7 +207,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 			}
 			if (*pixelpntr == *(pixelpntr-xsize)) {
 				if (found)
-					alias(*regionpntr,
+					alias(lab, *regionpntr,
 						  *(regionpntr-xsize));
 				else {
 					*regionpntr = *(regionpntr-xsize);
@@ -189,7 +216,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 			}
 			if (*pixelpntr == *(pixelpntr-xsize+1)) {
 				if (found)
-					alias(*regionpntr,
+					alias(lab, *regionpntr,
 						  *(regionpntr-xsize+1));
 				else {
 					*regionpntr = *(regionpntr-xsize+1);
@@ -209,7 +236,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 		}
 		if (*pixelpntr == *(pixelpntr-xsize-1)) {
 			if (found)
-				alias(*regionpntr, *(regionpntr-xsize-1));
+				alias(lab, *regionpntr, *(regionpntr-xsize-1));
 			else {
 				*regionpntr = *(regionpntr-xsize-1);
 				found = 1;
@@ -217,7 +244,7 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 		}
 		if (*pixelpntr == *(pixelpntr-xsize)) {
 			if (found)
-				alias(*regionpntr, *(regionpntr-xsize));
+				alias(lab, *regionpntr, *(regionpntr-xsize));
 			else {
 				*regionpntr = *(regionpntr-xsize);
 				found = 1;
@@ -225,10 +252,26 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 		}
 		if (!found) *regionpntr = rcount++;
 	}
+	lab->rcount = rcount;
+}
+
+/*********************************************************************
+  Finish the row wise region labeling: Resolve the region aliases.
+  Falls minPixelCount>0:
+	Pixelanzahl, Farbe und Schwerpunkt der Regionen berechnen.
+	Pixelanzahl < minPixelCount: Pixelanzahl der Region = Null
+*********************************************************************/
+static iwRegCOMinfo *region_label_end (iwRegLabelState *lab, const uchar *color,
+									   int *nregions, int minPixelCount)
+{
+	int xsize = lab->xsize, ysize = lab->ysize, rcount = lab->rcount;
+	gint32 *region = lab->region, *r_alias = lab->r_alias, *r;
+	iwRegCOMinfo *COMinfo = lab->COMinfo;
+	int i, k;
 
 	/* Alle eingetragenen Regionen-Aliase normalisieren ... */
 	for (i = 0, r = r_alias; i < rcount; i++, r++)
-		*r = normalize(i);
+		*r = normalize(r_alias, i);
 	/* ... und fortlaufende Nummern vergeben */
 	*nregions = 0;
 	for (i = 0, r = r_alias; i < rcount; i++, r++)
@@ -241,12 +284,13 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 	if (minPixelCount>0) {
 		iwRegCOMinfo *infoptr;
 
-		if (*nregions > len_COMinfo) {
-			len_COMinfo = *nregions;
-			COMinfo = (iwRegCOMinfo *) realloc (COMinfo, len_COMinfo * sizeof (iwRegCOMinfo));
+		if (*nregions > lab->len_COMinfo) {
+			lab->len_COMinfo = *nregions;
+			COMinfo = (iwRegCOMinfo *) realloc (COMinfo, lab->len_COMinfo * sizeof (iwRegCOMinfo));
 			if (COMinfo == NULL)
 				iw_error ("Cannot realloc %ld Bytes for COMinfo in regionlabel",
-						  len_COMinfo * (long)sizeof(iwRegCOMinfo));
+						  lab->len_COMinfo * (long)sizeof(iwRegCOMinfo));
+			lab->COMinfo = COMinfo;
 		}
 
 		for (i=0; i<(*nregions); i++) {
@@ -309,15 +353,79 @@ static iwRegCOMinfo *region_label_do (int xsize, int ysize, const uchar *color,
 	return COMinfo;
 }
 
+/*********************************************************************
+  Regionenlabeling des Bildes color (Groesse xsize x ysize)
+  durchfuehren und nach region schreiben.
+  Falls minPixelCount>0:
+	Pixelanzahl, Farbe und Schwerpunkt der Regionen berechnen.
+	Pixelanzahl < minPixelCount: Pixelanzahl der Region = Null
+*********************************************************************/
+static iwRegCOMinfo *region_label_do (iwRegLabelState *lab, int xsize, int ysize,
+									  const uchar *color, gint32 *region,
+									  int *nregions, int minPixelCount)
+{
+	region_label_begin (lab, xsize, ysize, region);
+	region_label_rows (lab, color, 1, ysize-1);
+	return region_label_end (lab, color, nregions, minPixelCount);
+}
+
 /*********************************************************************
   Do a region labeling of the image color (size: xsize x ysize) and
   write the result to region.
   Return: Number of regions.
 *********************************************************************/
 int iw_reg_label (int xsize, int ysize, const uchar *color, gint32 *region)
+{
+	return iw_reg_label_data (xsize, ysize, color, region, NULL);
+}
+
+int iw_reg_label_data (int xsize, int ysize, const uchar *color, gint32 *region,
+					   iwRegCalcData *data)
+{
+	int nregions;
+	region_label_do (region_label_state (data), xsize, ysize, color, region,
+					 &nregions, -1);
+	return nregions;
+}
+
+/*********************************************************************
+  Row wise region labeling, gives the same result as iw_reg_label().
+  After iw_reg_label_begin() the rows of color must be passed in
+  increasing order with iw_reg_label_rows(), where the labeling of
+  row y needs the rows y-1 and y of color. iw_reg_label_end()
+  finishes the labeling and returns the number of regions.
+*********************************************************************/
+void iw_reg_label_begin (int xsize, int ysize, gint32 *region)
+{
+	iw_reg_label_begin_data (xsize, ysize, region, NULL);
+}
+
+void iw_reg_label_rows (const uchar *color, int y_start, int y_end)
+{
+	iw_reg_label_rows_data (color, y_start, y_end, NULL);
+}
+
+int iw_reg_label_end (const uchar *color)
+{
+	return iw_reg_label_end_data (color, NULL);
+}
+
+void iw_reg_label_begin_data (int xsize, int ysize, gint32 *region,
+							  iwRegCalcData *data)
+{
+	region_label_begin (region_label_state (data), xsize, ysize, region);
+}
+
+void iw_reg_label_rows_data (const uchar *color, int y_start, int y_end,
+							 iwRegCalcData *data)
+{
+	region_label_rows (region_label_state (data), color, y_start, y_end);
+}
+
+int iw_reg_label_end_data (const uchar *color, iwRegCalcData *data)
 {
 	int nregions;
-	region_label_do (xsize, ysize, color, region, &nregions, -1);
+	region_label_end (region_label_state (data), color, &nregions, -1);
 	return nregions;
 }
 
@@ -326,12 +434,22 @@ int iw_reg_label (int xsize, int ysize, const uchar *color, gint32 *region)
   write the result to region. Calculate pixel count, color, and COM
   of the regions.
   pixel count < minPixelCount -> Pixel count of the region = 0
-  Return value is a pointer to a static variable!
+  Return value is a pointer to a static variable! The _data version
+  uses memory of data instead, which is valid till the next call.
 *********************************************************************/
 iwRegCOMinfo *iw_reg_label_with_calc (int xsize, int ysize, const uchar *color,
 									  gint32 *region, int *nregions, int minPixelCount)
 {
-	return region_label_do (xsize,ysize,color,region,nregions,minPixelCount);
+	return iw_reg_label_with_calc_data (xsize, ysize, color, region,
+										nregions, minPixelCount, NULL);
+}
+
+iwRegCOMinfo *iw_reg_label_with_calc_data (int xsize, int ysize, const uchar *color,
+										   gint32 *region, int *nregions,
+										   int minPixelCount, iwRegCalcData *data)
+{
+	return region_label_do (region_label_state (data), xsize, ysize, color, region,
+							nregions, minPixelCount);
 }
 
 /*********************************************************************
@@ -83,15 +83,44 @@ extern "C" {
 *********************************************************************/
 int iw_reg_label (int xsize, int ysize, const uchar *color, gint32 *region);
 
+/*********************************************************************
+  The iw_reg_label...() functions keep intermediate results in static
+  variables. The _data versions keep them in data instead, so that
+  different data structs can be used in parallel from different
+  threads. data==NULL: Use the static variables.
+*********************************************************************/
+int iw_reg_label_data (int xsize, int ysize, const uchar *color, gint32 *region,
+					   iwRegCalcData *data);
+
+/*********************************************************************
+  Row wise region labeling, gives the same result as iw_reg_label().
+  After iw_reg_label_begin() the rows of color must be passed in
+  increasing order with iw_reg_label_rows(), where the labeling of
+  row y needs the rows y-1 and y of color. iw_reg_label_end()
+  finishes the labeling and returns the number of regions.
+*********************************************************************/
+void iw_reg_label_begin (int xsize, int ysize, gint32 *region);
+void iw_reg_label_rows (const uchar *color, int y_start, int y_end);
+int iw_reg_label_end (const uchar *color);
+void iw_reg_label_begin_data (int xsize, int ysize, gint32 *region,
+							  iwRegCalcData *data);
+void iw_reg_label_rows_data (const uchar *color, int y_start, int y_end,
+							 iwRegCalcData *data);
+int iw_reg_label_end_data (const uchar *color, iwRegCalcData *data);
+
 /*********************************************************************
   Do a region labeling of the image color (size: xsize x ysize) and
   write the result to region. Calculate pixel count, color, and COM
   of the regions.
   pixel count < minPixelCount -> Pixel count of the region = 0
-  Return value is a pointer to a static variable!
+  Return value is a pointer to a static variable! The _data version
+  uses memory of data instead, which is valid till the next call.
 *********************************************************************/
 iwRegCOMinfo *iw_reg_label_with_calc (int xsize, int ysize, const uchar *color,
 									  gint32 *region, int *nregions, int minPixelCount);
+iwRegCOMinfo *iw_reg_label_with_calc_data (int xsize, int ysize, const uchar *color,
+										   gint32 *region, int *nregions,
+										   int minPixelCount, iwRegCalcData *data);
 
 /*********************************************************************
   Maintain the struct holding settings for the region calculation.
@@ -106,6 +135,8 @@ iwRegCOMinfo *iw_reg_label_with_calc (int xsize, int ysize, const uchar *color,
   iwRegMode|iwRegThinning: See the flags above.
   maxdist : Distance value for the modes IW_REG_THIN_ABS and
             IW_REG_THIN_DIST.
+  Additionally data holds the intermediate results of the
+  iw_reg_label_..._data() functions and of iw_reg_calc_data().
 *********************************************************************/
 iwRegCalcData *iw_reg_data_create (void);
 void iw_reg_data_free			(iwRegCalcData *data);
@@ -122,6 +153,9 @@ void iw_reg_data_set_thinning	(iwRegCalcData *data, iwRegThinning mode, float ma
   num_reg   : in  : Number of labeld regions
               out : Number of calculated regions
   data      : Additional settings for the region calculation.
+  The returned regions are part of data and valid till the next call
+  with data. iw_reg_calc() and iw_reg_calc_img() use one static data
+  struct and are thus not reentrant.
 *********************************************************************/
 iwRegion *iw_reg_calc_data (int xlen, int ylen, gint32 *image, int *num_reg,
 							iwRegCalcData *data);
@@ -0,0 +1,63 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/* PRIVATE HEADER */
+
+/*
+ * Author: Frank Loemker
+ *
+ * Copyright (C) 1999-2009
+ * Frank Loemker, Applied Computer Science, Faculty of Technology,
+ * Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#ifndef iw_region_i_H
+#define iw_region_i_H
+
+#include "region.h"
+
+/* State of the region labeling (region.c) */
+typedef struct {
+	gint32 *r_alias;			/* Region aliases, index -1 is allowed */
+	gint32 last_new, last_old;	/* Last alias() call */
+	gint32 *region;				/* Label image of the current labeling */
+	int xsize, ysize;			/* Size of r_alias */
+	int rcount;					/* Number of used labels */
+	iwRegCOMinfo *COMinfo;		/* Result of iw_reg_label_with_calc() */
+	int len_COMinfo;
+} iwRegLabelState;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+  Free the memory of the labeling state lab.
+*********************************************************************/
+void iw_reg_label_state_free (iwRegLabelState *lab);
+
+/*********************************************************************
+  Return the labeling state of data.
+*********************************************************************/
+iwRegLabelState *iw_reg_data_get_label (iwRegCalcData *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* iw_region_i_H */
@@ -28,55 +28,112 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 #include "gui/Goptions.h"
 #include "gui/Grender.h"
 #include "gui/Ggui.h"
 #include "main/image.h"
+#include "main/classify.h"
 #include "gsimple/skin.h"
+#include "skinclass/skinclass.h"
 #include "tracking/handtrack.h"
 
 #define HISTSIZE		64
 #define HIST_RG2IND		(SKIN_SCALE / HISTSIZE)
 #define ZOOM			4
 
+/* Size of the YUV lookup tables, 7 bit per channel */
+#define LOOK_SIZE		(128*128*128)
+#define LOOK_NOSKIN		0xFFFF
+/* Marks a not yet sampled pixel of the image histogram */
+#define SAMPLE_NONE		0xFFFFFFFF
+
+static plugDefinition plug_backpro;
+
 typedef struct {
 	BOOL init_bpro;
 	BOOL dynamic_update;
 	int region_stretch;		/* Pixels by which the an update region should be stretched */
+	int hist_step;			/* Sample distance for the image histogram */
+	int ratio_thresh;		/* Histogram change in percent for a ratio recalculation */
 	int rect_x;
 	int rect_y;
 } bproValues;
 
-/* Variables which can be modified in the gui */
-static bproValues opt_values;
-
-/* Buffer for an image,
-   init with prev_new_window(), display with prev_...() */
-static prevBuffer *b_histogram;
-static prevBuffer *b_skin_histogram;
-static prevBuffer *b_ratio_histogram;
-
-/* 2D-Histogram for the image */
-static int histogram[HISTSIZE][HISTSIZE];
-
-/* 2D-Histogram for all kalman-regions */
-static int skin_histogram[HISTSIZE][HISTSIZE];
-
-/* Ratio-histogram for backprojection */
-static int ratio_histogram[HISTSIZE][HISTSIZE];
-
-static skinOptions *skin_options;
+/* A histogram window and if its content must be redrawn */
+typedef struct {
+	prevBuffer *b;
+	BOOL dirty;
+} bproView;
+
+/* Ratio histogram cell (r*HISTSIZE+g) of every quantized YUV value,
+   LOOK_NOSKIN if it is not in the skin locus. The table depends only
+   on the skin options and is shared by all plugin instances. */
+typedef struct bproCells {
+	skinOptions options;
+	guint16 *cells;
+	int refcount;
+	struct bproCells *next;
+} bproCells;
+
+static bproCells *cells_list = NULL;
+static pthread_mutex_t cells_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct bproPlugin {		/* All parameter of one plugin instance */
+	plugDefinition def;
+	bproValues values;		/* Variables which can be modified in the gui */
+
+	/* Buffer for an image,
+	   init with prev_new_window(), display with prev_...() */
+	bproView v_histogram;
+	bproView v_skin_histogram;
+	bproView v_ratio_histogram;
+
+	/* 2D-Histogram for the image, every hist_step pixel in x and y
+	   direction is counted */
+	int histogram[HISTSIZE][HISTSIZE];
+	int hist_width, hist_height, hist_step;
+	/* YUV value (y<<16 | u<<8 | v) and histogram cell of the sampled pixels */
+	guint32 *sample_yuv;
+	guint16 *sample_cell;
+	/* Number of changed histogram counts since the last ratio calculation */
+	int hist_shift;
+
+	/* 2D-Histogram for all kalman-regions and its value at the
+	   last ratio calculation */
+	int skin_histogram[HISTSIZE][HISTSIZE];
+	int skin_last[HISTSIZE][HISTSIZE];
+
+	/* Ratio-histogram for backprojection */
+	int ratio_histogram[HISTSIZE][HISTSIZE];
+
+	skinOptions *skin_options;
+
+	bproCells *look_cells;
+	/* YUV -> probability table for iw_classify() */
+	uchar *look_prob;
+	int look_ratio[HISTSIZE][HISTSIZE];
+} bproPlugin;
 
 /*********************************************************************
-  Draw 2D-histogram.
+  Draw 2D-histogram if the window of view is open and the histogram
+  changed since the last drawing.
   norm == TRUE: normalize hist to the range 0-255
 *********************************************************************/
-static void bpro_draw_histogram (int *hist, prevBuffer *buf, BOOL norm)
+static void bpro_draw_histogram (int *hist, bproView *view, BOOL norm)
 {
+	prevBuffer *buf = view->b;
 	int r, g, *pos;
 	int max = 255;
 
-	if (buf->window) {
+	if (!buf->window) {
+		/* Redraw if the window gets opened again */
+		view->dirty = TRUE;
+		return;
+	}
+	if (view->dirty) {
+		view->dirty = FALSE;
+
 		/* Get maximum in histogram */
 		if (norm) {
 			max = 0;
@@ -145,20 +202,61 @@ static void bpro_yuv2ind (uchar y, uchar u, uchar v, int *rd ,int *gd)
 }
 
 /*********************************************************************
-  Generate 2D-histogram for the image '**s'
+  Update the 2D-histogram for the image '**s' with every
+  values.hist_step pixel in x and y direction. Only sampled pixels
+  whose value changed since the last call are converted to rg and
+  only the counts of the changed histogram cells are moved.
 *********************************************************************/
-static void bpro_calc_histogram (uchar **s, int width, int height)
+static void bpro_calc_histogram (bproPlugin *plug, uchar **s, int width, int height)
 {
-	int r, g, count;
-	uchar *y=s[0], *u=s[1], *v=s[2];
-
-	iw_debug (4,"Calculating 2d-histogramm...");
-
-	/* Add all rg-values to histogram */
-	memset (histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
-	for (count = width*height; count>0; count--) {
-		bpro_yuv2ind (*y++, *u++, *v++, &r, &g);
-		histogram[r][g]++;
+	int *hist = (int*)plug->histogram;
+	int step = MAX (plug->values.hist_step, 1), x, y, r, g, i, cell, off;
+	guint32 *sample_yuv, yuv;
+	guint16 *sample_cell;
+	int shift = 0;
+
+	iw_debug (4,"Updating 2d-histogramm...");
+
+	if (width != plug->hist_width || height != plug->hist_height ||
+		step != plug->hist_step) {
+		int cnt = ((width+step-1)/step) * ((height+step-1)/step);
+
+		plug->hist_width = width;
+		plug->hist_height = height;
+		plug->hist_step = step;
+		plug->sample_yuv = realloc (plug->sample_yuv, sizeof(guint32)*cnt);
+		plug->sample_cell = realloc (plug->sample_cell, sizeof(guint16)*cnt);
+		if (!plug->sample_yuv || !plug->sample_cell)
+			iw_error ("Out of memory: BackPro histogram");
+		memset (plug->sample_yuv, 0xFF, sizeof(guint32)*cnt);
+		memset (plug->histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
+	}
+	sample_yuv = plug->sample_yuv;
+	sample_cell = plug->sample_cell;
+
+	i = 0;
+	for (y=0; y<height; y+=step) {
+		for (x=0, off=y*width; x<width; x+=step, off+=step, i++) {
+			yuv = (s[0][off] << 16) | (s[1][off] << 8) | s[2][off];
+			if (yuv == sample_yuv[i]) continue;
+
+			bpro_yuv2ind (s[0][off], s[1][off], s[2][off], &r, &g);
+			cell = r*HISTSIZE + g;
+			if (sample_yuv[i] == SAMPLE_NONE) {
+				hist[cell]++;
+				shift++;
+			} else if (cell != sample_cell[i]) {
+				hist[sample_cell[i]]--;
+				hist[cell]++;
+				shift++;
+			}
+			sample_yuv[i] = yuv;
+			sample_cell[i] = cell;
+		}
+	}
+	if (shift) {
+		plug->hist_shift += shift;
+		plug->v_histogram.dirty = TRUE;
 	}
 }
 
@@ -166,17 +264,21 @@ static void bpro_calc_histogram (uchar **s, int width, int height)
   Calculate the ratio histogram by deviding skin_histogram through
   histogram.
 *********************************************************************/
-static void bpro_calc_ratio_histogram (void)
+static void bpro_calc_ratio_histogram (bproPlugin *plug)
 {
-	int r, g, max = 0;
+	int (*ratio_histogram)[HISTSIZE] = plug->ratio_histogram;
+	int (*skin_histogram)[HISTSIZE] = plug->skin_histogram;
+	int (*histogram)[HISTSIZE] = plug->histogram;
+	int r, g, max = 0, step2 = plug->hist_step*plug->hist_step;
 	float max_norm;
 
-	/* Calculate ratio-histogram and find maximum */
+	/* Calculate ratio-histogram and find maximum,
+	   histogram contains only every step2 pixel */
 	memset (ratio_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
 	for (r=0;r<HISTSIZE;r++)
 		for (g=0;g<HISTSIZE;g++)
 			if (histogram[r][g] > 0) {
-				ratio_histogram[r][g] = (skin_histogram[r][g]*255) / histogram[r][g];
+				ratio_histogram[r][g] = (skin_histogram[r][g]*255) / (histogram[r][g]*step2);
 				if (ratio_histogram[r][g] > max)
 					max = ratio_histogram[r][g];
 			}
@@ -190,32 +292,62 @@ static void bpro_calc_ratio_histogram (void)
 	}
 }
 
+/*********************************************************************
+  Recalculate the ratio histogram if the image and the skin histogram
+  together changed by more than values.ratio_thresh percent of
+  their counts since the last calculation.
+*********************************************************************/
+static void bpro_update_ratio_histogram (bproPlugin *plug)
+{
+	int *skin = (int*)plug->skin_histogram, *last = (int*)plug->skin_last;
+	int i, skin_shift = 0, skin_total = 0;
+	double shift, total;
+
+	for (i=0; i<HISTSIZE*HISTSIZE; i++) {
+		skin_shift += abs (skin[i] - last[i]);
+		skin_total += skin[i];
+	}
+	if (skin_shift)
+		plug->v_skin_histogram.dirty = TRUE;
+
+	shift = (double)plug->hist_shift*plug->hist_step*plug->hist_step + skin_shift;
+	total = (double)plug->hist_width*plug->hist_height + skin_total;
+	if (shift <= 0 || shift*100 < total*plug->values.ratio_thresh)
+		return;
+
+	memcpy (plug->skin_last, plug->skin_histogram, sizeof(plug->skin_last));
+	plug->hist_shift = 0;
+	bpro_calc_ratio_histogram (plug);
+	plug->v_ratio_histogram.dirty = TRUE;
+}
+
 /*********************************************************************
   Called before any other bpro_*_mix()-calls.
   RETURN: FALSE: bpro_*_mix() should not be called.
 *********************************************************************/
-static BOOL bpro_do_mix (void)
+static BOOL bpro_do_mix (bproPlugin *plug)
 {
-	if (!opt_values.dynamic_update)
+	if (!plug->values.dynamic_update)
 		return FALSE;
 
-	memset (skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
+	memset (plug->skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
 	return TRUE;
 }
 
 /*********************************************************************
   Update skin-histogram
 *********************************************************************/
-static void bpro_update_mix (iwImage *img, uchar *y, uchar *u, uchar *v, int cnt, long kal_nr)
+static void bpro_update_mix (iwImage *img, uchar *y, uchar *u, uchar *v, int cnt,
+							 bproPlugin *plug)
 {
 	t_Pixel rg;
 	int i;
 
 	for (i=0; i<cnt; i++) {					/* Go through the given line */
 		iw_skin_yuv2rg (*y++, *u++, *v++, &rg);
-		if (iw_skin_pixelIsSkin (skin_options, &rg)) {
+		if (iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
 			/* Add to the histogramm */
-			skin_histogram[(int)(rg.r/HIST_RG2IND)][(int)(rg.g/HIST_RG2IND)]++;
+			plug->skin_histogram[(int)(rg.r/HIST_RG2IND)][(int)(rg.g/HIST_RG2IND)]++;
 		}
 	}
 }
@@ -225,17 +357,19 @@ static void bpro_update_mix (iwImage *img, uchar *y, uchar *u, uchar *v, int cnt
 *********************************************************************/
 static void cb_button_event (prevBuffer *b, prevEvent signal, int x, int y, void *data)
 {
-	if (!opt_values.init_bpro) return;
+	bproPlugin *plug = data;
+
+	if (!plug->values.init_bpro) return;
 
-	opt_values.rect_x = x;
-	opt_values.rect_y = y;
+	plug->values.rect_x = x;
+	plug->values.rect_y = y;
 }
 
 /*********************************************************************
   Trivial initialisation of skin-histogram by showing some skin
   to the camera
 *********************************************************************/
-static void bpro_init_skin_histogram (uchar **s, int width, int height)
+static void bpro_init_skin_histogram (bproPlugin *plug, uchar **s, int width, int height)
 {
 	int radius = 20;
 	int i, j, c, r, g, count = width*height;
@@ -243,17 +377,17 @@ static void bpro_init_skin_histogram (uchar **s, int width, int height)
 	uchar *y=s[0], *u=s[1], *v=s[2];
 	int xl, xr, yl, yr;
 
-	if (opt_values.rect_x < 0)
+	if (plug->values.rect_x < 0)
 		xl = width/2 - radius;
 	else
-		xl = opt_values.rect_x - radius;
+		xl = plug->values.rect_x - radius;
 	if (xl<0) xl = 0;
 	else if (xl+radius*2 >= width) xl = width-radius*2-1;
 
-	if (opt_values.rect_y < 0)
+	if (plug->values.rect_y < 0)
 		yl = height/2 - radius;
 	else
-		yl = opt_values.rect_y - radius;
+		yl = plug->values.rect_y - radius;
 	if (yl<0) yl = 0;
 	else if (yl+radius*2 >= height) yl = height-radius*2-1;
 
@@ -276,7 +410,7 @@ static void bpro_init_skin_histogram (uchar **s, int width, int height)
 		prev_render_rects (input, &rect, 1, 0, width, height);
 	}
 
-	memset (skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
+	memset (plug->skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
 	for (c=1; c<=count; c++) {
 		i = c / width;
 		j = c - (i * width);
@@ -285,7 +419,7 @@ static void bpro_init_skin_histogram (uchar **s, int width, int height)
 			bpro_yuv2ind (*y, *u, *v, &r, &g);
 
 			/* Add rg to skin-histogram */
-			skin_histogram[r][g]++;
+			plug->skin_histogram[r][g]++;
 		}
 		/* Next yuv-value */
 		y++;
@@ -295,19 +429,94 @@ static void bpro_init_skin_histogram (uchar **s, int width, int height)
 }
 
 /*********************************************************************
-  Classify one pixel.
+  Return the shared ratio histogram cell table for the skin options
+  opts, the table is calculated if no plugin instance uses it yet.
+  Use bpro_cells_release() if the table is not needed any more.
 *********************************************************************/
-static uchar pixelclassify (uchar y, uchar u, uchar v)
+static bproCells *bpro_cells_get (const skinOptions *opts)
 {
+	bproCells *c;
 	t_Pixel rg;
+	int i;
 
-	/* Calculate rg-value of yuv-pixel */
-	iw_skin_yuv2rg (y, u, v, &rg);
+	pthread_mutex_lock (&cells_mutex);
+	for (c = cells_list; c; c = c->next) {
+		if (c->options.excludeWhite == opts->excludeWhite &&
+			c->options.useLocus == opts->useLocus) {
+			c->refcount++;
+			pthread_mutex_unlock (&cells_mutex);
+			return c;
+		}
+	}
+	c = iw_malloc0 (sizeof(bproCells), "BackPro lookup");
+	c->options = *opts;
+	c->cells = iw_malloc (sizeof(guint16)*LOOK_SIZE, "BackPro lookup");
+	for (i=0; i<LOOK_SIZE; i++) {
+		iw_skin_yuv2rg (((i & 0x1fc000) >> 14)*2, ((i & 0x3f80) >> 7)*2,
+						(i & 0x7f)*2, &rg);
+		if (iw_skin_pixelIsSkin (&c->options, &rg))
+			c->cells[i] = (int)(rg.r/HIST_RG2IND)*HISTSIZE + (int)(rg.g/HIST_RG2IND);
+		else
+			c->cells[i] = LOOK_NOSKIN;
+	}
+	c->refcount = 1;
+	c->next = cells_list;
+	cells_list = c;
+	pthread_mutex_unlock (&cells_mutex);
 
-	if (iw_skin_pixelIsSkin (skin_options, &rg)) {
-		return (ratio_histogram[(int)(rg.r/HIST_RG2IND)][(int)(rg.g/HIST_RG2IND)]);
-	} else
-		return 0;
+	return c;
+}
+
+/*********************************************************************
+  Release the table obtained with bpro_cells_get().
+*********************************************************************/
+static void bpro_cells_release (bproCells *cells)
+{
+	bproCells **c;
+
+	if (!cells) return;
+
+	pthread_mutex_lock (&cells_mutex);
+	if (--cells->refcount <= 0) {
+		for (c = &cells_list; *c; c = &(*c)->next) {
+			if (*c == cells) {
+				*c = cells->next;
+				break;
+			}
+		}
+		free (cells->cells);
+		free (cells);
+	}
+	pthread_mutex_unlock (&cells_mutex);
+}
+
+/*********************************************************************
+  Update the YUV -> probability table look_prob from ratio_histogram.
+  The expensive rg conversion and skin locus test is only done if the
+  skin options changed, otherwise only the ratio histogram values
+  are copied to the table if they changed.
+*********************************************************************/
+static void bpro_calc_lookup (bproPlugin *plug)
+{
+	const int *ratio = (int*)plug->ratio_histogram;
+	const guint16 *cells;
+	int i;
+
+	if (!plug->look_cells ||
+		plug->look_cells->options.excludeWhite != plug->skin_options->excludeWhite ||
+		plug->look_cells->options.useLocus != plug->skin_options->useLocus) {
+		bpro_cells_release (plug->look_cells);
+		plug->look_cells = bpro_cells_get (plug->skin_options);
+		if (!plug->look_prob)
+			plug->look_prob = iw_malloc (LOOK_SIZE, "BackPro lookup");
+	} else if (!memcmp (plug->look_ratio, plug->ratio_histogram, sizeof(plug->look_ratio))) {
+		return;
+	}
+	memcpy (plug->look_ratio, plug->ratio_histogram, sizeof(plug->look_ratio));
+
+	cells = plug->look_cells->cells;
+	for (i=0; i<LOOK_SIZE; i++)
+		plug->look_prob[i] = cells[i] == LOOK_NOSKIN ? 0 : ratio[cells[i]];
 }
 
 /*********************************************************************
@@ -315,64 +524,38 @@ static uchar pixelclassify (uchar y, uchar u, uchar v)
   (mask size: size*2+1) to d.
   pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
 *********************************************************************/
-static BOOL bpro_classify (iwImage *img, uchar *d, int pix_cnt, int size, int thresh)
+static BOOL bpro_classify (plugDefinition *plug_d, iwImage *img, uchar *d,
+						   int pix_cnt, int size, int thresh)
 {
-	uchar *y=img->data[0], *u=img->data[1], *v=img->data[2], *dpos, *buffer;
+	bproPlugin *plug = (bproPlugin *)plug_d;
 	int width = img->width, height = img->height;
-	int count = width*height;
-
-	dpos = buffer = iw_img_get_buffer (count);
+	iwClassifyPara para;
 
 	/* Trivial initialisation for skin-histogramm */
-	if (opt_values.init_bpro)
-		bpro_init_skin_histogram (img->data, width, height);
+	if (plug->values.init_bpro)
+		bpro_init_skin_histogram (plug, img->data, width, height);
 
-	/* Calculate ratio-histogram for classification */
-	bpro_calc_ratio_histogram();
+	/* Calculate ratio-histogram for classification if the
+	   histograms changed enough */
+	bpro_update_ratio_histogram (plug);
 
 	/* Draw histogram visualisation */
-	bpro_draw_histogram ((int*)histogram, b_histogram, TRUE);
-	bpro_draw_histogram ((int*)skin_histogram, b_skin_histogram, TRUE);
-	bpro_draw_histogram ((int*)ratio_histogram, b_ratio_histogram, FALSE);
-
-	if (size == 0)
-		dpos = d;
-
-	if (pix_cnt==0) {
-		while (count--) {
-			*dpos++ = pixelclassify (*y, *u, *v);
-			y++;
-			u++;
-			v++;
-		}
-	} else {
-		int i,k, r,g,b;
-		if (!size) iw_img_border (dpos,width,height,1);
-		y+=width+1; u+=width+1; v+=width+1; dpos+=width+1;
-		for (i=1; i<height-1; i++) {
-			for (k=1; k<width-1; k++) {
-				if (pix_cnt==2) {
-					r = (*y + *(y-1) + *(y+1) + *(y-width) + *(y+width)) / 5;
-					g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-					b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-				} else {
-					r = (*(y-1) + *(y+1) + *(y-width) + *(y+width)) / 4;
-					g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-					b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-				}
-				*dpos++ = pixelclassify (r,g,b);
-				y++; u++; v++;
-			}
-			y+=2; u+=2; v+=2; dpos+=2;
-		}
-	}
-	if (size>0)
-		iw_img_median (buffer, d, width, height, size);
-
-	iw_img_release_buffer();
-
-	/* Generate 2D-histogram for 'img' */
-	bpro_calc_histogram (img->data, width, height);
+	bpro_draw_histogram ((int*)plug->histogram, &plug->v_histogram, TRUE);
+	bpro_draw_histogram ((int*)plug->skin_histogram, &plug->v_skin_histogram, TRUE);
+	bpro_draw_histogram ((int*)plug->ratio_histogram, &plug->v_ratio_histogram, FALSE);
+
+	/* Classify with a direct YUV -> probability table,
+	   which avoids the rg conversion for every pixel */
+	bpro_calc_lookup (plug);
+	iw_classify_init (&para);
+	para.feature = IW_CLASSIFY_YUV7;
+	para.lookup = plug->look_prob;
+	para.pix_cnt = pix_cnt;
+	para.size = size;
+	iw_classify (img, d, &para);
+
+	/* Update 2D-histogram with 'img' */
+	bpro_calc_histogram (plug, img->data, width, height);
 
 	return TRUE;
 }
@@ -381,8 +564,10 @@ static BOOL bpro_classify (iwImage *img, uchar *d, int pix_cnt, int size, int th
   Updating the BackProjection classifier taking into account the
   classified regions.
 *********************************************************************/
-static void bpro_update (iwImage *img, int *ireg, iwRegion *regions, int numregs)
+static void bpro_update (plugDefinition *plug_d, iwImage *img, int *ireg,
+						 iwRegion *regions, int numregs)
 {
+	bproPlugin *plug = (bproPlugin *)plug_d;
 	int i, j;
 	BOOL first = TRUE;
 
@@ -394,18 +579,19 @@ static void bpro_update (iwImage *img, int *ireg, iwRegion *regions, int numregs
 			prevDataPoint *pts;
 
 			if (first) {
-				if (!bpro_do_mix()) break;
+				if (!bpro_do_mix (plug)) break;
 				first = FALSE;
 			}
 
-			iw_reg_stretch (img->width, img->height, &regions[i], opt_values.region_stretch);
+			iw_reg_stretch (img->width, img->height, &regions[i],
+							plug->values.region_stretch);
 			pts = malloc(sizeof(prevDataPoint)*p->n_punkte);
 			for (j=0; j<p->n_punkte; j++) {
 				pts[j].x = p->punkt[j]->x;
 				pts[j].y = p->punkt[j]->y;
 			}
 			iw_img_fillPoly (img, p->n_punkte, pts, FALSE,
-							 (imgLineFunc)bpro_update_mix, (void*)(long)regions[i].id);
+							 (imgLineFunc)bpro_update_mix, plug);
 			free (pts);
 		}
 	}
@@ -414,7 +600,24 @@ static void bpro_update (iwImage *img, int *ireg, iwRegion *regions, int numregs
 /*********************************************************************
   Free the resources allocated during bpro_???().
 *********************************************************************/
-static void bpro_cleanup (plugDefinition *plug) {}
+static void bpro_cleanup (plugDefinition *plug_d)
+{
+	bproPlugin *plug = (bproPlugin *)plug_d;
+
+	if (plug->look_cells) {
+		bpro_cells_release (plug->look_cells);
+		free (plug->look_prob);
+		plug->look_cells = NULL;
+		plug->look_prob = NULL;
+	}
+	if (plug->sample_yuv) {
+		free (plug->sample_yuv);
+		free (plug->sample_cell);
+		plug->sample_yuv = NULL;
+		plug->sample_cell = NULL;
+		plug->hist_width = plug->hist_height = 0;
+	}
+}
 
 static void help (plugDefinition *plug)
 {
@@ -458,43 +661,57 @@ static void bpro_init (plugDefinition *plug, grabParameter *para, int argc, char
   Initialise the user interface for the plugin.
   Return: Number of the last opened option page.
 *********************************************************************/
-static int bpro_init_options (plugDefinition *plug)
+static int bpro_init_options (plugDefinition *plug_d)
 {
+	bproPlugin *plug = (bproPlugin *)plug_d;
+	bproValues *v = &plug->values;
 	int page;
 
-	opt_values.init_bpro = FALSE;
-	opt_values.dynamic_update = TRUE;
-	opt_values.region_stretch = 10;
-	opt_values.rect_x = -1;
-	opt_values.rect_y = -1;
+	v->init_bpro = FALSE;
+	v->dynamic_update = TRUE;
+	v->region_stretch = 10;
+	v->hist_step = 2;
+	v->ratio_thresh = 1;
+	v->rect_x = -1;
+	v->rect_y = -1;
 
-	page = opts_page_append ("BackPro");
+	page = opts_page_append (plug->def.name);
 	opts_toggle_create (page,"Init BackPro", "Show some skin to the camera!",
-						&opt_values.init_bpro);
+						&v->init_bpro);
 	opts_toggle_create (page,"Dynamic update",
 						"Update the skin histogram continuously",
-						&opt_values.dynamic_update);
+						&v->dynamic_update);
 	opts_entscale_create (page,"Region stretch",
 						  "Number of pixels by which an update region should be stretched",
-						  &opt_values.region_stretch, 0, 40);
-	skin_options = iw_skin_init (page);
-
-	b_histogram       = prev_new_window ("BackPro 2D-Histogram",
-										 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
-	b_skin_histogram  = prev_new_window ("BackPro Skin-Histogram",
-										 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
-	b_ratio_histogram = prev_new_window ("BackPro Ratio-Histogram",
-										 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
+						  &v->region_stretch, 0, 40);
+	opts_entscale_create (page,"Histogram step",
+						  "Use only every n-th pixel in x and y direction for the image histogram",
+						  &v->hist_step, 1, 8);
+	opts_entscale_create (page,"Ratio update",
+						  "Recalculate the ratio histogram only if the histograms changed by "
+						  "at least this percentage of their counts",
+						  &v->ratio_thresh, 0, 50);
+	plug->skin_options = iw_skin_init (page);
+
+	plug->v_histogram.b       = prev_new_window (plug_name (plug_d, " 2D-Histogram"),
+												 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
+	plug->v_skin_histogram.b  = prev_new_window (plug_name (plug_d, " Skin-Histogram"),
+												 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
+	plug->v_ratio_histogram.b = prev_new_window (plug_name (plug_d, " Ratio-Histogram"),
+												 ZOOM*HISTSIZE, ZOOM*HISTSIZE, TRUE, FALSE);
+	plug->v_histogram.dirty = plug->v_skin_histogram.dirty =
+		plug->v_ratio_histogram.dirty = TRUE;
 
 	prev_signal_connect (grab_get_inputBuf(), PREV_BUTTON_PRESS|PREV_BUTTON_MOTION,
-						 cb_button_event, NULL);
+						 cb_button_event, plug);
 
-	memset (skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
+	memset (plug->skin_histogram, 0, HISTSIZE*HISTSIZE*sizeof(int));
+	memset (plug->skin_last, 0, HISTSIZE*HISTSIZE*sizeof(int));
 
 	return page;
 }
 
-plugDefinition plug_backpro = {
+static plugDefinition plug_backpro = {
 	"BackPro",
 	PLUG_ABI_VERSION,
 	bpro_init,
@@ -510,6 +727,12 @@ plugDefinition plug_backpro = {
 *********************************************************************/
 plugDefinition *iw_bpro_get_info (int instCount, BOOL *append)
 {
+	bproPlugin *plug = calloc (1, sizeof(bproPlugin));
+
+	plug->def = plug_backpro;
+	if (instCount > 1)
+		plug->def.name = g_strdup_printf ("%s%d", plug_backpro.name, instCount);
+
 	*append = TRUE;
-	return &plug_backpro;
+	return (plugDefinition*)plug;
 }
@@ -34,6 +34,7 @@
 #include "gui/Ggui.h"
 #include "tools/tools.h"
 #include "main/image.h"
+#include "main/classify.h"
 #include "main/output.h"
 #include "main/plugin.h"
 #include "skin.h"
@@ -77,9 +78,6 @@ typedef struct {
 	int update_cont;
 } gsimpleValues;
 
-static gsimpleValues opt_values;
-static prevBuffer *b_region, *b_gauss, *b_background, *b_diff;
-
 typedef struct {
 	double mean_r;
 	double mean_g;
@@ -93,11 +91,44 @@ typedef struct {
 	int count;
 } t_gauss;
 
-static t_gauss gs_gauss;
-static uchar gs_lookup[LOOK_SIZE];
-static gsimpleState gs_state = GSIMPLE_CLASS;
+/* Drawing of the distribution into a prevBuffer, see gauss_draw_???() */
+typedef struct {
+	BOOL started;
+	int zoom;
+	prevBuffer *buf;
+} gsimpleDraw;
+
+typedef struct gsimplePlugin {		/* All parameter of one plugin instance */
+	plugDefinition def;
+	gsimpleValues values;
+	char *page_main, *page_update;	/* Names of the option pages */
+	prevBuffer *b_region, *b_gauss, *b_background, *b_diff;
+
+	t_gauss gauss;
+	uchar *lookup;				/* LOOK_SIZE, YUV -> probability */
+	gsimpleState state;
+	skinOptions *skin_options;
+	gsimpleDraw draw;
+
+	/* Skinclass option values saved by set_update_mode() */
+	long save_face;
+	int save_thresh, save_dthresh, save_comb, save_diff, save_mhi;
+
+	BOOL last_init_gsimple;
+
+	/* Images for background_check() */
+	uchar **back_fgimg, *back_bgimg[3];
+	int back_width;
+
+	/* Collected data of gsimple_update() */
+	t_gauss fill_gauss;
+	unsigned long last_time;
+	int iterations;
+	uchar *hist_back, *hist_img, *hist_ireg, *hist_reg;
+	int hist_max, hist_cnt;
+} gsimplePlugin;
 
-static skinOptions *skin_options;
+static plugDefinition plug_gauss_simple;
 
 static uchar gauss_calc_probability (t_gauss *g, t_Pixel rg)
 {
@@ -163,7 +194,7 @@ static void gauss_invert (t_gauss *g)
 		iw_warning ("Covariance matrix not invertible (det(A)=0)");
 }
 
-static void gauss_calc (t_gauss *g)
+static void gauss_calc (gsimplePlugin *plug, t_gauss *g)
 {
 	if (g->count != 0) {
 		/* Calculate mean-value */
@@ -175,9 +206,9 @@ static void gauss_calc (t_gauss *g)
 		g->sig_12 = g->rg/g->count - g->mean_r * g->mean_g;
 		g->sig_22 = g->gg/g->count - g->mean_g * g->mean_g;
 
-		g->sig_11 = g->sig_11 * opt_values.var_scale + opt_values.var_add;
-		g->sig_12 = g->sig_12 * opt_values.var_scale_kov;
-		g->sig_22 = g->sig_22 * opt_values.var_scale + opt_values.var_add;
+		g->sig_11 = g->sig_11 * plug->values.var_scale + plug->values.var_add;
+		g->sig_12 = g->sig_12 * plug->values.var_scale_kov;
+		g->sig_22 = g->sig_22 * plug->values.var_scale + plug->values.var_add;
 
 		/* Print the covariance matrix */
 		iw_debug (4, "mean: %f %f", g->mean_r,  g->mean_g);
@@ -195,7 +226,8 @@ static void gauss_calc (t_gauss *g)
 /*********************************************************************
   Classify one pixel.
 *********************************************************************/
-static uchar pixelclassify (t_gauss *g, uchar y, uchar u, uchar v)
+static uchar pixelclassify (skinOptions *skin_options, t_gauss *g,
+							uchar y, uchar u, uchar v)
 {
 	t_Pixel rg;
 
@@ -208,21 +240,19 @@ static uchar pixelclassify (t_gauss *g, uchar y, uchar u, uchar v)
 		return 0;
 }
 
-static void calc_lookup (t_gauss *g)
+static void calc_lookup (gsimplePlugin *plug)
 {
 	int i;
 
 	for (i=0; i<LOOK_SIZE; ++i)
-		gs_lookup[i] = pixelclassify (g, ((i & 0x1fc000) >> 14)*2,
-									  ((i & 0x3f80) >> 7)*2,
-									  (i & 0x7f)*2);
+		plug->lookup[i] = pixelclassify (plug->skin_options, &plug->gauss,
+										 ((i & 0x1fc000) >> 14)*2,
+										 ((i & 0x3f80) >> 7)*2,
+										 (i & 0x7f)*2);
 }
 
 
-static BOOL draw_started = FALSE;
-static int draw_zoom = 0;
-static prevBuffer *draw_buf;
-static BOOL gauss_draw_start (prevBuffer *buf)
+static BOOL gauss_draw_start (gsimpleDraw *draw, prevBuffer *buf)
 {
 	if (buf->window) {
 		int z;
@@ -230,12 +260,12 @@ static BOOL gauss_draw_start (prevBuffer *buf)
 		prev_buffer_lock();
 
 		z = buf->height / COLCNT;
-		draw_zoom = buf->width / COLCNT;
-		if (z < draw_zoom) draw_zoom = z;
+		draw->zoom = buf->width / COLCNT;
+		if (z < draw->zoom) draw->zoom = z;
 
-		if (draw_zoom > 0) {
-			draw_started = TRUE;
-			draw_buf = buf;
+		if (draw->zoom > 0) {
+			draw->started = TRUE;
+			draw->buf = buf;
 			return TRUE;
 		}
 
@@ -243,60 +273,61 @@ static BOOL gauss_draw_start (prevBuffer *buf)
 	}
 	return FALSE;
 }
-static void gauss_draw_stop (void)
+static void gauss_draw_stop (gsimpleDraw *draw)
 {
-	if (draw_started) {
+	if (draw->started) {
 		prev_buffer_unlock();
-		draw_started = FALSE;
-		prev_draw_buffer (draw_buf);
+		draw->started = FALSE;
+		prev_draw_buffer (draw->buf);
 	}
 }
-static void gauss_draw_lock (void)
+static void gauss_draw_lock (gsimpleDraw *draw)
 {
-	if (draw_started) prev_buffer_lock();
+	if (draw->started) prev_buffer_lock();
 }
-static void gauss_draw_unlock (void)
+static void gauss_draw_unlock (gsimpleDraw *draw)
 {
-	if (draw_started) prev_buffer_unlock();
+	if (draw->started) prev_buffer_unlock();
 }
-static void gauss_draw_clear (void)
+static void gauss_draw_clear (gsimpleDraw *draw)
 {
-	if (draw_started) memset (draw_buf->buffer, 0,
-							  draw_buf->width*draw_buf->height*3);
+	if (draw->started) memset (draw->buf->buffer, 0,
+							   draw->buf->width*draw->buf->height*3);
 }
-static void gauss_draw_pixel (t_Pixel rg, uchar col)
+static void gauss_draw_pixel (gsimpleDraw *draw, t_Pixel rg, uchar col)
 {
-	if (draw_started) {
-		prev_drawInit (draw_buf, col, -1, -1);
-		prev_drawFRect_color_nc (rg.r*draw_zoom*COLCNT/SKIN_SCALE,
-								 rg.g*draw_zoom*COLCNT/SKIN_SCALE,
-								 draw_zoom, draw_zoom);
+	if (draw->started) {
+		prev_drawInit (draw->buf, col, -1, -1);
+		prev_drawFRect_color_nc (rg.r*draw->zoom*COLCNT/SKIN_SCALE,
+								 rg.g*draw->zoom*COLCNT/SKIN_SCALE,
+								 draw->zoom, draw->zoom);
 	}
 }
-static void gauss_draw_dist (t_gauss *g)
+static void gauss_draw_dist (gsimplePlugin *plug, t_gauss *g)
 {
+	gsimpleDraw *draw = &plug->draw;
 	int x, y, max;
 	t_Pixel rg;
 
-	if (draw_started) {
-		max = draw_zoom*COLCNT;
+	if (draw->started) {
+		max = draw->zoom*COLCNT;
 		for (y=0; y<max; y++) {
 			rg.g = y*SKIN_SCALE/max;
 			for (x=0; x<max; x++) {
 				rg.r = x*SKIN_SCALE/max;
 				if (rg.r+rg.g >= SKIN_SCALE) {
-					prev_drawInit (draw_buf, 0, 0, 0);
-				} else if (iw_skin_pixelIsSkin (skin_options, &rg)) {
-					prev_drawInit (draw_buf, -1, gauss_calc_probability (g, rg),0);
+					prev_drawInit (draw->buf, 0, 0, 0);
+				} else if (iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
+					prev_drawInit (draw->buf, -1, gauss_calc_probability (g, rg),0);
 				} else if (rg.r*100/SKIN_SCALE < 16 || rg.g*100/SKIN_SCALE < 16) {
 					int R = rg.r * 255/1024;
 					int G = rg.g * 255/1024;
-					prev_drawInit (draw_buf, R, G, 255-R-G);
+					prev_drawInit (draw->buf, R, G, 255-R-G);
 				} else
-					prev_drawInit (draw_buf, -1, gauss_calc_probability (g, rg),150);
-				prev_drawFRect_color_nc (rg.r*draw_zoom*COLCNT/SKIN_SCALE,
-										 rg.g*draw_zoom*COLCNT/SKIN_SCALE,
-										 draw_zoom, draw_zoom);
+					prev_drawInit (draw->buf, -1, gauss_calc_probability (g, rg),150);
+				prev_drawFRect_color_nc (rg.r*draw->zoom*COLCNT/SKIN_SCALE,
+										 rg.g*draw->zoom*COLCNT/SKIN_SCALE,
+										 draw->zoom, draw->zoom);
 			}
 		}
 	}
@@ -305,7 +336,7 @@ static void gauss_draw_dist (t_gauss *g)
 /*********************************************************************
   Read lookup table and gauss parameter from file name.
 *********************************************************************/
-static BOOL gsimple_read (char *name)
+static BOOL gsimple_read (gsimplePlugin *plug, char *name)
 {
 	FILE *file;
 	BOOL ok = TRUE;
@@ -314,8 +345,8 @@ static BOOL gsimple_read (char *name)
 		iw_warning ("Unable to open '%s'", name);
 		return FALSE;
 	}
-	ok = ok && fread (&gs_gauss, 1, sizeof(t_gauss), file) == sizeof(t_gauss);
-	ok = ok && fread (gs_lookup, 1, LOOK_SIZE, file) == LOOK_SIZE;
+	ok = ok && fread (&plug->gauss, 1, sizeof(t_gauss), file) == sizeof(t_gauss);
+	ok = ok && fread (plug->lookup, 1, LOOK_SIZE, file) == LOOK_SIZE;
 	if (!ok)
 		iw_warning ("Unable to read from '%s'", name);
 	fclose (file);
@@ -325,7 +356,7 @@ static BOOL gsimple_read (char *name)
 /*********************************************************************
   Write lookup table and gauss parameter to file name.
 *********************************************************************/
-static BOOL gsimple_write (char *name)
+static BOOL gsimple_write (gsimplePlugin *plug, char *name)
 {
 	FILE *file;
 	BOOL ok = TRUE;
@@ -335,8 +366,8 @@ static BOOL gsimple_write (char *name)
 		return FALSE;
 	}
 
-	ok = ok && fwrite (&gs_gauss, 1, sizeof(t_gauss), file) == sizeof(t_gauss);
-	ok = ok && fwrite (gs_lookup, 1, LOOK_SIZE, file) == LOOK_SIZE;
+	ok = ok && fwrite (&plug->gauss, 1, sizeof(t_gauss), file) == sizeof(t_gauss);
+	ok = ok && fwrite (plug->lookup, 1, LOOK_SIZE, file) == LOOK_SIZE;
 	if (!ok)
 		iw_warning ("Unable to write to '%s'", name);
 	fclose (file);
@@ -348,65 +379,67 @@ static BOOL gsimple_write (char *name)
 *********************************************************************/
 static void cb_button_event (prevBuffer *b, prevEvent signal, int x, int y, void *data)
 {
-	if (!opt_values.init_gsimple) return;
+	gsimplePlugin *plug = data;
 
-	opt_values.rect_x = x;
-	opt_values.rect_y = y;
+	if (!plug->values.init_gsimple) return;
+
+	plug->values.rect_x = x;
+	plug->values.rect_y = y;
 }
 
-static void set_update_mode (BOOL update, int thresh_new)
+/*********************************************************************
+  Switch between the update and the classification mode by changing
+  the options of the (first) skinclass plugin. The changed option
+  values are saved in plug and restored on return to classification.
+*********************************************************************/
+static void set_update_mode (gsimplePlugin *plug, BOOL update, int thresh_new)
 {
-	static long face = OPTS_SET_ERROR, ret;
-	static int thresh = OPTS_SET_ERROR;
-	static int dthresh = OPTS_SET_ERROR;
-	static int comb = OPTS_SET_ERROR;
-	static int diff = OPTS_SET_ERROR;
-	static int mhi = OPTS_SET_ERROR;
+	long ret;
 
 	if (update) {
-		gsimple_read (GSIMPLE_FILE_UPDATE);
+		gsimple_read (plug, GSIMPLE_FILE_UPDATE);
 
 		ret = opts_value_set (OPT_DIFF_THRESH, GINT_TO_POINTER(0));
-		if (dthresh == OPTS_SET_ERROR) dthresh = ret;
+		if (plug->save_dthresh == OPTS_SET_ERROR) plug->save_dthresh = ret;
 
 		ret = opts_value_set (OPT_DIFF_DO, GINT_TO_POINTER(1));
-		if (diff == OPTS_SET_ERROR) diff = ret;
+		if (plug->save_diff == OPTS_SET_ERROR) plug->save_diff = ret;
 
 		ret = opts_value_set (OPT_COMB_MODE, GINT_TO_POINTER(SCLAS_COMB_MUL));
-		if (comb == OPTS_SET_ERROR) comb = ret;
+		if (plug->save_comb == OPTS_SET_ERROR) plug->save_comb = ret;
 
 		ret = opts_value_set (OPT_CLASS_THRESH, GINT_TO_POINTER(0));
-		if (thresh == OPTS_SET_ERROR) thresh = ret;
+		if (plug->save_thresh == OPTS_SET_ERROR) plug->save_thresh = ret;
 
 		ret = opts_value_set ("Motion History Image", GINT_TO_POINTER(0));
-		if (mhi == OPTS_SET_ERROR) mhi = ret;
+		if (plug->save_mhi == OPTS_SET_ERROR) plug->save_mhi = ret;
 
 		ret = opts_value_set ("Face detection:", GINT_TO_POINTER(0));
-		if (face == OPTS_SET_ERROR) face = ret;
+		if (plug->save_face == OPTS_SET_ERROR) plug->save_face = ret;
 
-		gs_state = GSIMPLE_UPDATE;
+		plug->state = GSIMPLE_UPDATE;
 	} else {
-		opts_value_set (OPT_DIFF_THRESH, GINT_TO_POINTER(dthresh));
-		dthresh = OPTS_SET_ERROR;
-		opts_value_set (OPT_COMB_MODE, GINT_TO_POINTER(comb));
-		comb = OPTS_SET_ERROR;
-		opts_value_set (OPT_DIFF_DO, GINT_TO_POINTER(diff));
-		diff = OPTS_SET_ERROR;
-
-		if (thresh_new >= 0) thresh = thresh_new;
-		if (thresh == OPTS_SET_ERROR) thresh = 60;
-		opts_value_set (OPT_CLASS_THRESH, GINT_TO_POINTER(thresh));
-		thresh = OPTS_SET_ERROR;
-
-		if (mhi != OPTS_SET_ERROR) {
-			opts_value_set ("Motion History Image", GINT_TO_POINTER(mhi));
-			mhi = OPTS_SET_ERROR;
+		opts_value_set (OPT_DIFF_THRESH, GINT_TO_POINTER(plug->save_dthresh));
+		plug->save_dthresh = OPTS_SET_ERROR;
+		opts_value_set (OPT_COMB_MODE, GINT_TO_POINTER(plug->save_comb));
+		plug->save_comb = OPTS_SET_ERROR;
+		opts_value_set (OPT_DIFF_DO, GINT_TO_POINTER(plug->save_diff));
+		plug->save_diff = OPTS_SET_ERROR;
+
+		if (thresh_new >= 0) plug->save_thresh = thresh_new;
+		if (plug->save_thresh == OPTS_SET_ERROR) plug->save_thresh = 60;
+		opts_value_set (OPT_CLASS_THRESH, GINT_TO_POINTER(plug->save_thresh));
+		plug->save_thresh = OPTS_SET_ERROR;
+
+		if (plug->save_mhi != OPTS_SET_ERROR) {
+			opts_value_set ("Motion History Image", GINT_TO_POINTER(plug->save_mhi));
+			plug->save_mhi = OPTS_SET_ERROR;
 		}
-		if (face != OPTS_SET_ERROR) {
-			opts_value_set ("Face detection:", (void*)face);
-			face = OPTS_SET_ERROR;
+		if (plug->save_face != OPTS_SET_ERROR) {
+			opts_value_set ("Face detection:", (void*)plug->save_face);
+			plug->save_face = OPTS_SET_ERROR;
 		}
-		gs_state = GSIMPLE_CLASS;
+		plug->state = GSIMPLE_CLASS;
 	}
 }
 
@@ -414,23 +447,23 @@ static void set_update_mode (BOOL update, int thresh_new)
   Initialisation of gauss distribution by showing some skin to the
   camera.
 *********************************************************************/
-static void gsimple_init_interactive (uchar **s, int width, int height)
+static void gsimple_init_interactive (gsimplePlugin *plug, uchar **s, int width, int height)
 {
 	prevBuffer *input = grab_get_inputBuf();
 	int x, y, i, j, of;
 	t_Pixel rg;
 
-	if (opt_values.rect_x < 0)
+	if (plug->values.rect_x < 0)
 		x = (width - RECTSIZE) / 2;
 	else
-		x = opt_values.rect_x - RECTSIZE/2;
+		x = plug->values.rect_x - RECTSIZE/2;
 	if (x<0) x = 0;
 	else if (x+RECTSIZE >= width) x = width-RECTSIZE-1;
 
-	if (opt_values.rect_y < 0)
+	if (plug->values.rect_y < 0)
 		y = (height - RECTSIZE) / 2;
 	else
-		y = opt_values.rect_y - RECTSIZE/2;
+		y = plug->values.rect_y - RECTSIZE/2;
 	if (y<0) y = 0;
 	else if (y+RECTSIZE >= height) y = height-RECTSIZE-1;
 
@@ -450,28 +483,39 @@ static void gsimple_init_interactive (uchar **s, int width, int height)
 		prev_render_rects (input, &rect, 1, 0, width, height);
 	}
 
-	gauss_clear (&gs_gauss);
-	gauss_draw_start (b_gauss);
-	gauss_draw_clear();
+	gauss_clear (&plug->gauss);
+	gauss_draw_start (&plug->draw, plug->b_gauss);
+	gauss_draw_clear (&plug->draw);
 
 	of = y*width + x;
 	for (i=RECTSIZE; i>0; i--) {
 		for (j=RECTSIZE; j>0; j--) {
 			iw_skin_yuv2rg (*(s[0]+of), *(s[1]+of), *(s[2]+of), &rg);
 
-			if (iw_skin_pixelIsSkin (skin_options, &rg)) {
-				gauss_add_pixel (&gs_gauss, rg);
-				gauss_draw_pixel (rg, 255);
+			if (iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
+				gauss_add_pixel (&plug->gauss, rg);
+				gauss_draw_pixel (&plug->draw, rg, 255);
 			} else
-				gauss_draw_pixel (rg, 127);
+				gauss_draw_pixel (&plug->draw, rg, 127);
 
 			of++;
 		}
 		of += width - RECTSIZE;
 	}
-	gauss_calc (&gs_gauss);
-	gauss_draw_dist (&gs_gauss);
-	gauss_draw_stop ();
+	gauss_calc (plug, &plug->gauss);
+	gauss_draw_dist (plug, &plug->gauss);
+	gauss_draw_stop (&plug->draw);
+}
+
+/*********************************************************************
+  iwClassifyFunc for iw_classify(), classify one pixel with the
+  gaussian data.
+*********************************************************************/
+static uchar gsimple_pixelclassify (void *data, int y, int u, int v)
+{
+	gsimplePlugin *plug = data;
+
+	return pixelclassify (plug->skin_options, &plug->gauss, y, u, v);
 }
 
 /*********************************************************************
@@ -479,112 +523,76 @@ static void gsimple_init_interactive (uchar **s, int width, int height)
   (mask size: size*2+1) to d.
   pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
 *********************************************************************/
-static BOOL gsimple_classify (iwImage *img, uchar *d, int pix_cnt, int size, int thresh)
+static BOOL gsimple_classify (plugDefinition *plug_d, iwImage *img, uchar *d,
+							  int pix_cnt, int size, int thresh)
 {
-	static BOOL last_init_gsimple = FALSE;
-	uchar *y=img->data[0], *u=img->data[1], *v=img->data[2], *dpos, *buffer;
+	gsimplePlugin *plug = (gsimplePlugin *)plug_d;
 	int width = img->width, height = img->height;
-	int count = width*height, index;
 	BOOL use_lookup = TRUE;
+	iwClassifyPara para;
 
-	dpos = buffer = iw_img_get_buffer(count);
-
-	if (opt_values.init_gsimple) {
-		gsimple_init_interactive (img->data, width, height);
-		last_init_gsimple = TRUE;
+	if (plug->values.init_gsimple) {
+		gsimple_init_interactive (plug, img->data, width, height);
+		plug->last_init_gsimple = TRUE;
 		use_lookup = FALSE;
-	} else if (last_init_gsimple) {
-		calc_lookup (&gs_gauss);
-		last_init_gsimple = FALSE;
+	} else if (plug->last_init_gsimple) {
+		calc_lookup (plug);
+		plug->last_init_gsimple = FALSE;
 	}
-	if (opt_values.calc_lookup) {
-		gauss_draw_start (b_gauss);
-		gauss_calc (&gs_gauss);
-		gauss_draw_dist (&gs_gauss);
-		gauss_draw_stop ();
-		calc_lookup (&gs_gauss);
-		opt_values.calc_lookup = FALSE;
+	if (plug->values.calc_lookup) {
+		gauss_draw_start (&plug->draw, plug->b_gauss);
+		gauss_calc (plug, &plug->gauss);
+		gauss_draw_dist (plug, &plug->gauss);
+		gauss_draw_stop (&plug->draw);
+		calc_lookup (plug);
+		plug->values.calc_lookup = FALSE;
 	}
-	if (opt_values.save != 0) {
-		if (opt_values.save == 1)
-			gsimple_write (GSIMPLE_FILE);
+	if (plug->values.save != 0) {
+		if (plug->values.save == 1)
+			gsimple_write (plug, GSIMPLE_FILE);
 		else
-			gsimple_read (GSIMPLE_FILE);
-		opt_values.save = 0;
+			gsimple_read (plug, GSIMPLE_FILE);
+		plug->values.save = 0;
 	}
-	if (opt_values.class_mode != 0) {
-		if (opt_values.class_mode != 1 && gs_state == GSIMPLE_UPDATE)
+	if (plug->values.class_mode != 0) {
+		if (plug->values.class_mode != 1 && plug->state == GSIMPLE_UPDATE)
 			iw_output_status (STATUS_UPDATE" "IW_OUTPUT_STATUS_CANCEL);
-		set_update_mode (opt_values.class_mode==1, -1);
-		opt_values.class_mode = 0;
+		set_update_mode (plug, plug->values.class_mode==1, -1);
+		plug->values.class_mode = 0;
 	}
 
-	if (size == 0)
-		dpos = d;
-
-	if (pix_cnt==0) {
-		if (use_lookup) {
-			while (count--) {
-				index = ((*y++ >>1) << 14) | ((*u++ >>1) << 7) | (*v++ >>1);
-				*dpos++ = gs_lookup[index];
-			}
-		} else {
-			while (count--)
-				*dpos++ = pixelclassify (&gs_gauss, *y++, *u++, *v++);
-		}
+	iw_classify_init (&para);
+	if (use_lookup) {
+		para.feature = IW_CLASSIFY_YUV7;
+		para.lookup = plug->lookup;
 	} else {
-		int i,k, r,g,b;
-		if (!size) iw_img_border (dpos,width,height,1);
-		y+=width+1; u+=width+1; v+=width+1; dpos+=width+1;
-		for (i=1; i<height-1; i++) {
-			for (k=1; k<width-1; k++) {
-				if (pix_cnt==2) {
-					r = (*y + *(y-1) + *(y+1) + *(y-width) + *(y+width)) / 5;
-					g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-					b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-				} else {
-					r = (*(y-1) + *(y+1) + *(y-width) + *(y+width)) / 4;
-					g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-					b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-				}
-				if (use_lookup) {
-					index = ((r >>1) << 14) | ((g >>1) << 7) | (b >>1);
-					*dpos++ = gs_lookup[index];
-				} else
-					*dpos++ = pixelclassify (&gs_gauss, r,g,b);
-				y++; u++; v++;
-			}
-			y+=2; u+=2; v+=2; dpos+=2;
-
-		}
+		para.func = gsimple_pixelclassify;
+		para.data = plug;
 	}
-	if (size>0)
-		iw_img_median (buffer,d,width,height,size);
-
-	iw_img_release_buffer();
+	para.pix_cnt = pix_cnt;
+	para.size = size;
+	iw_classify (img, d, &para);
 
 	return TRUE;
 }
 
-static BOOL is_background (uchar **s, uchar **b, int of)
+static BOOL is_background (gsimplePlugin *plug, uchar **s, uchar **b, int of)
 {
 	/*
 	int k = 0.333 * (abs(s[0][of]-b[0][of]) + abs(s[1][of]-b[1][of]) + abs(s[2][of]-b[2][of]));
 	*/
 	int k = 0.5 * (abs(s[1][of]-b[1][of]) + abs(s[2][of]-b[2][of]));
-	return (k <= opt_values.diff_back);
+	return (k <= plug->values.diff_back);
 }
 
-static uchar **back_fgimg, *back_bgimg[3];
-static int back_width;
-
 /*********************************************************************
   Fill function to remove any background pixels staring at offset
   (One border pixel of the region labeld with label in ireg). Not
   recursive to save stack space.
 *********************************************************************/
-static void background_check (int *ireg, int label, int offset)
+static void background_check (int *ireg, int label, int offset, void *data)
 {
+	gsimplePlugin *plug = data;
 	int *stack, sptr, ssize;
 
 	ssize = 1000;
@@ -595,7 +603,7 @@ static void background_check (int *ireg, int label, int offset)
 		offset = stack[--sptr];
 
 		if (*(ireg+offset) == label &&
-			is_background (back_fgimg, back_bgimg, offset)) {
+			is_background (plug, plug->back_fgimg, plug->back_bgimg, offset)) {
 			*(ireg+offset) = -1;
 
 			if (sptr+4+1 >= ssize) {
@@ -604,19 +612,19 @@ static void background_check (int *ireg, int label, int offset)
 			}
 			stack[sptr++] = offset-1;
 			stack[sptr++] = offset+1;
-			stack[sptr++] = offset-back_width;
-			stack[sptr++] = offset+back_width;
+			stack[sptr++] = offset-plug->back_width;
+			stack[sptr++] = offset+plug->back_width;
 		}
 	}
 	free (stack);
 }
 
 /*********************************************************************
-  Calculate and return threshold such that opt_values.threshold % of
+  Calculate and return threshold such that plug->values.threshold % of
   all training pixels (marked in hist_ireg by gsimple_update_do() with
   G_MAXINT) get classified correctly.
 *********************************************************************/
-static int gsimple_get_thresh (iwImage *img, int hist_cnt,
+static int gsimple_get_thresh (gsimplePlugin *plug, iwImage *img, int hist_cnt,
 							   uchar *hist_img, int *hist_ireg)
 {
 	int hist[256];
@@ -632,7 +640,7 @@ static int gsimple_get_thresh (iwImage *img, int hist_cnt,
 				index = ((*hist_img >>1) << 14)
 					| ((*(hist_img+count) >>1) << 7)
 					| (*(hist_img+count*2) >>1);
-				hist[gs_lookup[index]]++;
+				hist[plug->lookup[index]]++;
 				anzvec++;
 			}
 			hist_img++;
@@ -644,13 +652,13 @@ static int gsimple_get_thresh (iwImage *img, int hist_cnt,
 	sum = 0;
 	for (x=255; x>=0; x--) {
 		sum += hist[x];
-		if (100*sum/anzvec >= opt_values.threshold) {
+		if (100*sum/anzvec >= plug->values.threshold) {
 			thresh = x;
 			break;
 		}
 	}
 	iw_debug (2, "Threshold to get %d%% correctly: %d",
-			  opt_values.threshold, thresh);
+			  plug->values.threshold, thresh);
 	return thresh;
 }
 
@@ -659,7 +667,7 @@ static int gsimple_get_thresh (iwImage *img, int hist_cnt,
   regions of all hist_cnt images and removing pixels which are similar
   to the background image from hist_back.
 *********************************************************************/
-static void gsimple_update_do (iwImage *img, int hist_cnt,
+static void gsimple_update_do (gsimplePlugin *plug, iwImage *img, int hist_cnt,
 							   uchar *hist_back, uchar *hist_img,
 							   uchar *hist_ireg, uchar *hist_reg)
 {
@@ -674,14 +682,14 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 
 	buffer = iw_img_get_buffer (w*h + sizeof(gint32)*w*h+sizeof(gint32));
 	ireg = (gint32*)((size_t)(buffer + w*h + sizeof(gint32)-1) & -sizeof(gint32));
-	gauss_clear (&gs_gauss);
-	gauss_draw_clear();
+	gauss_clear (&plug->gauss);
+	gauss_draw_clear (&plug->draw);
 
-	back_width = w;
-	back_fgimg = s;
-	back_bgimg[0] = hist_back;
-	back_bgimg[1] = hist_back+w*h;
-	back_bgimg[2] = hist_back+2*w*h;
+	plug->back_width = w;
+	plug->back_fgimg = s;
+	plug->back_bgimg[0] = hist_back;
+	plug->back_bgimg[1] = hist_back+w*h;
+	plug->back_bgimg[2] = hist_back+2*w*h;
 
 	while (hist_cnt--) {
 
@@ -702,7 +710,7 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 			if (reg_x >= 0) {
 				memcpy (ireg, hist_ireg, w*h*sizeof(gint32));
 				iw_gsimple_shrink (ireg, w, h, reg_x, reg_y, reg_w, reg_h,
-								   reg_index, opt_values.reg_shrink, background_check);
+								   reg_index, plug->values.reg_shrink, background_check, plug);
 
 				cnt = 0;
 				of = reg_y*w + reg_x;
@@ -711,7 +719,7 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 						if (*((int*)ireg+of) == reg_index) {
 							iw_skin_yuv2rg (*(s[0]+of), *(s[1]+of), *(s[2]+of), &rg);
 						
-							if (iw_skin_pixelIsSkin (skin_options, &rg))
+							if (iw_skin_pixelIsSkin (plug->skin_options, &rg))
 								cnt++;
 						}
 						of++;
@@ -733,7 +741,7 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 		reg_h = *reg++;
 		reg_index = *reg++;
 
-		if (b_region->window) memcpy (buffer, s[0], w*h);
+		if (plug->b_region->window) memcpy (buffer, s[0], w*h);
 		of = 0;
 		for (x=w*h; x>0; x--) {
 			if (*((int*)hist_ireg+of) == reg_index)
@@ -742,7 +750,7 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 		}
 
 		iw_gsimple_shrink ((gint32*)hist_ireg, w, h, reg_x, reg_y, reg_w, reg_h,
-						   reg_index, opt_values.reg_shrink, background_check);
+						   reg_index, plug->values.reg_shrink, background_check, plug);
 
 		of = reg_y*w + reg_x;
 		for (y=reg_h; y>0; y--) {
@@ -750,30 +758,30 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 				if (*((int*)hist_ireg+of) == reg_index) {
 					iw_skin_yuv2rg (*(s[0]+of), *(s[1]+of), *(s[2]+of), &rg);
 
-					if (iw_skin_pixelIsSkin (skin_options, &rg)) {
-						gauss_add_pixel (&gs_gauss, rg);
-						gauss_draw_pixel (rg, 255);
+					if (iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
+						gauss_add_pixel (&plug->gauss, rg);
+						gauss_draw_pixel (&plug->draw, rg, 255);
 						*(buffer+of) = 255;
 						*((int*)hist_ireg+of) = G_MAXINT;
 					} else
-						gauss_draw_pixel (rg, 127);
+						gauss_draw_pixel (&plug->draw, rg, 127);
 				}
 				of++;
 			}
 			of += w - reg_w;
 		}
 
-		gauss_draw_unlock ();
-		prev_render (b_region, &buffer, w, h, IW_YUV);
-		prev_draw_buffer (b_region);
-		if (opt_values.update_wait) {
+		gauss_draw_unlock (&plug->draw);
+		prev_render (plug->b_region, &buffer, w, h, IW_YUV);
+		prev_draw_buffer (plug->b_region);
+		if (plug->values.update_wait) {
 			/* Single UpdateRegion display */
-			while (opt_values.update_cont == 0)
+			while (plug->values.update_cont == 0)
 				iw_usleep (100);
-			if (opt_values.update_cont == 1)
-				opt_values.update_cont = 0;
+			if (plug->values.update_cont == 1)
+				plug->values.update_cont = 0;
 		}
-		gauss_draw_lock ();
+		gauss_draw_lock (&plug->draw);
 
 		hist_img += 3*w*h;
 		hist_ireg += sizeof(int)*w*h;
@@ -781,11 +789,9 @@ static void gsimple_update_do (iwImage *img, int hist_cnt,
 	}
 	iw_img_release_buffer();
 
-	opt_values.update_cont = 0;
+	plug->values.update_cont = 0;
 }
 
-static t_gauss gs_fill_gauss;
-
 /*********************************************************************
   Test if the pixel with offset 'offset' in s belongs to a hand
   region. If so add this pixel to a new gauss distribution.
@@ -800,14 +806,14 @@ static BOOL gsimple_fill_cb (iwImage *s, uchar *d, int offset, ppmColor col, voi
 
 	iw_skin_yuv2rg (*y, *u, *v, &rg);
 
-	if (!iw_skin_pixelIsSkin (skin_options, &rg)) {
-		gauss_draw_pixel (rg, 127);
+	if (!iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
+		gauss_draw_pixel (&plug->draw, rg, 127);
 		return FALSE;
 	}
 
 	if ((abs(*u - col.g) + abs(*v - col.b)) < (int)data) {
-		gauss_add_pixel (&gs_fill_gauss, rg);
-		gauss_draw_pixel (rg, 255);
+		gauss_add_pixel (&plug->fill_gauss, rg);
+		gauss_draw_pixel (&plug->draw, rg, 255);
 		return TRUE;
 	} else
 		return FALSE;
@@ -823,8 +829,8 @@ static void gsimple_polygon_cb (iwImage *img, uchar *y, uchar *u, uchar *v,
 	while (cnt--) {
 		iw_skin_yuv2rg (*y++, *u++, *v++, &rg);
 
-		gauss_add_pixel (&gs_fill_gauss, rg);
-		gauss_draw_pixel (rg, 255);
+		gauss_add_pixel (&plug->fill_gauss, rg);
+		gauss_draw_pixel (&plug->draw, rg, 255);
 	}
 }
 */
@@ -835,80 +841,76 @@ static void gsimple_polygon_cb (iwImage *img, uchar *y, uchar *u, uchar *v,
   the color channel) over some frames (specified in the gui) and
   tacking a generated background image into account.
 *********************************************************************/
-static void gsimple_update (grabImageData *gimg, int *ireg,
+static void gsimple_update (plugDefinition *plug_d, grabImageData *gimg, int *ireg,
 							iwRegion *regions, int numregs)
 {
-	static unsigned long last_time = 0;
-	static int iterations = 0;
-	static uchar *hist_back, *hist_img, *hist_ireg, *hist_reg = NULL;
-	static int hist_max, hist_cnt;
-
+	gsimplePlugin *plug = (gsimplePlugin *)plug_d;
 	iwImage *img = &gimg->img;
 	unsigned long cur_time;
 	int max, max2, max3, i, w = img->width, h = img->height;
 	uchar *buffer;
 	iwRegion *reg;
 
-	if (gs_state != GSIMPLE_UPDATE) iterations = 0;
-	if (iterations > 0) iterations++;
+	if (plug->state != GSIMPLE_UPDATE) plug->iterations = 0;
+	if (plug->iterations > 0) plug->iterations++;
 
-	if (gs_state != GSIMPLE_UPDATE || numregs <= 0) return;
+	if (plug->state != GSIMPLE_UPDATE || numregs <= 0) return;
 
 	cur_time = gimg->time.tv_sec*1000 + gimg->time.tv_usec/1000;
-	gauss_draw_start (b_gauss);
+	gauss_draw_start (&plug->draw, plug->b_gauss);
 
 	/* Initialise the distribution if a new 'round' should be started */
-	if (cur_time-last_time > 700 ||
-		iterations > (int)(opt_values.iterations*1.5+0.5) ||
-		iterations == 0) {
+	if (cur_time-plug->last_time > 700 ||
+		plug->iterations > (int)(plug->values.iterations*1.5+0.5) ||
+		plug->iterations == 0) {
 
-		gauss_clear (&gs_fill_gauss);
-		iterations = 1;
+		gauss_clear (&plug->fill_gauss);
+		plug->iterations = 1;
 
-		gauss_draw_clear();
+		gauss_draw_clear (&plug->draw);
 
-		if (hist_reg) free (hist_reg);
-		hist_max = opt_values.iterations;
-		hist_cnt = 0;
-		hist_reg = calloc (hist_max*img->planes*w*h+
-							sizeof(int)*hist_max*w*h+
+		if (plug->hist_reg) free (plug->hist_reg);
+		plug->hist_max = plug->values.iterations;
+		plug->hist_cnt = 0;
+		plug->hist_reg = calloc (plug->hist_max*img->planes*w*h+
+							sizeof(int)*plug->hist_max*w*h+
 							(img->planes+1)*w*h+
-							hist_max*5*3*sizeof(int), 1);
-		hist_ireg = hist_reg + hist_max*5*3*sizeof(int);
-		hist_img = hist_ireg + hist_max*sizeof(int)*w*h;
-		hist_back = hist_img + hist_max*img->planes*w*h;
+							plug->hist_max*5*3*sizeof(int), 1);
+		plug->hist_ireg = plug->hist_reg + plug->hist_max*5*3*sizeof(int);
+		plug->hist_img = plug->hist_ireg + plug->hist_max*sizeof(int)*w*h;
+		plug->hist_back = plug->hist_img + plug->hist_max*img->planes*w*h;
 	}
 	iw_debug (5,"dtime: %lu iterations: %d pixCount: %d",
-			  cur_time-last_time, iterations, gs_fill_gauss.count);
+			  cur_time-plug->last_time, plug->iterations, plug->fill_gauss.count);
 
-	if (hist_cnt < hist_max) {
+	if (plug->hist_cnt < plug->hist_max) {
 		int d, k, k2, count = w*h;
 		uchar *y,*u,*v,*cnt, *m_ptr[3], *y0,*u0,*v0, *y1,*u1,*v1, *y2,*u2,*v2;
 		uchar *buffer = iw_img_get_buffer (w*h), *b_pos = buffer;
 
-		hist_cnt++;
+		plug->hist_cnt++;
 
 		/* Save image and the region segmentation for later update of the
 		   gauss distribution. */
 		for (d=0; d<img->planes; d++)
-			memcpy (hist_img+(hist_cnt-1)*img->planes*count+d*count, img->data[d], count);
-		memcpy (hist_ireg+(hist_cnt-1)*sizeof(int)*count, ireg, sizeof(int)*count);
+			memcpy (plug->hist_img+(plug->hist_cnt-1)*img->planes*count+d*count, img->data[d], count);
+		memcpy (plug->hist_ireg+(plug->hist_cnt-1)*sizeof(int)*count, ireg, sizeof(int)*count);
 
 		/* Update the background image by adding pixels which were not
 		   in the last two difference images. */
-		if (hist_cnt > 2) {
-			gauss_draw_unlock();
+		if (plug->hist_cnt > 2) {
+			gauss_draw_unlock (&plug->draw);
 
-			y0 = hist_img + (hist_cnt-1)*img->planes*count;
+			y0 = plug->hist_img + (plug->hist_cnt-1)*img->planes*count;
 			u0 = y0 + count;
 			v0 = y0 + 2*count;
-			y1 = hist_img + (hist_cnt-2)*img->planes*count;
+			y1 = plug->hist_img + (plug->hist_cnt-2)*img->planes*count;
 			u1 = y1 + count;
 			v1 = y1 + 2*count;
-			y2 = hist_img + (hist_cnt-3)*img->planes*count;
+			y2 = plug->hist_img + (plug->hist_cnt-3)*img->planes*count;
 			u2 = y2 + count;
 			v2 = y2 + 2*count;
-			y = hist_back;
+			y = plug->hist_back;
 			u = y+count;
 			v = y+2*count;
 
@@ -920,7 +922,7 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 				*/
 				k = 0.5 * (abs((*u1)-(*u0)) + abs((*v1)-(*v0)));
 				k2 = 0.5 * (abs((*u2)-(*u1)) + abs((*v2)-(*v1)));
-				if (k <= opt_values.diff_thresh && k2 <= opt_values.diff_thresh) {
+				if (k <= plug->values.diff_thresh && k2 <= plug->values.diff_thresh) {
 					*y = (*y * (*cnt) + *y0) / (*cnt+1);
 					*u = (*u * (*cnt) + *u0) / (*cnt+1);
 					*v = (*v * (*cnt) + *v0) / (*cnt+1);
@@ -935,16 +937,16 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 				y2++; u2++; v2++;
 			}
 
-			m_ptr[0] = hist_back;
-			m_ptr[1] = hist_back+w*h;
-			m_ptr[2] = hist_back+2*w*h;
-			prev_render (b_background, m_ptr, w, h, IW_YUV);
-			prev_draw_buffer (b_background);
+			m_ptr[0] = plug->hist_back;
+			m_ptr[1] = plug->hist_back+w*h;
+			m_ptr[2] = plug->hist_back+2*w*h;
+			prev_render (plug->b_background, m_ptr, w, h, IW_YUV);
+			prev_draw_buffer (plug->b_background);
 
-			prev_render (b_diff, &buffer, w, h, IW_YUV);
-			prev_draw_buffer (b_diff);
+			prev_render (plug->b_diff, &buffer, w, h, IW_YUV);
+			prev_draw_buffer (plug->b_diff);
 
-			gauss_draw_lock();
+			gauss_draw_lock (&plug->draw);
 		}
 		iw_img_release_buffer();
 	}
@@ -967,7 +969,7 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 	reg = &regions[max];
 
 	buffer = iw_img_get_buffer (w*h);
-	if (b_region->window) memcpy (buffer, img->data[0], w*h);
+	if (plug->b_region->window) memcpy (buffer, img->data[0], w*h);
 
 	/* Collect pixels for the new distribution */
 	{
@@ -981,12 +983,12 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 		reg_h = reg_h-reg_y+1;
 
 		iw_gsimple_shrink (ireg, w, h, reg_x, reg_y, reg_w, reg_h,
-						   reg->labindex, opt_values.reg_shrink, NULL);
+						   reg->labindex, plug->values.reg_shrink, NULL, NULL);
 
-		if (hist_cnt <= hist_max) {
+		if (plug->hist_cnt <= plug->hist_max) {
 			int x, y, w, h, idx;
 
-			pos = (int*)(hist_reg+(hist_cnt-1)*5*3*sizeof(int));
+			pos = (int*)(plug->hist_reg+(plug->hist_cnt-1)*5*3*sizeof(int));
 			*pos++ = reg_x;
 			*pos++ = reg_y;
 			*pos++ = reg_w;
@@ -1023,12 +1025,12 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 				if (*(ireg+of) == reg->labindex) {
 					iw_skin_yuv2rg (*(s[0]+of), *(s[1]+of), *(s[2]+of), &rg);
 
-					if (iw_skin_pixelIsSkin (skin_options, &rg)) {
-						gauss_add_pixel (&gs_fill_gauss, rg);
-						gauss_draw_pixel (rg, 255);
+					if (iw_skin_pixelIsSkin (plug->skin_options, &rg)) {
+						gauss_add_pixel (&plug->fill_gauss, rg);
+						gauss_draw_pixel (&plug->draw, rg, 255);
 						*(d+of) = 255;
 					} else
-						gauss_draw_pixel (rg, 127);
+						gauss_draw_pixel (&plug->draw, rg, 127);
 				}
 				of++;
 			}
@@ -1043,68 +1045,78 @@ static void gsimple_update (grabImageData *gimg, int *ireg,
 		col.b = reg->r.echtfarbe.z;
 
 		iw_gsimple_fill (img, buffer, reg->r.schwerpunkt.x, reg->r.schwerpunkt.y,
-						 col, gsimple_fill_cb, (void*)opt_values.fill_thresh);
+						 col, gsimple_fill_cb, (void*)plug->values.fill_thresh);
 	} */
 	/*
 	iw_img_fillPoly_raw (img->data, w, h, img->planes,
 						 &reg->r.polygon, FALSE, gsimple_polygon_cb, NULL);
 	*/
 
-	gauss_draw_unlock();
-	prev_render (b_region, &buffer, w, h, IW_YUV);
-	prev_draw_buffer (b_region);
-	gauss_draw_lock();
+	gauss_draw_unlock (&plug->draw);
+	prev_render (plug->b_region, &buffer, w, h, IW_YUV);
+	prev_draw_buffer (plug->b_region);
+	gauss_draw_lock (&plug->draw);
 	iw_img_release_buffer();
 
 	/* Calculate the new distribution */
-	if (gs_fill_gauss.count > opt_values.fill_minsize &&
-		iterations >= opt_values.iterations) {
+	if (plug->fill_gauss.count > plug->values.fill_minsize &&
+		plug->iterations >= plug->values.iterations) {
 
 		int thresh = 60;
 
-		if (opt_values.background)
-			gsimple_update_do (img, hist_cnt,
-							   hist_back, hist_img, hist_ireg, hist_reg);
+		if (plug->values.background)
+			gsimple_update_do (plug, img, plug->hist_cnt, plug->hist_back,
+							   plug->hist_img, plug->hist_ireg, plug->hist_reg);
 		else
-			gs_gauss = gs_fill_gauss;
+			plug->gauss = plug->fill_gauss;
 
-		gauss_calc (&gs_gauss);
-		calc_lookup (&gs_gauss);
-		gauss_draw_dist (&gs_gauss);
+		gauss_calc (plug, &plug->gauss);
+		calc_lookup (plug);
+		gauss_draw_dist (plug, &plug->gauss);
 		/* prev_buffer_unlock() must be called before calling set_update_mode(),
 		   otherwise a deadlock may happen */
-		gauss_draw_stop ();
+		gauss_draw_stop (&plug->draw);
 
-		if (opt_values.background)
-			thresh = gsimple_get_thresh (img, hist_cnt, hist_img, (int*)hist_ireg);
+		if (plug->values.background)
+			thresh = gsimple_get_thresh (plug, img, plug->hist_cnt, plug->hist_img,
+										(int*)plug->hist_ireg);
 
-		set_update_mode (FALSE, thresh);
+		set_update_mode (plug, FALSE, thresh);
 		iw_output_status (STATUS_UPDATE" "IW_OUTPUT_STATUS_DONE);
 		iw_debug (3,"New distribution with %d pixels after %d iterations",
-				  gs_gauss.count, iterations);
-		iterations = 0;
-	} else if (cur_time-last_time < 200) {
-		gauss_draw_stop ();
+				  plug->gauss.count, plug->iterations);
+		plug->iterations = 0;
+	} else if (cur_time-plug->last_time < 200) {
+		gauss_draw_stop (&plug->draw);
 		/* Last iteration was quite fast,
 		   slow it down to get reasonable difference images */
 		iw_debug (3, "Fast iteration, slowing down by %ld ms ...",
-				  200-(cur_time-last_time)+10);
-		iw_usleep (200-(cur_time-last_time)+10);
+				  200-(cur_time-plug->last_time)+10);
+		iw_usleep (200-(cur_time-plug->last_time)+10);
 	} else
-		gauss_draw_stop ();
+		gauss_draw_stop (&plug->draw);
 
-	if (iterations == 0) {
-		free (hist_reg);
-		hist_reg = NULL;
-		hist_cnt = 0;
+	if (plug->iterations == 0) {
+		free (plug->hist_reg);
+		plug->hist_reg = NULL;
+		plug->hist_cnt = 0;
 	}
-	last_time = cur_time;
+	plug->last_time = cur_time;
 }
 
 /*********************************************************************
   Free the resources allocated during bpro_???().
 *********************************************************************/
-static void gsimple_cleanup (plugDefinition *plug) {}
+static void gsimple_cleanup (plugDefinition *plug_d)
+{
+	gsimplePlugin *plug = (gsimplePlugin *)plug_d;
+
+	if (plug->hist_reg) {
+		free (plug->hist_reg);
+		plug->hist_reg = NULL;
+		plug->hist_cnt = 0;
+	}
+}
 
 static void help (plugDefinition *plug)
 {
@@ -1148,102 +1160,103 @@ static void gsimple_init (plugDefinition *plug, grabParameter *para, int argc, c
   Initialise the user interface for the plugin.
   Return: Number of the last opened option page.
 *********************************************************************/
-static int gsimple_init_options (plugDefinition *plug)
+static int gsimple_init_options (plugDefinition *plug_d)
 {
+	gsimplePlugin *plug = (gsimplePlugin *)plug_d;
 	int page;
 
-	opt_values.init_gsimple = FALSE;
-	opt_values.calc_lookup = FALSE;
-	opt_values.var_scale = 1.5;
-	opt_values.var_scale_kov = 1.5;
-	opt_values.var_add = 0;
-	opt_values.threshold = 95;
-	opt_values.fill_minsize = 100;
-	opt_values.iterations = 10;
-	opt_values.reg_shrink = 2;
-	opt_values.background = 1;
-	opt_values.diff_thresh = 8;
-	opt_values.diff_back = 8;
-	opt_values.save = 0;
-	opt_values.class_mode = 0;
-	opt_values.update_wait = FALSE;
-	opt_values.update_cont = 0;
-	opt_values.rect_x = -1;
-	opt_values.rect_y = -1;
-
-	page = opts_page_append ("GaussSimple");
+	plug->values.init_gsimple = FALSE;
+	plug->values.calc_lookup = FALSE;
+	plug->values.var_scale = 1.5;
+	plug->values.var_scale_kov = 1.5;
+	plug->values.var_add = 0;
+	plug->values.threshold = 95;
+	plug->values.fill_minsize = 100;
+	plug->values.iterations = 10;
+	plug->values.reg_shrink = 2;
+	plug->values.background = 1;
+	plug->values.diff_thresh = 8;
+	plug->values.diff_back = 8;
+	plug->values.save = 0;
+	plug->values.class_mode = 0;
+	plug->values.update_wait = FALSE;
+	plug->values.update_cont = 0;
+	plug->values.rect_x = -1;
+	plug->values.rect_y = -1;
+
+	page = opts_page_append (plug->page_main);
 	opts_toggle_create (page, "Init GaussSimple", "Show some skin to the camera!",
-						&opt_values.init_gsimple);
+						&plug->values.init_gsimple);
 	opts_button_create (page, "Recalculate Lookup",
 						"Calculating lookup table of gaussian classifier using current "
 						"settings of var-scale, skin locus, and white point",
-						&opt_values.calc_lookup);
+						&plug->values.calc_lookup);
 	opts_float_create (page, "VarScaling", "variance scaling factor",
-					   &opt_values.var_scale, 0.1, 200);
+					   &plug->values.var_scale, 0.1, 200);
 	opts_float_create (page, "VarScalKov", "covariance scaling factor",
-					   &opt_values.var_scale_kov, -20, 20);
+					   &plug->values.var_scale_kov, -20, 20);
 	opts_float_create (page, "VarAdd", "variance scaling addend",
-					   &opt_values.var_add, -100, 100);
+					   &plug->values.var_add, -100, 100);
 	opts_entscale_create (page, "Threshold",
 						  "How much of the training material should be classified correctly?",
-						  &opt_values.threshold, 0, 100);
+						  &plug->values.threshold, 0, 100);
 
 	opts_button_create (page, "UpdateClass|DoClass",
 						"Set mode to update and read the lookup table from file "
 						GSIMPLE_FILE_UPDATE"|"
 						"Set mode to classification(don't try to change the distribution)",
-						&opt_values.class_mode);
+						&plug->values.class_mode);
 	opts_toggle_create (page, "During Update: Wait for button",
 						"Wait for NextRegDisp,Continue buttons during "
 						"calculation of a new distribution",
-						&opt_values.update_wait);
-	opts_button_create (page, "NextRegDisp|Continue", NULL, &opt_values.update_cont);
+						&plug->values.update_wait);
+	opts_button_create (page, "NextRegDisp|Continue", NULL, &plug->values.update_cont);
 
-	page = opts_page_append ("GaussSimple2");
+	page = opts_page_append (plug->page_update);
 
 	opts_entscale_create (page, "MinPixCount",
 						  "Number of pixels necessary to recalculate a new distribution",
-						  &opt_values.fill_minsize, 0, 2000);
+						  &plug->values.fill_minsize, 0, 2000);
 	opts_entscale_create (page, "Iterations",
 						  "Number of iterations (grabbed images) necessary"
 						  " to recalculate a new distribution",
-						  &opt_values.iterations, 1, 100);
+						  &plug->values.iterations, 1, 100);
 	opts_entscale_create (page, "RegShrink",
 						  "Number of pixels a difference region is shrunk before"
 						  " adding the pixels to the new distribution",
-						  &opt_values.reg_shrink, 0, 20);
+						  &plug->values.reg_shrink, 0, 20);
 
 	opts_toggle_create (page, "Background separation",
 						"Remove pixels which are similar to the background",
-						&opt_values.background);
+						&plug->values.background);
 	opts_entscale_create (page, "DiffThresh",
 						  "Threshold for difference image for background image calculation",
-						  &opt_values.diff_thresh, 0, 30);
+						  &plug->values.diff_thresh, 0, 30);
 	opts_entscale_create (page, "DiffBack",
 						  "Min. difference with background image before pixels"
 						  " are added to the new distribution",
-						  &opt_values.diff_back, 0, 30);
+						  &plug->values.diff_back, 0, 30);
 
 	opts_button_create (page, "Save Lookup|Load Lookup",
 						"Save gauss values and lookup table in "GSIMPLE_FILE"|"
 						"Load gauss values and lookup table from "GSIMPLE_FILE,
-						&opt_values.save);
-	skin_options = iw_skin_init (page);
+						&plug->values.save);
+	plug->skin_options = iw_skin_init (page);
 
-	b_region = prev_new_window (plug_name(plug, ".region"), -1, -1, TRUE, FALSE);
-	b_gauss = prev_new_window (plug_name(plug, ".distribution"), -1, -1, FALSE, FALSE);
-	b_background = prev_new_window (plug_name(plug, ".mean image"), -1, -1, FALSE, FALSE);
-	b_diff = prev_new_window (plug_name(plug, ".backDiff image"), -1, -1, TRUE, FALSE);
+	plug->b_region = prev_new_window (plug_name(plug_d, ".region"), -1, -1, TRUE, FALSE);
+	plug->b_gauss = prev_new_window (plug_name(plug_d, ".distribution"), -1, -1, FALSE, FALSE);
+	plug->b_background = prev_new_window (plug_name(plug_d, ".mean image"), -1, -1, FALSE, FALSE);
+	plug->b_diff = prev_new_window (plug_name(plug_d, ".backDiff image"), -1, -1, TRUE, FALSE);
 
 	prev_signal_connect (grab_get_inputBuf(), PREV_BUTTON_PRESS|PREV_BUTTON_MOTION,
-						 cb_button_event, NULL);
+						 cb_button_event, plug);
 
-	gsimple_read (GSIMPLE_FILE);
+	gsimple_read (plug, GSIMPLE_FILE);
 
 	return page;
 }
 
-plugDefinition plug_gauss_simple = {
+static plugDefinition plug_gauss_simple = {
 	"GSimple",
 	PLUG_ABI_VERSION,
 	gsimple_init,
@@ -1256,9 +1269,28 @@ plugDefinition plug_gauss_simple = {
   Called on load of the plugin. Returns the filled plugin definition
   structure and whether the plugin should be inserted at the start or
   at the end of the iceWing internal plugin list.
+  The first instance keeps the old plugin and option page names, all
+  further instances get the instance number appended.
 *********************************************************************/
 plugDefinition *iw_gsimple_get_info (int instCount, BOOL *append)
 {
+	gsimplePlugin *plug = calloc (1, sizeof(gsimplePlugin));
+
+	plug->def = plug_gauss_simple;
+	if (instCount > 1) {
+		plug->def.name = g_strdup_printf ("%s%d", plug_gauss_simple.name, instCount);
+		plug->page_main = g_strdup_printf ("GaussSimple #%d", instCount);
+		plug->page_update = g_strdup_printf ("GaussSimple2 #%d", instCount);
+	} else {
+		plug->page_main = "GaussSimple";
+		plug->page_update = "GaussSimple2";
+	}
+	plug->lookup = iw_malloc0 (LOOK_SIZE, "GSimple lookup");
+	plug->state = GSIMPLE_CLASS;
+	plug->save_face = OPTS_SET_ERROR;
+	plug->save_thresh = plug->save_dthresh = plug->save_comb =
+		plug->save_diff = plug->save_mhi = OPTS_SET_ERROR;
+
 	*append = TRUE;
-	return &plug_gauss_simple;
+	return (plugDefinition*)plug;
 }
@@ -30,85 +30,87 @@
 #include "main/image.h"
 #include "gsimple_image.h"
 
-/* Variables for the img_fill function,
- *  global to reduce stack need of the recursive img_fill_helper()
+/* Variables for the img_fill function, passed as one pointer
+ *  to reduce stack need of the recursive img_fill_helper()
  */
-static iwImage *fill_s;		/* Source image */
-static uchar *fill_d;			/* Destination image */
-static iwColor fill_col;		/* Comparison color in img_cmp_pix() */
-static int fill_y, fill_x;		/* Current location in image */
-static iwGsimpleFillFunc fill_fkt;	/* !=NULL: Function to use instead of img_cmp_pix() */
-								/*		   fill_data is passed to the function. */
-								/* ==NULL: fill_data gives threshold for img_cmp_pix() */
-static void *fill_data;
-
-static BOOL img_cmp_pix (int offset)
+typedef struct {
+	iwImage *s;				/* Source image */
+	uchar *d;				/* Destination image */
+	iwColor col;			/* Comparison color in img_cmp_pix() */
+	int y, x;				/* Current location in image */
+	iwGsimpleFillFunc fkt;	/* !=NULL: Function to use instead of img_cmp_pix() */
+							/*		   data is passed to the function. */
+							/* ==NULL: data gives threshold for img_cmp_pix() */
+	void *data;
+} gsimpleFill;
+
+static BOOL img_cmp_pix (gsimpleFill *f, int offset)
 {
 	BOOL fill;
 
 	/* Pixel already set -> return */
-	if (*(fill_d+offset) == IW_COLMAX) return FALSE;
+	if (*(f->d+offset) == IW_COLMAX) return FALSE;
 
-	if (fill_fkt) {
-		fill = fill_fkt (fill_s, fill_d, offset, fill_col, fill_data);
+	if (f->fkt) {
+		fill = f->fkt (f->s, f->d, offset, f->col, f->data);
 	} else {
-		if (fill_s->planes == 1) {
-			fill = (*(fill_s->data[0]+offset) - fill_col.r) < GPOINTER_TO_INT(fill_data);
+		if (f->s->planes == 1) {
+			fill = (*(f->s->data[0]+offset) - f->col.r) < GPOINTER_TO_INT(f->data);
 		} else {
-			int y = abs(*(fill_s->data[0]+offset) - fill_col.r);
-			int u = abs(*(fill_s->data[1]+offset) - fill_col.g);
-			int v = abs(*(fill_s->data[2]+offset) - fill_col.b);
+			int y = abs(*(f->s->data[0]+offset) - f->col.r);
+			int u = abs(*(f->s->data[1]+offset) - f->col.g);
+			int v = abs(*(f->s->data[2]+offset) - f->col.b);
 
 			/* Compare max difference of all channels with the threshold */
 			int max = y;
 			if (u > max) max = u;
 			if (v > max) max = v;
 
-			fill = max < GPOINTER_TO_INT(fill_data);
+			fill = max < GPOINTER_TO_INT(f->data);
 
 			/*
-			fill = (u + v) < GPOINTER_TO_INT(fill_data);
+			fill = (u + v) < GPOINTER_TO_INT(f->data);
 			*/
 		}
 	}
 
 	if (fill) {
-		*(fill_d+offset) = IW_COLMAX;
+		*(f->d+offset) = IW_COLMAX;
 		return TRUE;
 	} else
 		return FALSE;
 }
 
-static void img_fill_helper (int offset)
+static void img_fill_helper (gsimpleFill *f, int offset)
 {
 	int of, start, end;
 
 	/* Get maximal points left and right from the current point */
-	start = fill_x;
+	start = f->x;
 	of = offset;
-	while (start>0 && img_cmp_pix (--of))
+	while (start>0 && img_cmp_pix (f, --of))
 		start--;
 
-	end = fill_x;
+	end = f->x;
 	of = offset;
-	while (end<fill_s->width-1 && img_cmp_pix (++of))
+	while (end<f->s->width-1 && img_cmp_pix (f, ++of))
 		end++;
 
-	of = offset-(fill_x-start);
+	of = offset-(f->x-start);
 
 	/* Test all points below and above the found line for possible continuations */
 	for (; start<=end; start++) {
-		if (fill_y > 0 && img_cmp_pix (of-fill_s->width)) {
-			fill_y -= 1;
-			fill_x = start;
-			img_fill_helper (of-fill_s->width);
-			fill_y += 1;
+		if (f->y > 0 && img_cmp_pix (f, of-f->s->width)) {
+			f->y -= 1;
+			f->x = start;
+			img_fill_helper (f, of-f->s->width);
+			f->y += 1;
 		}
-		if (fill_y < fill_s->height-1 && img_cmp_pix (of+fill_s->width)) {
-			fill_y += 1;
-			fill_x = start;
-			img_fill_helper (of+fill_s->width);
-			fill_y -= 1;
+		if (f->y < f->s->height-1 && img_cmp_pix (f, of+f->s->width)) {
+			f->y += 1;
+			f->x = start;
+			img_fill_helper (f, of+f->s->width);
+			f->y -= 1;
 		}
 		of++;
 	}
@@ -124,48 +126,47 @@ void iw_gsimple_fill (iwImage *s, uchar *d, int xs, int ys,
 					  iwColor col, iwGsimpleFillFunc fkt, void *data)
 {
 	int of = s->width*ys + xs;
+	gsimpleFill f;
 
-	/* Set variables,
-	   global to reduce stack need of the recursive img_fill_helper() */
-	fill_s = s;
-	fill_d = d;
-	fill_col = col;
-	fill_fkt = fkt;
-	fill_data = data;
-	fill_y = ys;
-	fill_x = xs;
+	f.s = s;
+	f.d = d;
+	f.col = col;
+	f.fkt = fkt;
+	f.data = data;
+	f.y = ys;
+	f.x = xs;
 
 	/* Search for a start point which is below the threshold */
-	if (img_cmp_pix (of)) {
-	} else if (fill_x >= 3 && img_cmp_pix (of-3)) {
-		fill_x -= 3;
+	if (img_cmp_pix (&f, of)) {
+	} else if (f.x >= 3 && img_cmp_pix (&f, of-3)) {
+		f.x -= 3;
 		of -= 3;
-	} else if (fill_x < fill_s->width-3 && img_cmp_pix (of+3)) {
-		fill_x += 3;
+	} else if (f.x < s->width-3 && img_cmp_pix (&f, of+3)) {
+		f.x += 3;
 		of += 3;
-	} else if (fill_y >= 3 && img_cmp_pix (of-3*fill_s->width)) {
-		fill_y -= 3;
-		of += 3*fill_s->width;
-	} else if (fill_y < fill_s->height-3 && img_cmp_pix (of+3*fill_s->width)) {
-		fill_y += 3;
-		of -= 3*fill_s->width;
+	} else if (f.y >= 3 && img_cmp_pix (&f, of-3*s->width)) {
+		f.y -= 3;
+		of += 3*s->width;
+	} else if (f.y < s->height-3 && img_cmp_pix (&f, of+3*s->width)) {
+		f.y += 3;
+		of -= 3*s->width;
 	} else
 		return;
-	iw_img_col_debug ("img_fill", fill_s, fill_x, fill_y);
-	img_fill_helper (of);
+	iw_img_col_debug ("img_fill", s, f.x, f.y);
+	img_fill_helper (&f, of);
 }
 
 /*********************************************************************
   Call for every border pixel of the region with label 'label' the
-  function fkt (img, label, pixel-offset) and shrink the region 'cnt'
-  times by 1 pixel.
+  function fkt (img, label, pixel-offset, data) and shrink the region
+  'cnt' times by 1 pixel.
   img : region labeled image of size width x height.
   reg_x, reg_y, reg_w, reg_h: Part of the image which should be
 							  searched for the region.
 *********************************************************************/
 void iw_gsimple_shrink (int *img, int width, int height, int reg_x, int reg_y,
 						int reg_w, int reg_h, int label, int cnt,
-						iwGsimpleShrinkFunc fkt)
+						iwGsimpleShrinkFunc fkt, void *data)
 {
 #define MAXLOOP			50000	/* Maximal contour length */
 	/* x- and y- offsets giving the next point to be checked */
@@ -270,7 +271,7 @@ void iw_gsimple_shrink (int *img, int width, int height, int reg_x, int reg_y,
 	if (fkt) {
 		point = points;
 		while (x--) {
-			fkt (img, label, *point+ *(point+1)*width);
+			fkt (img, label, *point+ *(point+1)*width, data);
 			point += 2;
 		}
 	}
@@ -29,7 +29,7 @@
 
 typedef BOOL (*iwGsimpleFillFunc) (iwImage *s, uchar *d, int offset,
 								   iwColor col, void *data);
-typedef void (*iwGsimpleShrinkFunc) (int *ireg, int label, int offset);
+typedef void (*iwGsimpleShrinkFunc) (int *ireg, int label, int offset, void *data);
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,15 +46,15 @@ void iw_gsimple_fill (iwImage *s, uchar *d, int xs, int ys,
 
 /*********************************************************************
   Call for every border pixel of the region with label 'label' the
-  function fkt (img, label, pixel-offset) and shrink the region 'cnt'
-  times by 1 pixel.
+  function fkt (img, label, pixel-offset, data) and shrink the region
+  'cnt' times by 1 pixel.
   img : region labeled image of size width x height.
   reg_x, reg_y, reg_w, reg_h: Part of the image which should be
 							  searched for the region.
 *********************************************************************/
 void iw_gsimple_shrink (int *img, int width, int height, int reg_x, int reg_y,
 						int reg_w, int reg_h, int label, int cnt,
-						iwGsimpleShrinkFunc fkt);
+						iwGsimpleShrinkFunc fkt, void *data);
 
 #ifdef __cplusplus
 }
@@ -61,14 +61,21 @@ typedef struct iclasPlugin {		/* All parameter of one plugin instance */
 	plugDefinition def;
 	iclasValues values;
 	iclasParameter para;
+	iwRegCalcData *rdata;			/* State of the labeling and region calculation */
 	prevBuffer *b_colorseg, *b_region;
 } iclasPlugin;
 
 /*********************************************************************
   Free the resources allocated during iclas_???().
 *********************************************************************/
-static void iclas_cleanup (plugDefinition *plug)
+static void iclas_cleanup (plugDefinition *plug_d)
 {
+	iclasPlugin *plug = (iclasPlugin *)plug_d;
+
+	iw_lookup_close (plug->para.lookup.lookup);
+	plug->para.lookup.lookup = NULL;
+	iw_reg_data_free (plug->rdata);
+	plug->rdata = NULL;
 }
 
 static void help (iclasPlugin *plug)
@@ -203,23 +210,36 @@ static BOOL iclas_process (plugDefinition *plug_d, char *ident, plugData *data)
 
 	if (plug->values.class_mode == ICLAS_OFF) return TRUE;
 
+	if (!plug->rdata)
+		plug->rdata = iw_reg_data_create();
 	ireg = iw_img_get_buffer(sizeof(int)*w*h);
 	d = malloc (w*h);
 
 	iw_time_start (time_class);
 
-	iw_sclas_classify (img, d, plug->values.smooth_size,
-					   plug->values.class_avg, &plug->para.lookup);
+	/* Classify and label in one pass if regions are needed */
+	iw_sclas_classify_label (img, d, plug->values.smooth_size,
+							 plug->values.class_avg, &plug->para.lookup,
+							 plug->values.class_mode == ICLAS_SEG ? NULL : ireg,
+							 &nregions, plug->rdata);
 	prev_render (plug->b_colorseg, &d, w, h, IW_INDEX);
 	prev_draw_buffer (plug->b_colorseg);
 
 	if (plug->values.class_mode == ICLAS_SEG) {
 		plug_data_set (plug_d, "segmentation", d, segmentation_destroy);
 	} else {
-		iw_img_border (d, w, h, 1);
-		nregions = iw_reg_label (w, h, d, ireg);
-		regions = iw_reg_calc (w, h, d, ireg, img->data, NULL, &nregions,
-							   plug->values.inclusion, plug->values.reg_min);
+		iwImage cimg;
+
+		iw_img_init (&cimg);
+		cimg.data = &d;
+		cimg.width = w;
+		cimg.height = h;
+		cimg.planes = 1;
+		iw_reg_data_set_minregion (plug->rdata, plug->values.reg_min);
+		iw_reg_data_set_images (plug->rdata, &cimg, img->data, NULL);
+		iw_reg_data_set_mode (plug->rdata, plug->values.inclusion ?
+							  IW_REG_INCLUSION : IW_REG_NO_ZERO);
+		regions = iw_reg_calc_data (w, h, ireg, &nregions, plug->rdata);
 		if (regions) {
 			iw_debug (3, "Number of second regions: %d", nregions);
 
@@ -30,41 +30,51 @@
 #include "gui/Ggui.h"
 #include "main/image.h"
 #include "main/plugin.h"
-#include "skinclass/sclas_image.h"
+#include "skinclass/skinclass.h"
 
 #define LOOKUP		"lookup.dat"		/* Default Color-Classifier-Lookup-File */
 
 static plugDefinition plug_polynom;
 
-static sclasLookup lookup = {NULL, NULL, NULL, FALSE, FALSE, -1};
+typedef struct polyPlugin {		/* All parameter of one plugin instance */
+	plugDefinition def;
+	sclasLookup lookup;
+} polyPlugin;
 
 /*********************************************************************
   Color classification of img. Write median() smoothed result
   (mask size: size*2+1) to dest.
   pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
 *********************************************************************/
-static BOOL poly_classify (iwImage *img, uchar *dest,
+static BOOL poly_classify (plugDefinition *plug_d, iwImage *img, uchar *dest,
 						   int pix_cnt, int size, int thresh)
 {
-	return iw_sclas_classify (img, dest, size, pix_cnt, &lookup);
+	polyPlugin *plug = (polyPlugin *)plug_d;
+
+	return iw_sclas_classify (img, dest, size, pix_cnt, &plug->lookup);
 }
 
 /*********************************************************************
   Updating the BackProjection classifier taking into account the
   classified regions.
 *********************************************************************/
-static void poly_update (iwImage *img, int *ireg, iwRegion *regions, int numregs)
+static void poly_update (plugDefinition *plug_d, iwImage *img, int *ireg,
+						 iwRegion *regions, int numregs)
 {
 }
 
 /*********************************************************************
   Free the resources allocated during poly_???().
 *********************************************************************/
-static void poly_cleanup (plugDefinition *plug)
+static void poly_cleanup (plugDefinition *plug_d)
 {
+	polyPlugin *plug = (polyPlugin *)plug_d;
+
+	iw_lookup_close (plug->lookup.lookup);
+	plug->lookup.lookup = NULL;
 }
 
-static void help (plugDefinition *plug)
+static void help (polyPlugin *plug)
 {
 	fprintf (stderr, "\n%s plugin for %s, (c) 1999-2009 by Frank Loemker\n"
 			 "Perform color classification with a lookup table.\n"
@@ -77,8 +87,8 @@ static void help (plugDefinition *plug)
 			 "         plugins datadir '%s'.\n"
 			 "         default: %s\n"
 			 "-lc      lookup table for color classification, contains confidence mappings\n",
-			 plug->name, ICEWING_NAME, plug->name,
-			 lookup.datadir, LOOKUP);
+			 plug->def.name, ICEWING_NAME, plug->def.name,
+			 plug->lookup.datadir, LOOKUP);
 	gui_exit (1);
 }
 
@@ -88,29 +98,33 @@ static void help (plugDefinition *plug)
   argc, argv: plugin specific options
 *********************************************************************/
 #define ARG_TEMPLATE "-L:Lr -LC:Cr -H:H"
-static void poly_init (plugDefinition *plug, grabParameter *para, int argc, char **argv)
+static void poly_init (plugDefinition *plug_d, grabParameter *para, int argc, char **argv)
 {
+	polyPlugin *plug = (polyPlugin *)plug_d;
+	sclasLookup *lookup = &plug->lookup;
 	void *arg;
 	char ch;
 	int nr = 0;
 
-	lookup.name = LOOKUP;
-	lookup.datadir = plug_get_datadir (plug);
-	lookup.confidence = FALSE;
-	lookup.twoclass = TRUE;
+	lookup->lookup = NULL;
+	lookup->name = LOOKUP;
+	lookup->datadir = plug_get_datadir (plug_d);
+	lookup->confidence = FALSE;
+	lookup->twoclass = TRUE;
+	lookup->feat_mode = -1;
 
 	while (nr < argc) {
 		ch = iw_parse_args (argc, argv, &nr, &arg, ARG_TEMPLATE);
 		switch (ch) {
 			case 'L':				/* -l */
-				lookup.name = (char*)arg;
-				lookup.confidence = FALSE;
-				lookup.twoclass = TRUE;
+				lookup->name = (char*)arg;
+				lookup->confidence = FALSE;
+				lookup->twoclass = TRUE;
 				break;
 			case 'C':				/* -lc */
-				lookup.name = (char*)arg;
-				lookup.confidence = TRUE;
-				lookup.twoclass = FALSE;
+				lookup->name = (char*)arg;
+				lookup->confidence = TRUE;
+				lookup->twoclass = FALSE;
 				break;
 			case 'H':
 			case '\0':
@@ -120,8 +134,8 @@ static void poly_init (plugDefinition *plug, grabParameter *para, int argc, char
 				help (plug);
 		}
 	}
-	plug_function_register (plug, "classify", (plugFunc)poly_classify);
-	plug_function_register (plug, "update", (plugFunc)poly_update);
+	plug_function_register (plug_d, "classify", (plugFunc)poly_classify);
+	plug_function_register (plug_d, "update", (plugFunc)poly_update);
 }
 
 /*********************************************************************
@@ -149,6 +163,12 @@ static plugDefinition plug_polynom = {
 *********************************************************************/
 plugDefinition *iw_poly_get_info (int instCount, BOOL *append)
 {
+	polyPlugin *plug = calloc (1, sizeof(polyPlugin));
+
+	plug->def = plug_polynom;
+	if (instCount > 1)
+		plug->def.name = g_strdup_printf ("%s%d", plug_polynom.name, instCount);
+
 	*append = TRUE;
-	return &plug_polynom;
+	return (plugDefinition*)plug;
 }
@@ -35,6 +35,7 @@
 #include <sys/types.h>
 
 #include "tools/tools.h"
+#include "tools/parallel.h"
 #include "main/image.h"
 #include "main/plugin.h"
 #include "gui/Gimage_i.h"
@@ -55,6 +56,13 @@
 #define REC_PARALLEL	2
 #define REC_ONCE		3
 
+/* What to do if the queue of to be saved images is full */
+#define REC_FULL_WAIT		0
+#define REC_FULL_DROP_NEW	1
+#define REC_FULL_DROP_OLD	2
+
+#define REC_THREADS_MAX		16
+
 /* Image is already converted, save directly */
 #define REC_IMG_FORMAT_DATA		(IW_IMG_FORMAT_VECTOR + 100)
 /* Close all movie files */
@@ -78,32 +86,48 @@ typedef struct recMovie {
 typedef struct recImage {
 	iwImgFormat format;		/* Format of data */
 	struct timeval time;	/* The time image data was grabbed */
-	char fname[PATH_MAX];	/* File name of image or NULL */
-	int frame_number;		/* Image from movie file -> frame number, 0 otherwise */
-	const char *pname;		/* Name of providing plugin (don't free this) */
+	int img_number;			/* Consecutive number of the grabbed image */
+	char fname[PATH_MAX];	/* File name the image is saved to */
 	recMovie *movie;		/* The movie where data should be added */
 	int dup_cnt;			/* Duplicate last frame dup_cnt times */
 	int length;				/* Length of data */
 	void *data;				/* The image data */
+
+	int seq;				/* Position in the ordered write back */
+	struct timeval queued;	/* Time the image was queued */
 } recImage;
 
 typedef struct recQEntry {
 	struct recQEntry *next;
 	struct recQEntry *prev;
-	void *data;
+	recImage *data;
 } recQEntry;
 
 typedef struct recQueue {
 	recQEntry *first;
 	recQEntry *last;
 	int nentries;
+	BOOL quit;				/* Exit all encoding threads if queue is empty */
 	pthread_mutex_t in_use;
-	pthread_cond_t changed;
+	pthread_cond_t changed;	/* Signaled if an entry was added */
+	pthread_cond_t space;	/* Signaled if an entry was removed */
+
+	int seq_next;			/* Sequence number for the next ordered entry */
+	int seq_write;			/* Sequence number of the entry allowed to write */
+	pthread_cond_t written;	/* Signaled if seq_write was incremented */
+
+	int saved;				/* Statistics since the last movie close */
+	int dropped;
+	int depth_max;
+	double lat_sum;			/* Summed up latency queueing -> saved in ms */
+	double lat_max;
 } recQueue;
 
 typedef struct recValues {
 	int record;				/* Do recording / do only recording ? */
 	int framedrop;			/* Min. queue length before waiting some ms */
+	int queue_max;			/* Max. number of queued images, 0: unlimited */
+	int queue_full;			/* REC_FULL_..., what to do if the queue is full */
 	BOOL rgb;				/* Convert to rgb? */
 	iwImgFormat format;
 	BOOL avi_usefrate;		/* Drop/duplicate frames to obey frame rate? */
@@ -116,13 +140,14 @@ typedef struct recValues {
 typedef struct recParameter {	/* Command line arguments */
 	BOOL grab;
 	char *name;
+	int threads;				/* Number of encoding threads */
 } recParameter;
 
 typedef struct recPlugin {		/* All parameter of one plugin instance */
 	plugDefinition def;
 	recValues values;
 	recParameter para;
-	pthread_t save_thread;
+	pthread_t *save_threads;
 
 	recQueue *images;
 	GHashTable *movie_hash;		/* Movies for all providing plugins */
@@ -133,23 +158,50 @@ typedef struct recPlugin {		/* All parameter of one plugin instance */
 	iwImgFormat last_format;	/* Format of last queued image */
 } recPlugin;
 
+/* Must the image be written in the order it was queued? */
+#define REC_IS_ORDERED(img)	((img)->movie || (img)->format >= REC_IMG_FORMAT_CLOSE)
+
 static recQueue *queue_init (void)
 {
-	recQueue *queue = malloc (sizeof(recQueue));
+	recQueue *queue = calloc (1, sizeof(recQueue));
 	queue->first = NULL;
 	queue->last = NULL;
-	queue->nentries = 0;
 	pthread_mutex_init (&queue->in_use, NULL);
 	pthread_cond_init (&queue->changed, NULL);
+	pthread_cond_init (&queue->space, NULL);
+	pthread_cond_init (&queue->written, NULL);
 
 	return queue;
 }
 
-static void queue_push (recQueue *queue, void *data)
+/*********************************************************************
+  Remove entry from queue. queue->in_use must be locked.
+*********************************************************************/
+static recImage *queue_unlink (recQueue *queue, recQEntry *entry)
+{
+	recImage *data = entry->data;
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		queue->first = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		queue->last = entry->prev;
+	queue->nentries--;
+	free (entry);
+
+	pthread_cond_broadcast (&queue->space);
+	return data;
+}
+
+static void queue_push (recQueue *queue, recImage *data)
 {
 	recQEntry *entry = malloc (sizeof(recQEntry));
 	entry->data = data;
 	entry->next = NULL;
+	gettimeofday (&data->queued, NULL);
 
 	pthread_mutex_lock (&queue->in_use);
 	if (queue->first == NULL) {
@@ -161,39 +213,154 @@ static void queue_push (recQueue *queue, void *data)
 	}
 	queue->last = entry;
 	queue->nentries++;
+	if (queue->nentries > queue->depth_max)
+		queue->depth_max = queue->nentries;
 
 	pthread_cond_broadcast (&queue->changed);
 	pthread_mutex_unlock (&queue->in_use);
 }
 
-static void *queue_pop (recQueue *queue)
+/*********************************************************************
+  Make room for one more image in the queue, which is limited to max
+  entries (max<=0: unlimited). Depending on policy wait till an entry
+  was removed by the encoding threads, drop the oldest images, or
+  drop the new image.
+  Return: FALSE if the new image should be dropped.
+*********************************************************************/
+static BOOL queue_reserve (recQueue *queue, int max, int policy)
+{
+	BOOL ok = TRUE;
+
+	if (max <= 0) return TRUE;
+
+	pthread_mutex_lock (&queue->in_use);
+	if (policy == REC_FULL_WAIT) {
+		while (queue->nentries >= max && !queue->quit)
+			pthread_cond_wait (&queue->space, &queue->in_use);
+	} else if (policy == REC_FULL_DROP_OLD) {
+		recQEntry *entry = queue->first;
+		while (queue->nentries >= max && entry) {
+			recQEntry *next = entry->next;
+			/* Close requests must never be dropped */
+			if (entry->data->format < REC_IMG_FORMAT_CLOSE) {
+				recImage *img = queue_unlink (queue, entry);
+				free (img->data);
+				free (img);
+				queue->dropped++;
+			}
+			entry = next;
+		}
+		ok = queue->nentries < max;
+	} else if (queue->nentries >= max) {
+		ok = FALSE;
+	}
+	if (!ok) queue->dropped++;
+	pthread_mutex_unlock (&queue->in_use);
+
+	if (!ok) fprintf (stderr, ".");
+	return ok;
+}
+
+/*********************************************************************
+  Return the next image from the queue, wait if the queue is empty.
+  Images which must be written in order get a sequence number.
+  Return: NULL if the encoding threads should exit.
+*********************************************************************/
+static recImage *queue_pop (recQueue *queue)
 {
-	recQEntry *entry;
-	void *data = NULL;
+	recImage *data = NULL;
 
 	pthread_mutex_lock (&queue->in_use);
-	while (queue->first == NULL) {
+	while (queue->first == NULL && !queue->quit) {
 		int ret;
 		while ((ret = pthread_cond_wait (&queue->changed,
 										 &queue->in_use)) != 0) {
 		   iw_warning ("WaitCondition returned error %d", ret);
 		}
 	}
-	entry = queue->first;
-	queue->first = entry->next;
-	if (queue->first == NULL)
-		queue->last = NULL;
-	else
-		queue->first->prev = NULL;
-	data = entry->data;
-	queue->nentries--;
+	if (queue->first) {
+		data = queue_unlink (queue, queue->first);
+		if (REC_IS_ORDERED(data))
+			data->seq = queue->seq_next++;
+	}
 	pthread_mutex_unlock (&queue->in_use);
 
-	free (entry);
-
 	return data;
 }
 
+/*********************************************************************
+  Signal all encoding threads to exit after the queue is empty.
+*********************************************************************/
+static void queue_quit (recQueue *queue)
+{
+	pthread_mutex_lock (&queue->in_use);
+	queue->quit = TRUE;
+	pthread_cond_broadcast (&queue->changed);
+	pthread_cond_broadcast (&queue->space);
+	pthread_mutex_unlock (&queue->in_use);
+}
+
+/*********************************************************************
+  Wait till all ordered images queued before img are written. Must be
+  followed by queue_order_leave().
+*********************************************************************/
+static void queue_order_enter (recQueue *queue, recImage *img)
+{
+	pthread_mutex_lock (&queue->in_use);
+	while (queue->seq_write != img->seq)
+		pthread_cond_wait (&queue->written, &queue->in_use);
+	pthread_mutex_unlock (&queue->in_use);
+}
+
+static void queue_order_leave (recQueue *queue)
+{
+	pthread_mutex_lock (&queue->in_use);
+	queue->seq_write++;
+	pthread_cond_broadcast (&queue->written);
+	pthread_mutex_unlock (&queue->in_use);
+}
+
+/*********************************************************************
+  Update the statistics after img was saved.
+*********************************************************************/
+static void queue_stat_saved (recQueue *queue, recImage *img)
+{
+	struct timeval now;
+	double ms;
+
+	gettimeofday (&now, NULL);
+	ms = (now.tv_sec - img->queued.tv_sec) * 1000.0 +
+		(now.tv_usec - img->queued.tv_usec) / 1000.0;
+
+	pthread_mutex_lock (&queue->in_use);
+	queue->saved++;
+	queue->lat_sum += ms;
+	if (ms > queue->lat_max)
+		queue->lat_max = ms;
+	pthread_mutex_unlock (&queue->in_use);
+}
+
+/*********************************************************************
+  Output the statistics and reset them.
+*********************************************************************/
+static void queue_stat_print (recQueue *queue)
+{
+	pthread_mutex_lock (&queue->in_use);
+	if (queue->saved > 0 || queue->dropped > 0) {
+		fprintf (stderr, "\nSaved %d images, dropped %d, max. queue length %d,"
+				 " latency avg %.1fms max %.1fms\n",
+				 queue->saved, queue->dropped, queue->depth_max,
+				 queue->saved > 0 ? queue->lat_sum/queue->saved : 0.0,
+				 queue->lat_max);
+	}
+	queue->saved = 0;
+	queue->dropped = 0;
+	queue->depth_max = queue->nentries;
+	queue->lat_sum = 0;
+	queue->lat_max = 0;
+	pthread_mutex_unlock (&queue->in_use);
+}
+
 /*********************************************************************
   Close all movie files.
 *********************************************************************/
@@ -275,111 +442,135 @@ static void record_get_filename (recPlugin *plug, struct timeval *time,
 }
 
 /*********************************************************************
-  Continously save all grabbed images from the image queue.
+  Compress the YUV420P frame img of the MJPEG movie img->movie.
+  Return: The JPEG data (must be freed) or NULL on error.
+*********************************************************************/
+static uchar *record_encode_mjpeg (recPlugin *plug, recImage *img, int *cnt)
+{
+	uchar *buf = NULL;
+	*cnt = 0;
+#ifdef WITH_JPEG
+	{
+		recMovie *m = img->movie;
+		uchar *planes[3];
+		int w = AVI_video_width (m->AVI);
+		int h = AVI_video_height (m->AVI);
+		planes[0] = img->data;
+		planes[1] = planes[0]+w*h;
+		planes[2] = planes[1]+EVEN_PROD(w,h)/4;
+		buf = malloc (w*h*3/2);
+		*cnt = encode_jpeg_raw (buf, w*h*3/2, plug->values.quality,
+								LAV_NOT_INTERLACED, 0,
+								w, h, planes[0], planes[1], planes[2]);
+	}
+#endif
+	return buf;
+}
+
+/*********************************************************************
+  Encoding thread: Continously save all grabbed images from the image
+  queue. Still images are compressed and saved in parallel by all
+  threads, MJPEG frames are compressed in parallel and written in
+  the order they were queued. All other movie frames and the closing
+  of movies are completely done in queue order.
 *********************************************************************/
 static void record_save (recPlugin *plug)
 {
+	recQueue *queue = plug->images;
 	int file = 0;
 	recImage *img;
-	char fname[PATH_MAX];
 	iwImgStatus status;
 	iwImgFileData *fdata = iw_img_data_create();
 
 	iw_showtid (1, plug->def.name);
-	while (1) {
-		if ((img = queue_pop(plug->images))) {
-			iwImgFormat format = img->format;
+	while ((img = queue_pop (queue))) {
+		iwImgFormat format = img->format;
+
+		if (format >= REC_IMG_FORMAT_CLOSE) {
+			queue_order_enter (queue, img);
+			record_close_avi ((GHashTable*)img->data);
+			queue_stat_print (queue);
+			if (format == REC_IMG_FORMAT_EXIT)
+				queue_quit (queue);
+			queue_order_leave (queue);
+			free (img);
+			continue;
+		}
 
-			if (format >= REC_IMG_FORMAT_CLOSE) {
-				record_close_avi ((GHashTable*)img->data);
-				free (img);
-				if (format == REC_IMG_FORMAT_CLOSE)
-					continue;
-				else
-					break;
-			}
+		if (img->movie && img->movie->AVI) {
 
-			if (img->movie && img->movie->AVI) {
+			recMovie *m = img->movie;
+			int cnt = 0;
+			uchar *buf = NULL;
 
-				recMovie *m = img->movie;
-				int cnt = 0;
-				uchar *buf = NULL;
+			if (m->format == IW_IMG_FORMAT_AVI_MJPEG) {
+				buf = record_encode_mjpeg (plug, img, &cnt);
+			} else {
+				cnt = img->length;
+				buf = img->data;
+			}
 
-				for (; img->dup_cnt; img->dup_cnt--) {
-					AVI_dup_frame (m->AVI);
-					fprintf (stderr, "d");
-				}
-				if (m->format == IW_IMG_FORMAT_AVI_MJPEG) {
-#ifdef WITH_JPEG
-					uchar *planes[3];
-					int w = AVI_video_width (m->AVI);
-					int h = AVI_video_height (m->AVI);
-					planes[0] = img->data;
-					planes[1] = planes[0]+w*h;
-					planes[2] = planes[1]+EVEN_PROD(w,h)/4;
-					buf = gui_get_buffer (w*h*3/2);
-					cnt = encode_jpeg_raw (buf, w*h*3/2, plug->values.quality,
-										   LAV_NOT_INTERLACED, 0,
-										   w, h, planes[0], planes[1], planes[2]);
-#endif
-				} else {
-					cnt = img->length;
-					buf = img->data;
-				}
-				if (cnt > 0) {
-					if (AVI_write_frame_start (m->AVI, cnt) ||
-						AVI_write_frame (m->AVI, buf, cnt)) {
-						iw_warning ("Unable to write to '%s'", m->name);
-					} else {
-						AVI_write_frame_end (m->AVI);
-						fprintf (stderr, "W %d|", plug->images->nentries);
-					}
+			queue_order_enter (queue, img);
+			for (; img->dup_cnt; img->dup_cnt--) {
+				AVI_dup_frame (m->AVI);
+				fprintf (stderr, "d");
+			}
+			if (cnt > 0) {
+				if (AVI_write_frame_start (m->AVI, cnt) ||
+					AVI_write_frame (m->AVI, buf, cnt)) {
+					iw_warning ("Unable to write to '%s'", m->name);
 				} else {
-					iw_warning ("Compressed image to 0 byte");
+					AVI_write_frame_end (m->AVI);
+					fprintf (stderr, "W %d|", queue->nentries);
 				}
-				if (m->format == IW_IMG_FORMAT_AVI_MJPEG && buf)
-					gui_release_buffer (buf);
-
-			} else if (img->movie) {
-
-				recMovie *m = img->movie;
-				iw_img_data_set_movie (fdata, &m->movie,
-									   plug->values.avi_framerate);
-				iw_img_data_set_quality (fdata, plug->values.quality);
-				status = iw_img_save ((iwImage*)img->data, m->format,
-									  m->name, fdata);
-				if (status != IW_IMG_STATUS_OK)
-					iw_warning ("Error %d saving to %s", status, m->name);
-				else
-					fprintf (stderr, "W %d|", plug->images->nentries);
-
 			} else {
+				iw_warning ("Compressed image to 0 byte");
+			}
+			queue_order_leave (queue);
+
+			if (m->format == IW_IMG_FORMAT_AVI_MJPEG && buf)
+				free (buf);
+
+		} else if (img->movie) {
+
+			recMovie *m = img->movie;
+			queue_order_enter (queue, img);
+			iw_img_data_set_movie (fdata, &m->movie,
+								   plug->values.avi_framerate);
+			iw_img_data_set_quality (fdata, plug->values.quality);
+			iw_img_data_set_frame (fdata, &img->time, img->img_number);
+			status = iw_img_save ((iwImage*)img->data, m->format,
+								  m->name, fdata);
+			if (status != IW_IMG_STATUS_OK)
+				iw_warning ("Error %d saving to %s", status, m->name);
+			else
+				fprintf (stderr, "W %d|", queue->nentries);
+			queue_order_leave (queue);
 
-				record_get_filename (plug, &img->time, img->fname,
-									 img->frame_number, img->pname, fname);
-
-				fprintf (stderr, "Saving '%s' (queue size %d)...\n",
-						 fname, plug->images->nentries);
+		} else {
 
-				if (format == REC_IMG_FORMAT_DATA) {
-					if ((file = open(fname, O_WRONLY|O_CREAT|O_TRUNC|O_NONBLOCK, 0666)) >= 0) {
-						if (write (file, img->data, img->length) != img->length)
-							iw_warning ("Unable to write to '%s'", fname);
-						close (file);
-					} else
-						iw_warning ("Unable to open '%s'", fname);
-				} else {
-					iw_img_data_set_quality (fdata, plug->values.quality);
-					status = iw_img_save ((iwImage*)img->data, format,
-										  fname, fdata);
-					if (status != IW_IMG_STATUS_OK)
-						iw_warning ("Unable to save as '%s', error %d", fname, status);
-				}
+			fprintf (stderr, "Saving '%s' (queue size %d)...\n",
+					 img->fname, queue->nentries);
 
+			if (format == REC_IMG_FORMAT_DATA) {
+				if ((file = open(img->fname, O_WRONLY|O_CREAT|O_TRUNC|O_NONBLOCK, 0666)) >= 0) {
+					if (write (file, img->data, img->length) != img->length)
+						iw_warning ("Unable to write to '%s'", img->fname);
+					close (file);
+				} else
+					iw_warning ("Unable to open '%s'", img->fname);
+			} else {
+				iw_img_data_set_quality (fdata, plug->values.quality);
+				status = iw_img_save ((iwImage*)img->data, format,
+									  img->fname, fdata);
+				if (status != IW_IMG_STATUS_OK)
+					iw_warning ("Unable to save as '%s', error %d", img->fname, status);
 			}
-			free (img->data);
-			free (img);
+
 		}
+		queue_stat_saved (queue, img);
+		free (img->data);
+		free (img);
 	}
 	iw_img_data_free (fdata);
 }
@@ -471,15 +662,17 @@ static BOOL record_conv_avi (recPlugin *plug, recImage *recimg, const char *pnam
 	recMovie *m = recimg->movie;
 	iwImage *img = &gimg->img;
 
-	if (IW_TYPE_SIZE(img) > 1) {
+	BOOL iwr = m->format == IW_IMG_FORMAT_IWR_RAW || m->format == IW_IMG_FORMAT_IWR_LZ4;
+
+	if (IW_TYPE_SIZE(img) > 1 && !iwr) {
 		iw_warning ("Unable to save images of type %d as avi frames",
 					img->type);
 		return FALSE;
 	}
 
-	/* Check if FFV1 or MPEG4 should be saved
+	/* Check if FFV1, MPEG4, or a raw movie should be saved
 	   (not handled natively in the record plugin) */
-	if (m->movie ||
+	if (m->movie || iwr ||
 		m->format == IW_IMG_FORMAT_AVI_FFV1 || m->format == IW_IMG_FORMAT_AVI_MPEG4) {
 		if (!m->movie) {
 			record_get_filename (plug, &gimg->time, gimg->fname,
@@ -487,6 +680,8 @@ static BOOL record_conv_avi (recPlugin *plug, recImage *recimg, const char *pnam
 			fprintf (stderr, "Saving frames in movie '%s' (Numbers: Queue length)...\n",
 					 m->name);
 		}
+		recimg->time = gimg->time;
+		recimg->img_number = gimg->img_number;
 		record_copy_img (recimg, FALSE, img);
 		return TRUE;
 	}
@@ -582,10 +777,14 @@ static void record_cleanup (plugDefinition *plug_d)
 {
 	recPlugin *plug = (recPlugin *)plug_d;
 
-	if (plug->save_thread) {
+	int i;
+
+	if (plug->save_threads) {
 		record_push_close (plug, TRUE);
-		pthread_join (plug->save_thread, NULL);
-		plug->save_thread = (pthread_t)NULL;
+		for (i=0; i<plug->para.threads; i++)
+			pthread_join (plug->save_threads[i], NULL);
+		free (plug->save_threads);
+		plug->save_threads = NULL;
 	}
 }
 
@@ -595,10 +794,12 @@ static void help (recPlugin *plug)
 			 "Perform optimized saving of images with the ident 'image' of type\n"
 			 "grabImageData or with a given ident.\n"
 			 "\n"
-			 "Usage of the %s plugin: [-g ident | -i ident]\n"
+			 "Usage of the %s plugin: [-g ident | -i ident] [-t threads]\n"
 			 "-g        observe data of type grabImageData\n"
-			 "-i        observe data of type iwImage\n",
-			 plug->def.name, ICEWING_NAME, plug->def.name);
+			 "-i        observe data of type iwImage\n"
+			 "-t        number of threads used for image compression and saving,\n"
+			 "          default: number of CPUs, max. %d\n",
+			 plug->def.name, ICEWING_NAME, plug->def.name, REC_THREADS_MAX);
 	gui_exit (1);
 }
 
@@ -606,16 +807,17 @@ static void help (recPlugin *plug)
   Initialisation.
   'para': command line parameter
 *********************************************************************/
-#define ARG_TEMPLATE "-G:Gr -I:Ir -H:H -HELP:H --HELP:H"
+#define ARG_TEMPLATE "-G:Gr -I:Ir -T:Ti -H:H -HELP:H --HELP:H"
 static void record_init (plugDefinition *plug_d, grabParameter *para, int argc, char **argv)
 {
 	recPlugin *plug = (recPlugin *)plug_d;
 	void *arg;
 	char ch;
-	int nr = 0;
+	int i, nr = 0;
 
 	plug->para.grab = TRUE;
 	plug->para.name = "image";
+	plug->para.threads = iw_parallel_get_threads();
 
 	while (nr < argc) {
 		ch = iw_parse_args (argc, argv, &nr, &arg, ARG_TEMPLATE);
@@ -628,6 +830,11 @@ static void record_init (plugDefinition *plug_d, grabParameter *para, int argc,
 				plug->para.grab = FALSE;
 				plug->para.name = (char*)arg;
 				break;
+			case 'T':
+				plug->para.threads = (int)(long)arg;
+				if (plug->para.threads < 1)
+					help (plug);
+				break;
 			case 'H':
 			case '\0':
 				help (plug);
@@ -643,8 +850,12 @@ static void record_init (plugDefinition *plug_d, grabParameter *para, int argc,
 	plug->last_time = 0;
 	plug->last_format = 0;
 
-	pthread_create (&plug->save_thread, NULL,
-					(void*(*)(void*))record_save, plug);
+	if (plug->para.threads > REC_THREADS_MAX)
+		plug->para.threads = REC_THREADS_MAX;
+	plug->save_threads = malloc (sizeof(pthread_t)*plug->para.threads);
+	for (i=0; i<plug->para.threads; i++)
+		pthread_create (&plug->save_threads[i], NULL,
+						(void*(*)(void*))record_save, plug);
 
 	plug_observ_data (plug_d, plug->para.name);
 }
@@ -656,11 +867,14 @@ static void record_init (plugDefinition *plug_d, grabParameter *para, int argc,
 static int record_init_options (plugDefinition *plug_d)
 {
 	static char *record[] = {"Off", "Exclusive", "Parallel", "Once", NULL};
+	static char *full[] = {"Wait", "Drop new", "Drop old", NULL};
 	recPlugin *plug = (recPlugin *)plug_d;
 	int p;
 
 	plug->values.record = REC_OFF;
 	plug->values.framedrop = 0;
+	plug->values.queue_max = 100;
+	plug->values.queue_full = REC_FULL_WAIT;
 	plug->values.rgb = FALSE;
 	plug->values.format = IW_IMG_FORMAT_UNKNOWN;
 	plug->values.avi_usefrate = TRUE;
@@ -679,6 +893,14 @@ static int record_init_options (plugDefinition *plug_d)
 						  " (>4xVal -> 200ms, >2xVal -> 80ms, >1xVal -> 40ms),"
 						  " 0 -> never wait",
 						  &plug->values.framedrop, 0, 200);
+	opts_entscale_create (p, "Queue size",
+						  "Max. number of images waiting for saving, bounds the memory"
+						  " used if saving is slower than grabbing, 0 -> unlimited",
+						  &plug->values.queue_max, 0, 500);
+	opts_option_create (p, "Queue full:",
+						"What to do if the queue is full: Wait till images are saved,"
+						" drop the new image, or drop the oldest images",
+						full, &plug->values.queue_full);
 	opts_toggle_create (p, "Convert to RGB", "Convert image to RGB (ignored for AVI)?",
 						&plug->values.rgb);
 	opts_option_create (p, "Image format:",
@@ -735,7 +957,9 @@ static BOOL record_process (plugDefinition *plug_d, char *ident, plugData *data)
 			iw_debug (0, "Resetting image counter");
 		}
 
-		if (plug->movie_hash)
+		if (plug->movie_hash ||
+			(plug->last_format > IW_IMG_FORMAT_UNKNOWN &&
+			 plug->last_format < REC_IMG_FORMAT_CLOSE))
 			record_push_close (plug, FALSE);
 		return TRUE;
 	}
@@ -756,6 +980,7 @@ static BOOL record_process (plugDefinition *plug_d, char *ident, plugData *data)
 		gimg->img = *(iwImage*)data->data;
 		gimg->fname = NULL;
 		gimg->frame_number = 0;
+		gimg->img_number = 0;
 		gettimeofday (&gimg->time, NULL);
 	}
 
@@ -769,6 +994,9 @@ static BOOL record_process (plugDefinition *plug_d, char *ident, plugData *data)
 		else if (plug->images->nentries > x)
 			iw_usleep (40*1000);
 	}
+	if (!queue_reserve (plug->images, plug->values.queue_max,
+						plug->values.queue_full))
+		return plug->values.record != REC_EXCLUSIVE;
 
 	time = gimg->time.tv_sec*1000 + gimg->time.tv_usec/1000;
 	if (plug->last_time > 0)
@@ -802,17 +1030,16 @@ static BOOL record_process (plugDefinition *plug_d, char *ident, plugData *data)
 			return plug->values.record != REC_EXCLUSIVE;
 		}
 	} else {
-		char header[40];
+		char header[40], src[PATH_MAX];
 		iwImage *i = &gimg->img;
 		guchar *pos;
 
-		recimg->time = gimg->time;
 		if (gimg->fname && *gimg->fname) {
-			gui_strlcpy (recimg->fname, gimg->fname, PATH_MAX);
+			gui_strlcpy (src, gimg->fname, PATH_MAX);
 		} else
-			recimg->fname[0] = '\0';
-		recimg->frame_number = gimg->frame_number;
-		recimg->pname = data->plug->name;
+			src[0] = '\0';
+		record_get_filename (plug, &gimg->time, src, gimg->frame_number,
+							 data->plug->name, recimg->fname);
 
 		if (format == IW_IMG_FORMAT_PNM && i->type == IW_8U && !i->rowstride) {
 			sprintf (header, "P%d\n# frame time %d\n%d %d\n255\n",
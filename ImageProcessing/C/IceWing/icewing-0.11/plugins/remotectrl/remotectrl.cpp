@@ -45,6 +45,30 @@
 #define SOCK_COM_LOAD	"control"
 #define SOCK_COM_SAVE	"getSettings"
 
+/* Binary batch packets start with SOCK_BIN_MAGIC, followed by a
+   request id and any number of commands (op, status, length, data),
+   all numbers in network byte order. Must match icewing-control.cpp. */
+#define SOCK_BIN_MAGIC		"\0IWB"
+#define SOCK_BIN_MAGIC_LEN	4
+#define SOCK_BIN_HEAD_LEN	(SOCK_BIN_MAGIC_LEN+4)
+#define SOCK_BIN_COM_LEN	6
+#define SOCK_SUB_INTERVAL	40		/* Default ms between subscription checks */
+#define SOCK_SEND_TIMEOUT	500		/* ms until a stalled client is dropped */
+
+typedef enum {
+	CTRL_OP_SET = 1,		/* Load the settings given as data */
+	CTRL_OP_GET,			/* Return all settings or the ones given as data */
+	CTRL_OP_GET_DIFF,		/* Return settings changed since the last get */
+	CTRL_OP_SUBSCRIBE,		/* Stream changed settings, data: interval in ms */
+	CTRL_OP_UNSUBSCRIBE,
+	CTRL_OP_NOTIFY			/* Server -> client: changed settings */
+} ctrlOp;
+
+typedef enum {
+	CTRL_OK,
+	CTRL_ERR_UNKNOWN		/* Unknown command */
+} ctrlStatus;
+
 #ifdef WITH_XCF
 #define LOG4CPP_FIX_ERROR_COLLISION
 #include "xcf/xcf.hpp"
@@ -62,6 +86,15 @@ typedef struct ctrlPlugin {
 	int sockfd;				/* socket() file descriptor */
 } ctrlPlugin;
 
+/* One connection to a client */
+typedef struct ctrlClient {
+	int fd;
+	GHashTable *values;		/* title -> setting line of the last get, for diffs */
+	int interval;			/* Subscription interval in ms, 0: not subscribed */
+	long next_check;		/* Time for the next subscription check */
+	struct ctrlClient *next;
+} ctrlClient;
+
 static BOOL cb_opts_load (void *data, char *buffer, int size)
 {
 	char **string = (char**)data, *pos;
@@ -107,6 +140,21 @@ static BOOL cb_opts_save (void *data, char *string)
 	return TRUE;
 }
 
+/*********************************************************************
+  Append len bytes from data to dat.
+*********************************************************************/
+static void ctrl_buf_add (ctrlSaveData *dat, const void *data, int len)
+{
+	if (dat->outpos - dat->out + len >= dat->len) {
+		char *out = dat->out;
+		dat->len += MAX(len,1000);
+		dat->out = (char*)realloc (dat->out, dat->len);
+		dat->outpos = dat->outpos - out + dat->out;
+	}
+	memcpy (dat->outpos, data, len);
+	dat->outpos += len;
+}
+
 #ifdef WITH_XCF
 /*********************************************************************
   XCF function to remote-control the GUI
@@ -137,13 +185,27 @@ static void xcf_getSettingsFunc (std::string& in, std::string& out)
 #endif /* WITH_XCF */
 
 /*********************************************************************
-  Send one packet (len + buf (of length len)) to socket s.
+  Return the current time in milliseconds.
+*********************************************************************/
+static long ctrl_time_ms (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec*1000 + tv.tv_usec/1000;
+}
+
+/*********************************************************************
+  Send one packet (len + buf (of length len)) to socket s. Fail if
+  sending takes longer than SOCK_SEND_TIMEOUT ms (SO_SNDTIMEO alone
+  restarts for every partial send()).
 *********************************************************************/
 static ssize_t sock_send (int s, const void *buf, size_t len)
 {
 	size_t total = 0;
 	int cnt;
 	uint32_t len_n;
+	long end = ctrl_time_ms() + SOCK_SEND_TIMEOUT;
 
 	len_n = htonl(len);
 	do {
@@ -159,6 +221,10 @@ static ssize_t sock_send (int s, const void *buf, size_t len)
 		if (cnt < 0)
 			return -1;
 		total += cnt;
+		if (total < len && ctrl_time_ms() > end) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
 	}
 	return total;
 }
@@ -173,13 +239,18 @@ static ssize_t sock_recv (int s, char **buf, int *len)
 	size_t total = 0;
 	int cnt;
 
-	do {
-		cnt = recv (s, &packetlen, sizeof(packetlen), 0);
-	} while (cnt == -1 && errno == EINTR);
-	if (cnt < 0)
-		return -1;
-	else if (cnt != sizeof(packetlen))
-		return 0;
+	/* With pipelined requests the length can be split as well */
+	while (total < sizeof(packetlen)) {
+		do {
+			cnt = recv (s, (char*)&packetlen+total, sizeof(packetlen)-total, 0);
+		} while (cnt == -1 && errno == EINTR);
+		if (cnt < 0)
+			return -1;
+		else if (cnt == 0)
+			return 0;
+		total += cnt;
+	}
+	total = 0;
 	packetlen = ntohl (packetlen);
 
 	if (*len < (int)packetlen) {
@@ -197,6 +268,242 @@ static ssize_t sock_recv (int s, char **buf, int *len)
 	return total;
 }
 
+/*********************************************************************
+  Append the header of a binary command to dat.
+*********************************************************************/
+static void ctrl_bin_add (ctrlSaveData *dat, ctrlOp op, ctrlStatus status,
+						  const char *data, int len)
+{
+	unsigned char head[SOCK_BIN_COM_LEN];
+	uint32_t len_n = htonl (len);
+
+	head[0] = op;
+	head[1] = status;
+	memcpy (head+2, &len_n, 4);
+	ctrl_buf_add (dat, head, SOCK_BIN_COM_LEN);
+	if (len > 0)
+		ctrl_buf_add (dat, data, len);
+}
+
+/*********************************************************************
+  Return the part of the settings line line, which identifies the
+  setting, i.e. the quoted title, or NULL for comments.
+*********************************************************************/
+static char *ctrl_line_title (const char *line, int *len)
+{
+	const char *end;
+
+	if (*line != '"' || !(end = strchr (line+1, '"')))
+		return NULL;
+	*len = end - line + 1;
+	return (char*)line;
+}
+
+/*********************************************************************
+  Get the current settings. If titles is not NULL, return only the
+  settings referenced by the newline separated titles. If client is
+  not NULL, return only the settings which changed since the last
+  call for client. Menu settings are not part of a diff.
+  settings: Output of opts_save(), if NULL opts_save() is called.
+*********************************************************************/
+static void ctrl_settings_get (ctrlClient *client, const char *titles, int tlen,
+							   const char *settings, ctrlSaveData *res)
+{
+	ctrlSaveData all;
+	char *line, *next, *title, *old;
+	int len;
+
+	all.out = all.outpos = NULL;
+	all.len = 0;
+	if (!settings) {
+		opts_save (cb_opts_save, &all);
+		if (!all.out) return;
+		settings = all.out;
+	}
+
+	for (line = (char*)settings; *line; line = next) {
+		if ((next = strchr (line, '\n')))
+			next++;
+		else
+			next = line + strlen(line);
+
+		if (!(title = ctrl_line_title (line, &len))) {
+			/* Comments and menu settings only for a complete get */
+			if (!client && !titles)
+				ctrl_buf_add (res, line, next-line);
+			continue;
+		}
+		if (titles) {
+			const char *t = titles, *tend;
+			BOOL found = FALSE;
+			while (t < titles+tlen && !found) {
+				tend = (const char*)memchr (t, '\n', titles+tlen-t);
+				if (!tend) tend = titles+tlen;
+				found = tend-t == len-2 && !strncmp (t, title+1, len-2);
+				t = tend+1;
+			}
+			if (!found)
+				continue;
+		}
+		if (client) {
+			char *key = g_strndup (title, len);
+			gpointer okey, oval;
+			if (g_hash_table_lookup_extended (client->values, key, &okey, &oval)) {
+				old = (char*)oval;
+				if (!strncmp (old, line, next-line) && !old[next-line]) {
+					g_free (key);
+					continue;
+				}
+				g_free (key);
+				g_free (old);
+				key = (char*)okey;
+			}
+			g_hash_table_insert (client->values, key, g_strndup (line, next-line));
+		}
+		ctrl_buf_add (res, line, next-line);
+	}
+	free (all.out);
+}
+
+/*********************************************************************
+  Send the data collected in res (including the header) as one
+  binary packet to client.
+  Return: FALSE if the packet could not be sent completely.
+*********************************************************************/
+static BOOL ctrl_bin_send (ctrlClient *client, ctrlSaveData *res)
+{
+	int cnt = res->outpos - res->out;
+
+	if (sock_send (client->fd, res->out, cnt) != cnt) {
+		iw_warning_errno ("Unable to send() reply on socket %d", client->fd);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*********************************************************************
+  Handle one binary batch packet buffer of length len from client and
+  send one reply packet containing the results of all commands.
+  Return: FALSE if the reply could not be sent.
+*********************************************************************/
+static BOOL ctrl_bin_handle (ctrlClient *client, char *buffer, int len)
+{
+	ctrlSaveData res;
+	char *pos = buffer + SOCK_BIN_HEAD_LEN, *end = buffer + len;
+	char *data, *setting;
+	uint32_t dlen;
+	int op;
+	BOOL ok;
+
+	res.out = res.outpos = NULL;
+	res.len = 0;
+	ctrl_buf_add (&res, buffer, SOCK_BIN_HEAD_LEN);
+
+	while (pos + SOCK_BIN_COM_LEN <= end) {
+		op = (unsigned char)pos[0];
+		memcpy (&dlen, pos+2, 4);
+		dlen = ntohl (dlen);
+		data = pos + SOCK_BIN_COM_LEN;
+		if (dlen > (uint32_t)(end-data)) {
+			iw_warning ("Truncated binary command %d", op);
+			break;
+		}
+		pos = data + dlen;
+
+		switch (op) {
+			case CTRL_OP_SET:
+				/* opts_load() needs a '\0' terminated string */
+				setting = g_strndup (data, dlen);
+				data = setting;
+				opts_load (cb_opts_load, &data);
+				g_free (setting);
+				ctrl_bin_add (&res, CTRL_OP_SET, CTRL_OK, NULL, 0);
+				break;
+			case CTRL_OP_GET:
+			case CTRL_OP_GET_DIFF: {
+				int start = res.outpos - res.out;
+				uint32_t rlen;
+
+				ctrl_bin_add (&res, (ctrlOp)op, CTRL_OK, NULL, 0);
+				ctrl_settings_get (op == CTRL_OP_GET_DIFF ? client : NULL,
+								   dlen > 0 ? data : NULL, dlen, NULL, &res);
+				rlen = htonl (res.outpos - res.out - start - SOCK_BIN_COM_LEN);
+				memcpy (res.out + start + 2, &rlen, 4);
+				break;
+			}
+			case CTRL_OP_SUBSCRIBE:
+				client->interval = SOCK_SUB_INTERVAL;
+				if (dlen > 0) {
+					setting = g_strndup (data, dlen);
+					client->interval = MAX (atoi (setting), 1);
+					g_free (setting);
+				}
+				client->next_check = 0;
+				ctrl_bin_add (&res, CTRL_OP_SUBSCRIBE, CTRL_OK, NULL, 0);
+				break;
+			case CTRL_OP_UNSUBSCRIBE:
+				client->interval = 0;
+				ctrl_bin_add (&res, CTRL_OP_UNSUBSCRIBE, CTRL_OK, NULL, 0);
+				break;
+			default:
+				ctrl_bin_add (&res, (ctrlOp)op, CTRL_ERR_UNKNOWN, NULL, 0);
+				break;
+		}
+	}
+	ok = ctrl_bin_send (client, &res);
+	free (res.out);
+	return ok;
+}
+
+/*********************************************************************
+  Send all settings, which changed since the last check, to client as
+  an unsolicited CTRL_OP_NOTIFY packet with request id 0.
+  settings: Output of opts_save(), shared by all notified clients.
+  Return: FALSE if the packet could not be sent.
+*********************************************************************/
+static BOOL ctrl_bin_notify (ctrlClient *client, const char *settings)
+{
+	ctrlSaveData res;
+	uint32_t rlen;
+	BOOL ok = TRUE;
+
+	res.out = res.outpos = NULL;
+	res.len = 0;
+	ctrl_buf_add (&res, SOCK_BIN_MAGIC "\0\0\0\0", SOCK_BIN_HEAD_LEN);
+	ctrl_bin_add (&res, CTRL_OP_NOTIFY, CTRL_OK, NULL, 0);
+	ctrl_settings_get (client, NULL, 0, settings, &res);
+
+	rlen = res.outpos - res.out - SOCK_BIN_HEAD_LEN - SOCK_BIN_COM_LEN;
+	if (rlen > 0) {
+		rlen = htonl (rlen);
+		memcpy (res.out + SOCK_BIN_HEAD_LEN + 2, &rlen, 4);
+		ok = ctrl_bin_send (client, &res);
+	}
+	free (res.out);
+	return ok;
+}
+
+/*********************************************************************
+  Callback for g_hash_table_foreach_remove(client->values, ...).
+*********************************************************************/
+static gboolean cb_ctrl_values_free (gpointer key, gpointer value, gpointer data)
+{
+	g_free (key);
+	g_free (value);
+	return TRUE;
+}
+
+/*********************************************************************
+  Free a client and close its connection.
+*********************************************************************/
+static void ctrl_client_free (ctrlClient *client)
+{
+	close (client->fd);
+	g_hash_table_foreach_remove (client->values, cb_ctrl_values_free, NULL);
+	g_hash_table_destroy (client->values);
+	free (client);
+}
+
 /*********************************************************************
   Continously handle all requests on socket plug->sockfd.
 *********************************************************************/
@@ -206,78 +513,140 @@ static void sock_listen (ctrlPlugin *plug)
 	socklen_t addrlen = sizeof(addr);
 	char *buffer;
 	int bufferlen;
-	int fd, newfd, cnt;
-	fd_set all_fds;		/* All open file descriptors */
+	int newfd, cnt;
 	fd_set read_fds;	/* Temp file descriptor list for select() */
 	int fdmax;			/* Max. file descriptor number */
+	ctrlClient *clients = NULL, *client, **cpos;
+	struct timeval timeout, *ptimeout;
+	long now, next;
+	ctrlSaveData settings;
+	BOOL ok;
 
 	bufferlen = 200;
 	buffer = (char*)malloc (bufferlen);
 
-	FD_ZERO (&all_fds);
-	FD_SET (plug->sockfd, &all_fds);
-	fdmax = plug->sockfd;
-
 	while (1) {
 		/* Check all open file descriptors */
-		read_fds = all_fds;
-		if (select (fdmax+1, &read_fds, NULL, NULL, NULL) == -1) {
-			iw_warning_errno ("select()");
-			continue;
+		FD_ZERO (&read_fds);
+		FD_SET (plug->sockfd, &read_fds);
+		fdmax = plug->sockfd;
+		next = -1;
+		for (client = clients; client; client = client->next) {
+			FD_SET (client->fd, &read_fds);
+			if (client->fd > fdmax)
+				fdmax = client->fd;
+			if (client->interval > 0 && (next < 0 || client->next_check < next))
+				next = client->next_check;
 		}
 
-		for (fd = 0; fd <= fdmax; fd++) {
-			if (!FD_ISSET(fd, &read_fds))
-				continue;
+		/* Wake up for the next subscription check */
+		ptimeout = NULL;
+		if (next >= 0) {
+			now = ctrl_time_ms();
+			next = next > now ? next-now : 0;
+			timeout.tv_sec = next / 1000;
+			timeout.tv_usec = (next % 1000) * 1000;
+			ptimeout = &timeout;
+		}
+		if (select (fdmax+1, &read_fds, NULL, NULL, ptimeout) == -1) {
+			if (errno != EINTR)
+				iw_warning_errno ("select()");
+			continue;
+		}
 
-			if (fd == plug->sockfd) {
-				/* Accept and add new connection */
-				if ((newfd = accept (plug->sockfd, (struct sockaddr *)&addr,
-									 &addrlen)) == -1) {
-					iw_warning_errno ("Unable to accept() request");
-					continue;
-				}
-				FD_SET (newfd, &all_fds);
-				if (newfd > fdmax)
-					fdmax = newfd;
+		if (FD_ISSET(plug->sockfd, &read_fds)) {
+			/* Accept and add new connection */
+			if ((newfd = accept (plug->sockfd, (struct sockaddr *)&addr,
+								 &addrlen)) == -1) {
+				iw_warning_errno ("Unable to accept() request");
+			} else {
+				/* Do not let a client, which does not read its
+				   replies, block all other clients */
+				timeout.tv_sec = SOCK_SEND_TIMEOUT / 1000;
+				timeout.tv_usec = (SOCK_SEND_TIMEOUT % 1000) * 1000;
+				if (setsockopt (newfd, SOL_SOCKET, SO_SNDTIMEO,
+								&timeout, sizeof(timeout)) < 0)
+					iw_warning_errno ("Unable to set SO_SNDTIMEO");
+
+				client = (ctrlClient*)calloc (1, sizeof(ctrlClient));
+				client->fd = newfd;
+				client->values = g_hash_table_new (g_str_hash, g_str_equal);
+				client->next = clients;
+				clients = client;
 				iw_debug (3, "Got connection from %s on socket %d",
 						  inet_ntoa(addr.sin_addr), newfd);
-				continue;
 			}
+		}
 
-			/* Handle data from a client */
-			buffer[0] = '\0';
-			cnt = sock_recv (fd, &buffer, &bufferlen);
-
-			if (cnt <= 0) {
-				/* Error or connection closed by client */
-				if (cnt == -1)
-					iw_warning_errno ("Unable to recv() command");
-				close (fd);
-				FD_CLR (fd, &all_fds);
-				iw_debug (4, "Closed connection on socket %d", fd);
-			} else if (!strncmp (SOCK_COM_LOAD, buffer, sizeof(SOCK_COM_LOAD)-1)) {
-				char *str = buffer+sizeof(SOCK_COM_LOAD)-1;
-				opts_load (cb_opts_load, &str);
-			} else if (!strncmp (SOCK_COM_SAVE, buffer, sizeof(SOCK_COM_SAVE)-1)) {
-				ctrlSaveData dat;
-				dat.out = dat.outpos = NULL;
-				dat.len = 0;
-				opts_save (cb_opts_save, &dat);
-				cnt = strlen (dat.out) + 1;
-				if (sock_send (fd, dat.out, cnt) != cnt)
-					iw_warning_errno ("Unable to send() settings");
-				free (dat.out);
-			} else {
-				if (bufferlen > 20) {
-					buffer[17] = '.';
-					buffer[18] = '.';
-					buffer[19] = '.';
-					buffer[20] = '\0';
+		/* The settings are saved at most once per iteration and
+		   shared by all subscribed clients */
+		settings.out = settings.outpos = NULL;
+		settings.len = 0;
+
+		now = ctrl_time_ms();
+		cpos = &clients;
+		while ((client = *cpos)) {
+			ok = TRUE;
+			if (FD_ISSET(client->fd, &read_fds)) {
+				/* Handle data from a client */
+				buffer[0] = '\0';
+				cnt = sock_recv (client->fd, &buffer, &bufferlen);
+
+				if (cnt <= 0) {
+					/* Error or connection closed by client */
+					if (cnt == -1)
+						iw_warning_errno ("Unable to recv() command");
+					ok = FALSE;
+				} else if (cnt >= SOCK_BIN_HEAD_LEN &&
+						   !memcmp (buffer, SOCK_BIN_MAGIC, SOCK_BIN_MAGIC_LEN)) {
+					ok = ctrl_bin_handle (client, buffer, cnt);
+				} else if (!strncmp (SOCK_COM_LOAD, buffer, sizeof(SOCK_COM_LOAD)-1)) {
+					char *str = buffer+sizeof(SOCK_COM_LOAD)-1;
+					opts_load (cb_opts_load, &str);
+				} else if (!strncmp (SOCK_COM_SAVE, buffer, sizeof(SOCK_COM_SAVE)-1)) {
+					ctrlSaveData dat;
+					dat.out = dat.outpos = NULL;
+					dat.len = 0;
+					opts_save (cb_opts_save, &dat);
+					cnt = strlen (dat.out) + 1;
+					if (sock_send (client->fd, dat.out, cnt) != cnt) {
+						iw_warning_errno ("Unable to send() settings");
+						ok = FALSE;
+					}
+					free (dat.out);
+				} else {
+					if (bufferlen > 20) {
+						buffer[17] = '.';
+						buffer[18] = '.';
+						buffer[19] = '.';
+						buffer[20] = '\0';
+					}
+					iw_warning ("Received unknown command '%s'", buffer);
 				}
-				iw_warning ("Received unknown command '%s'", buffer);
 			}
-		} /* for */
+
+			/* Subscription check, independent of any received data */
+			if (ok && client->interval > 0 && client->next_check <= now) {
+				if (!settings.out) {
+					opts_save (cb_opts_save, &settings);
+					if (!settings.out)
+						cb_opts_save (&settings, (char*)"");
+				}
+				ok = ctrl_bin_notify (client, settings.out);
+				client->next_check = now + client->interval;
+			}
+
+			if (!ok) {
+				/* Closed, failed, or stalled for SOCK_SEND_TIMEOUT ms */
+				iw_debug (4, "Closed connection on socket %d", client->fd);
+				*cpos = client->next;
+				ctrl_client_free (client);
+				continue;
+			}
+			cpos = &client->next;
+		}
+		if (settings.out)
+			free (settings.out);
 	} /* while (1) */
 }
 
@@ -290,7 +659,8 @@ static void help (ctrlPlugin *plug)
 			 "Provide the XCF/INET socket function control(char) to control the\n"
 			 "GUI via XCF/INET sockets and the function getSettings(void) to get\n"
 			 "the current widget settings. Can be used with 'icewing-control' to\n"
-			 "remote control iceWing.\n"
+			 "remote control iceWing. Via INET sockets additionally batched binary\n"
+			 "commands, settings diffs, and subscriptions to changes are supported.\n"
 			 "\n"
 			 "Usage of the %s plugin:\n"
 			 "     [-p [port]]"
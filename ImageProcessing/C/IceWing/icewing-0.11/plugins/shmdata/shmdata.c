@@ -27,15 +27,20 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <sys/shm.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/socket.h>
-#include <sys/un.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include "tools/tools.h"
 #include "gui/Ggui.h"
@@ -43,6 +48,12 @@
 #include "gui/Grender.h"
 #include "main/plugin.h"
 
+#define SHM_RING_MAGIC	0x49575348	/* "IWSH" */
+#define SHM_CLIENTS_MAX	32			/* One bit per client in shmData.state */
+#define SHM_HEAD_SIZE	64			/* Size of shmData, data starts after it */
+#define SHM_WAIT_MS		200			/* Timeout for checking for dead processes */
+#define SHM_RING_SIZE	4096		/* Size of shmRing, the slots start after it */
+
 typedef enum {
 	SHM_NONE,
 	SHM_GRABIMG,
@@ -50,20 +61,75 @@ typedef enum {
 	SHM_STRING
 } shmType;
 
+typedef enum {
+	SHM_LOSSLESS,			/* Receive everything, the sender waits */
+	SHM_LATEST,				/* Receive only the newest data */
+	SHM_QUEUE				/* Receive the oldest of the last depth items */
+} shmPolicy;
+
+/* Header of one slot of the ring, the data follows at SHM_HEAD_SIZE */
 typedef struct shmData {
 	shmType type;
-	int shm_id;				/* Return value of shmget() */
-	int ref_cnt;
+	volatile gint32 seq;	/* Sequence number of the data, 0: slot is empty */
+	volatile guint64 state;	/* One bit per client, low 32 bits: data not yet
+							   received, high 32 bits: data in use */
 } shmData;
 
+#define SHM_PENDING(state)	((guint32)(state))
+#define SHM_BUSY(state)		((guint32)((state) >> 32))
+
+/* Registration and statistics of one receiver */
+typedef struct shmClient {
+	volatile gint32 pid;	/* Process id of the receiver, 0: entry is free */
+	volatile gint32 active;	/* Registration finished, the sender can use it */
+	gint32 policy;			/* shmPolicy of the receiver */
+	gint32 depth;			/* Max number of pending items for SHM_QUEUE */
+	volatile gint32 evicted;	/* Lossless receiver held up the sender and
+							   gets only the newest data until it caught up */
+	volatile gint32 cursor;	/* Sequence number of the last received data */
+	volatile gint32 received;	/* Number of received data elements */
+	volatile gint32 dropped;	/* Number of skipped data elements */
+	volatile gint32 evictions;	/* How often the receiver was evicted */
+} shmClient;
+
+/* Header of the shared ring, slot_cnt slots of slot_size bytes follow
+   at SHM_RING_SIZE. The ring is created by the sender on the first
+   data, the receivers register themselves in clients[]. */
+typedef struct shmRing {
+	guint32 magic;
+	gint32 pid;				/* Process id of the sender */
+	volatile gint32 closed;	/* Sender has removed the ring */
+	gint32 slot_cnt;		/* Number of slots */
+	gsize slot_size;		/* Size of one slot including shmData */
+	volatile gint32 seq;	/* Futex: Sequence number of the last data */
+	volatile gint32 release;/* Futex: Incremented if a client released a slot */
+	shmClient clients[SHM_CLIENTS_MAX];
+} shmRing;
+
+#define SHM_SLOT(ring,i)	((shmData*)((char*)(ring) + SHM_RING_SIZE + (ring)->slot_size*(i)))
+#define SHM_SLOT_DATA(slot)	((char*)(slot) + SHM_HEAD_SIZE)
+
+/* A ring mapped by a receiver, stays mapped as long as data is in use */
+typedef struct shmMap {
+	shmRing *ring;
+	size_t size;			/* Size of the mapping */
+	int client;				/* Index of the receiver in ring->clients[] */
+	int users;				/* Number of data elements in use from the map */
+	BOOL stale;				/* A newer ring is used, unmap if users == 0 */
+	struct shmMap *next;
+} shmMap;
+
 /* Command line arguments */
 typedef struct shmParameter {
-	char *socket;			/* Name of the server communication socket */
+	char *channel;			/* Name of the shared memory ring */
 	char *input_id;			/* Identifier to observe */
 	shmType type;			/* Type of input_id */
-	int shm_cnt;			/* Max. number of shm segments before blocking */
+	int shm_cnt;			/* Number of ring slots */
+	int evict_ms;			/* Evict lossless receivers blocking longer, 0: never */
 	char *output_id;		/* Identifier for providing the data */
-	BOOL block;				/* Blocking / non blocking reading on the socket */
+	BOOL block;				/* Blocking / non blocking reading from the ring */
+	shmPolicy policy;		/* How the receiver gets the data */
+	int depth;				/* Queue length for SHM_QUEUE */
 } shmParameter;
 
 /* All parameter of one plugin instance */
@@ -71,56 +137,60 @@ typedef struct shmPlugin {
 	plugDefinition def;		/* iceWing base class, a plugin */
 	shmParameter para;		/* Command line arguments */
 
-	int socket_fd;			/* Communication socket */
-
 	/* Sender */
-	struct sockaddr_un *clients; /* Array of all registered clients */
-	int clients_cnt;		/* Number of entries in clients array */
-	int clients_len;		/* Length of clients array */
-	shmData **shm_adr;		/* Array of shared memory segments */
+	shmRing *ring;			/* The ring, NULL until the first data */
+	size_t ring_size;		/* Size of the mapping */
+	long blocked;			/* ms the sender waited for the previous data */
 
 	/* Receiver */
-	int pipe[2];			/* Signal the processing thread to not block on clean up */
+	shmMap *map;			/* Currently used ring */
+	BOOL evicted;			/* Eviction was noticed */
+	volatile BOOL quit;		/* Stop waiting, the plugin is cleaned up */
 	int time_wait;			/* Length of the usleep() between grabbing of images */
 	BOOL contiune;			/* If time_wait < 0 -> Receive next image ? */
-
-	BOOL do_reg;			/* Register with the Sender? */
-	char *socket;			/* Receivers socket name */
 	prevBuffer *b_image;
 } shmPlugin;
 
+/* All rings mapped by receivers of this process */
+static shmMap *shm_maps = NULL;
+static pthread_mutex_t shm_maps_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef __linux__
 /*********************************************************************
-  Read from plug->socket_fd, but allow canceling by writing to
-  plug->pipe[1].
+  Wait at most ms milliseconds while *addr == val.
 *********************************************************************/
-static ssize_t shm_recvfrom (shmPlugin *plug, void *buf, size_t len, int flags,
-							 struct sockaddr *addr, socklen_t *addrlen)
+static void shm_futex_wait (volatile gint32 *addr, gint32 val, int ms)
 {
-	ssize_t cnt = -1;
-	fd_set rfds;
-	struct timeval tv = {0, 0}, *p_tv = &tv;
-	int maxfd = plug->socket_fd;
+	struct timespec ts;
 
-	FD_ZERO (&rfds);
-	FD_SET (plug->socket_fd, &rfds);
-	if (plug->pipe[0] >= 0) {
-		FD_SET (plug->pipe[0], &rfds);
-		if (plug->pipe[0] > plug->socket_fd) maxfd = plug->pipe[0];
-	}
-	if (plug->para.block)
-		p_tv = NULL;
-
-	if (select(maxfd+1, &rfds, NULL, NULL, p_tv) > 0) {
-		if (FD_ISSET(plug->socket_fd, &rfds)) {
-			do {
-				cnt = recvfrom (plug->socket_fd, buf, len, flags, addr, addrlen);
-			} while (cnt == -1 && errno == EINTR);
-		} else if (FD_ISSET(plug->pipe[0], &rfds)) {
-			char ch;
-			read (plug->pipe[0], &ch, 1);
-		}
-	}
-	return cnt;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	syscall (SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+/*********************************************************************
+  Wake all processes waiting on addr.
+*********************************************************************/
+static void shm_futex_wake (volatile gint32 *addr)
+{
+	syscall (SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#else
+/* Without futexes the waiting side polls */
+static void shm_futex_wait (volatile gint32 *addr, gint32 val, int ms)
+{
+	if (*addr == val)
+		iw_usleep (1000);
+}
+static void shm_futex_wake (volatile gint32 *addr) {}
+#endif
+
+/*********************************************************************
+  Return TRUE if process pid does not exist any more.
+*********************************************************************/
+static BOOL shm_pid_dead (gint32 pid)
+{
+	return kill (pid, 0) < 0 && errno == ESRCH;
 }
 
 /*********************************************************************
@@ -141,43 +211,299 @@ static void cb_shm_main (plugDefinition *plug_d)
 }
 
 /*********************************************************************
-  Free the resources allocated during shm_xxx().
+  Sender: Remove the ring, receivers still using it keep their mapping.
 *********************************************************************/
-static void shm_cleanup (plugDefinition *plug_d)
+static void shm_ring_remove (shmPlugin *plug)
 {
-	shmPlugin *plug = (shmPlugin *)plug_d;
+	if (!plug->ring) return;
+
+	plug->ring->closed = TRUE;
+	shm_futex_wake (&plug->ring->seq);
+	shm_unlink (plug->para.channel);
+	pthread_mutex_lock (&shm_maps_mutex);
+	munmap (plug->ring, plug->ring_size);
+	plug->ring = NULL;
+	pthread_mutex_unlock (&shm_maps_mutex);
+}
+
+/*********************************************************************
+  Sender: (Re)create the ring with slots for at least size bytes.
+*********************************************************************/
+static void shm_ring_create (shmPlugin *plug, size_t size)
+{
+	shmRing *ring;
+	size_t slot_size;
+	int fd;
+
+	shm_ring_remove (plug);
+
+	/* Some headroom, so that small size changes need no new ring */
+	slot_size = SHM_HEAD_SIZE + size + size/8;
+	slot_size = (slot_size + SHM_RING_SIZE-1) & ~(size_t)(SHM_RING_SIZE-1);
+	plug->ring_size = SHM_RING_SIZE + slot_size*plug->para.shm_cnt;
+
+	shm_unlink (plug->para.channel);
+	fd = shm_open (plug->para.channel, O_RDWR | O_CREAT | O_EXCL, 0666);
+	if (fd < 0)
+		iw_error ("Unable to create shared memory '%s',\n"
+				  "\terror: '%s'", plug->para.channel, strerror(errno));
+	if (fchmod (fd, 0666) < 0 || ftruncate (fd, plug->ring_size) < 0)
+		iw_error ("Unable to get %ld bytes shared memory '%s',\n"
+				  "\terror: '%s'", (long)plug->ring_size, plug->para.channel,
+				  strerror(errno));
+	ring = mmap (NULL, plug->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (ring == MAP_FAILED)
+		iw_error ("Unable to map shared memory '%s',\n"
+				  "\terror: '%s'", plug->para.channel, strerror(errno));
+
+	/* The memory is zeroed, receivers accept it after the magic is set */
+	ring->pid = getpid();
+	ring->slot_cnt = plug->para.shm_cnt;
+	ring->slot_size = slot_size;
+	__sync_synchronize();
+	ring->magic = SHM_RING_MAGIC;
+
+	plug->ring = ring;
+	iw_debug (2, "Created ring '%s' with %d slots of %ld bytes",
+			  plug->para.channel, ring->slot_cnt, (long)slot_size);
+}
+
+/*********************************************************************
+  Clear the bits of all clients in mask from the pending and (if busy)
+  the in use part of the state of all slots of ring.
+*********************************************************************/
+static void shm_ring_clear_bits (shmRing *ring, guint32 mask, BOOL busy)
+{
+	guint64 clear = busy ? (mask | ((guint64)mask << 32)) : mask;
 	int i;
 
-	/* Prevent any new messages */
-	if (plug->para.input_id && plug->para.socket)
-		unlink (plug->para.socket);
-	if (plug->para.output_id && plug->socket)
-		unlink (plug->socket);
-
-	/* Remove any remaining messages */
-	if (plug->para.output_id) {
-		shmData *shm_adr;
-		int shm_id, cnt;
-		plug->para.block = FALSE;
-		write (plug->pipe[1], "A", 1);
-		do {
-			cnt = shm_recvfrom (plug, &shm_id, sizeof(shm_id), 0, NULL, NULL);
-			if (cnt == sizeof(shm_id)) {
-				shm_adr = shmat (shm_id, 0, 0);
-				if (shm_adr != (shmData*)-1) {
-					shm_adr->ref_cnt--;
-					shmdt (shm_adr);
-				}
-			}
-		} while (cnt == sizeof(shm_id));
+	for (i=0; i<ring->slot_cnt; i++)
+		__sync_fetch_and_and (&SHM_SLOT(ring,i)->state, ~clear);
+}
+
+/*********************************************************************
+  Sender: Unregister all receivers which do not exist any more and
+  release their slots.
+*********************************************************************/
+static void shm_ring_check_clients (shmRing *ring)
+{
+	shmClient *c;
+	gint32 pid;
+	int i;
+
+	for (i=0; i<SHM_CLIENTS_MAX; i++) {
+		c = &ring->clients[i];
+		pid = c->pid;
+		if (pid && shm_pid_dead (pid)) {
+			iw_debug (2, "Receiver %d died, unregistering...", pid);
+			c->active = FALSE;
+			shm_ring_clear_bits (ring, 1U << i, TRUE);
+			__sync_bool_compare_and_swap (&c->pid, pid, 0);
+		}
+	}
+}
+
+/*********************************************************************
+  Receiver: Open the ring of the sender and register in it.
+  Return: FALSE if the ring is not (yet) available.
+*********************************************************************/
+static BOOL shm_ring_open (shmPlugin *plug)
+{
+	shmRing *ring;
+	shmClient *c;
+	shmMap *map;
+	struct stat st;
+	gint32 pid = getpid();
+	int fd, i;
+
+	fd = shm_open (plug->para.channel, O_RDWR, 0);
+	if (fd < 0)
+		return FALSE;
+	if (fstat (fd, &st) < 0 || st.st_size < SHM_RING_SIZE) {
+		close (fd);
+		return FALSE;
+	}
+	ring = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (ring == MAP_FAILED)
+		return FALSE;
+
+	if (ring->magic != SHM_RING_MAGIC || ring->closed ||
+		(size_t)st.st_size < SHM_RING_SIZE + ring->slot_size*ring->slot_cnt) {
+		munmap (ring, st.st_size);
+		return FALSE;
 	}
-	if (plug->pipe[0] >= 0) close (plug->pipe[0]);
-	if (plug->pipe[1] >= 0) close (plug->pipe[1]);
 
-	if (plug->shm_adr) {
-		for (i=0; i < plug->para.shm_cnt; i++)
-			if (plug->shm_adr[i])
-				shmdt (plug->shm_adr[i]);
+	for (i=0; i<SHM_CLIENTS_MAX; i++)
+		if (__sync_bool_compare_and_swap (&ring->clients[i].pid, 0, pid))
+			break;
+	if (i == SHM_CLIENTS_MAX) {
+		iw_warning ("More than %d receivers for '%s'",
+					SHM_CLIENTS_MAX, plug->para.channel);
+		munmap (ring, st.st_size);
+		return FALSE;
+	}
+
+	/* Entry is claimed, fill it and afterwards make it visible */
+	c = &ring->clients[i];
+	c->policy = plug->para.policy;
+	c->depth = plug->para.policy == SHM_LATEST ? 1 : plug->para.depth;
+	c->evicted = FALSE;
+	c->cursor = ring->seq;
+	c->received = 0;
+	c->dropped = 0;
+	c->evictions = 0;
+	__sync_synchronize();
+	c->active = TRUE;
+
+	map = calloc (1, sizeof(shmMap));
+	map->ring = ring;
+	map->size = st.st_size;
+	map->client = i;
+
+	pthread_mutex_lock (&shm_maps_mutex);
+	map->next = shm_maps;
+	shm_maps = map;
+	pthread_mutex_unlock (&shm_maps_mutex);
+
+	plug->map = map;
+	iw_debug (2, "Registered as receiver %d for '%s'", i, plug->para.channel);
+
+	return TRUE;
+}
+
+/*********************************************************************
+  Receiver: Unregister from the ring of map and release all its slots.
+*********************************************************************/
+static void shm_ring_unregister (shmMap *map)
+{
+	shmRing *ring = map->ring;
+
+	pthread_mutex_lock (&shm_maps_mutex);
+	if (!map->stale) {
+		map->stale = TRUE;
+		ring->clients[map->client].active = FALSE;
+		shm_ring_clear_bits (ring, 1U << map->client, TRUE);
+		__sync_bool_compare_and_swap (&ring->clients[map->client].pid, getpid(), 0);
+		__sync_add_and_fetch (&ring->release, 1);
+		shm_futex_wake (&ring->release);
+	}
+	pthread_mutex_unlock (&shm_maps_mutex);
+}
+
+/*********************************************************************
+  Receiver: Unmap the ring of map if none of its data is in use.
+  shm_maps_mutex must be locked.
+*********************************************************************/
+static void shm_ring_free (shmMap *map)
+{
+	shmMap **m;
+
+	if (map->users > 0) return;
+
+	for (m = &shm_maps; *m; m = &(*m)->next) {
+		if (*m == map) {
+			*m = map->next;
+			break;
+		}
+	}
+	munmap (map->ring, map->size);
+	free (map);
+}
+
+/*********************************************************************
+  Receiver: Release the data in slot, which was received from a ring
+  of this process.
+*********************************************************************/
+static void shm_ring_release (shmData *slot)
+{
+	shmMap *map;
+
+	pthread_mutex_lock (&shm_maps_mutex);
+	for (map = shm_maps; map; map = map->next)
+		if ((char*)slot > (char*)map->ring && (char*)slot < (char*)map->ring + map->size)
+			break;
+	if (map) {
+		if (!map->stale) {
+			__sync_fetch_and_and (&slot->state, ~((guint64)1 << (map->client+32)));
+			__sync_add_and_fetch (&map->ring->release, 1);
+			shm_futex_wake (&map->ring->release);
+		}
+		map->users--;
+		if (map->stale)
+			shm_ring_free (map);
+	}
+	pthread_mutex_unlock (&shm_maps_mutex);
+}
+
+/*********************************************************************
+  Print the statistics of all receivers of ring.
+*********************************************************************/
+static void shm_ring_stats (shmRing *ring, const char *channel)
+{
+	static char *policies[] = {"lossless", "latest", "queue"};
+	shmClient *c;
+	int i;
+
+	fprintf (stderr, "\nReceivers of '%s', last data %d:\n"
+			 "%8s %-10s %9s %6s %9s %8s\n", channel, ring->seq,
+			 "pid", "policy", "received", "lag", "dropped", "evicted");
+	for (i=0; i<SHM_CLIENTS_MAX; i++) {
+		c = &ring->clients[i];
+		if (!c->pid || !c->active)
+			continue;
+		if (c->policy == SHM_QUEUE) {
+			char policy[20];
+			sprintf (policy, "queue(%d)", c->depth);
+			fprintf (stderr, "%8d %-10s", c->pid, policy);
+		} else
+			fprintf (stderr, "%8d %-10s", c->pid, policies[c->policy]);
+		fprintf (stderr, " %9d %6d %9d %8d%s\n", c->received,
+				 ring->seq - c->cursor, c->dropped, c->evictions,
+				 c->evicted ? " (evicted)" : "");
+	}
+}
+
+/*********************************************************************
+  Button callback: Print the statistics of all receivers.
+*********************************************************************/
+static void cb_shm_stats (GtkWidget *widget, int number, void *data)
+{
+	shmPlugin *plug = (shmPlugin *)data;
+
+	pthread_mutex_lock (&shm_maps_mutex);
+	if (plug->ring)
+		shm_ring_stats (plug->ring, plug->para.channel);
+	else if (plug->map)
+		shm_ring_stats (plug->map->ring, plug->para.channel);
+	else
+		fprintf (stderr, "\n'%s' is not yet connected\n", plug->para.channel);
+	pthread_mutex_unlock (&shm_maps_mutex);
+}
+
+/*********************************************************************
+  Free the resources allocated during shm_xxx().
+*********************************************************************/
+static void shm_cleanup (plugDefinition *plug_d)
+{
+	shmPlugin *plug = (shmPlugin *)plug_d;
+
+	if (plug->para.input_id) {
+		/* The processing thread may still use the mapping,
+		   so only remove the ring for the receivers */
+		if (plug->ring) {
+			plug->ring->closed = TRUE;
+			shm_futex_wake (&plug->ring->seq);
+			shm_unlink (plug->para.channel);
+		}
+	} else {
+		/* Stop waiting and release all not yet received data */
+		plug->quit = TRUE;
+		if (plug->map) {
+			shm_ring_unregister (plug->map);
+			shm_futex_wake (&plug->map->ring->seq);
+		}
 	}
 }
 
@@ -189,24 +515,34 @@ static void help (shmPlugin *plug, char *err, ...)
 	va_list args;
 
 	fprintf (stderr,"\n%s plugin for %s, (c) 2006-2009 by Frank Loemker\n"
-			 "Distribute data via shared memory and local sockets to other\n"
-			 "local processes (1 to n communication).\n"
+			 "Distribute data via a shared memory ring to other local\n"
+			 "processes (1 to n communication).\n"
 			 "\n"
 			 "Usage of the %s plugin:\n"
-			 "     <-p socket> [-g ident | -i ident | -s ident] [-n num] [-o ident] [-b]\n"
-			 "-p       name of socket for the communication channel,\n"
-			 "         will be prefixed with '/tmp/'\n"
+			 "     <-p channel> [-g ident | -i ident | -s ident] [-n num] [-e ms]\n"
+			 "     [-o ident] [-m lossless|latest|queue] [-q num] [-b]\n"
+			 "-p       name of the communication channel, the shared memory\n"
+			 "         object '/icewing-shmdata-<channel>' is used\n"
 			 "-g       identifier to observe, must be of type grabImageData\n"
 			 "-i       identifier to observe, must be of type iwImage\n"
 			 "-s       identifier to observe, must be of type char[]\n"
-			 "-n       max number of distributed items before the sender blocks,\n"
-			 "         default: %d\n"
+			 "-n       number of ring slots, i.e. max number of distributed items\n"
+			 "         before the sender blocks, default: %d\n"
+			 "-e       evict lossless receivers which held up the sender for\n"
+			 "         consecutive data longer than ms milliseconds, they get\n"
+			 "         only the newest data until they have caught up,\n"
+			 "         default: 0 (never)\n"
 			 "-o       identifier for providing the received data\n"
-			 "-b       do not block while reading from the socket\n"
+			 "-m       receive mode, lossless: get all data, the sender waits,\n"
+			 "         latest: get only the newest data, queue: get the oldest\n"
+			 "         of the last num (see -q) data items, default: lossless\n"
+			 "-q       queue length for '-m queue', default: %d\n"
+			 "-b       do not block while reading from the ring\n"
 			 "\n"
 			 "Observed identifier (-g, -i, -s) can contain dependencies,\n"
 			 "e.g. \"ident()\" or \"ident(plug1 plug2 ...)\".\n",
-			 plug->def.name, ICEWING_NAME, plug->def.name, plug->para.shm_cnt);
+			 plug->def.name, ICEWING_NAME, plug->def.name, plug->para.shm_cnt,
+			 plug->para.depth);
 	if (err) {
 		fprintf (stderr, "\n");
 		va_start (args, err);
@@ -228,32 +564,28 @@ static void shm_init (plugDefinition *plug_d, grabParameter *para, int argc, cha
 	void *arg;
 	char ch;
 	int nr = 0;
-	struct sockaddr_un addr;
-	char *sockname;
-
-	plug->do_reg = TRUE;
-	plug->pipe[0] = plug->pipe[1] = -1;
 
-	plug->para.socket = NULL;
+	plug->para.channel = NULL;
 	plug->para.input_id = NULL;
 	plug->para.shm_cnt = 2;
+	plug->para.evict_ms = 0;
 	plug->para.output_id = NULL;
 	plug->para.block = TRUE;
+	plug->para.policy = SHM_LOSSLESS;
+	plug->para.depth = 4;
 	plug->para.type = SHM_NONE;
 
 	while (nr < argc) {
 		ch = iw_parse_args (argc, argv, &nr, &arg,
-							"-P:Pr -G:Gr -I:Ir -S:Sr -N:Ni -O:Or -B:B -H:H");
+							"-P:Pr -G:Gr -I:Ir -S:Sr -N:Ni -E:Ei -O:Or -M:Mr -Q:Qi -B:B -H:H");
 		switch (ch) {
 			case 'P':
-				if (!plug->para.socket && arg) {
-					char *s = (char*)arg;
-					plug->para.socket = malloc (6+strlen(s));
-					if (*s == '/')
-						strcpy (plug->para.socket, "/tmp");
-					else
-						strcpy (plug->para.socket, "/tmp/");
-					strcat (plug->para.socket, s);
+				if (!plug->para.channel && arg) {
+					char *s;
+					/* POSIX shared memory names contain only one '/' */
+					plug->para.channel = g_strconcat ("/icewing-shmdata-", (char*)arg, NULL);
+					for (s = plug->para.channel+1; *s; s++)
+						if (*s == '/') *s = '_';
 				}
 				break;
 			case 'G':
@@ -279,9 +611,29 @@ static void shm_init (plugDefinition *plug_d, grabParameter *para, int argc, cha
 				if (plug->para.shm_cnt < 1 || plug->para.shm_cnt > 1000)
 					help (plug, "Argument to -n must be between 1 and 1000!");
 				break;
+			case 'E':
+				plug->para.evict_ms = (int)(long)arg;
+				if (plug->para.evict_ms < 0)
+					help (plug, "Argument to -e must be >= 0!");
+				break;
 			case 'O':
 				plug->para.output_id = (char*)arg;
 				break;
+			case 'M':
+				if (!g_strcasecmp ((char*)arg, "lossless"))
+					plug->para.policy = SHM_LOSSLESS;
+				else if (!g_strcasecmp ((char*)arg, "latest"))
+					plug->para.policy = SHM_LATEST;
+				else if (!g_strcasecmp ((char*)arg, "queue"))
+					plug->para.policy = SHM_QUEUE;
+				else
+					help (plug, "Unknown receive mode '%s'!", (char*)arg);
+				break;
+			case 'Q':
+				plug->para.depth = (int)(long)arg;
+				if (plug->para.depth < 1)
+					help (plug, "Argument to -q must be >= 1!");
+				break;
 			case 'B':
 				plug->para.block = FALSE;
 				break;
@@ -296,39 +648,10 @@ static void shm_init (plugDefinition *plug_d, grabParameter *para, int argc, cha
 	if ((plug->para.input_id && plug->para.output_id) ||
 		(!plug->para.input_id && !plug->para.output_id))
 		help (plug, "Exactly one of '-g|-i|-s' and '-o' must be specified!");
-	if (!plug->para.socket)
+	if (!plug->para.channel)
 		help (plug, "-p must be specified!");
 
-	if (plug->para.output_id) {
-		plug->socket = malloc (strlen(plug->para.socket) + 11);
-		sprintf (plug->socket, "%s.%d", plug->para.socket, getpid());
-		sockname = plug->socket;
-
-		if (pipe (plug->pipe) < 0)
-			iw_error ("Cannot create clean up pipe: %s", g_strerror(errno));
-	} else {
-		sockname = plug->para.socket;
-		plug->para.block = FALSE;
-	}
-
-	unlink (sockname);
-	if ((plug->socket_fd = socket (AF_UNIX, SOCK_DGRAM, 0)) < 0)
-		iw_error ("Unable to create local socket '%s',\n"
-				  "\terror: '%s'", sockname, strerror(errno));
-
-	memset (&addr, 0, sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	strcpy (addr.sun_path, sockname);
-	if (bind (plug->socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
-		iw_error ("Unable to bind local socket '%s',\n"
-				  "\terror: '%s'", sockname, strerror(errno));
-
-	if (chmod (sockname, 0777) < 0)
-		iw_error ("Unable to set permissions on local socket '%s',\n"
-				  "\terror: '%s'", sockname, strerror(errno));
-
 	if (plug->para.input_id) {
-		plug->shm_adr = calloc (plug->para.shm_cnt, sizeof(shmData*));
 		plug_observ_data (plug_d, plug->para.input_id);
 	} else {
 		plug_observ_data (plug_d, "start");
@@ -348,11 +671,14 @@ static int shm_init_options (plugDefinition *plug_d)
 	plug->time_wait = 0;
 	plug->contiune = FALSE;
 
-	if (!plug->para.output_id)
-		return -1;
-
 	p = opts_page_append (plug->def.name);
 
+	opts_buttoncb_create (p, "Receiver statistics",
+						  "Show received, lagging, and dropped data of all receivers",
+						  cb_shm_stats, plug);
+	if (!plug->para.output_id)
+		return p;
+
 	opts_entscale_create (p, "Wait Time",
 						  "Time in ms to wait between data receives  "
 						  "-1: wait until the button is pressed",
@@ -368,46 +694,15 @@ static int shm_init_options (plugDefinition *plug_d)
 }
 
 /*********************************************************************
-  Allocate size+sizeof(shmData) bytes of shared memory,
-  init a shmData-struct at the start of the memory,
-  and return a pointer to the memory.
-*********************************************************************/
-static shmData* shm_get_mem (int size)
-{
-	shmData *ret = NULL;
-	int shm_id;
-
-	size += sizeof(shmData);
-	shm_id= shmget (IPC_PRIVATE, size, IPC_CREAT | 0777);
-	if (shm_id == -1) {
-		iw_error ("Unable to get %d bytes shared memory", size);
-	} else {
-		ret = shmat (shm_id, NULL, 0);
-		shmctl (shm_id, IPC_RMID, NULL);
-		if (ret == (shmData*)-1)
-			iw_error ("Unable to attach to shared memory segment");
-		ret->shm_id = shm_id;
-		ret->ref_cnt = 0;
-	}
-	return ret;
-}
-
-/*********************************************************************
-  Get shared memory for a grabImageData (grabimg==TRUE) or iwImage
-  and return a copy of the image gimg / gimg->img.
+  Return the size in bytes needed to store a grabImageData
+  (grabimg==TRUE) or iwImage gimg / gimg->img in a ring slot.
 *********************************************************************/
-static shmData* shm_img_duplicate (const grabImageData *gimg, BOOL grabimg)
+static size_t shm_img_size (const grabImageData *gimg, BOOL grabimg)
 {
 	const iwImage *img = &gimg->img;
-	int w = img->width, h = img->height;
 	int planes = img->planes;
-	int size;
-	void *pos;
-	shmData *ret = NULL;
-	grabImageData *rgimg = NULL;
-	iwImage *rimg;
+	size_t size;
 
-	/* Get necessary size in bytes of the shared memory area */
 	if (planes < 3) planes = 3;
 	size = planes*sizeof(uchar*);
 	if (grabimg) {
@@ -417,42 +712,56 @@ static shmData* shm_img_duplicate (const grabImageData *gimg, BOOL grabimg)
 	} else
 		size += sizeof(iwImage);
 	if (img->rowstride)
-		size += img->rowstride*h;
+		size += img->rowstride*img->height;
 	else
-		size += img->planes*w*h*IW_TYPE_SIZE(img);
+		size += img->planes*img->width*img->height*IW_TYPE_SIZE(img);
 	if (img->ctab > IW_COLFORMAT_MAX && img->ctab != IW_INDEX)
 		size += sizeof(img->ctab[0])*IW_CTAB_SIZE;
+	return size;
+}
 
-	/* Get memory and copy image */
-	ret = shm_get_mem (size);
-	pos = (void*)ret + sizeof(shmData);
+/*********************************************************************
+  Copy the grabImageData (grabimg==TRUE) or iwImage gimg / gimg->img
+  to the ring slot slot. All pointers are stored relative to the
+  start of the data.
+*********************************************************************/
+static void shm_img_copy (shmData *slot, const grabImageData *gimg, BOOL grabimg)
+{
+	const iwImage *img = &gimg->img;
+	int h = img->height;
+	int planes = img->planes;
+	char *pos = SHM_SLOT_DATA(slot);
+	grabImageData *rgimg = NULL;
+	iwImage *rimg;
+
+	if (planes < 3) planes = 3;
 
 	if (grabimg) {
-		ret->type = SHM_GRABIMG;
-		rgimg = pos;
+		slot->type = SHM_GRABIMG;
+		rgimg = (grabImageData*)pos;
 		pos += sizeof(grabImageData);
 		*rgimg = *gimg;
 	} else {
-		ret->type = SHM_IWIMG;
-		rgimg = pos;
+		slot->type = SHM_IWIMG;
+		rgimg = (grabImageData*)pos;
 		pos += sizeof(iwImage);
 		rgimg->img = gimg->img;
 	}
 	rimg = &rgimg->img;
 
-	rimg->data = pos;
+	rimg->data = (uchar**)pos;
 	pos += planes * sizeof(uchar*);
 
 	if (img->rowstride) {
-		rimg->data[0] = pos;
+		rimg->data[0] = (uchar*)pos;
 		pos += img->rowstride * h;
 		memcpy (rimg->data[0], img->data[0], img->rowstride * h);
 		rimg->data[0] = (uchar*)rimg->data[0]- (long)rgimg;
 	} else {
-		int i, count = w*h*IW_TYPE_SIZE(img);
+		int i, count = img->width*h*IW_TYPE_SIZE(img);
 
 		for (i=0; i<img->planes; i++) {
-			rimg->data[i] = pos;
+			rimg->data[i] = (uchar*)pos;
 			pos += count;
 			memcpy (rimg->data[i], img->data[i], count);
 			rimg->data[i] = (uchar*)rimg->data[i] - (long)rgimg;
@@ -463,7 +772,7 @@ static shmData* shm_img_duplicate (const grabImageData *gimg, BOOL grabimg)
 	if (img->ctab == IW_INDEX) {
 		rimg->ctab = (iwColtab)-1;
 	} else if (img->ctab > IW_COLFORMAT_MAX) {
-		rimg->ctab = pos;
+		rimg->ctab = (iwColtab)pos;
 		pos += sizeof(img->ctab[0])*IW_CTAB_SIZE;
 		memcpy (rimg->ctab, img->ctab,
 				sizeof(img->ctab[0])*IW_CTAB_SIZE);
@@ -475,16 +784,15 @@ static shmData* shm_img_duplicate (const grabImageData *gimg, BOOL grabimg)
 		strcpy (rgimg->fname, gimg->fname);
 		rgimg->fname = (char*)rgimg->fname - (long)rgimg;
 	}
-
-	return ret;
 }
 
 /*********************************************************************
   Extract a grabImageData or iwImage from shm and return it.
+  The image data is not copied, it stays in the ring slot.
 *********************************************************************/
 static grabImageData *shm_get_img (shmData *shm)
 {
-	grabImageData *simg = (void*)shm+sizeof(shmData);
+	grabImageData *simg = (grabImageData*)SHM_SLOT_DATA(shm);
 	grabImageData *gimg;
 	iwImage *img;
 	BOOL grabimg = shm->type == SHM_GRABIMG;
@@ -533,10 +841,8 @@ static grabImageData *shm_get_img (shmData *shm)
 static void shm_destroy_image (void *data)
 {
 	if (data) {
-		shmData **shm = data - sizeof(shmData*);
-		(*shm)->ref_cnt--;
-		if ((*shm)->shm_id != -1)
-			shmdt (*shm);
+		shmData **shm = (shmData**)((char*)data - sizeof(shmData*));
+		shm_ring_release (*shm);
 		free (shm);
 	}
 }
@@ -546,100 +852,304 @@ static void shm_destroy_image (void *data)
 *********************************************************************/
 static void shm_destroy_string (void *data)
 {
-	if (data) {
-		shmData *shm = data - sizeof(shmData);
-		shm->ref_cnt--;
-		if (shm->shm_id != -1)
-			shmdt (shm);
+	if (data)
+		shm_ring_release ((shmData*)((char*)data - SHM_HEAD_SIZE));
+}
+
+/*********************************************************************
+  Return the current time in milliseconds.
+*********************************************************************/
+static long shm_time_ms (void)
+{
+	struct timeval tv;
+
+	gettimeofday (&tv, NULL);
+	return tv.tv_sec*1000 + tv.tv_usec/1000;
+}
+
+/*********************************************************************
+  Sender: Return the registered receivers as a bitmask. *lossless is
+  set to the ones with policy SHM_LOSSLESS, which are not evicted.
+*********************************************************************/
+static guint32 shm_ring_clients (shmRing *ring, guint32 *lossless)
+{
+	shmClient *c;
+	guint32 clients = 0;
+	int i;
+
+	*lossless = 0;
+	for (i=0; i<SHM_CLIENTS_MAX; i++) {
+		c = &ring->clients[i];
+		if (c->pid && c->active) {
+			clients |= 1U << i;
+			if (c->policy == SHM_LOSSLESS && !c->evicted)
+				*lossless |= 1U << i;
+		}
 	}
+	return clients;
 }
 
 /*********************************************************************
-  Send data to all clients.
+  Remove the receivers in mask from the not yet received data in slot
+  and count the data as dropped for them. Data in use is not touched.
+  Return: TRUE if the slot is free afterwards.
 *********************************************************************/
-static void shm_send_data (shmPlugin *plug, void *data)
+static BOOL shm_slot_drop (shmRing *ring, shmData *slot, guint32 mask)
 {
-	shmData **shm_adr = plug->shm_adr;
-	char *str;
-	int i, idx, cnt, pid;
-	struct sockaddr_un addr;
-	socklen_t addrlen;
+	guint64 state, nstate;
+	guint32 drop;
+	int i;
 
-	/* Check if new clients want to register */
 	do {
-		addrlen = sizeof(addr);
-		cnt = shm_recvfrom (plug, &pid, sizeof(pid), 0,
-							(struct sockaddr*)&addr, &addrlen);
-		if (cnt == sizeof(pid)) {
-			if (plug->clients_cnt >= plug->clients_len) {
-				plug->clients_len += 5;
-				plug->clients = realloc (plug->clients,
-										 plug->clients_len*sizeof(struct sockaddr_un));
+		state = slot->state;
+		drop = SHM_PENDING(state) & mask;
+		nstate = state & ~(guint64)drop;
+	} while (drop && !__sync_bool_compare_and_swap (&slot->state, state, nstate));
+
+	for (i=0; drop; i++, drop >>= 1)
+		if (drop & 1)
+			__sync_add_and_fetch (&ring->clients[i].dropped, 1);
+	return nstate == 0;
+}
+
+/*********************************************************************
+  Sender: For all receivers in clients, which are not in lossless,
+  drop the oldest not yet received data exceeding their queue length.
+*********************************************************************/
+static void shm_ring_trim (shmRing *ring, guint32 clients, guint32 lossless)
+{
+	shmData *s, *oldest;
+	guint32 bit;
+	int i, j, cnt, depth;
+
+	for (i=0; i<SHM_CLIENTS_MAX; i++) {
+		bit = 1U << i;
+		if (!(clients & bit) || (lossless & bit))
+			continue;
+		/* Evicted lossless receivers get only the newest data */
+		depth = ring->clients[i].policy == SHM_LOSSLESS ? 1 : ring->clients[i].depth;
+		while (1) {
+			cnt = 0;
+			oldest = NULL;
+			for (j=0; j<ring->slot_cnt; j++) {
+				s = SHM_SLOT(ring, j);
+				if (SHM_PENDING(s->state) & bit) {
+					cnt++;
+					if (!oldest || s->seq < oldest->seq)
+						oldest = s;
+				}
 			}
-			iw_debug (2, "Registering new client '%s'", addr.sun_path);
-			plug->clients[plug->clients_cnt] = addr;
-			plug->clients_cnt++;
+			if (cnt <= depth)
+				break;
+			shm_slot_drop (ring, oldest, bit);
 		}
-	} while (cnt == sizeof(pid));
+	}
+}
 
-	/* No client? -> Nothing to do */
-	if (plug->clients_cnt <= 0)
+/*********************************************************************
+  Sender: Evict the lossless receiver with the most not yet received
+  data. It does not hold up the sender any more and gets only the
+  newest data until it has caught up.
+*********************************************************************/
+static void shm_ring_evict (shmPlugin *plug, guint32 lossless)
+{
+	shmRing *ring = plug->ring;
+	shmClient *c;
+	int i, j, cnt, max = 0, client = -1;
+
+	for (i=0; i<SHM_CLIENTS_MAX; i++) {
+		if (!(lossless & (1U << i)))
+			continue;
+		cnt = 0;
+		for (j=0; j<ring->slot_cnt; j++)
+			if (SHM_PENDING(SHM_SLOT(ring,j)->state) & (1U << i))
+				cnt++;
+		if (cnt > max) {
+			max = cnt;
+			client = i;
+		}
+	}
+	if (client < 0)
 		return;
 
-	/* Get shm_adr entry without any active client */
-	do {
-		for (idx=0; idx < plug->para.shm_cnt; idx++) {
-			if (!shm_adr[idx] || shm_adr[idx]->ref_cnt <= 0)
-				break;
-		}
-		if (idx == plug->para.shm_cnt) {
-			iw_usleep (5000);
-			gui_check_exit (FALSE);
+	c = &ring->clients[client];
+	iw_warning ("Receiver %d held up '%s' for more than %d ms, evicting it",
+				c->pid, plug->para.channel, plug->para.evict_ms);
+	c->evicted = TRUE;
+	c->evictions++;
+	for (j=0; j<ring->slot_cnt; j++)
+		shm_slot_drop (ring, SHM_SLOT(ring,j), 1U << client);
+}
+
+/*********************************************************************
+  Receiver: Take the oldest (SHM_LATEST: the newest) not yet received
+  data of receiver client from ring and mark it as in use. For
+  SHM_LATEST all older data is dropped.
+  Return: The slot or NULL if no new data is available.
+*********************************************************************/
+static shmData *shm_slot_take (shmRing *ring, int client)
+{
+	shmClient *c = &ring->clients[client];
+	guint32 bit = 1U << client;
+	shmData *s, *slot;
+	guint64 state;
+	int i;
+
+	while (1) {
+		slot = NULL;
+		for (i=0; i<ring->slot_cnt; i++) {
+			s = SHM_SLOT(ring, i);
+			if ((SHM_PENDING(s->state) & bit) &&
+				(!slot || (c->policy == SHM_LATEST ?
+						   s->seq > slot->seq : s->seq < slot->seq)))
+				slot = s;
 		}
-	} while (idx == plug->para.shm_cnt);
+		if (!slot)
+			return NULL;
+
+		/* Fails if the sender has dropped the data in the meantime */
+		state = slot->state;
+		if ((SHM_PENDING(state) & bit) &&
+			__sync_bool_compare_and_swap (&slot->state, state,
+										  (state & ~(guint64)bit) | ((guint64)bit << 32)))
+			break;
+	}
 
-	if (shm_adr[idx]) {
-		/* FIXME: reuse memory */
-		shmdt (shm_adr[idx]);
-		shm_adr[idx] = NULL;
+	if (c->policy == SHM_LATEST) {
+		for (i=0; i<ring->slot_cnt; i++) {
+			s = SHM_SLOT(ring, i);
+			if (s != slot && s->seq < slot->seq)
+				shm_slot_drop (ring, s, bit);
+		}
 	}
+	c->cursor = slot->seq;
+	c->received++;
+
+	return slot;
+}
+
+/*********************************************************************
+  Send data to all clients.
+*********************************************************************/
+static void shm_send_data (shmPlugin *plug, void *data)
+{
+	shmRing *ring;
+	shmData *s, *slot = NULL;
+	guint32 clients, lossless;
+	gint32 release;
+	long wait_start = 0;
+	size_t size = 0;
+	int i;
+
 	switch (plug->para.type) {
 		case SHM_GRABIMG:
-			shm_adr[idx] = shm_img_duplicate ((grabImageData*)data, TRUE);
+			size = shm_img_size ((grabImageData*)data, TRUE);
 			break;
 		case SHM_IWIMG:
-			shm_adr[idx] = shm_img_duplicate ((grabImageData*)data, FALSE);
+			size = shm_img_size ((grabImageData*)data, FALSE);
 			break;
 		case SHM_STRING:
-			str = (char*)data;
-			shm_adr[idx] = shm_get_mem (strlen(str)+1);
-			shm_adr[idx]->type = SHM_STRING;
-			strcpy ((char*)shm_adr[idx]+sizeof(shmData), str);
+			size = strlen((char*)data) + 1;
 			break;
 		default:
-			break;
+			return;
 	}
 
-	/* Send the data to all registered clients */
-	if (shm_adr[idx]) {
-		for (i = 0; i < plug->clients_cnt; i++) {
-			shm_adr[idx]->ref_cnt++;
-			addr = plug->clients[i];
-			do {
-				cnt = sendto (plug->socket_fd, &shm_adr[idx]->shm_id,
-							  sizeof(shm_adr[idx]->shm_id), 0,
-							  (struct sockaddr *)&addr, sizeof(addr));
-			} while (cnt == -1 && errno == EINTR);
-			if (cnt != sizeof(shm_adr[idx]->shm_id)) {
-				iw_debug (2, "'%s' not reachable, unregistering...",
-						  addr.sun_path);
-				shm_adr[idx]->ref_cnt--;
-				plug->clients[i] = plug->clients[plug->clients_cnt-1];
-				plug->clients_cnt--;
-				i--;
+	/* The ring is created on the first data, so that the slot size is
+	   known, and recreated if the data does not fit any more */
+	if (!plug->ring || size > plug->ring->slot_size - SHM_HEAD_SIZE)
+		shm_ring_create (plug, size);
+	ring = plug->ring;
+
+	/* No client? -> Nothing to do */
+	clients = shm_ring_clients (ring, &lossless);
+	if (!clients)
+		return;
+
+	while (1) {
+		release = ring->release;
+
+		/* Oldest slot which is not in use by any client */
+		for (i=0; i < ring->slot_cnt; i++) {
+			s = SHM_SLOT(ring, i);
+			if (s->state == 0 && (!slot || s->seq < slot->seq))
+				slot = s;
+		}
+		if (slot) {
+			/* Track how long the sender is held up in a row */
+			if (wait_start)
+				plug->blocked += shm_time_ms() - wait_start;
+			else
+				plug->blocked = 0;
+			break;
+		}
+
+		/* Oldest slot, which is only waiting for non lossless clients
+		   -> Drop it for them */
+		for (i=0; i < ring->slot_cnt; i++) {
+			s = SHM_SLOT(ring, i);
+			if (!SHM_BUSY(s->state) && !(SHM_PENDING(s->state) & lossless) &&
+				(!slot || s->seq < slot->seq))
+				slot = s;
+		}
+		if (slot) {
+			if (shm_slot_drop (ring, slot, ~lossless)) {
+				if (wait_start)
+					plug->blocked += shm_time_ms() - wait_start;
+				else
+					plug->blocked = 0;
+				break;
 			}
+			slot = NULL;
+			continue;
+		}
+
+		/* Wait for the clients, evict lossless ones which held
+		   up the sender too long for the last data elements */
+		if (!wait_start)
+			wait_start = shm_time_ms();
+		if (plug->para.evict_ms > 0 &&
+			plug->blocked + shm_time_ms() - wait_start >= plug->para.evict_ms) {
+			shm_ring_evict (plug, lossless);
+			plug->blocked = 0;
+			wait_start = 0;
+			clients = shm_ring_clients (ring, &lossless);
+			continue;
 		}
+		shm_futex_wait (&ring->release, release, SHM_WAIT_MS);
+		gui_check_exit (FALSE);
+		shm_ring_check_clients (ring);
+		clients = shm_ring_clients (ring, &lossless);
+		if (!clients)
+			return;
 	}
+
+	switch (plug->para.type) {
+		case SHM_GRABIMG:
+			shm_img_copy (slot, (grabImageData*)data, TRUE);
+			break;
+		case SHM_IWIMG:
+			shm_img_copy (slot, (grabImageData*)data, FALSE);
+			break;
+		case SHM_STRING:
+			slot->type = SHM_STRING;
+			strcpy (SHM_SLOT_DATA(slot), (char*)data);
+			break;
+		default:
+			break;
+	}
+
+	/* Publish the slot to all currently registered clients */
+	slot->seq = ring->seq + 1;
+	__sync_synchronize();
+	clients = shm_ring_clients (ring, &lossless);
+	slot->state = clients;
+	__sync_synchronize();
+	ring->seq = slot->seq;
+	shm_futex_wake (&ring->seq);
+
+	/* Afterwards, so that a receiver never sees an empty queue */
+	shm_ring_trim (ring, clients, lossless);
 }
 
 /*********************************************************************
@@ -647,90 +1157,109 @@ static void shm_send_data (shmPlugin *plug, void *data)
 *********************************************************************/
 static void shm_receive_data (shmPlugin *plug)
 {
-	shmData *shm_adr;
+	shmRing *ring;
+	shmClient *c;
+	shmData *slot = NULL;
 	grabImageData *img;
 	prevDataImage i;
-	int shm_id, cnt, pid;
-
-	/* Register with the sender by sending the pid */
-	if (plug->do_reg) {
-		struct sockaddr_un addr;
-
-		memset (&addr, 0, sizeof(addr));
-		addr.sun_family = AF_UNIX;
-		strcpy (addr.sun_path, plug->para.socket);
-		pid = getpid();
-
-		gui_check_exit (TRUE);
-		do {
-			cnt = sendto (plug->socket_fd, &pid, sizeof(pid), 0,
-						  (struct sockaddr *)&addr, sizeof(addr));
-			if (cnt != sizeof(pid)) {
-				iw_warning ("Unable to register via socket '%s', retrying ...",
-							plug->para.socket);
-				if (!plug->para.block)
-					return;
-				sleep (1);
-			}
-		} while (cnt != sizeof(pid));
-		gui_check_exit (FALSE);
-
-		plug->do_reg = FALSE;
-	}
+	gint32 seq;
 
-	/* recv() may block, thus enable immediate exit */
+	/* Waiting may block, thus enable immediate exit */
 	gui_check_exit (TRUE);
-	cnt = shm_recvfrom (plug, &shm_id, sizeof(shm_id), 0, NULL, NULL);
+	while (!slot && !plug->quit) {
+		/* Register with the sender */
+		if (!plug->map && !shm_ring_open (plug)) {
+			iw_warning ("Unable to open the ring '%s', retrying ...",
+						plug->para.channel);
+			if (!plug->para.block)
+				break;
+			sleep (1);
+			continue;
+		}
+		ring = plug->map->ring;
+		c = &ring->clients[plug->map->client];
+
+		if (c->evicted && !plug->evicted) {
+			iw_warning ("Evicted from '%s' as the sender was held up, receiving\n"
+						"\tonly the newest data until caught up", plug->para.channel);
+			plug->evicted = TRUE;
+		}
+
+		seq = ring->seq;
+		if ((slot = shm_slot_take (ring, plug->map->client)))
+			break;
+
+		/* No data is waiting -> Caught up with the sender */
+		if (c->evicted) {
+			iw_debug (2, "Caught up with '%s', receiving all data again",
+					  plug->para.channel);
+			c->evicted = FALSE;
+		}
+		plug->evicted = FALSE;
+
+		/* Sender has created a new ring or died? -> Open it again */
+		if (ring->closed || shm_pid_dead (ring->pid)) {
+			shm_ring_unregister (plug->map);
+			pthread_mutex_lock (&shm_maps_mutex);
+			shm_ring_free (plug->map);
+			plug->map = NULL;
+			pthread_mutex_unlock (&shm_maps_mutex);
+			continue;
+		}
+		if (!plug->para.block)
+			break;
+		shm_futex_wait (&ring->seq, seq, SHM_WAIT_MS);
+	}
 	gui_check_exit (FALSE);
 
-	if (cnt == sizeof(shm_id)) {
-		shm_adr = shmat (shm_id, 0, 0);
-		if (shm_adr == (shmData*)-1)
-			iw_error ("Unable to attach to shared memory segment");
-		switch (shm_adr->type) {
-			case SHM_GRABIMG:
-			case SHM_IWIMG:
-				img = shm_get_img (shm_adr);
-
-				i.i = &img->img;
-				i.x = i.y = 0;
-				prev_render_imgs (plug->b_image, &i, 1, RENDER_CLEAR,
-								  img->img.width, img->img.height);
-				prev_draw_buffer (plug->b_image);
+	if (!slot)
+		return;
+
+	pthread_mutex_lock (&shm_maps_mutex);
+	plug->map->users++;
+	pthread_mutex_unlock (&shm_maps_mutex);
+
+	switch (slot->type) {
+		case SHM_GRABIMG:
+		case SHM_IWIMG:
+			img = shm_get_img (slot);
+
+			i.i = &img->img;
+			i.x = i.y = 0;
+			prev_render_imgs (plug->b_image, &i, 1, RENDER_CLEAR,
+							  img->img.width, img->img.height);
+			prev_draw_buffer (plug->b_image);
 #ifdef IW_DEBUG
-				if (shm_adr->type == SHM_GRABIMG) {
-					if (img->fname && img->fname[0]) {
-						if (img->frame_number > 0)
-							iw_debug (3, "Image %d (%s:%d) received, size: %dx%d",
-									  img->img_number, img->fname, img->frame_number,
-									  img->img.width, img->img.height);
-						else
-							iw_debug (3, "Image %d (%s) received, size: %dx%d",
-									  img->img_number, img->fname,
-									  img->img.width, img->img.height);
-					} else
-						iw_debug (3, "Image %d received, size: %dx%d",
-								  img->img_number, img->img.width, img->img.height);
+			if (slot->type == SHM_GRABIMG) {
+				if (img->fname && img->fname[0]) {
+					if (img->frame_number > 0)
+						iw_debug (3, "Image %d (%s:%d) received, size: %dx%d",
+								  img->img_number, img->fname, img->frame_number,
+								  img->img.width, img->img.height);
+					else
+						iw_debug (3, "Image %d (%s) received, size: %dx%d",
+								  img->img_number, img->fname,
+								  img->img.width, img->img.height);
 				} else
-					iw_debug (3, "Image received, size: %dx%d",
-							  img->img.width, img->img.height);
+					iw_debug (3, "Image %d received, size: %dx%d",
+							  img->img_number, img->img.width, img->img.height);
+			} else
+				iw_debug (3, "Image received, size: %dx%d",
+						  img->img.width, img->img.height);
 #endif
-				plug_data_set (&plug->def, plug->para.output_id,
-							   img, shm_destroy_image);
-				break;
-			case SHM_STRING:
-				iw_debug (3, "String for ident %s received",
-						  plug->para.output_id);
-				plug_data_set (&plug->def, plug->para.output_id,
-							   (char*)shm_adr+sizeof(shmData),
-							   shm_destroy_string);
-				break;
-			default:
-				break;
-		}
-	} else if (cnt == 0)
-		iw_error ("Unable to read identifier from socket '%s'",
-				  plug->socket);
+			plug_data_set (&plug->def, plug->para.output_id,
+						   img, shm_destroy_image);
+			break;
+		case SHM_STRING:
+			iw_debug (3, "String for ident %s received",
+					  plug->para.output_id);
+			plug_data_set (&plug->def, plug->para.output_id,
+						   SHM_SLOT_DATA(slot), shm_destroy_string);
+			break;
+		default:
+			shm_ring_release (slot);
+			break;
+	}
 }
 
 /*********************************************************************
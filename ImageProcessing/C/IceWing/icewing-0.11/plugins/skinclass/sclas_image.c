@@ -28,12 +28,197 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <limits.h>
 #include <math.h>
 
 #include "config.h"
 #include "main/image.h"
+#include "main/classify.h"
+#include "tools/parallel.h"
 #include "sclas_image.h"
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define SCLAS_SSE2
+#include <emmintrin.h>
+#define SCLAS_TARGET(t)	__attribute__((target(t)))
+#endif
+
+#ifdef SCLAS_SSE2
+/*********************************************************************
+  Return TRUE if the SSE2 versions of the difference and motion
+  history functions can be used.
+*********************************************************************/
+static BOOL sclas_simd (void)
+{
+	static int simd = -1;
+	if (simd < 0) {
+		__builtin_cpu_init();
+		simd = __builtin_cpu_supports ("sse2") ? 1 : 0;
+	}
+	return simd;
+}
+
+/*********************************************************************
+  SSE2 version of the difference calculation of iw_sclas_difference()
+  for cnt pixels. min and max are updated for thresh<=0.
+  Return: Number of processed pixels.
+*********************************************************************/
+static SCLAS_TARGET("sse2") int sclas_difference_sse2 (const uchar *s1, const uchar *s2,
+													   uchar *d, int cnt, int thresh,
+													   uchar *min, uchar *max)
+{
+	__m128i a, b, vmin, vmax, vthresh, ones;
+	uchar m[16];
+	int x, i;
+
+	ones = _mm_set1_epi8 ((char)0xFF);
+	if (thresh > 0) {
+		vthresh = _mm_set1_epi8 ((char)MIN(thresh, 255));
+		for (x=0; x+16 <= cnt; x+=16) {
+			a = _mm_loadu_si128 ((const __m128i*)(s1+x));
+			b = _mm_loadu_si128 ((const __m128i*)(s2+x));
+			/* abs(a-b) > thresh <=> abs(a-b)-thresh (saturated) != 0 */
+			a = _mm_or_si128 (_mm_subs_epu8 (a, b), _mm_subs_epu8 (b, a));
+			a = _mm_cmpeq_epi8 (_mm_subs_epu8 (a, vthresh), _mm_setzero_si128());
+			_mm_storeu_si128 ((__m128i*)(d+x), _mm_xor_si128 (a, ones));
+		}
+		return x;
+	}
+
+	vmin = _mm_set1_epi8 ((char)*min);
+	vmax = _mm_set1_epi8 ((char)*max);
+	for (x=0; x+16 <= cnt; x+=16) {
+		a = _mm_loadu_si128 ((const __m128i*)(s1+x));
+		b = _mm_loadu_si128 ((const __m128i*)(s2+x));
+		/* (a-b+256)/2 == (a+(255-b)+1)/2 */
+		a = _mm_avg_epu8 (a, _mm_xor_si128 (b, ones));
+		vmin = _mm_min_epu8 (vmin, a);
+		vmax = _mm_max_epu8 (vmax, a);
+		_mm_storeu_si128 ((__m128i*)(d+x), a);
+	}
+	_mm_storeu_si128 ((__m128i*)m, vmin);
+	for (i=0; i<16; i++)
+		if (m[i] < *min) *min = m[i];
+	_mm_storeu_si128 ((__m128i*)m, vmax);
+	for (i=0; i<16; i++)
+		if (m[i] > *max) *max = m[i];
+	return x;
+}
+
+/*********************************************************************
+  SSE2 version of motion_row().
+  Return: Number of processed pixels.
+*********************************************************************/
+static SCLAS_TARGET("sse2") int motion_row_sse2 (const uchar *a1, const uchar *a2,
+												 const uchar *b1, const uchar *b2,
+												 const uchar *diff, uchar *hist, uchar *bin,
+												 int cnt, int thresh, int weight)
+{
+	__m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8 ((char)0xFF);
+	__m128i v255 = _mm_set1_epi16 (255), vthresh = _mm_set1_epi16 (thresh);
+	__m128i vw = _mm_set1_epi16 (weight), vnw = _mm_set1_epi16 (256-weight);
+	__m128i a, b, lo, hi, h;
+	int x;
+
+	for (x=0; x+16 <= cnt; x+=16) {
+		if (diff) {
+			a = _mm_loadu_si128 ((const __m128i*)(diff+x));
+			lo = _mm_unpacklo_epi8 (a, zero);
+			hi = _mm_unpackhi_epi8 (a, zero);
+		} else {
+			a = _mm_loadu_si128 ((const __m128i*)(a1+x));
+			b = _mm_loadu_si128 ((const __m128i*)(a2+x));
+			a = _mm_or_si128 (_mm_subs_epu8 (a, b), _mm_subs_epu8 (b, a));
+			lo = _mm_unpacklo_epi8 (a, zero);
+			hi = _mm_unpackhi_epi8 (a, zero);
+			if (b1) {
+				a = _mm_loadu_si128 ((const __m128i*)(b1+x));
+				b = _mm_loadu_si128 ((const __m128i*)(b2+x));
+				a = _mm_or_si128 (_mm_subs_epu8 (a, b), _mm_subs_epu8 (b, a));
+				lo = _mm_add_epi16 (lo, _mm_unpacklo_epi8 (a, zero));
+				hi = _mm_add_epi16 (hi, _mm_unpackhi_epi8 (a, zero));
+			}
+			lo = _mm_and_si128 (_mm_cmpgt_epi16 (lo, vthresh), v255);
+			hi = _mm_and_si128 (_mm_cmpgt_epi16 (hi, vthresh), v255);
+		}
+		/* hist*weight + val*(256-weight) <= 255*256, fits in 16 bit */
+		h = _mm_loadu_si128 ((const __m128i*)(hist+x));
+		lo = _mm_srli_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_unpacklo_epi8 (h, zero), vw),
+											_mm_mullo_epi16 (lo, vnw)), 8);
+		hi = _mm_srli_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (_mm_unpackhi_epi8 (h, zero), vw),
+											_mm_mullo_epi16 (hi, vnw)), 8);
+		h = _mm_packus_epi16 (lo, hi);
+		_mm_storeu_si128 ((__m128i*)(hist+x), h);
+		_mm_storeu_si128 ((__m128i*)(bin+x),
+						  _mm_xor_si128 (_mm_cmpeq_epi8 (h, zero), ones));
+	}
+	return x;
+}
+#endif
+
+/*********************************************************************
+  Update the motion history hist[0..cnt-1] with the thresholded
+  difference of a1 and a2 (plus the difference of b1 and b2 if
+  b1!=NULL) or, if diff!=NULL, with diff and write the binarized
+  history to bin. weight: Portion of the old history in 1/256.
+*********************************************************************/
+static void motion_row (const uchar *a1, const uchar *a2,
+						const uchar *b1, const uchar *b2,
+						const uchar *diff, uchar *hist, uchar *bin,
+						int cnt, int thresh, int weight)
+{
+	int x = 0, val;
+
+#ifdef SCLAS_SSE2
+	if (sclas_simd())
+		x = motion_row_sse2 (a1, a2, b1, b2, diff, hist, bin, cnt, thresh, weight);
+#endif
+	for (; x<cnt; x++) {
+		if (diff) {
+			val = diff[x];
+		} else {
+			val = abs (a1[x]-a2[x]);
+			if (b1) val += abs (b1[x]-b2[x]);
+			val = val > thresh ? IW_COLMAX:0;
+		}
+		hist[x] = (hist[x]*weight + val*(256-weight)) >> 8;
+		bin[x] = hist[x] > 0 ? IW_COLMAX:0;
+	}
+}
+
+/*********************************************************************
+  Copy every step-th value of the row s to d (cnt values).
+*********************************************************************/
+static const uchar *motion_sample (const uchar *s, uchar *d, int cnt, int step)
+{
+	int x;
+
+	if (!s) return NULL;
+	for (x=0; x<cnt; x++)
+		d[x] = s[x*step];
+	return d;
+}
+
+/*********************************************************************
+  Enlarge the image s of size ((width+step-1)/step)x((height+step-1)/step)
+  by pixel replication by step and write it to d (size width x height).
+*********************************************************************/
+static void motion_expand (const uchar *s, int step, uchar *d, int width, int height)
+{
+	int gw = (width+step-1)/step, x, y;
+
+	for (y=0; y<height; y++, d+=width) {
+		if (y % step) {
+			memcpy (d, d-width, width);
+		} else {
+			for (x=0; x<gw; x++)
+				memset (d+x*step, s[x], MIN(step, width-x*step));
+			s += gw;
+		}
+	}
+}
+
 /*********************************************************************
   Calculate difference image of s1 and s2, threshold result with
   thresh, and write median smoothed result (mask size: size*2+1) to d.
@@ -44,22 +229,31 @@
 uchar iw_sclas_difference (uchar *s1, uchar *s2, uchar *d, int width, int height,
 						   int size, int thresh)
 {
-	int x, y;
+	int x, y, done = 0;
 	uchar *dpos, *buffer = iw_img_get_buffer (width*height), ret;
+	uchar min = 127, max = 127;
 
 	if (size>0) dpos = buffer;
 	else dpos = d;
 
+#ifdef SCLAS_SSE2
+	if (sclas_simd()) {
+		done = sclas_difference_sse2 (s1, s2, dpos, width*height, thresh, &min, &max);
+		s1 += done;
+		s2 += done;
+		dpos += done;
+	}
+#endif
 	if (thresh > 0) {
-		for (x=width*height; x>0; x--) {
+		for (x=width*height-done; x>0; x--) {
 			y = (*s1++)-(*s2++);
 			*dpos++ = abs(y) > thresh ? IW_COLMAX:0;
 		}
 		ret = IW_COLMAX;
 	} else {
-		uchar h, min=127, max=127;
+		uchar h;
 
-		for (x=width*height; x>0; x--) {
+		for (x=width*height-done; x>0; x--) {
 			h = ((*s1++)-(*s2++) + IW_COLCNT) / 2;
 			if (h > max) max = h;
 			if (h < min) min = h;
@@ -79,269 +273,179 @@ uchar iw_sclas_difference (uchar *s1, uchar *s2, uchar *d, int width, int height
 }
 
 /*********************************************************************
-  Color classification of img by using a lookup table. Write median
-  smoothed result (mask size: size*2+1) to d.
-  pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
-  Lookup table is loaded from look->name if it is NULL.
+  Update the motion history m with the images s1 and s2 (both of size
+  width x height) and write the binarized and median smoothed history
+  to d. The difference, threshold, history decay, and binarization
+  are done in one pass with 8.8 fixed point weights.
+  src : Plane used for the difference, 3: Sum of the U and V
+        differences.
+  diff: If !=NULL, this difference image is used instead of
+        thresholding the differences of s1 and s2.
 *********************************************************************/
-BOOL iw_sclas_classify (iwImage *img, uchar *d, int size, int pix_cnt, sclasLookup *look)
+void iw_sclas_motion (sclasMotion *m, uchar **s1, uchar **s2, int src,
+					  const uchar *diff, int width, int height, uchar *d)
 {
-	uchar *y=img->data[0], *u=img->data[1], *v=img->data[2], *dpos, *buffer;
-	int width = img->width, height = img->height;
-	int count = width*height, index;
-
-	dpos = buffer = iw_img_get_buffer (width*height);
-
-	if (look->lookup == NULL) {
-		static int sizes[] = {2097152, 65536, 2097152*8, 0};
-		struct stat stbuf;
-		FILE *file;
-		char name[PATH_MAX];
-		int i = 0;
+	int step = MAX (m->step, 1), gw = (width+step-1)/step, gh = (height+step-1)/step;
+	int weight = (int)(m->weight*256+0.5), y, off;
+	const uchar *a1, *a2, *b1, *b2, *df;
+	uchar *bin, *sample = NULL, *smooth = NULL;
+
+	if (!m->history || gw != m->width || gh != m->height) {
+		if (!(m->history = realloc (m->history, gw*gh)) ||
+			!(m->binary = realloc (m->binary, gw*gh)))
+			iw_error ("Out of memory: motion history of size %dx%d", gw, gh);
+		memset (m->history, 0, gw*gh);
+		m->width = gw;
+		m->height = gh;
+	}
+	weight = CLAMP (weight, 0, 256);
 
-		strcpy (name, look->name);
-		if (stat(name, &stbuf) != 0) {
-			if (look->datadir)
-				strcpy (name, look->datadir);
-			if (name[strlen(name)-1] != '/') strcat (name, "/");
-			strcat (name, look->name);
-			if (stat(name, &stbuf) != 0) {
-				iw_warning ("Unable to stat lookup table '%s'\n"
-							"       or '%s'", name, look->name);
-				iw_img_release_buffer();
-				return FALSE;
-			}
+	if (step > 1) {
+		sample = iw_img_get_buffer (5*gw + gw*gh);
+		smooth = sample + 5*gw;
+	}
+	bin = (step == 1 && m->median <= 0) ? d : m->binary;
+
+	for (y=0; y<gh; y++) {
+		off = y*step*width;
+		a1 = a2 = b1 = b2 = df = NULL;
+		if (diff) {
+			df = diff+off;
+		} else if (src <= 2) {
+			a1 = s1[src]+off;
+			a2 = s2[src]+off;
+		} else {
+			a1 = s1[1]+off;
+			a2 = s2[1]+off;
+			b1 = s1[2]+off;
+			b2 = s2[2]+off;
 		}
-		while (sizes[i] != stbuf.st_size) {
-			if (sizes[i] <= 0)
-				iw_error ("Lookup table '%s' has unknown size %ld",
-						  name, (long)stbuf.st_size);
-			i++;
+		if (step > 1) {
+			a1 = motion_sample (a1, sample, gw, step);
+			a2 = motion_sample (a2, sample+gw, gw, step);
+			b1 = motion_sample (b1, sample+2*gw, gw, step);
+			b2 = motion_sample (b2, sample+3*gw, gw, step);
+			df = motion_sample (df, sample+4*gw, gw, step);
 		}
-		look->feat_mode = i;
-		look->lookup = iw_malloc0 (stbuf.st_size, "lookup table for color classification");
-		if (!(file = fopen(name, "r"))) {
-			iw_warning ("Unable to open lookup table '%s'", name);
-			iw_img_release_buffer();
-			return FALSE;
+		motion_row (a1, a2, b1, b2, df, m->history+y*gw, bin+y*gw,
+					gw, m->thresh, weight);
+	}
+
+	if (step == 1) {
+		if (m->median > 0)
+			iw_img_medianBW (m->binary, d, width, height, m->median);
+	} else {
+		if (m->median > 0) {
+			iw_img_medianBW (m->binary, smooth, gw, gh, (m->median+step-1)/step);
+			bin = smooth;
 		}
-		if (fread (look->lookup, 1, stbuf.st_size, file) != stbuf.st_size) {
-			iw_warning ("Unable to read lookup table '%s'", name);
-			iw_img_release_buffer();
-			fclose (file);
+		motion_expand (bin, step, d, width, height);
+		iw_img_release_buffer();
+	}
+}
+
+/*********************************************************************
+  Free the buffers of the motion history m.
+*********************************************************************/
+void iw_sclas_motion_free (sclasMotion *m)
+{
+	if (m->history) free (m->history);
+	if (m->binary) free (m->binary);
+	m->history = m->binary = NULL;
+	m->width = m->height = 0;
+}
+
+/*********************************************************************
+  Open the lookup table look->lookup from look->name and set
+  look->feat_mode according to its size. Two class tables are bit
+  packed.
+*********************************************************************/
+static BOOL sclas_lookup_load (sclasLookup *look)
+{
+	static int sizes[] = {2097152, 65536, 2097152*8, 0};
+	struct stat stbuf;
+	char name[PATH_MAX];
+	int i = 0;
+
+	strcpy (name, look->name);
+	if (stat(name, &stbuf) != 0) {
+		if (look->datadir)
+			strcpy (name, look->datadir);
+		if (name[strlen(name)-1] != '/') strcat (name, "/");
+		strcat (name, look->name);
+		if (stat(name, &stbuf) != 0) {
+			iw_warning ("Unable to stat lookup table '%s'\n"
+						"       or '%s'", name, look->name);
 			return FALSE;
 		}
-		fclose (file);
 	}
+	while (sizes[i] != stbuf.st_size) {
+		if (sizes[i] <= 0)
+			iw_error ("Lookup table '%s' has unknown size %ld",
+					  name, (long)stbuf.st_size);
+		i++;
+	}
+	look->feat_mode = i;
+	look->lookup = iw_lookup_open (name, look->twoclass && !look->confidence);
+
+	return look->lookup != NULL;
+}
+
+/*********************************************************************
+  Color classification of img by using a lookup table. Write median
+  smoothed result (mask size: size*2+1) to d.
+  pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
+  Lookup table is loaded from look->name if it is NULL.
+  label!=NULL: Additionally region label the result in the same pass
+               and return the number of regions in nregions.
+  rdata: Labeling state, NULL: the static one.
+*********************************************************************/
+BOOL iw_sclas_classify_label (iwImage *img, uchar *d, int size, int pix_cnt,
+							  sclasLookup *look, gint32 *label, int *nregions,
+							  iwRegCalcData *rdata)
+{
+	static iwClassifyFeature features[] = {
+		IW_CLASSIFY_YUV7, IW_CLASSIFY_UV8, IW_CLASSIFY_UV6_PAIR
+	};
+	iwClassifyPara para;
+	int n;
+
+	if (look->lookup == NULL && !sclas_lookup_load (look))
+		return FALSE;
+
+	iw_classify_init (&para);
+	para.feature = features[look->feat_mode];
+	if (look->lookup->packed)
+		para.bits = look->lookup->data;
+	else
+		para.lookup = look->lookup->data;
+	para.pix_cnt = pix_cnt;
+	para.size = size;
+	para.label = label;
+	para.label_data = rdata;
 	if (look->confidence) {
-		if (size == 0)
-			dpos = d;
-
-		if (pix_cnt==0) {
-			if (look->feat_mode == SCLAS_FEAT_ONE_YUV) {
-				while (count--) {
-					index = ((*y++ >>1) << 14) | ((*u++ >>1) << 7) | (*v++ >>1);
-					*dpos++ = look->lookup[index];
-				}
-			} else if (look->feat_mode == SCLAS_FEAT_ONE_UV) {
-				while (count--) {
-					*dpos++ = look->lookup[(*u++ << 8) | *v++];
-				}
-			} else {
-				count-=2; dpos++;
-				while (count--) {
-					index = ((*u++ >>2) << 18) | ((*v++ >>2) << 12);
-					index |= ((*(u+1) >>2) << 6) | (*(v+1) >>2);
-					*dpos++ = look->lookup[index];
-				}
-			}
-		} else {
-			int i, k, r, g, b;
-			if (!size) iw_img_border (dpos, width, height, 1);
-			y+=width+1; u+=width+1; v+=width+1; dpos+=width+1;
-			if (look->feat_mode == SCLAS_FEAT_ONE_YUV) {
-				for (i=1; i<height-1; i++) {
-					for (k=1; k<width-1; k++) {
-						if (pix_cnt==2) {
-							r = (*y + *(y-1) + *(y+1) + *(y-width) + *(y+width)) / 5;
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							r = (*(y-1) + *(y+1) + *(y-width) + *(y+width)) / 4;
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						index = ((r>>1) << 14) | ((g>>1) << 7) | (b>>1);
-						*dpos++ = look->lookup[index];
-						y++; u++; v++;
-					}
-					y+=2; u+=2; v+=2; dpos+=2;
-				}
-			} else if (look->feat_mode == SCLAS_FEAT_ONE_UV) {
-				for (i=1; i<height-1; i++) {
-					for (k=1; k<width-1; k++) {
-						if (pix_cnt==2) {
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						*dpos++ = look->lookup[(g << 8) | b];
-						u++; v++;
-					}
-					u+=2; v+=2; dpos+=2;
-				}
-
-			} else {
-				for (i=1; i<height-1; i++) {
-					for (k=2; k<width-2; k++) {
-						if (pix_cnt==2) {
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						index = ((g>>2) << 18) | ((b>>2) << 12);
-						u++; v++;
-						if (pix_cnt==2) {
-							g = (*(u+1) + *u + *(u+2) + *(u-width+1) + *(u+width+1)) / 5;
-							b = (*(v+1) + *v + *(v+2) + *(v-width+1) + *(v+width+1)) / 5;
-						} else {
-							g = (*u + *(u+2) + *(u-width+1) + *(u+width+1)) / 4;
-							b = (*v + *(v+2) + *(v-width+1) + *(v+width+1)) / 4;
-						}
-						index |= ((g>>2) << 6) | (b>>2);
-						*dpos++ = look->lookup[index];
-					}
-					u+=4; v+=4; dpos+=4;
-				}
-			}
-		}
-		if (size>0)
-			iw_img_median (buffer, d, width, height, size);
+		para.smooth = IW_CLASSIFY_MEDIAN;
 	} else {
-		if (size == 0) dpos = d;
-		if (pix_cnt==0) {
-			if (look->feat_mode == SCLAS_FEAT_ONE_YUV) {
-				if (look->twoclass)
-					while (count--) {
-						index = ((*y++ >>1) << 14) | ((*u++ >>1) << 7) | (*v++ >>1);
-						*dpos++ = (1-look->lookup[index])*IW_COLMAX;
-					}
-				else
-					while (count--) {
-						index = ((*y++ >>1) << 14) | ((*u++ >>1) << 7) | (*v++ >>1);
-						*dpos++ = look->lookup[index];
-					}
-			} else if (look->feat_mode == SCLAS_FEAT_ONE_UV) {
-				if (look->twoclass) {
-					while (count--) {
-						*dpos++ = (1-look->lookup[(*u++ << 8) | *v++])*IW_COLMAX;
-					}
-				} else
-					while (count--) {
-						*dpos++ = look->lookup[(*u++ << 8) | *v++];
-					}
-			} else {
-				count-=2; dpos++;
-				if (look->twoclass)
-					while (count--) {
-						index = ((*u++ >>2) << 18) | ((*v++ >>2) << 12);
-						index |= ((*(u+1) >>2) << 6) | (*(v+1) >>2);
-						*dpos++ = (1-look->lookup[index])*IW_COLMAX;
-					}
-				else
-					while (count--) {
-						index = ((*u++ >>2) << 18) | ((*v++ >>2) << 12);
-						index |= ((*(u+1) >>2) << 6) | (*(v+1) >>2);
-						*dpos++ = look->lookup[index];
-					}
-			}
-		} else {
-			int i, k, r, g, b;
-			if (!size) iw_img_border (dpos, width, height, 1);
-			y+=width+1; u+=width+1; v+=width+1; dpos+=width+1;
-			if (look->feat_mode == SCLAS_FEAT_ONE_YUV) {
-				for (i=1; i<height-1; i++) {
-					for (k=1; k<width-1; k++) {
-						if (pix_cnt==2) {
-							r = (*y + *(y-1) + *(y+1) + *(y-width) + *(y+width)) / 5;
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							r = (*(y-1) + *(y+1) + *(y-width) + *(y+width)) / 4;
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						index = ((r>>1) << 14) | ((g>>1) << 7) | (b>>1);
-						if (look->twoclass)
-							*dpos++ = (1-look->lookup[index])*IW_COLMAX;
-						else
-							*dpos++ = look->lookup[index];
-						y++; u++; v++;
-					}
-					y+=2; u+=2; v+=2; dpos+=2;
-				}
-			} else if (look->feat_mode == SCLAS_FEAT_ONE_UV) {
-				for (i=1; i<height-1; i++) {
-					for (k=1; k<width-1; k++) {
-						if (pix_cnt==2) {
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						if (look->twoclass)
-							*dpos++ = (1-look->lookup[(g << 8) | b])*IW_COLMAX;
-						else
-							*dpos++ = look->lookup[(g << 8) | b];
-						u++; v++;
-					}
-					u+=2; v+=2; dpos+=2;
-				}
-			} else {
-				for (i=1; i<height-1; i++) {
-					for (k=2; k<width-2; k++) {
-						if (pix_cnt==2) {
-							g = (*u + *(u-1) + *(u+1) + *(u-width) + *(u+width)) / 5;
-							b = (*v + *(v-1) + *(v+1) + *(v-width) + *(v+width)) / 5;
-						} else {
-							g = (*(u-1) + *(u+1) + *(u-width) + *(u+width)) / 4;
-							b = (*(v-1) + *(v+1) + *(v-width) + *(v+width)) / 4;
-						}
-						index = ((g>>2) << 18) | ((b>>2) << 12);
-						u++; v++;
-						if (pix_cnt==2) {
-							g = (*(u+1) + *u + *(u+2) + *(u-width+1) + *(u+width+1)) / 5;
-							b = (*(v+1) + *v + *(v+2) + *(v-width+1) + *(v+width+1)) / 5;
-						} else {
-							g = (*u + *(u+2) + *(u-width+1) + *(u+width+1)) / 4;
-							b = (*v + *(v+2) + *(v-width+1) + *(v+width+1)) / 4;
-						}
-						index |= ((g>>2) << 6) | (b>>2);
-						if (look->twoclass)
-							*dpos++ = (1-look->lookup[index])*IW_COLMAX;
-						else
-							*dpos++ = look->lookup[index];
-					}
-					u+=4; v+=4; dpos+=4;
-				}
-			}
-		}
-		if (size>0) {
-			if (look->twoclass)
-				iw_img_medianBW (buffer, d, width, height, size);
-			else
-				iw_img_max (buffer, d, width, height, size);
-		}
+		para.twoclass = look->twoclass;
+		para.smooth = look->twoclass ? IW_CLASSIFY_MEDIAN_BW : IW_CLASSIFY_MAX;
 	}
-	iw_img_release_buffer();
+	n = iw_classify (img, d, &para);
+	if (nregions) *nregions = n;
+
 	return TRUE;
 }
 
+/*********************************************************************
+  Color classification of img by using a lookup table. Write median
+  smoothed result (mask size: size*2+1) to d.
+  pix_cnt=0,1,2 -> calculate average over 1,4,5 pixels
+  Lookup table is loaded from look->name if it is NULL.
+*********************************************************************/
+BOOL iw_sclas_classify (iwImage *img, uchar *d, int size, int pix_cnt, sclasLookup *look)
+{
+	return iw_sclas_classify_label (img, d, size, pix_cnt, look, NULL, NULL, NULL);
+}
+
 /*********************************************************************
   Combine difference image and color classification (size
   width x height) according to mode comb_mode. Threshold result with
@@ -440,11 +544,211 @@ static int region_cmp (iwRegion *small, iwRegion *big)
 		return 0;
 }
 
+static int region_ptr_cmp (const void *small, const void *big)
+{
+	return region_cmp (*(iwRegion**)small, *(iwRegion**)big);
+}
+
+/*********************************************************************
+  Sort the regions with region_cmp(). iwRegion is large, so only
+  pointers are sorted and every region is copied just twice.
+*********************************************************************/
+static void region_sort (iwRegion *regions, int nregions)
+{
+	iwRegion **ptr, *sorted;
+	int i;
+
+	if (nregions < 2) return;
+
+	ptr = iw_malloc (nregions * sizeof(iwRegion*), "region pointers");
+	sorted = iw_malloc (nregions * sizeof(iwRegion), "sorted regions");
+	for (i=0; i<nregions; i++)
+		ptr[i] = &regions[i];
+	qsort (ptr, nregions, sizeof(iwRegion*), region_ptr_cmp);
+	for (i=0; i<nregions; i++)
+		sorted[i] = *ptr[i];
+	memcpy (regions, sorted, nregions * sizeof(iwRegion));
+	free (sorted);
+	free (ptr);
+}
+
+		/* Number of columns / diff regions per iw_parallel_for() job */
+#define JUDGE_COLUMNS		32
+#define JUDGE_DIFFS			16
+
+typedef struct {
+	iwRegion *regions;
+	int nregions;
+	iwRegCOMinfo *regDiff;
+	int nregDiff;
+	int xsize, ysize;
+	gint32 *image;
+	int *labmap, labcnt;	/* Region label -> region index, -1: no region */
+	int *siterow;			/* Row of the nearest region pixel in the same column,
+							   -1: none */
+	int *bbox;				/* Bounding box x1,y1,x2,y2 of the region polygons */
+	int *attach;			/* Result: Region the diff region is attached to */
+} sclasJudge;
+
+/*********************************************************************
+  Return the index of the region the pixel at pos belongs to, -1 if
+  it is not part of any region.
+*********************************************************************/
+static inline int judge_region (sclasJudge *j, int pos)
+{
+	int l = j->image[pos];
+	if (l < 0 || l >= j->labcnt) return -1;
+	return j->labmap[l];
+}
+
+/*********************************************************************
+  iw_parallel_for() worker for the distance transform: For the
+  columns of band nr store for every pixel the row of the nearest
+  region pixel in the same column.
+*********************************************************************/
+static void judge_columns (int nr, void *data)
+{
+	sclasJudge *j = data;
+	int w = j->xsize, *row = j->siterow;
+	int x1 = nr*JUDGE_COLUMNS, x2 = MIN(x1+JUDGE_COLUMNS, w), x, y, a, b;
+
+	/* Nearest region pixel above ... */
+	for (x=x1; x<x2; x++)
+		row[x] = judge_region (j, x) >= 0 ? 0 : -1;
+	for (y=1; y<j->ysize; y++)
+		for (x=x1; x<x2; x++)
+			row[y*w+x] = judge_region (j, y*w+x) >= 0 ? y : row[(y-1)*w+x];
+
+	/* ... or below */
+	for (y=j->ysize-2; y>=0; y--) {
+		for (x=x1; x<x2; x++) {
+			a = row[y*w+x];
+			b = row[(y+1)*w+x];
+			if (b >= 0 && (a < 0 || abs(b-y) < y-a))
+				row[y*w+x] = b;
+		}
+	}
+}
+
+/*********************************************************************
+  Return the index of the region with the nearest pixel to (x,y) by
+  using the column distance transform, -1 if there is no region or
+  no distance transform.
+  Only columns closer than the best distance found so far are
+  checked, so the costs depend on the distance and not on the number
+  of regions.
+*********************************************************************/
+static int judge_nearest (sclasJudge *j, int x, int y)
+{
+	int w = j->xsize, best = INT_MAX, site = -1, dx, q, i, d, *row;
+
+	if (!j->siterow) return -1;
+	row = j->siterow + y*w;
+	for (dx=0; dx*dx < best && (x-dx >= 0 || x+dx < w); dx++) {
+		for (i=0; i<2; i++) {
+			q = i ? x+dx : x-dx;
+			if (q < 0 || q >= w || (i && !dx) || row[q] < 0) continue;
+			d = dx*dx + (row[q]-y)*(row[q]-y);
+			if (d < best) {
+				best = d;
+				site = row[q]*w + q;
+			}
+		}
+	}
+	return site < 0 ? -1 : judge_region (j, site);
+}
+
+/*********************************************************************
+  Return the square of the distance of (x,y) to the bounding box
+  of region r, a lower bound for reg_calcdist().
+*********************************************************************/
+static int judge_bbox_dist (sclasJudge *j, int r, int x, int y)
+{
+	int *b = j->bbox + r*4, dx = 0, dy = 0;
+
+	if (x < b[0]) dx = b[0]-x;
+	else if (x > b[2]) dx = x-b[2];
+	if (y < b[1]) dy = b[1]-y;
+	else if (y > b[3]) dy = y-b[3];
+	return dx*dx + dy*dy;
+}
+
+/*********************************************************************
+  Attach a diff region, whose center of mass is outside of all
+  regions, to the region with the smallest distance if the second
+  nearest region is much farther away.
+  Return: Index of the region or -1.
+*********************************************************************/
+static int judge_outside (sclasJudge *j, iwRegCOMinfo *diff)
+{
+	int min = INT_MAX, r_min = -1, min2 = INT_MAX, dist, r, lim;
+
+	/* The region with the nearest pixel is most likely the region
+	   with the nearest polygon. Only regions which can be closer
+	   than 1.8 times its distance can influence the result. */
+	lim = INT_MAX;
+	r = judge_nearest (j, diff->com_x, diff->com_y);
+	if (r >= 0) {
+		float l = 1.8*sqrtf ((float)reg_calcdist (&j->regions[r].r.polygon,
+												  diff->com_x, diff->com_y)) + 2;
+		if (l*l < INT_MAX) lim = l*l;
+	}
+
+	/* Get the two regions with the smallest distance */
+	for (r=0; r<j->nregions; r++) {
+		if (j->regions[r].r.polygon.n_punkte <= 0 ||
+			judge_bbox_dist (j, r, diff->com_x, diff->com_y) >= lim)
+			continue;
+		dist = reg_calcdist (&j->regions[r].r.polygon, diff->com_x, diff->com_y);
+		if (dist<min2) {
+			if (dist<min) {
+				min2 = min;
+				min = dist; r_min = r;
+			} else
+				min2 = dist;
+		}
+	}
+	if (r_min < 0) return -1;
+	min = sqrtf ((float)min);
+	min2 = min2 == INT_MAX ? INT_MAX : sqrtf ((float)min2);
+	if ((min==0 || (float)min2/min > 1.8) && min < j->xsize/10)
+		return r_min;
+	return -1;
+}
+
+/*********************************************************************
+  iw_parallel_for() worker: Find the regions for the diff regions of
+  block nr. The regions are only modified afterwards, so all diff
+  regions can be handled independently.
+*********************************************************************/
+static void judge_diffs (int nr, void *data)
+{
+	sclasJudge *j = data;
+	int d, r, d2 = MIN((nr+1)*JUDGE_DIFFS, j->nregDiff);
+
+	for (d=nr*JUDGE_DIFFS; d<d2; d++) {
+		iwRegCOMinfo *diff = &j->regDiff[d];
+
+		j->attach[d] = -1;
+		if (diff->pixelcount <= 0) continue;
+
+		/* Center of mass of the diff region is inside a region? */
+		r = judge_region (j, diff->com_y*j->xsize+diff->com_x);
+		if (r < 0)
+			r = judge_outside (j, diff);
+		j->attach[d] = r;
+	}
+}
+
 /*********************************************************************
   Judge regions based on avgConf and based on the diff regions regDiff
   (are attached to neighboring regions).
   image: region labeled image of size xsize x ysize.
 
+  Diff regions outside of all regions are attached with the help of a
+  distance transform of image, which is calculated once per call.
+  The diff regions are handled in parallel.
+
   Regions with a judgement < bew_min -> pixelanzahl = 0
   max_reg_anz>0: Only the max_reg_anz regions with the best judgement
                  will have pixelanzahl > 0.
@@ -454,67 +758,83 @@ void iw_sclas_judge_diff (iwRegion *regions, int nregions,
 						  int xsize, int ysize, gint32 *image,
 						  float bew_min, int max_reg_anz)
 {
-	int d, r, col, sum_in_region;
-	BOOL done;
-	static int *in_region = NULL, len_region = 0;
-
-	if (len_region < nregions) {
-		in_region = (int *) realloc (in_region, nregions * sizeof(int));
-		if (in_region == NULL)
-			iw_error ("Cannot alloc %ld Bytes for in_region", nregions * (long)sizeof(int));
-		len_region = nregions;
-	}
+	int d, r, i, sum_in_region, *in_region, outside = 0, points = 0;
+	sclasJudge j;
+
+	in_region = iw_malloc0 (MAX(nregions,1) * sizeof(int), "in_region");
+
+	memset (&j, 0, sizeof(j));
+	j.regions = regions;
+	j.nregions = nregions;
+	j.regDiff = regDiff;
+	j.nregDiff = nregDiff;
+	j.xsize = xsize;
+	j.ysize = ysize;
+	j.image = image;
+
+	/* Map the labels to the regions, the first region of a label wins */
+	for (r=0; r<nregions; r++)
+		if (regions[r].labindex >= j.labcnt)
+			j.labcnt = regions[r].labindex+1;
+	j.labmap = iw_malloc (MAX(j.labcnt,1) * sizeof(int), "label map");
+	for (i=0; i<j.labcnt; i++)
+		j.labmap[i] = -1;
+	for (r=nregions-1; r>=0; r--)
+		if (regions[r].labindex >= 0)
+			j.labmap[regions[r].labindex] = r;
+	j.attach = iw_malloc (MAX(nregDiff,1) * sizeof(int), "diff attach");
+
+	/* Distance transform and bounding boxes are only needed
+	   if diff regions are outside of all regions */
+	for (d=0; d<nregDiff; d++)
+		if (regDiff[d].pixelcount > 0 &&
+			judge_region (&j, regDiff[d].com_y*xsize+regDiff[d].com_x) < 0)
+			outside++;
+	if (outside > 0) {
+		/* The distance transform pays off only if testing all
+		   polygons for all outside diff regions is more expensive */
+		for (r=0; r<nregions; r++)
+			points += regions[r].r.polygon.n_punkte;
+		if ((double)points*outside > (double)xsize*ysize) {
+			j.siterow = iw_malloc (xsize*ysize * sizeof(int), "distance transform");
+			iw_parallel_for ((xsize+JUDGE_COLUMNS-1) / JUDGE_COLUMNS, judge_columns, &j);
+		}
 
-	memset (in_region, 0, nregions * sizeof(int));
+		j.bbox = iw_malloc (MAX(nregions,1) * 4*sizeof(int), "region bounding boxes");
+		for (r=0; r<nregions; r++) {
+			Polygon_t *p = &regions[r].r.polygon;
+			int *b = j.bbox + r*4;
+
+			b[0] = b[1] = INT_MAX;
+			b[2] = b[3] = INT_MIN;
+			for (i=0; i<p->n_punkte; i++) {
+				int x = p->punkt[i]->x, y = p->punkt[i]->y;
+				if (x < b[0]) b[0] = x;
+				if (x > b[2]) b[2] = x;
+				if (y < b[1]) b[1] = y;
+				if (y > b[3]) b[3] = y;
+			}
+		}
+	}
 
 	/* Try to attach diff regions to the color regions */
+	iw_parallel_for ((nregDiff+JUDGE_DIFFS-1) / JUDGE_DIFFS, judge_diffs, &j);
+
 	sum_in_region = 0;
 	for (d=0; d<nregDiff; d++) {
-		if (regDiff[d].pixelcount > 0) {
-			done = FALSE;
-			col = image[regDiff[d].com_y*xsize+regDiff[d].com_x];
-
-			for (r=0; !done && r<nregions; r++) {
-				if (regions[r].labindex == col) {
-					/* Center of mass of the diff region is inside a region */
-					sum_in_region += regDiff[d].pixelcount;
-					in_region[r] += regDiff[d].pixelcount;
-					regDiff[d].color = gruen;
-					regions[r].r.echtfarbe.modell = FARB_MODELL_UNDEF;
-					regions[r].r.farbe = weiss;
-
-					done = TRUE;
-				}
-			}
-			if (!done) {
-				/* Try to attach diff regions, which are outside of regions,
-				   to the region with the smallest distance */
-				int min = 9999999, r_min = -1, min2 = 9999999, dist;
-
-				/* Get the two regions with the smallest distance */
-				for (r=0; r<nregions; r++) {
-					dist = reg_calcdist (&regions[r].r.polygon,
-										 regDiff[d].com_x, regDiff[d].com_y);
-					if (dist<min2) {
-						if (dist<min) {
-							min2 = min;
-							min = dist; r_min = r;
-						} else
-							min2 = dist;
-					}
-				}
-				min = sqrtf ((float)min);
-				min2 = sqrtf ((float)min2);
-				if ((min==0 || (float)min2/min > 1.8) && min < xsize/10) {
-					regDiff[d].color = gruen;
-					regions[r_min].r.echtfarbe.modell = FARB_MODELL_UNDEF;
-					regions[r_min].r.farbe = weiss;
-					sum_in_region += regDiff[d].pixelcount;
-					in_region[r_min] += regDiff[d].pixelcount;
-				}
-			}
-		}
+		r = j.attach[d];
+		if (r < 0) continue;
+		regDiff[d].color = gruen;
+		regions[r].r.echtfarbe.modell = FARB_MODELL_UNDEF;
+		regions[r].r.farbe = weiss;
+		sum_in_region += regDiff[d].pixelcount;
+		in_region[r] += regDiff[d].pixelcount;
 	}
+	free (j.labmap);
+	free (j.attach);
+	if (j.siterow) free (j.siterow);
+	if (j.bbox) free (j.bbox);
+
 	/* Judge based on avgConf and diff regions attached to the region */
 	for (r=0; r<nregions; r++) {
 		float b;
@@ -531,11 +851,13 @@ void iw_sclas_judge_diff (iwRegion *regions, int nregions,
 			regions[r].judgement = b;
 	}
 
-	qsort (regions, nregions, sizeof(iwRegion), (int(*)())region_cmp);
+	region_sort (regions, nregions);
 
 	if (max_reg_anz > 0)
 		for (r=max_reg_anz; r<nregions; r++)
 			regions[r].r.pixelanzahl = 0;
+
+	free (in_region);
 }
 
 /*********************************************************************
@@ -559,7 +881,7 @@ void iw_sclas_judge (iwRegion *regions, int nregions,
 			regions[r].judgement = b;
 	}
 
-	qsort (regions, nregions, sizeof(iwRegion), (int(*)())region_cmp);
+	region_sort (regions, nregions);
 
 	if (max_reg_anz > 0)
 		for (r=max_reg_anz; r<nregions; r++)
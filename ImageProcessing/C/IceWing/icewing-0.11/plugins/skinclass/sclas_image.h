@@ -29,6 +29,7 @@
 
 #include "gui/Gimage.h"
 #include "main/region.h"
+#include "main/classify.h"
 #include "tools/tools.h"
 
 #define SCLAS_COMB_NONE		0		/* Combine-Modi */
@@ -40,7 +41,7 @@
 #define SCLAS_FEAT_TWO_UV	2		/* Feature vector: 2 Pixel UV 6 bit */
 
 typedef struct {
-	uchar *lookup;				/* Lookup table */
+	iwLookup *lookup;			/* Lookup table, shared with other users */
 	char *name;					/* Filename for lookup table */
 	char *datadir;
 	BOOL confidence;			/* Lookup table with data for confidence mapping? */
@@ -48,6 +49,18 @@ typedef struct {
 	int feat_mode;				/* FEAT_..., is set according to size of lookup table */
 } sclasLookup;
 
+/* Motion history image, see iw_sclas_motion() */
+typedef struct {
+	int thresh;					/* Threshold for the difference image */
+	float weight;				/* Portion of the old history compared to the new part */
+	int step;					/* Use only every step pixel in x and y direction */
+	int median;					/* Size of the black/white median filter, 0: none */
+
+	int width, height;			/* Private: Size of history */
+	uchar *history;				/* History image (size width x height) */
+	uchar *binary;				/* Binarized history */
+} sclasMotion;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -62,6 +75,24 @@ extern "C" {
 uchar iw_sclas_difference (uchar *s1, uchar *s2, uchar *d, int width, int height,
 						   int size, int thresh);
 
+/*********************************************************************
+  Update the motion history m with the images s1 and s2 (both of size
+  width x height) and write the binarized and median smoothed history
+  to d. The difference, threshold, history decay, and binarization
+  are done in one pass with 8.8 fixed point weights.
+  src : Plane used for the difference, 3: Sum of the U and V
+        differences.
+  diff: If !=NULL, this difference image is used instead of
+        thresholding the differences of s1 and s2.
+*********************************************************************/
+void iw_sclas_motion (sclasMotion *m, uchar **s1, uchar **s2, int src,
+					  const uchar *diff, int width, int height, uchar *d);
+
+/*********************************************************************
+  Free the buffers of the motion history m.
+*********************************************************************/
+void iw_sclas_motion_free (sclasMotion *m);
+
 /*********************************************************************
   Color classification of img by using a lookup table. Write median
   smoothed result (mask size: size*2+1) to d.
@@ -70,6 +101,16 @@ uchar iw_sclas_difference (uchar *s1, uchar *s2, uchar *d, int width, int height
 *********************************************************************/
 BOOL iw_sclas_classify (iwImage *img, uchar *d, int size, int pix_cnt, sclasLookup *look);
 
+/*********************************************************************
+  Like iw_sclas_classify(), but additionally region label the result
+  in the same pass (see iw_reg_label()) if label!=NULL and return the
+  number of regions in nregions. rdata: Labeling state, see
+  iw_reg_label_data(), NULL: the static one.
+*********************************************************************/
+BOOL iw_sclas_classify_label (iwImage *img, uchar *d, int size, int pix_cnt,
+							  sclasLookup *look, gint32 *label, int *nregions,
+							  iwRegCalcData *rdata);
+
 /*********************************************************************
   Combine difference image and color classification (size
   width x height) according to mode comb_mode. Threshold result with
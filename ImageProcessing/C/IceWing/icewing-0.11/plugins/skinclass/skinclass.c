@@ -44,6 +44,9 @@
 #define BUF_MOTION		4
 #define BUF_TMP			5
 
+/* Widget name without the page name of the OPT_??? defines */
+#define OPT_WIDGET(page,opt)	((opt)+sizeof(page))
+
 static plugDefinition plug_skinclass;
 
 typedef struct {
@@ -62,6 +65,7 @@ typedef struct {
 	int mhi_diff_src;		/* Source data for difference image calculation */
 	float mhi_weight;		/* Portion of old MHI-Image compared to new part */
 	int mhi_median;			/* Size of median filter */
+	int mhi_step;			/* Sample distance for the MHI calculation */
 
 	int comb_mode;			/* Modus for diff. image color classification combination */
 	int comb_thresh;		/* Threshold value after combination */
@@ -72,35 +76,64 @@ typedef struct {
 	int reg_bew_anz;		/* Provide n best judgest regions */
 } sclasValues;
 
-static sclasValues opt_values;
-static char **class_mode_names;
-		/* Buffer for intermediate images */
-static uchar *buffer[BUF_TMP+1] = {NULL,NULL,NULL,NULL,NULL};
-
-static struct sclasParameter {
+typedef struct sclasParameter {
+	char *input;			/* Identifier of the observed images */
 	char *out_regions;
-} parameter;
-
-static prevBuffer *b_diff, *b_mhihist, *b_mhithresh, *b_colorseg, *b_combine, *b_rlab, *b_region;
+} sclasParameter;
+
+typedef struct sclasPlugin {		/* All parameter of one plugin instance */
+	plugDefinition def;
+	sclasValues values;
+	sclasParameter para;
+	char *page_motion, *page_class;	/* Names of the option pages */
+	char **class_mode_names;
+	uchar *buffer[BUF_TMP+1];		/* Buffer for intermediate images */
+	int buf_size;
+	int *ireg, *iregdiff;			/* Label images of get_regions() */
+	int ir_size;
+	iwRegCalcData *rdata;			/* State of the labeling and region calculation */
+	plugDataFunc *region_func;		/* Function registered for SCLAS_IDENT_REGION,
+									   (plugDataFunc*)1: not searched yet */
+	sclasMotion motion;				/* Motion history image */
+	prevBuffer *b_diff, *b_mhihist, *b_mhithresh, *b_colorseg, *b_combine,
+		*b_rlab, *b_region;
+} sclasPlugin;
 
 /*********************************************************************
   Free the resources allocated during sclas_???().
 *********************************************************************/
-static void sclas_cleanup (plugDefinition *plug)
+static void sclas_cleanup (plugDefinition *plug_d)
 {
+	sclasPlugin *plug = (sclasPlugin *)plug_d;
+	int i;
+
+	iw_sclas_motion_free (&plug->motion);
+	for (i=0; i<=BUF_TMP; i++) {
+		if (plug->buffer[i]) free (plug->buffer[i]);
+		plug->buffer[i] = NULL;
+	}
+	plug->buf_size = 0;
+	if (plug->ireg) free (plug->ireg);
+	if (plug->iregdiff) free (plug->iregdiff);
+	plug->ireg = plug->iregdiff = NULL;
+	plug->ir_size = 0;
+	iw_reg_data_free (plug->rdata);
+	plug->rdata = NULL;
 }
 
-static void help (void)
+static void help (sclasPlugin *plug)
 {
 	fprintf (stderr, "\n%s plugin for %s, (c) 1999-2009 by Frank Loemker\n"
 			 "Segment skin colored regions. Needs at least one other\n"
 			 "plugin to perform color classification.\n"
 			 "\n"
 			 "Usage of the %s plugin:\n"
-			 "     [-o]\n"
+			 "     [-i ident] [-o]\n"
+			 "-i       identifier of the images to process, must be the image\n"
+			 "         identifier of a grabbing plugin, default: %s\n"
 			 "-o       output hand hypotheses on stream <%s>_gHypos\n",
-			 plug_skinclass.name, ICEWING_NAME, plug_skinclass.name,
-			 IW_DACSNAME);
+			 plug->def.name, ICEWING_NAME, plug->def.name,
+			 IW_GRAB_IDENT, IW_DACSNAME);
 	gui_exit (1);
 }
 
@@ -109,149 +142,162 @@ static void help (void)
   'para': command line parameter for main program
   argc, argv: plugin specific command line parameter
 *********************************************************************/
-#define ARG_TEMPLATE "-L:Lr -O:O -H:H"
-static void sclas_init (plugDefinition *plug, grabParameter *para, int argc, char **argv)
+#define ARG_TEMPLATE "-I:Ir -L:Lr -O:O -H:H"
+static void sclas_init (plugDefinition *plug_d, grabParameter *para, int argc, char **argv)
 {
+	sclasPlugin *plug = (sclasPlugin *)plug_d;
 	void *arg;
 	char ch;
 	int nr = 0;
 
-	parameter.out_regions = NULL;
+	plug->para.input = IW_GRAB_IDENT;
+	plug->para.out_regions = NULL;
+	plug->region_func = (plugDataFunc*)1;
 
 	while (nr < argc) {
 		ch = iw_parse_args (argc, argv, &nr, &arg, ARG_TEMPLATE);
 		switch (ch) {
+			case 'I':
+				plug->para.input = (char*)arg;
+				break;
 			case 'O':
-				parameter.out_regions =
+				plug->para.out_regions =
 					iw_output_register_stream ("_gHypos",
 											   (NDRfunction_t*)ndr_RegionHyp);
 				break;
 			case 'H':
 			case '\0':
-				help();
+				help (plug);
 			default:
 				fprintf (stderr, "Unknown character %c!\n", ch);
-				help();
+				help (plug);
 		}
 	}
-	plug_observ_data (plug, "image");
+	plug_observ_data (plug_d, plug->para.input);
 }
 
 /*********************************************************************
   Initialise the user interface for the plugin.
   Return: Number of the last opened option page.
 *********************************************************************/
-static int sclas_init_options (plugDefinition *plug)
+static int sclas_init_options (plugDefinition *plug_d)
 {
 	static char *diff_sources[] = {"Y","U","V",NULL};
 	static char *mhi_diff_sources[] = {"Y","U","V","U+V",NULL};
 	static char *comb_mode[] = {"None","Add","Mul",NULL};
 	static char *class_avg[] = {"1","4","5",NULL};
 
+	sclasPlugin *plug = (sclasPlugin *)plug_d;
+	sclasValues *v = &plug->values;
 	int p, cnt;
 	plugDataFunc *func;
 
-	opt_values.diff_do = TRUE;
-	opt_values.diff_med_size = 0;
-	opt_values.diff_thresh = 6;
-	opt_values.diff_source = 2;
+	v->diff_do = TRUE;
+	v->diff_med_size = 0;
+	v->diff_thresh = 6;
+	v->diff_source = 2;
 
-	opt_values.mhi_do = 0;
-	opt_values.mhi_diff_thresh = 12;
-	opt_values.mhi_diff_src = 0;
-	opt_values.mhi_weight = 0.7;
-	opt_values.mhi_median = 2;
+	v->mhi_do = 0;
+	v->mhi_diff_thresh = 12;
+	v->mhi_diff_src = 0;
+	v->mhi_weight = 0.7;
+	v->mhi_median = 2;
+	v->mhi_step = 1;
 
 
 	cnt = 0;
-	class_mode_names = malloc (sizeof(char*)*2);
-	class_mode_names[cnt++] = strdup("None");
+	plug->class_mode_names = malloc (sizeof(char*)*2);
+	plug->class_mode_names[cnt++] = strdup("None");
 	
 	/* Get list of classifier plugins */
 	func = NULL;
 	while ((func = plug_function_get (SCLAS_IDENT_CLASSIFY, func))) {
-		class_mode_names = realloc (class_mode_names, sizeof(char*)*(cnt+2));
-		class_mode_names[cnt++] = strdup (func->plug->name);
+		plug->class_mode_names = realloc (plug->class_mode_names, sizeof(char*)*(cnt+2));
+		plug->class_mode_names[cnt++] = strdup (func->plug->name);
 	}
-	class_mode_names[cnt] = NULL;
-
-	opt_values.class_mode = cnt>0 ? 1:0;
-	opt_values.class_avg = 0;
-	opt_values.class_med_size = 2;
-	opt_values.class_thresh = 127;
-	opt_values.comb_mode = SCLAS_COMB_NONE;
-	opt_values.comb_thresh = 0;
-	opt_values.reg_min = 100;
-	opt_values.reg_diff_min = 100;
-	opt_values.reg_bew_min = 0.1;
-	opt_values.reg_bew_anz = 0;
-
-	b_diff = prev_new_window (plug_name(plug, ".Differenz image"),-1,-1,TRUE,FALSE);
-	prev_opts_append (b_diff, PREV_IMAGE, PREV_TEXT, -1);
-	b_mhihist = prev_new_window (plug_name(plug, ".MHI history image"),-1,-1,TRUE,FALSE);
-	b_mhithresh = prev_new_window (plug_name(plug, ".MHI threshold"),-1,-1,TRUE,FALSE);
-	b_colorseg = prev_new_window (plug_name(plug, ".Color segmentation"),-1,-1,TRUE,FALSE);
-	b_combine = prev_new_window (plug_name(plug, ".Combined Segment + Diff"),-1,-1,TRUE,FALSE);
-
-	b_rlab = prev_new_window (plug_name(plug, ".Region lab"),-1,-1,TRUE,FALSE);
-	b_region = prev_new_window (plug_name(plug, ".Recognized regions"),-1,-1,FALSE,FALSE);
-	prev_opts_append (b_region, PREV_TEXT, PREV_REGION, PREV_COMINFO, -1);
-
-	p = opts_page_append (OPT_SKIN_MOTION);
-
-	opts_toggle_create (p,OPT_DIFF_DO,NULL,&opt_values.diff_do);
+	plug->class_mode_names[cnt] = NULL;
+
+	v->class_mode = cnt>0 ? 1:0;
+	v->class_avg = 0;
+	v->class_med_size = 2;
+	v->class_thresh = 127;
+	v->comb_mode = SCLAS_COMB_NONE;
+	v->comb_thresh = 0;
+	v->reg_min = 100;
+	v->reg_diff_min = 100;
+	v->reg_bew_min = 0.1;
+	v->reg_bew_anz = 0;
+
+	plug->b_diff = prev_new_window (plug_name(plug_d, ".Differenz image"),-1,-1,TRUE,FALSE);
+	prev_opts_append (plug->b_diff, PREV_IMAGE, PREV_TEXT, -1);
+	plug->b_mhihist = prev_new_window (plug_name(plug_d, ".MHI history image"),-1,-1,TRUE,FALSE);
+	plug->b_mhithresh = prev_new_window (plug_name(plug_d, ".MHI threshold"),-1,-1,TRUE,FALSE);
+	plug->b_colorseg = prev_new_window (plug_name(plug_d, ".Color segmentation"),-1,-1,TRUE,FALSE);
+	plug->b_combine = prev_new_window (plug_name(plug_d, ".Combined Segment + Diff"),-1,-1,TRUE,FALSE);
+
+	plug->b_rlab = prev_new_window (plug_name(plug_d, ".Region lab"),-1,-1,TRUE,FALSE);
+	plug->b_region = prev_new_window (plug_name(plug_d, ".Recognized regions"),-1,-1,FALSE,FALSE);
+	prev_opts_append (plug->b_region, PREV_TEXT, PREV_REGION, PREV_COMINFO, -1);
+
+	p = opts_page_append (plug->page_motion);
+
+	opts_toggle_create (p, OPT_WIDGET(OPT_SKIN_MOTION, OPT_DIFF_DO), NULL, &v->diff_do);
 	opts_entscale_create (p,"Diff. Med size",
-						  "Radius of median filter",&opt_values.diff_med_size,0,20);
-	opts_entscale_create (p,OPT_DIFF_THRESH,NULL,&opt_values.diff_thresh,0,255);
-	opts_radio_create (p,"Diff. Source:",NULL,diff_sources,&opt_values.diff_source);
+						  "Radius of median filter",&v->diff_med_size,0,20);
+	opts_entscale_create (p, OPT_WIDGET(OPT_SKIN_MOTION, OPT_DIFF_THRESH), NULL,
+						  &v->diff_thresh, 0, 255);
+	opts_radio_create (p,"Diff. Source:",NULL,diff_sources,&v->diff_source);
 
-	opts_toggle_create (p, "Motion History Image", NULL, &opt_values.mhi_do);
+	opts_toggle_create (p, "Motion History Image", NULL, &v->mhi_do);
 	opts_entscale_create (p, "MHI DiffThresh",
 						  "Threshold for initial difference image",
-						  &opt_values.mhi_diff_thresh, 0, 255);
+						  &v->mhi_diff_thresh, 0, 255);
 	opts_radio_create (p,"MHI DiffSrc:",
 					   "Source data for difference image calculation",
-					   mhi_diff_sources, &opt_values.mhi_diff_src);
+					   mhi_diff_sources, &v->mhi_diff_src);
 	opts_float_create (p, "MHI Weight",
 					   "Portion of old MHI-Image compared to new part",
-					   &opt_values.mhi_weight, 0, 1);
+					   &v->mhi_weight, 0, 1);
 	opts_entscale_create (p,"MHI Med size", "Radius of median filter",
-						  &opt_values.mhi_median, 0, 20);
+						  &v->mhi_median, 0, 20);
+	opts_entscale_create (p,"MHI Step",
+						  "Calculate the MHI only for every n-th pixel in x and y direction",
+						  &v->mhi_step, 1, 8);
 
-	p = opts_page_append (OPT_SKIN_CLASS);
+	p = opts_page_append (plug->page_class);
 
 	opts_option_create (p, "ColSeg Mode:",
 						"Color classifier to use",
-						class_mode_names, &opt_values.class_mode);
+						plug->class_mode_names, &v->class_mode);
 	opts_radio_create (p, "Pixel Cnt:",
 					   "Number of to pixels to average for the classifier feature",
-					   class_avg, &opt_values.class_avg);
-	opts_entscale_create (p, OPT_CLASS_MED_SIZE,
+					   class_avg, &v->class_avg);
+	opts_entscale_create (p, OPT_WIDGET(OPT_SKIN_CLASS, OPT_CLASS_MED_SIZE),
 						  "Radius of median filter for color segmented image",
-						  &opt_values.class_med_size, 0, 20);
-	opts_entscale_create (p, OPT_CLASS_THRESH,
+						  &v->class_med_size, 0, 20);
+	opts_entscale_create (p, OPT_WIDGET(OPT_SKIN_CLASS, OPT_CLASS_THRESH),
 						  "Threshold for color segmented image",
-						  &opt_values.class_thresh, 0, 255);
+						  &v->class_thresh, 0, 255);
 
-	opts_radio_create (p, OPT_COMB_MODE,
+	opts_radio_create (p, OPT_WIDGET(OPT_SKIN_CLASS, OPT_COMB_MODE),
 					   "Combine color segmentation and difference-/MHI-image",
-					   comb_mode, &opt_values.comb_mode);
+					   comb_mode, &v->comb_mode);
 	opts_entscale_create (p, "Comb. Threshold",
 						  "Threshold for the combined image",
-						  &opt_values.comb_thresh, 0, 255);
+						  &v->comb_thresh, 0, 255);
 
 	opts_entscale_create (p, "Min Region",
 						  "Remove all smaller regions",
-						  &opt_values.reg_min, 32, 5000);
+						  &v->reg_min, 32, 5000);
 	opts_entscale_create (p, "Min DiffReg",
 						  "Remove all smaller difference regions",
-						  &opt_values.reg_diff_min, 32, 5000);
+						  &v->reg_diff_min, 32, 5000);
 	opts_float_create (p, "Min Rating",
 					   "Remove all regions which are judged worse",
-					   &opt_values.reg_bew_min, 0, 2);
+					   &v->reg_bew_min, 0, 2);
 	opts_entscale_create (p, "#Regions",
 						  "Keep only the best n judged regions, 0: keep all",
-						  &opt_values.reg_bew_anz, 0, 20);
+						  &v->reg_bew_anz, 0, 20);
 
 	return p;
 }
@@ -261,76 +307,39 @@ static int sclas_init_options (plugDefinition *plug)
   src1, src2: Data of last two grabbed images.
   w, h      : Size of the images.
 *********************************************************************/
-static void motion_do (uchar **src1, uchar **src2, int w, int h)
+static void motion_do (sclasPlugin *plug, uchar **src1, uchar **src2, int w, int h)
 {
-	static int w_old = -1, h_old = -1;
-	static uchar *buf;
-	uchar *u, *u2, *v, *v2;
-	uchar *d, *d2, val;
-	int x;
-
-	if (w_old != w || h_old != h) {
-		if (buf) free (buf);
-		buf = calloc (1, 2*w*h);
-		w_old = w;
-		h_old = h;
-	}
+	sclasValues *v = &plug->values;
+	sclasMotion *motion = &plug->motion;
+	uchar *diff = NULL;
 
-	d = buf;
-	if (opt_values.mhi_median > 0)
-		d2 = buf+w*h;
-	else
-		d2 = buffer[BUF_MOTION];
-	if (opt_values.diff_do && opt_values.diff_source == opt_values.mhi_diff_src &&
-		opt_values.diff_thresh == opt_values.mhi_diff_thresh) {
+	motion->thresh = v->mhi_diff_thresh;
+	motion->weight = v->mhi_weight;
+	motion->step = v->mhi_step;
+	motion->median = v->mhi_median;
+
+	if (v->diff_do && v->diff_source == v->mhi_diff_src &&
+		v->diff_thresh == v->mhi_diff_thresh) {
 		/* Use previously calculated difference image */
-		u = buffer[BUF_DIFF];
-		for (x=w*h; x>0; x--) {
-			*d = (*d)*opt_values.mhi_weight + (*u++)*(1-opt_values.mhi_weight);
-			*d2++ = *d > 0 ? 255:0;
-			d++;
-		}
-	} else if (opt_values.mhi_diff_src <= 2) {
-		/* Difference image between two planes */
-		u = src1[opt_values.mhi_diff_src];
-		u2 = src2[opt_values.mhi_diff_src];
-		for (x=w*h; x>0; x--) {
-			val = abs((*u++)-(*u2++)) > opt_values.mhi_diff_thresh ? 255:0;
-			*d = (*d)*opt_values.mhi_weight + val*(1-opt_values.mhi_weight);
-			*d2++ = *d > 0 ? 255:0;
-			d++;
-		}
-	} else {
-		/* U+V difference image */
-		u = src1[1];
-		v = src1[2];
-		u2 = src2[1];
-		v2 = src2[2];
-		for (x=w*h; x>0; x--) {
-			val = (abs((*(u)++)-(*(u2)++)) + abs((*(v)++)-(*(v2)++)))
-				> opt_values.mhi_diff_thresh ? 255:0;
-			*d = (*d)*opt_values.mhi_weight + (val)*(1-opt_values.mhi_weight);
-			*d2++ = *d > 0 ? 255:0;
-			d++;
-		}
+		diff = plug->buffer[BUF_DIFF];
 	}
-	prev_render (b_mhihist, &buf, w, h, IW_YUV);
-	prev_draw_buffer (b_mhihist);
+	iw_sclas_motion (motion, src1, src2, v->mhi_diff_src, diff,
+					 w, h, plug->buffer[BUF_MOTION]);
 
-	if (opt_values.mhi_median > 0) {
-		u = buf+w*h;
-		d = buffer[BUF_MOTION];
-		iw_img_medianBW (u, d, w, h, opt_values.mhi_median);
-	}
-	prev_render (b_mhithresh, &buffer[BUF_MOTION], w, h, IW_YUV);
-	prev_draw_buffer (b_mhithresh);
+	prev_render (plug->b_mhihist, &motion->history, motion->width, motion->height, IW_YUV);
+	prev_draw_buffer (plug->b_mhihist);
+
+	prev_render (plug->b_mhithresh, &plug->buffer[BUF_MOTION], w, h, IW_YUV);
+	prev_draw_buffer (plug->b_mhithresh);
 }
-	
+
 /*********************************************************************
   Bild s[actImg] (im YUV-Format) bearbeiten.
 *********************************************************************/
-static uchar* do_image (iwImage **s, int actImg, char *classifier)
+static uchar* do_image (sclasPlugin *plug, iwImage **s, int actImg, char *classifier)
 {
+	sclasValues *v = &plug->values;
+	uchar **buffer = plug->buffer;
 	int x, w = s[actImg]->width, h = s[actImg]->height;
 	uchar **planes = s[actImg]->data, *buf_classify;
 	uchar *retbuf = NULL, max_diff = 0;
@@ -339,23 +348,23 @@ static uchar* do_image (iwImage **s, int actImg, char *classifier)
 
 	iw_debug (4,"Image size: %dx%d", w, h);
 
-	if ((opt_values.diff_do || opt_values.mhi_do) && actImg <= 0)
+	if ((v->diff_do || v->mhi_do) && actImg <= 0)
 		return NULL;
 
 	iw_time_start (time_motion);
-	if (opt_values.diff_do) {
-		max_diff = iw_sclas_difference (planes[opt_values.diff_source],
-										s[actImg-1]->data[opt_values.diff_source],
+	if (v->diff_do) {
+		max_diff = iw_sclas_difference (planes[v->diff_source],
+										s[actImg-1]->data[v->diff_source],
 										buffer[BUF_DIFF],
-										w, h, opt_values.diff_med_size,opt_values.diff_thresh);
-		prev_render (b_diff, &buffer[BUF_DIFF], w, h, IW_YUV);
-		prev_draw_buffer (b_diff);
+										w, h, v->diff_med_size,v->diff_thresh);
+		prev_render (plug->b_diff, &buffer[BUF_DIFF], w, h, IW_YUV);
+		prev_draw_buffer (plug->b_diff);
 
 		if (s[actImg-1]->data[0])
 			retbuf = buffer[BUF_DIFF];
 	}
-	if (opt_values.mhi_do)
-		motion_do (planes, s[actImg-1]->data, w, h);
+	if (v->mhi_do)
+		motion_do (plug, planes, s[actImg-1]->data, w, h);
 	iw_time_stop (time_motion, FALSE);
 
 	iw_time_start (time_class);
@@ -364,40 +373,41 @@ static uchar* do_image (iwImage **s, int actImg, char *classifier)
 		plugDataFunc *func =
 			plug_function_get_full (SCLAS_IDENT_CLASSIFY, NULL, classifier);
 		if (func) {
-			ok = ((sclasClassifyFunc)func->func) (s[actImg], buffer[BUF_CLASS_CONF],
-												  opt_values.class_avg,
-												  opt_values.class_med_size,
-												  opt_values.class_thresh);
+			ok = ((sclasClassifyFunc)func->func) (func->plug, s[actImg],
+												  buffer[BUF_CLASS_CONF],
+												  v->class_avg,
+												  v->class_med_size,
+												  v->class_thresh);
 			if (!ok) {
 				iw_time_stop (time_class, FALSE);
 				return NULL;
 			}
 
-			if (opt_values.class_thresh) {
+			if (v->class_thresh) {
 				uchar *s = buffer[BUF_CLASS_CONF], *d = buffer[BUF_CLASSIFY];
 				for (x=w*h; x>0; x--)
-					*d++ = *s++ > opt_values.class_thresh ? 255:0;
+					*d++ = *s++ > v->class_thresh ? 255:0;
 				buf_classify = buffer[BUF_CLASSIFY];
 			} else
 				buf_classify = buffer[BUF_CLASS_CONF];
 
-			prev_render (b_colorseg, &buf_classify, w, h, IW_YUV);
-			prev_draw_buffer (b_colorseg);
+			prev_render (plug->b_colorseg, &buf_classify, w, h, IW_YUV);
+			prev_draw_buffer (plug->b_colorseg);
 
-			if ((opt_values.diff_do || opt_values.mhi_do) &&
-				opt_values.comb_mode != SCLAS_COMB_NONE) {
+			if ((v->diff_do || v->mhi_do) &&
+				v->comb_mode != SCLAS_COMB_NONE) {
 				uchar *src;
 
-				if (opt_values.mhi_do) {
+				if (v->mhi_do) {
 					max_diff = 255;
 					src = buffer[BUF_MOTION];
 				} else
 					src = buffer[BUF_DIFF];
 				iw_sclas_combine (src, max_diff, buf_classify,
-								  buffer[BUF_COMB], w, h, opt_values.comb_thresh,
-								  opt_values.comb_mode);
-				prev_render (b_combine, &buffer[BUF_COMB], w, h, IW_YUV);
-				prev_draw_buffer (b_combine);
+								  buffer[BUF_COMB], w, h, v->comb_thresh,
+								  v->comb_mode);
+				prev_render (plug->b_combine, &buffer[BUF_COMB], w, h, IW_YUV);
+				prev_draw_buffer (plug->b_combine);
 				retbuf = buffer[BUF_COMB];
 			} else
 				retbuf = buf_classify;
@@ -408,37 +418,50 @@ static uchar* do_image (iwImage **s, int actImg, char *classifier)
 	return retbuf;
 }
 
-static void get_regions (uchar *reg_img, grabImageData *gimg, char *classifier)
+static void get_regions (sclasPlugin *plug, uchar *reg_img, grabImageData *gimg,
+						 char *classifier)
 {
+	sclasValues *v = &plug->values;
 	iwRegion *regions = NULL;
 	iwRegCOMinfo *COMinfo = NULL;
-	static int *ireg = NULL, *iregdiff = NULL, ir_width=0, ir_height=0;
 	int w = gimg->img.width, h = gimg->img.height, i, nregions;
+	int *ireg;
+	iwImage cimg;
 	iw_time_add_static3 (time_region, "RegionCalc",
 					  time_regrest, "RegionRest",
 					  time_track, "Tracking");
 
 	if (!reg_img) return;
 
-	if (!ireg || ir_width!=w || ir_height!=h) {
-		ir_width = w;
-		ir_height = h;
-		if (!(ireg = realloc (ireg, sizeof(int) * ir_width * ir_height)))
+	if (!plug->ireg || plug->ir_size != w*h) {
+		plug->ir_size = w*h;
+		if (!(plug->ireg = realloc (plug->ireg, sizeof(int) * w * h)))
 			iw_error ("Out of memory: ireg for regionlab");
-		if (!(iregdiff = realloc (iregdiff, sizeof(int) * ir_width * ir_height)))
+		if (!(plug->iregdiff = realloc (plug->iregdiff, sizeof(int) * w * h)))
 			iw_error ("Out of memory: iregdiff for regionlab");
 	}
+	ireg = plug->ireg;
+	if (!plug->rdata)
+		plug->rdata = iw_reg_data_create();
 
 	iw_time_start (time_region);
 	iw_img_border (reg_img, w, h, 1);
-	nregions = iw_reg_label (w, h, reg_img, ireg);
-	regions = iw_reg_calc (w, h, reg_img, ireg,
-						   gimg->img.data, buffer[BUF_CLASS_CONF],
-						   &nregions, FALSE, opt_values.reg_min);
+	nregions = iw_reg_label_data (w, h, reg_img, ireg, plug->rdata);
+
+	iw_img_init (&cimg);
+	cimg.data = &reg_img;
+	cimg.width = w;
+	cimg.height = h;
+	cimg.planes = 1;
+	iw_reg_data_set_minregion (plug->rdata, v->reg_min);
+	iw_reg_data_set_images (plug->rdata, &cimg, gimg->img.data,
+							plug->buffer[BUF_CLASS_CONF]);
+	iw_reg_data_set_mode (plug->rdata, IW_REG_NO_ZERO);
+	regions = iw_reg_calc_data (w, h, ireg, &nregions, plug->rdata);
 	iw_time_stop (time_region, FALSE);
 
-	prev_render_int (b_rlab, ireg, w, h, 60);
-	prev_draw_buffer (b_rlab);
+	prev_render_int (plug->b_rlab, ireg, w, h, 60);
+	prev_draw_buffer (plug->b_rlab);
 
 	iw_time_start (time_regrest);
 	if (regions && nregions > 0) {
@@ -446,33 +469,34 @@ static void get_regions (uchar *reg_img, grabImageData *gimg, char *classifier)
 
 		iw_debug (3, "Number of hand regions: %d", nregions);
 
-		if (opt_values.diff_do && opt_values.diff_thresh>0) {
-			uchar *s = buffer[BUF_DIFF];
+		if (v->diff_do && v->diff_thresh>0) {
+			uchar *s = plug->buffer[BUF_DIFF];
 			int nCOMinfo;
 
 			iw_img_border (s, w, h, 1);
 
-			COMinfo = iw_reg_label_with_calc (w, h, s, iregdiff,
-											  &nCOMinfo, opt_values.reg_diff_min);
+			COMinfo = iw_reg_label_with_calc_data (w, h, s, plug->iregdiff,
+												   &nCOMinfo, v->reg_diff_min,
+												   plug->rdata);
 			iw_debug (3, "Number of diff regions: %d", nCOMinfo);
 
 			if (COMinfo) {
 				for (i=0; i<nCOMinfo; i++)
 					COMinfo[i].color = rot;
 				iw_sclas_judge_diff (regions, nregions, COMinfo, nCOMinfo,
-									 w, h, ireg, opt_values.reg_bew_min,
-									 opt_values.reg_bew_anz);
+									 w, h, ireg, v->reg_bew_min,
+									 v->reg_bew_anz);
 
-				prev_render_COMinfos (b_region, COMinfo, nCOMinfo, mode, w, h);
+				prev_render_COMinfos (plug->b_region, COMinfo, nCOMinfo, mode, w, h);
 				mode &= ~RENDER_CLEAR;
 			} else
-				iw_sclas_judge (regions, nregions, opt_values.reg_bew_min,
-								opt_values.reg_bew_anz);
+				iw_sclas_judge (regions, nregions, v->reg_bew_min,
+								v->reg_bew_anz);
 		} else
-			iw_sclas_judge (regions, nregions, opt_values.reg_bew_min,
-							opt_values.reg_bew_anz);
-		prev_render_regions (b_region, regions, nregions, mode, w, h);
-		prev_draw_buffer (b_region);
+			iw_sclas_judge (regions, nregions, v->reg_bew_min,
+							v->reg_bew_anz);
+		prev_render_regions (plug->b_region, regions, nregions, mode, w, h);
+		prev_draw_buffer (plug->b_region);
 	}
 	iw_time_stop (time_regrest, FALSE);
 
@@ -485,42 +509,38 @@ static void get_regions (uchar *reg_img, grabImageData *gimg, char *classifier)
 	iw_reg_upsample (nregions, regions, 1.0/gimg->downw, 1.0/gimg->downh);
 	iw_time_stop (time_track, FALSE);
 
-	{
-		static plugDataFunc *func = (plugDataFunc*)1;
-		if (func == (plugDataFunc*)1)
-			func = plug_function_get (SCLAS_IDENT_REGION, NULL);
-		if (func)
-			((sclasUpdateFunc)func->func) (&gimg->img, ireg, regions, nregions);
-	}
+	if (plug->region_func == (plugDataFunc*)1)
+		plug->region_func = plug_function_get (SCLAS_IDENT_REGION, NULL);
+	if (plug->region_func)
+		((sclasRegionFunc)plug->region_func->func) (&gimg->img, ireg, regions, nregions);
 
 	if (classifier) {
 		/* Update the classifier with the help of the regions */
 		plugDataFunc *func =
 			plug_function_get_full (SCLAS_IDENT_UPDATE, NULL, classifier);
 		if (func)
-			((sclasUpdateFunc)func->func) (&gimg->img, ireg, regions, nregions);
+			((sclasUpdateFunc)func->func) (func->plug, &gimg->img, ireg,
+										   regions, nregions);
 	}
-	if (parameter.out_regions) {
+	if (plug->para.out_regions) {
 		if (regions)
 			iw_reg_upsample (nregions, regions, gimg->downw, gimg->downh);
 		iw_output_hypos (regions, nregions, gimg->time, gimg->img_number,
-						 parameter.out_regions);
+						 plug->para.out_regions);
 	}
 }
 
-static void check_buffer (int width, int height)
+static void check_buffer (sclasPlugin *plug, int width, int height)
 {
-	static int buf_size = 0;
-
-	if (!buffer[0] || width*height != buf_size) {
+	if (!plug->buffer[0] || width*height != plug->buf_size) {
 		int i;
 		for (i=0; i<=BUF_TMP; i++) {
-			if (!(buffer[i] = realloc (buffer[i],width*height)))
+			if (!(plug->buffer[i] = realloc (plug->buffer[i],width*height)))
 				iw_error ("Out of memory: image buffer of size %dx%d",
 						  width, height);
-			memset (buffer[i], 0, width*height);
+			memset (plug->buffer[i], 0, width*height);
 		}
-		buf_size = width*height;
+		plug->buf_size = width*height;
 	}
 }
 
@@ -530,14 +550,23 @@ static void check_buffer (int width, int height)
   data : Result of plug_data_get_new (ident, NULL).
   Return: Continue the execution of the remaining plugins?
 *********************************************************************/
-static BOOL sclas_process (plugDefinition *plug, char *ident, plugData *data)
+static BOOL sclas_process (plugDefinition *plug_d, char *ident, plugData *data)
 {
+	sclasPlugin *plug = (sclasPlugin *)plug_d;
 	grabImageData *gimg = (grabImageData*)data->data;
 	grabImageData *gimg_old;
+	plugDefinition *grab = NULL;
 	iwImage *imgs[2];
 	int actImg = 0;
 
-	gimg_old = grab_get_image (gimg->img_number-1, NULL);
+	/* Images not stored under the default identifier are from a
+	   separate grabbing plugin instance, get the previous image there */
+	if (strcmp (ident, IW_GRAB_IDENT))
+		grab = data->plug;
+	if (grab)
+		gimg_old = grab_get_image_from_plug (grab, gimg->img_number-1, NULL);
+	else
+		gimg_old = grab_get_image (gimg->img_number-1, NULL);
 
 	if (gimg_old) {
 		imgs[0] = &gimg_old->img;
@@ -553,17 +582,22 @@ static BOOL sclas_process (plugDefinition *plug, char *ident, plugData *data)
 		char *class_plug = NULL;
 		uchar *reg_img;
 
-		if (opt_values.class_mode > 0)
-			class_plug = class_mode_names[opt_values.class_mode];
+		if (plug->values.class_mode > 0)
+			class_plug = plug->class_mode_names[plug->values.class_mode];
 
-		check_buffer (imgs[0]->width, imgs[0]->height);
+		check_buffer (plug, imgs[0]->width, imgs[0]->height);
 		gui_check_exit (FALSE);
-		reg_img = do_image (imgs, actImg, class_plug);
+		reg_img = do_image (plug, imgs, actImg, class_plug);
 		gui_check_exit (FALSE);
-		get_regions (reg_img, gimg, class_plug);
+		get_regions (plug, reg_img, gimg, class_plug);
 	}
 
-	if (gimg_old) grab_release_image (gimg_old);
+	if (gimg_old) {
+		if (grab)
+			grab_release_image_from_plug (grab, gimg_old);
+		else
+			grab_release_image (gimg_old);
+	}
 
 	return TRUE;
 }
@@ -581,9 +615,23 @@ static plugDefinition plug_skinclass = {
   Called on load of the plugin. Returns the filled plugin definition
   structure and whether the plugin should be inserted at the start or
   at the end of the iceWing internal plugin list.
+  The first instance keeps the old plugin and option page names, all
+  further instances get the instance number appended.
 *********************************************************************/
 plugDefinition *iw_sclas_get_info (int instCount, BOOL *append)
 {
+	sclasPlugin *plug = calloc (1, sizeof(sclasPlugin));
+
+	plug->def = plug_skinclass;
+	if (instCount > 1) {
+		plug->def.name = g_strdup_printf ("%s%d", plug_skinclass.name, instCount);
+		plug->page_motion = g_strdup_printf ("%s%d", OPT_SKIN_MOTION, instCount);
+		plug->page_class = g_strdup_printf ("%s%d", OPT_SKIN_CLASS, instCount);
+	} else {
+		plug->page_motion = OPT_SKIN_MOTION;
+		plug->page_class = OPT_SKIN_CLASS;
+	}
+
 	*append = TRUE;
-	return &plug_skinclass;
+	return (plugDefinition*)plug;
 }
@@ -27,10 +27,17 @@
 #ifndef iw_skinclass_H
 #define iw_skinclass_H
 
+#include "main/plugin.h"
 #include "sclas_image.h"
 
-typedef BOOL (*sclasClassifyFunc) (iwImage *img, uchar *d, int pix_cnt, int size, int thresh);
-typedef void (*sclasUpdateFunc) (iwImage *img, int *ireg, iwRegion *regions, int numregs);
+/* Functions registered by the classifier plugins, plug is the
+   plugin instance which registered the function */
+typedef BOOL (*sclasClassifyFunc) (plugDefinition *plug, iwImage *img, uchar *d,
+								   int pix_cnt, int size, int thresh);
+typedef void (*sclasUpdateFunc) (plugDefinition *plug, iwImage *img, int *ireg,
+								 iwRegion *regions, int numregs);
+/* Function registered under SCLAS_IDENT_REGION */
+typedef void (*sclasRegionFunc) (iwImage *img, int *ireg, iwRegion *regions, int numregs);
 
 #define SCLAS_IDENT_CLASSIFY	"classify"
 #define SCLAS_IDENT_UPDATE		"update"
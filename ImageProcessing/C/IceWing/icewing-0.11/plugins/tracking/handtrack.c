@@ -50,9 +50,9 @@ static plugDefinition plug_tracking;
 
 static track_global_t global;             /* Lokale Variablen */
 static track_visual_t visual;             /* Dto. fuer Visualisierung */
-static tracker_t      **trk = NULL;       /* Die Tracker */
+static tracker_list_t trackers;           /* Die Tracker */
 static opt_values_t   opt_values;         /* Optionen aus der GUI */
-static track_imp_t    track_imp[3]={{NULL,NULL,NULL,NULL,NULL}};
+static track_imp_t    track_imp[3]={{NULL,NULL,NULL,NULL,NULL,NULL,NULL}};
 
 /*********************************************************************
   Return TRUE if tracking filter has good judgement.
@@ -84,7 +84,7 @@ static void track_cb_main (plugDefinition *plug)
 *********************************************************************/
 void track_clearAll (void)
 {
-	tracker_clear_all (trk);
+	tracker_clear_all (trackers.trk, trackers.cnt);
 }
 
 /*********************************************************************
@@ -180,12 +180,15 @@ static void help (void)
 			 "Track regions with a kalman filter.\n"
 			 "\n"
 			 "Usage of the %s plugin:\n"
-			 "     [-s stream][-o]\n"
+			 "     [-s stream][-o][-d]\n"
 			 "-s       read regions from the DACS regionHyp stream\n"
 			 "-o       output tracking results on streams\n"
-			 "         <%s>_track, <%s>_points, and <%s>_points2\n",
+			 "         <%s>_track, <%s>_points, and <%s>_points2\n"
+			 "-d       output on <%s>_track only the trajectory points added\n"
+			 "         since the last output (plus the last point of the last\n"
+			 "         output), HT_FIRST gives the index of the first point\n",
 			 plug_tracking.name, ICEWING_NAME, plug_tracking.name,
-			 IW_DACSNAME, IW_DACSNAME, IW_DACSNAME);
+			 IW_DACSNAME, IW_DACSNAME, IW_DACSNAME, IW_DACSNAME);
 	gui_exit (1);
 }
 
@@ -194,7 +197,7 @@ static void help (void)
   <dname>_track and <dname>_points and the input stream
   <source_region>.
 *********************************************************************/
-#define ARG_TEMPLATE "-S:Sr -O:O -H:H"
+#define ARG_TEMPLATE "-S:Sr -O:O -D:D -H:H"
 static void track_init (plugDefinition *plug, grabParameter *para, int argc, char **argv)
 {
 	struct timeval time;
@@ -204,6 +207,7 @@ static void track_init (plugDefinition *plug, grabParameter *para, int argc, cha
 
 	visual.parameter.out_track = NULL;
 	visual.parameter.in_regions = NULL;
+	visual.parameter.out_delta = FALSE;
 	for (i=0; i<VIS_TRAJECT_CNT; i++) {
 		visual.traject[i].traject = NULL;
 		visual.traject[i].stream = NULL;
@@ -226,6 +230,9 @@ static void track_init (plugDefinition *plug, grabParameter *para, int argc, cha
 					iw_output_register_stream ("_points2",
 											   (NDRfunction_t*)ndr_Trajectory);
 				break;
+			case 'D':
+				visual.parameter.out_delta = TRUE;
+				break;
 			case 'H':
 			case '\0':
 				help();
@@ -241,9 +248,7 @@ static void track_init (plugDefinition *plug, grabParameter *para, int argc, cha
 	global.dt_min = 40;
 
 	/* Allokation des Speichers fuer Tracker, Trajektorien,... */
-	trk = (tracker_t**)malloc(sizeof(tracker_t*)*MAXKALMAN);
-	for (nr=0; nr<MAXKALMAN; nr++)
-		trk[nr] = tracker_create();
+	tracker_list_init (&trackers, TRACKER_START_CNT);
 
 	if (visual.parameter.in_regions) {
 		plug_observ_data (plug, "start");
@@ -265,18 +270,14 @@ static void track_cleanup (plugDefinition *plug)
 		}
 	}
 
-	if (trk) {
-		for (i=0; i<MAXKALMAN; i++)
-			tracker_free (trk[i]);
-		free (trk);
-		trk = NULL;
-	}
+	if (trackers.trk)
+		tracker_list_free (&trackers, track_imp[global.track_type_last].special_free);
 }
 
 /*********************************************************************
   Ausgabe der Tracker-Zustaende.
 *********************************************************************/
-static void tracker_output_traject (tracker_t **trk, opt_values_t *opt_values,
+static void tracker_output_traject (tracker_t **trk, int trk_cnt, opt_values_t *opt_values,
 									track_visual_t *visual, int track_type)
 {
 	/*
@@ -291,7 +292,7 @@ static void tracker_output_traject (tracker_t **trk, opt_values_t *opt_values,
 
 	if (!visual->traject[0].stream) return;
 
-	for (i=0; i<MAXKALMAN; i++) {
+	for (i=0; i<trk_cnt; i++) {
 		/* Ermittlung der beiden best-bewertetesten Tracker, die ausgegeben werden sollen
 		if (track_is_valid(trk[i]->judge->judgement) && trk[i]->judge->judgement > max2) {
 			if (trk[i]->judge->judgement > max) {
@@ -377,12 +378,39 @@ static void tracker_output_traject (tracker_t **trk, opt_values_t *opt_values,
 	}
 }
 
+/*********************************************************************
+  Output the trajectory ring of tracker trk on the stream
+  <parameter.out_track>. With parameter.out_delta only the points
+  added since the last output are given out.
+*********************************************************************/
+static void track_output_traject (traject_ring_t *ring, tracker_t *trk, char *prefix,
+								  grabImageData *gimg)
+{
+	char buf[150];
+	iwRegion reg;
+	int first;
+
+	if (ring->reg.r.polygon.n_punkte <= 0)
+		return;
+	if (!visual.parameter.out_delta) {
+		iw_output_regions (&ring->reg, 1, gimg->time, gimg->img_number,
+						   track_getDataString (trk, prefix, &global),
+						   visual.parameter.out_track);
+		return;
+	}
+	traject_delta (ring, &reg, &first);
+	sprintf (buf, "%s HT_FIRST: %d", track_getDataString (trk, prefix, &global), first);
+	iw_output_regions (&reg, 1, gimg->time, gimg->img_number, buf,
+					   visual.parameter.out_track);
+}
+
 /*********************************************************************
   Do a tracking loop and output the results on the stream
   opened by track_init().
 *********************************************************************/
 void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 {
+	tracker_t **trk;
 	int i, numTracker = 0;
 	unsigned int last_time;
 	int track_type = opt_values.track_type;
@@ -395,24 +423,25 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 	if (global.track_type_last != track_type) {
 		iw_debug (2, "Switched tracking type.");
 		/* Clear old data */
-		for (i=0; i<MAXKALMAN; i++) {
-			tracker_remove (trk[i]);
-			trk[i]->status = Prepare;
+		for (i=0; i<trackers.cnt; i++) {
+			tracker_remove (trackers.trk[i]);
+			trackers.trk[i]->status = Prepare;
 
 			/* Free old special tracker data */
-			if (track_imp[global.track_type_last].special_init)
-				track_imp[global.track_type_last].special_init (trk[i]);
+			if (track_imp[global.track_type_last].special_free)
+				track_imp[global.track_type_last].special_free (trackers.trk[i]);
 
 			/* Init special tracker data */
 			if (track_imp[track_type].special_init)
-				track_imp[track_type].special_init (trk[i]);
+				track_imp[track_type].special_init (trackers.trk[i]);
 		}
 	}
 
 	global.track_type_last = track_type;
+	trackers.special_init = track_imp[track_type].special_init;
 
 	if (opt_values.clear_do) {
-		tracker_clear_all (trk);
+		tracker_clear_all (trackers.trk, trackers.cnt);
 		opt_values.clear_do = FALSE;
 	}
 
@@ -421,25 +450,34 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 	last_time = global.cur_time;
 	global.cur_time = gimg->time.tv_sec*1000 + gimg->time.tv_usec/1000;
 
-	if (trk == NULL)
+	if (trackers.trk == NULL)
 		iw_error ("No tracker structure");
+	trk = trackers.trk;
 
 	/* Praediziere die vermutete Position */
-	for (i=0; i<MAXKALMAN; i++)
-		if (trk[i]->status == Run)
-			track_imp[track_type].predict (trk[i], &opt_values, &global);
+	if (track_imp[track_type].predict_all) {
+		track_imp[track_type].predict_all (trk, trackers.cnt, &opt_values, &global);
+	} else {
+		for (i=0; i<trackers.cnt; i++)
+			if (trk[i]->status == Run)
+				track_imp[track_type].predict (trk[i], &opt_values, &global);
+	}
 
 	/* Finde die guenstigste Zuordnung der Regionen zu den
 	   Trackern auf Grund der praedizierten Positionen */
-	tracker_all_mapRegions (trk, regions, numregs, &opt_values, &global);
+	tracker_all_mapRegions (&trackers, regions, numregs, &opt_values, &global);
+	trk = trackers.trk;
 
 	/* Falls fuer einen Tracker eine Zuordnung zustande kam,
 	   wird der Schaetzwert der Position anhand der Messung korrigiert */
+	if (track_imp[track_type].correct_all)
+		track_imp[track_type].correct_all (trk, trackers.cnt, &opt_values, &global);
 	numTracker = 0;
-	for (i=0; i<MAXKALMAN; i++) {
+	for (i=0; i<trackers.cnt; i++) {
 
 		if (trk[i]->work->region_zugeordnet) {
-			track_imp[track_type].correct (trk[i], &opt_values, &global);
+			if (!track_imp[track_type].correct_all)
+				track_imp[track_type].correct (trk[i], &opt_values, &global);
 		} else {
 			trk[i]->status = Prepare;
 			tracker_traject_free (trk[i]);
@@ -451,7 +489,7 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 	}
 	iw_debug (2, "Duration: %d, No. tracker: %d", global.cur_time - last_time, numTracker);
 
-	tracker_all_judge (trk, regions, numregs, &opt_values, global.cur_time);
+	tracker_all_judge (trk, trackers.cnt, regions, numregs, &opt_values, global.cur_time);
 
 	/* Streams rausschicken */
 	if (visual.parameter.out_track) {
@@ -460,7 +498,7 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 		  regions, trajektorie_hand, trajektorie_predict, trajektorie_kalman:
 		  judgement = regions[ht[j]->best_match_region].judgement
 		  stabilitaet = ht[j]->judgement
-		  id = j  [0..MAXKALMAN-1]
+		  id = j  [0..trackers.cnt-1]
 		  alter = rintf((cur_time - ht[j]->init_zeit) / global.dt_min);
 
 		  trajektorie_hand, trajektorie_predict, trajektorie_kalman:
@@ -470,46 +508,35 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 		iw_output_regions (regions, numregs, gimg->time, gimg->img_number,
 						   IW_GHYP_TITLE, visual.parameter.out_track);
 
-		for (i=0; i<MAXKALMAN; i++) {
+		for (i=0; i<trackers.cnt; i++) {
 			if (! trk[i]->work->region_zugeordnet || trk[i]->status!=Run)
 				continue;
-			if (opt_values.handtrajekt && trk[i]->traject->tracker.r.polygon.n_punkte > 0)
-				iw_output_regions (&trk[i]->traject->tracker, 1, gimg->time,
-								   gimg->img_number,
-								   track_getDataString(trk[i], "hand", &global),
-								   visual.parameter.out_track);
-
-			if (opt_values.kalmanpredict && trk[i]->traject->predict.r.polygon.n_punkte > 0)
-				iw_output_regions (&trk[i]->traject->predict, 1, gimg->time,
-								   gimg->img_number,
-								   track_getDataString(trk[i], "predict", &global),
-								   visual.parameter.out_track);
-
-			if (opt_values.kalmantrajekt && trk[i]->traject->correct.r.polygon.n_punkte > 0)
-				iw_output_regions (&trk[i]->traject->correct, 1, gimg->time,
-								   gimg->img_number,
-								   track_getDataString(trk[i], "kalman", &global),
-								   visual.parameter.out_track);
+			if (opt_values.handtrajekt)
+				track_output_traject (&trk[i]->traject->tracker, trk[i], "hand", gimg);
+			if (opt_values.kalmanpredict)
+				track_output_traject (&trk[i]->traject->predict, trk[i], "predict", gimg);
+			if (opt_values.kalmantrajekt)
+				track_output_traject (&trk[i]->traject->correct, trk[i], "kalman", gimg);
 		}
 		iw_output_sync (visual.parameter.out_track);
 	}
 
 	/* Trajektorien der Tracker-Zustaende rausschicken */
-	tracker_output_traject (trk, &opt_values, &visual, track_type);
+	tracker_output_traject (trk, trackers.cnt, &opt_values, &visual, track_type);
 
 	if (visual.b_region->window) {
 
 		int cnt = 0, lcnt = 0;
-		prevData data[MAXKALMAN*4];
-		prevDataLine lines[MAXKALMAN];
+		prevData *data = iw_malloc (sizeof(prevData)*trackers.cnt*4, "tracker display");
+		prevDataLine *lines = iw_malloc (sizeof(prevDataLine)*trackers.cnt, "tracker display");
 
-		for (i=0; i<MAXKALMAN; i++)
+		for (i=0; i<trackers.cnt; i++)
 			if (trk[i]->work->region_zugeordnet && trk[i]->status == Run) {
-				if (opt_values.handtrajekt && trk[i]->traject->tracker.r.polygon.n_punkte > 0) {
+				if (opt_values.handtrajekt && trk[i]->traject->tracker.reg.r.polygon.n_punkte > 0) {
 					data[cnt].type = PREV_REGION;
-					data[cnt++].data = &trk[i]->traject->tracker;
+					data[cnt++].data = &trk[i]->traject->tracker.reg;
 				}
-				if (opt_values.kalmanpredict && trk[i]->traject->predict.r.polygon.n_punkte > 0) {
+				if (opt_values.kalmanpredict && trk[i]->traject->predict.reg.r.polygon.n_punkte > 0) {
 					lines[lcnt].ctab = IW_INDEX;
 					lines[lcnt].r = rot;
 					lines[lcnt].x1 = (int)trk[i]->pos->predict.x-25;
@@ -520,11 +547,11 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 					data[cnt++].data = &lines[lcnt++];
 
 					data[cnt].type = PREV_REGION;
-					data[cnt++].data = &trk[i]->traject->predict;
+					data[cnt++].data = &trk[i]->traject->predict.reg;
 				}
-				if (opt_values.kalmantrajekt && trk[i]->traject->correct.r.polygon.n_punkte > 0) {
+				if (opt_values.kalmantrajekt && trk[i]->traject->correct.reg.r.polygon.n_punkte > 0) {
 					data[cnt].type = PREV_REGION;
-					data[cnt++].data = &trk[i]->traject->correct;
+					data[cnt++].data = &trk[i]->traject->correct.reg;
 				}
 			}
 		/* White background for snapshots's? */
@@ -537,15 +564,17 @@ void track_do_tracking (iwRegion *regions, int numregs, grabImageData *gimg)
 							 visual.width, visual.height);
 		prev_render_set (visual.b_region, data, cnt, 0,
 						 visual.width, visual.height);
+		free (data);
+		free (lines);
 
 		if (opt_values.deriv_kind)
-			for (i=0; i<MAXKALMAN; i++)
+			for (i=0; i<trackers.cnt; i++)
 				if (trk[i]->work->region_zugeordnet && trk[i]->status == Run) {
-					if (opt_values.handtrajekt && trk[i]->traject->tracker.r.polygon.n_punkte > 0)
-						track_show_derivative (&visual, &trk[i]->traject->tracker.r.polygon,
+					if (opt_values.handtrajekt && trk[i]->traject->tracker.reg.r.polygon.n_punkte > 0)
+						track_show_derivative (&visual, &trk[i]->traject->tracker.reg.r.polygon,
 											   opt_values.deriv_kind);
-					if (opt_values.kalmantrajekt && trk[i]->traject->correct.r.polygon.n_punkte > 0)
-						track_show_derivative (&visual, &trk[i]->traject->correct.r.polygon,
+					if (opt_values.kalmantrajekt && trk[i]->traject->correct.reg.r.polygon.n_punkte > 0)
+						track_show_derivative (&visual, &trk[i]->traject->correct.reg.r.polygon,
 											   opt_values.deriv_kind);
 				}
 		prev_draw_buffer (visual.b_region);
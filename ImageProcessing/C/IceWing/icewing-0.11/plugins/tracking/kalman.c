@@ -23,209 +23,161 @@
 
 #include "config.h"
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
 #include "kalman.h"
 
-kalman_t *kalman_create (void)
-{
-	int i,j;
-	kalman_t *kalman;
-	int      dim_x, dim_z;
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define KALMAN_SSE2
+#include <emmintrin.h>
+#define KALMAN_TARGET(t)	__attribute__((target(t)))
+#endif
 
-#ifdef KOHLER
-	dim_x = 4;
+/* Number of arrays over all lanes in kalman_t */
+#define KALMAN_ARRAYS		(2*KALMAN_ORDER + 2*KALMAN_DIM_P + 4)
+
+static BOOL simd_enabled = TRUE;	/* Set by kalman_set_simd() */
+
+/*********************************************************************
+  Return TRUE if the CPU supports SSE2.
+*********************************************************************/
+static BOOL kalman_simd_cpu (void)
+{
+#ifdef KALMAN_SSE2
+	static int simd = -1;
+	if (simd < 0) {
+		__builtin_cpu_init();
+		simd = __builtin_cpu_supports ("sse2") ? 1 : 0;
+	}
+	return simd;
 #else
-	dim_x = 6;
+	return FALSE;
 #endif
-	dim_z = 2;
-
-	kalman = (kalman_t*) malloc(sizeof(kalman_t));
-	kalman->x_predict = iw_create_matrix(dim_x,1);
-	kalman->x_correct = iw_create_matrix(dim_x,1);
-	kalman->P_predict = iw_create_matrix(dim_x,dim_x);
-	kalman->P_correct = iw_create_matrix(dim_x,dim_x);
-	kalman->K = iw_create_matrix(dim_x,dim_z);
-	kalman->z = iw_create_matrix(dim_z,1);
-	kalman->A = iw_create_matrix(dim_x,dim_x);
-	kalman->A_trans = iw_create_matrix(dim_x,dim_x);
-	kalman->H = iw_create_matrix(dim_z,dim_x);
-	kalman->H_trans = iw_create_matrix(dim_x,dim_z);
-	kalman->Q = iw_create_matrix(dim_x,dim_x);
-	kalman->R = iw_create_matrix(dim_z,dim_z);
-	kalman->I = iw_create_matrix(dim_x,dim_x);
-	for (i=0;i < kalman->I->rows;i++)
-		for (j=0;j < kalman->I->cols;j++)
-			kalman->I->elem[i][j] = ((i==j) ? 1.0 : 0.0);
-
-	return kalman;
 }
 
-void kalman_free (kalman_t *kalman)
+/*********************************************************************
+  Enable or disable the SSE2 version of the time and measurement
+  update (default: enabled).
+  Return: TRUE if the CPU supports SSE2.
+*********************************************************************/
+BOOL kalman_set_simd (BOOL enable)
 {
-	iw_free_matrix(kalman->x_predict);
-	iw_free_matrix(kalman->x_correct);
-	iw_free_matrix(kalman->P_predict);
-	iw_free_matrix(kalman->P_correct);
-	iw_free_matrix(kalman->K);
-	iw_free_matrix(kalman->z);
-	iw_free_matrix(kalman->A);
-	iw_free_matrix(kalman->A_trans);
-	iw_free_matrix(kalman->H);
-	iw_free_matrix(kalman->H_trans);
-	iw_free_matrix(kalman->Q);
-	iw_free_matrix(kalman->R);
-	iw_free_matrix(kalman->I);
-
-	free(kalman);
-	kalman = NULL;
+	simd_enabled = enable;
+	return kalman_simd_cpu();
 }
 
-void kalman_init_handtrack (kalman_t *kalman,
-							double x, double y, double vx, double vy , double ax, double ay,
-							double q, double r, double P, double t)
+/*********************************************************************
+  Let the lane arrays of kalman point into mem, which holds
+  KALMAN_ARRAYS arrays of lanes values.
+*********************************************************************/
+static void kalman_set_arrays (kalman_t *kalman, double *mem, int lanes)
 {
-	register int i;
-	register int j;
-	
-#ifdef KOHLER
-	float a_2;
-#endif
+	int i;
 
-	kalman->x_predict->elem[0][0] = x;
-	kalman->x_predict->elem[1][0] = y;
-	kalman->x_predict->elem[2][0] = vx;
-	kalman->x_predict->elem[3][0] = vy;
-#ifndef KOHLER
-	kalman->x_predict->elem[4][0] = ax;
-	kalman->x_predict->elem[5][0] = ay;
-#endif
-	for(i=0; i < kalman->P_predict->rows; i++) {
-		for(j=0; j < kalman->P_predict->cols; j++) {
-			kalman->P_predict->elem[i][j] = ((i==j) ? P : 0.0);
-		}
+	kalman->mem = mem;
+	for (i=0; i<KALMAN_ORDER; i++) {
+		kalman->x_predict[i] = mem; mem += lanes;
+		kalman->x_correct[i] = mem; mem += lanes;
 	}
-
-	for(i=0; i < kalman->A->rows; i++) {
-		for(j=0; j < kalman->A->cols; j++) {
-			if (i==j)
-				kalman->A->elem[i][j] = 1.0;
-			else if (j==i+2)
-				kalman->A->elem[i][j] = 1.0;
-			else if (j==i+4)
-				kalman->A->elem[i][j] = 0.5;
-			else
-				kalman->A->elem[i][j] = 0.0;
-		}
+	for (i=0; i<KALMAN_DIM_P; i++) {
+		kalman->P_predict[i] = mem; mem += lanes;
+		kalman->P_correct[i] = mem; mem += lanes;
 	}
-	iw_transpose_matrix(kalman->A, kalman->A_trans);
+	kalman->z = mem; mem += lanes;
+	kalman->t = mem; mem += lanes;
+	kalman->q = mem; mem += lanes;
+	kalman->r = mem;
+}
 
-	/*nur die Position uebernehmen, alles weitere schaetzen....*/
-	for(i=0; i < kalman->H->rows; i++) {
-		for(j=0; j < kalman->H->cols; j++) {
-			kalman->H->elem[i][j] = ((i==j) ? 1.0 : 0.0);
-		}
-	}
+kalman_t *kalman_create (int size)
+{
+	kalman_t *kalman = iw_malloc0 (sizeof(kalman_t), "kalman");
 
-	iw_transpose_matrix(kalman->H, kalman->H_trans);
+	kalman_resize (kalman, size);
+	return kalman;
+}
 
-#ifdef KOHLER
-	a_2 = q * q;
-	kalman->Q->elem[0][0] = (a_2*t*t*t)/3;
-	kalman->Q->elem[1][1] = (a_2*t*t*t)/3;
-	kalman->Q->elem[2][2] = (a_2*t);
-	kalman->Q->elem[3][3] = (a_2*t);
-
-	kalman->Q->elem[0][2] = (a_2*t*t)/2;
-	kalman->Q->elem[1][3] = (a_2*t*t)/2;
-	kalman->Q->elem[2][0] = (a_2*t*t)/2;
-	kalman->Q->elem[3][1] = (a_2*t*t)/2;
-#else
-	for (i=0; i < kalman->Q->rows; i++) {
-		for (j=0; j < kalman->Q->cols; j++) {
-			kalman->Q->elem[i][j] = ((i==j) ? q : 0.0);
-		}
-	}
-#endif
+void kalman_resize (kalman_t *kalman, int size)
+{
+	int i, old_lanes = kalman->size*2, lanes = size*2;
+	double *mem;
 
-	for (i=0; i < kalman->R->rows; i++) {
-		for (j=0; j < kalman->R->cols; j++) {
-			kalman->R->elem[i][j] = ((i==j) ? r : 0.0);
-		}
+	if (size == kalman->size) return;
+
+	mem = iw_malloc0 (sizeof(double)*KALMAN_ARRAYS*MAX(lanes, 1), "kalman states");
+	if (kalman->mem) {
+		int cnt = MIN(old_lanes, lanes);
+		for (i=0; i<KALMAN_ARRAYS; i++)
+			memcpy (mem + i*lanes, kalman->mem + i*old_lanes, sizeof(double)*cnt);
+		free (kalman->mem);
 	}
-}
+	kalman_set_arrays (kalman, mem, lanes);
 
+	kalman->active = iw_realloc (kalman->active, MAX(size, 1), "kalman active flags");
+	if (size > kalman->size)
+		memset (kalman->active+kalman->size, 0, size-kalman->size);
+	kalman->size = size;
+}
 
-void kalman_setPeriode (kalman_t *kalman, double t,double q)
+void kalman_free (kalman_t *kalman)
 {
-	register int i,j;
-#ifdef KOHLER
-	float a_2;
-#endif
+	if (!kalman) return;
 
-	for (i=0; i < kalman->A->rows; i++)
-		for (j=0; j < kalman->A->cols; j++) {
-			if (i==j)
-				kalman->A->elem[i][j] = 1.0;
-			else if (j==i+2)
-				kalman->A->elem[i][j] = t;
-			else if (j==i+4)
-				kalman->A->elem[i][j] = 0.5*t*t;
-			else
-				kalman->A->elem[i][j] = 0.0;
-		}
-	iw_transpose_matrix(kalman->A, kalman->A_trans);
-#ifdef KOHLER
-	a_2 = q * q;
+	free (kalman->mem);
+	free (kalman->active);
+	free (kalman);
+}
 
-	kalman->Q->elem[0][0] = (a_2*t*t*t)/3;
-	kalman->Q->elem[1][1] = (a_2*t*t*t)/3;
-	kalman->Q->elem[2][2] = (a_2*t);
-	kalman->Q->elem[3][3] = (a_2*t);
+void kalman_init_handtrack (kalman_t *kalman, int i,
+							double x, double y, double vx, double vy , double ax, double ay,
+							double q, double r, double P, double t)
+{
+	int j, l;
 
-	kalman->Q->elem[0][2] = (a_2*t*t)/2;
-	kalman->Q->elem[1][3] = (a_2*t*t)/2;
-	kalman->Q->elem[2][0] = (a_2*t*t)/2;
-	kalman->Q->elem[3][1] = (a_2*t*t)/2;
+	KALMAN_ELEM(kalman->x_predict, i, 0) = x;
+	KALMAN_ELEM(kalman->x_predict, i, 1) = y;
+	KALMAN_ELEM(kalman->x_predict, i, 2) = vx;
+	KALMAN_ELEM(kalman->x_predict, i, 3) = vy;
+#ifndef KOHLER
+	KALMAN_ELEM(kalman->x_predict, i, 4) = ax;
+	KALMAN_ELEM(kalman->x_predict, i, 5) = ay;
 #endif
+	for (l=2*i; l<2*i+2; l++) {
+		/* Diagonal elements of the packed upper triangle */
+		for (j=0; j<KALMAN_DIM_P; j++)
+			kalman->P_predict[j][l] = 0.0;
+		kalman->P_predict[0][l] = P;
+		kalman->P_predict[KALMAN_ORDER][l] = P;
+#ifndef KOHLER
+		kalman->P_predict[KALMAN_DIM_P-1][l] = P;
+#endif
+		kalman->t[l] = t;
+		kalman->q[l] = q;
+		kalman->r[l] = r;
+	}
 }
 
-int kalman_change_Q_and_R(kalman_t *kalman, double new_q, double new_r)
+void kalman_setPeriode (kalman_t *kalman, int i, double t, double q)
 {
-	register int i, j;
-
+	kalman->t[2*i] = kalman->t[2*i+1] = t;
 #ifdef KOHLER
-	float a_2;
-	float t = 40.0;
-
-	printf("Test2\n");
-	if (kalman->Q->elem[0][2] > 0.0) {
-	    t = (3/2) * (kalman->Q->elem[0][0]/kalman->Q->elem[0][2]);
-	    printf("\n t: %f\n",t);
-	}
-	a_2 = new_q * new_q;
-
-	kalman->Q->elem[0][0] = (a_2*t*t*t)/3;
-	kalman->Q->elem[1][1] = (a_2*t*t*t)/3;
-	kalman->Q->elem[2][2] = (a_2*t);
-	kalman->Q->elem[3][3] = (a_2*t);
-
-	kalman->Q->elem[0][2] = (a_2*t*t)/2;
-	kalman->Q->elem[1][3] = (a_2*t*t)/2;
-	kalman->Q->elem[2][0] = (a_2*t*t)/2;
-	kalman->Q->elem[3][1] = (a_2*t*t)/2;
-#else
-	for (i=0; i < kalman->Q->rows; i++)
-		for (j=0; j < kalman->Q->cols; j++)
-			kalman->Q->elem[i][j] = (i==j) ? new_q : 0.0;
+	kalman->q[2*i] = kalman->q[2*i+1] = q;
 #endif
+}
 
-	for (i=0; i < kalman->R->rows; i++)
-		for (j=0; j < kalman->R->cols; j++)
-			kalman->R->elem[i][j] = (i==j) ? new_r : 0.0;
-
+int kalman_change_Q_and_R (kalman_t *kalman, int i, double new_q, double new_r)
+{
+	kalman->q[2*i] = kalman->q[2*i+1] = new_q;
+	kalman->r[2*i] = kalman->r[2*i+1] = new_r;
 	return 0;
 }
 
+void kalman_set_measurement (kalman_t *kalman, int i, double x, double y)
+{
+	kalman->z[2*i] = x;
+	kalman->z[2*i+1] = y;
+}
+
 /*
 execution of Kalman calculation:
 
@@ -236,35 +188,42 @@ K = --------------
 x_correct = x + K * (z - H * x)
 
 P_correct = (I - K * H) * P
+
+H only selects the position of every axis, so H * P * H' + R is
+the scalar P[0][0] + r per axis and K is the first column of P
+divided by it.
 */
-int kalman_measurementUpdate(kalman_t *kalman)
+static void kalman_measurement_lane (kalman_t *k, int l)
 {
-	matrix_t *erg1, *erg2, *erg3;
-
-	erg1 = iw_multMatrix(kalman->H, kalman->P_predict);
-	erg2 = iw_multMatrix(erg1, kalman->H_trans);
-	iw_add_matrix(erg2, kalman->R, erg1);
-	iw_invert_matrix(erg1, erg2);
-	erg3 = iw_multMatrix(kalman->P_predict, kalman->H_trans);
-	iw_mult_matrix(erg3, erg2, erg1);
-	iw_assign_matrix(erg1, kalman->K);
-
-	iw_mult_matrix(kalman->H, kalman->x_predict, erg1);
-	iw_sub_matrix(kalman->z, erg1, erg2);
-	iw_mult_matrix(kalman->K, erg2, erg1);
-	iw_add_matrix(kalman->x_predict, erg1, erg2);
-	iw_assign_matrix(erg2, kalman->x_correct);
-
-	iw_mult_matrix(kalman->K, kalman->H, erg1);
-	iw_sub_matrix(kalman->I, erg1, erg2);
-	iw_mult_matrix(erg2, kalman->P_predict, erg1);
-	iw_assign_matrix(erg1, kalman->P_correct);
-
-	iw_free_matrix(erg1);
-	iw_free_matrix(erg2);
-	iw_free_matrix(erg3);
+	double s = 1.0 / (k->P_predict[0][l] + k->r[l]);
+	double y = k->z[l] - k->x_predict[0][l];
+	double p00 = k->P_predict[0][l], p01 = k->P_predict[1][l];
+	double k0 = p00*s, k1 = p01*s;
+#ifdef KOHLER
+	double p11 = k->P_predict[2][l];
 
-	return 0;
+	k->x_correct[0][l] = k->x_predict[0][l] + k0*y;
+	k->x_correct[1][l] = k->x_predict[1][l] + k1*y;
+
+	k->P_correct[0][l] = p00 - k0*p00;
+	k->P_correct[1][l] = p01 - k0*p01;
+	k->P_correct[2][l] = p11 - k1*p01;
+#else
+	double p02 = k->P_predict[2][l], p11 = k->P_predict[3][l];
+	double p12 = k->P_predict[4][l], p22 = k->P_predict[5][l];
+	double k2 = p02*s;
+
+	k->x_correct[0][l] = k->x_predict[0][l] + k0*y;
+	k->x_correct[1][l] = k->x_predict[1][l] + k1*y;
+	k->x_correct[2][l] = k->x_predict[2][l] + k2*y;
+
+	k->P_correct[0][l] = p00 - k0*p00;
+	k->P_correct[1][l] = p01 - k0*p01;
+	k->P_correct[2][l] = p02 - k0*p02;
+	k->P_correct[3][l] = p11 - k1*p01;
+	k->P_correct[4][l] = p12 - k1*p02;
+	k->P_correct[5][l] = p22 - k2*p02;
+#endif
 }
 
 /*
@@ -272,22 +231,180 @@ x_predict = A * x
 
 P_predict = A * P * A' + Q
 
+A is per axis the identity plus t for the velocity (and 0.5*t*t for
+the acceleration) in the row above, so A * P * A' is expanded by hand.
 */
+static void kalman_time_lane (kalman_t *k, int l)
+{
+	double t = k->t[l], q = k->q[l];
+#ifdef KOHLER
+	double a_2 = q*q;
+	double p00 = k->P_correct[0][l], p01 = k->P_correct[1][l], p11 = k->P_correct[2][l];
+	double b00 = p00 + t*p01, b01 = p01 + t*p11;
+
+	k->x_predict[0][l] = k->x_correct[0][l] + t*k->x_correct[1][l];
+	k->x_predict[1][l] = k->x_correct[1][l];
+
+	k->P_predict[0][l] = b00 + t*b01 + (a_2*t*t*t)/3;
+	k->P_predict[1][l] = b01 + (a_2*t*t)/2;
+	k->P_predict[2][l] = p11 + a_2*t;
+#else
+	double h = 0.5*t*t;
+	double p00 = k->P_correct[0][l], p01 = k->P_correct[1][l], p02 = k->P_correct[2][l];
+	double p11 = k->P_correct[3][l], p12 = k->P_correct[4][l], p22 = k->P_correct[5][l];
+	double b00 = p00 + t*p01 + h*p02;
+	double b01 = p01 + t*p11 + h*p12;
+	double b02 = p02 + t*p12 + h*p22;
+	double b11 = p11 + t*p12;
+	double b12 = p12 + t*p22;
+	double x1 = k->x_correct[1][l], x2 = k->x_correct[2][l];
+
+	k->x_predict[0][l] = k->x_correct[0][l] + t*x1 + h*x2;
+	k->x_predict[1][l] = x1 + t*x2;
+	k->x_predict[2][l] = x2;
+
+	k->P_predict[0][l] = b00 + t*b01 + h*b02 + q;
+	k->P_predict[1][l] = b01 + t*b02;
+	k->P_predict[2][l] = b02;
+	k->P_predict[3][l] = b11 + t*b12 + q;
+	k->P_predict[4][l] = b12;
+	k->P_predict[5][l] = p22 + q;
+#endif
+}
+
+#ifdef KALMAN_SSE2
+
+#define LD(a)		_mm_loadu_pd(&(a)[l])
+#define ST(a,v)		_mm_storeu_pd(&(a)[l], v)
+#define ADD(a,b)	_mm_add_pd(a,b)
+#define SUB(a,b)	_mm_sub_pd(a,b)
+#define MUL(a,b)	_mm_mul_pd(a,b)
+
+/*********************************************************************
+  SSE2 version of kalman_measurement_lane() for the two lanes l, l+1
+  (the x and the y axis of one tracker).
+*********************************************************************/
+static KALMAN_TARGET("sse2") void kalman_measurement_sse2 (kalman_t *k, int l)
+{
+	__m128d s = _mm_div_pd (_mm_set1_pd(1.0), ADD(LD(k->P_predict[0]), LD(k->r)));
+	__m128d y = SUB(LD(k->z), LD(k->x_predict[0]));
+	__m128d p00 = LD(k->P_predict[0]), p01 = LD(k->P_predict[1]);
+	__m128d k0 = MUL(p00, s), k1 = MUL(p01, s);
+#ifdef KOHLER
+	__m128d p11 = LD(k->P_predict[2]);
+
+	ST(k->x_correct[0], ADD(LD(k->x_predict[0]), MUL(k0, y)));
+	ST(k->x_correct[1], ADD(LD(k->x_predict[1]), MUL(k1, y)));
+
+	ST(k->P_correct[0], SUB(p00, MUL(k0, p00)));
+	ST(k->P_correct[1], SUB(p01, MUL(k0, p01)));
+	ST(k->P_correct[2], SUB(p11, MUL(k1, p01)));
+#else
+	__m128d p02 = LD(k->P_predict[2]), p11 = LD(k->P_predict[3]);
+	__m128d p12 = LD(k->P_predict[4]), p22 = LD(k->P_predict[5]);
+	__m128d k2 = MUL(p02, s);
+
+	ST(k->x_correct[0], ADD(LD(k->x_predict[0]), MUL(k0, y)));
+	ST(k->x_correct[1], ADD(LD(k->x_predict[1]), MUL(k1, y)));
+	ST(k->x_correct[2], ADD(LD(k->x_predict[2]), MUL(k2, y)));
+
+	ST(k->P_correct[0], SUB(p00, MUL(k0, p00)));
+	ST(k->P_correct[1], SUB(p01, MUL(k0, p01)));
+	ST(k->P_correct[2], SUB(p02, MUL(k0, p02)));
+	ST(k->P_correct[3], SUB(p11, MUL(k1, p01)));
+	ST(k->P_correct[4], SUB(p12, MUL(k1, p02)));
+	ST(k->P_correct[5], SUB(p22, MUL(k2, p02)));
+#endif
+}
 
-int kalman_timeUpdate(kalman_t *kalman)
+/*********************************************************************
+  SSE2 version of kalman_time_lane() for the two lanes l, l+1.
+*********************************************************************/
+static KALMAN_TARGET("sse2") void kalman_time_sse2 (kalman_t *k, int l)
 {
-	matrix_t *erg1, *erg2;
+	__m128d t = LD(k->t), q = LD(k->q);
+#ifdef KOHLER
+	__m128d a_2 = MUL(q, q), t2 = MUL(t, t);
+	__m128d p00 = LD(k->P_correct[0]), p01 = LD(k->P_correct[1]), p11 = LD(k->P_correct[2]);
+	__m128d b00 = ADD(p00, MUL(t, p01)), b01 = ADD(p01, MUL(t, p11));
+
+	ST(k->x_predict[0], ADD(LD(k->x_correct[0]), MUL(t, LD(k->x_correct[1]))));
+	ST(k->x_predict[1], LD(k->x_correct[1]));
 
-	erg1 = iw_multMatrix(kalman->A, kalman->x_correct);
-	iw_assign_matrix(erg1, kalman->x_predict);
+	ST(k->P_predict[0], ADD(ADD(b00, MUL(t, b01)),
+							_mm_div_pd (MUL(a_2, MUL(t2, t)), _mm_set1_pd(3.0))));
+	ST(k->P_predict[1], ADD(b01, _mm_div_pd (MUL(a_2, t2), _mm_set1_pd(2.0))));
+	ST(k->P_predict[2], ADD(p11, MUL(a_2, t)));
+#else
+	__m128d h = MUL(_mm_set1_pd(0.5), MUL(t, t));
+	__m128d p00 = LD(k->P_correct[0]), p01 = LD(k->P_correct[1]), p02 = LD(k->P_correct[2]);
+	__m128d p11 = LD(k->P_correct[3]), p12 = LD(k->P_correct[4]), p22 = LD(k->P_correct[5]);
+	__m128d b00 = ADD(ADD(p00, MUL(t, p01)), MUL(h, p02));
+	__m128d b01 = ADD(ADD(p01, MUL(t, p11)), MUL(h, p12));
+	__m128d b02 = ADD(ADD(p02, MUL(t, p12)), MUL(h, p22));
+	__m128d b11 = ADD(p11, MUL(t, p12));
+	__m128d b12 = ADD(p12, MUL(t, p22));
+	__m128d x1 = LD(k->x_correct[1]), x2 = LD(k->x_correct[2]);
+
+	ST(k->x_predict[0], ADD(ADD(LD(k->x_correct[0]), MUL(t, x1)), MUL(h, x2)));
+	ST(k->x_predict[1], ADD(x1, MUL(t, x2)));
+	ST(k->x_predict[2], x2);
+
+	ST(k->P_predict[0], ADD(ADD(ADD(b00, MUL(t, b01)), MUL(h, b02)), q));
+	ST(k->P_predict[1], ADD(b01, MUL(t, b02)));
+	ST(k->P_predict[2], b02);
+	ST(k->P_predict[3], ADD(ADD(b11, MUL(t, b12)), q));
+	ST(k->P_predict[4], b12);
+	ST(k->P_predict[5], ADD(p22, q));
+#endif
+}
 
-	iw_mult_matrix(kalman->A, kalman->P_correct, erg1);
-	erg2 = iw_multMatrix(erg1, kalman->A_trans);
-	iw_add_matrix(erg2, kalman->Q, erg1);
-	iw_assign_matrix(erg1, kalman->P_predict);
+#undef LD
+#undef ST
+#undef ADD
+#undef SUB
+#undef MUL
 
-	iw_free_matrix(erg1);
-	iw_free_matrix(erg2);
+#endif /* KALMAN_SSE2 */
 
+int kalman_measurementUpdate (kalman_t *kalman)
+{
+	int i;
+
+#ifdef KALMAN_SSE2
+	if (simd_enabled && kalman_simd_cpu()) {
+		for (i=0; i<kalman->size; i++)
+			if (kalman->active[i])
+				kalman_measurement_sse2 (kalman, 2*i);
+		return 0;
+	}
+#endif
+	for (i=0; i<kalman->size; i++) {
+		if (kalman->active[i]) {
+			kalman_measurement_lane (kalman, 2*i);
+			kalman_measurement_lane (kalman, 2*i+1);
+		}
+	}
+	return 0;
+}
+
+int kalman_timeUpdate (kalman_t *kalman)
+{
+	int i;
+
+#ifdef KALMAN_SSE2
+	if (simd_enabled && kalman_simd_cpu()) {
+		for (i=0; i<kalman->size; i++)
+			if (kalman->active[i])
+				kalman_time_sse2 (kalman, 2*i);
+		return 0;
+	}
+#endif
+	for (i=0; i<kalman->size; i++) {
+		if (kalman->active[i]) {
+			kalman_time_lane (kalman, 2*i);
+			kalman_time_lane (kalman, 2*i+1);
+		}
+	}
 	return 0;
 }
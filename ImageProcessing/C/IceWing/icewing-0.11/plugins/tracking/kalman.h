@@ -24,42 +24,98 @@
 #ifndef iw_kalman_H
 #define iw_kalman_H
 
-#include "matrix.h"
+#include "tools/tools.h"
 
 /* Nachfolgendes Define fuer Annahme konstanter Geschwindigkeit nach "Kohler", bei
    zusaetzlicher Annahme konstanter Beschleunigung dieses Define auf NO_KOHLER o.ae.! */
 #define NoKOHLER
 
+#ifdef KOHLER
+#define KALMAN_ORDER		2		/* Position, velocity */
+#else
+#define KALMAN_ORDER		3		/* Position, velocity, acceleration */
+#endif
+#define KALMAN_DIM_X		(2*KALMAN_ORDER)
+#define KALMAN_DIM_P		(KALMAN_ORDER*(KALMAN_ORDER+1)/2)
+
+/* Kalman filters for 'size' trackers with the state (x, y, vx, vy[, ax, ay])
+   and the measurement (x, y). The x and y axis are independent of each
+   other, so every tracker consists of two one dimensional filters stored
+   in the lanes 2*i (x axis) and 2*i+1 (y axis). Every component has its
+   own array over all lanes, so all trackers are updated in one pass
+   without any allocation. */
 typedef struct kalman_t {
-	matrix_t *x_predict;
-	matrix_t *x_correct;
-	matrix_t *P_predict;
-	matrix_t *P_correct;
-	matrix_t *K;
-	matrix_t *z;
-	matrix_t *A;
-	matrix_t *A_trans;
-	matrix_t *H;
-	matrix_t *H_trans;
-	matrix_t *Q;
-	matrix_t *R;
-	matrix_t *I;
+	int size;								/* Number of trackers */
+	char *active;							/* Update tracker i in the next
+											   time/measurement update? */
+	double *x_predict[KALMAN_ORDER];		/* State, [order][lane] */
+	double *x_correct[KALMAN_ORDER];
+	double *P_predict[KALMAN_DIM_P];		/* Upper triangle of the covariance
+											   of one axis, row by row */
+	double *P_correct[KALMAN_DIM_P];
+	double *z;								/* Measurement */
+	double *t;								/* Time period */
+	double *q;								/* Model noise */
+	double *r;								/* Measurement noise */
+	double *mem;
 } kalman_t;
 
-kalman_t *kalman_create (void);
+/* Element j of the state vector (x, y, vx, vy[, ax, ay]) of tracker i,
+   x: x_predict or x_correct */
+#define KALMAN_ELEM(x,i,j)	((x)[(j)>>1][((i)<<1)+((j)&1)])
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+  Enable or disable the SSE2 version of the time and measurement
+  update (default: enabled).
+  Return: TRUE if the CPU supports SSE2.
+*********************************************************************/
+BOOL kalman_set_simd (BOOL enable);
+
+/*********************************************************************
+  Allocate Kalman filters for size trackers. All trackers are
+  initially inactive.
+*********************************************************************/
+kalman_t *kalman_create (int size);
+
+/*********************************************************************
+  Change the number of trackers of kalman to size. The state of the
+  first MIN(old size, size) trackers is preserved.
+*********************************************************************/
+void kalman_resize (kalman_t *kalman, int size);
 
 void kalman_free (kalman_t *kalman);
 
-void kalman_init_handtrack(kalman_t *kalman,
-						   double x, double y, double vx, double vy , double ax, double ay,
-						   double q, double r, double P, double t);
+/*********************************************************************
+  Initialize the predicted state and the noise of tracker i.
+*********************************************************************/
+void kalman_init_handtrack (kalman_t *kalman, int i,
+							double x, double y, double vx, double vy, double ax, double ay,
+							double q, double r, double P, double t);
+
+void kalman_setPeriode (kalman_t *kalman, int i, double t, double q);
+
+int kalman_change_Q_and_R (kalman_t *kalman, int i, double new_q, double new_r);
 
-void kalman_setPeriode(kalman_t *kalman, double t, double q);
+void kalman_set_measurement (kalman_t *kalman, int i, double x, double y);
 
-int kalman_change_Q_and_R(kalman_t *kalman, double new_q, double new_r);
+/*********************************************************************
+  Correct the prediction of all active trackers with their
+  measurements (x_predict, P_predict -> x_correct, P_correct).
+*********************************************************************/
+int kalman_measurementUpdate (kalman_t *kalman);
 
-int kalman_measurementUpdate(kalman_t *kalman);
+/*********************************************************************
+  Predict the next state of all active trackers
+  (x_correct, P_correct -> x_predict, P_predict).
+*********************************************************************/
+int kalman_timeUpdate (kalman_t *kalman);
 
-int kalman_timeUpdate(kalman_t *kalman);
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* iw_kalman_H */
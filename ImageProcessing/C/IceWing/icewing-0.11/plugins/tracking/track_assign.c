@@ -0,0 +1,352 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+
+/*********************************************************************
+  Gating and optimal assignment of regions to trackers, see
+  track_assign_regions().
+*********************************************************************/
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "track_assign.h"
+
+/* Uniform grid over the centers of all valid regions */
+typedef struct {
+	float x0, y0;				/* Upper left corner */
+	float size;					/* Width and height of one cell */
+	int w, h;					/* Number of cells */
+	int *start;					/* Regions of cell i: reg[start[i]..start[i+1]-1] */
+	int *reg;
+} assignGrid;
+
+/* A tracker/region pair within the gate */
+typedef struct {
+	int trk, reg;
+	float dist;
+} assignEdge;
+
+/*********************************************************************
+  Sort all regions with pixelanzahl != 0 into a grid with cells of
+  (at least) size x size pixels.
+*********************************************************************/
+static void grid_init (assignGrid *grid, iwRegion *regions, int num_regions, float size)
+{
+	float x1 = 0, y1 = 0;
+	int i, c, cnt = 0;
+
+	grid->x0 = grid->y0 = 0;
+	for (i=0; i<num_regions; i++) {
+		Punkt_t *p = &regions[i].r.schwerpunkt;
+		if (!regions[i].r.pixelanzahl) continue;
+		if (!cnt || p->x < grid->x0) grid->x0 = p->x;
+		if (!cnt || p->y < grid->y0) grid->y0 = p->y;
+		if (!cnt || p->x > x1) x1 = p->x;
+		if (!cnt || p->y > y1) y1 = p->y;
+		cnt++;
+	}
+
+	/* Limit the number of cells to around the number of regions */
+	if (size < 1) size = 1;
+	while ((x1-grid->x0)/size * (y1-grid->y0)/size > 4*cnt+16)
+		size *= 2;
+	grid->size = size;
+	grid->w = (x1-grid->x0)/size + 1;
+	grid->h = (y1-grid->y0)/size + 1;
+
+	grid->start = iw_malloc0 (sizeof(int)*(grid->w*grid->h+1), "assign grid");
+	grid->reg = iw_malloc (sizeof(int)*MAX(cnt,1), "assign grid");
+
+	/* Counting sort of the regions into the cells */
+	for (i=0; i<num_regions; i++) {
+		if (!regions[i].r.pixelanzahl) continue;
+		c = (int)((regions[i].r.schwerpunkt.y-grid->y0)/size) * grid->w +
+			(int)((regions[i].r.schwerpunkt.x-grid->x0)/size);
+		grid->start[c+1]++;
+	}
+	for (c=0; c<grid->w*grid->h; c++)
+		grid->start[c+1] += grid->start[c];
+	for (i=0; i<num_regions; i++) {
+		if (!regions[i].r.pixelanzahl) continue;
+		c = (int)((regions[i].r.schwerpunkt.y-grid->y0)/size) * grid->w +
+			(int)((regions[i].r.schwerpunkt.x-grid->x0)/size);
+		grid->reg[grid->start[c]++] = i;
+	}
+	/* start[c] was moved to the end of cell c, shift it back */
+	for (c=grid->w*grid->h; c>0; c--)
+		grid->start[c] = grid->start[c-1];
+	grid->start[0] = 0;
+}
+
+static void grid_free (assignGrid *grid)
+{
+	free (grid->start);
+	free (grid->reg);
+}
+
+typedef void (*assignGridFunc) (int reg, float dist, void *data);
+
+/*********************************************************************
+  Call fkt(i, dist, data) for all regions i whose centers have a
+  distance dist < max_dist to p.
+*********************************************************************/
+static void grid_query (assignGrid *grid, iwRegion *regions, Punkt_t p, float max_dist,
+						assignGridFunc fkt, void *data)
+{
+	int cx0 = floor ((p.x-max_dist-grid->x0)/grid->size);
+	int cx1 = floor ((p.x+max_dist-grid->x0)/grid->size);
+	int cy0 = floor ((p.y-max_dist-grid->y0)/grid->size);
+	int cy1 = floor ((p.y+max_dist-grid->y0)/grid->size);
+	float max_sq = max_dist*max_dist, dx, dy, dist;
+	int cx, cy, i;
+
+	if (cx0 < 0) cx0 = 0;
+	if (cy0 < 0) cy0 = 0;
+	if (cx1 >= grid->w) cx1 = grid->w-1;
+	if (cy1 >= grid->h) cy1 = grid->h-1;
+
+	for (cy=cy0; cy<=cy1; cy++) {
+		for (cx=cx0; cx<=cx1; cx++) {
+			int c = cy*grid->w + cx;
+			for (i=grid->start[c]; i<grid->start[c+1]; i++) {
+				dx = p.x - regions[grid->reg[i]].r.schwerpunkt.x;
+				dy = p.y - regions[grid->reg[i]].r.schwerpunkt.y;
+				dist = dx*dx + dy*dy;
+				if (dist < max_sq)
+					fkt (grid->reg[i], sqrt(dist), data);
+			}
+		}
+	}
+}
+
+/* Data for grid_query() callbacks */
+typedef struct {
+	int trk;
+	assignEdge *edges;
+	int cnt, size;
+	int best;					/* Nearest region */
+	float best_dist;
+} assignQuery;
+
+static void query_edge (int reg, float dist, void *data)
+{
+	assignQuery *q = data;
+
+	if (q->cnt >= q->size) {
+		q->size = q->size*2 + 16;
+		q->edges = iw_realloc (q->edges, sizeof(assignEdge)*q->size, "assign edges");
+	}
+	q->edges[q->cnt].trk = q->trk;
+	q->edges[q->cnt].reg = reg;
+	q->edges[q->cnt].dist = dist;
+	q->cnt++;
+}
+
+static void query_nearest (int reg, float dist, void *data)
+{
+	assignQuery *q = data;
+
+	if (dist < q->best_dist || (dist == q->best_dist && reg < q->best)) {
+		q->best = reg;
+		q->best_dist = dist;
+	}
+}
+
+/*********************************************************************
+  Hungarian algorithm (shortest augmenting paths with potentials)
+  for the sparse cost matrix given by the edges: The candidates of
+  row i are edges[start[i]..start[i+1]-1]. Every row can
+  additionally be left unassigned for the cost no_edge, which must be
+  bigger than all edge costs. As the augmenting paths only visit
+  columns with a path cost below no_edge, the search stays local and
+  the costs are nearly linear in the number of edges.
+  Return: In row_to_col[i] the column assigned to row i or -1.
+*********************************************************************/
+static void hungarian (assignEdge *edges, int *start, int n, int m, double no_edge,
+					   int *row_to_col)
+{
+	/* Columns 0..m-1: regions, m+i: "unassigned" column of row i */
+	int cols = m + n;
+	double *u = iw_malloc0 (sizeof(double)*n, "hungarian");
+	double *v = iw_malloc0 (sizeof(double)*cols, "hungarian");
+	double *minv = iw_malloc (sizeof(double)*cols, "hungarian");
+	int *p = iw_malloc (sizeof(int)*cols, "hungarian");
+	int *way = iw_malloc (sizeof(int)*cols, "hungarian");
+	int *touched = iw_malloc (sizeof(int)*cols, "hungarian");
+	char *state = iw_malloc0 (cols, "hungarian");	/* 0: free, 1: touched, 2: used */
+	int s, i0, j, j0, j1, k, e, ntouched, nused;
+	double delta, cur, c;
+
+	for (j=0; j<cols; j++)
+		p[j] = -1;
+
+	for (s=0; s<n; s++) {
+		/* touched[0..nused-1]: used columns, touched[nused..ntouched-1]:
+		   columns reached but not yet used; j0: column whose row is
+		   expanded, -1: the start row s */
+		ntouched = nused = 0;
+		j0 = -1;
+		i0 = s;
+		while (1) {
+			for (e=start[i0]; e<=start[i0+1]; e++) {
+				if (e < start[i0+1]) {
+					j = edges[e].reg;
+					c = edges[e].dist;
+				} else {
+					j = m + i0;
+					c = no_edge;
+				}
+				if (state[j] == 2) continue;
+				cur = c - u[i0] - v[j];
+				if (state[j] == 0) {
+					state[j] = 1;
+					touched[ntouched++] = j;
+					minv[j] = cur;
+					way[j] = j0;
+				} else if (cur < minv[j]) {
+					minv[j] = cur;
+					way[j] = j0;
+				}
+			}
+
+			delta = HUGE_VAL;
+			j1 = -1;
+			for (k=nused; k<ntouched; k++) {
+				if (minv[touched[k]] < delta) {
+					delta = minv[touched[k]];
+					j1 = k;
+				}
+			}
+
+			u[s] += delta;
+			for (k=0; k<nused; k++) {
+				u[p[touched[k]]] += delta;
+				v[touched[k]] -= delta;
+			}
+			for (k=nused; k<ntouched; k++)
+				minv[touched[k]] -= delta;
+
+			/* Move column j1 to the used columns */
+			j = touched[j1];
+			touched[j1] = touched[nused];
+			touched[nused++] = j;
+			state[j] = 2;
+
+			if (p[j] < 0) break;
+			j0 = j;
+			i0 = p[j];
+		}
+
+		/* Augment along the path */
+		while (j >= 0) {
+			j1 = way[j];
+			p[j] = j1 < 0 ? s : p[j1];
+			j = j1;
+		}
+		for (k=0; k<ntouched; k++)
+			state[touched[k]] = 0;
+	}
+
+	for (i0=0; i0<n; i0++)
+		row_to_col[i0] = -1;
+	for (j=0; j<m; j++)
+		if (p[j] >= 0) row_to_col[p[j]] = j;
+
+	free (u);
+	free (v);
+	free (minv);
+	free (p);
+	free (way);
+	free (touched);
+	free (state);
+}
+
+/*********************************************************************
+  Assign the regions to the cnt trackers trk, see track_assign.h.
+*********************************************************************/
+void track_assign_regions (tracker_t **trk, int cnt, iwRegion *regions,
+						   int num_regions, float max_dist)
+{
+	assignGrid grid;
+	assignQuery query;
+	int *start, *assigned;
+	int j, e;
+
+	if (cnt <= 0) return;
+
+	grid_init (&grid, regions, num_regions, max_dist);
+
+	/* Gating: all regions within max_dist of a tracker prediction */
+	memset (&query, 0, sizeof(query));
+	start = iw_malloc (sizeof(int)*(cnt+1), "assign edges");
+	for (j=0; j<cnt; j++) {
+		start[j] = query.cnt;
+		if (!trk[j]->work->region_zugeordnet) continue;
+		query.trk = j;
+		grid_query (&grid, regions, trk[j]->pos->correct, max_dist, query_edge, &query);
+	}
+	start[cnt] = query.cnt;
+
+	assigned = iw_malloc (sizeof(int)*cnt, "assign edges");
+	hungarian (query.edges, start, cnt, num_regions, max_dist, assigned);
+
+	for (j=0; j<cnt; j++) {
+		if (!trk[j]->work->region_zugeordnet) continue;
+
+		/* Left over tracker: Share the nearest region with another tracker */
+		if (assigned[j] < 0) {
+			float best_dist = max_dist;
+			for (e=start[j]; e<start[j+1]; e++) {
+				if (query.edges[e].dist < best_dist) {
+					best_dist = query.edges[e].dist;
+					assigned[j] = query.edges[e].reg;
+				}
+			}
+		}
+
+		/* Virtual tracker: Search around the virtual center of mass */
+		if (assigned[j] < 0 && trk[j]->work->virtuell) {
+			query.best = -1;
+			query.best_dist = max_dist;
+			grid_query (&grid, regions, trk[j]->pos->tracker_2, max_dist,
+						query_nearest, &query);
+			assigned[j] = query.best;
+		}
+
+		if (assigned[j] >= 0) {
+			trk[j]->work->best_match_region = assigned[j];
+			trk[j]->pos->region_hypo.x = regions[assigned[j]].r.schwerpunkt.x;
+			trk[j]->pos->region_hypo.y = regions[assigned[j]].r.schwerpunkt.y;
+		} else {
+			iw_debug (3, "Deleted tracker %d, no region within %f", j, max_dist);
+			tracker_remove (trk[j]);
+		}
+	}
+
+	free (query.edges);
+	free (start);
+	free (assigned);
+	grid_free (&grid);
+}
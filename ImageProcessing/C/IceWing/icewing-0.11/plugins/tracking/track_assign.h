@@ -0,0 +1,54 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+
+#ifndef iw_track_assign_H
+#define iw_track_assign_H
+
+#include "track_tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+  Assign the regions to the cnt trackers trk, which have
+  work->region_zugeordnet set. Only regions within max_dist of the
+  predicted tracker position (pos->correct) are candidates, they are
+  found with a uniform grid over the region centers. The candidates
+  are assigned optimal with the Hungarian algorithm: The sum of the
+  distances is minimized, where a tracker without an own region
+  counts as max_dist. Trackers left over take their nearest
+  candidate, so that two trackers can follow merged regions. Virtual trackers
+  without a candidate search around pos->tracker_2.
+  Sets work->best_match_region and pos->region_hypo, trackers
+  without any region within max_dist are removed.
+*********************************************************************/
+void track_assign_regions (tracker_t **trk, int cnt, iwRegion *regions,
+						   int num_regions, float max_dist);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* iw_track_assign_H */
@@ -29,7 +29,6 @@
 
 #include "main/output.h"
 #include "gui/Goptions.h"
-#include "matrix.h"
 #include "track_tools.h"
 #include "track_kalman.h"
 
@@ -42,13 +41,17 @@
 
 /* Special kalman data structure */
 typedef struct {
-	kalman_t       *kalman;            /* Der Kalman-Filter */
-	double         adaptive_q;         /* Adaptives Modellrauschen */
-	double         adaptive_r;         /* Adaptives Messrauschen (noch nicht benutzt) */
-	matrix_t       *kal_state_prev;    /* Alter kalman-zustand */
-	matrix_t       *kal_state_new;     /* Neuer kalman-zustand */
+	int            index;                      /* Tracker index in kal_batch */
+	double         adaptive_q;                 /* Adaptives Modellrauschen */
+	double         adaptive_r;                 /* Adaptives Messrauschen (noch nicht benutzt) */
+	double         kal_state_prev[KALMAN_DIM_X]; /* Alter kalman-zustand */
+	double         kal_state_new[KALMAN_DIM_X];  /* Neuer kalman-zustand */
 } tracker_kalman_t;
 
+/* The Kalman filters of all trackers, updated together */
+static kalman_t *kal_batch = NULL;
+static tracker_t **kal_trk = NULL;		/* Tracker using index i of kal_batch */
+
 /* #[ Special data struct handling functions : */
 
 /*********************************************************************
@@ -57,21 +60,26 @@ typedef struct {
 static void tracker_kalman_special_init (tracker_t *trk)
 {
 	tracker_kalman_t *kalman;
+	int i, size;
 
 	trk->special = (void*) calloc (1, sizeof(tracker_kalman_t));
 	kalman = (tracker_kalman_t*)trk->special;
 
-	kalman->kalman = kalman_create();
+	if (!kal_batch)
+		kal_batch = kalman_create (TRACKER_START_CNT);
+	for (i=0; i<kal_batch->size && kal_trk && kal_trk[i]; i++) /* empty */;
+	if (!kal_trk || i >= kal_batch->size) {
+		size = kal_trk ? kal_batch->size*2 : kal_batch->size;
+		kalman_resize (kal_batch, size);
+		kal_trk = iw_realloc (kal_trk, sizeof(tracker_t*)*size, "kalman trackers");
+		memset (kal_trk+i, 0, sizeof(tracker_t*)*(size-i));
+	}
+	kal_trk[i] = trk;
+	kal_batch->active[i] = FALSE;
+
+	kalman->index = i;
 	kalman->adaptive_q = 0.0;
 	kalman->adaptive_r = 0.0;
-
-#ifdef KOHLER
-	kalman->kal_state_prev = iw_create_matrix(4,1);
-	kalman->kal_state_new = iw_create_matrix(4,1);
-#else
-	kalman->kal_state_prev = iw_create_matrix(6,1);
-	kalman->kal_state_new = iw_create_matrix(6,1);
-#endif
 }
 
 /*********************************************************************
@@ -79,12 +87,24 @@ static void tracker_kalman_special_init (tracker_t *trk)
 *********************************************************************/
 static void tracker_kalman_special_free (tracker_t *trk)
 {
-	iw_free_matrix ( ((tracker_kalman_t*)trk->special)->kal_state_prev);
-	iw_free_matrix ( ((tracker_kalman_t*)trk->special)->kal_state_new);
-	kalman_free ( ((tracker_kalman_t*)trk->special)->kalman);
+	tracker_kalman_t *kalman = (tracker_kalman_t*)trk->special;
+	int i;
 
+	if (!kalman) return;
+
+	kal_trk[kalman->index] = NULL;
+	kal_batch->active[kalman->index] = FALSE;
 	free(trk->special);
 	trk->special = NULL;
+
+	/* Last tracker removed -> free the filters */
+	for (i=0; i<kal_batch->size && !kal_trk[i]; i++) /* empty */;
+	if (i >= kal_batch->size) {
+		kalman_free (kal_batch);
+		kal_batch = NULL;
+		free (kal_trk);
+		kal_trk = NULL;
+	}
 }
 
 /* #]  : */
@@ -92,61 +112,92 @@ static void tracker_kalman_special_free (tracker_t *trk)
   /* #[ Kalman tracking: */
 
 /*********************************************************************
-  Predict new positions for all regions.
+  Prepare the prediction of the new position of one tracker.
+  Return: TRUE if the tracker takes part in the time update.
 *********************************************************************/
-static void track_kalman_predict (tracker_t *trk, opt_values_t *opt_values,
-								  track_global_t *global)
+static BOOL track_kalman_predict_prepare (tracker_t *trk, opt_values_t *opt_values,
+										  track_global_t *global)
 {
+	tracker_kalman_t *kalman = (tracker_kalman_t*)trk->special;
+
 	global->dt = global->cur_time - trk->judge->start_zeit;
 	trk->judge->start_zeit = global->cur_time;
 
 	if (global->dt > MAX_TIME_DIFF) {
 		iw_debug (2, "Removing Tracker due to time limit exception");
 		tracker_remove (trk);
-	} else {
-		tracker_kalman_t *kalman = (tracker_kalman_t*)trk->special;
+		return FALSE;
+	}
 
-		/* Bereinige Ausreisser */
-		if (global->dt < global->dt_min)
-			global->dt = global->dt_min;
+	/* Bereinige Ausreisser */
+	if (global->dt < global->dt_min)
+		global->dt = global->dt_min;
 
-		tracker_getNumCycles (trk, global);
+	tracker_getNumCycles (trk, global);
 
-		kalman->adaptive_q = (double)opt_values->rauschen_q * RAUSCHEN_Q;
-		kalman->adaptive_r = (double)opt_values->rauschen_r;
+	kalman->adaptive_q = (double)opt_values->rauschen_q * RAUSCHEN_Q;
+	kalman->adaptive_r = (double)opt_values->rauschen_r;
+
+	kalman_change_Q_and_R (kal_batch, kalman->index,
+						   kalman->adaptive_q, kalman->adaptive_r);
+
+	/* Berechne unkorrigierte (Messwerte gehen nicht ein) Kalman Praediktion */
+	kalman_setPeriode (kal_batch, kalman->index, (double)global->dt,
+					   (double)kalman->adaptive_q);
+	return TRUE;
+}
+
+/*********************************************************************
+  Predict new positions for all regions. All running trackers are
+  updated in one kalman_timeUpdate() call.
+*********************************************************************/
+static void track_kalman_predict_all (tracker_t **trk, int cnt, opt_values_t *opt_values,
+									  track_global_t *global)
+{
+	int i;
 
-		kalman_change_Q_and_R ( kalman->kalman,
-								kalman->adaptive_q, kalman->adaptive_r);
+	if (!kal_batch) return;
+
+	memset (kal_batch->active, 0, kal_batch->size);
+	for (i=0; i<cnt; i++) {
+		if (trk[i]->status == Run &&
+			track_kalman_predict_prepare (trk[i], opt_values, global))
+			kal_batch->active[((tracker_kalman_t*)trk[i]->special)->index] = TRUE;
+	}
 
-		/* Berechne unkorrigierte (Messwerte gehen nicht ein) Kalman Praediktion */
-		kalman_setPeriode ( kalman->kalman, (double)global->dt,
-							(double)kalman->adaptive_q);
+	kalman_timeUpdate (kal_batch);
 
-		kalman_timeUpdate ( kalman->kalman);
+	for (i=0; i<cnt; i++) {
+		tracker_kalman_t *kalman = (tracker_kalman_t*)trk[i]->special;
+		double x, y;
 
-		trk->pos->correct.x = kalman->kalman->x_predict->elem[0][0];
-		trk->pos->correct.y = kalman->kalman->x_predict->elem[1][0];
+		if (!kalman || !kal_batch->active[kalman->index]) continue;
+
+		x = KALMAN_ELEM(kal_batch->x_predict, kalman->index, 0);
+		y = KALMAN_ELEM(kal_batch->x_predict, kalman->index, 1);
+		trk[i]->pos->correct.x = x;
+		trk[i]->pos->correct.y = y;
 
 		/* Visualisiere Kalman Praediktion */
-		trk->pos->predict.x = kalman->kalman->x_predict->elem[0][0];
-		trk->pos->predict.y = kalman->kalman->x_predict->elem[1][0];
+		trk[i]->pos->predict.x = x;
+		trk[i]->pos->predict.y = y;
 
-		traject_update ( kalman->kalman->x_predict->elem[0][0],
-						 kalman->kalman->x_predict->elem[1][0],
-						 trk->work->num_cycles, &trk->traject->predict.r);
+		traject_update (x, y, trk[i]->work->num_cycles, &trk[i]->traject->predict);
 	}
 }
 
 /*********************************************************************
-  Inintialize or update positions and variables of kalman filters.
+  Inintialize or update positions and variables of one kalman filter
+  up to the measurement update.
+  Return: TRUE if the tracker takes part in the measurement update.
 *********************************************************************/
-static void track_kalman_correct (tracker_t *trk, opt_values_t *opt_values,
-								  track_global_t *global)
+static BOOL track_kalman_correct_prepare (tracker_t *trk, opt_values_t *opt_values,
+										  track_global_t *global)
 {
 	double neu_vx, neu_vy;
 	tracker_kalman_t *kalman = (tracker_kalman_t*)trk->special;
 
-	iw_assign_matrix (kalman->kal_state_new, kalman->kal_state_prev);
+	memcpy (kalman->kal_state_prev, kalman->kal_state_new, sizeof(kalman->kal_state_new));
 
 	trk->pos->tracker.x = trk->pos->region_hypo.x;
 	trk->pos->tracker.y = trk->pos->region_hypo.y;
@@ -156,31 +207,20 @@ static void track_kalman_correct (tracker_t *trk, opt_values_t *opt_values,
 
 		kalman->adaptive_q = (double)opt_values->rauschen_q * RAUSCHEN_Q;
 		kalman->adaptive_r = (double)opt_values->rauschen_r;
-		kalman_change_Q_and_R ( kalman->kalman,
-								kalman->adaptive_q, kalman->adaptive_r);
+		kalman_change_Q_and_R (kal_batch, kalman->index,
+							   kalman->adaptive_q, kalman->adaptive_r);
 
 		/* Messwerte fuer Kalman-Filter eintragen */
-		kalman->kalman->z->elem[0][0] = trk->pos->tracker.x;
-		kalman->kalman->z->elem[1][0] = trk->pos->tracker.y;
+		kalman_set_measurement (kal_batch, kalman->index,
+								trk->pos->tracker.x, trk->pos->tracker.y);
 
 		trk->pos->previous.x = trk->pos->tracker.x;
 		trk->pos->previous.y = trk->pos->tracker.y;
 
 		/* Messpunkt in Handtrajektorie eintragen */
 		traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
-						trk->work->num_cycles, &trk->traject->tracker.r);
-
-		/* Korrigiere die Praediktion anhand der Messwerte */
-		kalman_measurementUpdate(kalman->kalman);
-
-		iw_assign_matrix (kalman->kalman->x_correct, kalman->kal_state_new);
-		trk->pos->correct.x = kalman->kalman->x_correct->elem[0][0];
-		trk->pos->correct.y = kalman->kalman->x_correct->elem[1][0];
-
-		/* Zustand des Kalman-Filters in die Kalman-Trajektorie eintragen */
-		traject_update (trk->pos->correct.x,trk->pos->correct.y,
-						trk->work->num_cycles,
-						& trk->traject->correct.r);
+						trk->work->num_cycles, &trk->traject->tracker);
+		return TRUE;
 
 		/* 2. Durchlauf, Kalman-Filter initialisieren */
 	} else if (trk->status == Init) {
@@ -193,46 +233,31 @@ static void track_kalman_correct (tracker_t *trk, opt_values_t *opt_values,
 		if (global->dt > MAX_TIME_DIFF) {
 			iw_debug (2,"Removing Kalman due to time limit exception");
 			tracker_remove(trk);
+			return FALSE;
+		}
+
+		/* Bereinige Ausreisser */
+		if (global->dt < global->dt_min)
+			global->dt = global->dt_min;
 
-		} else {
-			/* Bereinige Ausreisser */
-			if (global->dt < global->dt_min)
-				global->dt = global->dt_min;
-
-			tracker_getNumCycles (trk, global);
-			neu_vx = (trk->pos->tracker.x - trk->pos->previous.x) / global->dt;
-			neu_vy = (trk->pos->tracker.y - trk->pos->previous.y) / global->dt;
-
-			/* Kalman-Filter initialisieren */
-			kalman->adaptive_q = (double)opt_values->rauschen_q * RAUSCHEN_Q;
-			kalman->adaptive_r = (double)opt_values->rauschen_r;
-			kalman_init_handtrack ( kalman->kalman,
-									trk->pos->tracker.x, trk->pos->tracker.y,
-									neu_vx, neu_vy, 0.0, 0.0,
-									kalman->adaptive_q, kalman->adaptive_r,
-									100.0, global->dt);
-			kalman_setPeriode ( kalman->kalman, (double)global->dt,
-								(double)kalman->adaptive_q);
-
-			kalman->kalman->z->elem[0][0] = trk->pos->tracker.x;
-			kalman->kalman->z->elem[1][0] = trk->pos->tracker.y;
-			kalman_measurementUpdate ( kalman->kalman);
-
-			/* Trajektorien updaten */
-			traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
-							trk->work->num_cycles, &trk->traject->tracker.r);
-			traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
-							trk->work->num_cycles, &trk->traject->correct.r);
-			traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
-							trk->work->num_cycles, &trk->traject->predict.r);
-
-			/* Praediktion init */
-			trk->pos->previous.x = trk->pos->tracker.x;
-			trk->pos->previous.y = trk->pos->tracker.y;
-			trk->pos->correct.x = trk->pos->tracker.x;
-			trk->pos->correct.y = trk->pos->tracker.y;
-			trk->status = Run;
-		} /* (global->dt > MAX_TIME_DIFF) */
+		tracker_getNumCycles (trk, global);
+		neu_vx = (trk->pos->tracker.x - trk->pos->previous.x) / global->dt;
+		neu_vy = (trk->pos->tracker.y - trk->pos->previous.y) / global->dt;
+
+		/* Kalman-Filter initialisieren */
+		kalman->adaptive_q = (double)opt_values->rauschen_q * RAUSCHEN_Q;
+		kalman->adaptive_r = (double)opt_values->rauschen_r;
+		kalman_init_handtrack (kal_batch, kalman->index,
+							   trk->pos->tracker.x, trk->pos->tracker.y,
+							   neu_vx, neu_vy, 0.0, 0.0,
+							   kalman->adaptive_q, kalman->adaptive_r,
+							   100.0, global->dt);
+		kalman_setPeriode (kal_batch, kalman->index, (double)global->dt,
+						   (double)kalman->adaptive_q);
+
+		kalman_set_measurement (kal_batch, kalman->index,
+								trk->pos->tracker.x, trk->pos->tracker.y);
+		return TRUE;
 
 	} else if (trk->status == Prepare) {
 
@@ -247,15 +272,80 @@ static void track_kalman_correct (tracker_t *trk, opt_values_t *opt_values,
 
 		/* Trajektorien initialisieren */
 		traject_init (trk->pos->tracker.x, trk->pos->tracker.y,
-					  &trk->traject->tracker.r);
+					  &trk->traject->tracker);
 		traject_init (trk->pos->tracker.x, trk->pos->tracker.y,
-					  &trk->traject->correct.r);
+					  &trk->traject->correct);
 		traject_init (trk->pos->tracker.x, trk->pos->tracker.y,
-					  &trk->traject->predict.r);
+					  &trk->traject->predict);
 
 		trk->status = Init;
 		trk->judge->start_zeit = global->cur_time;
 	}
+	return FALSE;
+}
+
+/*********************************************************************
+  Finish the correction of one tracker after the measurement update.
+*********************************************************************/
+static void track_kalman_correct_finish (tracker_t *trk)
+{
+	tracker_kalman_t *kalman = (tracker_kalman_t*)trk->special;
+	int j;
+
+	if (trk->status == Run) {
+		for (j=0; j<KALMAN_DIM_X; j++)
+			kalman->kal_state_new[j] = KALMAN_ELEM(kal_batch->x_correct, kalman->index, j);
+		trk->pos->correct.x = kalman->kal_state_new[0];
+		trk->pos->correct.y = kalman->kal_state_new[1];
+
+		/* Zustand des Kalman-Filters in die Kalman-Trajektorie eintragen */
+		traject_update (trk->pos->correct.x,trk->pos->correct.y,
+						trk->work->num_cycles,
+						& trk->traject->correct);
+	} else {
+		/* Trajektorien updaten */
+		traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
+						trk->work->num_cycles, &trk->traject->tracker);
+		traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
+						trk->work->num_cycles, &trk->traject->correct);
+		traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
+						trk->work->num_cycles, &trk->traject->predict);
+
+		/* Praediktion init */
+		trk->pos->previous.x = trk->pos->tracker.x;
+		trk->pos->previous.y = trk->pos->tracker.y;
+		trk->pos->correct.x = trk->pos->tracker.x;
+		trk->pos->correct.y = trk->pos->tracker.y;
+		trk->status = Run;
+	}
+}
+
+/*********************************************************************
+  Inintialize or update positions and variables of the kalman filters
+  of all trackers with an assigned region. All measurements are
+  processed in one kalman_measurementUpdate() call.
+*********************************************************************/
+static void track_kalman_correct_all (tracker_t **trk, int cnt, opt_values_t *opt_values,
+									  track_global_t *global)
+{
+	int i;
+
+	if (!kal_batch) return;
+
+	memset (kal_batch->active, 0, kal_batch->size);
+	for (i=0; i<cnt; i++) {
+		if (trk[i]->work->region_zugeordnet &&
+			track_kalman_correct_prepare (trk[i], opt_values, global))
+			kal_batch->active[((tracker_kalman_t*)trk[i]->special)->index] = TRUE;
+	}
+
+	kalman_measurementUpdate (kal_batch);
+
+	for (i=0; i<cnt; i++) {
+		tracker_kalman_t *kalman = (tracker_kalman_t*)trk[i]->special;
+		if (kalman && kal_batch->active[kalman->index])
+			track_kalman_correct_finish (trk[i]);
+	}
 }
 
 static void track_kalman_traject_calc (tracker_t *trk, int i, float *vals, int window_len)
@@ -264,16 +354,16 @@ static void track_kalman_traject_calc (tracker_t *trk, int i, float *vals, int w
 	float interpolation = (double)i/trk->work->num_cycles;
 
 	/* Absolute Position als Merkmal */
-	vals[0] = kal->kal_state_prev->elem[0][0] +
-		(kal->kal_state_new->elem[0][0] - kal->kal_state_prev->elem[0][0])*interpolation;
-	vals[1] = kal->kal_state_prev->elem[1][0] +
-		(kal->kal_state_new->elem[1][0] - kal->kal_state_prev->elem[1][0])*interpolation;
+	vals[0] = kal->kal_state_prev[0] +
+		(kal->kal_state_new[0] - kal->kal_state_prev[0])*interpolation;
+	vals[1] = kal->kal_state_prev[1] +
+		(kal->kal_state_new[1] - kal->kal_state_prev[1])*interpolation;
 
 	/* Geschwindigkeit als Merkmal */
-	vals[2] = kal->kal_state_prev->elem[2][0] +
-		(kal->kal_state_new->elem[2][0] - kal->kal_state_prev->elem[2][0])*interpolation;
-	vals[3] = kal->kal_state_prev->elem[3][0] +
-		(kal->kal_state_new->elem[3][0] - kal->kal_state_prev->elem[3][0])*interpolation;
+	vals[2] = kal->kal_state_prev[2] +
+		(kal->kal_state_new[2] - kal->kal_state_prev[2])*interpolation;
+	vals[3] = kal->kal_state_prev[3] +
+		(kal->kal_state_new[3] - kal->kal_state_prev[3])*interpolation;
 }
 
 /* #]  : */
@@ -308,8 +398,10 @@ int kalman_init_options (opt_values_t *opt_values, track_imp_t *imp)
 
 	imp->special_init = tracker_kalman_special_init;
 	imp->special_free = tracker_kalman_special_free;
-	imp->predict = track_kalman_predict;
-	imp->correct = track_kalman_correct;
+	imp->predict = NULL;
+	imp->correct = NULL;
+	imp->predict_all = track_kalman_predict_all;
+	imp->correct_all = track_kalman_correct_all;
 	imp->traject_calc = track_kalman_traject_calc;
 
 	return p;
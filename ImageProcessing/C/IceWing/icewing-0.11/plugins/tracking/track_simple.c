@@ -98,11 +98,11 @@ static void track_simple_correct (tracker_t *trk, opt_values_t *opt_values,
 
 		/* Messpunkt in Trajektorie eintragen */
 		traject_update (trk->pos->tracker.x, trk->pos->tracker.y,
-						trk->work->num_cycles, &trk->traject->tracker.r);
+						trk->work->num_cycles, &trk->traject->tracker);
 
 		traject_update (trk->pos->correct.x,trk->pos->correct.y,
 						trk->work->num_cycles,
-						& trk->traject->correct.r);
+						& trk->traject->correct);
 
 	/* 1. Durchlauf, Tracker initialisieren */
 	} else if (trk->status == Prepare) {
@@ -113,9 +113,9 @@ static void track_simple_correct (tracker_t *trk, opt_values_t *opt_values,
 
 		/* Handtrajektorie initialisieren */
 		traject_init (trk->pos->tracker.x, trk->pos->tracker.y,
-					  &trk->traject->tracker.r);
+					  &trk->traject->tracker);
 		traject_init (trk->pos->tracker.x, trk->pos->tracker.y,
-					  &trk->traject->correct.r);
+					  &trk->traject->correct);
 		trk->pos->previous.x = trk->pos->tracker.x;
 		trk->pos->previous.y = trk->pos->tracker.y;
 		trk->pos->correct.x = trk->pos->tracker.x;
@@ -131,15 +131,32 @@ static void track_simple_correct (tracker_t *trk, opt_values_t *opt_values,
 
 static void track_simple_traject_calc (tracker_t *trk, int i, float *vals, int window_len)
 {
-	int norm = trk->work->num_cycles * window_len;
+	/* The last num_cycles points of the corrected trajectory are
+	   the interpolated points of the current time step */
+	int back = trk->work->num_cycles-1-i;
+	Punkt_t *p = traject_last (&trk->traject->correct, back);
+	Punkt_t *prev = traject_last (&trk->traject->correct, back+1);
+
+	if (!p || !prev) {
+		int norm = trk->work->num_cycles * window_len;
+
+		/* Absolute Position als Merkmal */
+		vals[0] = trk->pos->correct.x;
+		vals[1] = trk->pos->correct.y;
+
+		/* Geschwindigkeit als Merkmal */
+		vals[2] = (trk->pos->correct.x - trk->pos->previous.x)/norm;
+		vals[3] = (trk->pos->correct.y - trk->pos->previous.y)/norm;
+		return;
+	}
 
 	/* Absolute Position als Merkmal */
-	vals[0] = trk->pos->correct.x;
-	vals[1] = trk->pos->correct.y;
+	vals[0] = p->x;
+	vals[1] = p->y;
 
 	/* Geschwindigkeit als Merkmal */
-	vals[2] = (trk->pos->correct.x - trk->pos->previous.x)/norm;
-	vals[3] = (trk->pos->correct.y - trk->pos->previous.y)/norm;
+	vals[2] = (p->x - prev->x)/window_len;
+	vals[3] = (p->y - prev->y)/window_len;
 }
 
 /* #]  : */
@@ -32,11 +32,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "track_tools.h"
+#include "track_assign.h"
 #include "main/grab.h"
 
-		/* Max length of trajectory (older points are removed) */
-#define MAXTRACKLEN			500
-
 /* #[ Math tools : */
 
 /*********************************************************************
@@ -193,6 +191,46 @@ static void regRegion_init (iwRegion *reg)
 	reg->r.echtfarbe.x = reg->r.echtfarbe.y = reg->r.echtfarbe.z = 0;
 }
 
+/*********************************************************************
+  Remove all points from the trajectory ring.
+*********************************************************************/
+static void traject_clear (traject_ring_t *ring)
+{
+	ring->start = 0;
+	ring->total = 0;
+	ring->sent = 0;
+	ring->reg.r.polygon.n_punkte = 0;
+	ring->reg.r.polygon.punkt = ring->ptrs;
+}
+
+/*********************************************************************
+  Allocate the points of the trajectory ring, the ring is empty.
+*********************************************************************/
+static void traject_alloc (traject_ring_t *ring)
+{
+	int i;
+
+	regRegion_init (&ring->reg);
+	ring->pts = iw_malloc (sizeof(Punkt_t)*MAXTRACKLEN, "Trajectory points");
+	ring->ptrs = iw_malloc (sizeof(Punkt_t*)*MAXTRACKLEN*2, "Trajectory points");
+	for (i=0; i<MAXTRACKLEN*2; i++)
+		ring->ptrs[i] = &ring->pts[i % MAXTRACKLEN];
+	traject_clear (ring);
+}
+
+/*********************************************************************
+  Free the points of the trajectory ring.
+*********************************************************************/
+static void traject_release (traject_ring_t *ring)
+{
+	free (ring->pts);
+	free (ring->ptrs);
+	ring->pts = NULL;
+	ring->ptrs = NULL;
+	ring->reg.r.polygon.n_punkte = 0;
+	ring->reg.r.polygon.punkt = NULL;
+}
+
 /*********************************************************************
   Alloc and init tracker_t type.
 *********************************************************************/
@@ -208,16 +246,16 @@ tracker_t* tracker_create (void)
 	trk->judge   = (tracker_judge_t*)    calloc (1, sizeof(tracker_judge_t));
 
 	/* Init trajectories */
-	regRegion_init (&trk->traject->tracker);
-	regRegion_init (&trk->traject->predict);
-	regRegion_init (&trk->traject->correct);
+	traject_alloc (&trk->traject->tracker);
+	traject_alloc (&trk->traject->predict);
+	traject_alloc (&trk->traject->correct);
 
-	trk->traject->tracker.r.farbe = rot;
-	trk->traject->tracker.r.farbe2 = rot;
-	trk->traject->predict.r.farbe = blau;
-	trk->traject->predict.r.farbe2 = blau;
-	trk->traject->correct.r.farbe = gruen;
-	trk->traject->correct.r.farbe2 = gruen;
+	trk->traject->tracker.reg.r.farbe = rot;
+	trk->traject->tracker.reg.r.farbe2 = rot;
+	trk->traject->predict.reg.r.farbe = blau;
+	trk->traject->predict.reg.r.farbe2 = blau;
+	trk->traject->correct.reg.r.farbe = gruen;
+	trk->traject->correct.reg.r.farbe2 = gruen;
 
 	/* Init work data */
 	trk->work->region_zugeordnet = FALSE;
@@ -269,24 +307,8 @@ void tracker_remove (tracker_t *trk)
 	trk->judge->init_zeit = 0;
 	trk->judge->max_dist = 0.0;
 	tracker_traject_free(trk);
-	trk->traject->correct.r.farbe = gruen;
-	trk->traject->correct.r.farbe2 = gruen;
-}
-
-/*********************************************************************
-  Clear trajectory and points.
-*********************************************************************/
-static void region_clear (Region_t *reg)
-{
-	int i;
-
-	if (reg->polygon.n_punkte > 0) {
-		for (i=0; i<reg->polygon.n_punkte; i++)
-			free (reg->polygon.punkt[i]);
-		free (reg->polygon.punkt);
-
-		reg->polygon.n_punkte = 0;
-	}
+	trk->traject->correct.reg.r.farbe = gruen;
+	trk->traject->correct.reg.r.farbe2 = gruen;
 }
 
 /*********************************************************************
@@ -295,9 +317,9 @@ static void region_clear (Region_t *reg)
 void tracker_free (tracker_t *trk)
 {
 	/* Free trajectories */
-	region_clear (&trk->traject->tracker.r);
-	region_clear (&trk->traject->predict.r);
-	region_clear (&trk->traject->correct.r);
+	traject_release (&trk->traject->tracker);
+	traject_release (&trk->traject->predict);
+	traject_release (&trk->traject->correct);
 
 	/* Free other data */
 	free (trk->traject);
@@ -314,19 +336,19 @@ void tracker_free (tracker_t *trk)
 }
 
 /*********************************************************************
-  Only free trajectories, reset colors and predict point.
+  Only clear trajectories, reset colors and predict point.
 *********************************************************************/
 void tracker_traject_free (tracker_t *trk)
 {
-	region_clear (&trk->traject->tracker.r);
-	region_clear (&trk->traject->correct.r);
-	region_clear (&trk->traject->predict.r);
-	trk->traject->tracker.r.farbe = rot;
-	trk->traject->tracker.r.farbe2 = rot;
-	trk->traject->predict.r.farbe = blau;
-	trk->traject->predict.r.farbe2 = blau;
-	trk->traject->correct.r.farbe = gruen;
-	trk->traject->correct.r.farbe2 = gruen;
+	traject_clear (&trk->traject->tracker);
+	traject_clear (&trk->traject->correct);
+	traject_clear (&trk->traject->predict);
+	trk->traject->tracker.reg.r.farbe = rot;
+	trk->traject->tracker.reg.r.farbe2 = rot;
+	trk->traject->predict.reg.r.farbe = blau;
+	trk->traject->predict.reg.r.farbe2 = blau;
+	trk->traject->correct.reg.r.farbe = gruen;
+	trk->traject->correct.reg.r.farbe2 = gruen;
 	trk->pos->predict.x = 0;
 	trk->pos->predict.y = 0;
 }
@@ -346,14 +368,61 @@ void tracker_getNumCycles (tracker_t *trk, track_global_t *global)
 /*********************************************************************
   Clear all tracker
 *********************************************************************/
-void tracker_clear_all (tracker_t **trk)
+void tracker_clear_all (tracker_t **trk, int cnt)
 {
 	int i;
-	for (i=0; i<MAXKALMAN; i++)
+	for (i=0; i<cnt; i++)
 		tracker_remove(trk[i]);
 	iw_debug (4, "Deleted all tracker");
 }
 
+/*********************************************************************
+  Allocate cnt trackers in list.
+*********************************************************************/
+void tracker_list_init (tracker_list_t *list, int cnt)
+{
+	int i;
+
+	list->trk = (tracker_t**)iw_malloc (sizeof(tracker_t*)*cnt, "tracker list");
+	for (i=0; i<cnt; i++)
+		list->trk[i] = tracker_create();
+	list->cnt = cnt;
+	list->special_init = NULL;
+}
+
+/*********************************************************************
+  Append a new tracker to list and return it.
+*********************************************************************/
+tracker_t *tracker_list_add (tracker_list_t *list)
+{
+	tracker_t *trk = tracker_create();
+
+	list->trk = (tracker_t**)iw_realloc (list->trk, sizeof(tracker_t*)*(list->cnt+1),
+										 "tracker list");
+	list->trk[list->cnt++] = trk;
+	if (list->special_init)
+		list->special_init (trk);
+	iw_debug (3, "Number of trackers increased to %d", list->cnt);
+	return trk;
+}
+
+/*********************************************************************
+  Free all trackers of list, calling special_free() for them.
+*********************************************************************/
+void tracker_list_free (tracker_list_t *list, void (*special_free) (tracker_t *trk))
+{
+	int i;
+
+	for (i=0; i<list->cnt; i++) {
+		if (special_free)
+			special_free (list->trk[i]);
+		tracker_free (list->trk[i]);
+	}
+	free (list->trk);
+	list->trk = NULL;
+	list->cnt = 0;
+}
+
 /* #]  : */
 
 /* #[ Handtrack : */
@@ -361,114 +430,113 @@ void tracker_clear_all (tracker_t **trk)
 /*********************************************************************
   Initialisie tracker.
 *********************************************************************/
-void tracker_all_init (tracker_t **trk, iwRegion *regions,
+void tracker_all_init (tracker_list_t *list, iwRegion *regions,
 					   int num_regions, opt_values_t *opt_values,
 					   track_global_t *global)
 {
-	int i,j;
-	BOOL tracker_zugeordnet, region_zugeordnet;
+	int i, j, free_trk = 0;
+	BOOL *region_zugeordnet;
+	tracker_t *trk;
 
 	/* Initialisiere tracker, beachte dabei:
 	   - Region darf nicht einem anderen Filter zugeordnet sein
 	   - Bewertung der Region muss ueber opt_values->region_judgement/init_bewertung liegen */
 
+	/* Welche Regionen werden bereits getrackt? */
+	region_zugeordnet = (BOOL*)iw_malloc0 (sizeof(BOOL)*MAX(num_regions,1),
+										   "tracked regions");
+	for (j=0; j<list->cnt; j++)
+		if (list->trk[j]->work->best_match_region >= 0 &&
+			list->trk[j]->work->best_match_region < num_regions)
+			region_zugeordnet[list->trk[j]->work->best_match_region] = TRUE;
+
 	for (i=0; i<num_regions; i++) {
-		/* Soll diese Region getrackt werden? */
+		/* Soll diese Region getrackt werden und wird sie noch nicht getrackt? */
 		if (regions[i].r.pixelanzahl > 0 &&
-			regions[i].judgement >= opt_values->region_judgement) {
-
-			/* Wird diese Region bereits getrackt? */
-			region_zugeordnet = FALSE;
-			for (j=0; j<MAXKALMAN; j++) {
-				if (i == trk[j]->work->best_match_region) {
-					region_zugeordnet = TRUE;
-					break;
-				}
-			}
-
-			/* Region ist noch nicht getrackt */
-			if (!region_zugeordnet) {
-				tracker_zugeordnet = FALSE;
-
-				/* Suche "freien" Tracker */
-				for (j=0; j<MAXKALMAN; j++) {
-					if (! trk[j]->work->region_zugeordnet) {
-						iw_debug (2,"Tracker %d is assigned to region %d", j, i);
-						tracker_zugeordnet = TRUE;
-						trk[j]->work->region_zugeordnet = TRUE;
-						trk[j]->work->best_match_region = i;
-						trk[j]->status = Prepare;
-						trk[j]->pos->region_hypo.x = regions[i].r.schwerpunkt.x;
-						trk[j]->pos->region_hypo.y = regions[i].r.schwerpunkt.y;
-						trk[j]->pos->previous.x = trk[j]->pos->region_hypo.x;
-						trk[j]->pos->previous.y = trk[j]->pos->region_hypo.y;
-						trk[j]->pos->correct.x = trk[j]->pos->region_hypo.x;
-						trk[j]->pos->correct.y = trk[j]->pos->region_hypo.y;
-						trk[j]->judge->init_zeit = global->cur_time;
-						trk[j]->judge->init_pos.x = trk[j]->pos->region_hypo.x;
-						trk[j]->judge->init_pos.y = trk[j]->pos->region_hypo.y;
-						trk[j]->judge->max_dist = 0.0;
-						break;
-					}
-				}
-				if (!tracker_zugeordnet)
-					iw_warning ("No free tracker for a region");
-			}
+			regions[i].judgement >= opt_values->region_judgement &&
+			!region_zugeordnet[i]) {
+
+			/* Suche "freien" Tracker, lege einen neuen an, falls keiner frei ist */
+			while (free_trk < list->cnt && list->trk[free_trk]->work->region_zugeordnet)
+				free_trk++;
+			if (free_trk < list->cnt)
+				trk = list->trk[free_trk];
+			else
+				trk = tracker_list_add (list);
+
+			iw_debug (2,"Tracker %d is assigned to region %d", free_trk, i);
+			trk->work->region_zugeordnet = TRUE;
+			trk->work->best_match_region = i;
+			trk->status = Prepare;
+			trk->pos->region_hypo.x = regions[i].r.schwerpunkt.x;
+			trk->pos->region_hypo.y = regions[i].r.schwerpunkt.y;
+			trk->pos->previous.x = trk->pos->region_hypo.x;
+			trk->pos->previous.y = trk->pos->region_hypo.y;
+			trk->pos->correct.x = trk->pos->region_hypo.x;
+			trk->pos->correct.y = trk->pos->region_hypo.y;
+			trk->judge->init_zeit = global->cur_time;
+			trk->judge->init_pos.x = trk->pos->region_hypo.x;
+			trk->judge->init_pos.y = trk->pos->region_hypo.y;
+			trk->judge->max_dist = 0.0;
+			region_zugeordnet[i] = TRUE;
 		}
 	}
+	free (region_zugeordnet);
 }
 
 /*********************************************************************
   Zuordnung der Regionen zu den Trackern.
 *********************************************************************/
-void tracker_all_mapRegions (tracker_t **trk, iwRegion *regions,
+void tracker_all_mapRegions (tracker_list_t *list, iwRegion *regions,
 							 int num_regions, opt_values_t *opt_values,
 							 track_global_t *global)
 {
 	Punkt_t center1, center2;
+	tracker_t **trk;
 	float dist;
 	int j, k;
 
-	for (j=0; j<MAXKALMAN; j++)
-		trk[j]->work->best_match_region = -1;
+	for (j=0; j<list->cnt; j++)
+		list->trk[j]->work->best_match_region = -1;
 
 	/* Zuordnung der Regionen zu den Trackern. Falls einem Tracker noch keine
 	   Region zugeordnet ist, wird er mit einer Region im gueltigen Bereich
 	   initialisiert */
 
-	tracker_all_findBestMatchRegion (trk, regions, num_regions, opt_values);
-	tracker_all_init (trk, regions, num_regions, opt_values, global);
+	tracker_all_findBestMatchRegion (list->trk, list->cnt, regions, num_regions, opt_values);
+	tracker_all_init (list, regions, num_regions, opt_values, global);
 
-	for (j=0; j<MAXKALMAN; j++) {
+	trk = list->trk;
+	for (j=0; j<list->cnt; j++) {
 		if (trk[j]->work->region_zugeordnet) {
 
 			/* Trage Parameter in die Trajektorien ein */
 			dist = _dist (trk[j]->pos->previous, trk[j]->judge->init_pos);
 			if (dist > trk[j]->judge->max_dist) trk[j]->judge->max_dist = dist;
 
-			trk[j]->traject->correct.r.umfang =
-				trk[j]->traject->tracker.r.umfang =
-				trk[j]->traject->predict.r.umfang =
+			trk[j]->traject->correct.reg.r.umfang =
+				trk[j]->traject->tracker.reg.r.umfang =
+				trk[j]->traject->predict.reg.r.umfang =
 				global->cur_time - trk[j]->judge->init_zeit;
 
-			trk[j]->traject->correct.r.compactness =
-				trk[j]->traject->tracker.r.compactness =
-				trk[j]->traject->predict.r.compactness =
+			trk[j]->traject->correct.reg.r.compactness =
+				trk[j]->traject->tracker.reg.r.compactness =
+				trk[j]->traject->predict.reg.r.compactness =
 				trk[j]->judge->max_dist;
 
-			trk[j]->traject->correct.id =
-				trk[j]->traject->tracker.id =
-				trk[j]->traject->predict.id =
+			trk[j]->traject->correct.reg.id =
+				trk[j]->traject->tracker.reg.id =
+				trk[j]->traject->predict.reg.id =
 				regions[trk[j]->work->best_match_region].id =
 				j;
 
 			regions[trk[j]->work->best_match_region].alter =
-				trk[j]->traject->correct.alter =
-				trk[j]->traject->tracker.alter =
-				trk[j]->traject->predict.alter =
+				trk[j]->traject->correct.reg.alter =
+				trk[j]->traject->tracker.reg.alter =
+				trk[j]->traject->predict.reg.alter =
 				rintf((float)(global->cur_time - trk[j]->judge->init_zeit) / global->dt_min);
 
-			for (k=0; k<MAXKALMAN; k++) {
+			for (k=0; k<list->cnt; k++) {
 
 				/* Falls 2 Tracker auf die gleiche Region zeigen, und
 				   einer davon nur eine sehr kurze Zeit existiert bzw. einen
@@ -537,71 +605,28 @@ void tracker_all_mapRegions (tracker_t **trk, iwRegion *regions,
 					trk[j]->work->virtuell = FALSE;
 
 				}
-			} /* for (k=0; k<MAXKALMAN; k++) */
+			} /* for (k=0; k<list->cnt; k++) */
 		} /* if (trk[j]->work->region_zugeordnet) */
-	} /* for (j=0; j<MAXKALMAN; j++) */
+	} /* for (j=0; j<list->cnt; j++) */
 }
 
 /*********************************************************************
-  Suche die naechstliegende Region.
+  Suche fuer jeden aktiven Tracker die naechstliegende Region, bei
+  konkurrierenden Trackern optimal ueber alle Tracker.
 *********************************************************************/
-void tracker_all_findBestMatchRegion (tracker_t **trk, iwRegion *regions,
+void tracker_all_findBestMatchRegion (tracker_t **trk, int cnt, iwRegion *regions,
 									  int num_regions, opt_values_t *opt_values)
 {
-	int i,j;
-	float min_dist, dist;
-	float max_dist = (float)opt_values->max_tol_dist; /* Maximal tolerierte Entfernung */
-
-	for (j=0; j<MAXKALMAN; j++) {
-
-		/* Ist der tracker aktiv? */
-		if (trk[j]->work->region_zugeordnet) {
-
-			/* Suche die naheliegendste Region */
-			min_dist = 10000.0;
-			for (i=0; i<num_regions; i++) {
-				if (!regions[i].r.pixelanzahl) continue;
-				dist = _dist(regions[i].r.schwerpunkt, trk[j]->pos->correct);
-				if (dist < min_dist) {
-					min_dist = dist;
-					trk[j]->work->best_match_region = i;
-					trk[j]->pos->region_hypo.x = regions[i].r.schwerpunkt.x;
-					trk[j]->pos->region_hypo.y = regions[i].r.schwerpunkt.y;
-				}
-			}
-
-			/* Ist die Region zu weit weg und der tracker virtuell? */
-			if (min_dist >= max_dist && trk[j]->work->virtuell) {
-
-				/* Suche die naheliegendste Region
-				   bezueglich des virtuellen Schwerpunktes */
-				min_dist = 10000.0;
-				for (i=0; i<num_regions; i++) {
-					if (!regions[i].r.pixelanzahl) continue;
-					dist = _dist (regions[i].r.schwerpunkt, trk[j]->pos->tracker_2);
-					if (dist < min_dist) {
-						min_dist = dist;
-						trk[j]->work->best_match_region = i;
-						trk[j]->pos->region_hypo.x = regions[i].r.schwerpunkt.x;
-						trk[j]->pos->region_hypo.y = regions[i].r.schwerpunkt.y;
-					}
-				}
-			}
-			if (min_dist < max_dist) {
-				trk[j]->work->region_zugeordnet = TRUE;
-			} else {
-				iw_debug (3, "Deleted tracker %d min_dist: %f", j, min_dist);
-				tracker_remove (trk[j]);
-			}
-		}
-	}
+	/* Maximal tolerierte Entfernung */
+	track_assign_regions (trk, cnt, regions, num_regions,
+						  (float)opt_values->max_tol_dist);
 }
 
 /*********************************************************************
   Bewertung der Tracker bezueglich der Zeit, die sie existieren und
   der Distanz, die sie zurueckgelegt haben.
 *********************************************************************/
-void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
+void tracker_all_judge (tracker_t **trk, int trk_cnt, iwRegion *regions, int numregs,
 						opt_values_t *opt_values, unsigned int cur_time)
 {
 #define NORM	(1/(tanh(1)*tanh(1)))
@@ -610,7 +635,7 @@ void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
 	int min_zeit = opt_values->time_init;
 	float min_weg = (float)opt_values->dist_init;
 
-	for (i=0; i<MAXKALMAN; i++) {
+	for (i=0; i<trk_cnt; i++) {
 
 		if (trk[i]->work->region_zugeordnet && trk[i]->status == Run) {
 
@@ -627,7 +652,7 @@ void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
 			   trk[i]->judge->judgement = (time > min_zeit && dist > min_weg); */
 
 			/* Update motion judgement */
-			cnt = trk[i]->traject->tracker.r.polygon.n_punkte - trk[i]->work->num_cycles - 2;
+			cnt = trk[i]->traject->tracker.reg.r.polygon.n_punkte - trk[i]->work->num_cycles - 2;
 			if (cnt<-1) cnt = -1;
 			for (j=0; j<trk[i]->work->num_cycles; j++) {
 				cnt++;
@@ -639,37 +664,37 @@ void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
 
 			if(opt_values->black_white) {
 				if (trk[i]->judge->judgement > opt_values->rating) {
-					trk[i]->traject->correct.r.farbe = blau;
-					trk[i]->traject->correct.r.farbe2 = blau;
+					trk[i]->traject->correct.reg.r.farbe = blau;
+					trk[i]->traject->correct.reg.r.farbe2 = blau;
 				} else {
-					trk[i]->traject->correct.r.farbe = hintergrund;
-					trk[i]->traject->correct.r.farbe2 = hintergrund;
+					trk[i]->traject->correct.reg.r.farbe = hintergrund;
+					trk[i]->traject->correct.reg.r.farbe2 = hintergrund;
 				}
 			} else {
 				if (trk[i]->judge->judgement > opt_values->rating) {
-					trk[i]->traject->correct.r.farbe = gelb;
-					trk[i]->traject->correct.r.farbe2 = gelb;
+					trk[i]->traject->correct.reg.r.farbe = gelb;
+					trk[i]->traject->correct.reg.r.farbe2 = gelb;
 				} else {
-					trk[i]->traject->correct.r.farbe = gruen;
-					trk[i]->traject->correct.r.farbe2 = gruen;
+					trk[i]->traject->correct.reg.r.farbe = gruen;
+					trk[i]->traject->correct.reg.r.farbe2 = gruen;
 				}
 			}
 
 			regions[ trk[i]->work->best_match_region ].judge_kalman =
-				trk[i]->traject->tracker.judge_kalman =
-				trk[i]->traject->predict.judge_kalman =
-				trk[i]->traject->correct.judge_kalman =
+				trk[i]->traject->tracker.reg.judge_kalman =
+				trk[i]->traject->predict.reg.judge_kalman =
+				trk[i]->traject->correct.reg.judge_kalman =
 				trk[i]->judge->judgement;
 
 			regions[ trk[i]->work->best_match_region ].judge_motion =
-				trk[i]->traject->tracker.judge_motion =
-				trk[i]->traject->predict.judge_motion =
-				trk[i]->traject->correct.judge_motion =
+				trk[i]->traject->tracker.reg.judge_motion =
+				trk[i]->traject->predict.reg.judge_motion =
+				trk[i]->traject->correct.reg.judge_motion =
 				trk[i]->judge->motion;
 
-			trk[i]->traject->tracker.judgement =
-				trk[i]->traject->predict.judgement =
-				trk[i]->traject->correct.judgement =
+			trk[i]->traject->tracker.reg.judgement =
+				trk[i]->traject->predict.reg.judgement =
+				trk[i]->traject->correct.reg.judgement =
 				regions[ trk[i]->work->best_match_region ].judgement;
 		}
 	}
@@ -680,64 +705,95 @@ void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
 /* #[ Trajectories : */
 
 /*********************************************************************
-  Allocate and init trajectory.
+  Append the point (x,y) to the trajectory. If the trajectory is
+  full, the oldest point is overwritten. O(1), nothing is allocated.
+*********************************************************************/
+static inline void traject_append (traject_ring_t *ring, float x, float y)
+{
+	Polygon_t *poly = &ring->reg.r.polygon;
+	Punkt_t *p;
+
+	if (poly->n_punkte < MAXTRACKLEN) {
+		p = ring->ptrs[ring->start + poly->n_punkte];
+		poly->n_punkte++;
+	} else {
+		p = ring->ptrs[ring->start];
+		ring->start = (ring->start+1) % MAXTRACKLEN;
+		poly->punkt = &ring->ptrs[ring->start];
+	}
+	p->x = x;
+	p->y = y;
+	ring->total++;
+}
+
+/*********************************************************************
+  Restart the trajectory with the two points (x,y).
 *********************************************************************/
-void traject_init (float x, float y, Region_t *reg)
+void traject_init (float x, float y, traject_ring_t *ring)
 {
-	region_clear (reg);
-
-	reg->polygon.n_punkte = 2;
-	reg->polygon.punkt = (Punkt_t**)malloc(sizeof(Punkt_t*) * 2);
-	reg->polygon.punkt[0] = (Punkt_t*)malloc(sizeof(Punkt_t));
-	reg->polygon.punkt[0]->x = x;
-	reg->polygon.punkt[0]->y = y;
-	reg->polygon.punkt[1] = (Punkt_t*)malloc(sizeof(Punkt_t));
-	reg->polygon.punkt[1]->x = x;
-	reg->polygon.punkt[1]->y = y;
-	reg->schwerpunkt.x = x;
-	reg->schwerpunkt.y = y+30;
+	traject_clear (ring);
+	traject_append (ring, x, y);
+	traject_append (ring, x, y);
+	ring->reg.r.schwerpunkt.x = x;
+	ring->reg.r.schwerpunkt.y = y+30;
 }
 
 /*********************************************************************
-  Update trajectory with new points,
-  remove old points, interpolate
+  Update trajectory with cnt new points interpolated from the last
+  point to (x,y). Old points are removed if the trajectory gets
+  longer than MAXTRACKLEN.
 *********************************************************************/
-void traject_update (float x, float y, int cnt, Region_t *reg)
+void traject_update (float x, float y, int cnt, traject_ring_t *ring)
 {
-	int i, j, npunkt;
-	float oldx, oldy;
-
-	npunkt = reg->polygon.n_punkte;
-	oldx = reg->polygon.punkt[npunkt-1]->x;
-	oldy = reg->polygon.punkt[npunkt-1]->y;
-
-	/* Allocate new points if less than MAXTRACKLEN */
-	i = cnt;
-	if (npunkt+i > MAXTRACKLEN) i = MAXTRACKLEN - npunkt;
-	if (i > 0) {
-		npunkt += i;
-		reg->polygon.n_punkte += i;
-		reg->polygon.punkt = (Punkt_t**)realloc(reg->polygon.punkt,
-												(sizeof(Punkt_t*) * npunkt));
-		for (j=npunkt-i; j<npunkt; j++)
-			reg->polygon.punkt[j] = (Punkt_t*)malloc(sizeof(Punkt_t));
-	}
-	/* Remove old points if number of points gets above MAXTRACKLEN */
-	if (i != cnt) {
-		i = cnt-i;
-		for (j=i; j<npunkt; j++) {
-			reg->polygon.punkt[j-i]->x = reg->polygon.punkt[j]->x;
-			reg->polygon.punkt[j-i]->y = reg->polygon.punkt[j]->y;
-		}
+	Polygon_t *poly = &ring->reg.r.polygon;
+	float oldx = x, oldy = y;
+	int i;
+
+	if (poly->n_punkte > 0) {
+		oldx = poly->punkt[poly->n_punkte-1]->x;
+		oldy = poly->punkt[poly->n_punkte-1]->y;
 	}
-	/* Enter interpolated points */
+	/* Points which would be removed immediately are only counted */
 	i = (cnt>MAXTRACKLEN) ? (cnt-MAXTRACKLEN) : 0;
-	for (; i<cnt; i++) {
-		reg->polygon.punkt[npunkt-cnt+i]->x = oldx + (x - oldx)*(i+1)/cnt;
-		reg->polygon.punkt[npunkt-cnt+i]->y = oldy + (y - oldy)*(i+1)/cnt;
-	}
-	reg->schwerpunkt.x = x;
-	reg->schwerpunkt.y = y+30;
+	ring->total += i;
+	for (; i<cnt; i++)
+		traject_append (ring, oldx + (x - oldx)*(i+1)/cnt, oldy + (y - oldy)*(i+1)/cnt);
+
+	ring->reg.r.schwerpunkt.x = x;
+	ring->reg.r.schwerpunkt.y = y+30;
+}
+
+/*********************************************************************
+  Return the i-th newest point of the trajectory (i=0: last added
+  point) or NULL if the trajectory has not that many points.
+*********************************************************************/
+Punkt_t *traject_last (traject_ring_t *ring, int i)
+{
+	Polygon_t *poly = &ring->reg.r.polygon;
+
+	if (i < 0 || i >= poly->n_punkte) return NULL;
+	return poly->punkt[poly->n_punkte-1-i];
+}
+
+/*********************************************************************
+  Initialize reg with the part of the trajectory, which was added
+  since the last call, preceded by the last point of the last call
+  (if it is still available) to connect both parts. Only pointers
+  are copied, reg is valid till the next trajectory update.
+  first: Index of the first point of reg counted from the start of
+         the trajectory, 0 for a new trajectory.
+*********************************************************************/
+void traject_delta (traject_ring_t *ring, iwRegion *reg, int *first)
+{
+	int oldest = ring->total - ring->reg.r.polygon.n_punkte;
+	int f = ring->sent > 0 ? ring->sent-1 : 0;
+
+	if (f < oldest) f = oldest;
+	*reg = ring->reg;
+	reg->r.polygon.punkt += f - oldest;
+	reg->r.polygon.n_punkte = ring->total - f;
+	ring->sent = ring->total;
+	*first = f;
 }
 
 /* #]  : */
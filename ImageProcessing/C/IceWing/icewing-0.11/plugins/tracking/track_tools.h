@@ -35,7 +35,8 @@
 
 /* #[ Defines : */
 
-#define MAXKALMAN			20			/* Max number of kalmans */
+#define TRACKER_START_CNT	20			/* Initial number of trackers */
+#define MAXTRACKLEN			500			/* Max length of trajectory (older points are removed) */
 #define MAX_TIME_DIFF		160000
 
 #define VIS_TRAJECT_CNT		2
@@ -44,10 +45,22 @@
 
 /* #[ Typedefs : */
 
+/* Trajectory with at most MAXTRACKLEN points, stored in a ring buffer.
+   reg.r.polygon is a view of the ring (oldest point first), as ptrs
+   holds the point pointers twice, no points must be copied. */
 typedef struct {
-	iwRegion	  tracker;				/* Gemessene Trajektorie */
-	iwRegion	  predict;				/* Unkorrigierte Praediktion */
-	iwRegion	  correct;				/* Korrigierte Trajektorie */
+	iwRegion	  reg;					/* Region with the trajectory as polygon */
+	Punkt_t		  *pts;					/* MAXTRACKLEN points */
+	Punkt_t		  **ptrs;				/* 2*MAXTRACKLEN pointers, ptrs[i] = &pts[i%MAXTRACKLEN] */
+	int			  start;				/* Index of the oldest point in pts */
+	int			  total;				/* Number of points added since traject_init() */
+	int			  sent;					/* total during the last delta output */
+} traject_ring_t;
+
+typedef struct {
+	traject_ring_t tracker;				/* Gemessene Trajektorie */
+	traject_ring_t predict;				/* Unkorrigierte Praediktion */
+	traject_ring_t correct;				/* Korrigierte Trajektorie */
 } tracker_traject_t;
 
 typedef struct {
@@ -93,6 +106,13 @@ typedef struct tracker_t {
 	void*				special;		/* Holds special data e.g. *kalman */
 } tracker_t;
 
+/* All trackers, grows if more regions must be tracked */
+typedef struct {
+	tracker_t **trk;
+	int cnt;							/* Number of trackers in trk */
+	void (*special_init) (tracker_t *trk);	/* Called for new trackers */
+} tracker_list_t;
+
 typedef enum {
 	None,
 	Kalman,
@@ -137,6 +157,7 @@ typedef struct {
 typedef struct {
 	char *out_track;
 	char *in_regions;
+	BOOL out_delta;						/* Output only new trajectory points? */
 }  visParameter_t;
 
 typedef struct {
@@ -159,6 +180,12 @@ typedef struct track_imp_t {
 	void (*predict) (tracker_t *trk, opt_values_t *opt_values, track_global_t *global);
 	void (*correct) (tracker_t *trk, opt_values_t *opt_values, track_global_t *global);
 	void (*traject_calc) (tracker_t *trk, int i, float *vals, int window_len);
+	/* If !=NULL, called with all cnt trackers instead of calling
+	   predict()/correct() for the running/assigned trackers */
+	void (*predict_all) (tracker_t **trk, int cnt, opt_values_t *opt_values,
+						 track_global_t *global);
+	void (*correct_all) (tracker_t **trk, int cnt, opt_values_t *opt_values,
+						 track_global_t *global);
 } track_imp_t;
 
 /* #]  : */
@@ -175,23 +202,28 @@ void tracker_remove(tracker_t *trk);
 void tracker_free (tracker_t *trk);
 void tracker_traject_free (tracker_t *trk);
 void tracker_getNumCycles (tracker_t *trk, track_global_t *global);
-void tracker_clear_all (tracker_t **trk);
+void tracker_clear_all (tracker_t **trk, int cnt);
+void tracker_list_init (tracker_list_t *list, int cnt);
+tracker_t *tracker_list_add (tracker_list_t *list);
+void tracker_list_free (tracker_list_t *list, void (*special_free) (tracker_t *trk));
 
 /* Handtrack */
-void tracker_all_mapRegions (tracker_t **trk, iwRegion *regions,
+void tracker_all_mapRegions (tracker_list_t *list, iwRegion *regions,
 							 int num_regions, opt_values_t *opt_values,
 							 track_global_t *global);
-void tracker_all_findBestMatchRegion (tracker_t **trk, iwRegion *regions,
+void tracker_all_findBestMatchRegion (tracker_t **trk, int cnt, iwRegion *regions,
 									  int num_regions, opt_values_t *opt_values);
-void tracker_all_init (tracker_t **trk, iwRegion *regions,
+void tracker_all_init (tracker_list_t *list, iwRegion *regions,
 					   int num_regions, opt_values_t *opt_values,
 					   track_global_t *global);
-void tracker_all_judge (tracker_t **trk, iwRegion *regions, int numregs,
+void tracker_all_judge (tracker_t **trk, int trk_cnt, iwRegion *regions, int numregs,
 						opt_values_t *opt_values, unsigned int cur_time);
 
 /* Trajectories */
-void traject_init (float x, float y, Region_t *reg);
-void traject_update (float x, float y, int cnt, Region_t *reg);
+void traject_init (float x, float y, traject_ring_t *ring);
+void traject_update (float x, float y, int cnt, traject_ring_t *ring);
+Punkt_t *traject_last (traject_ring_t *ring, int i);
+void traject_delta (traject_ring_t *ring, iwRegion *reg, int *first);
 
 /* Datastruct */
 void traject_store (visTraject_t *traject, float *vals);
@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "main/image.h"
 #include "fileset.h"
@@ -45,6 +46,30 @@ typedef struct fsetEntry {
 	BOOL frameadv:1;
 } fsetEntry;
 
+		/* Number of images/movie frames loaded in advance */
+#define FSET_PREFETCH		4
+		/* Number of threads loading the images */
+#define FSET_THREADS		2
+
+typedef enum {
+	FSET_SLOT_FREE,
+	FSET_SLOT_QUEUED,			/* Waiting for a prefetch thread */
+	FSET_SLOT_LOADING,
+	FSET_SLOT_DONE
+} fsetSlotState;
+
+typedef struct fsetSlot {
+	fsetSlotState state;
+	int pos;					/* Fileset position of the image */
+	int order;					/* Distance to the current position */
+	BOOL stale;					/* Loading, but the image is not needed any more */
+	iwImage *img;
+	iwImgStatus status;
+	double framerate;			/* Movie frames: frame rate of the movie */
+	BOOL has_time;				/* Movie frames: time contains the frame time */
+	struct timeval time;
+} fsetSlot;
+
 typedef struct _fsetList {
 	int act;					/* Current position in fileset */
 	int cnt;					/* Number of entries in fileset */
@@ -56,6 +81,20 @@ typedef struct _fsetList {
 	BOOL rgb;					/* Command line: RGB/YUV */
 	BOOL use_ext;				/* Command line: check only extension? */
 	BOOL frameadv;
+
+	/* Read-ahead of images and movie frames, protected by pre_mutex */
+	pthread_mutex_t pre_mutex;
+	pthread_cond_t pre_work;	/* A slot was queued */
+	pthread_cond_t pre_done;	/* A slot was loaded */
+	fsetSlot pre_slot[FSET_PREFETCH];
+	int pre_threads;			/* Number of started prefetch threads */
+	int pre_last;				/* Position of the last read image */
+	int pre_step;				/* Read direction: 1 or -1 */
+	iwMovie *pre_movie;			/* Movie used by the prefetch threads */
+	char pre_movie_name[PATH_MAX];
+	BOOL pre_movie_busy;		/* A prefetch thread decodes from pre_movie */
+	iwImage *pre_free[FSET_PREFETCH+1];	/* Images for reuse by movie frames */
+	int pre_nfree;
 } _fsetList;
 
 /*********************************************************************
@@ -130,7 +169,7 @@ static void fileset_add (fsetList *f, char *name,
 static BOOL fileset_open_file (char *fname, BOOL use_ext)
 {
 	static char *ext[] = {
-		".asf", ".avi", ".bin", ".divx", ".flc", ".fli", ".m1v",
+		".asf", ".avi", ".bin", ".divx", ".flc", ".fli", ".iwr", ".iwz", ".m1v",
 		".m4v",".mjpeg", ".mjpg", ".mkv", ".mov", ".mpeg", ".mpg",
 		".nuv", ".ogg", ".ogm", ".qt", ".rm", ".viv", ".vob", ".wmv",
 		NULL};
@@ -209,6 +248,11 @@ int iw_fset_add (fsetList **fset, char *name)
 	if (!*fset) {
 		*fset = calloc (1, sizeof(fsetList));
 		(*fset)->rgb = TRUE;
+		pthread_mutex_init (&(*fset)->pre_mutex, NULL);
+		pthread_cond_init (&(*fset)->pre_work, NULL);
+		pthread_cond_init (&(*fset)->pre_done, NULL);
+		(*fset)->pre_last = -1;
+		(*fset)->pre_step = 1;
 	}
 	f = *fset;
 
@@ -436,6 +480,256 @@ static iwImage* avi_read (fsetList *fset, char *name,
 	return img;
 }
 
+/*********************************************************************
+  Keep the not any more needed image img for reuse by the prefetch
+  threads, so that the planes of movie frames must not be allocated
+  for every frame. pre_mutex must be locked.
+*********************************************************************/
+static void fset_image_put (fsetList *fset, iwImage *img)
+{
+	if (!img) return;
+	if (fset->pre_nfree < FSET_PREFETCH+1)
+		fset->pre_free[fset->pre_nfree++] = img;
+	else
+		iw_img_free (img, IW_IMG_FREE_ALL);
+}
+
+/*********************************************************************
+  Release the image returned by the last iw_fset_get() call.
+*********************************************************************/
+static void fset_image_release (fsetList *fset)
+{
+	pthread_mutex_lock (&fset->pre_mutex);
+	fset_image_put (fset, fset->image);
+	fset->image = NULL;
+	pthread_mutex_unlock (&fset->pre_mutex);
+}
+
+/*********************************************************************
+  Decode frame 'frame' of the movie 'name' into img, reusing its
+  planes if possible. Uses fset->pre_movie, the caller must have set
+  fset->pre_movie_busy. The status, the frame rate, and the frame time
+  are returned in res.
+*********************************************************************/
+static void fset_prefetch_movie (fsetList *fset, char *name, int frame,
+								 iwImage *img, fsetSlot *res)
+{
+	/* Check if a new file should be opened */
+	if (fset->pre_movie && strcmp (fset->pre_movie_name, name)) {
+		iw_movie_close (fset->pre_movie);
+		fset->pre_movie = NULL;
+	}
+	if (!fset->pre_movie) {
+		strncpy (fset->pre_movie_name, name, PATH_MAX-1);
+		fset->pre_movie_name[PATH_MAX-1] = '\0';
+	}
+
+	res->framerate = 0;
+	res->has_time = FALSE;
+	res->status = iw_movie_read_to (&fset->pre_movie, fset->pre_movie_name,
+									frame, img);
+	if (res->status == IW_IMG_STATUS_OK) {
+		res->framerate = iw_movie_get_framerate (fset->pre_movie);
+		res->has_time = iw_movie_get_frametime (fset->pre_movie, &res->time);
+	}
+}
+
+/*********************************************************************
+  Prefetch thread: Load the queued images and movie frames of the
+  fileset data. Movie frames are decoded by one thread at a time in
+  read direction, so that the decoder can continue sequentially.
+*********************************************************************/
+static void *fset_prefetch_worker (void *data)
+{
+	fsetList *fset = data;
+	fsetSlot *slot, res;
+	iwImage *img;
+	char *name;
+	int i, frame;
+
+	pthread_mutex_lock (&fset->pre_mutex);
+	while (TRUE) {
+		slot = NULL;
+		for (i=0; i<FSET_PREFETCH; i++) {
+			fsetSlot *s = &fset->pre_slot[i];
+			if (s->state == FSET_SLOT_QUEUED &&
+				(!slot || s->order < slot->order) &&
+				(fset->fileset[s->pos].frame < 0 || !fset->pre_movie_busy))
+				slot = s;
+		}
+		if (!slot) {
+			pthread_cond_wait (&fset->pre_work, &fset->pre_mutex);
+			continue;
+		}
+		slot->state = FSET_SLOT_LOADING;
+		slot->stale = FALSE;
+		name = fset->fileset[slot->pos].name;
+		frame = fset->fileset[slot->pos].frame;
+		img = NULL;
+		if (frame >= 0) {
+			fset->pre_movie_busy = TRUE;
+			if (fset->pre_nfree > 0)
+				img = fset->pre_free[--fset->pre_nfree];
+		}
+		pthread_mutex_unlock (&fset->pre_mutex);
+
+		if (frame >= 0) {
+			if (img || (img = iw_img_new())) {
+				fset_prefetch_movie (fset, name, frame, img, &res);
+			} else {
+				res.status = IW_IMG_STATUS_MEM;
+				res.framerate = 0;
+				res.has_time = FALSE;
+			}
+		} else {
+			img = iw_img_load (name, &res.status);
+			res.framerate = 0;
+			res.has_time = FALSE;
+		}
+
+		pthread_mutex_lock (&fset->pre_mutex);
+		if (frame >= 0) {
+			fset->pre_movie_busy = FALSE;
+			pthread_cond_broadcast (&fset->pre_work);
+			if (res.status != IW_IMG_STATUS_OK) {
+				fset_image_put (fset, img);
+				img = NULL;
+			}
+		}
+		if (slot->stale) {
+			fset_image_put (fset, img);
+			slot->state = FSET_SLOT_FREE;
+		} else {
+			slot->img = img;
+			slot->status = res.status;
+			slot->framerate = res.framerate;
+			slot->has_time = res.has_time;
+			slot->time = res.time;
+			slot->state = FSET_SLOT_DONE;
+		}
+		pthread_cond_broadcast (&fset->pre_done);
+	}
+	return NULL;
+}
+
+/*********************************************************************
+  Queue the images and movie frames following position pos in read
+  direction step for loading and cancel all prefetched images, which
+  are not needed any more, e.g. because of a seek via iw_fset_set_pos().
+  Movie frames of entries which advance relative to the movie
+  position (frameadv) are not prefetched.
+*********************************************************************/
+static void fset_prefetch_schedule (fsetList *fset, int pos, int step)
+{
+	int want[FSET_PREFETCH], nwant = 0, i, k, p;
+	BOOL queued = FALSE;
+
+	/* Positions, which will probably be read next */
+	p = pos;
+	for (k=0; k<FSET_PREFETCH && fset->cnt > 1; k++) {
+		p = (p + step + fset->cnt) % fset->cnt;
+		if (p == pos) break;
+		if (fset->fileset[p].frame < 0 || !fset->fileset[p].frameadv)
+			want[nwant++] = p;
+	}
+
+	pthread_mutex_lock (&fset->pre_mutex);
+
+	/* Cancel all images outside of the new window */
+	for (i=0; i<FSET_PREFETCH; i++) {
+		fsetSlot *slot = &fset->pre_slot[i];
+		if (slot->state == FSET_SLOT_FREE || slot->stale) continue;
+		for (k=0; k<nwant && want[k] != slot->pos; k++) /* empty */;
+		if (k < nwant) {
+			slot->order = k;
+			want[k] = -1;
+			continue;
+		}
+		if (slot->state == FSET_SLOT_LOADING) {
+			slot->stale = TRUE;
+		} else {
+			if (slot->state == FSET_SLOT_DONE)
+				fset_image_put (fset, slot->img);
+			slot->img = NULL;
+			slot->state = FSET_SLOT_FREE;
+		}
+	}
+
+	/* Queue the missing images */
+	for (k=0, i=0; k<nwant; k++) {
+		if (want[k] < 0) continue;
+		while (i<FSET_PREFETCH && fset->pre_slot[i].state != FSET_SLOT_FREE) i++;
+		if (i >= FSET_PREFETCH) break;
+		fset->pre_slot[i].state = FSET_SLOT_QUEUED;
+		fset->pre_slot[i].pos = want[k];
+		fset->pre_slot[i].order = k;
+		fset->pre_slot[i].stale = FALSE;
+		fset->pre_slot[i].img = NULL;
+		queued = TRUE;
+	}
+
+	if (queued) {
+		while (fset->pre_threads < FSET_THREADS) {
+			pthread_t thread;
+			pthread_attr_t attr;
+
+			pthread_attr_init (&attr);
+			pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+			if (pthread_create (&thread, &attr, fset_prefetch_worker, fset)) {
+				pthread_attr_destroy (&attr);
+				iw_warning ("Unable to start prefetch thread %d", fset->pre_threads);
+				break;
+			}
+			pthread_attr_destroy (&attr);
+			fset->pre_threads++;
+		}
+		if (fset->pre_threads > 0) {
+			pthread_cond_broadcast (&fset->pre_work);
+		} else {
+			/* No threads -> no prefetching */
+			for (i=0; i<FSET_PREFETCH; i++)
+				if (fset->pre_slot[i].state == FSET_SLOT_QUEUED)
+					fset->pre_slot[i].state = FSET_SLOT_FREE;
+		}
+	}
+	pthread_mutex_unlock (&fset->pre_mutex);
+}
+
+/*********************************************************************
+  If the image at position pos was prefetched, wait till it is loaded
+  and return it with its status (and for movie frames the frame rate
+  and frame time) in res.
+  Return: TRUE if the image was prefetched.
+*********************************************************************/
+static BOOL fset_prefetch_take (fsetList *fset, int pos, fsetSlot *res)
+{
+	fsetSlot *slot = NULL;
+	BOOL found = FALSE;
+	int i;
+
+	pthread_mutex_lock (&fset->pre_mutex);
+	for (i=0; i<FSET_PREFETCH && !slot; i++)
+		if (fset->pre_slot[i].state != FSET_SLOT_FREE &&
+			!fset->pre_slot[i].stale && fset->pre_slot[i].pos == pos)
+			slot = &fset->pre_slot[i];
+	if (slot) {
+		if (slot->state == FSET_SLOT_QUEUED) {
+			/* Not started yet -> load it directly */
+			slot->state = FSET_SLOT_FREE;
+		} else {
+			while (slot->state == FSET_SLOT_LOADING)
+				pthread_cond_wait (&fset->pre_done, &fset->pre_mutex);
+			*res = *slot;
+			slot->img = NULL;
+			slot->state = FSET_SLOT_FREE;
+			found = TRUE;
+		}
+	}
+	pthread_mutex_unlock (&fset->pre_mutex);
+
+	return found;
+}
+
 /*********************************************************************
   Read current image and return it, including different meta
   information about the image.
@@ -461,12 +755,29 @@ iwImgStatus iw_fset_get (fsetList *fset, fsetImage *i, int direction)
 	/* Try reading an avi file */
 	if (frame >= 0) {
 		double framerate;
+		BOOL has_time;
+		fsetSlot pre;
+
 		if (direction && fset->fileset[fset->act].frameadv) {
 			i->img = avi_read (fset, i->fname, direction, &framerate, &status);
 			fset->act += iw_movie_get_framepos(fset->avi_file) - frame;
-		} else
+			has_time = i->img && iw_movie_get_frametime (fset->avi_file, &i->time);
+		} else if (fset_prefetch_take (fset, fset->act, &pre)) {
+			/* Decoded in advance by a prefetch thread */
+			fset_image_release (fset);
+			fset->image = pre.img;
+			i->img = pre.img;
+			status = pre.status;
+			framerate = pre.framerate;
+			has_time = pre.has_time;
+			if (has_time) i->time = pre.time;
+		} else {
 			i->img = avi_read (fset, i->fname, frame, &framerate, &status);
-		if (i->img) {
+			has_time = i->img && iw_movie_get_frametime (fset->avi_file, &i->time);
+		}
+		if (i->img && has_time) {
+			/* Movie stores the grabbing time of its frames */
+		} else if (i->img) {
 			i->time = fset->fileset[fset->act].time;
 			if (i->time.tv_sec == 0 && i->time.tv_usec == 0) {
 				i->time.tv_usec = 1000*1000 / framerate;
@@ -484,11 +795,17 @@ iwImgStatus iw_fset_get (fsetList *fset, fsetImage *i, int direction)
 			}
 		}
 	}
-	/* Try reading a bitmap image */
+	/* Try reading a bitmap image, prefetched if possible */
 	if (!i->img) {
-		if (fset->image)
-			iw_img_free (fset->image, IW_IMG_FREE_ALL);
-		i->img = fset->image = iw_img_load (i->fname, &status);
+		fsetSlot pre;
+
+		fset_image_release (fset);
+		if (fset_prefetch_take (fset, fset->act, &pre)) {
+			fset->image = pre.img;
+			status = pre.status;
+		} else
+			fset->image = iw_img_load (i->fname, &status);
+		i->img = fset->image;
 		i->time = fset->fileset[fset->act].time;
 
 		/* Try the movie reader if not already done */
@@ -497,5 +814,13 @@ iwImgStatus iw_fset_get (fsetList *fset, fsetImage *i, int direction)
 	}
 	i->fset_pos = fset->act;
 
+	/* Start loading the next images */
+	if (direction == IW_MOVIE_PREV_FRAME || fset->act == fset->pre_last-1)
+		fset->pre_step = -1;
+	else if (direction == IW_MOVIE_NEXT_FRAME || fset->act == fset->pre_last+1)
+		fset->pre_step = 1;
+	fset->pre_last = fset->act;
+	fset_prefetch_schedule (fset, fset->act, fset->pre_step);
+
 	return status;
 }
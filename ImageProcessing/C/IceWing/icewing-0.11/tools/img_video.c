@@ -27,10 +27,124 @@
 #include "config.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "gui/Gtools.h"
 #include "tools/tools.h"
+#include "tools/parallel.h"
 #include "tools/img_video.h"
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define IMG_VIDEO_SSE2
+#include <emmintrin.h>
+#define IMG_TARGET(t)	__attribute__((target(t)))
+#endif
+
+/* Interpolation modes for a single pixel, used by the SIMD code */
+typedef enum {
+	BAYER_COPY,		/* Center pixel */
+	BAYER_HORIZ,	/* Mean of the left and right neighbour */
+	BAYER_VERT,		/* Mean of the upper and lower neighbour */
+	BAYER_DIAG,		/* Mean of the 4 diagonal neighbours */
+	BAYER_CROSS,	/* Mean of the 4 direct neighbours */
+	BAYER_EDGE		/* Edge sensing: HORIZ, VERT, or CROSS */
+} bayerMode;
+
+#ifdef IMG_VIDEO_SSE2
+
+/*********************************************************************
+  Return TRUE if the CPU supports SSE2.
+*********************************************************************/
+static BOOL bayer_simd (void)
+{
+	static int sse2 = -1;
+
+	if (sse2 < 0) {
+		__builtin_cpu_init();
+		sse2 = __builtin_cpu_supports ("sse2") ? 1 : 0;
+	}
+	return sse2;
+}
+
+/* Floor of the mean of a and b, i.e. (a+b)/2 */
+static inline IMG_TARGET("sse2") __m128i mean2_sse2 (__m128i a, __m128i b)
+{
+	return _mm_sub_epi8 (_mm_avg_epu8 (a, b),
+						 _mm_and_si128 (_mm_xor_si128 (a, b), _mm_set1_epi8 (1)));
+}
+
+/* (a+b+c+d)/4 */
+static inline IMG_TARGET("sse2") __m128i mean4_sse2 (__m128i a, __m128i b,
+													  __m128i c, __m128i d)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16 (_mm_add_epi16 (_mm_unpacklo_epi8 (a, zero),
+											   _mm_unpacklo_epi8 (b, zero)),
+								_mm_add_epi16 (_mm_unpacklo_epi8 (c, zero),
+											   _mm_unpacklo_epi8 (d, zero)));
+	__m128i hi = _mm_add_epi16 (_mm_add_epi16 (_mm_unpackhi_epi8 (a, zero),
+											   _mm_unpackhi_epi8 (b, zero)),
+								_mm_add_epi16 (_mm_unpackhi_epi8 (c, zero),
+											   _mm_unpackhi_epi8 (d, zero)));
+	return _mm_packus_epi16 (_mm_srli_epi16 (lo, 2), _mm_srli_epi16 (hi, 2));
+}
+
+#define LOAD(p)		_mm_loadu_si128 ((__m128i*)(p))
+
+/* Interpolate 16 pixels starting at s with mode */
+static inline IMG_TARGET("sse2") __m128i bayer_mode_sse2 (const guchar *s, int w,
+														   bayerMode mode)
+{
+	switch (mode) {
+		case BAYER_HORIZ:
+			return mean2_sse2 (LOAD(s-1), LOAD(s+1));
+		case BAYER_VERT:
+			return mean2_sse2 (LOAD(s-w), LOAD(s+w));
+		case BAYER_DIAG:
+			return mean4_sse2 (LOAD(s-w-1), LOAD(s-w+1), LOAD(s+w-1), LOAD(s+w+1));
+		case BAYER_CROSS:
+			return mean4_sse2 (LOAD(s-w), LOAD(s-1), LOAD(s+1), LOAD(s+w));
+		case BAYER_EDGE: {
+			__m128i l = LOAD(s-1), r = LOAD(s+1), u = LOAD(s-w), d = LOAD(s+w);
+			__m128i dh = _mm_or_si128 (_mm_subs_epu8 (l, r), _mm_subs_epu8 (r, l));
+			__m128i dv = _mm_or_si128 (_mm_subs_epu8 (u, d), _mm_subs_epu8 (d, u));
+			__m128i eq = _mm_cmpeq_epi8 (dh, dv);
+			__m128i le = _mm_cmpeq_epi8 (_mm_min_epu8 (dh, dv), dh);
+			return _mm_or_si128 (
+				_mm_or_si128 (_mm_andnot_si128 (eq, _mm_and_si128 (le, mean2_sse2 (l, r))),
+							  _mm_andnot_si128 (le, mean2_sse2 (u, d))),
+				_mm_and_si128 (eq, mean4_sse2 (u, l, r, d)));
+		}
+		default:
+			return LOAD(s);
+	}
+}
+
+/*********************************************************************
+  Interpolate the pixels 0..cnt-1 of the line s (neighbours are
+  accessed at s[-w-1] up to s[cnt+w]) and store them in d. Pixels
+  with an even index are interpolated according to even, pixels with
+  an odd index according to odd. Process 16 pixels per step and
+  return the number of processed pixels.
+*********************************************************************/
+static IMG_TARGET("sse2") int bayer_row_sse2 (const guchar *s, guchar *d, int w, int cnt,
+											  bayerMode even, bayerMode odd)
+{
+	__m128i sel = _mm_set1_epi16 (0x00FF);
+	int i;
+
+	for (i=0; i+16 <= cnt; i+=16) {
+		__m128i ve = bayer_mode_sse2 (s+i, w, even);
+		__m128i vo = bayer_mode_sse2 (s+i, w, odd);
+		_mm_storeu_si128 ((__m128i*)(d+i), _mm_or_si128 (_mm_and_si128 (sel, ve),
+														 _mm_andnot_si128 (sel, vo)));
+	}
+	return i;
+}
+#undef LOAD
+
+#endif /* IMG_VIDEO_SSE2 */
+
 #define IVsize 255
 #define IVtype guchar
 #define RENAME(n)		n##_guchar
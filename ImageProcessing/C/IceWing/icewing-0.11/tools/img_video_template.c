@@ -60,6 +60,25 @@ static void RENAME(img_stereo_decode) (IVtype *s, IVtype *d, int length)
 	}
 }
 
+/*********************************************************************
+  Interpolate the two lines s and s+w starting at column 1 with SIMD
+  code if possible. m0/m1: Modes for pixels with an even/odd offset
+  from s in the first line, m2/m3: the same for the second line.
+  Return the number of processed pixels per line (always even).
+*********************************************************************/
+static int RENAME(bayer_rows) (IVtype *s, IVtype *d, int w,
+							   bayerMode m0, bayerMode m1, bayerMode m2, bayerMode m3)
+{
+#if defined(IMG_VIDEO_SSE2) && IVsize==255
+	if (bayer_simd()) {
+		int cnt = bayer_row_sse2 (s, d, w, w-2, m0, m1);
+		bayer_row_sse2 (s+w, d+w, w, cnt, m2, m3);
+		return cnt;
+	}
+#endif
+	return 0;
+}
+
 /*********************************************************************
   Bilinear interpolation of the line y from src to dimg.
 *********************************************************************/
@@ -146,7 +165,10 @@ static void RENAME(bayer_edge_green_cggc) (IVtype *s, IVtype *dg, int w, int h)
 		dg[0] = s[0];
 		dg[w] = (s[0]+s[w+1]+s[2*w]) / 3;
 		dg++; s++;
-		for (x=1; x<w-1; x+=2) {
+		x = 1 + RENAME(bayer_rows) (s, dg, w, BAYER_EDGE, BAYER_COPY,
+									BAYER_COPY, BAYER_EDGE);
+		dg += x-1; s += x-1;
+		for (; x<w-1; x+=2) {
 			dh = ABS(s[-1]-s[1]);
 			dv = ABS(s[-w]-s[w]);
 			if (dh < dv)
@@ -203,7 +225,10 @@ static void RENAME(bayer_edge_green_gccg) (IVtype *s, IVtype *dg, int w, int h)
 		dg[0] = (s[-w]+s[1]+s[w]) / 3;
 		dg[w] = s[w];
 		dg++; s++;
-		for (x=1; x<w-1; x+=2) {
+		x = 1 + RENAME(bayer_rows) (s, dg, w, BAYER_COPY, BAYER_EDGE,
+									BAYER_EDGE, BAYER_COPY);
+		dg += x-1; s += x-1;
+		for (; x<w-1; x+=2) {
 			dg[0] = s[0];
 
 			dh = ABS(s[0]-s[2]);
@@ -260,7 +285,10 @@ static void RENAME(bayer_bilinear_green_cggc) (IVtype *s, IVtype *dg, int w, int
 		dg[0] = s[0];
 		dg[w] = (s[0]+s[w+1]+s[2*w]) / 3;
 		dg++; s++;
-		for (x=1; x<w-1; x+=2) {
+		x = 1 + RENAME(bayer_rows) (s, dg, w, BAYER_CROSS, BAYER_COPY,
+									BAYER_COPY, BAYER_CROSS);
+		dg += x-1; s += x-1;
+		for (; x<w-1; x+=2) {
 			dg[0] = (s[-w]+s[-1]+s[1]+s[w]) / 4;
 			dg[1] = s[1];
 			dg[w] = s[w];
@@ -302,7 +330,10 @@ static void RENAME(bayer_bilinear_green_gccg) (IVtype *s, IVtype *dg, int w, int
 		dg[0] = (s[-w]+s[1]+s[w]) / 3;
 		dg[w] = s[w];
 		dg++; s++;
-		for (x=1; x<w-1; x+=2) {
+		x = 1 + RENAME(bayer_rows) (s, dg, w, BAYER_COPY, BAYER_CROSS,
+									BAYER_CROSS, BAYER_COPY);
+		dg += x-1; s += x-1;
+		for (; x<w-1; x+=2) {
 			dg[0] = s[0];
 			dg[1] = (s[-w+1]+s[0]+s[2]+s[w+1]) / 4;
 			dg[w] = (s[0]+s[w-1]+s[w+1]+s[2*w]) / 4;
@@ -573,7 +604,13 @@ static void RENAME(img_bayer_bilinear) (IVtype *s, iwImage *dimg, iwImgBayerPatt
 			H2(w, 1, 2*w+1, b);
 			dg++; dr++; db++;
 			s++;
-			for (x=1; x<w-1; x+=2) {
+			RENAME(bayer_rows) (s, dr, w, BAYER_DIAG, BAYER_VERT,
+								BAYER_HORIZ, BAYER_COPY);
+			x = 1 + RENAME(bayer_rows) (s, db, w, BAYER_COPY, BAYER_HORIZ,
+										BAYER_VERT, BAYER_DIAG);
+			dg += x-1; dr += x-1; db += x-1;
+			s += x-1;
+			for (; x<w-1; x+=2) {
 				H4(0, r);
 				H2(1, -w+1, w+1, r);
 				H2(w, w-1, w+1, r);
@@ -635,7 +672,13 @@ static void RENAME(img_bayer_bilinear) (IVtype *s, iwImage *dimg, iwImgBayerPatt
 
 			dg++; dr++; db++;
 			s++;
-			for (x=1; x<w-1; x+=2) {
+			RENAME(bayer_rows) (s, dr, w, BAYER_VERT, BAYER_DIAG,
+								BAYER_COPY, BAYER_HORIZ);
+			x = 1 + RENAME(bayer_rows) (s, db, w, BAYER_HORIZ, BAYER_COPY,
+										BAYER_DIAG, BAYER_VERT);
+			dg += x-1; dr += x-1; db += x-1;
+			s += x-1;
+			for (; x<w-1; x+=2) {
 				H2(0, -w, w, r);
 				H4(1, r);
 				dr[w] = s[w];
@@ -802,23 +845,37 @@ static void RENAME(img_bayer_down) (IVtype *s, iwImage *dimg, iwImgBayerPattern
 	}
 }
 
-static void RENAME(rgb_to_cielab) (IVtype rgb[3], short lab[3])
+static float RENAME(lab_cbrt)[IVsize+1], RENAME(lab_xyz)[3][3];
+static pthread_once_t RENAME(lab_once) = PTHREAD_ONCE_INIT;
+
+/*********************************************************************
+  Initialize the lookup tables for rgb_to_cielab(). Called via
+  pthread_once() as the AHD tiles are converted in parallel.
+*********************************************************************/
+static void RENAME(cielab_init) (void)
 {
-	static BOOL initialized = FALSE;
-	static float cbrt[IVsize+1], xyz[3][3];
 	int i, j;
-	float r, x, y, z;
+	float r;
 
-	if (!initialized) {
-		for (i = 0; i <= IVsize; i++) {
-			r = i / (float)IVsize;
-			cbrt[i] = r > 0.008856 ? pow(r,1/3.0) : 7.787*r + 16/116.0;
-		}
-		for (i = 0; i < 3; i++)
-			for (j = 0; j < 3; j++)
-				xyz[i][j] = xyz_rgb[i][j] / d65_white[i];
-		initialized = TRUE;
+	for (i = 0; i <= IVsize; i++) {
+		r = i / (float)IVsize;
+		RENAME(lab_cbrt)[i] = r > 0.008856 ? pow(r,1/3.0) : 7.787*r + 16/116.0;
 	}
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			RENAME(lab_xyz)[i][j] = xyz_rgb[i][j] / d65_white[i];
+}
+
+/*********************************************************************
+  Convert rgb to CIE LAB * 64 by using the tables from cielab_init().
+*********************************************************************/
+static inline void RENAME(rgb_to_cielab) (IVtype rgb[3], short lab[3])
+{
+	float (*xyz)[3] = RENAME(lab_xyz);
+	float *cbrt = RENAME(lab_cbrt);
+	float x, y, z;
+	int i;
+
 	i = gui_lrint(xyz[0][0]*rgb[0] + xyz[0][1]*rgb[1] + xyz[0][2]*rgb[2]);
 	x = cbrt[CLAMP(i, 0, IVsize)];
 	i = gui_lrint(xyz[1][0]*rgb[0] + xyz[1][1]*rgb[1] + xyz[1][2]*rgb[2]);
@@ -832,131 +889,201 @@ static void RENAME(rgb_to_cielab) (IVtype rgb[3], short lab[3])
 	lab[2] = gui_lrint(64 * 200 * (y - z));
 }
 
+#define TS 256		/* Tile Size */
+
+#ifndef AHD_DATA
+#define AHD_DATA
+/* Shared data of all img_bayer_ahd() tiles */
+typedef struct {
+	void *src;
+	iwImage *dimg;
+	iwImgBayerPattern pattern;
+	int tiles_x;				/* Number of tiles per row */
+	pthread_mutex_t mutex;		/* Protects buffer/buffer_cnt */
+	char *buffer[IW_PARALLEL_MAX];	/* Unused tile buffers */
+	int buffer_cnt;
+} ahdData;
+#endif
+
 /*********************************************************************
-  Adaptive homogeneity-directed bayer decomposition ported from dcraw
-  (http://www.cybercom.net/~dcoffin/dcraw). Based on the work of
-  Keigo Hirakawa and Thomas Parks for the algorithm and Paul Lee for
-  the implementation in dcraw.
+  Adaptive homogeneity-directed interpolation of the tile with the
+  top left corner top/left by using buffer as temporary memory.
 *********************************************************************/
-#define TS 256		/* Tile Size */
-static void RENAME(img_bayer_ahd) (IVtype *src, iwImage *dimg, iwImgBayerPattern pattern)
+static void RENAME(ahd_tile) (IVtype *src, iwImage *dimg, iwImgBayerPattern pattern,
+							  int top, int left, char *buffer)
 {
 	static const int dir[4] = { -1, 1, -TS, TS };
 	IVtype *pix;
 	IVtype **dst = (IVtype **)dimg->data;
 	int width = dimg->width, height = dimg->height;
-	int i, top, left, y, x, tr, tc, c, d, val, hm[2];
+	int i, y, x, tr, tc, c, d, val, hm[2];
 	unsigned int ldiff[2][4], abdiff[2][4], leps, abeps;
 	IVtype (*rgb)[TS][TS][3], (*rix)[3];
 	short (*lab)[TS][TS][3];
-	char (*homo)[TS][TS], *buffer, *h;
-
-	RENAME(border_interpolate) (src, dimg, pattern);
+	char (*homo)[TS][TS], *h;
 
-	buffer = iw_malloc ((sizeof(IVtype)*6+14)*TS*TS, "ahd_interpolate()");
 	rgb  = (IVtype(*)[TS][TS][3]) buffer;
 	lab  = (short (*)[TS][TS][3])(buffer + sizeof(IVtype)*6*TS*TS);
 	homo = (char  (*)[TS][TS])   (buffer + (sizeof(IVtype)*6+12)*TS*TS);
 
-	for (top = 0; top < height; top += TS-6) {
-		for (left = 0; left < width; left += TS-6) {
-			/* Interpolate green horizontally and vertically */
-			for (y = top < 2 ? 2:top; y < top+TS && y < height-2; y++) {
-				x = left + (FC(pattern,left,y) == 1);
-				if (x < 2) x += 2;
-				for (; x < left+TS && x < width-2; x+=2) {
-					pix = src + y*width+x;
-					val = ((pix[-1] + pix[0] + pix[1]) * 2
-						   - pix[-2] - pix[2]) >> 2;
-					rgb[0][y-top][x-left][1] = UCLAMP(val,pix[-1],pix[1]);
-					val = ((pix[-width] + pix[0] + pix[width]) * 2
-						   - pix[-2*width] - pix[2*width]) >> 2;
-					rgb[1][y-top][x-left][1] = UCLAMP(val,pix[-width],pix[width]);
-				}
-			}
-			/* Interpolate red and blue, and convert to CIELab */
-			for (d = 0; d < 2; d++) {
-				for (y = top+1; y < top+TS-1 && y < height-1; y++) {
-					for (x = left+1; x < left+TS-1 && x < width-1; x++) {
-						pix = src + y*width+x;
-						rix = &rgb[d][y-top][x-left];
-						if ((c = 2 - FC(pattern,x,y)) == 1) {
-							c = FC(pattern,x,y+1);
-							val = pix[0] + (( pix[-1] + pix[1]
-											  - rix[-1][1] - rix[1][1] ) >> 1);
-							rix[0][2-c] = CLAMP(val, 0, IVsize);
-							val = pix[0] + (( pix[-width] + pix[width]
-											  - rix[-TS][1] - rix[TS][1] ) >> 1);
-						} else
-							val = rix[0][1] + (( pix[-width-1] + pix[-width+1]
-												 + pix[width-1] + pix[width+1]
-												 - rix[-TS-1][1] - rix[-TS+1][1]
-												 - rix[+TS-1][1] - rix[+TS+1][1] + 1) >> 2);
-						rix[0][c] = CLAMP(val, 0, IVsize);
-						rix[0][FC(pattern,x,y)] = pix[0];
-						RENAME(rgb_to_cielab) (rix[0], lab[d][y-top][x-left]);
-					}
-				}
+	/* At the image border not all values get interpolated and later
+	   read, clear them so that the result does not depend on the
+	   tile processing order */
+	if (top < 2 || left < 2 || top+TS > height-2 || left+TS > width-2)
+		memset (rgb, 0, sizeof(IVtype)*6*TS*TS);
+
+	/* Interpolate green horizontally and vertically */
+	for (y = top < 2 ? 2:top; y < top+TS && y < height-2; y++) {
+		x = left + (FC(pattern,left,y) == 1);
+		if (x < 2) x += 2;
+		for (; x < left+TS && x < width-2; x+=2) {
+			pix = src + y*width+x;
+			val = ((pix[-1] + pix[0] + pix[1]) * 2
+				   - pix[-2] - pix[2]) >> 2;
+			rgb[0][y-top][x-left][1] = UCLAMP(val,pix[-1],pix[1]);
+			val = ((pix[-width] + pix[0] + pix[width]) * 2
+				   - pix[-2*width] - pix[2*width]) >> 2;
+			rgb[1][y-top][x-left][1] = UCLAMP(val,pix[-width],pix[width]);
+		}
+	}
+	/* Interpolate red and blue, and convert to CIELab */
+	for (d = 0; d < 2; d++) {
+		for (y = top+1; y < top+TS-1 && y < height-1; y++) {
+			for (x = left+1; x < left+TS-1 && x < width-1; x++) {
+				pix = src + y*width+x;
+				rix = &rgb[d][y-top][x-left];
+				if ((c = 2 - FC(pattern,x,y)) == 1) {
+					c = FC(pattern,x,y+1);
+					val = pix[0] + (( pix[-1] + pix[1]
+									  - rix[-1][1] - rix[1][1] ) >> 1);
+					rix[0][2-c] = CLAMP(val, 0, IVsize);
+					val = pix[0] + (( pix[-width] + pix[width]
+									  - rix[-TS][1] - rix[TS][1] ) >> 1);
+				} else
+					val = rix[0][1] + (( pix[-width-1] + pix[-width+1]
+										 + pix[width-1] + pix[width+1]
+										 - rix[-TS-1][1] - rix[-TS+1][1]
+										 - rix[+TS-1][1] - rix[+TS+1][1] + 1) >> 2);
+				rix[0][c] = CLAMP(val, 0, IVsize);
+				rix[0][FC(pattern,x,y)] = pix[0];
+				RENAME(rgb_to_cielab) (rix[0], lab[d][y-top][x-left]);
 			}
-			/* Build homogeneity maps from the CIELab images */
-			memset (homo, 0, 2*TS*TS);
-			for (y = 2; y < TS-2 && y < height-top; y++) {
-				for (x = 2; x < TS-2 && x < width-left; x++) {
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++) {
-							val = lab[d][y][x][0]-lab[d][y][x+dir[i]][0];
-							ldiff[d][i] = ABS(val);
-						}
-					leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
-							   MAX(ldiff[1][2],ldiff[1][3]));
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++)
-							if (i >> 1 == d || ldiff[d][i] <= leps)
-								abdiff[d][i] =
-									SQR(lab[d][y][x][1]-lab[d][y][x+dir[i]][1])
-									+ SQR(lab[d][y][x][2]-lab[d][y][x+dir[i]][2]);
-					abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
-								MAX(abdiff[1][2],abdiff[1][3]));
-					for (d = 0; d < 2; d++)
-						for (i = 0; i < 4; i++)
-							if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
-								homo[d][y][x]++;
+		}
+	}
+	/* Build homogeneity maps from the CIELab images */
+	memset (homo, 0, 2*TS*TS);
+	for (y = 2; y < TS-2 && y < height-top; y++) {
+		for (x = 2; x < TS-2 && x < width-left; x++) {
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++) {
+					val = lab[d][y][x][0]-lab[d][y][x+dir[i]][0];
+					ldiff[d][i] = ABS(val);
 				}
+			leps = MIN(MAX(ldiff[0][0],ldiff[0][1]),
+					   MAX(ldiff[1][2],ldiff[1][3]));
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					if (i >> 1 == d || ldiff[d][i] <= leps)
+						abdiff[d][i] =
+							SQR(lab[d][y][x][1]-lab[d][y][x+dir[i]][1])
+							+ SQR(lab[d][y][x][2]-lab[d][y][x+dir[i]][2]);
+			abeps = MIN(MAX(abdiff[0][0],abdiff[0][1]),
+						MAX(abdiff[1][2],abdiff[1][3]));
+			for (d = 0; d < 2; d++)
+				for (i = 0; i < 4; i++)
+					if (ldiff[d][i] <= leps && abdiff[d][i] <= abeps)
+						homo[d][y][x]++;
+		}
+	}
+	/* Combine the most homogenous pixels for the final result */
+	for (y = top+3; y < top+TS-3 && y < height-3; y++) {
+		tr = y-top;
+		for (x = left+3; x < left+TS-3 && x < width-3; x++) {
+			tc = x-left;
+			for (d = 0; d < 2; d++) {
+				h = &homo[d][tr-1][tc-1];
+				hm[d] =
+					h[0] + h[1] + h[2] +
+					h[TS+0] + h[TS+1] + h[TS+2] +
+					h[TS+TS+0] + h[TS+TS+1] + h[TS+TS+2];
 			}
-			/* Combine the most homogenous pixels for the final result */
-			for (y = top+3; y < top+TS-3 && y < height-3; y++) {
-				tr = y-top;
-				for (x = left+3; x < left+TS-3 && x < width-3; x++) {
-					tc = x-left;
-					for (d = 0; d < 2; d++) {
-						h = &homo[d][tr-1][tc-1];
-						hm[d] =
-							h[0] + h[1] + h[2] +
-							h[TS+0] + h[TS+1] + h[TS+2] +
-							h[TS+TS+0] + h[TS+TS+1] + h[TS+TS+2];
-					}
-					val = y*width+x;
-					if (hm[0] != hm[1]) {
-						c = hm[1] > hm[0];
-						dst[0][val] = rgb[c][tr][tc][0];
-						dst[1][val] = rgb[c][tr][tc][1];
-						dst[2][val] = rgb[c][tr][tc][2];
-					} else {
-						dst[0][val] = (rgb[0][tr][tc][0] + rgb[1][tr][tc][0]) >> 1;
-						dst[1][val] = (rgb[0][tr][tc][1] + rgb[1][tr][tc][1]) >> 1;
-						dst[2][val] = (rgb[0][tr][tc][2] + rgb[1][tr][tc][2]) >> 1;
-					}
-				}
+			val = y*width+x;
+			if (hm[0] != hm[1]) {
+				c = hm[1] > hm[0];
+				dst[0][val] = rgb[c][tr][tc][0];
+				dst[1][val] = rgb[c][tr][tc][1];
+				dst[2][val] = rgb[c][tr][tc][2];
+			} else {
+				dst[0][val] = (rgb[0][tr][tc][0] + rgb[1][tr][tc][0]) >> 1;
+				dst[1][val] = (rgb[0][tr][tc][1] + rgb[1][tr][tc][1]) >> 1;
+				dst[2][val] = (rgb[0][tr][tc][2] + rgb[1][tr][tc][2]) >> 1;
 			}
-			/* Missing: Interpolation Artifact Reduction
-				repeat m times
-					R = median_8(R-G) + G		// median without center pixel (correct?)
-					B = median_8(B-G) + G
-					G = 1/2(median_4(G-R) + median_4(G-B) + R + B)
-				end
-			*/
 		}
 	}
-	free (buffer);
+	/* Missing: Interpolation Artifact Reduction
+		repeat m times
+			R = median_8(R-G) + G		// median without center pixel (correct?)
+			B = median_8(B-G) + G
+			G = 1/2(median_4(G-R) + median_4(G-B) + R + B)
+		end
+	*/
+}
+
+/*********************************************************************
+  iw_parallel_for() worker for img_bayer_ahd(): Process tile nr.
+*********************************************************************/
+static void RENAME(ahd_tile_worker) (int nr, void *data)
+{
+	ahdData *ahd = data;
+	char *buffer;
+
+	pthread_mutex_lock (&ahd->mutex);
+	if (ahd->buffer_cnt > 0)
+		buffer = ahd->buffer[--ahd->buffer_cnt];
+	else
+		buffer = iw_malloc ((sizeof(IVtype)*6+14)*TS*TS, "ahd_interpolate()");
+	pthread_mutex_unlock (&ahd->mutex);
+
+	RENAME(ahd_tile) ((IVtype*)ahd->src, ahd->dimg, ahd->pattern,
+					  (nr / ahd->tiles_x) * (TS-6), (nr % ahd->tiles_x) * (TS-6),
+					  buffer);
+
+	pthread_mutex_lock (&ahd->mutex);
+	if (ahd->buffer_cnt < IW_PARALLEL_MAX)
+		ahd->buffer[ahd->buffer_cnt++] = buffer;
+	else
+		free (buffer);
+	pthread_mutex_unlock (&ahd->mutex);
+}
+
+/*********************************************************************
+  Adaptive homogeneity-directed bayer decomposition ported from dcraw
+  (http://www.cybercom.net/~dcoffin/dcraw). Based on the work of
+  Keigo Hirakawa and Thomas Parks for the algorithm and Paul Lee for
+  the implementation in dcraw. The overlapping tiles are processed
+  in parallel, as every tile writes only its own inner part.
+*********************************************************************/
+static void RENAME(img_bayer_ahd) (IVtype *src, iwImage *dimg, iwImgBayerPattern pattern)
+{
+	ahdData ahd;
+	int i;
+
+	pthread_once (&RENAME(lab_once), RENAME(cielab_init));
+
+	RENAME(border_interpolate) (src, dimg, pattern);
+
+	ahd.src = src;
+	ahd.dimg = dimg;
+	ahd.pattern = pattern;
+	ahd.tiles_x = (dimg->width + TS-7) / (TS-6);
+	pthread_mutex_init (&ahd.mutex, NULL);
+	ahd.buffer_cnt = 0;
+
+	iw_parallel_for (ahd.tiles_x * ((dimg->height + TS-7) / (TS-6)),
+					 RENAME(ahd_tile_worker), &ahd);
+
+	for (i=0; i<ahd.buffer_cnt; i++)
+		free (ahd.buffer[i]);
+	pthread_mutex_destroy (&ahd.mutex);
 }
 #undef TS
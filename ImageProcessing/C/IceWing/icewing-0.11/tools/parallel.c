@@ -0,0 +1,159 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tools/parallel.h"
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+static int pool_threads = -1;		/* Threads to use, including the caller */
+static int pool_started = 0;		/* Number of started worker threads */
+static BOOL pool_busy = FALSE;		/* iw_parallel_for() is running */
+static unsigned int pool_gen = 0;	/* Incremented for every new job */
+
+/* The current job */
+static iwParallelFunc job_func;
+static void *job_data;
+static int job_cnt = 0, job_next = 0;
+static int job_running = 0;			/* Number of workers inside the job */
+
+/*********************************************************************
+  Return the number of threads (including the calling thread) used
+  by iw_parallel_for(). Defaults to the number of online CPUs.
+*********************************************************************/
+int iw_parallel_get_threads (void)
+{
+	if (pool_threads <= 0) {
+		long cpus = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		cpus = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+		pool_threads = CLAMP (cpus, 1, IW_PARALLEL_MAX);
+	}
+	return pool_threads;
+}
+
+/*********************************************************************
+  Set the number of threads (including the calling thread) used by
+  iw_parallel_for(). threads<=0: Use the number of online CPUs.
+*********************************************************************/
+void iw_parallel_set_threads (int threads)
+{
+	pthread_mutex_lock (&pool_mutex);
+	pool_threads = MIN (threads, IW_PARALLEL_MAX);
+	pthread_mutex_unlock (&pool_mutex);
+}
+
+/*********************************************************************
+  Main function of the worker threads. Wait for new jobs and process
+  job entries until all are done. Called with pool_mutex unlocked.
+*********************************************************************/
+static void* pool_worker (void *data)
+{
+	int index = (long)data;
+	unsigned int gen = 0;
+
+	pthread_mutex_lock (&pool_mutex);
+	while (TRUE) {
+		while (gen == pool_gen)
+			pthread_cond_wait (&pool_start, &pool_mutex);
+		gen = pool_gen;
+
+		/* Surplus workers after iw_parallel_set_threads() just sleep */
+		if (index >= pool_threads-1) continue;
+
+		job_running++;
+		while (job_next < job_cnt) {
+			int nr = job_next++;
+			pthread_mutex_unlock (&pool_mutex);
+			job_func (nr, job_data);
+			pthread_mutex_lock (&pool_mutex);
+		}
+		if (--job_running == 0)
+			pthread_cond_signal (&pool_done);
+	}
+	return NULL;
+}
+
+/*********************************************************************
+  Call func(nr,data) for nr = 0..cnt-1, distributed over a pool of
+  worker threads, and return after all calls have finished. The
+  calling thread takes part in the work. If the pool is already in
+  use by another thread (or by a nested call), all calls are
+  performed directly in the calling thread.
+*********************************************************************/
+void iw_parallel_for (int cnt, iwParallelFunc func, void *data)
+{
+	int nr, threads = iw_parallel_get_threads();
+
+	if (cnt <= 0) return;
+
+	pthread_mutex_lock (&pool_mutex);
+	if (cnt == 1 || threads <= 1 || pool_busy) {
+		pthread_mutex_unlock (&pool_mutex);
+		for (nr=0; nr<cnt; nr++)
+			func (nr, data);
+		return;
+	}
+	pool_busy = TRUE;
+
+	while (pool_started < threads-1) {
+		pthread_t thread;
+		pthread_attr_t attr;
+
+		pthread_attr_init (&attr);
+		pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create (&thread, &attr, pool_worker, (void*)(long)pool_started)) {
+			pthread_attr_destroy (&attr);
+			iw_warning ("Unable to start worker thread %d", pool_started);
+			break;
+		}
+		pthread_attr_destroy (&attr);
+		pool_started++;
+	}
+
+	job_func = func;
+	job_data = data;
+	job_cnt = cnt;
+	job_next = 0;
+	pool_gen++;
+	pthread_cond_broadcast (&pool_start);
+
+	while (job_next < job_cnt) {
+		nr = job_next++;
+		pthread_mutex_unlock (&pool_mutex);
+		func (nr, data);
+		pthread_mutex_lock (&pool_mutex);
+	}
+	while (job_running > 0)
+		pthread_cond_wait (&pool_done, &pool_mutex);
+
+	pool_busy = FALSE;
+	pthread_mutex_unlock (&pool_mutex);
+}
@@ -0,0 +1,64 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+#ifndef iw_parallel_H
+#define iw_parallel_H
+
+#include "tools/tools.h"
+
+/* Max. number of threads used by iw_parallel_for() */
+#define IW_PARALLEL_MAX		64
+
+/* Worker function for iw_parallel_for(), called for nr = 0..cnt-1 */
+typedef void (*iwParallelFunc) (int nr, void *data);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************************************************************
+  Return the number of threads (including the calling thread) used
+  by iw_parallel_for(). Defaults to the number of online CPUs.
+*********************************************************************/
+int iw_parallel_get_threads (void);
+
+/*********************************************************************
+  Set the number of threads (including the calling thread) used by
+  iw_parallel_for(). threads<=0: Use the number of online CPUs.
+*********************************************************************/
+void iw_parallel_set_threads (int threads);
+
+/*********************************************************************
+  Call func(nr,data) for nr = 0..cnt-1, distributed over a pool of
+  worker threads, and return after all calls have finished. The
+  calling thread takes part in the work. If the pool is already in
+  use by another thread (or by a nested call), all calls are
+  performed directly in the calling thread.
+*********************************************************************/
+void iw_parallel_for (int cnt, iwParallelFunc func, void *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* iw_parallel_H */
@@ -586,6 +586,44 @@ void iw_showtid (int level, const char *str)
 
 #ifdef IW_TIME_MESSURE
 
+#include <pthread.h>
+#include <time.h>
+
+/* Number of events per thread ring buffer, must be a power of 2 */
+#define TRACE_EVENTS	(1<<16)
+/* Maximal nesting depth of the scopes */
+#define TRACE_DEPTH		64
+
+#if defined(__GNUC__)
+#define TRACE_BARRIER()	__sync_synchronize()
+#else
+#define TRACE_BARRIER()
+#endif
+
+typedef struct {
+	guint64 start, dur;			/* Start time and duration in ns */
+	const char *name;
+	int depth;					/* Nesting depth of the scope */
+} traceEvent;
+
+typedef struct traceThread {
+	int tid;					/* Sequential thread number */
+	volatile unsigned int head;	/* Number of recorded events */
+	int depth;					/* Number of open scopes */
+	guint64 start[TRACE_DEPTH];	/* Start times of the open scopes */
+	const char *name[TRACE_DEPTH];
+	traceEvent *events;			/* Ring buffer, only written by the thread */
+	struct traceThread *next;
+} traceThread;
+
+static BOOL trace_enabled = FALSE;
+static char *trace_fname = NULL;
+static guint64 trace_start;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_key;
+static traceThread *trace_threads = NULL;
+static int trace_tid = 0;
+
 typedef struct {
 	struct timeval start;
 	struct tms start_user;
@@ -756,16 +794,255 @@ int iw_time_add (const char *name)
 	return timer_cnt-1;
 }
 
+/*********************************************************************
+  Return a monotonic time stamp in ns.
+*********************************************************************/
+static guint64 trace_now (void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (guint64)ts.tv_sec*1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday (&tv, NULL);
+	return (guint64)tv.tv_sec*1000000000 + (guint64)tv.tv_usec*1000;
+#endif
+}
+
+/*********************************************************************
+  Create the key for the thread specific trace buffers.
+*********************************************************************/
+static void trace_key_init (void)
+{
+	pthread_key_create (&trace_key, NULL);
+}
+
+/*********************************************************************
+  Return the trace buffer of the current thread, create it if needed.
+  Only the creation needs a lock, the recording itself is lock-free.
+*********************************************************************/
+static traceThread* trace_thread (void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	traceThread *t;
+
+	pthread_once (&once, trace_key_init);
+	if ((t = pthread_getspecific (trace_key)))
+		return t;
+
+	t = iw_malloc0 (sizeof(traceThread), "trace buffer");
+	t->events = iw_malloc (sizeof(traceEvent)*TRACE_EVENTS, "trace buffer");
+
+	pthread_mutex_lock (&trace_mutex);
+	t->tid = ++trace_tid;
+	t->next = trace_threads;
+	trace_threads = t;
+	pthread_mutex_unlock (&trace_mutex);
+
+	pthread_setspecific (trace_key, t);
+	return t;
+}
+
+/*********************************************************************
+  End the last open scope called name (name==NULL: the last open
+  scope) of the current thread and record it. Inner scopes, which
+  were not ended, are closed as well.
+*********************************************************************/
+static void trace_end (const char *name)
+{
+	traceThread *t = trace_thread();
+	guint64 now = trace_now();
+	traceEvent *ev;
+	int d;
+
+	if (t->depth > TRACE_DEPTH) {
+		/* Scope was not stored in begin() */
+		t->depth--;
+		return;
+	}
+	d = t->depth-1;
+	if (name)
+		while (d >= 0 && t->name[d] != name) d--;
+	if (d < 0) return;
+
+	while (t->depth > d) {
+		t->depth--;
+		ev = &t->events[t->head & (TRACE_EVENTS-1)];
+		ev->start = t->start[t->depth];
+		ev->dur = now - ev->start;
+		ev->name = t->name[t->depth];
+		ev->depth = t->depth;
+		/* Make the event visible to iw_time_trace_write() */
+		TRACE_BARRIER();
+		t->head++;
+	}
+}
+
+/*********************************************************************
+  Begin a new scope called name in the trace of the current thread.
+  Scopes can be nested. name must be valid until the trace is
+  written. Does nothing if no trace is recorded.
+*********************************************************************/
+void iw_time_scope_begin (const char *name)
+{
+	traceThread *t;
+
+	if (!trace_enabled) return;
+
+	t = trace_thread();
+	if (t->depth < TRACE_DEPTH) {
+		t->name[t->depth] = name;
+		t->start[t->depth] = trace_now();
+	}
+	t->depth++;
+}
+
+/*********************************************************************
+  End the last scope started with iw_time_scope_begin() in the
+  current thread.
+*********************************************************************/
+void iw_time_scope_end (void)
+{
+	if (trace_enabled)
+		trace_end (NULL);
+}
+
+/*********************************************************************
+  Start recording a trace of all timers and scopes. Every thread
+  records its last events lock-free into an own ring buffer.
+  fname: File for iw_time_trace_write(NULL), may be NULL.
+*********************************************************************/
+BOOL iw_time_trace_start (const char *fname)
+{
+	if (trace_fname) free (trace_fname);
+	trace_fname = fname ? strdup (fname) : NULL;
+	if (!trace_enabled) {
+		trace_start = trace_now();
+		trace_enabled = TRUE;
+	}
+	return TRUE;
+}
+
+/*********************************************************************
+  Write name as a JSON string to fp.
+*********************************************************************/
+static void trace_json_string (FILE *fp, const char *name)
+{
+	fputc ('"', fp);
+	for (; *name; name++) {
+		if (*name == '"' || *name == '\\')
+			fprintf (fp, "\\%c", *name);
+		else if ((unsigned char)*name < 0x20)
+			fprintf (fp, "\\u%04x", *name);
+		else
+			fputc (*name, fp);
+	}
+	fputc ('"', fp);
+}
+
+/*********************************************************************
+  Write the recorded trace to fname (NULL: use the file name from
+  iw_time_trace_start()). A file name ending in ".json" gives the
+  Chrome trace-event format (chrome://tracing), otherwise a binary
+  dump of the ring buffers is written:
+    "IWTRACE1", guint32 thread count
+    per thread: guint32 tid, guint32 event count
+      per event: guint64 start, guint64 duration (ns, relative to
+                 iw_time_trace_start()), guint16 depth,
+                 guint16 name length, name (without '\0')
+  All values are in host byte order. Return TRUE on success.
+*********************************************************************/
+BOOL iw_time_trace_write (const char *fname)
+{
+	traceThread *t;
+	BOOL json, first = TRUE;
+	unsigned int head, i, cnt;
+	int len;
+	FILE *fp;
+
+	if (!trace_enabled) return FALSE;
+	if (!fname) fname = trace_fname;
+	if (!fname) return FALSE;
+
+	len = strlen (fname);
+	json = len > 5 && !strcasecmp (fname+len-5, ".json");
+
+	if (!(fp = fopen (fname, "wb"))) {
+		iw_warning ("Unable to open trace file '%s'", fname);
+		return FALSE;
+	}
+
+	pthread_mutex_lock (&trace_mutex);
+	if (json) {
+		fprintf (fp, "{\"traceEvents\":[\n");
+	} else {
+		guint32 v = 0;
+		fwrite ("IWTRACE1", 1, 8, fp);
+		for (t = trace_threads; t; t = t->next) v++;
+		fwrite (&v, sizeof(v), 1, fp);
+	}
+	for (t = trace_threads; t; t = t->next) {
+		head = t->head;
+		TRACE_BARRIER();
+		cnt = MIN (head, TRACE_EVENTS);
+
+		if (json) {
+			fprintf (fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+					 "\"args\":{\"name\":\"Thread %d\"}}",
+					 first ? "" : ",\n", t->tid, t->tid);
+			first = FALSE;
+		} else {
+			guint32 v = t->tid;
+			fwrite (&v, sizeof(v), 1, fp);
+			v = cnt;
+			fwrite (&v, sizeof(v), 1, fp);
+		}
+		for (i = head-cnt; i != head; i++) {
+			traceEvent *ev = &t->events[i & (TRACE_EVENTS-1)];
+			guint64 start = ev->start - trace_start;
+
+			if (json) {
+				fprintf (fp, ",\n{\"name\":");
+				trace_json_string (fp, ev->name);
+				fprintf (fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+						 "\"ts\":%.3f,\"dur\":%.3f}",
+						 t->tid, start/1000.0, ev->dur/1000.0);
+			} else {
+				guint16 v;
+				fwrite (&start, sizeof(start), 1, fp);
+				fwrite (&ev->dur, sizeof(ev->dur), 1, fp);
+				v = ev->depth;
+				fwrite (&v, sizeof(v), 1, fp);
+				v = strlen (ev->name);
+				fwrite (&v, sizeof(v), 1, fp);
+				fwrite (ev->name, 1, v, fp);
+			}
+		}
+	}
+	pthread_mutex_unlock (&trace_mutex);
+
+	if (json)
+		fprintf (fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	if (fclose (fp)) {
+		iw_warning ("Unable to write trace file '%s'", fname);
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /*********************************************************************
   Start the timer nr (which was added before with iw_time_add()).
 *********************************************************************/
 void iw_time_start (int nr)
 {
-	if (!time_enabled) return;
-
 	iw_assert (nr>=0 && nr<timer_cnt,
 			   "index %d for start_time out of bounds", nr);
 
+	if (trace_enabled)
+		iw_time_scope_begin (timer[nr].name);
+	if (!time_enabled) return;
+
 	gettimeofday (&timer[nr].start, NULL);
 	times (&timer[nr].start_user);
 	timer[nr].start_ticks = time_rdtsc();
@@ -783,11 +1060,13 @@ long iw_time_stop (int nr, BOOL show)
 	unsigned long long ticks, ms_ticks;
 	long ms, ms_user, ms_sys;
 
-	if (!time_enabled) return -1;
-
 	iw_assert (nr>=0 && nr<timer_cnt,
 			   "index %d for start_time out of bounds", nr);
 
+	if (trace_enabled)
+		trace_end (timer[nr].name);
+	if (!time_enabled) return -1;
+
 	ticks = time_rdtsc();
 	gettimeofday (&real, NULL);
 	times (&user);
@@ -324,6 +324,34 @@ long iw_time_stop (int nr, BOOL show);
 *********************************************************************/
 void iw_time_show (void);
 
+/*********************************************************************
+  Start recording a trace of all timers and scopes. Every thread
+  records its last events lock-free into an own ring buffer.
+  fname: File for iw_time_trace_write(NULL), may be NULL.
+*********************************************************************/
+BOOL iw_time_trace_start (const char *fname);
+
+/*********************************************************************
+  Write the recorded trace to fname (NULL: use the file name from
+  iw_time_trace_start()). A file name ending in ".json" gives the
+  Chrome trace-event format (chrome://tracing), otherwise a binary
+  dump of the ring buffers is written. Return TRUE on success.
+*********************************************************************/
+BOOL iw_time_trace_write (const char *fname);
+
+/*********************************************************************
+  Begin a new scope called name in the trace of the current thread.
+  Scopes can be nested. name must be valid until the trace is
+  written. Does nothing if no trace is recorded.
+*********************************************************************/
+void iw_time_scope_begin (const char *name);
+
+/*********************************************************************
+  End the last scope started with iw_time_scope_begin() in the
+  current thread.
+*********************************************************************/
+void iw_time_scope_end (void);
+
 #else
 #   define iw_time_add_static(number,name)
 #   define iw_time_add_static2(number,name,number2,name2)
@@ -335,6 +363,10 @@ void iw_time_show (void);
 #   define iw_time_start(nr)
 #   define iw_time_stop(nr,show)	((void)0)
 #   define iw_time_show()
+#   define iw_time_trace_start(fname)	(FALSE)
+#   define iw_time_trace_write(fname)	(FALSE)
+#   define iw_time_scope_begin(name)
+#   define iw_time_scope_end()
 #endif
 
 /*********************************************************************
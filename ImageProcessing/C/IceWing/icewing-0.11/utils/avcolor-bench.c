@@ -0,0 +1,173 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Micro benchmark for the color conversion functions from
+ * avvideo/AVColor.c. Every format is converted with the plain C code
+ * and with the best SIMD version supported by the CPU, the results
+ * are compared, and the throughput is given out in MPixel/s.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "AVColor.h"
+
+#define BENCH_WIDTH		640
+#define BENCH_HEIGHT	480
+#define BENCH_RUNS		200
+
+typedef enum {
+	F_YUYV, F_UYVY, F_YUV420, F_YUV422P, F_RGB24, F_BGR24,
+	F_RGB32, F_BGR32, F_MONO12, F_CNT
+} benchFormat;
+
+static char *format_names[F_CNT] = {
+	"YUYV", "UYVY", "YUV420", "YUV422P", "RGB24", "BGR24",
+	"RGB32", "BGR32", "MONO12"
+};
+
+/* Size of the source data in bytes per pixel * 2 */
+static int format_size2[F_CNT] = {4, 4, 3, 4, 6, 6, 8, 8, 3};
+
+static void convert (benchFormat f, iwImage *img, guchar *src)
+{
+	switch (f) {
+		case F_YUYV:	av_color_yuyv (img, src, 0); break;
+		case F_UYVY:	av_color_yuyv (img, src, 1); break;
+		case F_YUV420:	av_color_yuv420 (img, src, 1); break;
+		case F_YUV422P:	av_color_yuv422P (img, src); break;
+		case F_RGB24:	av_color_rgb24 (img, src, 0, 1, 2); break;
+		case F_BGR24:	av_color_rgb24 (img, src, 2, 1, 0); break;
+		case F_RGB32:	av_color_rgb32 (img, src); break;
+		case F_BGR32:	av_color_bgr32 (img, src); break;
+		case F_MONO12:
+			av_color_mono12 (img->data[0], src, img->width*img->height);
+			break;
+		default:
+			break;
+	}
+}
+
+static void image_init (iwImage *img, int width, int height)
+{
+	int p;
+
+	memset (img, 0, sizeof(iwImage));
+	img->width = width;
+	img->height = height;
+	img->planes = 3;
+	img->type = IW_8U;
+	img->data = malloc (3 * sizeof(guchar*));
+	/* 2 bytes per pixel to allow 16 bit output for MONO12 */
+	for (p=0; p<3; p++)
+		img->data[p] = calloc (width*height, 2);
+}
+
+static double bench (benchFormat f, iwImage *img, guchar *src, int runs)
+{
+	struct timeval start, end;
+	double ms;
+	int i;
+
+	gettimeofday (&start, NULL);
+	for (i=0; i<runs; i++)
+		convert (f, img, src);
+	gettimeofday (&end, NULL);
+
+	ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+	if (ms <= 0) ms = 0.001;
+	return (double)img->width*img->height*runs / (ms*1000.0);
+}
+
+int main (int argc, char **argv)
+{
+	static char *simd_names[] = {"C", "SSE2", "SSSE3", "AVX2"};
+	int width = BENCH_WIDTH, height = BENCH_HEIGHT, runs = BENCH_RUNS;
+	iwImage ref, img;
+	avColorSimd simd;
+	guchar *src;
+	int f, p, size, errors = 0;
+
+	if (argc > 1 && (!strcmp (argv[1], "-h") || !strcmp (argv[1], "--help"))) {
+		fprintf (stderr, "Usage: %s [width height [runs]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) {
+		width = atoi (argv[1]);
+		height = atoi (argv[2]);
+	}
+	if (argc > 3)
+		runs = atoi (argv[3]);
+	if (width < 4 || height < 4 || runs < 1) {
+		fprintf (stderr, "Invalid size %dx%d or run count %d\n", width, height, runs);
+		return 1;
+	}
+	/* All converters need even sizes, YUV410 and YUV41P multiples of 4 */
+	width &= ~3;
+	height &= ~3;
+
+	size = width*height*4;
+	src = malloc (size);
+	srand (1);
+	for (p=0; p<size; p++)
+		src[p] = rand();
+
+	image_init (&ref, width, height);
+	image_init (&img, width, height);
+
+	simd = av_color_get_simd();
+	printf ("Image size %dx%d, %d runs, SIMD level %s\n\n",
+			width, height, runs, simd_names[simd]);
+	printf ("%-10s %12s %12s %8s\n", "Format", "C MPix/s",
+			simd_names[simd], "Speedup");
+
+	for (f=0; f<F_CNT; f++) {
+		double c_rate, simd_rate;
+		int bytes = width*height * (f == F_MONO12 ? 2 : 1);
+
+		av_color_set_simd (AV_COLOR_SCALAR);
+		convert (f, &ref, src);
+		c_rate = bench (f, &ref, src, runs);
+
+		av_color_set_simd (simd);
+		convert (f, &img, src);
+		simd_rate = bench (f, &img, src, runs);
+
+		for (p=0; p < (f == F_MONO12 ? 1 : 3); p++) {
+			if (memcmp (ref.data[p], img.data[p], bytes)) {
+				printf ("%s: Plane %d differs between C and %s!\n",
+						format_names[f], p, simd_names[simd]);
+				errors++;
+			}
+		}
+		printf ("%-10s %12.1f %12.1f %7.2fx   (%.1f MB/s input)\n",
+				format_names[f], c_rate, simd_rate, simd_rate/c_rate,
+				simd_rate*format_size2[f]/2);
+	}
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Micro benchmark for the bayer decomposition from tools/img_video.c.
+ * Every pattern is decoded with every method for 8 and 16 bit images,
+ * once with a single thread and once with the default thread count,
+ * and the throughput is given out in MPixel/s.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "tools/img_video.h"
+#include "tools/parallel.h"
+
+#define BENCH_WIDTH		640
+#define BENCH_HEIGHT	480
+#define BENCH_RUNS		20
+
+static char *pattern_names[] = {"RGGB", "BGGR", "GRBG", "GBRG"};
+static char *method_names[] = {
+	"none", "down", "neighbor", "bilinear", "hue", "edge", "ahd"
+};
+
+/*********************************************************************
+  tools.c calls gui_exit() on fatal errors.
+*********************************************************************/
+void gui_exit (int status)
+{
+	exit (status);
+}
+
+static void image_init (iwImage *img, int width, int height, iwType type)
+{
+	int p;
+
+	memset (img, 0, sizeof(iwImage));
+	img->width = width;
+	img->height = height;
+	img->planes = 3;
+	img->type = type;
+	img->data = malloc (3 * sizeof(guchar*));
+	for (p=0; p<3; p++)
+		img->data[p] = calloc (width*height, type == IW_16U ? 2 : 1);
+}
+
+static double bench (guchar *src, iwImage *img, iwImgBayer method,
+					 iwImgBayerPattern pattern, int runs)
+{
+	struct timeval start, end;
+	double ms;
+	int i;
+
+	iw_img_bayer_decode (src, img, method, pattern);
+
+	gettimeofday (&start, NULL);
+	for (i=0; i<runs; i++)
+		iw_img_bayer_decode (src, img, method, pattern);
+	gettimeofday (&end, NULL);
+
+	ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+	if (ms <= 0) ms = 0.001;
+	/* Throughput is given in source pixels */
+	if (method == IW_IMG_BAYER_DOWN)
+		return (double)img->width*img->height*4*runs / (ms*1000.0);
+	return (double)img->width*img->height*runs / (ms*1000.0);
+}
+
+int main (int argc, char **argv)
+{
+	int width = BENCH_WIDTH, height = BENCH_HEIGHT, runs = BENCH_RUNS;
+	int threads, t, p, m, i, size;
+	guchar *src;
+
+	if (argc > 1 && (!strcmp (argv[1], "-h") || !strcmp (argv[1], "--help"))) {
+		fprintf (stderr, "Usage: %s [width height [runs]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) {
+		width = atoi (argv[1]);
+		height = atoi (argv[2]);
+	}
+	if (argc > 3)
+		runs = atoi (argv[3]);
+	if (width < 8 || height < 8 || runs < 1) {
+		fprintf (stderr, "Invalid size %dx%d or run count %d\n", width, height, runs);
+		return 1;
+	}
+	width &= ~1;
+	height &= ~1;
+
+	size = width*height*2;
+	src = malloc (size);
+	srand (1);
+	for (i=0; i<size; i++)
+		src[i] = rand();
+
+	threads = iw_parallel_get_threads();
+	printf ("Image size %dx%d, %d runs, %d threads\n\n", width, height, runs, threads);
+	printf ("%-4s %-8s %-9s %12s %12s %8s\n", "Type", "Pattern", "Method",
+			"1T MPix/s", "MT MPix/s", "Speedup");
+
+	for (t=0; t<2; t++) {
+		for (p=IW_IMG_BAYER_RGGB; p<IW_IMG_BAYER_AUTO; p++) {
+			for (m=IW_IMG_BAYER_DOWN; m<=IW_IMG_BAYER_AHD; m++) {
+				double single, multi;
+				iwImage img;
+
+				if (m == IW_IMG_BAYER_DOWN)
+					image_init (&img, width/2, height/2, t ? IW_16U : IW_8U);
+				else
+					image_init (&img, width, height, t ? IW_16U : IW_8U);
+
+				iw_parallel_set_threads (1);
+				single = bench (src, &img, m, p, runs);
+				iw_parallel_set_threads (threads);
+				multi = bench (src, &img, m, p, runs);
+
+				printf ("%-4s %-8s %-9s %12.1f %12.1f %7.2fx\n",
+						t ? "16U" : "8U", pattern_names[p], method_names[m],
+						single, multi, multi/single);
+
+				for (i=0; i<3; i++)
+					free (img.data[i]);
+				free (img.data);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,222 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+/*
+ * Micro benchmark for the pixel classification from main/classify.c
+ * like it is used by the gsimple and backpro plugins. Every table
+ * based classifier is run with the plain C code and with the AVX2
+ * version (if supported by the CPU), the results are compared, and
+ * the throughput is given out in MPixel/s. The per pixel floating
+ * point rg conversion formerly used by backpro is measured as well.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "main/classify.h"
+
+#define BENCH_WIDTH		640
+#define BENCH_HEIGHT	480
+#define BENCH_RUNS		100
+
+#define LOOK_SIZE		(1<<24)
+#define HISTSIZE		64
+
+typedef struct {
+	char *name;
+	iwClassifyFeature feature;
+	int pix_cnt;
+} benchClassifier;
+
+/* YUV7: gsimple and backpro, UV8: skinclass, UV6_PAIR: skinclass/imgclass,
+   FUNC: the rg conversion formerly used by backpro */
+static benchClassifier classifiers[] = {
+	{"YUV7 table", IW_CLASSIFY_YUV7, 0},
+	{"YUV7 table", IW_CLASSIFY_YUV7, 1},
+	{"YUV7 table", IW_CLASSIFY_YUV7, 2},
+	{"UV8 table", IW_CLASSIFY_UV8, 0},
+	{"UV8 table", IW_CLASSIFY_UV8, 2},
+	{"UV6 pair table", IW_CLASSIFY_UV6_PAIR, 0},
+	{"UV6 pair table", IW_CLASSIFY_UV6_PAIR, 2},
+	{"rg float", IW_CLASSIFY_FUNC, 0},
+	{"rg float", IW_CLASSIFY_FUNC, 2},
+	{NULL, 0, 0}
+};
+
+/* Ratio histogram for the "rg float" classifier */
+static int ratio[HISTSIZE][HISTSIZE];
+
+/*********************************************************************
+  tools.c calls gui_exit() on fatal errors.
+*********************************************************************/
+void gui_exit (int status)
+{
+	exit (status);
+}
+
+/*********************************************************************
+  Simple replacements for the intermediate buffers from image.c.
+*********************************************************************/
+static void *buffer = NULL;
+void* iw_img_get_buffer (int size)
+{
+	static int buffer_size = 0;
+
+	if (size > buffer_size) {
+		buffer = realloc (buffer, size);
+		buffer_size = size;
+	}
+	return buffer;
+}
+
+void iw_img_release_buffer (void) {}
+
+/*********************************************************************
+  Classify one pixel like backpro did before using the YUV lookup
+  table: floating point rg conversion and ratio histogram lookup.
+*********************************************************************/
+static uchar bench_rg_classify (void *data, int y, int u, int v)
+{
+	float Y = 1.164*(y - 16), U = u - 128, V = v - 128;
+	int r, g, b, rgb;
+
+	r = (int)(Y+1.597*V+0.5);
+	g = (int)(Y-0.392*U-0.816*V+0.5);
+	b = (int)(Y+2.018*U+0.5);
+
+	r = r < 0 ? 0 : (r > 255 ? 255: r);
+	g = g < 0 ? 0 : (g > 255 ? 255: g);
+	b = b < 0 ? 0 : (b > 255 ? 255: b);
+
+	rgb = r+g+b;
+	if (rgb <= 0) return 0;
+	return ratio[r*(HISTSIZE-1)/rgb][g*(HISTSIZE-1)/rgb];
+}
+
+static double bench (iwImage *img, uchar *d, iwClassifyPara *para, int runs)
+{
+	struct timeval start, end;
+	double ms;
+	int i;
+
+	gettimeofday (&start, NULL);
+	for (i=0; i<runs; i++)
+		iw_classify (img, d, para);
+	gettimeofday (&end, NULL);
+
+	ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0;
+	if (ms <= 0) ms = 0.001;
+	return (double)img->width*img->height*runs / (ms*1000.0);
+}
+
+int main (int argc, char **argv)
+{
+	int width = BENCH_WIDTH, height = BENCH_HEIGHT, runs = BENCH_RUNS;
+	uchar *lookup, *ref, *d;
+	iwImage img;
+	BOOL avx2;
+	int c, i, x, y, errors = 0;
+
+	if (argc > 1 && (!strcmp (argv[1], "-h") || !strcmp (argv[1], "--help"))) {
+		fprintf (stderr, "Usage: %s [width height [runs]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) {
+		width = atoi (argv[1]);
+		height = atoi (argv[2]);
+	}
+	if (argc > 3)
+		runs = atoi (argv[3]);
+	if (width < 4 || height < 4 || runs < 1) {
+		fprintf (stderr, "Invalid size %dx%d or run count %d\n", width, height, runs);
+		return 1;
+	}
+
+	/* A smooth random image, so that the table accesses are
+	   as local as in a camera image */
+	memset (&img, 0, sizeof(iwImage));
+	img.width = width;
+	img.height = height;
+	img.planes = 3;
+	img.type = IW_8U;
+	img.data = malloc (3 * sizeof(guchar*));
+	srand (1);
+	for (i=0; i<3; i++) {
+		img.data[i] = malloc (width*height);
+		for (y=0; y<height; y++)
+			for (x=0; x<width; x++)
+				img.data[i][y*width+x] = ((x/8)*37 + (y/8)*53 + i*91 + (rand() & 15)) & 255;
+	}
+	ref = malloc (width*height);
+	d = malloc (width*height);
+
+	lookup = malloc (LOOK_SIZE);
+	for (i=0; i<LOOK_SIZE; i++)
+		lookup[i] = rand();
+	for (x=0; x<HISTSIZE; x++)
+		for (y=0; y<HISTSIZE; y++)
+			ratio[x][y] = rand() & 255;
+
+	avx2 = iw_classify_set_simd (TRUE);
+	printf ("Image size %dx%d, %d runs, AVX2 %s\n\n",
+			width, height, runs, avx2 ? "supported" : "not supported");
+	printf ("%-14s %5s %12s %12s %8s\n", "Classifier", "Avg", "C MPix/s",
+			"AVX2 MPix/s", "Speedup");
+
+	for (c=0; classifiers[c].name; c++) {
+		benchClassifier *bc = &classifiers[c];
+		iwClassifyPara para;
+		double c_rate, simd_rate;
+
+		iw_classify_init (&para);
+		para.feature = bc->feature;
+		para.lookup = lookup;
+		para.func = bench_rg_classify;
+		para.pix_cnt = bc->pix_cnt;
+
+		iw_classify_set_simd (FALSE);
+		iw_classify (&img, ref, &para);
+		c_rate = bench (&img, ref, &para, runs);
+
+		if (!avx2 || bc->feature == IW_CLASSIFY_FUNC || bc->feature == IW_CLASSIFY_UV6_PAIR) {
+			printf ("%-14s %5d %12.1f %12s\n", bc->name, bc->pix_cnt, c_rate, "-");
+			continue;
+		}
+
+		iw_classify_set_simd (TRUE);
+		iw_classify (&img, d, &para);
+		simd_rate = bench (&img, d, &para, runs);
+
+		if (memcmp (ref, d, width*height)) {
+			printf ("%s: Result differs between C and AVX2!\n", bc->name);
+			errors++;
+		}
+		printf ("%-14s %5d %12.1f %12.1f %7.2fx\n", bc->name, bc->pix_cnt,
+				c_rate, simd_rate, simd_rate/c_rate);
+	}
+
+	return errors ? 1 : 0;
+}
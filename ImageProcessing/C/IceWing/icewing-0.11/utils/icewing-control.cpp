@@ -45,7 +45,10 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <errno.h>
 
@@ -79,6 +82,33 @@ static const char *sock_name = NULL;
 	/* socket() file descriptor */
 static int sock_fd = 0;
 
+	/* Binary batch packets start with SOCK_BIN_MAGIC, followed by a
+	   request id and any number of commands (op, status, length, data),
+	   all numbers in network byte order. Must match remotectrl.cpp. */
+#define SOCK_BIN_MAGIC		"\0IWB"
+#define SOCK_BIN_MAGIC_LEN	4
+#define SOCK_BIN_HEAD_LEN	(SOCK_BIN_MAGIC_LEN+4)
+#define SOCK_BIN_COM_LEN	6
+#define BIN_OP_SET			1
+#define BIN_OP_GET			2
+#define BIN_OP_GET_DIFF		3
+#define BIN_OP_SUBSCRIBE	4
+#define BIN_OP_UNSUBSCRIBE	5
+#define BIN_OP_NOTIFY		6
+	/* Max number of commands in one batch packet */
+#define BATCH_MAX			256
+	/* Max number of batch packets sent without a reply */
+#define PIPE_MAX			8
+
+	/* Growing buffer for one binary packet */
+typedef struct {
+	char *data;
+	int len;
+	int size;
+} binPacket;
+	/* Request id of the last binary packet */
+static uint32_t bin_id = 0;
+
 #ifdef WITH_DACS
 static DACSentry_t *dacs_entry = NULL;
 	/* Default iceWing DACS name */
@@ -105,6 +135,8 @@ static char **titles = NULL;
 typedef enum {
 	COM_NONE,
 	COM_GET,
+	COM_DIFF,
+	COM_WATCH,
 	COM_SET,
 	COM_HELP,
 	COM_QUIT,
@@ -117,12 +149,18 @@ typedef struct {
 } COMMAND;
 
 static int com_get (char *arg);
+static int com_diff (char *arg);
+static int com_watch (char *arg);
 static int com_set (char *arg);
 static int com_help (char *arg);
 static int com_quit (char *arg);
 COMMAND commands[] = {
 	{"get", COM_GET, com_get,
 	 "Get all iceWing settings"},
+	{"diff", COM_DIFF, com_diff,
+	 "Get the iceWing settings changed since the last \"diff\""},
+	{"watch", COM_WATCH, com_watch,
+	 "Show changed iceWing settings every n ms until return is pressed, e.g.: \"watch 100\""},
 	{"set", COM_SET, com_set,
 	 "Set one widget in iceWing, e.g.: \"set GrabImage1.Wait Time = 94\""},
 	{"help", COM_HELP, com_help,
@@ -196,13 +234,18 @@ static ssize_t sock_recv (int s, char **buf, int *len)
 	size_t total = 0;
 	int cnt;
 
-	do {
-		cnt = recv (s, &packetlen, sizeof(packetlen), 0);
-	} while (cnt == -1 && errno == EINTR);
-	if (cnt < 0)
-		return -1;
-	else if (cnt != sizeof(packetlen))
-		return 0;
+	/* With pipelined requests the length can be split as well */
+	while (total < sizeof(packetlen)) {
+		do {
+			cnt = recv (s, (char*)&packetlen+total, sizeof(packetlen)-total, 0);
+		} while (cnt == -1 && errno == EINTR);
+		if (cnt < 0)
+			return -1;
+		else if (cnt == 0)
+			return 0;
+		total += cnt;
+	}
+	total = 0;
 	packetlen = ntohl (packetlen);
 
 	if (*len < (int)packetlen) {
@@ -220,6 +263,115 @@ static ssize_t sock_recv (int s, char **buf, int *len)
 	return total;
 }
 
+/*********************************************************************
+  Append len bytes from data to the packet p.
+*********************************************************************/
+static void bin_add_data (binPacket *p, const void *data, int len)
+{
+	if (p->len + len > p->size) {
+		p->size = p->len + len + 4000;
+		p->data = (char*)realloc (p->data, p->size);
+	}
+	memcpy (p->data + p->len, data, len);
+	p->len += len;
+}
+
+/*********************************************************************
+  Start a new binary packet p with the next request id.
+*********************************************************************/
+static void bin_start (binPacket *p)
+{
+	uint32_t id_n = htonl (++bin_id);
+
+	p->len = 0;
+	bin_add_data (p, SOCK_BIN_MAGIC, SOCK_BIN_MAGIC_LEN);
+	bin_add_data (p, &id_n, 4);
+}
+
+/*********************************************************************
+  Append command op with argument data (of length len) to packet p.
+*********************************************************************/
+static void bin_add (binPacket *p, int op, const char *data, int len)
+{
+	unsigned char head[SOCK_BIN_COM_LEN];
+	uint32_t len_n = htonl (len);
+
+	head[0] = op;
+	head[1] = 0;
+	memcpy (head+2, &len_n, 4);
+	bin_add_data (p, head, SOCK_BIN_COM_LEN);
+	if (len > 0)
+		bin_add_data (p, data, len);
+}
+
+/*********************************************************************
+  Receive one binary packet from the remotectrl plugin and print the
+  results of all commands in it. If failed is given and one of the
+  commands failed, *failed is set to TRUE.
+  Return: The request id of the packet (0 for change notifications)
+          or -1 on error.
+*********************************************************************/
+static long bin_recv_print (BOOL *failed)
+{
+	static char *buf = NULL;
+	static int buflen = 0;
+	char *pos, *end;
+	uint32_t id, len;
+	int cnt;
+
+	cnt = sock_recv (sock_fd, &buf, &buflen);
+	if (cnt <= 0) {
+		if (cnt < 0)
+			perror ("Unable to recv() reply");
+		else
+			fprintf (stderr, "Connection closed by iceWing.\n");
+		return -1;
+	}
+	if (cnt < SOCK_BIN_HEAD_LEN || memcmp (buf, SOCK_BIN_MAGIC, SOCK_BIN_MAGIC_LEN)) {
+		fprintf (stderr, "Received invalid reply.\n");
+		return -1;
+	}
+	memcpy (&id, buf+SOCK_BIN_MAGIC_LEN, 4);
+
+	pos = buf + SOCK_BIN_HEAD_LEN;
+	end = buf + cnt;
+	while (pos + SOCK_BIN_COM_LEN <= end) {
+		memcpy (&len, pos+2, 4);
+		len = ntohl (len);
+		if (len > (uint32_t)(end - pos - SOCK_BIN_COM_LEN)) {
+			fprintf (stderr, "Received truncated reply.\n");
+			return -1;
+		}
+		if (pos[1]) {
+			fprintf (stderr, "Command %d failed with status %d.\n", pos[0], pos[1]);
+			if (failed) *failed = TRUE;
+		} else if (len > 0)
+			fwrite (pos+SOCK_BIN_COM_LEN, 1, len, stdout);
+		pos += SOCK_BIN_COM_LEN + len;
+	}
+	fflush (stdout);
+	return (long)ntohl (id);
+}
+
+/*********************************************************************
+  Send packet p and print all replies until the reply for p arrived.
+  Return: TRUE on error.
+*********************************************************************/
+static BOOL bin_call (binPacket *p)
+{
+	BOOL failed = FALSE;
+	long id;
+
+	if (sock_send (sock_fd, p->data, p->len) != p->len) {
+		perror ("Unable to send() command");
+		return TRUE;
+	}
+	do {
+		id = bin_recv_print (&failed);
+	} while (id >= 0 && id != (long)bin_id);
+	return id < 0 || failed;
+}
+
 /*****************************************************************
    If arg is no valid argument for caller print an error message
    and return FALSE else return TRUE.
@@ -410,6 +562,222 @@ static int com_get (char *arg)
 	return com_get_do (TRUE);
 }
 
+/*****************************************************************
+  Get all widget settings, which changed since the last call.
+*****************************************************************/
+static int com_diff (char *arg)
+{
+	binPacket p = {NULL, 0, 0};
+	BOOL err;
+
+	if (!sock_fd) {
+		fprintf (stderr, "diff: Only available for socket communication.\n");
+		return 1;
+	}
+	bin_start (&p);
+	bin_add (&p, BIN_OP_GET_DIFF, NULL, 0);
+	err = bin_call (&p);
+	free (p.data);
+	return err;
+}
+
+/*****************************************************************
+  Show all changed widget settings until return is pressed.
+*****************************************************************/
+static int com_watch (char *arg)
+{
+	binPacket p = {NULL, 0, 0};
+	BOOL err;
+
+	if (!sock_fd) {
+		fprintf (stderr, "watch: Only available for socket communication.\n");
+		return 1;
+	}
+	bin_start (&p);
+	bin_add (&p, BIN_OP_SUBSCRIBE, arg, arg ? strlen(arg) : 0);
+	err = bin_call (&p);
+
+	if (!err) {
+		fprintf (stderr, "Watching for changes, press return to stop...\n");
+		while (1) {
+			fd_set fds;
+			FD_ZERO (&fds);
+			FD_SET (0, &fds);
+			FD_SET (sock_fd, &fds);
+			if (select (sock_fd+1, &fds, NULL, NULL, NULL) < 0) {
+				if (errno == EINTR) continue;
+				perror ("watch: select()");
+				err = TRUE;
+				break;
+			}
+			if (FD_ISSET (sock_fd, &fds) && bin_recv_print (NULL) < 0) {
+				err = TRUE;
+				break;
+			}
+			if (FD_ISSET (0, &fds)) {
+				char line[200];
+				if (!fgets (line, sizeof(line), stdin))
+					clearerr (stdin);
+				break;
+			}
+		}
+		if (!err) {
+			bin_start (&p);
+			bin_add (&p, BIN_OP_UNSUBSCRIBE, NULL, 0);
+			err = bin_call (&p);
+		}
+	}
+	free (p.data);
+	return err;
+}
+
+/*****************************************************************
+  Read one line from fd into *line. Data following the line is
+  kept in buf.
+  Return: FALSE on end of file.
+*****************************************************************/
+typedef struct {
+	char *data;
+	int len;
+	int size;
+	BOOL eof;
+} lineBuffer;
+static BOOL batch_read_line (int fd, lineBuffer *buf, char **line)
+{
+	char *end;
+	int cnt;
+
+	while (!(end = (char*)memchr (buf->data, '\n', buf->len))) {
+		if (buf->eof) {
+			if (buf->len == 0)
+				return FALSE;
+			end = buf->data + buf->len;
+			break;
+		}
+		if (buf->len + 4000 > buf->size) {
+			buf->size = buf->len + 8000;
+			buf->data = (char*)realloc (buf->data, buf->size);
+		}
+		do {
+			cnt = read (fd, buf->data + buf->len, buf->size - buf->len - 1);
+		} while (cnt < 0 && errno == EINTR);
+		if (cnt <= 0)
+			buf->eof = TRUE;
+		else
+			buf->len += cnt;
+	}
+	*line = (char*)malloc (end - buf->data + 1);
+	memcpy (*line, buf->data, end - buf->data);
+	(*line)[end - buf->data] = '\0';
+
+	if (end < buf->data + buf->len) end++;
+	buf->len -= end - buf->data;
+	memmove (buf->data, end, buf->len);
+	return TRUE;
+}
+
+/*****************************************************************
+  Return TRUE if a complete line can be read from fd or buf without
+  blocking.
+*****************************************************************/
+static BOOL batch_line_pending (int fd, lineBuffer *buf)
+{
+	struct timeval timeout = {0, 0};
+	fd_set fds;
+
+	if (buf->eof || memchr (buf->data, '\n', buf->len))
+		return TRUE;
+	FD_ZERO (&fds);
+	FD_SET (fd, &fds);
+	return select (fd+1, &fds, NULL, NULL, &timeout) > 0;
+}
+
+/*****************************************************************
+  Execute the commands "set <setting>", "get [title]", and "diff"
+  read from file name ("-": stdin). Consecutive commands are sent
+  in one packet and up to PIPE_MAX packets are sent before waiting
+  for the replies.
+  Return: TRUE on error.
+*****************************************************************/
+static BOOL batch_run (const char *name)
+{
+	binPacket p = {NULL, 0, 0};
+	lineBuffer buf = {NULL, 0, 0, FALSE};
+	uint32_t acked = bin_id;
+	int fd = 0, cnt = 0, lnr = 0;
+	BOOL err = FALSE, failed = FALSE, more = TRUE;
+	char *line, *str;
+
+	if (!sock_fd) {
+		fprintf (stderr, "batch: Only available for socket communication.\n");
+		return TRUE;
+	}
+	if (strcmp (name, "-") && (fd = open (name, O_RDONLY)) < 0) {
+		perror ("batch: Unable to open command file");
+		return TRUE;
+	}
+	buf.size = 8000;
+	buf.data = (char*)malloc (buf.size);
+
+	while (more && !err) {
+		more = batch_read_line (fd, &buf, &line);
+		if (more) {
+			lnr++;
+			for (str = line; whitespace (*str); str++) /* empty */;
+			if (!cnt)
+				bin_start (&p);
+			if (!strncmp (str, "set", 3) && whitespace (str[3])) {
+				for (str += 4; whitespace (*str); str++) /* empty */;
+				bin_add (&p, BIN_OP_SET, str, strlen(str));
+				cnt++;
+			} else if (!strncmp (str, "get", 3) && (!str[3] || whitespace (str[3]))) {
+				for (str += 3; whitespace (*str); str++) /* empty */;
+				if (*str == '"') {
+					str++;
+					if (*str && str[strlen(str)-1] == '"')
+						str[strlen(str)-1] = '\0';
+				}
+				bin_add (&p, BIN_OP_GET, str, strlen(str));
+				cnt++;
+			} else if (!strcmp (str, "diff")) {
+				bin_add (&p, BIN_OP_GET_DIFF, NULL, 0);
+				cnt++;
+			} else if (*str && *str != '#') {
+				fprintf (stderr, "batch: Unknown command in line %d: %s\n", lnr, str);
+			}
+			free (line);
+		}
+
+		/* Send the packet if it is full or no further command is waiting */
+		if (cnt > 0 && (!more || cnt >= BATCH_MAX || !batch_line_pending (fd, &buf))) {
+			if (sock_send (sock_fd, p.data, p.len) != p.len) {
+				perror ("batch: Unable to send() commands");
+				err = TRUE;
+			}
+			cnt = 0;
+			while (!err && bin_id - acked >= PIPE_MAX) {
+				if (bin_recv_print (&failed) < 0)
+					err = TRUE;
+				else
+					acked++;
+			}
+		}
+	}
+	while (!err && acked != bin_id) {
+		long id = bin_recv_print (&failed);
+		if (id < 0)
+			err = TRUE;
+		else if (id > 0)
+			acked++;
+	}
+
+	if (fd)
+		close (fd);
+	free (buf.data);
+	free (p.data);
+	return err || failed;
+}
+
 /*****************************************************************
   Set widgets of icewing to new values.
 *****************************************************************/
@@ -665,7 +1033,7 @@ static int execute_line (char *line)
 
 static void help (void)
 {
-	fprintf (stderr, "\n"PRGNAME" V0.3 (c) 2005-2009 by Frank Loemker\n"
+	fprintf (stderr, "\n"PRGNAME" V0.4 (c) 2005-2009 by Frank Loemker\n"
 			 "Usage: "PRGNAME" [-p [host:port]]"
 #ifdef WITH_DACS
 			 " [-n [name]]"
@@ -674,6 +1042,7 @@ static void help (void)
 			 " [-x [xcf-server]]"
 #endif
 			 " [-g] [-s config-setting]\n"
+			 "                      [-b [file|-]] [-w [ms]]\n"
 			 "-p    Socket communication to the icewing remotectrl plugin,\n"
 			 "      default: %s:%d\n",
 			 SOCK_NAME, SOCK_PORT);
@@ -690,8 +1059,12 @@ static void help (void)
 			 "-g    Call the 'getSettings(void)' function to get all current widget settings\n"
 			 "-s    Call the 'control(char)' function to set the specified widgets to the\n"
 			 "      specified values\n"
+			 "-b    Read commands ('set <setting>', 'get [title]', or 'diff') from a file\n"
+			 "      or stdin (default) and send them batched and pipelined, socket only\n"
+			 "-w    Print all widget changes, checked every ms milliseconds, until return\n"
+			 "      is pressed, socket only\n"
 			 "\n"
-			 "If neither any -g nor any -s argument is given, an interactive shell is\n"
+			 "If neither any -g, -s, -b, nor -w argument is given, an interactive shell is\n"
 			 "started.");
 #if defined(WITH_DACS) || defined(WITH_XCF)
 	fprintf (stderr, " If neither -p, -n, nor -x is given, '-p' is used for communication.\n");
@@ -717,6 +1090,8 @@ int main (int argc, char **argv)
 	signal (SIGTERM, stop_it_sig);
 
 	int getarg = FALSE;
+	char *batcharg = NULL, *watcharg = NULL;
+	BOOL watch = FALSE;
 	char *setarg = NULL;
 	int setlen = 0;
 
@@ -772,6 +1147,24 @@ int main (int argc, char **argv)
 					interactive = FALSE;
 					n++;
 					break;
+				case 'B':
+					if (n < argc-1 && !strcmp (argv[n+1], "-"))
+						optarg = argv[n+1];
+					if (optarg) {
+						batcharg = optarg;
+						n++;
+					} else
+						batcharg = (char*)"-";
+					interactive = FALSE;
+					break;
+				case 'W':
+					if (optarg) {
+						watcharg = optarg;
+						n++;
+					}
+					watch = TRUE;
+					interactive = FALSE;
+					break;
 				case 'H':
 					help();
 				default:
@@ -866,6 +1259,14 @@ int main (int argc, char **argv)
 		if (com_get (NULL) != 0)
 			exit (1);
 	}
+	if (batcharg) {
+		if (batch_run (batcharg))
+			exit (1);
+	}
+	if (watch) {
+		if (com_watch (watcharg) != 0)
+			exit (1);
+	}
 	if (!interactive) exit (0);
 
 	/* Allow conditional parsing of the ~/.inputrc file. */
@@ -0,0 +1,151 @@
+/* -*- mode: C; tab-width: 4; c-basic-offset: 4; -*- */
+
+/*
+ * Copyright (C) 1999-2009
+ * Applied Computer Science, Faculty of Technology, Bielefeld University, Germany
+ *
+ * This file is part of iceWing, a graphical plugin shell.
+ *
+ * iceWing is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * iceWing is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ */
+
+
+/*
+ * Micro benchmark for the batched Kalman filters from
+ * plugins/tracking/kalman.c like they are used by the tracking plugin.
+ * All trackers are stepped with the plain C code and with the SSE2
+ * version (if supported by the CPU), the results are compared, and the
+ * time for one time and measurement update of all trackers is given out.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+#include "plugins/tracking/kalman.h"
+
+#define BENCH_TRACKER	500
+#define BENCH_RUNS		10000
+
+/*********************************************************************
+  tools.c calls gui_exit() on fatal errors.
+*********************************************************************/
+void gui_exit (int status)
+{
+	exit (status);
+}
+
+/*********************************************************************
+  Initialize all size trackers of kalman with the same random start
+  positions, velocities, and noise values.
+*********************************************************************/
+static void bench_init (kalman_t *kalman, int size)
+{
+	int i;
+
+	srand (1);
+	for (i=0; i<size; i++) {
+		double x = rand()%640, y = rand()%480;
+		kalman_init_handtrack (kalman, i, x, y,
+							   (rand()%100-50)/400.0, (rand()%100-50)/400.0, 0.0, 0.0,
+							   0.0000001, 50.0, 100.0, 40.0);
+		kalman_set_measurement (kalman, i, x, y);
+		kalman->active[i] = TRUE;
+	}
+	kalman_measurementUpdate (kalman);
+}
+
+/*********************************************************************
+  Do runs time and measurement updates of all trackers.
+  Return: Time for one update of all trackers in microseconds.
+*********************************************************************/
+static double bench (kalman_t *kalman, int size, int runs)
+{
+	struct timeval start, end;
+	double us;
+	int r, i;
+
+	gettimeofday (&start, NULL);
+	for (r=0; r<runs; r++) {
+		kalman_timeUpdate (kalman);
+		for (i=0; i<size; i++)
+			kalman_set_measurement (kalman, i,
+									KALMAN_ELEM(kalman->x_predict, i, 0) + (r&7) - 3.5,
+									KALMAN_ELEM(kalman->x_predict, i, 1) - (r&3) + 1.5);
+		kalman_measurementUpdate (kalman);
+	}
+	gettimeofday (&end, NULL);
+
+	us = (end.tv_sec - start.tv_sec) * 1000000.0 + (end.tv_usec - start.tv_usec);
+	return us / runs;
+}
+
+int main (int argc, char **argv)
+{
+	int size = BENCH_TRACKER, runs = BENCH_RUNS;
+	kalman_t *ref, *kal;
+	double c_time, simd_time, maxdiff = 0;
+	BOOL sse2;
+	int i, j;
+
+	if (argc > 1 && (!strcmp (argv[1], "-h") || !strcmp (argv[1], "--help"))) {
+		fprintf (stderr, "Usage: %s [trackers [runs]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 1)
+		size = atoi (argv[1]);
+	if (argc > 2)
+		runs = atoi (argv[2]);
+	if (size < 1 || runs < 1) {
+		fprintf (stderr, "Invalid tracker count %d or run count %d\n", size, runs);
+		return 1;
+	}
+
+	ref = kalman_create (size);
+	kal = kalman_create (size);
+
+	sse2 = kalman_set_simd (TRUE);
+	printf ("%d trackers, %d runs, SSE2 %s\n\n",
+			size, runs, sse2 ? "supported" : "not supported");
+
+	kalman_set_simd (FALSE);
+	bench_init (ref, size);
+	c_time = bench (ref, size, runs);
+	printf ("C:    %10.2f us per update of all trackers\n", c_time);
+
+	if (!sse2) return 0;
+
+	kalman_set_simd (TRUE);
+	bench_init (kal, size);
+	simd_time = bench (kal, size, runs);
+	printf ("SSE2: %10.2f us per update of all trackers, %.2fx\n",
+			simd_time, c_time/simd_time);
+
+	for (i=0; i<size; i++) {
+		for (j=0; j<KALMAN_DIM_X; j++) {
+			double a = KALMAN_ELEM(ref->x_correct, i, j);
+			double b = KALMAN_ELEM(kal->x_correct, i, j);
+			if (fabs (a-b) > maxdiff) maxdiff = fabs (a-b);
+		}
+	}
+	if (maxdiff > 1e-6) {
+		printf ("Result differs between C and SSE2: %g\n", maxdiff);
+		return 1;
+	}
+	return 0;
+}